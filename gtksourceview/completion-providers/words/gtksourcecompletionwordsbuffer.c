@@ -24,13 +24,11 @@
 #include "gtksourcecompletionwordsbuffer-private.h"
 #include "gtksourcecompletionwordsutils-private.h"
 #include "gtksourceview/gtksourceregion.h"
+#include "gtksourceview/gtksourcescheduler-private.h"
 
 /* Timeout in seconds */
 #define INITIATE_SCAN_TIMEOUT 5
 
-/* Timeout in milliseconds */
-#define BATCH_SCAN_TIMEOUT 10
-
 typedef struct
 {
 	GtkSourceCompletionWordsProposal *proposal;
@@ -45,7 +43,7 @@ struct _GtkSourceCompletionWordsBuffer
 	GtkTextBuffer *buffer;
 
 	GtkSourceRegion *scan_region;
-	gulong batch_scan_id;
+	gsize batch_scan_id;
 	gulong initiate_scan_id;
 
 	guint scan_batch_size;
@@ -111,11 +109,7 @@ gtk_source_completion_words_buffer_dispose (GObject *object)
 		buffer->words = NULL;
 	}
 
-	if (buffer->batch_scan_id != 0)
-	{
-		g_source_remove (buffer->batch_scan_id);
-		buffer->batch_scan_id = 0;
-	}
+	gtk_source_scheduler_clear (&buffer->batch_scan_id);
 
 	if (buffer->initiate_scan_id != 0)
 	{
@@ -299,7 +293,7 @@ scan_region (GtkSourceCompletionWordsBuffer *buffer,
 }
 
 static gboolean
-idle_scan_regions (GtkSourceCompletionWordsBuffer *buffer)
+scan_batch (GtkSourceCompletionWordsBuffer *buffer)
 {
 	guint nb_remaining_lines = buffer->scan_batch_size;
 	GtkSourceRegionIter region_iter;
@@ -343,6 +337,23 @@ idle_scan_regions (GtkSourceCompletionWordsBuffer *buffer)
 	return G_SOURCE_CONTINUE;
 }
 
+static gboolean
+idle_scan_regions (gint64   deadline,
+                   gpointer user_data)
+{
+	GtkSourceCompletionWordsBuffer *buffer = user_data;
+
+	while (scan_batch (buffer))
+	{
+		if (g_get_monotonic_time () >= deadline)
+		{
+			return G_SOURCE_CONTINUE;
+		}
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
 static gboolean
 initiate_scan (GtkSourceCompletionWordsBuffer *buffer)
 {
@@ -350,11 +361,11 @@ initiate_scan (GtkSourceCompletionWordsBuffer *buffer)
 
 	/* Add the batch scanner */
 	buffer->batch_scan_id =
-		g_timeout_add_full (G_PRIORITY_LOW,
-		                    BATCH_SCAN_TIMEOUT,
-		                    (GSourceFunc)idle_scan_regions,
-		                    buffer,
-		                    NULL);
+		_gtk_source_scheduler_add_for_owner (buffer->buffer,
+		                                     GTK_SOURCE_SCHEDULER_TASK_WORDS,
+		                                     idle_scan_regions,
+		                                     buffer,
+		                                     NULL);
 
 	return G_SOURCE_REMOVE;
 }
@@ -615,11 +626,7 @@ connect_buffer (GtkSourceCompletionWordsBuffer *buffer)
 static void
 on_library_lock (GtkSourceCompletionWordsBuffer *buffer)
 {
-	if (buffer->batch_scan_id != 0)
-	{
-		g_source_remove (buffer->batch_scan_id);
-		buffer->batch_scan_id = 0;
-	}
+	gtk_source_scheduler_clear (&buffer->batch_scan_id);
 
 	if (buffer->initiate_scan_id != 0)
 	{
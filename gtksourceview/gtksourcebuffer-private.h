@@ -53,6 +53,8 @@ GTK_SOURCE_INTERNAL
 void                      _gtk_source_buffer_add_search_context          (GtkSourceBuffer        *buffer,
                                                                           GtkSourceSearchContext *search_context);
 GTK_SOURCE_INTERNAL
+const GList              *_gtk_source_buffer_get_search_contexts         (GtkSourceBuffer        *buffer);
+GTK_SOURCE_INTERNAL
 void                      _gtk_source_buffer_set_as_invalid_character    (GtkSourceBuffer        *buffer,
                                                                           const GtkTextIter      *start,
                                                                           const GtkTextIter      *end);
@@ -76,10 +78,20 @@ GtkTextTag               *_gtk_source_buffer_get_snippet_focus_tag       (GtkSou
 GTK_SOURCE_INTERNAL
 gint64                    _gtk_source_buffer_get_insertion_count         (GtkSourceBuffer        *buffer);
 GTK_SOURCE_INTERNAL
+GtkSourceEngine          *_gtk_source_buffer_get_highlight_engine        (GtkSourceBuffer        *buffer);
+GTK_SOURCE_INTERNAL
 void                      _gtk_source_buffer_block_cursor_moved          (GtkSourceBuffer        *buffer);
 GTK_SOURCE_INTERNAL
 void                      _gtk_source_buffer_unblock_cursor_moved        (GtkSourceBuffer        *buffer);
 GTK_SOURCE_INTERNAL
+void                      _gtk_source_buffer_hold_changes                (GtkSourceBuffer        *buffer);
+GTK_SOURCE_INTERNAL
+void                      _gtk_source_buffer_release_changes             (GtkSourceBuffer        *buffer);
+GTK_SOURCE_INTERNAL
+void                      _gtk_source_buffer_flush_held_changes          (GtkSourceBuffer        *buffer);
+GTK_SOURCE_INTERNAL
+gboolean                  _gtk_source_buffer_get_changes_held            (GtkSourceBuffer        *buffer);
+GTK_SOURCE_INTERNAL
 void                      _gtk_source_buffer_begin_loading               (GtkSourceBuffer        *buffer);
 GTK_SOURCE_INTERNAL
 void                      _gtk_source_buffer_end_loading                 (GtkSourceBuffer        *buffer);
@@ -30,6 +30,7 @@
 #include <stdlib.h>
 #include <gtk/gtk.h>
 
+#include "gtksourcebufferinternal-private.h"
 #include "gtksourcelanguage.h"
 #include "gtksourcelanguage-private.h"
 #include "gtksource-marshal.h"
@@ -85,21 +86,21 @@
  * And the [signal@GtkSource.Buffer::highlight-updated] signal permits to be notified
  * when a context class region changes.
  *
- * Each context class has also an associated [class@Gtk.TextTag] with the name
- * `gtksourceview:context-classes:<name>`. For example to
+ * The context classes are stored by the highlighting engine, and the
+ * functions above do not need any [class@Gtk.TextTag]. A context class can
+ * also be rendered as a [class@Gtk.TextTag] named
+ * `gtksourceview:context-classes:<name>`, but only once it has been
+ * requested with [method@Buffer.ensure_context_class_tag]. For example to
  * retrieve the [class@Gtk.TextTag] for the string context class, one can write:
  * ```c
- * GtkTextTagTable *tag_table;
  * GtkTextTag *tag;
  *
- * tag_table = gtk_text_buffer_get_tag_table (buffer);
- * tag = gtk_text_tag_table_lookup (tag_table, "gtksourceview:context-classes:string");
+ * tag = gtk_source_buffer_ensure_context_class_tag (buffer, "string");
  * ```
  * ```python
  * buffer = GtkSource.Buffer()
  *
- * tag_table = buffer.get_tag_table()
- * tag = tag_table.lookup(name="gtksourceview:context-classes:string")
+ * tag = buffer.ensure_context_class_tag("string")
  * ```
  *
  * The tag must be used for read-only purposes.
@@ -126,6 +127,7 @@ enum
 {
 	CURSOR_MOVED,
 	HIGHLIGHT_UPDATED,
+	HIGHLIGHT_DEGRADED,
 	SOURCE_MARK_UPDATED,
 	UNDO,
 	REDO,
@@ -141,10 +143,15 @@ enum
 	PROP_IMPLICIT_TRAILING_NEWLINE,
 	PROP_LANGUAGE,
 	PROP_LOADING,
+	PROP_MAX_HIGHLIGHT_LINE_LENGTH,
+	PROP_MAX_HIGHLIGHT_LINE_TIME,
 	PROP_STYLE_SCHEME,
 	N_PROPERTIES
 };
 
+/* The time in milliseconds allowed to analyze a line, by default. */
+#define DEFAULT_MAX_HIGHLIGHT_LINE_TIME 250
+
 typedef struct
 {
 	GtkTextTag *bracket_match_tag;
@@ -166,15 +173,31 @@ typedef struct
 
 	GList *search_contexts;
 
+	/* Context classes rendered as a tag: name -> GtkTextTag */
+	GHashTable *context_class_tags;
+
 	GtkTextTag *invalid_char_tag;
 
 	gint64 insertion_count;
 
 	guint cursor_moved_block_count;
 
+	/* While the changes are held, the union of the modified text in
+	 * offsets of the current contents, and the difference of length
+	 * with the text it replaced.
+	 */
+	guint hold_changes_count;
+	gint held_start;
+	gint held_end;
+	gint held_delta;
+
 	int loading_count;
 
+	guint max_highlight_line_length;
+	guint max_highlight_line_time;
+
 	guint has_draw_spaces_tag : 1;
+	guint has_held_changes : 1;
 	guint highlight_syntax : 1;
 	guint highlight_brackets : 1;
 	guint implicit_trailing_newline : 1;
@@ -215,6 +238,7 @@ static void gtk_source_buffer_real_mark_deleted        (GtkTextBuffer      *buff
 static void gtk_source_buffer_real_highlight_updated   (GtkSourceBuffer    *buffer,
                                                         GtkTextIter        *start,
                                                         GtkTextIter        *end);
+static void update_context_class_tags                  (GtkSourceBuffer    *buffer);
 
 static void
 gtk_source_buffer_check_tag_for_spaces (GtkSourceBuffer *buffer,
@@ -334,6 +358,40 @@ gtk_source_buffer_class_init (GtkSourceBufferClass *klass)
 				      G_PARAM_READWRITE |
 				      G_PARAM_STATIC_STRINGS);
 
+	/**
+	 * GtkSourceBuffer:max-highlight-line-length:
+	 *
+	 * The number of bytes of a line analyzed at most by the syntax
+	 * highlighting, or 0 for no limit. See
+	 * [method@Buffer.set_max_highlight_line_length].
+	 *
+	 * Since: 5.22
+	 */
+	buffer_properties[PROP_MAX_HIGHLIGHT_LINE_LENGTH] =
+		g_param_spec_uint ("max-highlight-line-length",
+		                   "Max Highlight Line Length",
+		                   "The number of bytes of a line analyzed at most by the syntax highlighting",
+		                   0, G_MAXUINT, 0,
+		                   G_PARAM_READWRITE |
+		                   G_PARAM_STATIC_STRINGS);
+
+	/**
+	 * GtkSourceBuffer:max-highlight-line-time:
+	 *
+	 * The time in milliseconds that the syntax highlighting spends at
+	 * most analyzing a line, or 0 for no limit. See
+	 * [method@Buffer.set_max_highlight_line_time].
+	 *
+	 * Since: 5.22
+	 */
+	buffer_properties[PROP_MAX_HIGHLIGHT_LINE_TIME] =
+		g_param_spec_uint ("max-highlight-line-time",
+		                   "Max Highlight Line Time",
+		                   "The time in milliseconds spent at most analyzing a line",
+		                   0, G_MAXUINT, DEFAULT_MAX_HIGHLIGHT_LINE_TIME,
+		                   G_PARAM_READWRITE |
+		                   G_PARAM_STATIC_STRINGS);
+
 	buffer_properties[PROP_LANGUAGE] =
 		g_param_spec_object ("language",
 				     "Language",
@@ -431,6 +489,36 @@ gtk_source_buffer_class_init (GtkSourceBufferClass *klass)
 	                            G_TYPE_FROM_CLASS (klass),
 	                            _gtk_source_marshal_VOID__BOXED_BOXEDv);
 
+	/**
+	 * GtkSourceBuffer::highlight-degraded:
+	 * @buffer: the buffer that received the signal
+	 * @start: the start of the line
+	 * @end: the end of the line
+	 *
+	 * The ::highlight-degraded signal is emitted when only the beginning
+	 * of a line could be analyzed by the syntax highlighting, because the
+	 * line is longer than [property@Buffer:max-highlight-line-length] or
+	 * took longer than [property@Buffer:max-highlight-line-time] to
+	 * analyze. The rest of the line is highlighted
+	 * as the context reached at that point, while the other lines of the
+	 * @buffer are still fully highlighted.
+	 *
+	 * Since: 5.22
+	 */
+	buffer_signals[HIGHLIGHT_DEGRADED] =
+	    g_signal_new_class_handler ("highlight-degraded",
+	                                G_OBJECT_CLASS_TYPE (object_class),
+	                                G_SIGNAL_RUN_LAST,
+	                                NULL, NULL, NULL,
+	                                _gtk_source_marshal_VOID__BOXED_BOXED,
+	                                G_TYPE_NONE,
+	                                2,
+	                                GTK_TYPE_TEXT_ITER | G_SIGNAL_TYPE_STATIC_SCOPE,
+	                                GTK_TYPE_TEXT_ITER | G_SIGNAL_TYPE_STATIC_SCOPE);
+	g_signal_set_va_marshaller (buffer_signals[HIGHLIGHT_DEGRADED],
+	                            G_TYPE_FROM_CLASS (klass),
+	                            _gtk_source_marshal_VOID__BOXED_BOXEDv);
+
 	/**
 	 * GtkSourceBuffer::source-mark-updated:
 	 * @buffer: the buffer that received the signal
@@ -498,6 +586,7 @@ gtk_source_buffer_init (GtkSourceBuffer *buffer)
 
 	priv->highlight_syntax = TRUE;
 	priv->highlight_brackets = TRUE;
+	priv->max_highlight_line_time = DEFAULT_MAX_HIGHLIGHT_LINE_TIME;
 	priv->bracket_match_state = GTK_SOURCE_BRACKET_MATCH_NONE;
 
 	priv->source_marks = g_hash_table_new_full (g_str_hash,
@@ -507,6 +596,11 @@ gtk_source_buffer_init (GtkSourceBuffer *buffer)
 
 	priv->all_source_marks = _gtk_source_marks_sequence_new (GTK_TEXT_BUFFER (buffer));
 
+	priv->context_class_tags = g_hash_table_new_full (g_str_hash,
+							  g_str_equal,
+							  g_free,
+							  g_object_unref);
+
 	priv->style_scheme = _gtk_source_style_scheme_get_default ();
 
 	if (priv->style_scheme != NULL)
@@ -550,6 +644,7 @@ gtk_source_buffer_dispose (GObject *object)
 	priv->search_contexts = NULL;
 
 	g_clear_object (&priv->all_source_marks);
+	g_clear_pointer (&priv->context_class_tags, g_hash_table_unref);
 
 	if (priv->source_marks != NULL)
 	{
@@ -582,6 +677,14 @@ gtk_source_buffer_set_property (GObject      *object,
 			gtk_source_buffer_set_language (buffer, g_value_get_object (value));
 			break;
 
+		case PROP_MAX_HIGHLIGHT_LINE_LENGTH:
+			gtk_source_buffer_set_max_highlight_line_length (buffer, g_value_get_uint (value));
+			break;
+
+		case PROP_MAX_HIGHLIGHT_LINE_TIME:
+			gtk_source_buffer_set_max_highlight_line_time (buffer, g_value_get_uint (value));
+			break;
+
 		case PROP_STYLE_SCHEME:
 			gtk_source_buffer_set_style_scheme (buffer, g_value_get_object (value));
 			break;
@@ -623,6 +726,14 @@ gtk_source_buffer_get_property (GObject    *object,
 			g_value_set_boolean (value, gtk_source_buffer_get_loading (buffer));
 			break;
 
+		case PROP_MAX_HIGHLIGHT_LINE_LENGTH:
+			g_value_set_uint (value, priv->max_highlight_line_length);
+			break;
+
+		case PROP_MAX_HIGHLIGHT_LINE_TIME:
+			g_value_set_uint (value, priv->max_highlight_line_time);
+			break;
+
 		case PROP_STYLE_SCHEME:
 			g_value_set_object (value, priv->style_scheme);
 			break;
@@ -1088,6 +1199,44 @@ gtk_source_buffer_real_highlight_updated (GtkSourceBuffer *buffer,
 	queue_bracket_highlighting_update (buffer);
 }
 
+/* Adds a change to the held ones: @length characters inserted at @offset,
+ * or deleted if @length is negative.
+ */
+static void
+hold_change (GtkSourceBuffer *buffer,
+             gint             offset,
+             gint             length)
+{
+	GtkSourceBufferPrivate *priv = gtk_source_buffer_get_instance_private (buffer);
+
+	if (!priv->has_held_changes)
+	{
+		priv->has_held_changes = TRUE;
+		priv->held_start = offset;
+		priv->held_end = offset + MAX (length, 0);
+		priv->held_delta = length;
+		return;
+	}
+
+	if (length >= 0)
+	{
+		if (offset <= priv->held_end)
+			priv->held_end += length;
+		else
+			priv->held_end = offset + length;
+	}
+	else
+	{
+		if (priv->held_end >= offset - length)
+			priv->held_end += length;
+		else
+			priv->held_end = offset;
+	}
+
+	priv->held_start = MIN (priv->held_start, offset);
+	priv->held_delta += length;
+}
+
 static void
 gtk_source_buffer_content_inserted (GtkTextBuffer *buffer,
 				    gint           start_offset,
@@ -1096,6 +1245,12 @@ gtk_source_buffer_content_inserted (GtkTextBuffer *buffer,
 	GtkSourceBuffer *source_buffer = GTK_SOURCE_BUFFER (buffer);
 	GtkSourceBufferPrivate *priv = gtk_source_buffer_get_instance_private (source_buffer);
 
+	if (priv->hold_changes_count > 0)
+	{
+		hold_change (source_buffer, start_offset, end_offset - start_offset);
+		return;
+	}
+
 	cursor_moved (source_buffer);
 
 	if (priv->highlight_engine != NULL)
@@ -1211,6 +1366,12 @@ gtk_source_buffer_real_delete_range (GtkTextBuffer *buffer,
 
 	GTK_TEXT_BUFFER_CLASS (gtk_source_buffer_parent_class)->delete_range (buffer, start, end);
 
+	if (priv->hold_changes_count > 0)
+	{
+		hold_change (source_buffer, offset, -length);
+		return;
+	}
+
 	cursor_moved (source_buffer);
 
 	/* emit text deleted for engines */
@@ -1513,6 +1674,119 @@ gtk_source_buffer_set_highlight_syntax (GtkSourceBuffer *buffer,
 	}
 }
 
+/**
+ * gtk_source_buffer_get_max_highlight_line_length:
+ * @buffer: a #GtkSourceBuffer.
+ *
+ * Returns: the number of bytes of a line analyzed at most by the syntax
+ * highlighting, or 0 if there is no limit.
+ *
+ * Since: 5.22
+ */
+guint
+gtk_source_buffer_get_max_highlight_line_length (GtkSourceBuffer *buffer)
+{
+	GtkSourceBufferPrivate *priv = gtk_source_buffer_get_instance_private (buffer);
+
+	g_return_val_if_fail (GTK_SOURCE_IS_BUFFER (buffer), 0);
+
+	return priv->max_highlight_line_length;
+}
+
+/**
+ * gtk_source_buffer_set_max_highlight_line_length:
+ * @buffer: a #GtkSourceBuffer.
+ * @max_length: the number of bytes, or 0 for no limit.
+ *
+ * Limits the syntax highlighting of each line to its first @max_length
+ * bytes, so that very long lines, such as the ones of minified files,
+ * do not make the highlighting slow. The rest of such a line keeps the
+ * highlighting of the context open at that point, and
+ * [signal@Buffer::highlight-degraded] is emitted for the line.
+ *
+ * A line taking more than [property@Buffer:max-highlight-line-time] to
+ * analyze is degraded the same way, whatever the limit.
+ *
+ * Since: 5.22
+ */
+void
+gtk_source_buffer_set_max_highlight_line_length (GtkSourceBuffer *buffer,
+                                                 guint            max_length)
+{
+	GtkSourceBufferPrivate *priv = gtk_source_buffer_get_instance_private (buffer);
+
+	g_return_if_fail (GTK_SOURCE_IS_BUFFER (buffer));
+
+	if (priv->max_highlight_line_length == max_length)
+		return;
+
+	priv->max_highlight_line_length = max_length;
+
+	/* The engine reads the limit when attached, and then analyzes
+	 * the whole buffer again.
+	 */
+	if (priv->highlight_engine != NULL)
+	{
+		_gtk_source_engine_attach_buffer (priv->highlight_engine, NULL);
+		_gtk_source_engine_attach_buffer (priv->highlight_engine,
+		                                  GTK_TEXT_BUFFER (buffer));
+		update_context_class_tags (buffer);
+	}
+
+	g_object_notify_by_pspec (G_OBJECT (buffer), buffer_properties[PROP_MAX_HIGHLIGHT_LINE_LENGTH]);
+}
+
+/**
+ * gtk_source_buffer_get_max_highlight_line_time:
+ * @buffer: a #GtkSourceBuffer.
+ *
+ * Returns: the time in milliseconds spent at most by the syntax
+ * highlighting on a line, or 0 if there is no limit.
+ *
+ * Since: 5.22
+ */
+guint
+gtk_source_buffer_get_max_highlight_line_time (GtkSourceBuffer *buffer)
+{
+	GtkSourceBufferPrivate *priv = gtk_source_buffer_get_instance_private (buffer);
+
+	g_return_val_if_fail (GTK_SOURCE_IS_BUFFER (buffer), 0);
+
+	return priv->max_highlight_line_time;
+}
+
+/**
+ * gtk_source_buffer_set_max_highlight_line_time:
+ * @buffer: a #GtkSourceBuffer.
+ * @max_time: the time in milliseconds, or 0 for no limit.
+ *
+ * Limits the time spent by the syntax highlighting on each line to
+ * @max_time milliseconds. When a line takes longer, its analysis stops
+ * there: the rest of the line keeps the highlighting of the context open
+ * at that point, and [signal@Buffer::highlight-degraded] is emitted for
+ * the line. The default is 250 milliseconds.
+ *
+ * Since: 5.22
+ */
+void
+gtk_source_buffer_set_max_highlight_line_time (GtkSourceBuffer *buffer,
+                                               guint            max_time)
+{
+	GtkSourceBufferPrivate *priv = gtk_source_buffer_get_instance_private (buffer);
+
+	g_return_if_fail (GTK_SOURCE_IS_BUFFER (buffer));
+
+	if (priv->max_highlight_line_time == max_time)
+		return;
+
+	priv->max_highlight_line_time = max_time;
+
+	/* Only the lines analyzed from now on are affected, the engine
+	 * follows the property.
+	 */
+	g_object_notify_by_pspec (G_OBJECT (buffer), buffer_properties[PROP_MAX_HIGHLIGHT_LINE_TIME]);
+}
+
 /**
  * gtk_source_buffer_set_language:
  * @buffer: a #GtkSourceBuffer.
@@ -1563,6 +1837,8 @@ gtk_source_buffer_set_language (GtkSourceBuffer   *buffer,
 				_gtk_source_engine_set_style_scheme (priv->highlight_engine,
 								     priv->style_scheme);
 			}
+
+			update_context_class_tags (buffer);
 		}
 	}
 
@@ -2128,23 +2404,6 @@ _gtk_source_buffer_has_source_marks (GtkSourceBuffer *buffer)
 	return FALSE;
 }
 
-static GtkTextTag *
-get_context_class_tag (GtkSourceBuffer *buffer,
-		       const gchar     *context_class)
-{
-	gchar *tag_name;
-	GtkTextTagTable *tag_table;
-	GtkTextTag *tag;
-
-	tag_name = g_strdup_printf (CONTEXT_CLASSES_PREFIX "%s", context_class);
-
-	tag_table = gtk_text_buffer_get_tag_table (GTK_TEXT_BUFFER (buffer));
-	tag = gtk_text_tag_table_lookup (tag_table, tag_name);
-
-	g_free (tag_name);
-	return tag;
-}
-
 /**
  * gtk_source_buffer_iter_has_context_class:
  * @buffer: a #GtkSourceBuffer.
@@ -2162,20 +2421,20 @@ gtk_source_buffer_iter_has_context_class (GtkSourceBuffer   *buffer,
                                           const GtkTextIter *iter,
                                           const gchar       *context_class)
 {
-	GtkTextTag *tag;
+	GtkSourceBufferPrivate *priv = gtk_source_buffer_get_instance_private (buffer);
 
 	g_return_val_if_fail (GTK_SOURCE_IS_BUFFER (buffer), FALSE);
 	g_return_val_if_fail (iter != NULL, FALSE);
 	g_return_val_if_fail (context_class != NULL, FALSE);
 
-	tag = get_context_class_tag (buffer, context_class);
-
-	if (tag != NULL)
+	if (priv->highlight_engine == NULL)
 	{
-		return gtk_text_iter_has_tag (iter, tag);
+		return FALSE;
 	}
 
-	return FALSE;
+	return _gtk_source_engine_has_context_class (priv->highlight_engine,
+	                                             gtk_text_iter_get_offset (iter),
+	                                             context_class);
 }
 
 /**
@@ -2195,39 +2454,47 @@ gchar **
 gtk_source_buffer_get_context_classes_at_iter (GtkSourceBuffer   *buffer,
                                                const GtkTextIter *iter)
 {
-	const gsize prefix_len = strlen (CONTEXT_CLASSES_PREFIX);
-	GSList *tags;
-	GSList *l;
-	GPtrArray *ret;
+	GtkSourceBufferPrivate *priv = gtk_source_buffer_get_instance_private (buffer);
 
 	g_return_val_if_fail (GTK_SOURCE_IS_BUFFER (buffer), NULL);
 	g_return_val_if_fail (iter != NULL, NULL);
 
-	tags = gtk_text_iter_get_tags (iter);
-	ret = g_ptr_array_new ();
-
-	for (l = tags; l != NULL; l = l->next)
+	if (priv->highlight_engine == NULL)
 	{
-		GtkTextTag *tag = l->data;
-		gchar *tag_name;
+		return g_new0 (gchar *, 1);
+	}
 
-		g_object_get (tag, "name", &tag_name, NULL);
+	return _gtk_source_engine_get_context_classes (priv->highlight_engine,
+	                                               gtk_text_iter_get_offset (iter));
+}
 
-		if (tag_name != NULL &&
-		    g_str_has_prefix (tag_name, CONTEXT_CLASSES_PREFIX))
-		{
-			gchar *context_class_name = g_strdup (tag_name + prefix_len);
+static gboolean
+iter_to_context_class_toggle (GtkSourceBuffer *buffer,
+                              GtkTextIter     *iter,
+                              const gchar     *context_class,
+                              gboolean         forward)
+{
+	GtkSourceBufferPrivate *priv = gtk_source_buffer_get_instance_private (buffer);
+	gint offset = -1;
 
-			g_ptr_array_add (ret, context_class_name);
-		}
+	g_return_val_if_fail (GTK_SOURCE_IS_BUFFER (buffer), FALSE);
+	g_return_val_if_fail (iter != NULL, FALSE);
+	g_return_val_if_fail (context_class != NULL, FALSE);
 
-		g_free (tag_name);
+	if (priv->highlight_engine != NULL)
+	{
+		offset = _gtk_source_engine_find_context_class_toggle (priv->highlight_engine,
+		                                                       gtk_text_iter_get_offset (iter),
+		                                                       context_class,
+		                                                       forward);
 	}
 
-	g_slist_free (tags);
+	/* Without toggle, @iter is left where it is. */
+	if (offset < 0)
+		return FALSE;
 
-	g_ptr_array_add (ret, NULL);
-	return (gchar **) g_ptr_array_free (ret, FALSE);
+	gtk_text_buffer_get_iter_at_offset (GTK_TEXT_BUFFER (buffer), iter, offset);
+	return TRUE;
 }
 
 /**
@@ -2238,10 +2505,10 @@ gtk_source_buffer_get_context_classes_at_iter (GtkSourceBuffer   *buffer,
  *
  * Moves forward to the next toggle (on or off) of the context class.
  *
- * If no matching context class toggles are found, returns %FALSE, otherwise %TRUE.
- * Does not return toggles located at @iter, only toggles after @iter. Sets
- * @iter to the location of the toggle, or to the end of the buffer if no
- * toggle is found.
+ * If no matching context class toggles are found, returns %FALSE and leaves
+ * @iter unchanged, otherwise returns %TRUE and sets @iter to the location of
+ * the toggle. Does not return toggles located at @iter, only toggles after
+ * @iter.
  *
  * See the [class@Buffer] description for the list of default context classes.
  *
@@ -2252,20 +2519,7 @@ gtk_source_buffer_iter_forward_to_context_class_toggle (GtkSourceBuffer *buffer,
                                                         GtkTextIter     *iter,
                                                         const gchar     *context_class)
 {
-	GtkTextTag *tag;
-
-	g_return_val_if_fail (GTK_SOURCE_IS_BUFFER (buffer), FALSE);
-	g_return_val_if_fail (iter != NULL, FALSE);
-	g_return_val_if_fail (context_class != NULL, FALSE);
-
-	tag = get_context_class_tag (buffer, context_class);
-
-	if (tag != NULL)
-	{
-		return gtk_text_iter_forward_to_tag_toggle (iter, tag);
-	}
-
-	return FALSE;
+	return iter_to_context_class_toggle (buffer, iter, context_class, TRUE);
 }
 
 /**
@@ -2276,10 +2530,10 @@ gtk_source_buffer_iter_forward_to_context_class_toggle (GtkSourceBuffer *buffer,
  *
  * Moves backward to the next toggle (on or off) of the context class.
  *
- * If no matching context class toggles are found, returns %FALSE, otherwise %TRUE.
- * Does not return toggles located at @iter, only toggles after @iter. Sets
- * @iter to the location of the toggle, or to the end of the buffer if no
- * toggle is found.
+ * If no matching context class toggles are found, returns %FALSE and leaves
+ * @iter unchanged, otherwise returns %TRUE and sets @iter to the location of
+ * the toggle. Does not return toggles located at @iter, only toggles before
+ * @iter.
  *
  * See the [class@Buffer] description for the list of default context classes.
  *
@@ -2290,20 +2544,83 @@ gtk_source_buffer_iter_backward_to_context_class_toggle (GtkSourceBuffer *buffer
                                                          GtkTextIter     *iter,
                                                          const gchar     *context_class)
 {
+	return iter_to_context_class_toggle (buffer, iter, context_class, FALSE);
+}
+
+static void
+update_context_class_tags (GtkSourceBuffer *buffer)
+{
+	GtkSourceBufferPrivate *priv = gtk_source_buffer_get_instance_private (buffer);
+	GHashTableIter iter;
+	const gchar *context_class;
+
+	g_hash_table_iter_init (&iter, priv->context_class_tags);
+	while (g_hash_table_iter_next (&iter, (gpointer *) &context_class, NULL))
+	{
+		_gtk_source_engine_get_context_class_tag (priv->highlight_engine, context_class);
+	}
+}
+
+/**
+ * gtk_source_buffer_ensure_context_class_tag:
+ * @buffer: a #GtkSourceBuffer.
+ * @context_class: the context class.
+ *
+ * Gets the [class@Gtk.TextTag] applied to the text having @context_class,
+ * creating it if needed.
+ *
+ * The context classes are not stored as tags, so the tag is only
+ * maintained once requested. It is named
+ * `gtksourceview:context-classes:<name>`, it stays in the tag table for
+ * the lifetime of @buffer and keeps following the context class when the
+ * language changes. It must be used for read-only purposes.
+ *
+ * The other context class functions, such as
+ * [method@Buffer.iter_has_context_class], do not need the tag.
+ *
+ * Returns: (transfer none): the tag of @context_class.
+ *
+ * Since: 5.22
+ */
+GtkTextTag *
+gtk_source_buffer_ensure_context_class_tag (GtkSourceBuffer *buffer,
+                                            const gchar     *context_class)
+{
+	GtkSourceBufferPrivate *priv;
 	GtkTextTag *tag;
 
-	g_return_val_if_fail (GTK_SOURCE_IS_BUFFER (buffer), FALSE);
-	g_return_val_if_fail (iter != NULL, FALSE);
-	g_return_val_if_fail (context_class != NULL, FALSE);
+	g_return_val_if_fail (GTK_SOURCE_IS_BUFFER (buffer), NULL);
+	g_return_val_if_fail (context_class != NULL, NULL);
 
-	tag = get_context_class_tag (buffer, context_class);
+	priv = gtk_source_buffer_get_instance_private (buffer);
+	tag = g_hash_table_lookup (priv->context_class_tags, context_class);
 
-	if (tag != NULL)
+	if (tag == NULL)
 	{
-		return gtk_text_iter_backward_to_tag_toggle (iter, tag);
+		GtkTextTagTable *tag_table;
+		gchar *tag_name;
+
+		tag_name = g_strdup_printf (CONTEXT_CLASSES_PREFIX "%s", context_class);
+		tag_table = gtk_text_buffer_get_tag_table (GTK_TEXT_BUFFER (buffer));
+		tag = gtk_text_tag_table_lookup (tag_table, tag_name);
+
+		if (tag == NULL)
+		{
+			tag = gtk_text_buffer_create_tag (GTK_TEXT_BUFFER (buffer), tag_name, NULL);
+		}
+
+		g_hash_table_insert (priv->context_class_tags,
+		                     g_strdup (context_class),
+		                     g_object_ref (tag));
+		g_free (tag_name);
+
+		if (priv->highlight_engine != NULL)
+		{
+			_gtk_source_engine_get_context_class_tag (priv->highlight_engine, context_class);
+		}
 	}
 
-	return FALSE;
+	return tag;
 }
 
 /*
@@ -2777,43 +3094,36 @@ sort_raw_key (const char *str,
 	return g_strdup (str);
 }
 
-/**
- * gtk_source_buffer_sort_lines:
- * @buffer: a #GtkSourceBuffer.
- * @start: a #GtkTextIter.
- * @end: a #GtkTextIter.
- * @flags: #GtkSourceSortFlags specifying how the sort should behave
- * @column: sort considering the text starting at the given column
- *
- * Sort the lines of text between the specified iterators.
- */
-void
-gtk_source_buffer_sort_lines (GtkSourceBuffer    *buffer,
-                              GtkTextIter        *start,
-                              GtkTextIter        *end,
-                              GtkSourceSortFlags  flags,
-                              gint                column)
+static SortKeyFunc
+get_sort_key_func (GtkSourceSortFlags flags)
 {
-	SortKeyFunc key_func = NULL;
-	GtkTextBuffer *text_buffer;
-	GHashTable *dedup = NULL;
-	gint start_line;
-	gint end_line;
-	gint num_lines;
-	SortLine *lines;
-	gint i;
-	gint j;
-
-	g_return_if_fail (GTK_SOURCE_IS_BUFFER (buffer));
-	g_return_if_fail (start != NULL);
-	g_return_if_fail (end != NULL);
-
-	text_buffer = GTK_TEXT_BUFFER (buffer);
+	if ((flags & GTK_SOURCE_SORT_FLAGS_CASE_SENSITIVE) != 0)
+	{
+		return sort_raw_key;
+	}
+	else if ((flags & GTK_SOURCE_SORT_FLAGS_FILENAME) != 0)
+	{
+		return sort_filename_key;
+	}
+	else
+	{
+		return sort_collate_key;
+	}
+}
 
+/* Moves @start and @end to the bounds of the lines to sort. Returns %FALSE if
+ * there is less than two lines to sort.
+ */
+static gboolean
+get_sort_range (GtkTextIter *start,
+                GtkTextIter *end,
+                gint        *start_line,
+                gint        *end_line)
+{
 	gtk_text_iter_order (start, end);
 
-	start_line = gtk_text_iter_get_line (start);
-	end_line = gtk_text_iter_get_line (end);
+	*start_line = gtk_text_iter_get_line (start);
+	*end_line = gtk_text_iter_get_line (end);
 
 	/* Required for gtk_text_buffer_delete() */
 	if (!gtk_text_iter_starts_line (start))
@@ -2826,33 +3136,94 @@ gtk_source_buffer_sort_lines (GtkSourceBuffer    *buffer,
 	 * move the iter after the line terminator */
 	if (gtk_text_iter_starts_line (end))
 	{
-		end_line = MAX (start_line, end_line - 1);
+		*end_line = MAX (*start_line, *end_line - 1);
 	}
 	else
 	{
 		gtk_text_iter_forward_line (end);
 	}
 
-	if (start_line == end_line)
-	{
-		return;
-	}
+	return *start_line != *end_line;
+}
 
-	dedup = g_hash_table_new (g_str_hash, g_str_equal);
+static void
+replace_sorted_lines (GtkSourceBuffer *buffer,
+                      GtkTextIter     *start,
+                      GtkTextIter     *end,
+                      const SortLine  *lines,
+                      gsize            n_lines)
+{
+	GtkTextBuffer *text_buffer = GTK_TEXT_BUFFER (buffer);
+	GString *str;
+	gsize i;
 
-	if ((flags & GTK_SOURCE_SORT_FLAGS_CASE_SENSITIVE) != 0)
-	{
-		key_func = sort_raw_key;
-	}
-	else if ((flags & GTK_SOURCE_SORT_FLAGS_FILENAME) != 0)
+	str = g_string_new (NULL);
+
+	for (i = 0; i < n_lines; i++)
 	{
-		key_func = sort_filename_key;
+		g_string_append (str, lines[i].line);
+		g_string_append_c (str, '\n');
 	}
-	else
+
+	/* A single insertion, so that the handlers of the buffer signals
+	 * run once rather than once per line.
+	 */
+	_gtk_source_buffer_save_and_clear_selection (buffer);
+	gtk_text_buffer_begin_user_action (text_buffer);
+
+	gtk_text_buffer_delete (text_buffer, start, end);
+	gtk_text_buffer_insert (text_buffer, start, str->str, str->len);
+
+	gtk_text_buffer_end_user_action (text_buffer);
+	_gtk_source_buffer_restore_selection (buffer);
+
+	g_string_free (str, TRUE);
+}
+
+/**
+ * gtk_source_buffer_sort_lines:
+ * @buffer: a #GtkSourceBuffer.
+ * @start: a #GtkTextIter.
+ * @end: a #GtkTextIter.
+ * @flags: #GtkSourceSortFlags specifying how the sort should behave
+ * @column: sort considering the text starting at the given column
+ *
+ * Sort the lines of text between the specified iterators.
+ *
+ * See [method@Buffer.sort_lines_async] to sort a large number of lines
+ * without blocking.
+ */
+void
+gtk_source_buffer_sort_lines (GtkSourceBuffer    *buffer,
+                              GtkTextIter        *start,
+                              GtkTextIter        *end,
+                              GtkSourceSortFlags  flags,
+                              gint                column)
+{
+	SortKeyFunc key_func = NULL;
+	GtkTextBuffer *text_buffer;
+	GHashTable *dedup = NULL;
+	gint start_line;
+	gint end_line;
+	gint num_lines;
+	SortLine *lines;
+	gint i;
+	gint j;
+
+	g_return_if_fail (GTK_SOURCE_IS_BUFFER (buffer));
+	g_return_if_fail (start != NULL);
+	g_return_if_fail (end != NULL);
+
+	text_buffer = GTK_TEXT_BUFFER (buffer);
+
+	if (!get_sort_range (start, end, &start_line, &end_line))
 	{
-		key_func = sort_collate_key;
+		return;
 	}
 
+	dedup = g_hash_table_new (g_str_hash, g_str_equal);
+	key_func = get_sort_key_func (flags);
+
 	num_lines = end_line - start_line + 1;
 	lines = g_new0 (SortLine, num_lines);
 
@@ -2889,27 +3260,664 @@ gtk_source_buffer_sort_lines (GtkSourceBuffer    *buffer,
 		qsort (lines, num_lines, sizeof (SortLine), compare_line);
 	}
 
-	_gtk_source_buffer_save_and_clear_selection (buffer);
-	gtk_text_buffer_begin_user_action (text_buffer);
-
-	gtk_text_buffer_delete (text_buffer, start, end);
+	replace_sorted_lines (buffer, start, end, lines, num_lines);
 
 	for (i = 0; i < num_lines; i++)
 	{
-		gtk_text_buffer_insert (text_buffer, start, lines[i].line, -1);
-		gtk_text_buffer_insert (text_buffer, start, "\n", -1);
+		g_free (lines[i].line);
+		g_free (lines[i].key);
 	}
 
-	gtk_text_buffer_end_user_action (text_buffer);
-	_gtk_source_buffer_restore_selection (buffer);
+	g_free (lines);
+}
 
-	for (i = 0; i < num_lines; i++)
+/* Number of lines between two progress notifications. */
+#define SORT_PROGRESS_STEP 16384
+
+typedef struct
+{
+	GtkSourceBuffer       *buffer;
+	GtkTextMark           *start_mark;
+	GtkTextMark           *end_mark;
+	gulong                 changed_handler;
+
+	/* The text of the lines, each line is nul-terminated in place. */
+	gchar                 *text;
+	gsize                  text_len;
+	GArray                *lines;
+	SortLine              *sorted;
+
+	SortKeyFunc            key_func;
+	GCompareFunc           compare_func;
+	GtkSourceSortFlags     flags;
+	gint                   column;
+	guint                  n_workers;
+
+	GFileProgressCallback  progress_cb;
+	gpointer               progress_cb_data;
+	GDestroyNotify         progress_cb_notify;
+	gint                   n_keys;
+
+	guint                  buffer_changed : 1;
+} SortTaskData;
+
+typedef struct
+{
+	GTask         *task;
+	goffset        current;
+	goffset        total;
+} SortProgress;
+
+typedef struct
+{
+	GTask         *task;
+	SortLine      *src;
+	SortLine      *dst;
+	gsize          begin;
+	gsize          middle;
+	gsize          end;
+} SortJob;
+
+/* The task data can be freed in a worker thread, so what touches the buffer
+ * is released in the main thread, before applying the result.
+ */
+static void
+sort_task_data_release (SortTaskData *task_data)
+{
+	g_signal_handler_disconnect (task_data->buffer, task_data->changed_handler);
+	task_data->changed_handler = 0;
+
+	if (task_data->progress_cb_notify != NULL)
 	{
-		g_free (lines[i].line);
-		g_free (lines[i].key);
+		task_data->progress_cb_notify (task_data->progress_cb_data);
 	}
 
-	g_free (lines);
+	task_data->progress_cb = NULL;
+	task_data->progress_cb_data = NULL;
+	task_data->progress_cb_notify = NULL;
+}
+
+static void
+sort_task_data_free (gpointer data)
+{
+	SortTaskData *task_data = data;
+
+	if (task_data->lines != NULL)
+	{
+		guint i;
+
+		for (i = 0; i < task_data->lines->len; i++)
+		{
+			g_free (g_array_index (task_data->lines, SortLine, i).key);
+		}
+
+		g_array_unref (task_data->lines);
+	}
+
+	g_free (task_data->sorted);
+	g_free (task_data->text);
+	g_object_unref (task_data->buffer);
+	g_free (task_data);
+}
+
+static void
+sort_buffer_changed_cb (GtkTextBuffer *text_buffer,
+                        SortTaskData  *task_data)
+{
+	task_data->buffer_changed = TRUE;
+}
+
+static gboolean
+sort_progress_cb (gpointer data)
+{
+	SortProgress *progress = data;
+	SortTaskData *task_data = g_task_get_task_data (progress->task);
+
+	if (!g_task_get_completed (progress->task) &&
+	    task_data->progress_cb != NULL)
+	{
+		task_data->progress_cb (progress->current,
+		                        progress->total,
+		                        task_data->progress_cb_data);
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+sort_progress_free (gpointer data)
+{
+	SortProgress *progress = data;
+
+	g_object_unref (progress->task);
+	g_free (progress);
+}
+
+/* Called from the worker threads, the progress callback is run in the
+ * main context of the task.
+ */
+static void
+report_sort_progress (GTask   *task,
+                      goffset  current)
+{
+	SortTaskData *task_data = g_task_get_task_data (task);
+	SortProgress *progress;
+
+	if (task_data->progress_cb == NULL)
+	{
+		return;
+	}
+
+	progress = g_new0 (SortProgress, 1);
+	progress->task = g_object_ref (task);
+	progress->current = current;
+	progress->total = 2 * (goffset)task_data->lines->len;
+
+	g_main_context_invoke_full (g_task_get_context (task),
+	                            G_PRIORITY_DEFAULT,
+	                            sort_progress_cb,
+	                            progress,
+	                            sort_progress_free);
+}
+
+static void
+run_sort_jobs (SortTaskData *task_data,
+               GFunc         func,
+               SortJob      *jobs,
+               guint         n_jobs)
+{
+	GThreadPool *pool;
+	guint i;
+
+	pool = g_thread_pool_new (func, task_data, task_data->n_workers, FALSE, NULL);
+
+	for (i = 0; i < n_jobs; i++)
+	{
+		g_thread_pool_push (pool, &jobs[i], NULL);
+	}
+
+	/* Waits for all the jobs to be done. */
+	g_thread_pool_free (pool, FALSE, TRUE);
+}
+
+static void
+compute_keys_job (gpointer data,
+                  gpointer user_data)
+{
+	SortJob *job = data;
+	SortTaskData *task_data = user_data;
+	GCancellable *cancellable = g_task_get_cancellable (job->task);
+	gsize i;
+
+	for (i = job->begin; i < job->end; i++)
+	{
+		SortLine *line = &job->src[i];
+
+		line->key = task_data->key_func (line->line, task_data->column);
+
+		if ((i - job->begin + 1) % SORT_PROGRESS_STEP == 0)
+		{
+			if (g_cancellable_is_cancelled (cancellable))
+			{
+				break;
+			}
+
+			report_sort_progress (job->task,
+			                      g_atomic_int_add (&task_data->n_keys, SORT_PROGRESS_STEP) + SORT_PROGRESS_STEP);
+		}
+	}
+}
+
+static void
+sort_run_job (gpointer data,
+              gpointer user_data)
+{
+	SortJob *job = data;
+	SortTaskData *task_data = user_data;
+
+	qsort (job->src + job->begin,
+	       job->end - job->begin,
+	       sizeof (SortLine),
+	       task_data->compare_func);
+}
+
+static void
+merge_runs_job (gpointer data,
+                gpointer user_data)
+{
+	SortJob *job = data;
+	SortTaskData *task_data = user_data;
+	gsize i = job->begin;
+	gsize j = job->middle;
+	gsize k = job->begin;
+
+	/* Take from the left run on equality, to keep the merge stable. */
+	while (i < job->middle && j < job->end)
+	{
+		if (task_data->compare_func (&job->src[j], &job->src[i]) < 0)
+		{
+			job->dst[k++] = job->src[j++];
+		}
+		else
+		{
+			job->dst[k++] = job->src[i++];
+		}
+	}
+
+	if (i < job->middle)
+	{
+		memcpy (&job->dst[k], &job->src[i], (job->middle - i) * sizeof (SortLine));
+	}
+	else if (j < job->end)
+	{
+		memcpy (&job->dst[k], &job->src[j], (job->end - j) * sizeof (SortLine));
+	}
+}
+
+static void
+split_sort_lines (SortTaskData *task_data)
+{
+	GHashTable *dedup = NULL;
+	gchar *p = task_data->text;
+	gchar *text_end = task_data->text + task_data->text_len;
+
+	if ((task_data->flags & GTK_SOURCE_SORT_FLAGS_REMOVE_DUPLICATES) != 0)
+	{
+		dedup = g_hash_table_new (g_str_hash, g_str_equal);
+	}
+
+	/* Same paragraph delimiters as GtkTextBuffer. */
+	while (p < text_end)
+	{
+		SortLine line = { p, NULL };
+		gint delimiter;
+		gint next;
+
+		pango_find_paragraph_boundary (p, MIN (text_end - p, G_MAXINT), &delimiter, &next);
+		p[delimiter] = '\0';
+
+		if (dedup == NULL || g_hash_table_add (dedup, line.line))
+		{
+			g_array_append_val (task_data->lines, line);
+		}
+
+		if (next == delimiter)
+		{
+			break;
+		}
+
+		p += next;
+	}
+
+	g_clear_pointer (&dedup, g_hash_table_unref);
+}
+
+static void
+sort_lines_worker (GTask        *task,
+                   gpointer      source_object,
+                   gpointer      data,
+                   GCancellable *cancellable)
+{
+	SortTaskData *task_data = data;
+	SortLine *src;
+	SortLine *dst;
+	SortJob *jobs;
+	gsize *bounds;
+	gsize n_lines;
+	guint n_runs;
+	guint n_rounds;
+	guint merge_round;
+	guint i;
+
+	split_sort_lines (task_data);
+
+	n_lines = task_data->lines->len;
+	src = (SortLine *)(gpointer)task_data->lines->data;
+	n_runs = CLAMP (n_lines / 1024, 1, task_data->n_workers);
+
+	jobs = g_new0 (SortJob, n_runs);
+	bounds = g_new0 (gsize, n_runs + 1);
+
+	for (i = 0; i <= n_runs; i++)
+	{
+		bounds[i] = n_lines * i / n_runs;
+	}
+
+	for (i = 0; i < n_runs; i++)
+	{
+		jobs[i].task = task;
+		jobs[i].src = src;
+		jobs[i].begin = bounds[i];
+		jobs[i].end = bounds[i + 1];
+	}
+
+	/* The collation keys are the most expensive part. */
+	run_sort_jobs (task_data, compute_keys_job, jobs, n_runs);
+
+	if (g_task_return_error_if_cancelled (task))
+	{
+		goto cleanup;
+	}
+
+	report_sort_progress (task, n_lines);
+
+	/* Parallel merge sort: sort each run, then merge the runs pairwise. */
+	run_sort_jobs (task_data, sort_run_job, jobs, n_runs);
+
+	task_data->sorted = g_new (SortLine, MAX (n_lines, 1));
+	dst = task_data->sorted;
+
+	n_rounds = g_bit_storage (n_runs - 1);
+
+	for (merge_round = 1; n_runs > 1; merge_round++)
+	{
+		guint n_merged_runs = (n_runs + 1) / 2;
+		SortLine *tmp;
+
+		if (g_task_return_error_if_cancelled (task))
+		{
+			goto cleanup;
+		}
+
+		for (i = 0; i < n_merged_runs; i++)
+		{
+			jobs[i].task = task;
+			jobs[i].src = src;
+			jobs[i].dst = dst;
+			jobs[i].begin = bounds[2 * i];
+			jobs[i].middle = bounds[MIN (2 * i + 1, n_runs)];
+			jobs[i].end = bounds[MIN (2 * i + 2, n_runs)];
+		}
+
+		run_sort_jobs (task_data, merge_runs_job, jobs, n_merged_runs);
+
+		for (i = 0; i <= n_merged_runs; i++)
+		{
+			bounds[i] = bounds[MIN (2 * i, n_runs)];
+		}
+
+		n_runs = n_merged_runs;
+
+		tmp = src;
+		src = dst;
+		dst = tmp;
+
+		report_sort_progress (task, n_lines + n_lines * merge_round / n_rounds);
+	}
+
+	/* The array of lines only owns the keys. */
+	if (src != task_data->sorted)
+	{
+		memcpy (task_data->sorted, src, n_lines * sizeof (SortLine));
+	}
+
+	g_task_return_boolean (task, TRUE);
+
+cleanup:
+	g_free (bounds);
+	g_free (jobs);
+}
+
+static void
+sort_lines_cb (GObject      *source_object,
+               GAsyncResult *result,
+               gpointer      user_data)
+{
+	GtkSourceBuffer *buffer = GTK_SOURCE_BUFFER (source_object);
+	GTask *task = G_TASK (user_data);
+	SortTaskData *task_data;
+	GtkTextIter start;
+	GtkTextIter end;
+	GError *error = NULL;
+
+	task_data = g_task_get_task_data (G_TASK (result));
+	sort_task_data_release (task_data);
+
+	gtk_text_buffer_get_iter_at_mark (GTK_TEXT_BUFFER (buffer), &start, task_data->start_mark);
+	gtk_text_buffer_get_iter_at_mark (GTK_TEXT_BUFFER (buffer), &end, task_data->end_mark);
+	gtk_text_buffer_delete_mark (GTK_TEXT_BUFFER (buffer), task_data->start_mark);
+	gtk_text_buffer_delete_mark (GTK_TEXT_BUFFER (buffer), task_data->end_mark);
+
+	if (!g_task_propagate_boolean (G_TASK (result), &error))
+	{
+		g_task_return_error (task, error);
+		goto cleanup;
+	}
+
+	if (task_data->buffer_changed)
+	{
+		g_task_return_new_error (task,
+		                         G_IO_ERROR,
+		                         G_IO_ERROR_FAILED,
+		                         "The buffer was modified while sorting");
+		goto cleanup;
+	}
+
+	replace_sorted_lines (buffer, &start, &end, task_data->sorted, task_data->lines->len);
+
+	g_task_return_boolean (task, TRUE);
+
+cleanup:
+	g_object_unref (task);
+}
+
+/**
+ * gtk_source_buffer_sort_lines_async:
+ * @buffer: a #GtkSourceBuffer.
+ * @start: a #GtkTextIter.
+ * @end: a #GtkTextIter.
+ * @flags: #GtkSourceSortFlags specifying how the sort should behave
+ * @column: sort considering the text starting at the given column
+ * @cancellable: (nullable): optional #GCancellable object, %NULL to ignore.
+ * @progress_callback: (scope notified) (closure progress_callback_data) (destroy progress_callback_notify) (nullable):
+ *   function to call back with progress information, or %NULL if progress
+ *   information is not needed.
+ * @progress_callback_data: user data to pass to @progress_callback.
+ * @progress_callback_notify: (nullable): function to call on
+ *   @progress_callback_data when the @progress_callback is no longer needed, or
+ *   %NULL.
+ * @callback: (scope async): a #GAsyncReadyCallback to call when the lines
+ *   have been sorted.
+ * @user_data: user data to pass to @callback.
+ *
+ * Asynchronously sorts the lines of text between the specified iterators,
+ * like [method@Buffer.sort_lines].
+ *
+ * The text is copied and sorted in worker threads: the collation keys are
+ * computed in parallel, followed by a parallel merge sort. The sorted lines
+ * then replace the range in a single user action. The progress is reported
+ * in the thread-default main context of the caller.
+ *
+ * If the buffer is modified before the sort is complete, the operation
+ * fails and the buffer is left untouched.
+ *
+ * Since: 5.22
+ */
+void
+gtk_source_buffer_sort_lines_async (GtkSourceBuffer       *buffer,
+                                    GtkTextIter           *start,
+                                    GtkTextIter           *end,
+                                    GtkSourceSortFlags     flags,
+                                    gint                   column,
+                                    GCancellable          *cancellable,
+                                    GFileProgressCallback  progress_callback,
+                                    gpointer               progress_callback_data,
+                                    GDestroyNotify         progress_callback_notify,
+                                    GAsyncReadyCallback    callback,
+                                    gpointer               user_data)
+{
+	GtkTextBuffer *text_buffer;
+	SortTaskData *task_data;
+	GTask *task;
+	GTask *worker_task;
+	gint start_line;
+	gint end_line;
+
+	g_return_if_fail (GTK_SOURCE_IS_BUFFER (buffer));
+	g_return_if_fail (start != NULL);
+	g_return_if_fail (end != NULL);
+	g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+	text_buffer = GTK_TEXT_BUFFER (buffer);
+
+	task = g_task_new (buffer, cancellable, callback, user_data);
+	g_task_set_source_tag (task, gtk_source_buffer_sort_lines_async);
+
+	if (!get_sort_range (start, end, &start_line, &end_line))
+	{
+		if (progress_callback_notify != NULL)
+		{
+			progress_callback_notify (progress_callback_data);
+		}
+
+		g_task_return_boolean (task, TRUE);
+		g_object_unref (task);
+		return;
+	}
+
+	task_data = g_new0 (SortTaskData, 1);
+	task_data->buffer = g_object_ref (buffer);
+	task_data->start_mark = gtk_text_buffer_create_mark (text_buffer, NULL, start, TRUE);
+	task_data->end_mark = gtk_text_buffer_create_mark (text_buffer, NULL, end, FALSE);
+	task_data->text = gtk_text_buffer_get_slice (text_buffer, start, end, TRUE);
+	task_data->text_len = strlen (task_data->text);
+	task_data->lines = g_array_sized_new (FALSE, FALSE, sizeof (SortLine), end_line - start_line + 1);
+	task_data->key_func = get_sort_key_func (flags);
+	task_data->compare_func = (flags & GTK_SOURCE_SORT_FLAGS_REVERSE_ORDER) != 0 ? compare_line_reversed : compare_line;
+	task_data->flags = flags;
+	task_data->column = column;
+	task_data->n_workers = MAX (1, g_get_num_processors ());
+	task_data->progress_cb = progress_callback;
+	task_data->progress_cb_data = progress_callback_data;
+	task_data->progress_cb_notify = progress_callback_notify;
+	task_data->changed_handler = g_signal_connect (buffer,
+	                                               "changed",
+	                                               G_CALLBACK (sort_buffer_changed_cb),
+	                                               task_data);
+
+	worker_task = g_task_new (buffer, cancellable, sort_lines_cb, task);
+	g_task_set_source_tag (worker_task, sort_lines_worker);
+	g_task_set_task_data (worker_task, task_data, sort_task_data_free);
+	g_task_run_in_thread (worker_task, sort_lines_worker);
+	g_object_unref (worker_task);
+}
+
+/**
+ * gtk_source_buffer_sort_lines_finish:
+ * @buffer: a #GtkSourceBuffer.
+ * @result: a #GAsyncResult.
+ * @error: a #GError, or %NULL.
+ *
+ * Finishes an operation started with [method@Buffer.sort_lines_async].
+ *
+ * Returns: %TRUE if the lines have been sorted.
+ *
+ * Since: 5.22
+ */
+gboolean
+gtk_source_buffer_sort_lines_finish (GtkSourceBuffer  *buffer,
+                                     GAsyncResult     *result,
+                                     GError          **error)
+{
+	g_return_val_if_fail (GTK_SOURCE_IS_BUFFER (buffer), FALSE);
+	g_return_val_if_fail (g_task_is_valid (result, buffer), FALSE);
+
+	return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+/**
+ * gtk_source_buffer_replace_ranges:
+ * @buffer: a #GtkSourceBuffer.
+ * @starts: (array length=n_ranges): the start offsets of the ranges, in
+ *   characters.
+ * @ends: (array length=n_ranges): the end offsets of the ranges, in
+ *   characters.
+ * @replacements: (array length=n_ranges) (nullable): the replacement text of
+ *   each range, or %NULL to delete all the ranges.
+ * @n_ranges: the number of ranges.
+ *
+ * Replaces several ranges of the buffer at once.
+ *
+ * The ranges are given in offsets of the current buffer contents, they must
+ * be sorted and must not overlap. An empty range inserts its replacement, a
+ * %NULL or empty replacement deletes its range.
+ *
+ * All the replacements are applied in a single user action, so that they
+ * are undone in one step. Each range is deleted and its replacement inserted
+ * on its own, from the last range to the first one, so the text between the
+ * ranges is not modified: its tags, marks and child anchors are kept.
+ *
+ * The syntax highlighting, the search contexts and the maps of the buffer
+ * are updated once, after the last replacement, for the text from the start
+ * of the first range to the end of the last one.
+ *
+ * Since: 5.22
+ */
+void
+gtk_source_buffer_replace_ranges (GtkSourceBuffer     *buffer,
+                                  const gint          *starts,
+                                  const gint          *ends,
+                                  const gchar * const *replacements,
+                                  guint                n_ranges)
+{
+	GtkTextBuffer *text_buffer;
+	gint char_count;
+	guint i;
+
+	g_return_if_fail (GTK_SOURCE_IS_BUFFER (buffer));
+	g_return_if_fail (n_ranges == 0 || starts != NULL);
+	g_return_if_fail (n_ranges == 0 || ends != NULL);
+
+	if (n_ranges == 0)
+	{
+		return;
+	}
+
+	text_buffer = GTK_TEXT_BUFFER (buffer);
+	char_count = gtk_text_buffer_get_char_count (text_buffer);
+
+	for (i = 0; i < n_ranges; i++)
+	{
+		g_return_if_fail (0 <= starts[i]);
+		g_return_if_fail (starts[i] <= ends[i]);
+		g_return_if_fail (ends[i] <= char_count);
+		g_return_if_fail (i == 0 || ends[i - 1] <= starts[i]);
+	}
+
+	GTK_SOURCE_PROFILER_BEGIN_MARK;
+
+	gtk_text_buffer_begin_user_action (text_buffer);
+	_gtk_source_buffer_hold_changes (buffer);
+
+	/* From the last range, so that the offsets of the ranges before the
+	 * edited one are still valid.
+	 */
+	i = n_ranges;
+
+	while (i-- > 0)
+	{
+		const gchar *replacement = replacements != NULL ? replacements[i] : NULL;
+		GtkTextIter start;
+		GtkTextIter end;
+
+		gtk_text_buffer_get_iter_at_offset (text_buffer, &start, starts[i]);
+
+		if (starts[i] < ends[i])
+		{
+			gtk_text_buffer_get_iter_at_offset (text_buffer, &end, ends[i]);
+			gtk_text_buffer_delete (text_buffer, &start, &end);
+		}
+
+		if (replacement != NULL && replacement[0] != '\0')
+		{
+			gtk_text_buffer_insert (text_buffer, &start, replacement, -1);
+		}
+	}
+
+	_gtk_source_buffer_release_changes (buffer);
+	gtk_text_buffer_end_user_action (text_buffer);
+
+	GTK_SOURCE_PROFILER_END_MARK ("GtkSourceBuffer", "replace_ranges");
 }
 
 void
@@ -2935,6 +3943,17 @@ _gtk_source_buffer_add_search_context (GtkSourceBuffer        *buffer,
 			   buffer);
 }
 
+/* Returns: (transfer none): the search contexts of @buffer. */
+const GList *
+_gtk_source_buffer_get_search_contexts (GtkSourceBuffer *buffer)
+{
+	GtkSourceBufferPrivate *priv = gtk_source_buffer_get_instance_private (buffer);
+
+	g_return_val_if_fail (GTK_SOURCE_IS_BUFFER (buffer), NULL);
+
+	return priv->search_contexts;
+}
+
 static void
 sync_invalid_char_tag (GtkSourceBuffer *buffer,
 		       GParamSpec      *pspec,
@@ -3152,6 +4171,16 @@ _gtk_source_buffer_get_insertion_count (GtkSourceBuffer *buffer)
 	return priv->insertion_count;
 }
 
+GtkSourceEngine *
+_gtk_source_buffer_get_highlight_engine (GtkSourceBuffer *buffer)
+{
+	GtkSourceBufferPrivate *priv = gtk_source_buffer_get_instance_private (buffer);
+
+	g_return_val_if_fail (GTK_SOURCE_IS_BUFFER (buffer), NULL);
+
+	return priv->highlight_engine;
+}
+
 void
 _gtk_source_buffer_block_cursor_moved (GtkSourceBuffer *buffer)
 {
@@ -3178,6 +4207,133 @@ _gtk_source_buffer_unblock_cursor_moved (GtkSourceBuffer *buffer)
 	}
 }
 
+/*
+ * _gtk_source_buffer_hold_changes:
+ * @buffer: a #GtkSourceBuffer.
+ *
+ * Until the matching _gtk_source_buffer_release_changes(), the insertions
+ * and deletions are only accumulated: the highlighting engine is not told
+ * about them, the cursor is not considered moved, and the search contexts
+ * and the map ignore the ::insert-text and ::delete-range signals. The calls
+ * can be nested.
+ */
+void
+_gtk_source_buffer_hold_changes (GtkSourceBuffer *buffer)
+{
+	GtkSourceBufferPrivate *priv = gtk_source_buffer_get_instance_private (buffer);
+
+	g_return_if_fail (GTK_SOURCE_IS_BUFFER (buffer));
+
+	priv->hold_changes_count++;
+}
+
+/* Reports the changes held so far as a single replacement, to the
+ * highlighting engine and with GtkSourceBufferInternal::text-replaced.
+ */
+static void
+report_held_changes (GtkSourceBuffer *buffer)
+{
+	GtkSourceBufferPrivate *priv = gtk_source_buffer_get_instance_private (buffer);
+	GtkSourceBufferInternal *buffer_internal;
+	gint start;
+	gint old_end;
+	gint new_end;
+
+	if (!priv->has_held_changes)
+	{
+		return;
+	}
+
+	start = priv->held_start;
+	new_end = priv->held_end;
+	old_end = priv->held_end - priv->held_delta;
+	priv->has_held_changes = FALSE;
+
+	if (start == old_end && start == new_end)
+	{
+		return;
+	}
+
+	cursor_moved (buffer);
+
+	if (priv->highlight_engine != NULL)
+	{
+		if (start < old_end)
+		{
+			_gtk_source_engine_text_deleted (priv->highlight_engine,
+			                                 start,
+			                                 old_end - start);
+		}
+
+		if (start < new_end)
+		{
+			_gtk_source_engine_text_inserted (priv->highlight_engine,
+			                                  start,
+			                                  new_end);
+		}
+	}
+
+	buffer_internal = _gtk_source_buffer_internal_get_from_buffer (buffer);
+	_gtk_source_buffer_internal_emit_text_replaced (buffer_internal, start, old_end, new_end);
+}
+
+/*
+ * _gtk_source_buffer_release_changes:
+ * @buffer: a #GtkSourceBuffer.
+ *
+ * Ends a _gtk_source_buffer_hold_changes(). For the last one, the changes
+ * made in between are reported once, as a single replacement of the text
+ * from the first modified offset to the last one: to the highlighting
+ * engine, and with the GtkSourceBufferInternal::text-replaced signal.
+ */
+void
+_gtk_source_buffer_release_changes (GtkSourceBuffer *buffer)
+{
+	GtkSourceBufferPrivate *priv = gtk_source_buffer_get_instance_private (buffer);
+
+	g_return_if_fail (GTK_SOURCE_IS_BUFFER (buffer));
+	g_return_if_fail (priv->hold_changes_count > 0);
+
+	priv->hold_changes_count--;
+
+	if (priv->hold_changes_count == 0)
+	{
+		report_held_changes (buffer);
+	}
+}
+
+/*
+ * _gtk_source_buffer_flush_held_changes:
+ * @buffer: a #GtkSourceBuffer.
+ *
+ * Reports the changes held so far, as the last
+ * _gtk_source_buffer_release_changes() would, but keeps holding the next
+ * ones. For the code that has to see up-to-date search occurrences or
+ * highlighting in the middle of held changes.
+ */
+void
+_gtk_source_buffer_flush_held_changes (GtkSourceBuffer *buffer)
+{
+	GtkSourceBufferPrivate *priv = gtk_source_buffer_get_instance_private (buffer);
+
+	g_return_if_fail (GTK_SOURCE_IS_BUFFER (buffer));
+
+	if (priv->hold_changes_count > 0)
+	{
+		report_held_changes (buffer);
+	}
+}
+
+gboolean
+_gtk_source_buffer_get_changes_held (GtkSourceBuffer *buffer)
+{
+	GtkSourceBufferPrivate *priv = gtk_source_buffer_get_instance_private (buffer);
+
+	g_return_val_if_fail (GTK_SOURCE_IS_BUFFER (buffer), FALSE);
+
+	return priv->hold_changes_count > 0;
+}
+
 void
 _gtk_source_buffer_begin_loading (GtkSourceBuffer *buffer)
 {
@@ -117,6 +117,16 @@ gboolean               gtk_source_buffer_get_highlight_syntax                  (
 GTK_SOURCE_AVAILABLE_IN_ALL
 void                   gtk_source_buffer_set_highlight_syntax                  (GtkSourceBuffer         *buffer,
                                                                                 gboolean                 highlight);
+GTK_SOURCE_AVAILABLE_IN_5_22
+guint                  gtk_source_buffer_get_max_highlight_line_length         (GtkSourceBuffer         *buffer);
+GTK_SOURCE_AVAILABLE_IN_5_22
+void                   gtk_source_buffer_set_max_highlight_line_length         (GtkSourceBuffer         *buffer,
+                                                                                guint                    max_length);
+GTK_SOURCE_AVAILABLE_IN_5_22
+guint                  gtk_source_buffer_get_max_highlight_line_time           (GtkSourceBuffer         *buffer);
+GTK_SOURCE_AVAILABLE_IN_5_22
+void                   gtk_source_buffer_set_max_highlight_line_time           (GtkSourceBuffer         *buffer,
+                                                                                guint                    max_time);
 GTK_SOURCE_AVAILABLE_IN_ALL
 gboolean               gtk_source_buffer_get_highlight_matching_brackets       (GtkSourceBuffer         *buffer);
 GTK_SOURCE_AVAILABLE_IN_ALL
@@ -179,6 +189,9 @@ GTK_SOURCE_AVAILABLE_IN_ALL
 gboolean               gtk_source_buffer_iter_backward_to_context_class_toggle (GtkSourceBuffer         *buffer,
                                                                                 GtkTextIter             *iter,
                                                                                 const gchar             *context_class);
+GTK_SOURCE_AVAILABLE_IN_5_22
+GtkTextTag            *gtk_source_buffer_ensure_context_class_tag              (GtkSourceBuffer         *buffer,
+                                                                                const gchar             *context_class);
 GTK_SOURCE_AVAILABLE_IN_ALL
 void                   gtk_source_buffer_change_case                           (GtkSourceBuffer         *buffer,
                                                                                 GtkSourceChangeCaseType  case_type,
@@ -194,6 +207,28 @@ void                   gtk_source_buffer_sort_lines                            (
                                                                                 GtkTextIter             *end,
                                                                                 GtkSourceSortFlags       flags,
                                                                                 gint                     column);
+GTK_SOURCE_AVAILABLE_IN_5_22
+void                   gtk_source_buffer_sort_lines_async                      (GtkSourceBuffer         *buffer,
+                                                                                GtkTextIter             *start,
+                                                                                GtkTextIter             *end,
+                                                                                GtkSourceSortFlags       flags,
+                                                                                gint                     column,
+                                                                                GCancellable            *cancellable,
+                                                                                GFileProgressCallback    progress_callback,
+                                                                                gpointer                 progress_callback_data,
+                                                                                GDestroyNotify           progress_callback_notify,
+                                                                                GAsyncReadyCallback      callback,
+                                                                                gpointer                 user_data);
+GTK_SOURCE_AVAILABLE_IN_5_22
+gboolean               gtk_source_buffer_sort_lines_finish                     (GtkSourceBuffer         *buffer,
+                                                                                GAsyncResult            *result,
+                                                                                GError                 **error);
+GTK_SOURCE_AVAILABLE_IN_5_22
+void                   gtk_source_buffer_replace_ranges                        (GtkSourceBuffer         *buffer,
+                                                                                const gint              *starts,
+                                                                                const gint              *ends,
+                                                                                const gchar * const     *replacements,
+                                                                                guint                    n_ranges);
 GTK_SOURCE_AVAILABLE_IN_ALL
 void                   gtk_source_buffer_set_implicit_trailing_newline         (GtkSourceBuffer         *buffer,
                                                                                 gboolean                 implicit_trailing_newline);
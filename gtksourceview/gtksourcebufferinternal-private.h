@@ -31,9 +31,17 @@ G_GNUC_INTERNAL
 G_DECLARE_FINAL_TYPE (GtkSourceBufferInternal, _gtk_source_buffer_internal, GTK_SOURCE, BUFFER_INTERNAL, GObject)
 
 G_GNUC_INTERNAL
-GtkSourceBufferInternal *_gtk_source_buffer_internal_get_from_buffer   (GtkSourceBuffer         *buffer);
+GtkSourceBufferInternal *_gtk_source_buffer_internal_get_from_buffer             (GtkSourceBuffer         *buffer);
 G_GNUC_INTERNAL
-void                     _gtk_source_buffer_internal_emit_search_start (GtkSourceBufferInternal *buffer_internal,
-                                                                        GtkSourceSearchContext  *search_context);
+void                     _gtk_source_buffer_internal_emit_search_start           (GtkSourceBufferInternal *buffer_internal,
+                                                                                  GtkSourceSearchContext  *search_context);
+G_GNUC_INTERNAL
+void                     _gtk_source_buffer_internal_emit_search_matches_changed (GtkSourceBufferInternal *buffer_internal,
+                                                                                  GtkSourceSearchContext  *search_context);
+G_GNUC_INTERNAL
+void                     _gtk_source_buffer_internal_emit_text_replaced          (GtkSourceBufferInternal *buffer_internal,
+                                                                                  gint                     start_offset,
+                                                                                  gint                     old_end_offset,
+                                                                                  gint                     new_end_offset);
 
 G_END_DECLS
@@ -36,6 +36,8 @@ struct _GtkSourceBufferInternal
 enum
 {
 	SIGNAL_SEARCH_START,
+	SIGNAL_SEARCH_MATCHES_CHANGED,
+	SIGNAL_TEXT_REPLACED,
 	N_SIGNALS
 };
 
@@ -69,6 +71,55 @@ _gtk_source_buffer_internal_class_init (GtkSourceBufferInternalClass *klass)
 	g_signal_set_va_marshaller (signals[SIGNAL_SEARCH_START],
 	                            G_TYPE_FROM_CLASS (klass),
 	                            g_cclosure_marshal_VOID__OBJECTv);
+
+	/*
+	 * GtkSourceBufferInternal::search-matches-changed:
+	 * @buffer_internal: the object that received the signal.
+	 * @search_context: the #GtkSourceSearchContext.
+	 *
+	 * The ::search-matches-changed signal is emitted when occurrences
+	 * that are not marked with a text tag are found or removed, or when
+	 * their style changes, so that the views paint them again.
+	 */
+	signals[SIGNAL_SEARCH_MATCHES_CHANGED] =
+		g_signal_new ("search-matches-changed",
+			      G_OBJECT_CLASS_TYPE (object_class),
+			      G_SIGNAL_RUN_LAST,
+			      0,
+			      NULL, NULL,
+		              g_cclosure_marshal_VOID__OBJECT,
+			      G_TYPE_NONE,
+			      1, GTK_SOURCE_TYPE_SEARCH_CONTEXT);
+	g_signal_set_va_marshaller (signals[SIGNAL_SEARCH_MATCHES_CHANGED],
+	                            G_TYPE_FROM_CLASS (klass),
+	                            g_cclosure_marshal_VOID__OBJECTv);
+
+	/*
+	 * GtkSourceBufferInternal::text-replaced:
+	 * @buffer_internal: the object that received the signal.
+	 * @start_offset: the start of the modified text.
+	 * @old_end_offset: the end of the replaced text, in offsets of the
+	 *   contents before the changes.
+	 * @new_end_offset: the end of the new text.
+	 *
+	 * The ::text-replaced signal is emitted when the changes held with
+	 * _gtk_source_buffer_hold_changes() are released. The ::insert-text
+	 * and ::delete-range signals emitted in between are to be ignored, and
+	 * the changes handled as if [@start_offset, @old_end_offset] had been
+	 * replaced by [@start_offset, @new_end_offset].
+	 */
+	signals[SIGNAL_TEXT_REPLACED] =
+		g_signal_new ("text-replaced",
+			      G_OBJECT_CLASS_TYPE (object_class),
+			      G_SIGNAL_RUN_LAST,
+			      0,
+			      NULL, NULL,
+			      _gtk_source_marshal_VOID__INT_INT_INT,
+			      G_TYPE_NONE,
+			      3, G_TYPE_INT, G_TYPE_INT, G_TYPE_INT);
+	g_signal_set_va_marshaller (signals[SIGNAL_TEXT_REPLACED],
+	                            G_TYPE_FROM_CLASS (klass),
+	                            _gtk_source_marshal_VOID__INT_INT_INTv);
 }
 
 static void
@@ -120,3 +171,32 @@ _gtk_source_buffer_internal_emit_search_start (GtkSourceBufferInternal *buffer_i
 		       0,
 		       search_context);
 }
+
+void
+_gtk_source_buffer_internal_emit_search_matches_changed (GtkSourceBufferInternal *buffer_internal,
+                                                         GtkSourceSearchContext  *search_context)
+{
+	g_return_if_fail (GTK_SOURCE_IS_BUFFER_INTERNAL (buffer_internal));
+	g_return_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search_context));
+
+	g_signal_emit (buffer_internal,
+		       signals[SIGNAL_SEARCH_MATCHES_CHANGED],
+		       0,
+		       search_context);
+}
+
+void
+_gtk_source_buffer_internal_emit_text_replaced (GtkSourceBufferInternal *buffer_internal,
+                                                gint                     start_offset,
+                                                gint                     old_end_offset,
+                                                gint                     new_end_offset)
+{
+	g_return_if_fail (GTK_SOURCE_IS_BUFFER_INTERNAL (buffer_internal));
+
+	g_signal_emit (buffer_internal,
+		       signals[SIGNAL_TEXT_REPLACED],
+		       0,
+		       start_offset,
+		       old_end_offset,
+		       new_end_offset);
+}
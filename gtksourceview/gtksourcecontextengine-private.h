@@ -47,6 +47,24 @@ typedef enum _GtkSourceContextRefOptions {
 	GTK_SOURCE_CONTEXT_REF_ORIGINAL   = 1 << 2
 } GtkSourceContextRefOptions;
 
+typedef struct _GtkSourceRegexStats {
+	guint n_regexes;
+	guint n_compiled;
+	guint n_jit_compiled;
+} GtkSourceRegexStats;
+
+typedef struct _GtkSourceContextEngineStats {
+	guint n_segments;
+	guint n_segments_allocated;
+	guint n_sub_patterns;
+	guint n_sub_patterns_allocated;
+	gsize tree_size;
+
+	/* Since the last change of the text. */
+	guint n_toggles_added;
+	guint n_toggles_removed;
+} GtkSourceContextEngineStats;
+
 G_GNUC_INTERNAL
 G_DECLARE_FINAL_TYPE (GtkSourceContextEngine, _gtk_source_context_engine, GTK_SOURCE, CONTEXT_ENGINE, GObject)
 
@@ -75,6 +93,11 @@ gboolean                 _gtk_source_context_data_define_context  (GtkSourceCont
                                                                    GtkSourceContextFlags        flags,
                                                                    GError                     **error);
 G_GNUC_INTERNAL
+void                     _gtk_source_context_data_set_keywords    (GtkSourceContextData        *data,
+                                                                   const gchar                 *id,
+                                                                   const gchar * const         *keywords,
+                                                                   gboolean                     caseless);
+G_GNUC_INTERNAL
 gboolean                 _gtk_source_context_data_add_sub_pattern (GtkSourceContextData        *data,
                                                                    const gchar                 *id,
                                                                    const gchar                 *parent_id,
@@ -100,6 +123,23 @@ G_GNUC_INTERNAL
 gboolean                 _gtk_source_context_data_finish_parse    (GtkSourceContextData        *data,
                                                                    GList                       *overrides,
                                                                    GError                     **error);
+G_GNUC_INTERNAL
+void                     _gtk_source_context_data_start_recording (GtkSourceContextData        *data);
+G_GNUC_INTERNAL
+GVariant                *_gtk_source_context_data_end_recording   (GtkSourceContextData        *data);
+G_GNUC_INTERNAL
+gboolean                 _gtk_source_context_data_replay          (GtkSourceContextData        *data,
+                                                                   GVariant                    *calls,
+                                                                   GError                     **error);
+G_GNUC_INTERNAL
+void                     _gtk_source_context_data_get_regex_stats (GtkSourceContextData        *data,
+                                                                   GtkSourceRegexStats         *stats);
+G_GNUC_INTERNAL
+gboolean                 _gtk_source_context_data_compile_regexes (GtkSourceContextData        *data,
+                                                                   GError                     **error);
+G_GNUC_INTERNAL
+void                     _gtk_source_context_engine_get_stats     (GtkSourceContextEngine      *ce,
+                                                                   GtkSourceContextEngineStats *stats);
 /* Only for lang files version 1, do not use it */
 G_GNUC_INTERNAL
 void                     _gtk_source_context_data_set_escape_char (GtkSourceContextData        *data,
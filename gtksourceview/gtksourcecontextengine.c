@@ -30,7 +30,9 @@
 #include "gtksourcelanguage.h"
 #include "gtksourcelanguage-private.h"
 #include "gtksourcebuffer.h"
+#include "gtksourcekeywordtrie-private.h"
 #include "gtksourceregex-private.h"
+#include "gtksourcescheduler-private.h"
 #include "gtksourcestyle.h"
 #include "gtksourcestylescheme.h"
 #include "gtksourceutils-private.h"
@@ -42,34 +44,27 @@
 # define NEED_DEBUG_ID
 #endif
 
-/* Priority of one-time idle which is installed after buffer is modified. */
-#define FIRST_UPDATE_PRIORITY		G_PRIORITY_HIGH_IDLE
-
-/* Maximal amount of time (in milliseconds) allowed to spend in the first idle.
- * Should be small enough, since in worst case we block ui for this time after
- * each keypress.
- */
-#define FIRST_UPDATE_TIME_SLICE		10
-
-/* Priority of long running idle which is used to analyze whole buffer, if
- * the engine wasn't quick enough to analyze it in one shot.
- */
-/* FIXME this priority is low, since we don't want to block other gui stuff.
- * But, e.g. if we have a big file, and scroll down, we do want the engine
- * to analyze quickly. Perhaps we want to reinstall first_update in case
- * of expose events or something.
+/* Maximal amount of time (in milliseconds) allowed to spend highlihting a
+ * single line. If it is not enough, the rest of the line is left in the
+ * context reached so far, see analyze_line().
  */
-#define INCREMENTAL_UPDATE_PRIORITY	G_PRIORITY_LOW
 
-/* Maximal amount of time (in milliseconds) allowed to spend in one cycle of
- * background idle.
+/* The lines shown in a view far below the analyzed text are highlighted
+ * speculatively, see speculate_highlight(). The analysis must be at least
+ * SPECULATION_MIN_LINES lines above, and the speculative analysis starts
+ * at most SPECULATION_MAX_LINES lines above the shown lines.
  */
-#define INCREMENTAL_UPDATE_TIME_SLICE	30
-
-/* Maximal amount of time (in milliseconds) allowed to spend highlihting a
- * single line. If it is not enough, then highlighting is disabled.
+#define SPECULATION_MIN_LINES		500
+#define SPECULATION_MAX_LINES		200
+#define SPECULATION_MAX_TIME		10
+#define CHECKPOINT_INTERVAL		100
+#define MAX_CHECKPOINTS			256
+
+/* Size in bytes of the chunks of a Slab, which are aligned on their
+ * size, and number of bits of an id for the position in its chunk.
  */
-#define MAX_TIME_FOR_ONE_LINE		2000
+#define SLAB_CHUNK_SIZE			(1 << 15)
+#define SLAB_INDEX_BITS			11
 
 #define GTK_SOURCE_CONTEXT_ENGINE_ERROR (gtk_source_context_engine_error_quark ())
 
@@ -106,9 +101,18 @@
 #define SEGMENT_IS_SIMPLE(s) CONTEXT_IS_SIMPLE ((s)->context)
 #define SEGMENT_IS_CONTAINER(s) CONTEXT_IS_CONTAINER ((s)->context)
 
+/* The segments and sub patterns of a tree refer to each other by their
+ * 32-bit id in the slabs of the engine, see Slab.
+ */
+#define SEGMENT(ce,id) ((Segment *) slab_get (&(ce)->segments, (id)))
+#define SEGMENT_ID(s) slab_get_id ((s), sizeof (Segment))
+#define SUB_PATTERN(ce,id) ((SubPattern *) slab_get (&(ce)->sub_patterns, (id)))
+#define SUB_PATTERN_ID(sp) slab_get_id ((sp), sizeof (SubPattern))
+
 typedef struct _SubPatternDefinition SubPatternDefinition;
 typedef struct _SubPattern SubPattern;
 typedef struct _Segment Segment;
+typedef struct _SlabChunk SlabChunk;
 typedef struct _Context Context;
 typedef struct _ContextPtr ContextPtr;
 typedef struct _ContextDefinition ContextDefinition;
@@ -116,7 +120,11 @@ typedef struct _DefinitionChild DefinitionChild;
 typedef struct _DefinitionsIter DefinitionsIter;
 typedef struct _LineInfo LineInfo;
 typedef struct _InvalidRegion InvalidRegion;
-typedef struct _ContextClassTag ContextClassTag;
+typedef struct _ContextClassRef ContextClassRef;
+typedef struct _ContextClassRanges ContextClassRanges;
+typedef struct _ClassRange ClassRange;
+typedef struct _Checkpoint Checkpoint;
+typedef struct _TagRun TagRun;
 
 typedef enum _GtkSourceContextEngineError {
 	GTK_SOURCE_CONTEXT_ENGINE_ERROR_DUPLICATED_ID = 0,
@@ -170,8 +178,17 @@ struct _ContextDefinition
 	/* Union of every regular expression we can find from this context. */
 	GtkSourceRegex *reg_all;
 
+	/* The words matched by the regex of a simple context made of
+	 * <keyword>'s, or NULL.
+	 */
+	GtkSourceKeywordTrie *keywords;
+
+	/* The keywords of all the children, which are not in reg_all. */
+	GtkSourceKeywordTrie *children_keywords;
+
 	guint flags : 8;
-	guint ref_count : 24;
+	guint ref_count : 23;
+	guint children_keywords_set : 1;
 };
 
 struct _SubPatternDefinition
@@ -290,21 +307,31 @@ struct _GtkSourceContextReplace
 	gchar *replace_with;
 };
 
+/* The id of a segment or of a sub pattern, 0 for none. */
+typedef guint32 SegmentId;
+typedef guint32 SubPatternId;
+
+/* With 32-bit ids a Segment is 48 bytes on 64-bit systems, in its slab.
+ * With pointers it was 80 bytes, and 96 with the malloc header and
+ * rounding, so the memory of a tree is about halved. A SubPattern is
+ * still 24 bytes, because of the pointer to its definition, but it loses
+ * the 8 bytes of malloc overhead.
+ */
 struct _Segment
 {
-	Segment *parent;
-	Segment *next;
-	Segment *prev;
-	Segment *children;
-	Segment *last_child;
-
 	/* This is NULL if and only if it's a dummy segment which denotes
 	 * inserted or deleted text.
 	 */
 	Context *context;
 
+	SegmentId parent;
+	SegmentId next;
+	SegmentId prev;
+	SegmentId children;
+	SegmentId last_child;
+
 	/* Subpatterns found in this segment. */
-	SubPattern *sub_patterns;
+	SubPatternId sub_patterns;
 
 	/* The context is used in the interval [start_at; end_at). */
 	gint start_at;
@@ -314,7 +341,7 @@ struct _Segment
 	 * of start/end match.
 	 */
 	gint start_len;
-	gint end_len;
+	gint end_len : 31;
 
 	/* Whether this segment is a whole good segment, or it's an end of
 	 * a bigger one left after erase_segments() call.
@@ -327,9 +354,11 @@ struct _SubPattern
 	SubPatternDefinition *definition;
 	gint start_at;
 	gint end_at;
-	SubPattern *next;
+	SubPatternId next;
 };
 
+G_STATIC_ASSERT (sizeof (Segment) == sizeof (gpointer) + 10 * sizeof (guint32));
+
 /* Line terminator characters (\n, \r, \r\n, or unicode paragraph separator)
  * are removed from the line text. The problem is that pcre does not understand
  * arbitrary line terminators, so $ in pcre means (?=\n) (not quite, it's also
@@ -376,18 +405,66 @@ struct _InvalidRegion
 	gint delta;
 };
 
+/* The stack of contexts at the beginning of a line, recorded by the
+ * speculative analysis to resume from there later.
+ */
+struct _Checkpoint
+{
+	gint offset;
+
+	/* Context* from the outermost one, without the root context, ref()'ed. */
+	GSList *contexts;
+};
+
+/* A tag applied to a range of text, see collect_tags(). */
+struct _TagRun
+{
+	GtkTextTag *tag;
+	gint start_at;
+	gint end_at;
+};
+
 struct _GtkSourceContextClass
 {
 	gchar *name;
 	gboolean enabled;
 };
 
-struct _ContextClassTag
+struct _ContextClassRef
 {
-	GtkTextTag *tag;
+	ContextClassRanges *cclass;
 	gboolean enabled;
 };
 
+/* The text having a context class, kept by the engine instead of
+ * being a GtkTextTag, see refresh_context_classes().
+ */
+struct _ContextClassRanges
+{
+	gchar *name;
+
+	/* Sorted ClassRange's, neither overlapping nor adjacent. They are
+	 * a gap buffer of offsets: the ranges from @gap on are stored
+	 * without @gap_delta, so an edit only moves the ranges between the
+	 * previous edit and this one instead of all the ranges after it.
+	 * See class_ranges_move_gap().
+	 */
+	GArray *ranges;
+	guint gap;
+	gint gap_delta;
+
+	/* Tag covering the ranges, only when a consumer asked for it. It
+	 * belongs to the buffer, which keeps it in its tag table.
+	 */
+	GtkTextTag *tag;
+};
+
+struct _ClassRange
+{
+	gint start_at;
+	gint end_at;
+};
+
 struct _GtkSourceContextData
 {
 	guint ref_count;
@@ -396,8 +473,104 @@ struct _GtkSourceContextData
 
 	/* Contains every ContextDefinition indexed by its id. */
 	GHashTable *definitions;
+
+	/* The calls made to fill the definitions, while recording them.
+	 * See _gtk_source_context_data_start_recording(). */
+	GVariantBuilder *recording;
+};
+
+/* Allocator of the segments, or of the sub patterns, of an engine. The
+ * elements are allocated by chunks, and the freed ones are reused before
+ * allocating new chunks, so that a tree is packed in a few blocks of
+ * memory instead of being spread over the heap. A chunk is released
+ * once all of its elements are freed.
+ *
+ * An element is designated by a 32-bit id: the position of its chunk
+ * plus one, then its index in the chunk on SLAB_INDEX_BITS bits. The
+ * chunks are aligned on SLAB_CHUNK_SIZE, so that the id of an element
+ * is found from its address, in the header of its chunk.
+ */
+struct _SlabChunk
+{
+	/* Freed elements, linked through their first pointer. */
+	gpointer free_list;
+
+	/* Id of the first element of the chunk. */
+	guint32 first_id;
+
+	/* Number of elements handed out, freed or not. */
+	guint n_used;
+
+	/* Number of elements allocated and not freed. */
+	guint n_live;
+
+	/* Whether the chunk is in the available chunks of its slab. */
+	guint available : 1;
 };
 
+/* The elements follow the header of their chunk. */
+#define SLAB_HEADER_SIZE ((sizeof (SlabChunk) + 15) & ~(gsize) 15)
+
+typedef struct
+{
+	/* The chunks by position, NULL for the released ones. */
+	GPtrArray *chunks;
+
+	/* The positions of the chunks with room for more elements. */
+	GArray *available;
+
+	/* A chunk emptied and kept for the next one needed, so that
+	 * allocating and freeing around a chunk boundary does not allocate
+	 * and release a chunk each time.
+	 */
+	SlabChunk *spare;
+
+	gsize element_size;
+
+	/* Number of elements in a chunk. */
+	guint n_per_chunk;
+
+	/* Number of chunks in @chunks which are not released. */
+	guint n_chunks;
+
+	/* Number of elements allocated and not freed. */
+	guint n_live;
+
+	/* Number of elements allocated since the slab was created. */
+	guint n_allocated;
+
+	/* Number of chunks released since the slab was created. */
+	guint n_released;
+} Slab;
+
+static inline gpointer
+slab_get (Slab     *slab,
+          guint32   id)
+{
+	guint8 *chunk;
+
+	if (id == 0)
+		return NULL;
+
+	chunk = g_ptr_array_index (slab->chunks, (id >> SLAB_INDEX_BITS) - 1);
+
+	return chunk + SLAB_HEADER_SIZE + (id & ((1 << SLAB_INDEX_BITS) - 1)) * slab->element_size;
+}
+
+static inline guint32
+slab_get_id (gconstpointer element,
+             gsize         element_size)
+{
+	const SlabChunk *chunk;
+
+	if (element == NULL)
+		return 0;
+
+	chunk = (const SlabChunk *) ((guintptr) element & ~(guintptr) (SLAB_CHUNK_SIZE - 1));
+
+	return chunk->first_id + ((const guint8 *) element - (const guint8 *) chunk - SLAB_HEADER_SIZE) / element_size;
+}
+
 struct _GtkSourceContextEngine
 {
 	GObject parent_instance;
@@ -410,23 +583,44 @@ struct _GtkSourceContextEngine
 	/* All tags indexed by style name: values are GSList's of tags, ref()'ed. */
 	GHashTable *tags;
 
+	/* All the tags of @tags, to find them among the buffer tags. */
+	GHashTable *tag_set;
+
 	/* Number of all syntax tags created by the engine, needed to set
 	 * correct tag priorities.
 	 */
 	guint n_tags;
 
-	/* List of GtkTextTag* for context classes. */
-	GSList *context_classes;
+	/* Tag toggles added and removed in the buffer since the last change
+	 * of the text, for profiling and the tests.
+	 */
+	guint toggles_added;
+	guint toggles_removed;
+
+	/* ContextClassRanges* indexed by name. */
+	GHashTable *context_classes;
 
 	/* Whether or not to actually highlight the buffer. */
 	gboolean highlight;
 
-	/* Whether syntax analysis was disabled because of errors. */
-	gboolean disabled;
+	/* The number of bytes of a line analyzed at most, 0 for no limit. */
+	guint max_line_length;
+
+	/* The time in milliseconds spent at most analyzing a line, 0 for
+	 * no limit.
+	 */
+	guint max_line_time;
 
 	/* Region covering the unhighlighted text. */
 	GtkSourceRegion *refresh_region;
 
+	/* Lines reported as degraded, and the ones still to report from
+	 * degraded_handler.
+	 */
+	GtkSourceRegion *degraded_region;
+	GtkSourceRegion *degraded_pending;
+	gsize degraded_handler;
+
 	/* Tree of contexts. */
 	Context *root_context;
 	Segment *root_segment;
@@ -437,21 +631,44 @@ struct _GtkSourceContextEngine
 	GSList *invalid;
 	InvalidRegion invalid_region;
 
-	guint first_update;
-	guint incremental_update;
+	/* Visible scheduler work analyzing the invalid areas right after a
+	 * modification, before the redraw.
+	 */
+	gsize first_update;
+
+	/* Scheduler handler analyzing the invalid areas in background. */
+	gsize update_handler;
+
+	/* Tree of contexts of the lines highlighted ahead of the analysis,
+	 * separate from the main one. The text in
+	 * [spec_highlighted_start; spec_root->end_at) is tagged according
+	 * to it until the analysis confirms or corrects the tags.
+	 */
+	Segment *spec_root;
+	Segment *spec_state;
+	gint spec_highlighted_start;
+
+	/* Checkpoint's sorted by offset. */
+	GArray *checkpoints;
+
+	/* Allocators of the Segment's and SubPattern's of both trees. */
+	Slab segments;
+	Slab sub_patterns;
 };
 
 #ifdef ENABLE_CHECK_TREE
 static void check_tree             (GtkSourceContextEngine *ce);
-static void check_segment_list     (Segment                *segment);
-static void check_segment_children (Segment                *segment);
+static void check_segment_list     (GtkSourceContextEngine *ce,
+                                    Segment                *segment);
+static void check_segment_children (GtkSourceContextEngine *ce,
+                                    Segment                *segment);
 #define CHECK_TREE check_tree
 #define CHECK_SEGMENT_LIST check_segment_list
 #define CHECK_SEGMENT_CHILDREN check_segment_children
 #else
 #define CHECK_TREE(ce)
-#define CHECK_SEGMENT_LIST(s)
-#define CHECK_SEGMENT_CHILDREN(s)
+#define CHECK_SEGMENT_LIST(ce, s)
+#define CHECK_SEGMENT_CHILDREN(ce, s)
 #endif
 
 static GQuark             gtk_source_context_engine_error_quark (void);
@@ -482,7 +699,8 @@ static void               erase_segments                        (GtkSourceContex
                                                                  Segment                 *hint);
 static void               segment_remove                        (GtkSourceContextEngine  *ce,
                                                                  Segment                 *segment);
-static void               find_insertion_place                  (Segment                 *segment,
+static void               find_insertion_place                  (GtkSourceContextEngine  *ce,
+                                                                 Segment                 *segment,
                                                                  gint                     offset,
                                                                  Segment                **parent,
                                                                  Segment                **prev,
@@ -492,7 +710,8 @@ static void               segment_destroy                       (GtkSourceContex
                                                                  Segment                 *segment);
 static ContextDefinition *context_definition_ref                (ContextDefinition       *definition);
 static void               context_definition_unref              (ContextDefinition       *definition);
-static void               segment_extend                        (Segment                 *state,
+static void               segment_extend                        (GtkSourceContextEngine  *ce,
+                                                                 Segment                 *state,
                                                                  gint                     end_at);
 static Context           *ancestor_context_ends_here            (Context                 *state,
                                                                  LineInfo                *line,
@@ -504,8 +723,15 @@ static void               definition_iter_destroy               (DefinitionsIter
 static void               update_syntax                         (GtkSourceContextEngine  *ce,
                                                                  const GtkTextIter       *end,
                                                                  gint                     time);
-static void               install_idle_worker                   (GtkSourceContextEngine  *ce);
+static void               install_update_worker                 (GtkSourceContextEngine  *ce);
 static void               install_first_update                  (GtkSourceContextEngine  *ce);
+static void               speculate_highlight                   (GtkSourceContextEngine  *ce,
+                                                                 const GtkTextIter       *start,
+                                                                 const GtkTextIter       *end);
+static void               invalidate_speculation                (GtkSourceContextEngine  *ce,
+                                                                 gint                     offset);
+static void               clear_speculation                     (GtkSourceContextEngine  *ce);
+static void               checkpoint_clear                      (Checkpoint              *checkpoint);
 
 static ContextDefinition *
 gtk_source_context_data_lookup (GtkSourceContextData *ctx_data,
@@ -556,22 +782,22 @@ gtk_source_context_class_free (GtkSourceContextClass *cclass)
 	g_slice_free (GtkSourceContextClass, cclass);
 }
 
-static ContextClassTag *
-context_class_tag_new (GtkTextTag *tag,
-                       gboolean    enabled)
+static ContextClassRef *
+context_class_ref_new (ContextClassRanges *cclass,
+                       gboolean            enabled)
 {
-	ContextClassTag *attrtag = g_slice_new (ContextClassTag);
+	ContextClassRef *ref = g_slice_new (ContextClassRef);
 
-	attrtag->tag = tag;
-	attrtag->enabled = enabled;
+	ref->cclass = cclass;
+	ref->enabled = enabled;
 
-	return attrtag;
+	return ref;
 }
 
 static void
-context_class_tag_free (ContextClassTag *attrtag)
+context_class_ref_free (ContextClassRef *ref)
 {
-	g_slice_free (ContextClassTag, attrtag);
+	g_slice_free (ContextClassRef, ref);
 }
 
 struct BufAndIters {
@@ -673,6 +899,7 @@ create_tag (GtkSourceContextEngine *ce,
 	 * higher than highlighting tags created before */
 	gtk_text_tag_set_priority (new_tag, ce->n_tags);
 	set_tag_style (ce, new_tag, style_id);
+	g_hash_table_add (ce->tag_set, new_tag);
 	ce->n_tags += 1;
 
 	return new_tag;
@@ -797,15 +1024,24 @@ get_context_tag (GtkSourceContextEngine *ce,
 	return context->tag;
 }
 
+/**
+ * collect_tags:
+ * @ce: a #GtkSourceContextEngine.
+ * @segment: the segment.
+ * @start_offset: the beginning of the area.
+ * @end_offset: the end of the area.
+ * @runs: (element-type TagRun): array to append the tags to.
+ *
+ * Finds the tags @segment and its children give to the area.
+ */
 static void
-apply_tags (GtkSourceContextEngine *ce,
-            Segment                *segment,
-            gint                    start_offset,
-            gint                    end_offset)
+collect_tags (GtkSourceContextEngine *ce,
+              Segment                *segment,
+              gint                    start_offset,
+              gint                    end_offset,
+              GArray                 *runs)
 {
-	GtkTextTag *tag;
-	GtkTextIter start_iter, end_iter;
-	GtkTextBuffer *buffer = ce->buffer;
+	TagRun run;
 	SubPattern *sp;
 	Segment *child;
 
@@ -820,60 +1056,302 @@ apply_tags (GtkSourceContextEngine *ce,
 	start_offset = MAX (start_offset, segment->start_at);
 	end_offset = MIN (end_offset, segment->end_at);
 
-	tag = get_context_tag (ce, segment->context);
+	run.tag = get_context_tag (ce, segment->context);
 
-	if (tag != NULL)
+	if (run.tag != NULL)
 	{
-		gint style_start_at, style_end_at;
-
-		style_start_at = start_offset;
-		style_end_at = end_offset;
+		run.start_at = start_offset;
+		run.end_at = end_offset;
 
 		if (HAS_OPTION (segment->context->definition, STYLE_INSIDE))
 		{
-			style_start_at = MAX (segment->start_at + segment->start_len, start_offset);
-			style_end_at = MIN (segment->end_at - segment->end_len, end_offset);
+			run.start_at = MAX (segment->start_at + segment->start_len, start_offset);
+			run.end_at = MIN (segment->end_at - segment->end_len, end_offset);
 		}
 
-		if (style_start_at > style_end_at)
-		{
+		if (run.start_at > run.end_at)
 			g_critical ("%s: oops", G_STRLOC);
+		else
+			g_array_append_val (runs, run);
+	}
+
+	for (sp = SUB_PATTERN (ce, segment->sub_patterns); sp != NULL; sp = SUB_PATTERN (ce, sp->next))
+	{
+		if (sp->start_at >= start_offset && sp->end_at <= end_offset)
+		{
+			run.start_at = MAX (start_offset, sp->start_at);
+			run.end_at = MIN (end_offset, sp->end_at);
+			run.tag = get_subpattern_tag (ce, segment->context, sp->definition);
+
+			if (run.tag != NULL)
+				g_array_append_val (runs, run);
 		}
+	}
+
+	for (child = SEGMENT (ce, segment->children);
+	     child != NULL && child->start_at < end_offset;
+	     child = SEGMENT (ce, child->next))
+	{
+		if (child->end_at > start_offset)
+			collect_tags (ce, child, start_offset, end_offset, runs);
+	}
+}
+
+static gint
+tag_run_cmp (gconstpointer a,
+             gconstpointer b)
+{
+	const TagRun *run1 = a;
+	const TagRun *run2 = b;
+
+	if (run1->tag != run2->tag)
+		return GPOINTER_TO_SIZE (run1->tag) < GPOINTER_TO_SIZE (run2->tag) ? -1 : 1;
+
+	return run1->start_at - run2->start_at;
+}
+
+/**
+ * normalize_tag_runs:
+ * @runs: (element-type TagRun): the runs.
+ *
+ * Sorts the runs by tag and offset, and merges the overlapping and
+ * adjacent runs of a tag, as the buffer does.
+ */
+static void
+normalize_tag_runs (GArray *runs)
+{
+	guint i, n = 0;
+
+	g_array_sort (runs, tag_run_cmp);
+
+	for (i = 0; i < runs->len; i++)
+	{
+		TagRun run = g_array_index (runs, TagRun, i);
+		TagRun *last = n > 0 ? &g_array_index (runs, TagRun, n - 1) : NULL;
+
+		if (run.start_at == run.end_at)
+			continue;
+
+		if (last != NULL && last->tag == run.tag && run.start_at <= last->end_at)
+			last->end_at = MAX (last->end_at, run.end_at);
 		else
+			g_array_index (runs, TagRun, n++) = run;
+	}
+
+	g_array_set_size (runs, n);
+}
+
+/**
+ * get_buffer_tags:
+ * @ce: a #GtkSourceContextEngine.
+ * @start: the beginning of the area.
+ * @end: the end of the area.
+ * @runs: (element-type TagRun): array to append the tags to.
+ *
+ * Finds the ranges of the engine tags currently in the area, walking
+ * its tag toggles.
+ */
+static void
+get_buffer_tags (GtkSourceContextEngine *ce,
+                 const GtkTextIter      *start,
+                 const GtkTextIter      *end,
+                 GArray                 *runs)
+{
+	GHashTable *open_tags;
+	GHashTableIter hash_iter;
+	GtkTextIter iter;
+	GSList *tags, *l;
+	gpointer key, value;
+	gint start_offset, end_offset;
+
+	open_tags = g_hash_table_new (NULL, NULL);
+	start_offset = gtk_text_iter_get_offset (start);
+	end_offset = gtk_text_iter_get_offset (end);
+
+	tags = gtk_text_iter_get_tags (start);
+	for (l = tags; l != NULL; l = l->next)
+	{
+		if (g_hash_table_contains (ce->tag_set, l->data))
+			g_hash_table_insert (open_tags, l->data, GINT_TO_POINTER (start_offset));
+	}
+	g_slist_free (tags);
+
+	iter = *start;
+
+	while (gtk_text_iter_forward_to_tag_toggle (&iter, NULL) &&
+	       gtk_text_iter_compare (&iter, end) < 0)
+	{
+		gint offset = gtk_text_iter_get_offset (&iter);
+
+		tags = gtk_text_iter_get_toggled_tags (&iter, FALSE);
+		for (l = tags; l != NULL; l = l->next)
 		{
-			gtk_text_buffer_get_iter_at_offset (buffer, &start_iter, style_start_at);
-			end_iter = start_iter;
-			gtk_text_iter_forward_chars (&end_iter, style_end_at - style_start_at);
-			gtk_text_buffer_apply_tag (ce->buffer, tag, &start_iter, &end_iter);
+			if (g_hash_table_lookup_extended (open_tags, l->data, NULL, &value))
+			{
+				TagRun run = { l->data, GPOINTER_TO_INT (value), offset };
+
+				g_array_append_val (runs, run);
+				g_hash_table_remove (open_tags, l->data);
+			}
 		}
+		g_slist_free (tags);
+
+		tags = gtk_text_iter_get_toggled_tags (&iter, TRUE);
+		for (l = tags; l != NULL; l = l->next)
+		{
+			if (g_hash_table_contains (ce->tag_set, l->data))
+				g_hash_table_insert (open_tags, l->data, GINT_TO_POINTER (offset));
+		}
+		g_slist_free (tags);
 	}
 
-	for (sp = segment->sub_patterns; sp != NULL; sp = sp->next)
+	g_hash_table_iter_init (&hash_iter, open_tags);
+	while (g_hash_table_iter_next (&hash_iter, &key, &value))
 	{
-		if (sp->start_at >= start_offset && sp->end_at <= end_offset)
+		TagRun run = { key, GPOINTER_TO_INT (value), end_offset };
+
+		g_array_append_val (runs, run);
+	}
+
+	g_hash_table_destroy (open_tags);
+}
+
+/**
+ * change_tag_difference:
+ * @ce: a #GtkSourceContextEngine.
+ * @runs1: normalized runs of a tag.
+ * @n_runs1: the number of @runs1.
+ * @runs2: normalized runs of the same tag.
+ * @n_runs2: the number of @runs2.
+ * @apply: whether to apply or to remove the tag.
+ *
+ * Applies or removes the tag on the text covered by @runs1 but not
+ * by @runs2.
+ *
+ * Returns: the number of ranges changed.
+ */
+static guint
+change_tag_difference (GtkSourceContextEngine *ce,
+                       const TagRun           *runs1,
+                       guint                   n_runs1,
+                       const TagRun           *runs2,
+                       guint                   n_runs2,
+                       gboolean                apply)
+{
+	guint i, j = 0;
+	guint n_changed = 0;
+
+	for (i = 0; i < n_runs1; i++)
+	{
+		gint pos = runs1[i].start_at;
+
+		while (pos < runs1[i].end_at)
 		{
-			gint start = MAX (start_offset, sp->start_at);
-			gint end = MIN (end_offset, sp->end_at);
+			GtkTextIter start_iter, end_iter;
+			gint change_end = runs1[i].end_at;
 
-			tag = get_subpattern_tag (ce, segment->context, sp->definition);
+			while (j < n_runs2 && runs2[j].end_at <= pos)
+				j++;
 
-			if (tag != NULL)
+			/* The tag is already as it should be here. */
+			if (j < n_runs2 && runs2[j].start_at <= pos)
 			{
-				gtk_text_buffer_get_iter_at_offset (buffer, &start_iter, start);
-				end_iter = start_iter;
-				gtk_text_iter_forward_chars (&end_iter, end - start);
-				gtk_text_buffer_apply_tag (ce->buffer, tag, &start_iter, &end_iter);
+				pos = runs2[j].end_at;
+				continue;
 			}
+
+			if (j < n_runs2)
+				change_end = MIN (change_end, runs2[j].start_at);
+
+			gtk_text_buffer_get_iter_at_offset (ce->buffer, &start_iter, pos);
+			end_iter = start_iter;
+			gtk_text_iter_forward_chars (&end_iter, change_end - pos);
+
+			if (apply)
+				gtk_text_buffer_apply_tag (ce->buffer, runs1[i].tag, &start_iter, &end_iter);
+			else
+				gtk_text_buffer_remove_tag (ce->buffer, runs1[i].tag, &start_iter, &end_iter);
+
+			n_changed++;
+			pos = change_end;
 		}
 	}
 
-	for (child = segment->children;
-	     child != NULL && child->start_at < end_offset;
-	     child = child->next)
+	return n_changed;
+}
+
+/**
+ * update_tags:
+ * @ce: a #GtkSourceContextEngine.
+ * @segment: the root of the tree giving the tags.
+ * @start: the beginning of the area.
+ * @end: the end of the area.
+ *
+ * Makes the engine tags in the area match the tree. The tags are
+ * compared with the ones already in the buffer, so that only the
+ * ranges that change are touched, and redrawn.
+ */
+static void
+update_tags (GtkSourceContextEngine *ce,
+             Segment                *segment,
+             const GtkTextIter      *start,
+             const GtkTextIter      *end)
+{
+	GArray *wanted;
+	GArray *current;
+	guint i = 0, j = 0;
+	guint added = 0, removed = 0;
+
+	if (gtk_text_iter_equal (start, end))
+		return;
+
+	wanted = g_array_new (FALSE, FALSE, sizeof (TagRun));
+	current = g_array_new (FALSE, FALSE, sizeof (TagRun));
+
+	collect_tags (ce, segment,
+		      gtk_text_iter_get_offset (start),
+		      gtk_text_iter_get_offset (end),
+		      wanted);
+	get_buffer_tags (ce, start, end, current);
+
+	normalize_tag_runs (wanted);
+	normalize_tag_runs (current);
+
+	/* Both arrays are sorted by tag, handle one tag at a time. */
+	while (i < wanted->len || j < current->len)
 	{
-		if (child->end_at > start_offset)
-			apply_tags (ce, child, start_offset, end_offset);
+		const TagRun *wanted_runs = (const TagRun *) wanted->data + i;
+		const TagRun *current_runs = (const TagRun *) current->data + j;
+		GtkTextTag *tag;
+		guint n_wanted = 0, n_current = 0;
+
+		if (j == current->len ||
+		    (i < wanted->len && tag_run_cmp (wanted_runs, current_runs) < 0))
+			tag = wanted_runs->tag;
+		else
+			tag = current_runs->tag;
+
+		while (i + n_wanted < wanted->len && wanted_runs[n_wanted].tag == tag)
+			n_wanted++;
+		while (j + n_current < current->len && current_runs[n_current].tag == tag)
+			n_current++;
+
+		removed += change_tag_difference (ce, current_runs, n_current, wanted_runs, n_wanted, FALSE);
+		added += change_tag_difference (ce, wanted_runs, n_wanted, current_runs, n_current, TRUE);
+
+		i += n_wanted;
+		j += n_current;
 	}
+
+	/* Each range has two toggles. */
+	ce->toggles_added += 2 * added;
+	ce->toggles_removed += 2 * removed;
+
+	GTK_SOURCE_PROFILER_LOG ("tag toggles since the last change: %u added, %u removed",
+	                         ce->toggles_added, ce->toggles_removed);
+
+	g_array_unref (wanted);
+	g_array_unref (current);
 }
 
 static void
@@ -894,12 +1372,7 @@ highlight_region (GtkSourceContextEngine *ce,
 	timer = g_timer_new ();
 #endif
 
-	/* First we need to delete tags in the regions. */
-	unhighlight_region (ce, start, end);
-
-	apply_tags (ce, ce->root_segment,
-		    gtk_text_iter_get_offset (start),
-		    gtk_text_iter_get_offset (end));
+	update_tags (ce, ce->root_segment, start, end);
 
 #ifdef ENABLE_PROFILE
 	g_print ("highlight (from %d to %d), %g ms elapsed\n",
@@ -954,62 +1427,303 @@ ensure_highlighted (GtkSourceContextEngine *ce,
 	gtk_source_region_subtract_subregion (ce->refresh_region, start, end);
 }
 
-static GtkTextTag *
-get_context_class_tag (GtkSourceContextEngine *ce,
-                       gchar const            *name)
+/* CONTEXT CLASSES -------------------------------------------------------- */
+
+static inline ClassRange
+class_range_get (ContextClassRanges *cclass,
+                 guint               i)
 {
-	gchar *tag_name;
-	GtkTextTagTable *tag_table;
-	GtkTextTag *tag;
+	ClassRange range = g_array_index (cclass->ranges, ClassRange, i);
+
+	if (i >= cclass->gap)
+	{
+		range.start_at += cclass->gap_delta;
+		range.end_at += cclass->gap_delta;
+	}
+
+	return range;
+}
 
-	tag_name = g_strdup_printf ("gtksourceview:context-classes:%s", name);
+/**
+ * class_ranges_move_gap:
+ * @cclass: a #ContextClassRanges.
+ * @gap: the new position of the gap.
+ *
+ * Moves the gap of the ranges of @cclass so that the ranges before
+ * @gap hold their real offsets and can be changed, added or removed.
+ * Consecutive edits are usually close to each other, so the gap only
+ * moves a little.
+ */
+static void
+class_ranges_move_gap (ContextClassRanges *cclass,
+                       guint               gap)
+{
+	GArray *ranges = cclass->ranges;
+
+	for (; cclass->gap < gap; cclass->gap++)
+	{
+		ClassRange *range = &g_array_index (ranges, ClassRange, cclass->gap);
 
-	tag_table = gtk_text_buffer_get_tag_table (ce->buffer);
-	tag = gtk_text_tag_table_lookup (tag_table, tag_name);
+		range->start_at += cclass->gap_delta;
+		range->end_at += cclass->gap_delta;
+	}
 
-	if (tag == NULL)
+	for (; cclass->gap > gap; cclass->gap--)
 	{
-		tag = gtk_text_buffer_create_tag (ce->buffer, tag_name, NULL);
-		g_return_val_if_fail (tag != NULL, NULL);
+		ClassRange *range = &g_array_index (ranges, ClassRange, cclass->gap - 1);
 
-		ce->context_classes = g_slist_prepend (ce->context_classes,
-							     g_object_ref (tag));
+		range->start_at -= cclass->gap_delta;
+		range->end_at -= cclass->gap_delta;
 	}
 
-	g_free (tag_name);
-	return tag;
+	if (cclass->gap == ranges->len)
+		cclass->gap_delta = 0;
 }
 
-static GSList *
-extend_context_classes (GtkSourceContextEngine *ce,
-                        GSList                 *definitions)
+/**
+ * find_class_range:
+ * @cclass: a #ContextClassRanges.
+ * @offset: the offset.
+ *
+ * Returns: the index of the first range ending after @offset, or the
+ * number of ranges.
+ */
+static guint
+find_class_range (ContextClassRanges *cclass,
+                  gint                offset)
 {
-	GSList *item;
-	GSList *ret = NULL;
+	guint lo = 0;
+	guint hi = cclass->ranges->len;
 
-	for (item = definitions; item != NULL; item = g_slist_next (item))
+	while (lo < hi)
 	{
-		GtkSourceContextClass *cclass = item->data;
-		ContextClassTag *attrtag = context_class_tag_new (get_context_class_tag (ce, cclass->name),
-		                                                  cclass->enabled);
+		guint mid = (lo + hi) / 2;
 
-		ret = g_slist_prepend (ret, attrtag);
+		if (class_range_get (cclass, mid).end_at <= offset)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
 
-	return g_slist_reverse (ret);
+	return lo;
 }
 
-static GSList *
-get_subpattern_context_classes (GtkSourceContextEngine *ce,
-                                Context                *context,
-                                SubPatternDefinition   *sp_def)
+static void
+remove_class_range (ContextClassRanges *cclass,
+                    gint                start,
+                    gint                end)
 {
-	g_assert (sp_def->index < context->definition->n_sub_patterns);
+	GArray *ranges = cclass->ranges;
+	guint i = find_class_range (cclass, start);
+	guint first = i;
+	guint last;
 
-	if (context->subpattern_context_classes == NULL)
-		context->subpattern_context_classes = g_new0 (GSList *, context->definition->n_sub_patterns);
+	if (start >= end || i == ranges->len)
+		return;
 
-	if (context->subpattern_context_classes[sp_def->index] == NULL)
+	/* The ranges touched are the ones before the gap. */
+	for (last = i; last < ranges->len; last++)
+	{
+		if (class_range_get (cclass, last).start_at >= end)
+			break;
+	}
+
+	class_ranges_move_gap (cclass, MIN (last + 1, ranges->len));
+
+	/* A range containing the whole area is split. */
+	{
+		ClassRange *range = &g_array_index (ranges, ClassRange, i);
+
+		if (range->start_at < start && range->end_at > end)
+		{
+			ClassRange tail = { end, range->end_at };
+
+			range->end_at = start;
+			g_array_insert_val (ranges, i + 1, tail);
+			cclass->gap++;
+			return;
+		}
+
+		if (range->start_at < start)
+		{
+			range->end_at = start;
+			first = ++i;
+		}
+	}
+
+	while (i < ranges->len && g_array_index (ranges, ClassRange, i).end_at <= end)
+		i++;
+
+	if (i < cclass->gap)
+	{
+		ClassRange *range = &g_array_index (ranges, ClassRange, i);
+
+		if (range->start_at < end)
+			range->start_at = end;
+	}
+
+	if (i > first)
+	{
+		g_array_remove_range (ranges, first, i - first);
+		cclass->gap -= i - first;
+	}
+}
+
+static void
+add_class_range (ContextClassRanges *cclass,
+                 gint                start,
+                 gint                end)
+{
+	GArray *ranges = cclass->ranges;
+	ClassRange new_range = { start, end };
+	guint i, n;
+
+	if (start >= end)
+		return;
+
+	/* The ranges touching the new one are merged into it. */
+	i = find_class_range (cclass, start - 1);
+
+	for (n = 0; i + n < ranges->len; n++)
+	{
+		ClassRange range = class_range_get (cclass, i + n);
+
+		if (range.start_at > end)
+			break;
+
+		new_range.start_at = MIN (new_range.start_at, range.start_at);
+		new_range.end_at = MAX (new_range.end_at, range.end_at);
+	}
+
+	class_ranges_move_gap (cclass, i + n);
+
+	if (n > 0)
+		g_array_remove_range (ranges, i, n);
+
+	g_array_insert_val (ranges, i, new_range);
+	cclass->gap = cclass->gap - n + 1;
+}
+
+static void
+context_class_ranges_free (ContextClassRanges *cclass)
+{
+	g_clear_object (&cclass->tag);
+	g_array_unref (cclass->ranges);
+	g_free (cclass->name);
+	g_slice_free (ContextClassRanges, cclass);
+}
+
+static ContextClassRanges *
+get_context_class_ranges (GtkSourceContextEngine *ce,
+                          gchar const            *name)
+{
+	ContextClassRanges *cclass;
+
+	cclass = g_hash_table_lookup (ce->context_classes, name);
+
+	if (cclass == NULL)
+	{
+		cclass = g_slice_new0 (ContextClassRanges);
+		cclass->name = g_strdup (name);
+		cclass->ranges = g_array_new (FALSE, FALSE, sizeof (ClassRange));
+		g_hash_table_insert (ce->context_classes, cclass->name, cclass);
+	}
+
+	return cclass;
+}
+
+/**
+ * sync_context_class_tag:
+ * @ce: a #GtkSourceContextEngine.
+ * @cclass: a context class with a tag.
+ * @start: the beginning of the area.
+ * @end: the end of the area.
+ *
+ * Makes the tag of @cclass cover the ranges of the class in the area.
+ */
+static void
+sync_context_class_tag (GtkSourceContextEngine   *ce,
+                        ContextClassRanges       *cclass,
+                        gint                      start,
+                        gint                      end)
+{
+	GtkTextIter start_iter, end_iter;
+	guint i;
+
+	gtk_text_buffer_get_iter_at_offset (ce->buffer, &start_iter, start);
+	gtk_text_buffer_get_iter_at_offset (ce->buffer, &end_iter, end);
+	gtk_text_buffer_remove_tag (ce->buffer, cclass->tag, &start_iter, &end_iter);
+
+	for (i = find_class_range (cclass, start); i < cclass->ranges->len; i++)
+	{
+		ClassRange range = class_range_get (cclass, i);
+
+		if (range.start_at >= end)
+			break;
+
+		gtk_text_buffer_get_iter_at_offset (ce->buffer, &start_iter, MAX (start, range.start_at));
+		gtk_text_buffer_get_iter_at_offset (ce->buffer, &end_iter, MIN (end, range.end_at));
+		gtk_text_buffer_apply_tag (ce->buffer, cclass->tag, &start_iter, &end_iter);
+	}
+}
+
+static GtkTextTag *
+ensure_context_class_tag (GtkSourceContextEngine *ce,
+                          const gchar            *name)
+{
+	ContextClassRanges *cclass = get_context_class_ranges (ce, name);
+
+	if (cclass->tag == NULL)
+	{
+		GtkTextTagTable *tag_table;
+		gchar *tag_name;
+
+		tag_name = g_strdup_printf ("gtksourceview:context-classes:%s", name);
+		tag_table = gtk_text_buffer_get_tag_table (ce->buffer);
+		cclass->tag = gtk_text_tag_table_lookup (tag_table, tag_name);
+
+		if (cclass->tag == NULL)
+			cclass->tag = gtk_text_buffer_create_tag (ce->buffer, tag_name, NULL);
+
+		g_object_ref (cclass->tag);
+		g_free (tag_name);
+
+		sync_context_class_tag (ce, cclass, 0, gtk_text_buffer_get_char_count (ce->buffer));
+	}
+
+	return cclass->tag;
+}
+
+static GSList *
+extend_context_classes (GtkSourceContextEngine *ce,
+                        GSList                 *definitions)
+{
+	GSList *item;
+	GSList *ret = NULL;
+
+	for (item = definitions; item != NULL; item = g_slist_next (item))
+	{
+		GtkSourceContextClass *cclass = item->data;
+		ContextClassRef *ref = context_class_ref_new (get_context_class_ranges (ce, cclass->name),
+		                                              cclass->enabled);
+
+		ret = g_slist_prepend (ret, ref);
+	}
+
+	return g_slist_reverse (ret);
+}
+
+static GSList *
+get_subpattern_context_classes (GtkSourceContextEngine *ce,
+                                Context                *context,
+                                SubPatternDefinition   *sp_def)
+{
+	g_assert (sp_def->index < context->definition->n_sub_patterns);
+
+	if (context->subpattern_context_classes == NULL)
+		context->subpattern_context_classes = g_new0 (GSList *, context->definition->n_sub_patterns);
+
+	if (context->subpattern_context_classes[sp_def->index] == NULL)
 	{
 		context->subpattern_context_classes[sp_def->index] =
 				extend_context_classes (ce,
@@ -1039,32 +1753,132 @@ apply_context_classes (GtkSourceContextEngine *ce,
                        gint                    start,
                        gint                    end)
 {
-	GtkTextIter start_iter;
-	GtkTextIter end_iter;
 	GSList *item;
 
-	gtk_text_buffer_get_iter_at_offset (ce->buffer, &start_iter, start);
-	end_iter = start_iter;
-	gtk_text_iter_forward_chars (&end_iter, end - start);
-
 	for (item = context_classes; item != NULL; item = g_slist_next (item))
 	{
-		ContextClassTag *attrtag = item->data;
+		ContextClassRef *ref = item->data;
 
-		if (attrtag->enabled)
+		if (ref->enabled)
+			add_class_range (ref->cclass, start, end);
+		else
+			remove_class_range (ref->cclass, start, end);
+	}
+}
+
+/**
+ * context_classes_text_inserted:
+ * @ce: a #GtkSourceContextEngine.
+ * @offset: the beginning of the inserted text.
+ * @length: the length of the inserted text.
+ *
+ * Moves the ranges of the context classes after @offset, like the
+ * tags of the buffer: a range containing @offset grows. Only the gap
+ * of the ranges moves to @offset.
+ */
+static void
+context_classes_text_inserted (GtkSourceContextEngine *ce,
+                               gint                    offset,
+                               gint                    length)
+{
+	GHashTableIter iter;
+	ContextClassRanges *cclass;
+
+	g_hash_table_iter_init (&iter, ce->context_classes);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &cclass))
+	{
+		guint i = find_class_range (cclass, offset);
+
+		if (i == cclass->ranges->len)
+			continue;
+
+		if (class_range_get (cclass, i).start_at < offset)
 		{
-			gtk_text_buffer_apply_tag (ce->buffer,
-			                           attrtag->tag,
-			                           &start_iter,
-			                           &end_iter);
+			class_ranges_move_gap (cclass, i + 1);
+			g_array_index (cclass->ranges, ClassRange, i).end_at += length;
 		}
 		else
 		{
-			gtk_text_buffer_remove_tag (ce->buffer,
-			                            attrtag->tag,
-			                            &start_iter,
-			                            &end_iter);
+			class_ranges_move_gap (cclass, i);
+		}
+
+		cclass->gap_delta += length;
+	}
+}
+
+static inline gint
+class_offset_after_delete (gint offset,
+                           gint start,
+                           gint length)
+{
+	if (offset <= start)
+		return offset;
+	if (offset >= start + length)
+		return offset - length;
+	return start;
+}
+
+/**
+ * context_classes_text_deleted:
+ * @ce: a #GtkSourceContextEngine.
+ * @offset: the beginning of the deleted text.
+ * @length: the length of the deleted text.
+ *
+ * Moves the ranges of the context classes after @offset, dropping the
+ * ones that were deleted and joining the ones that now touch.
+ */
+static void
+context_classes_text_deleted (GtkSourceContextEngine *ce,
+                              gint                    offset,
+                              gint                    length)
+{
+	GHashTableIter iter;
+	ContextClassRanges *cclass;
+
+	g_hash_table_iter_init (&iter, ce->context_classes);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &cclass))
+	{
+		GArray *ranges = cclass->ranges;
+		guint first, last, i, n;
+
+		/* Start at the range before the deleted text, it may have
+		 * to be joined with the one after. */
+		first = find_class_range (cclass, offset);
+		if (first > 0)
+			first--;
+
+		/* The ranges starting after the deleted text only move. */
+		for (last = first; last < ranges->len; last++)
+		{
+			if (class_range_get (cclass, last).start_at > offset + length)
+				break;
+		}
+
+		class_ranges_move_gap (cclass, last);
+
+		for (i = n = first; i < last; i++)
+		{
+			ClassRange range = g_array_index (ranges, ClassRange, i);
+
+			range.start_at = class_offset_after_delete (range.start_at, offset, length);
+			range.end_at = class_offset_after_delete (range.end_at, offset, length);
+
+			if (range.start_at == range.end_at)
+				continue;
+
+			if (n > first && g_array_index (ranges, ClassRange, n - 1).end_at >= range.start_at)
+				g_array_index (ranges, ClassRange, n - 1).end_at = range.end_at;
+			else
+				g_array_index (ranges, ClassRange, n++) = range;
+		}
+
+		if (n < last)
+		{
+			g_array_remove_range (ranges, n, last - n);
+			cclass->gap = n;
 		}
+
+		cclass->gap_delta -= length;
 	}
 }
 
@@ -1103,7 +1917,7 @@ add_region_context_classes (GtkSourceContextEngine *ce,
 		                       end_offset);
 	}
 
-	for (sp = segment->sub_patterns; sp != NULL; sp = sp->next)
+	for (sp = SUB_PATTERN (ce, segment->sub_patterns); sp != NULL; sp = SUB_PATTERN (ce, sp->next))
 	{
 		if (sp->start_at >= start_offset && sp->end_at <= end_offset)
 		{
@@ -1124,9 +1938,9 @@ add_region_context_classes (GtkSourceContextEngine *ce,
 		}
 	}
 
-	for (child = segment->children;
+	for (child = SEGMENT (ce, segment->children);
 	     child != NULL && child->start_at < end_offset;
-	     child = child->next)
+	     child = SEGMENT (ce, child->next))
 	{
 		if (child->end_at > start_offset)
 		{
@@ -1137,24 +1951,42 @@ add_region_context_classes (GtkSourceContextEngine *ce,
 
 static void
 remove_region_context_classes (GtkSourceContextEngine *ce,
-                               const GtkTextIter      *start,
-                               const GtkTextIter      *end)
+                               gint                    start,
+                               gint                    end)
 {
-	GSList *l;
+	GHashTableIter iter;
+	ContextClassRanges *cclass;
 
-	if (gtk_text_iter_equal (start, end))
-	{
-		return;
-	}
+	g_hash_table_iter_init (&iter, ce->context_classes);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &cclass))
+		remove_class_range (cclass, start, end);
+}
 
-	for (l = ce->context_classes; l != NULL; l = l->next)
-	{
-		GtkTextTag *tag = l->data;
+static void
+sync_context_class_tags (GtkSourceContextEngine *ce,
+                         gint                    start,
+                         gint                    end)
+{
+	GHashTableIter iter;
+	ContextClassRanges *cclass;
 
-		gtk_text_buffer_remove_tag (ce->buffer, tag, start, end);
+	g_hash_table_iter_init (&iter, ce->context_classes);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &cclass))
+	{
+		if (cclass->tag != NULL)
+			sync_context_class_tag (ce, cclass, start, end);
 	}
 }
 
+/**
+ * refresh_context_classes:
+ * @ce: a #GtkSourceContextEngine.
+ * @start: the beginning of the analyzed area.
+ * @end: the end of the analyzed area.
+ *
+ * Updates the ranges of the context classes in the area from the
+ * segment tree, and the tags of the classes rendered with a tag.
+ */
 static void
 refresh_context_classes (GtkSourceContextEngine *ce,
                          const GtkTextIter      *start,
@@ -1179,14 +2011,20 @@ refresh_context_classes (GtkSourceContextEngine *ce,
 	timer = g_timer_new ();
 #endif
 
-	/* First we need to delete tags in the regions. */
-	remove_region_context_classes (ce, start, &realend);
+	/* First we need to delete the classes in the regions. */
+	remove_region_context_classes (ce,
+	                               gtk_text_iter_get_offset (start),
+	                               gtk_text_iter_get_offset (&realend));
 
 	add_region_context_classes (ce,
 	                            ce->root_segment,
 	                            gtk_text_iter_get_offset (start),
 	                            gtk_text_iter_get_offset (&realend));
 
+	sync_context_class_tags (ce,
+	                         gtk_text_iter_get_offset (start),
+	                         gtk_text_iter_get_offset (&realend));
+
 #ifdef ENABLE_PROFILE
 	g_print ("applied context classes (from %d to %d), %g ms elapsed\n",
 		 gtk_text_iter_get_offset (start),
@@ -1207,35 +2045,310 @@ refresh_context_classes (GtkSourceContextEngine *ce,
  * Marks the area as updated and notifies view about it.
  */
 static void
-refresh_range (GtkSourceContextEngine *ce,
-               const GtkTextIter      *start,
-               const GtkTextIter      *end)
+refresh_range (GtkSourceContextEngine *ce,
+               const GtkTextIter      *start,
+               const GtkTextIter      *end)
+{
+	GtkTextIter real_end;
+
+	if (gtk_text_iter_equal (start, end))
+		return;
+
+	/* Refresh the context classes here */
+	refresh_context_classes (ce, start, end);
+
+	/* Here we need to make sure we do not make it redraw next line */
+	real_end = *end;
+	if (gtk_text_iter_starts_line (&real_end))
+	{
+		/* I don't quite like this here, but at least it won't jump into
+		 * the middle of \r\n  */
+		gtk_text_iter_backward_cursor_position (&real_end);
+	}
+
+	g_signal_emit_by_name (ce->buffer,
+			       "highlight-updated",
+			       start,
+			       &real_end);
+}
+
+
+/* SEGMENT TREE ----------------------------------------------------------- */
+
+static void
+slab_init (Slab  *slab,
+           gsize  element_size)
+{
+	g_assert (element_size >= sizeof (gpointer));
+
+	slab->chunks = g_ptr_array_new ();
+	slab->available = g_array_new (FALSE, FALSE, sizeof (guint));
+	slab->spare = NULL;
+	slab->element_size = element_size;
+	slab->n_per_chunk = MIN ((SLAB_CHUNK_SIZE - SLAB_HEADER_SIZE) / element_size,
+	                         1 << SLAB_INDEX_BITS);
+	slab->n_chunks = 0;
+	slab->n_live = 0;
+	slab->n_allocated = 0;
+	slab->n_released = 0;
+}
+
+/* Frees all the memory of @slab, none of its elements must be in use. */
+static void
+slab_clear (Slab *slab)
+{
+	g_assert (slab->n_live == 0);
+
+	for (guint i = 0; i < slab->chunks->len; i++)
+		g_clear_pointer (&g_ptr_array_index (slab->chunks, i), g_aligned_free);
+
+	g_clear_pointer (&slab->spare, g_aligned_free);
+	g_ptr_array_set_size (slab->chunks, 0);
+	g_array_set_size (slab->available, 0);
+	slab->n_chunks = 0;
+}
+
+static void
+slab_destroy (Slab *slab)
+{
+	slab_clear (slab);
+	g_clear_pointer (&slab->chunks, g_ptr_array_unref);
+	g_clear_pointer (&slab->available, g_array_unref);
+}
+
+static guint
+slab_chunk_get_position (SlabChunk *chunk)
+{
+	return (chunk->first_id >> SLAB_INDEX_BITS) - 1;
+}
+
+static SlabChunk *
+slab_add_chunk (Slab *slab)
+{
+	SlabChunk *chunk;
+	guint position;
+
+	if (slab->spare != NULL)
+		chunk = g_steal_pointer (&slab->spare);
+	else
+		chunk = g_aligned_alloc (1, SLAB_CHUNK_SIZE, SLAB_CHUNK_SIZE);
+
+	/* Reuse the position of a released chunk, if any. */
+	for (position = 0; position < slab->chunks->len; position++)
+	{
+		if (g_ptr_array_index (slab->chunks, position) == NULL)
+			break;
+	}
+
+	if (position == slab->chunks->len)
+	{
+		g_assert (position < (1 << (32 - SLAB_INDEX_BITS)) - 1);
+		g_ptr_array_add (slab->chunks, NULL);
+	}
+
+	g_ptr_array_index (slab->chunks, position) = chunk;
+	slab->n_chunks++;
+
+	chunk->free_list = NULL;
+	chunk->first_id = (position + 1) << SLAB_INDEX_BITS;
+	chunk->n_used = 0;
+	chunk->n_live = 0;
+	chunk->available = TRUE;
+	g_array_append_val (slab->available, position);
+
+	return chunk;
+}
+
+static void
+slab_release_chunk (Slab      *slab,
+                    SlabChunk *chunk)
+{
+	guint position = slab_chunk_get_position (chunk);
+
+	g_assert (chunk->n_live == 0);
+
+	if (chunk->available)
+	{
+		for (guint i = slab->available->len; i > 0; i--)
+		{
+			if (g_array_index (slab->available, guint, i - 1) == position)
+			{
+				g_array_remove_index_fast (slab->available, i - 1);
+				break;
+			}
+		}
+	}
+
+	g_ptr_array_index (slab->chunks, position) = NULL;
+	slab->n_chunks--;
+	slab->n_released++;
+
+	/* Forget the released positions at the end. */
+	while (slab->chunks->len > 0 &&
+	       g_ptr_array_index (slab->chunks, slab->chunks->len - 1) == NULL)
+	{
+		g_ptr_array_set_size (slab->chunks, slab->chunks->len - 1);
+	}
+
+	if (slab->spare == NULL)
+		slab->spare = chunk;
+	else
+		g_aligned_free (chunk);
+}
+
+static gpointer
+slab_alloc0 (Slab *slab)
+{
+	SlabChunk *chunk;
+	gpointer element;
+
+	if (slab->available->len > 0)
+	{
+		guint position = g_array_index (slab->available, guint, slab->available->len - 1);
+		chunk = g_ptr_array_index (slab->chunks, position);
+	}
+	else
+	{
+		chunk = slab_add_chunk (slab);
+	}
+
+	if (chunk->free_list != NULL)
+	{
+		element = chunk->free_list;
+		chunk->free_list = *(gpointer *) element;
+	}
+	else
+	{
+		element = (guint8 *) chunk + SLAB_HEADER_SIZE + slab->element_size * chunk->n_used++;
+	}
+
+	/* The chunk is full. */
+	if (chunk->free_list == NULL && chunk->n_used == slab->n_per_chunk)
+	{
+		chunk->available = FALSE;
+		g_array_set_size (slab->available, slab->available->len - 1);
+	}
+
+	chunk->n_live++;
+	slab->n_live++;
+	slab->n_allocated++;
+
+	return memset (element, 0, slab->element_size);
+}
+
+static void
+slab_free (Slab     *slab,
+           gpointer  element)
+{
+	SlabChunk *chunk;
+
+	g_assert (slab->n_live > 0);
+
+	chunk = (SlabChunk *) ((guintptr) element & ~(guintptr) (SLAB_CHUNK_SIZE - 1));
+
+#ifdef ENABLE_DEBUG
+	memset (element, 1, slab->element_size);
+#endif
+
+	*(gpointer *) element = chunk->free_list;
+	chunk->free_list = element;
+	chunk->n_live--;
+	slab->n_live--;
+
+	if (chunk->n_live == 0)
+	{
+		slab_release_chunk (slab, chunk);
+	}
+	else if (!chunk->available)
+	{
+		guint position = slab_chunk_get_position (chunk);
+
+		chunk->available = TRUE;
+		g_array_append_val (slab->available, position);
+	}
+}
+
+static gsize
+slab_get_size (Slab *slab)
+{
+	return (slab->n_chunks + (slab->spare != NULL ? 1 : 0)) * SLAB_CHUNK_SIZE;
+}
+
+/**
+ * log_memory_usage:
+ * @ce: a #GtkSourceContextEngine.
+ *
+ * Reports the memory used by the segment trees and the context classes
+ * of the engine, and how many regexes of the language were compiled.
+ * The report goes to the profiler when it records, and otherwise to the
+ * debug messages, shown with G_MESSAGES_DEBUG=GtkSourceView.
+ */
+static void
+log_memory_usage (GtkSourceContextEngine *ce)
 {
-	GtkTextIter real_end;
+	GHashTableIter iter;
+	ContextClassRanges *cclass;
+	gsize context_classes_size = 0;
+	GtkSourceRegexStats stats;
+	gchar *messages[2];
 
-	if (gtk_text_iter_equal (start, end))
+	if (!GTK_SOURCE_PROFILER_ACTIVE &&
+	    g_log_writer_default_would_drop (G_LOG_LEVEL_DEBUG, G_LOG_DOMAIN))
 		return;
 
-	/* Refresh the context classes here */
-	refresh_context_classes (ce, start, end);
+	g_hash_table_iter_init (&iter, ce->context_classes);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &cclass))
+		context_classes_size += sizeof (ClassRange) * cclass->ranges->len;
 
-	/* Here we need to make sure we do not make it redraw next line */
-	real_end = *end;
-	if (gtk_text_iter_starts_line (&real_end))
+	_gtk_source_context_data_get_regex_stats (ce->ctx_data, &stats);
+
+	messages[0] = g_strdup_printf ("segments: %u (%" G_GSIZE_FORMAT " bytes, %u chunks released), "
+	                               "sub patterns: %u (%" G_GSIZE_FORMAT " bytes, %u chunks released), "
+	                               "context classes: %" G_GSIZE_FORMAT " bytes",
+	                               ce->segments.n_live, slab_get_size (&ce->segments),
+	                               ce->segments.n_released,
+	                               ce->sub_patterns.n_live, slab_get_size (&ce->sub_patterns),
+	                               ce->sub_patterns.n_released,
+	                               context_classes_size);
+	messages[1] = g_strdup_printf ("regexes of %s: %u, %u compiled, %u JIT compiled",
+	                               gtk_source_language_get_id (ce->ctx_data->lang),
+	                               stats.n_regexes, stats.n_compiled, stats.n_jit_compiled);
+
+	for (guint i = 0; i < G_N_ELEMENTS (messages); i++)
 	{
-		/* I don't quite like this here, but at least it won't jump into
-		 * the middle of \r\n  */
-		gtk_text_iter_backward_cursor_position (&real_end);
-	}
+		if (GTK_SOURCE_PROFILER_ACTIVE)
+			GTK_SOURCE_PROFILER_LOG ("%s", messages[i]);
+		else
+			g_debug ("%s", messages[i]);
 
-	g_signal_emit_by_name (ce->buffer,
-			       "highlight-updated",
-			       start,
-			       &real_end);
+		g_free (messages[i]);
+	}
 }
 
+/**
+ * _gtk_source_context_engine_get_stats:
+ * @ce: a #GtkSourceContextEngine.
+ * @stats: (out): where to store the counts.
+ *
+ * Counts the segments and sub patterns of the engine, the ones in the
+ * trees and the ones allocated since the engine was created, for the
+ * benchmarks.
+ */
+void
+_gtk_source_context_engine_get_stats (GtkSourceContextEngine      *ce,
+                                      GtkSourceContextEngineStats *stats)
+{
+	g_return_if_fail (GTK_SOURCE_IS_CONTEXT_ENGINE (ce));
+	g_return_if_fail (stats != NULL);
 
-/* SEGMENT TREE ----------------------------------------------------------- */
+	stats->n_segments = ce->segments.n_live;
+	stats->n_segments_allocated = ce->segments.n_allocated;
+	stats->n_sub_patterns = ce->sub_patterns.n_live;
+	stats->n_sub_patterns_allocated = ce->sub_patterns.n_allocated;
+	stats->tree_size = slab_get_size (&ce->segments) + slab_get_size (&ce->sub_patterns);
+	stats->n_toggles_added = ce->toggles_added;
+	stats->n_toggles_removed = ce->toggles_removed;
+}
 
 /**
  * segment_cmp:
@@ -1311,6 +2424,7 @@ remove_invalid (GtkSourceContextEngine *ce,
 
 /**
  * fix_offsets_insert_:
+ * @ce: the engine.
  * @segment: segment.
  * @start: start offset.
  * @delta: length of inserted text.
@@ -1319,9 +2433,10 @@ remove_invalid (GtkSourceContextEngine *ce,
  * only from insert_range().
  */
 static void
-fix_offsets_insert_ (Segment *segment,
-                     gint     start,
-                     gint     delta)
+fix_offsets_insert_ (GtkSourceContextEngine *ce,
+                     Segment                *segment,
+                     gint                    start,
+                     gint                    delta)
 {
 	Segment *child;
 	SubPattern *sp;
@@ -1334,10 +2449,10 @@ fix_offsets_insert_ (Segment *segment,
 	segment->start_at += delta;
 	segment->end_at += delta;
 
-	for (child = segment->children; child != NULL; child = child->next)
-		fix_offsets_insert_ (child, start, delta);
+	for (child = SEGMENT (ce, segment->children); child != NULL; child = SEGMENT (ce, child->next))
+		fix_offsets_insert_ (ce, child, start, delta);
 
-	for (sp = segment->sub_patterns; sp != NULL; sp = sp->next)
+	for (sp = SUB_PATTERN (ce, segment->sub_patterns); sp != NULL; sp = SUB_PATTERN (ce, sp->next))
 	{
 		sp->start_at += delta;
 		sp->end_at += delta;
@@ -1346,6 +2461,7 @@ fix_offsets_insert_ (Segment *segment,
 
 /**
  * find_insertion_place_forward_:
+ * @ce: the engine.
  * @segment: the (grand)parent segment the new one should be inserted into.
  * @offset: offset at which text is inserted.
  * @start: segment from which to start search (to avoid
@@ -1357,22 +2473,23 @@ fix_offsets_insert_ (Segment *segment,
  * Auxiliary function used in find_insertion_place().
  */
 static void
-find_insertion_place_forward_ (Segment  *segment,
-                               gint      offset,
-                               Segment  *start,
-                               Segment **parent,
-                               Segment **prev,
-                               Segment **next)
+find_insertion_place_forward_ (GtkSourceContextEngine  *ce,
+                               Segment                 *segment,
+                               gint                     offset,
+                               Segment                 *start,
+                               Segment                **parent,
+                               Segment                **prev,
+                               Segment                **next)
 {
 	Segment *child;
 
 	g_assert (start->end_at < offset);
 
-	for (child = start; child != NULL; child = child->next)
+	for (child = start; child != NULL; child = SEGMENT (ce, child->next))
 	{
 		if (child->start_at <= offset && child->end_at >= offset)
 		{
-			find_insertion_place (child, offset, parent, prev, next, NULL);
+			find_insertion_place (ce, child, offset, parent, prev, next, NULL);
 			return;
 		}
 
@@ -1387,7 +2504,7 @@ find_insertion_place_forward_ (Segment  *segment,
 			else
 			{
 				*prev = child;
-				*next = child->next;
+				*next = SEGMENT (ce, child->next);
 				*parent = segment;
 			}
 
@@ -1414,6 +2531,7 @@ find_insertion_place_forward_ (Segment  *segment,
 
 /**
  * find_insertion_place_backward_:
+ * @ce: the engine.
  * @segment: the (grand)parent segment the new one should be inserted into.
  * @offset: offset at which text is inserted.
  * @start: segment from which to start search (to avoid
@@ -1425,22 +2543,23 @@ find_insertion_place_forward_ (Segment  *segment,
  * Auxiliary function used in find_insertion_place().
  */
 static void
-find_insertion_place_backward_ (Segment  *segment,
-                                gint      offset,
-                                Segment  *start,
-                                Segment **parent,
-                                Segment **prev,
-                                Segment **next)
+find_insertion_place_backward_ (GtkSourceContextEngine  *ce,
+                                Segment                 *segment,
+                                gint                     offset,
+                                Segment                 *start,
+                                Segment                **parent,
+                                Segment                **prev,
+                                Segment                **next)
 {
 	Segment *child;
 
 	g_assert (start->end_at >= offset);
 
-	for (child = start; child != NULL; child = child->prev)
+	for (child = start; child != NULL; child = SEGMENT (ce, child->prev))
 	{
 		if (child->start_at <= offset && child->end_at >= offset)
 		{
-			find_insertion_place (child, offset, parent, prev, next, NULL);
+			find_insertion_place (ce, child, offset, parent, prev, next, NULL);
 			return;
 		}
 
@@ -1455,7 +2574,7 @@ find_insertion_place_backward_ (Segment  *segment,
 			else
 			{
 				*prev = child;
-				*next = child->next;
+				*next = SEGMENT (ce, child->next);
 				*parent = segment;
 			}
 
@@ -1465,7 +2584,7 @@ find_insertion_place_backward_ (Segment  *segment,
 		if (child->end_at < offset)
 		{
 			*prev = child;
-			*next = child->next;
+			*next = SEGMENT (ce, child->next);
 			break;
 		}
 
@@ -1483,6 +2602,7 @@ find_insertion_place_backward_ (Segment  *segment,
 
 /**
  * find_insertion_place:
+ * @ce: the engine.
  * @segment: the (grand)parent segment the new one should be inserted into.
  * @offset: offset at which text is inserted.
  * @start: segment from which to start search (to avoid
@@ -1499,19 +2619,20 @@ find_insertion_place_backward_ (Segment  *segment,
  * There is no return value, it always succeeds (or crashes).
  */
 static void
-find_insertion_place (Segment  *segment,
-                      gint      offset,
-                      Segment **parent,
-                      Segment **prev,
-                      Segment **next,
-                      Segment  *hint)
+find_insertion_place (GtkSourceContextEngine  *ce,
+                      Segment                 *segment,
+                      gint                     offset,
+                      Segment                **parent,
+                      Segment                **prev,
+                      Segment                **next,
+                      Segment                 *hint)
 {
 	g_assert (segment->start_at <= offset && segment->end_at >= offset);
 
 	*prev = NULL;
 	*next = NULL;
 
-	if (SEGMENT_IS_INVALID (segment) || segment->children == NULL)
+	if (SEGMENT_IS_INVALID (segment) || segment->children == 0)
 	{
 		*parent = segment;
 		return;
@@ -1521,27 +2642,27 @@ find_insertion_place (Segment  *segment,
 	{
 #ifdef ENABLE_CHECK_TREE
 		g_assert (!segment->children ||
-			  !SEGMENT_IS_INVALID (segment->children) ||
-			  segment->children->start_at > offset);
+			  !SEGMENT_IS_INVALID (SEGMENT (ce, segment->children)) ||
+			  SEGMENT (ce, segment->children)->start_at > offset);
 #endif
 
 		*parent = segment;
-		*next = segment->children;
+		*next = SEGMENT (ce, segment->children);
 
 		return;
 	}
 
 	if (hint != NULL)
-		while (hint != NULL && hint->parent != segment)
-			hint = hint->parent;
+		while (hint != NULL && hint->parent != SEGMENT_ID (segment))
+			hint = SEGMENT (ce, hint->parent);
 
 	if (hint == NULL)
-		hint = segment->children;
+		hint = SEGMENT (ce, segment->children);
 
 	if (hint->end_at < offset)
-		find_insertion_place_forward_ (segment, offset, hint, parent, prev, next);
+		find_insertion_place_forward_ (ce, segment, offset, hint, parent, prev, next);
 	else
-		find_insertion_place_backward_ (segment, offset, hint, parent, prev, next);
+		find_insertion_place_backward_ (ce, segment, offset, hint, parent, prev, next);
 }
 
 /**
@@ -1590,7 +2711,7 @@ segment_add_subpattern (Segment    *state,
                         SubPattern *sp)
 {
 	sp->next = state->sub_patterns;
-	state->sub_patterns = sp;
+	state->sub_patterns = SUB_PATTERN_ID (sp);
 }
 
 /**
@@ -1606,14 +2727,15 @@ segment_add_subpattern (Segment    *state,
  * Returns: new subpattern.
  */
 static SubPattern *
-sub_pattern_new (Segment              *segment,
-                 gint                  start_at,
-                 gint                  end_at,
-                 SubPatternDefinition *sp_def)
+sub_pattern_new (GtkSourceContextEngine *ce,
+                 Segment                *segment,
+                 gint                    start_at,
+                 gint                    end_at,
+                 SubPatternDefinition   *sp_def)
 {
 	SubPattern *sp;
 
-	sp = g_slice_new (SubPattern);
+	sp = slab_alloc0 (&ce->sub_patterns);
 	sp->start_at = start_at;
 	sp->end_at = end_at;
 	sp->definition = sp_def;
@@ -1625,18 +2747,16 @@ sub_pattern_new (Segment              *segment,
 
 /**
  * sub_pattern_free:
+ * @ce: the engine.
  * @sp: subppatern.
  *
- * Calls g_free on subpattern, was useful for debugging.
+ * Returns the subpattern to the allocator of @ce.
  */
 static inline void
-sub_pattern_free (SubPattern *sp)
+sub_pattern_free (GtkSourceContextEngine *ce,
+                  SubPattern             *sp)
 {
-#ifdef ENABLE_DEBUG
-	memset (sp, 1, sizeof (SubPattern));
-#else
-	g_slice_free (SubPattern, sp);
-#endif
+	slab_free (&ce->sub_patterns, sp);
 }
 
 /**
@@ -1655,13 +2775,13 @@ segment_make_invalid_ (GtkSourceContextEngine *ce,
 
 	g_assert (!SEGMENT_IS_INVALID (segment));
 
-	sp = segment->sub_patterns;
-	segment->sub_patterns = NULL;
+	sp = SUB_PATTERN (ce, segment->sub_patterns);
+	segment->sub_patterns = 0;
 
 	while (sp != NULL)
 	{
-		SubPattern *next = sp->next;
-		sub_pattern_free (sp);
+		SubPattern *next = SUB_PATTERN (ce, sp->next);
+		sub_pattern_free (ce, sp);
 		sp = next;
 	}
 
@@ -1698,17 +2818,17 @@ simple_segment_split_ (GtkSourceContextEngine *ce,
 	g_assert (SEGMENT_IS_SIMPLE (segment));
 	g_assert (segment->start_at < offset && offset < segment->end_at);
 
-	sp = segment->sub_patterns;
-	segment->sub_patterns = NULL;
+	sp = SUB_PATTERN (ce, segment->sub_patterns);
+	segment->sub_patterns = 0;
 	segment->end_at = offset;
 
-	invalid = create_segment (ce, segment->parent, NULL, offset, offset, FALSE, segment);
-	new_segment = create_segment (ce, segment->parent, segment->context, offset, end_at, FALSE, invalid);
+	invalid = create_segment (ce, SEGMENT (ce, segment->parent), NULL, offset, offset, FALSE, segment);
+	new_segment = create_segment (ce, SEGMENT (ce, segment->parent), segment->context, offset, end_at, FALSE, invalid);
 
 	while (sp != NULL)
 	{
 		Segment *append_to = NULL;
-		SubPattern *next = sp->next;
+		SubPattern *next = SUB_PATTERN (ce, sp->next);
 
 		if (sp->end_at <= offset)
 		{
@@ -1720,7 +2840,8 @@ simple_segment_split_ (GtkSourceContextEngine *ce,
 		}
 		else
 		{
-			sub_pattern_new (new_segment,
+			sub_pattern_new (ce,
+					 new_segment,
 					 offset,
 					 sp->end_at,
 					 sp->definition);
@@ -1836,16 +2957,16 @@ insert_range (GtkSourceContextEngine *ce,
 	parent = get_invalid_at (ce, offset);
 
 	if (parent == NULL)
-		find_insertion_place (ce->root_segment, offset,
+		find_insertion_place (ce, ce->root_segment, offset,
 				      &parent, &prev, &next,
 				      ce->hint);
 
 	g_assert (parent->start_at <= offset);
 	g_assert (parent->end_at >= offset);
-	g_assert (!prev || prev->parent == parent);
-	g_assert (!next || next->parent == parent);
-	g_assert (!prev || prev->next == next);
-	g_assert (!next || next->prev == prev);
+	g_assert (!prev || prev->parent == SEGMENT_ID (parent));
+	g_assert (!next || next->parent == SEGMENT_ID (parent));
+	g_assert (!prev || prev->next == SEGMENT_ID (next));
+	g_assert (!next || next->prev == SEGMENT_ID (prev));
 
 	if (SEGMENT_IS_INVALID (parent))
 	{
@@ -1878,18 +2999,18 @@ insert_range (GtkSourceContextEngine *ce,
 
 		new_segment = segment_new (ce, parent, NULL, offset, offset, FALSE);
 
-		new_segment->next = next;
-		new_segment->prev = prev;
+		new_segment->next = SEGMENT_ID (next);
+		new_segment->prev = SEGMENT_ID (prev);
 
 		if (next != NULL)
-			next->prev = new_segment;
+			next->prev = SEGMENT_ID (new_segment);
 		else
-			parent->last_child = new_segment;
+			parent->last_child = SEGMENT_ID (new_segment);
 
 		if (prev != NULL)
-			prev->next = new_segment;
+			prev->next = SEGMENT_ID (new_segment);
 		else
-			parent->children = new_segment;
+			parent->children = SEGMENT_ID (new_segment);
 
 		segment = new_segment;
 	}
@@ -1905,12 +3026,12 @@ insert_range (GtkSourceContextEngine *ce,
 			Segment *tmp;
 			SubPattern *sp;
 
-			for (tmp = segment->next; tmp != NULL; tmp = tmp->next)
-				fix_offsets_insert_ (tmp, offset, length);
+			for (tmp = SEGMENT (ce, segment->next); tmp != NULL; tmp = SEGMENT (ce, tmp->next))
+				fix_offsets_insert_ (ce, tmp, offset, length);
 
 			segment->end_at += length;
 
-			for (sp = segment->sub_patterns; sp != NULL; sp = sp->next)
+			for (sp = SUB_PATTERN (ce, segment->sub_patterns); sp != NULL; sp = SUB_PATTERN (ce, sp->next))
 			{
 				if (sp->start_at > offset)
 					sp->start_at += length;
@@ -1918,7 +3039,7 @@ insert_range (GtkSourceContextEngine *ce,
 					sp->end_at += length;
 			}
 
-			segment = segment->parent;
+			segment = SEGMENT (ce, segment->parent);
 		}
 	}
 
@@ -1941,23 +3062,24 @@ gtk_source_context_engine_text_inserted (GtkSourceEngine *engine,
 	GtkTextIter iter;
 	GtkSourceContextEngine *ce = GTK_SOURCE_CONTEXT_ENGINE (engine);
 
-	if (!ce->disabled)
-	{
-		g_return_if_fail (start_offset < end_offset);
+	g_return_if_fail (start_offset < end_offset);
 
-		invalidate_region (ce, start_offset, end_offset - start_offset);
+	invalidate_region (ce, start_offset, end_offset - start_offset);
+	invalidate_speculation (ce, start_offset);
+	context_classes_text_inserted (ce, start_offset, end_offset - start_offset);
+	ce->toggles_added = 0;
+	ce->toggles_removed = 0;
 
-		/* If end_offset is at the start of a line (enter key pressed) then
-		 * we need to invalidate the whole new line, otherwise it may not be
-		 * highlighted because the engine analyzes the previous line, end
-		 * context there is none, start context at this line is none too,
-		 * and the engine stops. */
-		gtk_text_buffer_get_iter_at_offset (ce->buffer, &iter, end_offset);
-		if (gtk_text_iter_starts_line (&iter) && !gtk_text_iter_ends_line (&iter))
-		{
-			gtk_text_iter_forward_to_line_end (&iter);
-			invalidate_region (ce, gtk_text_iter_get_offset (&iter), 0);
-		}
+	/* If end_offset is at the start of a line (enter key pressed) then
+	 * we need to invalidate the whole new line, otherwise it may not be
+	 * highlighted because the engine analyzes the previous line, end
+	 * context there is none, start context at this line is none too,
+	 * and the engine stops. */
+	gtk_text_buffer_get_iter_at_offset (ce->buffer, &iter, end_offset);
+	if (gtk_text_iter_starts_line (&iter) && !gtk_text_iter_ends_line (&iter))
+	{
+		gtk_text_iter_forward_to_line_end (&iter);
+		invalidate_region (ce, gtk_text_iter_get_offset (&iter), 0);
 	}
 }
 
@@ -1989,6 +3111,7 @@ fix_offset_delete_one_ (gint offset,
 
 /**
  * fix_offsets_delete_:
+ * @ce: the engine.
  * @segment: segment.
  * @start: start offset.
  * @length: length of deleted text.
@@ -1998,10 +3121,11 @@ fix_offset_delete_one_ (gint offset,
  * only from delete_range_().
  */
 static void
-fix_offsets_delete_ (Segment *segment,
-                     gint     offset,
-                     gint     length,
-                     Segment *hint)
+fix_offsets_delete_ (GtkSourceContextEngine *ce,
+                     Segment                *segment,
+                     gint                    offset,
+                     gint                    length,
+                     Segment                *hint)
 {
 	Segment *child;
 	SubPattern *sp;
@@ -2009,27 +3133,27 @@ fix_offsets_delete_ (Segment *segment,
 	g_return_if_fail (segment->end_at > offset);
 
 	if (hint != NULL)
-		while (hint != NULL && hint->parent != segment)
-			hint = hint->parent;
+		while (hint != NULL && hint->parent != SEGMENT_ID (segment))
+			hint = SEGMENT (ce, hint->parent);
 
 	if (hint == NULL)
-		hint = segment->children;
+		hint = SEGMENT (ce, segment->children);
 
-	for (child = hint; child != NULL; child = child->next)
+	for (child = hint; child != NULL; child = SEGMENT (ce, child->next))
 	{
 		if (child->end_at <= offset)
 			continue;
-		fix_offsets_delete_ (child, offset, length, NULL);
+		fix_offsets_delete_ (ce, child, offset, length, NULL);
 	}
 
-	for (child = hint ? hint->prev : NULL; child != NULL; child = child->prev)
+	for (child = hint ? SEGMENT (ce, hint->prev) : NULL; child != NULL; child = SEGMENT (ce, child->prev))
 	{
 		if (child->end_at <= offset)
 			break;
-		fix_offsets_delete_ (child, offset, length, NULL);
+		fix_offsets_delete_ (ce, child, offset, length, NULL);
 	}
 
-	for (sp = segment->sub_patterns; sp != NULL; sp = sp->next)
+	for (sp = SUB_PATTERN (ce, segment->sub_patterns); sp != NULL; sp = SUB_PATTERN (ce, sp->next))
 	{
 		sp->start_at = fix_offset_delete_one_ (sp->start_at, offset, length);
 		sp->end_at = fix_offset_delete_one_ (sp->end_at, offset, length);
@@ -2058,7 +3182,7 @@ delete_range_ (GtkSourceContextEngine *ce,
 
 	/* FIXME adjacent invalid segments? */
 	erase_segments (ce, start, end, NULL);
-	fix_offsets_delete_ (ce->root_segment, start, end - start, ce->hint);
+	fix_offsets_delete_ (ce, ce->root_segment, start, end - start, ce->hint);
 
 	/* no need to invalidate at start, update_tree will do it */
 
@@ -2082,10 +3206,11 @@ gtk_source_context_engine_text_deleted (GtkSourceEngine *engine,
 
 	g_return_if_fail (length > 0);
 
-	if (!ce->disabled)
-	{
-		invalidate_region (ce, offset, - length);
-	}
+	invalidate_region (ce, offset, - length);
+	invalidate_speculation (ce, offset);
+	context_classes_text_deleted (ce, offset, length);
+	ce->toggles_added = 0;
+	ce->toggles_removed = 0;
 }
 
 /**
@@ -2225,7 +3350,7 @@ gtk_source_context_engine_update_highlight (GtkSourceEngine   *engine,
 	gint end_line;
 	GtkSourceContextEngine *ce = GTK_SOURCE_CONTEXT_ENGINE (engine);
 
-	if (!ce->highlight || ce->disabled)
+	if (!ce->highlight)
 		return;
 
 	GTK_SOURCE_PROFILER_BEGIN_MARK;
@@ -2256,6 +3381,7 @@ gtk_source_context_engine_update_highlight (GtkSourceEngine   *engine,
 			ensure_highlighted (ce, start, &valid_end);
 		}
 
+		speculate_highlight (ce, start, end);
 		install_first_update (ce);
 	}
 
@@ -2281,6 +3407,7 @@ enable_highlight (GtkSourceContextEngine *ce,
 		return;
 
 	ce->highlight = enable != 0;
+	clear_speculation (ce);
 	gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (ce->buffer),
 				    &start, &end);
 
@@ -2305,6 +3432,12 @@ buffer_notify_highlight_syntax_cb (GtkSourceContextEngine *ce)
 	enable_highlight (ce, highlight);
 }
 
+static void
+buffer_notify_max_highlight_line_time_cb (GtkSourceContextEngine *ce)
+{
+	g_object_get (ce->buffer, "max-highlight-line-time", &ce->max_line_time, NULL);
+}
+
 
 /* IDLE WORKER CODE ------------------------------------------------------- */
 
@@ -2321,96 +3454,119 @@ all_analyzed (GtkSourceContextEngine *ce)
 }
 
 /**
- * idle_worker:
- * @ce: #GtkSourceContextEngine.
+ * update_worker:
+ * @deadline: the time the work should complete by.
+ * @user_data: #GtkSourceContextEngine.
  *
- * Analyzes a batch in idle. Stops when
- * whole buffer is analyzed.
+ * Analyzes a batch of text in the time given by the scheduler.
+ * Stops when whole buffer is analyzed.
  */
 static gboolean
-idle_worker (GtkSourceContextEngine *ce)
+update_worker (gint64   deadline,
+               gpointer user_data)
 {
-	gboolean retval = G_SOURCE_CONTINUE;
+	GtkSourceContextEngine *ce = user_data;
+	gint time;
 
 	g_return_val_if_fail (ce->buffer != NULL, G_SOURCE_REMOVE);
 
+	/* In milliseconds, at least one line is analyzed anyway. */
+	time = MAX (1, (deadline - g_get_monotonic_time ()) / 1000);
+
 	/* analyze batch of text */
-	update_syntax (ce, NULL, INCREMENTAL_UPDATE_TIME_SLICE);
+	update_syntax (ce, NULL, time);
 	CHECK_TREE (ce);
 
 	if (all_analyzed (ce))
 	{
-		ce->incremental_update = 0;
-		retval = G_SOURCE_REMOVE;
+		clear_speculation (ce);
+		log_memory_usage (ce);
+		ce->update_handler = 0;
+		return G_SOURCE_REMOVE;
 	}
 
-	return retval;
+	return G_SOURCE_CONTINUE;
 }
 
 /**
  * first_update_callback:
- * @ce: a #GtkSourceContextEngine.
+ * @deadline: when to stop.
+ * @user_data: a #GtkSourceContextEngine.
  *
- * Same as idle_worker, except: it runs once, and install idle_worker
- * if not everything was analyzed at once.
+ * Same as update_worker, except: it runs once, as visible work of the
+ * scheduler, and hands the rest to the background work if not everything
+ * was analyzed at once.
  */
 static gboolean
-first_update_callback (GtkSourceContextEngine *ce)
+first_update_callback (gint64   deadline,
+                       gpointer user_data)
 {
+	GtkSourceContextEngine *ce = user_data;
+	gint time;
+
 	g_return_val_if_fail (ce->buffer != NULL, G_SOURCE_REMOVE);
 
+	time = MAX (1, (deadline - g_get_monotonic_time ()) / 1000);
+
 	/* analyze batch of text */
-	update_syntax (ce, NULL, FIRST_UPDATE_TIME_SLICE);
+	update_syntax (ce, NULL, time);
 	CHECK_TREE (ce);
 
 	ce->first_update = 0;
 
-	if (!all_analyzed (ce))
-		install_idle_worker (ce);
+	if (all_analyzed (ce))
+	{
+		clear_speculation (ce);
+		log_memory_usage (ce);
+	}
+	else
+	{
+		install_update_worker (ce);
+	}
 
 	return G_SOURCE_REMOVE;
 }
 
 /**
- * install_idle_worker:
+ * install_first_update:
  * @ce: #GtkSourceContextEngine.
  *
- * Schedules reanalyzing buffer in idle.
+ * Schedules first_update_callback call, before the next redraw, so
+ * that the edited or shown lines are not drawn unhighlighted.
  * Always safe to call.
  */
 static void
-install_idle_worker (GtkSourceContextEngine *ce)
+install_first_update (GtkSourceContextEngine *ce)
 {
-	if (ce->first_update == 0 && ce->incremental_update == 0)
-		ce->incremental_update =
-			g_idle_add_full (INCREMENTAL_UPDATE_PRIORITY,
-			                 (GSourceFunc) idle_worker,
-			                 ce, NULL);
+	if (ce->first_update == 0)
+	{
+		gtk_source_scheduler_clear (&ce->update_handler);
+
+		ce->first_update =
+			_gtk_source_scheduler_add_visible (GTK_SOURCE_SCHEDULER_TASK_HIGHLIGHTING,
+			                                   first_update_callback,
+			                                   ce, NULL);
+	}
 }
 
 /**
- * install_first_update:
+ * install_update_worker:
  * @ce: #GtkSourceContextEngine.
  *
- * Schedules first_update_callback call.
+ * Schedules reanalyzing buffer in background, sharing the frame
+ * budget of the scheduler with the other buffers. Does nothing while
+ * the first update is pending, it installs the worker if needed.
  * Always safe to call.
  */
 static void
-install_first_update (GtkSourceContextEngine *ce)
+install_update_worker (GtkSourceContextEngine *ce)
 {
-	if (ce->first_update == 0)
-	{
-		if (ce->incremental_update != 0)
-		{
-			g_source_remove (ce->incremental_update);
-			ce->incremental_update = 0;
-		}
-
-		ce->first_update =
-			g_idle_add_full (FIRST_UPDATE_PRIORITY,
-			                 (GSourceFunc) first_update_callback,
-			                 ce, NULL);
-	}
+	if (ce->first_update == 0 && ce->update_handler == 0)
+		ce->update_handler =
+			_gtk_source_scheduler_add_for_owner (ce->buffer,
+			                                     GTK_SOURCE_SCHEDULER_TASK_HIGHLIGHTING,
+			                                     update_worker,
+			                                     ce, NULL);
 }
 
 /* GtkSourceContextEngine class ------------------------------------------- */
@@ -2462,26 +3618,31 @@ destroy_tags_hash (GtkSourceContextEngine *ce)
                               gtk_text_buffer_get_tag_table (ce->buffer));
 	g_hash_table_destroy (ce->tags);
 	ce->tags = NULL;
+	g_clear_pointer (&ce->tag_set, g_hash_table_destroy);
 }
 
 static void
 destroy_context_classes_list (GtkSourceContextEngine *ce)
 {
-	GtkTextTagTable *table;
-	GSList *l;
+	GHashTableIter iter;
+	ContextClassRanges *cclass;
+	GtkTextIter start, end;
 
-	table = gtk_text_buffer_get_tag_table (ce->buffer);
+	gtk_text_buffer_get_bounds (ce->buffer, &start, &end);
 
-	for (l = ce->context_classes; l != NULL; l = l->next)
+	g_hash_table_iter_init (&iter, ce->context_classes);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &cclass))
 	{
-		GtkTextTag *tag = l->data;
+		if (cclass->tag == NULL)
+			continue;
 
-		gtk_text_tag_table_remove (table, tag);
-		g_object_unref (tag);
+		/* The tag owned by the buffer stays, but the classes go
+		 * away with the engine.
+		 */
+		gtk_text_buffer_remove_tag (ce->buffer, cclass->tag, &start, &end);
 	}
 
-	g_slist_free (ce->context_classes);
-	ce->context_classes = NULL;
+	g_clear_pointer (&ce->context_classes, g_hash_table_destroy);
 }
 
 /**
@@ -2509,13 +3670,16 @@ gtk_source_context_engine_attach_buffer (GtkSourceEngine *engine,
 		g_signal_handlers_disconnect_by_func (ce->buffer,
 						      (gpointer) buffer_notify_highlight_syntax_cb,
 						      ce);
+		g_signal_handlers_disconnect_by_func (ce->buffer,
+						      (gpointer) buffer_notify_max_highlight_line_time_cb,
+						      ce);
 
-		if (ce->first_update != 0)
-			g_source_remove (ce->first_update);
-		if (ce->incremental_update != 0)
-			g_source_remove (ce->incremental_update);
-		ce->first_update = 0;
-		ce->incremental_update = 0;
+		gtk_source_scheduler_clear (&ce->first_update);
+		gtk_source_scheduler_clear (&ce->update_handler);
+		gtk_source_scheduler_clear (&ce->degraded_handler);
+
+		clear_speculation (ce);
+		g_clear_pointer (&ce->checkpoints, g_array_unref);
 
 		if (ce->root_segment != NULL)
 			segment_destroy (ce, ce->root_segment);
@@ -2527,6 +3691,10 @@ gtk_source_context_engine_attach_buffer (GtkSourceEngine *engine,
 		ce->root_context = NULL;
 		ce->invalid = NULL;
 
+		/* Give the memory of the trees back at once. */
+		slab_clear (&ce->segments);
+		slab_clear (&ce->sub_patterns);
+
 		if (ce->invalid_region.start != NULL)
 			gtk_text_buffer_delete_mark (ce->buffer,
 						     ce->invalid_region.start);
@@ -2548,6 +3716,8 @@ gtk_source_context_engine_attach_buffer (GtkSourceEngine *engine,
 		destroy_context_classes_list (ce);
 
 		g_clear_object (&ce->refresh_region);
+		g_clear_object (&ce->degraded_region);
+		g_clear_object (&ce->degraded_pending);
 	}
 
 	ce->buffer = buffer;
@@ -2567,7 +3737,12 @@ gtk_source_context_engine_attach_buffer (GtkSourceEngine *engine,
 		ce->root_segment = create_segment (ce, NULL, ce->root_context, 0, 0, TRUE, NULL);
 
 		ce->tags = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
-		ce->context_classes = NULL;
+		ce->tag_set = g_hash_table_new (NULL, NULL);
+		ce->context_classes = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+		                                             (GDestroyNotify) context_class_ranges_free);
+
+		ce->checkpoints = g_array_new (FALSE, FALSE, sizeof (Checkpoint));
+		g_array_set_clear_func (ce->checkpoints, (GDestroyNotify) checkpoint_clear);
 
 		gtk_text_buffer_get_bounds (buffer, &start, &end);
 		ce->invalid_region.start = gtk_text_buffer_create_mark (buffer, NULL,
@@ -2586,37 +3761,28 @@ gtk_source_context_engine_attach_buffer (GtkSourceEngine *engine,
 			ce->invalid_region.delta = 0;
 		}
 
-		g_object_get (buffer, "highlight-syntax", &ce->highlight, NULL);
+		g_object_get (buffer,
+		              "highlight-syntax", &ce->highlight,
+		              "max-highlight-line-length", &ce->max_line_length,
+		              "max-highlight-line-time", &ce->max_line_time,
+		              NULL);
 		ce->refresh_region = gtk_source_region_new (buffer);
+		ce->degraded_region = gtk_source_region_new (buffer);
+		ce->degraded_pending = gtk_source_region_new (buffer);
 
 		g_signal_connect_swapped (buffer,
 					  "notify::highlight-syntax",
 					  G_CALLBACK (buffer_notify_highlight_syntax_cb),
 					  ce);
+		g_signal_connect_swapped (buffer,
+					  "notify::max-highlight-line-time",
+					  G_CALLBACK (buffer_notify_max_highlight_line_time_cb),
+					  ce);
 
 		install_first_update (ce);
 	}
 }
 
-/**
- * disable_syntax_analysis:
- * @ce: #GtkSourceContextEngine.
- *
- * Dsiables highlighting in case of errors (currently if highlighting
- * a single line took too long, so that highlighting doesn't freeze
- * text editor).
- */
-static void
-disable_syntax_analysis (GtkSourceContextEngine *ce)
-{
-	if (!ce->disabled)
-	{
-		ce->disabled = TRUE;
-		gtk_source_context_engine_attach_buffer (GTK_SOURCE_ENGINE (ce), NULL);
-		/* FIXME maybe emit some signal here? */
-	}
-}
-
 static void
 set_tag_style_hash_cb (const char             *style,
                        GSList                 *tags,
@@ -2671,17 +3837,12 @@ gtk_source_context_engine_finalize (GObject *object)
 	g_assert (!ce->root_context);
 	g_assert (!ce->root_segment);
 
-	if (ce->first_update != 0)
-	{
-		g_source_remove (ce->first_update);
-		ce->first_update = 0;
-	}
+	gtk_source_scheduler_clear (&ce->first_update);
+	gtk_source_scheduler_clear (&ce->update_handler);
+	gtk_source_scheduler_clear (&ce->degraded_handler);
 
-	if (ce->incremental_update != 0)
-	{
-		g_source_remove (ce->incremental_update);
-		ce->incremental_update = 0;
-	}
+	slab_destroy (&ce->segments);
+	slab_destroy (&ce->sub_patterns);
 
 	_gtk_source_context_data_unref (ce->ctx_data);
 
@@ -2691,6 +3852,115 @@ gtk_source_context_engine_finalize (GObject *object)
 	G_OBJECT_CLASS (_gtk_source_context_engine_parent_class)->finalize (object);
 }
 
+static gboolean
+gtk_source_context_engine_has_context_class (GtkSourceEngine *engine,
+                                             gint             offset,
+                                             const gchar     *context_class)
+{
+	GtkSourceContextEngine *ce = GTK_SOURCE_CONTEXT_ENGINE (engine);
+	ContextClassRanges *cclass;
+	guint i;
+
+	if (ce->context_classes == NULL)
+		return FALSE;
+
+	cclass = g_hash_table_lookup (ce->context_classes, context_class);
+
+	if (cclass == NULL)
+		return FALSE;
+
+	i = find_class_range (cclass, offset);
+
+	return i < cclass->ranges->len &&
+	       class_range_get (cclass, i).start_at <= offset;
+}
+
+static gchar **
+gtk_source_context_engine_get_context_classes (GtkSourceEngine *engine,
+                                               gint             offset)
+{
+	GtkSourceContextEngine *ce = GTK_SOURCE_CONTEXT_ENGINE (engine);
+	GPtrArray *ret = g_ptr_array_new ();
+
+	if (ce->context_classes != NULL)
+	{
+		GHashTableIter iter;
+		const gchar *name;
+
+		g_hash_table_iter_init (&iter, ce->context_classes);
+		while (g_hash_table_iter_next (&iter, (gpointer *) &name, NULL))
+		{
+			if (gtk_source_context_engine_has_context_class (engine, offset, name))
+				g_ptr_array_add (ret, g_strdup (name));
+		}
+	}
+
+	g_ptr_array_add (ret, NULL);
+	return (gchar **) g_ptr_array_free (ret, FALSE);
+}
+
+static gint
+gtk_source_context_engine_find_context_class_toggle (GtkSourceEngine *engine,
+                                                     gint             offset,
+                                                     const gchar     *context_class,
+                                                     gboolean         forward)
+{
+	GtkSourceContextEngine *ce = GTK_SOURCE_CONTEXT_ENGINE (engine);
+	ContextClassRanges *cclass;
+	ClassRange range;
+	guint n_ranges;
+	guint i;
+
+	if (ce->context_classes == NULL)
+		return -1;
+
+	cclass = g_hash_table_lookup (ce->context_classes, context_class);
+
+	if (cclass == NULL)
+		return -1;
+
+	n_ranges = cclass->ranges->len;
+
+	if (forward)
+	{
+		i = find_class_range (cclass, offset);
+
+		if (i == n_ranges)
+			return -1;
+
+		range = class_range_get (cclass, i);
+		return range.start_at > offset ? range.start_at : range.end_at;
+	}
+
+	/* The first range ending at or after @offset. */
+	i = find_class_range (cclass, offset - 1);
+
+	if (i < n_ranges)
+	{
+		range = class_range_get (cclass, i);
+
+		if (range.start_at < offset)
+			return range.start_at;
+	}
+
+	if (i > 0)
+		return class_range_get (cclass, i - 1).end_at;
+
+	return -1;
+}
+
+static GtkTextTag *
+gtk_source_context_engine_get_context_class_tag (GtkSourceEngine *engine,
+                                                 const gchar     *context_class)
+{
+	GtkSourceContextEngine *ce = GTK_SOURCE_CONTEXT_ENGINE (engine);
+
+	if (ce->context_classes == NULL)
+		return NULL;
+
+	return ensure_context_class_tag (ce, context_class);
+}
+
 static void
 _gtk_source_engine_interface_init (GtkSourceEngineInterface *iface)
 {
@@ -2699,6 +3969,10 @@ _gtk_source_engine_interface_init (GtkSourceEngineInterface *iface)
 	iface->text_deleted = gtk_source_context_engine_text_deleted;
 	iface->update_highlight = gtk_source_context_engine_update_highlight;
 	iface->set_style_scheme = gtk_source_context_engine_set_style_scheme;
+	iface->has_context_class = gtk_source_context_engine_has_context_class;
+	iface->get_context_classes = gtk_source_context_engine_get_context_classes;
+	iface->find_context_class_toggle = gtk_source_context_engine_find_context_class_toggle;
+	iface->get_context_class_tag = gtk_source_context_engine_get_context_class_tag;
 }
 
 static void
@@ -2713,6 +3987,9 @@ static void
 _gtk_source_context_engine_init (GtkSourceContextEngine *ce)
 {
 	ce = _gtk_source_context_engine_get_instance_private (ce);
+
+	slab_init (&ce->segments, sizeof (Segment));
+	slab_init (&ce->sub_patterns, sizeof (SubPattern));
 }
 
 GtkSourceContextEngine *
@@ -2748,6 +4025,7 @@ _gtk_source_context_data_new (GtkSourceLanguage *lang)
 	ctx_data->lang = lang;
 	ctx_data->definitions = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
 						       (GDestroyNotify) context_definition_unref);
+	ctx_data->recording = NULL;
 
 	return ctx_data;
 }
@@ -2778,6 +4056,8 @@ _gtk_source_context_data_unref (GtkSourceContextData *ctx_data)
 		if (ctx_data->lang != NULL)
 			_gtk_source_language_clear_ctx_data (ctx_data->lang, ctx_data);
 		g_hash_table_destroy (ctx_data->definitions);
+		if (ctx_data->recording != NULL)
+			g_variant_builder_unref (ctx_data->recording);
 		g_slice_free (GtkSourceContextData, ctx_data);
 	}
 }
@@ -2797,10 +4077,11 @@ _gtk_source_context_data_unref (GtkSourceContextData *ctx_data)
  * Applies sub patterns of kind @where to the matched text.
  */
 static void
-apply_sub_patterns (Segment         *state,
-                    LineInfo        *line,
-                    GtkSourceRegex  *regex,
-                    SubPatternWhere  where)
+apply_sub_patterns (GtkSourceContextEngine *ce,
+                    Segment                *state,
+                    LineInfo               *line,
+                    GtkSourceRegex         *regex,
+                    SubPatternWhere         where)
 {
 	GSList *sub_pattern_list = state->context->definition->sub_patterns;
 
@@ -2859,7 +4140,8 @@ apply_sub_patterns (Segment         *state,
 
 			if (start_pos >= 0 && start_pos != end_pos)
 			{
-				sub_pattern_new (state,
+				sub_pattern_new (ce,
+						 state,
 						 line->start_at + start_pos,
 						 line->start_at + end_pos,
 						 sp_def);
@@ -2972,19 +4254,20 @@ line_pos_to_offset (LineInfo *line,
  * Returns: %TRUE if the match can be applied.
  */
 static gboolean
-apply_match (Segment         *state,
-             LineInfo        *line,
-             gint            *line_pos,
-             GtkSourceRegex  *regex,
-             SubPatternWhere  where)
+apply_match (GtkSourceContextEngine *ce,
+             Segment                *state,
+             LineInfo               *line,
+             gint                   *line_pos,
+             GtkSourceRegex         *regex,
+             SubPatternWhere         where)
 {
 	gint match_end;
 
 	if (!can_apply_match (state->context, line, *line_pos, &match_end, regex))
 		return FALSE;
 
-	segment_extend (state, line_pos_to_offset (line, match_end));
-	apply_sub_patterns (state, line, regex, where);
+	segment_extend (ce, state, line_pos_to_offset (line, match_end));
+	apply_sub_patterns (ce, state, line, regex, where);
 	*line_pos = match_end;
 
 	return TRUE;
@@ -3018,6 +4301,7 @@ create_reg_all (Context           *context,
 	GString *all;
 	GtkSourceRegex *regex;
 	GError *error = NULL;
+	gboolean keywords_skipped = FALSE;
 
 	g_return_val_if_fail ((context == NULL && definition != NULL) ||
 			      (context != NULL && definition == NULL), NULL);
@@ -3093,6 +4377,15 @@ create_reg_all (Context           *context,
 
 		g_return_val_if_fail (child_def->resolved, NULL);
 
+		/* The keywords are found with children_keywords instead,
+		 * see next_segment().
+		 */
+		if (child_def->u.definition->keywords != NULL)
+		{
+			keywords_skipped = TRUE;
+			continue;
+		}
+
 		switch (child_def->u.definition->type)
 		{
 			case CONTEXT_TYPE_CONTAINER:
@@ -3115,10 +4408,16 @@ create_reg_all (Context           *context,
 
 	if (all->len > 1)
 		g_string_truncate (all, all->len - 1);
+	else if (keywords_skipped)
+		g_string_append (all, "?!");
 	g_string_append (all, ")");
 
+	/* Compiled now, to fall back to the children regexes if it fails. */
 	regex = _gtk_source_regex_new (all->str, 0, &error);
 
+	if (regex != NULL && !_gtk_source_regex_compile (regex, &error))
+		g_clear_pointer (&regex, _gtk_source_regex_unref);
+
 	if (regex == NULL)
 	{
 		/* regex_new could fail, for instance if there are different
@@ -3135,6 +4434,55 @@ create_reg_all (Context           *context,
 	return regex;
 }
 
+/**
+ * create_children_keywords:
+ * @definition: context definition.
+ *
+ * Merges the keywords of the children of @definition, which are left
+ * out of its reg_all.
+ *
+ * Returns: the keywords, or %NULL if no child has keywords.
+ */
+static GtkSourceKeywordTrie *
+create_children_keywords (ContextDefinition *definition)
+{
+	DefinitionsIter iter;
+	DefinitionChild *child_def;
+	GSList *children_keywords = NULL;
+	GSList *l;
+	GtkSourceKeywordTrie *trie = NULL;
+	gboolean caseless = FALSE;
+
+	definition_iter_init (&iter, definition);
+	while ((child_def = definition_iter_next (&iter)) != NULL)
+	{
+		GtkSourceKeywordTrie *keywords = child_def->u.definition->keywords;
+
+		if (keywords != NULL)
+		{
+			children_keywords = g_slist_prepend (children_keywords, keywords);
+			caseless = caseless || _gtk_source_keyword_trie_is_caseless (keywords);
+		}
+	}
+	definition_iter_destroy (&iter);
+
+	/* A single child can share its trie. */
+	if (children_keywords != NULL && children_keywords->next == NULL)
+	{
+		trie = _gtk_source_keyword_trie_ref (children_keywords->data);
+	}
+	else if (children_keywords != NULL)
+	{
+		trie = _gtk_source_keyword_trie_new (caseless);
+
+		for (l = children_keywords; l != NULL; l = l->next)
+			_gtk_source_keyword_trie_add_all (trie, l->data);
+	}
+
+	g_slist_free (children_keywords);
+	return trie;
+}
+
 static Context *
 context_ref (Context *context)
 {
@@ -3197,6 +4545,12 @@ context_new (Context           *parent,
 		context->reg_all = _gtk_source_regex_ref (definition->reg_all);
 	}
 
+	if (!definition->children_keywords_set)
+	{
+		definition->children_keywords = create_children_keywords (definition);
+		definition->children_keywords_set = TRUE;
+	}
+
 #ifdef ENABLE_DEBUG
 	{
 		GString *str = g_string_new (definition->id);
@@ -3336,11 +4690,11 @@ context_unref (Context *context)
 		for (i = 0; i < context->definition->n_sub_patterns; ++i)
 		{
 			g_slist_free_full (context->subpattern_context_classes[i],
-			                   (GDestroyNotify)context_class_tag_free);
+			                   (GDestroyNotify)context_class_ref_free);
 		}
 	}
 
-	g_slist_free_full (context->context_classes, (GDestroyNotify)context_class_tag_free);
+	g_slist_free_full (context->context_classes, (GDestroyNotify)context_class_ref_free);
 
 	g_free (context->subpattern_context_classes);
 	g_free (context->subpattern_tags);
@@ -3551,8 +4905,8 @@ segment_new (GtkSourceContextEngine *ce,
 	g_assert (!is_start || context != NULL);
 #endif
 
-	segment = g_slice_new0 (Segment);
-	segment->parent = parent;
+	segment = slab_alloc0 (&ce->segments);
+	segment->parent = SEGMENT_ID (parent);
 	segment->context = context_ref (context);
 	segment->start_at = start_at;
 	segment->end_at = end_at;
@@ -3565,11 +4919,12 @@ segment_new (GtkSourceContextEngine *ce,
 }
 
 static void
-find_segment_position_forward_ (Segment  *segment,
-                                gint      start_at,
-                                gint      end_at,
-                                Segment **prev,
-                                Segment **next)
+find_segment_position_forward_ (GtkSourceContextEngine  *ce,
+                                Segment                 *segment,
+                                gint                     start_at,
+                                gint                     end_at,
+                                Segment                **prev,
+                                Segment                **next)
 {
 	g_assert (segment->start_at <= start_at);
 
@@ -3577,11 +4932,11 @@ find_segment_position_forward_ (Segment  *segment,
 	{
 		if (segment->end_at == start_at)
 		{
-			while (segment->next != NULL && segment->next->start_at == start_at)
-				segment = segment->next;
+			while (segment->next != 0 && SEGMENT (ce, segment->next)->start_at == start_at)
+				segment = SEGMENT (ce, segment->next);
 
 			*prev = segment;
-			*next = segment->next;
+			*next = SEGMENT (ce, segment->next);
 
 			break;
 		}
@@ -3589,7 +4944,7 @@ find_segment_position_forward_ (Segment  *segment,
 		if (segment->start_at == end_at)
 		{
 			*next = segment;
-			*prev = segment->prev;
+			*prev = SEGMENT (ce, segment->prev);
 			break;
 		}
 
@@ -3602,16 +4957,17 @@ find_segment_position_forward_ (Segment  *segment,
 		if (segment->end_at < start_at)
 			*prev = segment;
 
-		segment = segment->next;
+		segment = SEGMENT (ce, segment->next);
 	}
 }
 
 static void
-find_segment_position_backward_ (Segment  *segment,
-                                 gint      start_at,
-                                 gint      end_at,
-                                 Segment **prev,
-                                 Segment **next)
+find_segment_position_backward_ (GtkSourceContextEngine  *ce,
+                                 Segment                 *segment,
+                                 gint                     start_at,
+                                 gint                     end_at,
+                                 Segment                **prev,
+                                 Segment                **next)
 {
 	g_assert (start_at < segment->end_at);
 
@@ -3626,12 +4982,13 @@ find_segment_position_backward_ (Segment  *segment,
 		g_assert (segment->start_at >= end_at);
 
 		*next = segment;
-		segment = segment->prev;
+		segment = SEGMENT (ce, segment->prev);
 	}
 }
 
 /**
  * find_segment_position:
+ * @ce: the engine.
  * @parent: parent segment (not %NULL).
  * @hint: segment somewhere near new segment position.
  * @start_at: start offset.
@@ -3644,27 +5001,28 @@ find_segment_position_backward_ (Segment  *segment,
  * parent->children list.
  */
 static void
-find_segment_position (Segment  *parent,
-                       Segment  *hint,
-                       gint      start_at,
-                       gint      end_at,
-                       Segment **prev,
-                       Segment **next)
+find_segment_position (GtkSourceContextEngine  *ce,
+                       Segment                 *parent,
+                       Segment                 *hint,
+                       gint                     start_at,
+                       gint                     end_at,
+                       Segment                **prev,
+                       Segment                **next)
 {
 	Segment *tmp;
 
 	g_assert (parent->start_at <= start_at && end_at <= parent->end_at);
-	g_assert (!hint || hint->parent == parent);
+	g_assert (!hint || hint->parent == SEGMENT_ID (parent));
 
 	*prev = *next = NULL;
 
-	if (parent->children == NULL)
+	if (parent->children == 0)
 		return;
 
-	if (parent->children->next == NULL)
-	{
-		tmp = parent->children;
+	tmp = SEGMENT (ce, parent->children);
 
+	if (tmp->next == 0)
+	{
 		if (start_at >= tmp->end_at)
 			*prev = tmp;
 		else
@@ -3674,12 +5032,12 @@ find_segment_position (Segment  *parent,
 	}
 
 	if (hint == NULL)
-		hint = parent->children;
+		hint = tmp;
 
 	if (hint->end_at <= start_at)
-		find_segment_position_forward_ (hint, start_at, end_at, prev, next);
+		find_segment_position_forward_ (ce, hint, start_at, end_at, prev, next);
 	else
-		find_segment_position_backward_ (hint, start_at, end_at, prev, next);
+		find_segment_position_backward_ (ce, hint, start_at, end_at, prev, next);
 }
 
 /**
@@ -3718,33 +5076,33 @@ create_segment (GtkSourceContextEngine *ce,
 		if (hint == NULL)
 		{
 			hint = ce->hint;
-			while (hint != NULL && hint->parent != parent)
-				hint = hint->parent;
+			while (hint != NULL && hint->parent != SEGMENT_ID (parent))
+				hint = SEGMENT (ce, hint->parent);
 		}
 
-		find_segment_position (parent, hint,
+		find_segment_position (ce, parent, hint,
 				       start_at, end_at,
 				       &prev, &next);
 
 		g_assert ((!parent->children && !prev && !next) ||
 			  (parent->children && (prev || next)));
-		g_assert (!prev || prev->next == next);
-		g_assert (!next || next->prev == prev);
+		g_assert (!prev || prev->next == SEGMENT_ID (next));
+		g_assert (!next || next->prev == SEGMENT_ID (prev));
 
-		segment->next = next;
-		segment->prev = prev;
+		segment->next = SEGMENT_ID (next);
+		segment->prev = SEGMENT_ID (prev);
 
 		if (next != NULL)
-			next->prev = segment;
+			next->prev = SEGMENT_ID (segment);
 		else
-			parent->last_child = segment;
+			parent->last_child = SEGMENT_ID (segment);
 
 		if (prev != NULL)
-			prev->next = segment;
+			prev->next = SEGMENT_ID (segment);
 		else
-			parent->children = segment;
+			parent->children = SEGMENT_ID (segment);
 
-		CHECK_SEGMENT_LIST (parent);
+		CHECK_SEGMENT_LIST (ce, parent);
 		CHECK_TREE (ce);
 	}
 
@@ -3753,21 +5111,23 @@ create_segment (GtkSourceContextEngine *ce,
 
 /**
  * segment_extend:
+ * @ce: the engine.
  * @state: the segment.
  * @end_at: new end offset, characters.
  *
  * Updates end offset in the segment and its ancestors.
  */
 static void
-segment_extend (Segment *state,
-                gint     end_at)
+segment_extend (GtkSourceContextEngine *ce,
+                Segment                *state,
+                gint                    end_at)
 {
 	while (state != NULL && state->end_at < end_at)
 	{
 		state->end_at = end_at;
-		state = state->parent;
+		state = SEGMENT (ce, state->parent);
 	}
-	CHECK_SEGMENT_LIST (state->parent);
+	CHECK_SEGMENT_LIST (ce, SEGMENT (ce, state->parent));
 }
 
 static void
@@ -3779,24 +5139,25 @@ segment_destroy_children (GtkSourceContextEngine *ce,
 
 	g_return_if_fail (segment != NULL);
 
-	child = segment->children;
-	segment->children = NULL;
-	segment->last_child = NULL;
+	child = SEGMENT (ce, segment->children);
+	segment->children = 0;
+	segment->last_child = 0;
 
 	while (child != NULL)
 	{
-		Segment *next = child->next;
+		Segment *next = SEGMENT (ce, child->next);
+
 		segment_destroy (ce, child);
 		child = next;
 	}
 
-	sp = segment->sub_patterns;
-	segment->sub_patterns = NULL;
+	sp = SUB_PATTERN (ce, segment->sub_patterns);
+	segment->sub_patterns = 0;
 
 	while (sp != NULL)
 	{
-		SubPattern *next = sp->next;
-		sub_pattern_free (sp);
+		SubPattern *next = SUB_PATTERN (ce, sp->next);
+		sub_pattern_free (ce, sp);
 		sp = next;
 	}
 }
@@ -3833,10 +5194,9 @@ segment_destroy (GtkSourceContextEngine *ce,
 
 #ifdef ENABLE_DEBUG
 	g_assert (!g_slist_find (ce->invalid, segment));
-	memset (segment, 1, sizeof (Segment));
-#else
-	g_slice_free (Segment, segment);
 #endif
+
+	slab_free (&ce->segments, segment);
 }
 
 /**
@@ -3882,7 +5242,7 @@ container_context_starts_here (GtkSourceContextEngine  *ce,
 
 	g_assert (match_end <= line->byte_length);
 
-        segment_extend (state, line_pos_to_offset (line, match_end));
+        segment_extend (ce, state, line_pos_to_offset (line, match_end));
         new_segment = create_segment (ce, state, new_context,
 				      line_pos_to_offset (line, *line_pos),
 				      line_pos_to_offset (line, match_end),
@@ -3896,16 +5256,16 @@ container_context_starts_here (GtkSourceContextEngine  *ce,
 	 * and has zero length then we remove the segment. We do it this way instead of
 	 * checking before creating the segment because it's more convenient. */
 	if (*line_pos == match_end &&
-	    new_segment->prev != NULL &&
-	    new_segment->prev->context == new_segment->context &&
-	    new_segment->prev->start_at == new_segment->prev->end_at &&
-	    new_segment->prev->start_at == line_pos_to_offset (line, *line_pos))
+	    new_segment->prev != 0 &&
+	    SEGMENT (ce, new_segment->prev)->context == new_segment->context &&
+	    SEGMENT (ce, new_segment->prev)->start_at == SEGMENT (ce, new_segment->prev)->end_at &&
+	    SEGMENT (ce, new_segment->prev)->start_at == line_pos_to_offset (line, *line_pos))
 	{
 		segment_remove (ce, new_segment);
 		return FALSE;
 	}
 
-	apply_sub_patterns (new_segment, line,
+	apply_sub_patterns (ce, new_segment, line,
 			    definition->u.start_end.start,
 			    SUB_PATTERN_WHERE_START);
 	*line_pos = match_end;
@@ -3936,6 +5296,16 @@ simple_context_starts_here (GtkSourceContextEngine  *ce,
 
 	g_assert (*line_pos <= line->byte_length);
 
+	/* No keyword can match here, do not bother running the regex. */
+	if (definition->keywords != NULL &&
+	    !_gtk_source_keyword_trie_has_prefix (definition->keywords,
+	                                          line->text,
+	                                          line->byte_length,
+	                                          *line_pos))
+	{
+		return FALSE;
+	}
+
 	if (!_gtk_source_regex_match (definition->u.match,
 				      line->text,
 				      line->byte_length,
@@ -3968,7 +5338,7 @@ simple_context_starts_here (GtkSourceContextEngine  *ce,
 	}
 
 	g_assert (match_end <= line->byte_length);
-	segment_extend (state, line_pos_to_offset (line, match_end));
+	segment_extend (ce, state, line_pos_to_offset (line, match_end));
 
 	if (*line_pos != match_end)
 	{
@@ -3979,7 +5349,7 @@ simple_context_starts_here (GtkSourceContextEngine  *ce,
 					      line_pos_to_offset (line, match_end),
 					      TRUE,
 					      ce->hint2);
-		apply_sub_patterns (new_segment, line, definition->u.match, SUB_PATTERN_WHERE_DEFAULT);
+		apply_sub_patterns (ce, new_segment, line, definition->u.match, SUB_PATTERN_WHERE_DEFAULT);
 		ce->hint2 = new_segment;
 	}
 
@@ -3989,7 +5359,7 @@ simple_context_starts_here (GtkSourceContextEngine  *ce,
 		do
 		{
 			ce->hint2 = state;
-			state = state->parent;
+			state = SEGMENT (ce, state->parent);
 		}
 		while (SEGMENT_ENDS_PARENT (state));
 	}
@@ -4133,6 +5503,7 @@ ancestor_context_ends_here (Context  *state,
 
 /**
  * ancestor_ends_here:
+ * @ce: the engine.
  * @state: current state.
  * @line: the line to analyze.
  * @line_pos: the position inside @line, bytes.
@@ -4146,10 +5517,11 @@ ancestor_context_ends_here (Context  *state,
  * Returns: %TRUE if an ancestor ends at the given position.
  */
 static gboolean
-ancestor_ends_here (Segment   *state,
-                    LineInfo  *line,
-                    gint       line_pos,
-                    Segment  **new_state)
+ancestor_ends_here (GtkSourceContextEngine  *ce,
+                    Segment                 *state,
+                    LineInfo                *line,
+                    gint                     line_pos,
+                    Segment                **new_state)
 {
 	Context *terminating_context;
 
@@ -4163,7 +5535,7 @@ ancestor_ends_here (Segment   *state,
 		Segment *current_segment = state;
 
 		while (current_segment->context != terminating_context)
-			current_segment = current_segment->parent;
+			current_segment = SEGMENT (ce, current_segment->parent);
 
 		*new_state = current_segment;
 		g_assert (*new_state != NULL);
@@ -4195,8 +5567,11 @@ next_segment (GtkSourceContextEngine  *ce,
               gboolean                 had_bom)
 {
 	gint pos = *line_pos;
+	gint reg_all_from = -1;
+	gint reg_all_pos = -1;
+
+	g_assert (!ce->hint2 || ce->hint2->parent == SEGMENT_ID (state));
 
-	g_assert (!ce->hint2 || ce->hint2->parent == state);
 	g_assert (pos <= line->byte_length);
 
 	while (pos <= line->byte_length)
@@ -4207,24 +5582,60 @@ next_segment (GtkSourceContextEngine  *ce,
 
 		if (state->context->reg_all)
 		{
-			if (!_gtk_source_regex_match (state->context->reg_all,
-						      line->text,
-						      line->byte_length,
-						      pos))
+			GtkSourceKeywordTrie *keywords = state->context->definition->children_keywords;
+			gint next_pos;
+
+			/* A keyword found before the match of reg_all may
+			 * not start a context, the match is then still the
+			 * first one after pos, unless reg_all uses \G.
+			 */
+			if (reg_all_from < 0 || pos > reg_all_pos ||
+			    (pos > reg_all_from && _gtk_source_regex_uses_offset (state->context->reg_all)))
 			{
-				return FALSE;
+				reg_all_from = pos;
+				reg_all_pos = G_MAXINT;
+
+				if (_gtk_source_regex_match (state->context->reg_all,
+							     line->text,
+							     line->byte_length,
+							     pos))
+				{
+					_gtk_source_regex_fetch_pos_bytes (state->context->reg_all,
+									   0, &reg_all_pos, NULL);
+				}
+			}
+
+			next_pos = reg_all_pos < G_MAXINT ? reg_all_pos : -1;
+
+			/* The keywords are not in reg_all, look for one
+			 * before its match.
+			 */
+			if (keywords != NULL)
+			{
+				gint keyword_pos;
+
+				keyword_pos = _gtk_source_keyword_trie_find (keywords,
+				                                             line->text,
+				                                             line->byte_length,
+				                                             pos,
+				                                             next_pos >= 0 ? next_pos : line->byte_length);
+
+				if (keyword_pos >= 0)
+					next_pos = keyword_pos;
 			}
 
-			_gtk_source_regex_fetch_pos_bytes (state->context->reg_all,
-							   0, &pos, NULL);
+			if (next_pos < 0)
+				return FALSE;
+
+			pos = next_pos;
 		}
 
 		/* Does an ancestor end here? */
 		if (ANCESTOR_CAN_END_CONTEXT (state->context) &&
-		    ancestor_ends_here (state, line, pos, new_state))
+		    ancestor_ends_here (ce, state, line, pos, new_state))
 		{
 			g_assert (pos <= line->byte_length);
-			segment_extend (state, line_pos_to_offset (line, pos));
+			segment_extend (ce, state, line_pos_to_offset (line, pos));
 			*line_pos = pos;
 			return TRUE;
 		}
@@ -4254,7 +5665,7 @@ next_segment (GtkSourceContextEngine  *ce,
 			{
 				Segment *prev;
 
-				for (prev = state->children; prev != NULL; prev = prev->next)
+				for (prev = SEGMENT (ce, state->children); prev != NULL; prev = SEGMENT (ce, prev->next))
 				{
 					if (prev->context != NULL &&
 					    prev->context->definition == child_def->u.definition)
@@ -4291,14 +5702,14 @@ next_segment (GtkSourceContextEngine  *ce,
 			 * Still, it may happen that parent context ends in
 			 * the middle of the end regex match, apply_match()
 			 * checks this. */
-			if (apply_match (state, line, &pos, state->context->end, SUB_PATTERN_WHERE_END))
+			if (apply_match (ce, state, line, &pos, state->context->end, SUB_PATTERN_WHERE_END))
 			{
 				g_assert (pos <= line->byte_length);
 
 				while (SEGMENT_ENDS_PARENT (state))
-					state = state->parent;
+					state = SEGMENT (ce, state->parent);
 
-				*new_state = state->parent;
+				*new_state = SEGMENT (ce, state->parent);
 				ce->hint2 = state;
 				*line_pos = pos;
 				return TRUE;
@@ -4329,7 +5740,8 @@ check_line_end (GtkSourceContextEngine *ce,
 	Segment *current_segment;
 	Segment *terminating_segment;
 
-	g_assert (!ce->hint2 || ce->hint2->parent == state);
+	g_assert (!ce->hint2 || ce->hint2->parent == SEGMENT_ID (state));
+
 
 	/* A context can be terminated by the parent if extend_parent is
 	 * FALSE, so we need to verify the end of all the parents of
@@ -4343,13 +5755,13 @@ check_line_end (GtkSourceContextEngine *ce,
 			terminating_segment = current_segment;
 		else if (!ANCESTOR_CAN_END_CONTEXT(current_segment->context))
 			break;
-		current_segment = current_segment->parent;
+		current_segment = SEGMENT (ce, current_segment->parent);
 	}
 
 	if (terminating_segment != NULL)
 	{
 		ce->hint2 = terminating_segment;
-		return terminating_segment->parent;
+		return SEGMENT (ce, terminating_segment->parent);
 	}
 	else
 	{
@@ -4383,7 +5795,7 @@ delete_zero_length_segments (GtkSourceContextEngine *ce,
 						break;
 					}
 
-					s2 = s2->parent;
+					s2 = SEGMENT (ce, s2->parent);
 				}
 
 				if (child)
@@ -4405,11 +5817,11 @@ delete_zero_length_segments (GtkSourceContextEngine *ce,
 						break;
 					}
 
-					s2 = s2->parent;
+					s2 = SEGMENT (ce, s2->parent);
 				}
 
 				if (child)
-					ce->hint2 = s->parent;
+					ce->hint2 = SEGMENT (ce, s->parent);
 			}
 
 			segment_remove (ce, s);
@@ -4425,54 +5837,73 @@ delete_zero_length_segments (GtkSourceContextEngine *ce,
  * @state: the state at the beginning of line.
  * @line: the line.
  * @had_bom: if the buffer had a BOM
+ * @degraded: (out) (optional): return location for whether only the
+ *   beginning of the line was analyzed.
  *
  * Finds contexts at the line and updates the syntax tree on it.
  *
+ * Only the first max_line_length bytes of the line are analyzed, and the
+ * analysis stops when it takes more than max_line_time. The rest
+ * of the line then stays in the context reached so far, like a line
+ * without any match would, so that a minified file or a huge data line
+ * does not freeze the editor. The contexts started on such a line end
+ * with it.
+ *
  * Returns: starting state at the next line.
  */
 static Segment *
 analyze_line (GtkSourceContextEngine *ce,
               Segment                *state,
               LineInfo               *line,
-              gboolean                had_bom)
+              gboolean                had_bom,
+              gboolean               *degraded)
 {
+	LineInfo analyzed = *line;
 	gint line_pos = 0;
 	GList *end_segments = NULL;
 	gint64 deadline;
+	gboolean is_degraded = FALSE;
 
 	g_assert (SEGMENT_IS_CONTAINER (state));
 
-        if (ce->hint2 == NULL || ce->hint2->parent != state)
-                ce->hint2 = state->last_child;
-        g_assert (!ce->hint2 || ce->hint2->parent == state);
+        if (ce->hint2 == NULL || ce->hint2->parent != SEGMENT_ID (state))
+                ce->hint2 = SEGMENT (ce, state->last_child);
+        g_assert (!ce->hint2 || ce->hint2->parent == SEGMENT_ID (state));
+
+	if (ce->max_line_length > 0 && line->byte_length > (gint) ce->max_line_length)
+	{
+		const gchar *end = line->text + ce->max_line_length;
+
+		/* Cut the line at a character boundary. */
+		while (end > line->text && (*end & 0xC0) == 0x80)
+			end--;
+
+		analyzed.byte_length = end - line->text;
+		analyzed.char_length = g_utf8_strlen (line->text, analyzed.byte_length);
+		is_degraded = TRUE;
+	}
 
-	deadline = g_get_monotonic_time () + MAX_TIME_FOR_ONE_LINE * G_TIME_SPAN_MILLISECOND;
+	if (ce->max_line_time > 0)
+		deadline = g_get_monotonic_time () + ce->max_line_time * G_TIME_SPAN_MILLISECOND;
+	else
+		deadline = G_MAXINT64;
 
 	/* Find the contexts in the line. */
-	while (line_pos <= line->byte_length)
+	while (line_pos <= analyzed.byte_length)
 	{
 		Segment *new_state = NULL;
 
-		if (!next_segment (ce, state, line, &line_pos, &new_state, had_bom))
-			break;
-
-		if (g_get_monotonic_time () > deadline)
-		{
-			g_critical ("%s",
-			            _("Highlighting a single line took too much time, "
-				      "syntax highlighting will be disabled"));
-			disable_syntax_analysis (ce);
+		if (!next_segment (ce, state, &analyzed, &line_pos, &new_state, had_bom))
 			break;
-		}
 
 		g_assert (new_state != NULL);
 		g_assert (SEGMENT_IS_CONTAINER (new_state));
 
 		state = new_state;
 
-                if (ce->hint2 == NULL || ce->hint2->parent != state)
-                        ce->hint2 = state->last_child;
-                g_assert (!ce->hint2 || ce->hint2->parent == state);
+                if (ce->hint2 == NULL || ce->hint2->parent != SEGMENT_ID (state))
+                        ce->hint2 = SEGMENT (ce, state->last_child);
+                g_assert (!ce->hint2 || ce->hint2->parent == SEGMENT_ID (state));
 
 		/* XXX this a temporary workaround for zero-length segments in the end
 		 * of line. there are no zero-length segments in the middle because it goes
@@ -4481,15 +5912,45 @@ analyze_line (GtkSourceContextEngine *ce,
 		 * really have zero length */
 		if (state->start_at == line->char_length)
 			end_segments = g_list_prepend (end_segments, state);
+
+		if (g_get_monotonic_time () > deadline)
+		{
+			is_degraded = TRUE;
+			break;
+		}
 	}
 
-	if (ce->disabled)
-		return NULL;
+	if (degraded != NULL)
+		*degraded = is_degraded;
 
 	/* Extend current state to the end of line. */
-	segment_extend (state, line->start_at + line->char_length);
+	segment_extend (ce, state, line->start_at + line->char_length);
 	g_assert (line_pos <= line->byte_length);
 
+	if (is_degraded)
+	{
+		Segment *opened = NULL;
+		Segment *s;
+
+		GTK_SOURCE_PROFILER_LOG ("analyzed only %d bytes of the %d bytes of the line at %d",
+		                         line_pos, line->byte_length, line->start_at);
+
+		/* Close the contexts started in the analyzed part, so that the
+		 * next lines do not depend on the text which was skipped. */
+		for (s = state; s->parent != 0 && s->start_at >= line->start_at; s = SEGMENT (ce, s->parent))
+		{
+			if (s->is_start)
+				opened = s;
+		}
+
+		if (opened != NULL)
+		{
+			ce->hint2 = opened;
+			state = SEGMENT (ce, opened->parent);
+
+		}
+	}
+
 	/* Verify if we need to close the context because we are at
 	 * the end of the line. */
 	if (ANCESTOR_CAN_END_CONTEXT (state->context) ||
@@ -4500,7 +5961,7 @@ analyze_line (GtkSourceContextEngine *ce,
 
 	/* Extend the segment to the beginning of next line. */
 	g_assert (SEGMENT_IS_CONTAINER (state));
-	segment_extend (state, NEXT_LINE_OFFSET (line));
+	segment_extend (ce, state, NEXT_LINE_OFFSET (line));
 
 	/* if it's the last line, don't bother with zero length segments */
 	if (!line->eol_length)
@@ -4596,51 +6057,56 @@ segment_tree_zero_len (GtkSourceContextEngine *ce)
 
 #ifdef ENABLE_CHECK_TREE
 static Segment *
-get_segment_at_offset_slow_ (Segment *segment,
-                             gint     offset)
+get_segment_at_offset_slow_ (GtkSourceContextEngine *ce,
+                             Segment                *segment,
+                             gint                    offset)
 {
 	Segment *child;
 
 start:
-	if (segment->parent == NULL && offset == segment->end_at)
+	if (segment->parent == 0 && offset == segment->end_at)
 		return segment;
 
 	if (segment->start_at > offset)
 	{
-		g_assert (segment->parent != NULL);
-		segment = segment->parent;
+		g_assert (segment->parent != 0);
+		segment = SEGMENT (ce, segment->parent);
 		goto start;
 	}
 
 	if (segment->start_at == offset)
 	{
-		if (segment->children != NULL && segment->children->start_at == offset)
+		child = SEGMENT (ce, segment->children);
+
+		if (child != NULL && child->start_at == offset)
 		{
-			segment = segment->children;
+			segment = child;
 			goto start;
 		}
 
 		return segment;
 	}
 
-        if (segment->end_at <= offset && segment->parent != NULL)
+        if (segment->end_at <= offset && segment->parent != 0)
 	{
-		if (segment->next != NULL)
+		Segment *next = SEGMENT (ce, segment->next);
+
+		if (next != NULL)
 		{
-			if (segment->next->start_at > offset)
-				return segment->parent;
+			if (next->start_at > offset)
+				return SEGMENT (ce, segment->parent);
 
-			segment = segment->next;
+			segment = next;
 		}
 		else
 		{
-			segment = segment->parent;
+			segment = SEGMENT (ce, segment->parent);
 		}
 
 		goto start;
 	}
 
-	for (child = segment->children; child != NULL; child = child->next)
+	for (child = SEGMENT (ce, segment->children); child != NULL; child = SEGMENT (ce, child->next))
 	{
 		if (child->start_at == offset)
 		{
@@ -4666,33 +6132,40 @@ start:
 #define SEGMENT_CONTAINS(s,o) ((s)->start_at <= (o) && (s)->end_at > (o))
 #define SEGMENT_DISTANCE(s,o) (MIN (ABS ((s)->start_at - (o)), ABS ((s)->end_at - (o))))
 static Segment *
-get_segment_in_ (Segment *segment,
-                 gint     offset)
+get_segment_in_ (GtkSourceContextEngine *ce,
+                 Segment                *segment,
+                 gint                    offset)
 {
+	Segment *first_child;
+	Segment *last_child;
 	Segment *child;
 
 	g_assert (segment->start_at <= offset && segment->end_at > offset);
 
-	if (segment->children == NULL)
+	if (segment->children == 0)
 		return segment;
 
+	first_child = SEGMENT (ce, segment->children);
+
 	if (segment->children == segment->last_child)
 	{
-		if (SEGMENT_IS_ZERO_LEN_AT (segment->children, offset))
-			return segment->children;
+		if (SEGMENT_IS_ZERO_LEN_AT (first_child, offset))
+			return first_child;
 
-		if (SEGMENT_CONTAINS (segment->children, offset))
-			return get_segment_in_ (segment->children, offset);
+		if (SEGMENT_CONTAINS (first_child, offset))
+			return get_segment_in_ (ce, first_child, offset);
 
 		return segment;
 	}
 
-	if (segment->children->start_at > offset || segment->last_child->end_at < offset)
+	last_child = SEGMENT (ce, segment->last_child);
+
+	if (first_child->start_at > offset || last_child->end_at < offset)
 		return segment;
 
-	if (SEGMENT_DISTANCE (segment->children, offset) >= SEGMENT_DISTANCE (segment->last_child, offset))
+	if (SEGMENT_DISTANCE (first_child, offset) >= SEGMENT_DISTANCE (last_child, offset))
 	{
-		for (child = segment->children; child; child = child->next)
+		for (child = first_child; child; child = SEGMENT (ce, child->next))
 		{
 			if (child->start_at > offset)
 				return segment;
@@ -4701,17 +6174,19 @@ get_segment_in_ (Segment *segment,
 				return child;
 
 			if (SEGMENT_CONTAINS (child, offset))
-				return get_segment_in_ (child, offset);
+				return get_segment_in_ (ce, child, offset);
 		}
 	}
 	else
 	{
-		for (child = segment->last_child; child; child = child->prev)
+		for (child = last_child; child; child = SEGMENT (ce, child->prev))
 		{
 			if (SEGMENT_IS_ZERO_LEN_AT (child, offset))
 			{
-				while (child->prev != NULL && SEGMENT_IS_ZERO_LEN_AT (child->prev, offset))
-					child = child->prev;
+				Segment *prev;
+
+				while ((prev = SEGMENT (ce, child->prev)) != NULL && SEGMENT_IS_ZERO_LEN_AT (prev, offset))
+					child = prev;
 				return child;
 			}
 
@@ -4719,7 +6194,7 @@ get_segment_in_ (Segment *segment,
 				return segment;
 
 			if (SEGMENT_CONTAINS (child, offset))
-				return get_segment_in_ (child, offset);
+				return get_segment_in_ (ce, child, offset);
 		}
 	}
 
@@ -4728,13 +6203,18 @@ get_segment_in_ (Segment *segment,
 
 /* assumes zero-length segments can't have children */
 static Segment *
-get_segment_ (Segment *segment,
-              gint     offset)
+get_segment_ (GtkSourceContextEngine *ce,
+              Segment                *segment,
+              gint                    offset)
 {
-	if (segment->parent != NULL)
+	Segment *parent = SEGMENT (ce, segment->parent);
+	Segment *prev;
+	Segment *next;
+
+	if (parent != NULL)
 	{
-		if (!SEGMENT_CONTAINS (segment->parent, offset))
-			return get_segment_ (segment->parent, offset);
+		if (!SEGMENT_CONTAINS (parent, offset))
+			return get_segment_ (ce, parent, offset);
 	}
 	else
 	{
@@ -4743,64 +6223,64 @@ get_segment_ (Segment *segment,
 	}
 
 	if (SEGMENT_CONTAINS (segment, offset))
-		return get_segment_in_ (segment, offset);
+		return get_segment_in_ (ce, segment, offset);
 
 	if (SEGMENT_IS_ZERO_LEN_AT (segment, offset))
 	{
-		while (segment->prev != NULL && SEGMENT_IS_ZERO_LEN_AT (segment->prev, offset))
-			segment = segment->prev;
+		while ((prev = SEGMENT (ce, segment->prev)) != NULL && SEGMENT_IS_ZERO_LEN_AT (prev, offset))
+			segment = prev;
 		return segment;
 	}
 
 	if (offset < segment->start_at)
 	{
-		while (segment->prev != NULL && segment->prev->start_at > offset)
-			segment = segment->prev;
+		while ((prev = SEGMENT (ce, segment->prev)) != NULL && prev->start_at > offset)
+			segment = prev;
 
-		g_assert (!segment->prev || segment->prev->start_at <= offset);
+		g_assert (!prev || prev->start_at <= offset);
 
-		if (segment->prev == NULL)
-			return segment->parent;
+		if (prev == NULL)
+			return parent;
 
-		if (segment->prev->end_at > offset)
-			return get_segment_in_ (segment->prev, offset);
+		if (prev->end_at > offset)
+			return get_segment_in_ (ce, prev, offset);
 
-		if (segment->prev->end_at == offset)
+		if (prev->end_at == offset)
 		{
-			if (SEGMENT_IS_ZERO_LEN_AT (segment->prev, offset))
+			if (SEGMENT_IS_ZERO_LEN_AT (prev, offset))
 			{
-				segment = segment->prev;
-				while (segment->prev != NULL && SEGMENT_IS_ZERO_LEN_AT (segment->prev, offset))
-					segment = segment->prev;
+				segment = prev;
+				while ((prev = SEGMENT (ce, segment->prev)) != NULL && SEGMENT_IS_ZERO_LEN_AT (prev, offset))
+					segment = prev;
 				return segment;
 			}
 
-			return segment->parent;
+			return parent;
 		}
 
 		/* segment->prev->end_at < offset */
-		return segment->parent;
+		return parent;
 	}
 
 	/* offset >= segment->end_at, not zero-length */
 
-	while (segment->next != NULL)
+	while ((next = SEGMENT (ce, segment->next)) != NULL)
 	{
-		if (SEGMENT_IS_ZERO_LEN_AT (segment->next, offset))
-			return segment->next;
+		if (SEGMENT_IS_ZERO_LEN_AT (next, offset))
+			return next;
 
-		if (segment->next->end_at > offset)
+		if (next->end_at > offset)
 		{
-			if (segment->next->start_at <= offset)
-				return get_segment_in_ (segment->next, offset);
+			if (next->start_at <= offset)
+				return get_segment_in_ (ce, next, offset);
 			else
-				return segment->parent;
+				return parent;
 		}
 
-		segment = segment->next;
+		segment = next;
 	}
 
-	return segment->parent;
+	return parent;
 }
 #undef SEGMENT_IS_ZERO_LEN_AT
 #undef SEGMENT_CONTAINS
@@ -4840,10 +6320,10 @@ get_segment_at_offset (GtkSourceContextEngine *ce,
 	}
 #endif
 
-	result = get_segment_ (hint ? hint : ce->root_segment, offset);
+	result = get_segment_ (ce, hint ? hint : ce->root_segment, offset);
 
 #ifdef ENABLE_CHECK_TREE
-	g_assert (result == get_segment_at_offset_slow_ (hint, offset));
+	g_assert (result == get_segment_at_offset_slow_ (ce, hint, offset));
 #endif
 
 	return result;
@@ -4863,38 +6343,42 @@ static void
 segment_remove (GtkSourceContextEngine *ce,
                 Segment                *segment)
 {
-	if (segment->next != NULL)
-		segment->next->prev = segment->prev;
+	Segment *parent = SEGMENT (ce, segment->parent);
+	Segment *next = SEGMENT (ce, segment->next);
+	Segment *prev = SEGMENT (ce, segment->prev);
+
+	if (next != NULL)
+		next->prev = segment->prev;
 	else
-		segment->parent->last_child = segment->prev;
+		parent->last_child = segment->prev;
 
-	if (segment->prev != NULL)
-		segment->prev->next = segment->next;
+	if (prev != NULL)
+		prev->next = segment->next;
 	else
-		segment->parent->children = segment->next;
+		parent->children = segment->next;
 
 	/* if ce->hint is being deleted, set it to some
 	 * neighbour segment */
 	if (ce->hint == segment)
 	{
-		if (segment->next != NULL)
-			ce->hint = segment->next;
-		else if (segment->prev != NULL)
-			ce->hint = segment->prev;
+		if (next != NULL)
+			ce->hint = next;
+		else if (prev != NULL)
+			ce->hint = prev;
 		else
-			ce->hint = segment->parent;
+			ce->hint = parent;
 	}
 
         /* if ce->hint2 is being deleted, set it to some
          * neighbour segment */
         if (ce->hint2 == segment)
         {
-                if (segment->next != NULL)
-                        ce->hint2 = segment->next;
-                else if (segment->prev != NULL)
-                        ce->hint2 = segment->prev;
+                if (next != NULL)
+                        ce->hint2 = next;
+                else if (prev != NULL)
+                        ce->hint2 = prev;
                 else
-                        ce->hint2 = segment->parent;
+                        ce->hint2 = parent;
         }
 
 	segment_destroy (ce, segment);
@@ -4910,7 +6394,7 @@ segment_erase_middle_ (GtkSourceContextEngine *ce,
 	SubPattern *sp;
 
 	new_segment = segment_new (ce,
-				   segment->parent,
+				   SEGMENT (ce, segment->parent),
 				   segment->context,
 				   end,
 				   segment->end_at,
@@ -4918,22 +6402,22 @@ segment_erase_middle_ (GtkSourceContextEngine *ce,
 	segment->end_at = start;
 
 	new_segment->next = segment->next;
-	segment->next = new_segment;
-	new_segment->prev = segment;
+	segment->next = SEGMENT_ID (new_segment);
+	new_segment->prev = SEGMENT_ID (segment);
 
-	if (new_segment->next != NULL)
-		new_segment->next->prev = new_segment;
+	if (new_segment->next != 0)
+		SEGMENT (ce, new_segment->next)->prev = SEGMENT_ID (new_segment);
 	else
-		new_segment->parent->last_child = new_segment;
+		SEGMENT (ce, new_segment->parent)->last_child = SEGMENT_ID (new_segment);
 
-	child = segment->children;
-	segment->children = NULL;
-	segment->last_child = NULL;
+	child = SEGMENT (ce, segment->children);
+	segment->children = 0;
+	segment->last_child = 0;
 
 	while (child != NULL)
 	{
 		Segment *append_to;
-		Segment *next = child->next;
+		Segment *next = SEGMENT (ce, child->next);
 
 		if (child->start_at < start)
 		{
@@ -4946,31 +6430,31 @@ segment_erase_middle_ (GtkSourceContextEngine *ce,
 			append_to = new_segment;
 		}
 
-		child->parent = append_to;
+		child->parent = SEGMENT_ID (append_to);
 
-		if (append_to->last_child != NULL)
+		if (append_to->last_child != 0)
 		{
-			append_to->last_child->next = child;
+			SEGMENT (ce, append_to->last_child)->next = SEGMENT_ID (child);
 			child->prev = append_to->last_child;
-			child->next = NULL;
-			append_to->last_child = child;
+			child->next = 0;
+			append_to->last_child = SEGMENT_ID (child);
 		}
 		else
 		{
-			child->next = child->prev = NULL;
-			append_to->last_child = child;
-			append_to->children = child;
+			child->next = child->prev = 0;
+			append_to->last_child = SEGMENT_ID (child);
+			append_to->children = SEGMENT_ID (child);
 		}
 
 		child = next;
 	}
 
-	sp = segment->sub_patterns;
-	segment->sub_patterns = NULL;
+	sp = SUB_PATTERN (ce, segment->sub_patterns);
+	segment->sub_patterns = 0;
 
 	while (sp != NULL)
 	{
-		SubPattern *next = sp->next;
+		SubPattern *next = SUB_PATTERN (ce, sp->next);
 		Segment *append_to;
 
 		if (sp->start_at < start)
@@ -4985,14 +6469,13 @@ segment_erase_middle_ (GtkSourceContextEngine *ce,
 			append_to = new_segment;
 		}
 
-		sp->next = append_to->sub_patterns;
-		append_to->sub_patterns = sp;
+		segment_add_subpattern (append_to, sp);
 
 		sp = next;
 	}
 
-	CHECK_SEGMENT_CHILDREN (segment);
-	CHECK_SEGMENT_CHILDREN (new_segment);
+	CHECK_SEGMENT_CHILDREN (ce, segment);
+	CHECK_SEGMENT_CHILDREN (ce, new_segment);
 }
 
 /**
@@ -5036,51 +6519,51 @@ segment_erase_range_ (GtkSourceContextEngine *ce,
 
 	if (segment->start_at == end)
 	{
-		Segment *child = segment->children;
+		Segment *child = SEGMENT (ce, segment->children);
 
 		while (child != NULL && child->start_at == end)
 		{
-			Segment *next = child->next;
+			Segment *next = SEGMENT (ce, child->next);
 			segment_erase_range_ (ce, child, start, end);
 			child = next;
 		}
 	}
 	else if (segment->end_at == start)
 	{
-		Segment *child = segment->last_child;
+		Segment *child = SEGMENT (ce, segment->last_child);
 
 		while (child != NULL && child->end_at == start)
 		{
-			Segment *prev = child->prev;
+			Segment *prev = SEGMENT (ce, child->prev);
 			segment_erase_range_ (ce, child, start, end);
 			child = prev;
 		}
 	}
 	else
 	{
-		Segment *child = segment->children;
+		Segment *child = SEGMENT (ce, segment->children);
 
 		while (child != NULL)
 		{
-			Segment *next = child->next;
+			Segment *next = SEGMENT (ce, child->next);
 			segment_erase_range_ (ce, child, start, end);
 			child = next;
 		}
 	}
 
-	if (segment->sub_patterns != NULL)
+	if (segment->sub_patterns != 0)
 	{
 		SubPattern *sp;
 
-		sp = segment->sub_patterns;
-		segment->sub_patterns = NULL;
+		sp = SUB_PATTERN (ce, segment->sub_patterns);
+		segment->sub_patterns = 0;
 
 		while (sp != NULL)
 		{
-			SubPattern *next = sp->next;
+			SubPattern *next = SUB_PATTERN (ce, sp->next);
 
 			if (sp->start_at >= start && sp->end_at <= end)
-				sub_pattern_free (sp);
+				sub_pattern_free (ce, sp);
 			else
 				segment_add_subpattern (segment, sp);
 
@@ -5088,7 +6571,7 @@ segment_erase_range_ (GtkSourceContextEngine *ce,
 		}
 	}
 
-	if (segment->parent != NULL)
+	if (segment->parent != 0)
 	{
 		/* Now all children and subpatterns are cleaned up,
 		 * so we only need to split segment properly if its middle
@@ -5141,30 +6624,30 @@ segment_merge (GtkSourceContextEngine *ce,
 	g_assert (first->end_at == second->start_at);
 
 	if (first->parent != second->parent)
-		segment_merge (ce, first->parent, second->parent);
+		segment_merge (ce, SEGMENT (ce, first->parent), SEGMENT (ce, second->parent));
 
-	parent = first->parent;
+	parent = SEGMENT (ce, first->parent);
 
-	g_assert (first->next == second);
+	g_assert (first->next == SEGMENT_ID (second));
 	g_assert (first->parent == second->parent);
-	g_assert (second != parent->children);
+	g_assert (SEGMENT_ID (second) != parent->children);
 
-	if (second == parent->last_child)
-		parent->last_child = first;
+	if (SEGMENT_ID (second) == parent->last_child)
+		parent->last_child = SEGMENT_ID (first);
 	first->next = second->next;
-	if (second->next != NULL)
-		second->next->prev = first;
+	if (second->next != 0)
+		SEGMENT (ce, second->next)->prev = SEGMENT_ID (first);
 
 	first->end_at = second->end_at;
 
-	if (second->children != NULL)
+	if (second->children != 0)
 	{
 		Segment *child;
 
-		for (child = second->children; child != NULL; child = child->next)
-			child->parent = first;
+		for (child = SEGMENT (ce, second->children); child != NULL; child = SEGMENT (ce, child->next))
+			child->parent = SEGMENT_ID (first);
 
-		if (first->children == NULL)
+		if (first->children == 0)
 		{
 			g_assert (!first->last_child);
 			first->children = second->children;
@@ -5172,33 +6655,32 @@ segment_merge (GtkSourceContextEngine *ce,
 		}
 		else
 		{
-			first->last_child->next = second->children;
-			second->children->prev = first->last_child;
+			SEGMENT (ce, first->last_child)->next = second->children;
+			SEGMENT (ce, second->children)->prev = first->last_child;
 			first->last_child = second->last_child;
 		}
 	}
 
-	if (second->sub_patterns != NULL)
+	if (second->sub_patterns != 0)
 	{
-		if (first->sub_patterns == NULL)
+		if (first->sub_patterns == 0)
 		{
 			first->sub_patterns = second->sub_patterns;
 		}
 		else
 		{
-			while (second->sub_patterns != NULL)
+			while (second->sub_patterns != 0)
 			{
-				SubPattern *sp = second->sub_patterns;
+				SubPattern *sp = SUB_PATTERN (ce, second->sub_patterns);
 				second->sub_patterns = sp->next;
-				sp->next = first->sub_patterns;
-				first->sub_patterns = sp;
+				segment_add_subpattern (first, sp);
 			}
 		}
 	}
 
-	second->children = NULL;
-	second->last_child = NULL;
-	second->sub_patterns = NULL;
+	second->children = 0;
+	second->last_child = 0;
+	second->sub_patterns = 0;
 
 	segment_destroy (ce, second);
 }
@@ -5224,25 +6706,25 @@ erase_segments (GtkSourceContextEngine *ce,
 	Segment *root = ce->root_segment;
 	Segment *child, *hint_prev;
 
-	if (root->children == NULL)
+	if (root->children == 0)
 		return;
 
 	if (hint == NULL)
 		hint = ce->hint;
 
 	if (hint != NULL)
-		while (hint != NULL && hint->parent != ce->root_segment)
-			hint = hint->parent;
+		while (hint != NULL && hint->parent != SEGMENT_ID (ce->root_segment))
+			hint = SEGMENT (ce, hint->parent);
 
 	if (hint == NULL)
-		hint = root->children;
+		hint = SEGMENT (ce, root->children);
 
-	hint_prev = hint->prev;
+	hint_prev = SEGMENT (ce, hint->prev);
 
 	child = hint;
 	while (child != NULL)
 	{
-		Segment *next = child->next;
+		Segment *next = SEGMENT (ce, child->next);
 
 		if (child->end_at < start)
 		{
@@ -5267,7 +6749,8 @@ erase_segments (GtkSourceContextEngine *ce,
 	child = hint_prev;
 	while (child != NULL)
 	{
-		Segment *prev = child->prev;
+		Segment *prev = SEGMENT (ce, child->prev);
+
 
 		if (ce->hint == NULL)
 			ce->hint = child;
@@ -5292,6 +6775,115 @@ erase_segments (GtkSourceContextEngine *ce,
 
 #define IS_BOM(c) (c == 0xFEFF)
 
+/**
+ * emit_highlight_degraded_cb:
+ * @deadline: the time the work should complete by.
+ * @user_data: #GtkSourceContextEngine.
+ *
+ * Emits GtkSourceBuffer::highlight-degraded for the lines of
+ * degraded_pending. It runs from the scheduler, so that the handlers
+ * can modify the buffer while no analysis is in progress.
+ */
+static gboolean
+emit_highlight_degraded_cb (gint64   deadline,
+                            gpointer user_data)
+{
+	GtkSourceContextEngine *ce = user_data;
+	gsize handler = ce->degraded_handler;
+	gboolean again = G_SOURCE_REMOVE;
+
+	g_object_ref (ce);
+
+	/* A handler can detach the buffer, which removes this task. */
+	while (ce->degraded_handler == handler &&
+	       !gtk_source_region_is_empty (ce->degraded_pending))
+	{
+		GtkSourceRegionIter reg_iter;
+		GtkTextIter start, end;
+
+		if (g_get_monotonic_time () > deadline)
+		{
+			again = G_SOURCE_CONTINUE;
+			break;
+		}
+
+		gtk_source_region_get_start_region_iter (ce->degraded_pending, &reg_iter);
+		gtk_source_region_iter_get_subregion (&reg_iter, &start, NULL);
+
+		/* One line at a time, edits may have joined the lines. */
+		gtk_text_iter_set_line_offset (&start, 0);
+		end = start;
+
+		if (!gtk_text_iter_ends_line (&end))
+			gtk_text_iter_forward_to_line_end (&end);
+
+		gtk_source_region_subtract_subregion (ce->degraded_pending, &start, &end);
+
+		g_signal_emit_by_name (ce->buffer, "highlight-degraded", &start, &end);
+	}
+
+	if (again == G_SOURCE_REMOVE && ce->degraded_handler == handler)
+		ce->degraded_handler = 0;
+
+	g_object_unref (ce);
+
+	return again;
+}
+
+/**
+ * update_degraded_line:
+ * @ce: a #GtkSourceContextEngine.
+ * @line_start: the start of the line just analyzed.
+ * @degraded: whether only the beginning of the line was analyzed.
+ *
+ * Keeps track of the degraded lines, and queues the emission of
+ * GtkSourceBuffer::highlight-degraded for the ones which were not
+ * degraded before. Analyzing a line again does not report it again.
+ */
+static void
+update_degraded_line (GtkSourceContextEngine *ce,
+                      const GtkTextIter      *line_start,
+                      gboolean                degraded)
+{
+	GtkSourceRegion *reported;
+	GtkTextIter line_end = *line_start;
+
+	if (!gtk_text_iter_ends_line (&line_end))
+		gtk_text_iter_forward_to_line_end (&line_end);
+
+	if (!degraded)
+	{
+		gtk_source_region_subtract_subregion (ce->degraded_region, line_start, &line_end);
+		gtk_source_region_subtract_subregion (ce->degraded_pending, line_start, &line_end);
+		return;
+	}
+
+	reported = gtk_source_region_intersect_subregion (ce->degraded_region, line_start, &line_end);
+
+	if (reported != NULL)
+	{
+		gboolean is_reported = !gtk_source_region_is_empty (reported);
+
+		g_object_unref (reported);
+
+		if (is_reported)
+			return;
+	}
+
+	gtk_source_region_add_subregion (ce->degraded_region, line_start, &line_end);
+	gtk_source_region_add_subregion (ce->degraded_pending, line_start, &line_end);
+
+	if (ce->degraded_handler == 0)
+	{
+		ce->degraded_handler =
+			_gtk_source_scheduler_add_for_owner (ce->buffer,
+			                                     GTK_SOURCE_SCHEDULER_TASK_HIGHLIGHTING,
+			                                     emit_highlight_degraded_cb,
+			                                     ce,
+			                                     NULL);
+	}
+}
+
 /**
  * update_syntax:
  * @ce: #GtkSourceContextEngine.
@@ -5415,6 +7007,7 @@ update_syntax (GtkSourceContextEngine *ce,
 		LineInfo line;
 		gboolean next_line_invalid = FALSE;
 		gboolean need_invalidate_next = FALSE;
+		gboolean degraded;
 
 		/* Last buffer line. */
 		if (line_start_offset == line_end_offset)
@@ -5449,14 +7042,13 @@ update_syntax (GtkSourceContextEngine *ce,
 
 		ce->hint2 = ce->hint;
 
-		if (ce->hint2 != NULL && ce->hint2->parent != state)
+		if (ce->hint2 != NULL && ce->hint2->parent != SEGMENT_ID (state))
 			ce->hint2 = NULL;
 
-		state = analyze_line (ce, state, &line, had_bom);
+		state = analyze_line (ce, state, &line, had_bom, &degraded);
 
-		/* At this point analyze_line() could have disabled highlighting */
-		if (ce->disabled)
-			return;
+		if (degraded || !gtk_source_region_is_empty (ce->degraded_region))
+			update_degraded_line (ce, &line_start, degraded);
 
 #ifdef ENABLE_CHECK_TREE
 		{
@@ -5522,56 +7114,455 @@ update_syntax (GtkSourceContextEngine *ce,
 			break;
 		}
 
-		if (next_line_invalid)
+		if (next_line_invalid)
+		{
+			line_start_offset = line_end_offset;
+			line_start = line_end;
+			gtk_text_iter_forward_line (&line_end);
+			line_end_offset = gtk_text_iter_get_offset (&line_end);
+		}
+		else
+		{
+			gtk_text_buffer_get_iter_at_offset (buffer, &line_start, invalid->start_at);
+			gtk_text_iter_set_line_offset (&line_start, 0);
+			line_start_offset = gtk_text_iter_get_offset (&line_start);
+			line_end = line_start;
+			gtk_text_iter_forward_line (&line_end);
+			line_end_offset = gtk_text_iter_get_offset (&line_end);
+		}
+
+		first_line = (start_offset - had_bom) == line_start_offset;
+	}
+
+	if (analyzed_end == gtk_text_buffer_get_char_count (buffer))
+	{
+		g_assert (g_slist_length (ce->invalid) <= 1);
+
+		if (ce->invalid != NULL)
+		{
+			invalid = get_invalid_segment (ce);
+			segment_remove (ce, invalid);
+			CHECK_TREE (ce);
+		}
+	}
+
+	if (!all_analyzed (ce))
+		install_update_worker (ce);
+
+	gtk_text_iter_set_offset (&end_iter, analyzed_end);
+
+	refresh_range (ce, &start_iter, &end_iter);
+
+	GTK_SOURCE_PROFILER_LOG ("analyzed %d chars from %d to %d in %fms",
+	                         analyzed_end - start_offset, start_offset, analyzed_end,
+	                         g_timer_elapsed (timer, NULL) * 1000);
+
+	g_timer_destroy (timer);
+
+out:
+	/* must call context_thaw, so this is the only return point */
+	context_thaw (ce->root_context);
+}
+
+
+
+/* SPECULATIVE HIGHLIGHTING ----------------------------------------------- */
+
+static void
+checkpoint_clear (Checkpoint *checkpoint)
+{
+	g_slist_free_full (checkpoint->contexts, (GDestroyNotify) context_unref);
+	checkpoint->contexts = NULL;
+}
+
+/**
+ * add_checkpoint:
+ * @ce: a #GtkSourceContextEngine.
+ * @state: the state at the beginning of the line.
+ * @offset: the beginning of the line.
+ *
+ * Records the stack of contexts of @state, so that the speculative
+ * analysis can later resume at @offset.
+ */
+static void
+add_checkpoint (GtkSourceContextEngine *ce,
+                Segment                *state,
+                gint                    offset)
+{
+	Checkpoint checkpoint;
+	guint i;
+
+	checkpoint.offset = offset;
+	checkpoint.contexts = NULL;
+
+	for (; state->parent != 0; state = SEGMENT (ce, state->parent))
+		checkpoint.contexts = g_slist_prepend (checkpoint.contexts,
+						       context_ref (state->context));
+
+	for (i = 0; i < ce->checkpoints->len; i++)
+	{
+		Checkpoint *cur = &g_array_index (ce->checkpoints, Checkpoint, i);
+
+		if (cur->offset == offset)
+		{
+			checkpoint_clear (cur);
+			*cur = checkpoint;
+			return;
+		}
+
+		if (cur->offset > offset)
+			break;
+	}
+
+	g_array_insert_val (ce->checkpoints, i, checkpoint);
+
+	if (ce->checkpoints->len > MAX_CHECKPOINTS)
+		g_array_remove_index (ce->checkpoints, 0);
+}
+
+/**
+ * find_checkpoint:
+ * @ce: a #GtkSourceContextEngine.
+ * @offset: the offset.
+ * @min_offset: the minimal offset.
+ *
+ * Returns: the last checkpoint in [@min_offset; @offset], or %NULL.
+ */
+static Checkpoint *
+find_checkpoint (GtkSourceContextEngine *ce,
+                 gint                    offset,
+                 gint                    min_offset)
+{
+	guint i;
+
+	for (i = ce->checkpoints->len; i > 0; i--)
+	{
+		Checkpoint *checkpoint = &g_array_index (ce->checkpoints, Checkpoint, i - 1);
+
+		if (checkpoint->offset <= offset)
+			return checkpoint->offset >= min_offset ? checkpoint : NULL;
+	}
+
+	return NULL;
+}
+
+/**
+ * find_resync_line:
+ * @buffer: a #GtkTextBuffer.
+ * @line: the first line to highlight.
+ *
+ * Looks above @line for a line likely outside of any context: the
+ * beginning of the buffer, or a line that is not indented.
+ *
+ * Returns: the line where to start analyzing from the root context.
+ */
+static gint
+find_resync_line (GtkTextBuffer *buffer,
+                  gint           line)
+{
+	gint min_line = MAX (0, line - SPECULATION_MAX_LINES);
+	gint cur;
+
+	for (cur = line; cur >= min_line; cur--)
+	{
+		GtkTextIter iter;
+
+		if (cur == 0)
+			return 0;
+
+		gtk_text_buffer_get_iter_at_line (buffer, &iter, cur);
+
+		if (!gtk_text_iter_ends_line (&iter) &&
+		    !g_unichar_isspace (gtk_text_iter_get_char (&iter)))
+			return cur;
+	}
+
+	return line;
+}
+
+static void
+destroy_speculative_tree (GtkSourceContextEngine *ce)
+{
+	if (ce->spec_root != NULL)
+	{
+		segment_destroy (ce, ce->spec_root);
+		ce->spec_root = NULL;
+		ce->spec_state = NULL;
+	}
+}
+
+/**
+ * clear_speculation:
+ * @ce: a #GtkSourceContextEngine.
+ *
+ * Forgets the speculative tree and the checkpoints. The text keeps the
+ * speculative tags until it is highlighted again.
+ */
+static void
+clear_speculation (GtkSourceContextEngine *ce)
+{
+	destroy_speculative_tree (ce);
+
+	if (ce->checkpoints != NULL)
+		g_array_set_size (ce->checkpoints, 0);
+}
+
+/**
+ * invalidate_speculation:
+ * @ce: a #GtkSourceContextEngine.
+ * @offset: the beginning of the modified text.
+ *
+ * Forgets the speculative analysis that depends on the text at @offset.
+ */
+static void
+invalidate_speculation (GtkSourceContextEngine *ce,
+                        gint                    offset)
+{
+	guint i;
+
+	if (ce->spec_root != NULL && offset < ce->spec_root->end_at)
+		destroy_speculative_tree (ce);
+
+	if (ce->checkpoints == NULL)
+		return;
+
+	for (i = 0; i < ce->checkpoints->len; i++)
+	{
+		if (g_array_index (ce->checkpoints, Checkpoint, i).offset > offset)
+			break;
+	}
+
+	g_array_set_size (ce->checkpoints, i);
+}
+
+/**
+ * prune_speculation:
+ * @ce: a #GtkSourceContextEngine.
+ * @analyzed_end: the beginning of the first invalid segment.
+ *
+ * Drops what the analysis has caught up with.
+ */
+static void
+prune_speculation (GtkSourceContextEngine *ce,
+                   gint                    analyzed_end)
+{
+	guint n = 0;
+
+	if (ce->spec_root != NULL && ce->spec_root->end_at <= analyzed_end)
+		destroy_speculative_tree (ce);
+
+	while (n < ce->checkpoints->len &&
+	       g_array_index (ce->checkpoints, Checkpoint, n).offset <= analyzed_end)
+		n++;
+
+	if (n > 0)
+		g_array_remove_range (ce->checkpoints, 0, n);
+}
+
+/**
+ * speculate_highlight:
+ * @ce: a #GtkSourceContextEngine.
+ * @start: the beginning of the shown area.
+ * @end: the end of the shown area.
+ *
+ * Highlights the shown lines that the analysis will not reach soon,
+ * without waiting for it to analyze all the text above them. They are
+ * analyzed in a separate tree, starting at the nearest checkpoint, or
+ * at a line found by find_resync_line() when there is none. The
+ * analysis corrects the tags later, touching only the ones that differ,
+ * see update_tags().
+ */
+static void
+speculate_highlight (GtkSourceContextEngine *ce,
+                     const GtkTextIter      *start,
+                     const GtkTextIter      *end)
+{
+	GtkTextBuffer *buffer = ce->buffer;
+	GtkTextIter iter, line_start, line_end;
+	Segment *invalid = NULL;
+	Segment *state;
+	Segment *saved_hint, *saved_hint2;
+	GSList *l;
+	gint from, to;
+	gint from_line;
+	gint analyze_from;
+	gint n_lines = 0;
+	gboolean had_bom = FALSE;
+	GTimer *timer;
+
+	/* Called from update_syntax() through the ::highlight-updated signal. */
+	if (ce->root_context->frozen || gtk_text_buffer_get_char_count (buffer) == 0)
+		return;
+
+	context_freeze (ce->root_context);
+	update_tree (ce);
+	context_thaw (ce->root_context);
+
+	if (ce->invalid == NULL)
+	{
+		clear_speculation (ce);
+		return;
+	}
+
+	prune_speculation (ce, ((Segment *) ce->invalid->data)->start_at);
+
+	for (l = ce->invalid; l != NULL; l = l->next)
+	{
+		Segment *segment = l->data;
+
+		if (segment->end_at > gtk_text_iter_get_offset (start))
+		{
+			invalid = segment;
+			break;
+		}
+	}
+
+	if (invalid == NULL || invalid->start_at >= gtk_text_iter_get_offset (end))
+		return;
+
+	/* The lines to highlight, from the beginning of the first one to
+	 * the beginning of the line after the last one. */
+	from = MAX (gtk_text_iter_get_offset (start), invalid->start_at);
+	gtk_text_buffer_get_iter_at_offset (buffer, &line_start, from);
+	gtk_text_iter_set_line_offset (&line_start, 0);
+	from = gtk_text_iter_get_offset (&line_start);
+	from_line = gtk_text_iter_get_line (&line_start);
+
+	to = MIN (gtk_text_iter_get_offset (end), invalid->end_at);
+	gtk_text_buffer_get_iter_at_offset (buffer, &iter, to);
+	if (!gtk_text_iter_starts_line (&iter))
+		gtk_text_iter_forward_line (&iter);
+	to = gtk_text_iter_get_offset (&iter);
+
+	/* The analysis is close, it will be there soon. */
+	gtk_text_buffer_get_iter_at_offset (buffer, &iter, invalid->start_at);
+	if (from_line - gtk_text_iter_get_line (&iter) < SPECULATION_MIN_LINES)
+		return;
+
+	if (ce->spec_root != NULL &&
+	    from >= ce->spec_highlighted_start &&
+	    to <= ce->spec_root->end_at)
+		return;
+
+	saved_hint = ce->hint;
+	saved_hint2 = ce->hint2;
+	ce->hint = NULL;
+	ce->hint2 = NULL;
+
+	context_freeze (ce->root_context);
+
+	gtk_text_buffer_get_iter_at_offset (buffer, &iter,
+					    ce->spec_root != NULL ? ce->spec_root->end_at : 0);
+
+	if (ce->spec_root != NULL &&
+	    from >= ce->spec_highlighted_start &&
+	    from_line - gtk_text_iter_get_line (&iter) <= SPECULATION_MAX_LINES)
+	{
+		/* Continue the speculative tree, and highlight the lines
+		 * in between too. */
+		state = ce->spec_state;
+		line_start = iter;
+	}
+	else
+	{
+		Checkpoint *checkpoint;
+		gint min_offset;
+
+		destroy_speculative_tree (ce);
+
+		gtk_text_buffer_get_iter_at_line (buffer, &iter, MAX (0, from_line - SPECULATION_MAX_LINES));
+		min_offset = gtk_text_iter_get_offset (&iter);
+		checkpoint = find_checkpoint (ce, from, min_offset);
+
+		if (checkpoint != NULL)
 		{
-			line_start_offset = line_end_offset;
-			line_start = line_end;
-			gtk_text_iter_forward_line (&line_end);
-			line_end_offset = gtk_text_iter_get_offset (&line_end);
+			gtk_text_buffer_get_iter_at_offset (buffer, &line_start, checkpoint->offset);
 		}
 		else
 		{
-			gtk_text_buffer_get_iter_at_offset (buffer, &line_start, invalid->start_at);
-			gtk_text_iter_set_line_offset (&line_start, 0);
-			line_start_offset = gtk_text_iter_get_offset (&line_start);
-			line_end = line_start;
-			gtk_text_iter_forward_line (&line_end);
-			line_end_offset = gtk_text_iter_get_offset (&line_end);
-		}
+			gtk_text_buffer_get_iter_at_line (buffer, &line_start,
+							  find_resync_line (buffer, from_line));
 
-		first_line = (start_offset - had_bom) == line_start_offset;
-	}
+			/* See update_syntax(). */
+			if (gtk_text_iter_is_start (&line_start) &&
+			    IS_BOM (gtk_text_iter_get_char (&line_start)))
+			{
+				had_bom = TRUE;
+				gtk_text_iter_forward_char (&line_start);
+			}
+		}
 
-	if (analyzed_end == gtk_text_buffer_get_char_count (buffer))
-	{
-		g_assert (g_slist_length (ce->invalid) <= 1);
+		analyze_from = gtk_text_iter_get_offset (&line_start);
+		ce->spec_root = segment_new (ce, NULL, ce->root_context,
+					     analyze_from, analyze_from, TRUE);
+		ce->spec_highlighted_start = from;
+		state = ce->spec_root;
 
-		if (ce->invalid != NULL)
+		if (checkpoint != NULL)
 		{
-			invalid = get_invalid_segment (ce);
-			segment_remove (ce, invalid);
-			CHECK_TREE (ce);
+			for (l = checkpoint->contexts; l != NULL; l = l->next)
+				state = create_segment (ce, state, l->data,
+							analyze_from, analyze_from,
+							FALSE, NULL);
 		}
 	}
 
-	if (!all_analyzed (ce))
-		install_idle_worker (ce);
+	analyze_from = gtk_text_iter_get_offset (&line_start);
+	timer = g_timer_new ();
 
-	gtk_text_iter_set_offset (&end_iter, analyzed_end);
+	while (gtk_text_iter_get_offset (&line_start) < to)
+	{
+		LineInfo line;
 
-	refresh_range (ce, &start_iter, &end_iter);
+		line_end = line_start;
+		gtk_text_iter_forward_line (&line_end);
 
-	GTK_SOURCE_PROFILER_LOG ("analyzed %d chars from %d to %d in %fms",
-	                         analyzed_end - start_offset, start_offset, analyzed_end,
-	                         g_timer_elapsed (timer, NULL) * 1000);
+		if (gtk_text_iter_equal (&line_start, &line_end))
+			break;
 
-	g_timer_destroy (timer);
+		get_line_info (buffer, &line_start, &line_end, &line);
+
+		if (ce->hint != NULL && ce->hint->parent == SEGMENT_ID (state))
+			ce->hint2 = ce->hint;
+		else
+			ce->hint2 = NULL;
+
+		state = analyze_line (ce, state, &line, had_bom, NULL);
+		line_info_destroy (&line);
+
+		ce->hint = ce->hint2 != NULL ? ce->hint2 : state;
+		had_bom = FALSE;
+		line_start = line_end;
+
+		if (++n_lines % CHECKPOINT_INTERVAL == 0)
+			add_checkpoint (ce, state, gtk_text_iter_get_offset (&line_start));
+
+		if (g_timer_elapsed (timer, NULL) * 1000 > SPECULATION_MAX_TIME)
+			break;
+	}
+
+	ce->spec_state = state;
+	add_checkpoint (ce, state, gtk_text_iter_get_offset (&line_start));
+
+	ce->hint = saved_hint;
+	ce->hint2 = saved_hint2;
 
-out:
-	/* must call context_thaw, so this is the only return point */
 	context_thaw (ce->root_context);
-}
 
+	/* Highlight the new lines. */
+	from = MAX (analyze_from, ce->spec_highlighted_start);
+
+	if (from < ce->spec_root->end_at)
+	{
+		gtk_text_buffer_get_iter_at_offset (buffer, &iter, from);
+		update_tags (ce, ce->spec_root, &iter, &line_start);
+	}
+
+	GTK_SOURCE_PROFILER_LOG ("speculatively analyzed %d lines in %fms",
+	                         n_lines, g_timer_elapsed (timer, NULL) * 1000);
+
+	g_timer_destroy (timer);
+}
 
 /* DEFINITIONS MANAGEMENT ------------------------------------------------- */
 
@@ -5633,6 +7624,37 @@ copy_context_classes (GSList *context_classes)
 	return g_slist_reverse (ret);
 }
 
+static GVariant *
+context_classes_to_variant (GSList *context_classes)
+{
+	GVariantBuilder builder;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sb)"));
+
+	for (; context_classes != NULL; context_classes = context_classes->next)
+	{
+		GtkSourceContextClass *cclass = context_classes->data;
+		g_variant_builder_add (&builder, "(sb)", cclass->name, cclass->enabled);
+	}
+
+	return g_variant_builder_end (&builder);
+}
+
+static GSList *
+context_classes_from_variant (GVariant *variant)
+{
+	GVariantIter iter;
+	const gchar *name;
+	gboolean enabled;
+	GSList *ret = NULL;
+
+	g_variant_iter_init (&iter, variant);
+	while (g_variant_iter_next (&iter, "(&sb)", &name, &enabled))
+		ret = g_slist_prepend (ret, gtk_source_context_class_new (name, enabled));
+
+	return g_slist_reverse (ret);
+}
+
 static ContextDefinition *
 context_definition_new (const gchar            *id,
                         ContextType             type,
@@ -5789,6 +7811,8 @@ context_definition_unref (ContextDefinition *definition)
 	g_free (definition->id);
 	g_free (definition->default_style);
 	_gtk_source_regex_unref (definition->reg_all);
+	_gtk_source_keyword_trie_unref (definition->keywords);
+	_gtk_source_keyword_trie_unref (definition->children_keywords);
 
 	g_slist_free_full (definition->context_classes,
 	                   (GDestroyNotify)gtk_source_context_class_free);
@@ -5935,9 +7959,56 @@ _gtk_source_context_data_define_context (GtkSourceContextData   *ctx_data,
 	if (parent != NULL)
 		definition_child_new (parent, id, NULL, FALSE, FALSE, FALSE);
 
+	if (ctx_data->recording != NULL)
+		g_variant_builder_add (ctx_data->recording, "(yv)", 'c',
+				       g_variant_new ("(smsmsmsmsms@a(sb)u)",
+						      id, parent_id, match_regex,
+						      start_regex, end_regex, style,
+						      context_classes_to_variant (context_classes),
+						      flags));
+
 	return TRUE;
 }
 
+/**
+ * _gtk_source_context_data_set_keywords:
+ * @ctx_data: a #GtkSourceContextData.
+ * @id: the id of a simple context.
+ * @keywords: the literal words matched by the regex of the context.
+ * @caseless: whether the regex is case insensitive.
+ *
+ * Lets the engine find the context with a #GtkSourceKeywordTrie instead
+ * of running its regex everywhere. The regex still has to match the
+ * words between word boundaries only.
+ */
+void
+_gtk_source_context_data_set_keywords (GtkSourceContextData *ctx_data,
+                                       const gchar          *id,
+                                       const gchar * const  *keywords,
+                                       gboolean              caseless)
+{
+	ContextDefinition *definition;
+	guint i;
+
+	g_return_if_fail (ctx_data != NULL);
+	g_return_if_fail (id != NULL);
+	g_return_if_fail (keywords != NULL);
+
+	definition = gtk_source_context_data_lookup (ctx_data, id);
+	g_return_if_fail (definition != NULL);
+	g_return_if_fail (definition->type == CONTEXT_TYPE_SIMPLE);
+
+	_gtk_source_keyword_trie_unref (definition->keywords);
+	definition->keywords = _gtk_source_keyword_trie_new (caseless);
+
+	for (i = 0; keywords[i] != NULL; i++)
+		_gtk_source_keyword_trie_add (definition->keywords, keywords[i]);
+
+	if (ctx_data->recording != NULL)
+		g_variant_builder_add (ctx_data->recording, "(yv)", 'k',
+				       g_variant_new ("(s^asb)", id, keywords, caseless));
+}
+
 gboolean
 _gtk_source_context_data_add_sub_pattern (GtkSourceContextData  *ctx_data,
                                           const gchar           *id,
@@ -6023,6 +8094,12 @@ _gtk_source_context_data_add_sub_pattern (GtkSourceContextData  *ctx_data,
 
 	sp_def->context_classes = copy_context_classes (context_classes);
 
+	if (ctx_data->recording != NULL)
+		g_variant_builder_add (ctx_data->recording, "(yv)", 'p',
+				       g_variant_new ("(sssmsms@a(sb))",
+						      id, parent_id, name, where, style,
+						      context_classes_to_variant (context_classes)));
+
 	return TRUE;
 }
 
@@ -6053,6 +8130,7 @@ _gtk_source_context_data_add_ref (GtkSourceContextData        *ctx_data,
 	ContextDefinition *parent;
 	ContextDefinition *ref;
 	gboolean override_style = FALSE;
+	gboolean all_requested = all;
 
 	g_return_val_if_fail (parent_id != NULL, FALSE);
 	g_return_val_if_fail (ref_id != NULL, FALSE);
@@ -6092,6 +8170,11 @@ _gtk_source_context_data_add_ref (GtkSourceContextData        *ctx_data,
 	definition_child_new (parent, ref_id, style, override_style, all,
 			      (options & GTK_SOURCE_CONTEXT_REF_ORIGINAL) != 0);
 
+	if (ctx_data->recording != NULL)
+		g_variant_builder_add (ctx_data->recording, "(yv)", 'r',
+				       g_variant_new ("(ssumsb)", parent_id, ref_id,
+						      options, style, all_requested));
+
 	return TRUE;
 }
 
@@ -6256,6 +8339,10 @@ _gtk_source_context_data_finish_parse (GtkSourceContextData  *ctx_data,
 
 		g_return_val_if_fail (repl != NULL, FALSE);
 
+		if (ctx_data->recording != NULL)
+			g_variant_builder_add (ctx_data->recording, "(yv)", 'R',
+					       g_variant_new ("(ss)", repl->id, repl->replace_with));
+
 		if (!process_replace (ctx_data, repl->id, repl->replace_with, error))
 			return FALSE;
 
@@ -6386,6 +8473,358 @@ out:
 	g_slist_free (definitions);
 }
 
+/* REGEX STATS ------------------------------------------------------------ */
+
+static void
+add_regex_stats (GtkSourceRegexStats *stats,
+                 GtkSourceRegex      *regex)
+{
+	/* The unresolved end regexes are only templates, a new regex is
+	 * created from them for each context.
+	 */
+	if (regex == NULL || !_gtk_source_regex_is_resolved (regex))
+		return;
+
+	stats->n_regexes++;
+
+	if (_gtk_source_regex_is_compiled (regex))
+		stats->n_compiled++;
+
+	if (_gtk_source_regex_is_jit_compiled (regex))
+		stats->n_jit_compiled++;
+}
+
+/**
+ * _gtk_source_context_data_get_regex_stats:
+ * @ctx_data: a #GtkSourceContextData.
+ * @stats: (out): where to store the counts.
+ *
+ * Counts the regexes of the definitions of the language, and how many
+ * of them were compiled and JIT compiled so far, since they are only
+ * compiled when they are used.
+ */
+void
+_gtk_source_context_data_get_regex_stats (GtkSourceContextData *ctx_data,
+                                          GtkSourceRegexStats  *stats)
+{
+	GHashTable *seen;
+	GHashTableIter iter;
+	ContextDefinition *definition;
+
+	g_return_if_fail (ctx_data != NULL);
+	g_return_if_fail (stats != NULL);
+
+	memset (stats, 0, sizeof *stats);
+
+	/* A definition is there under several ids. */
+	seen = g_hash_table_new (NULL, NULL);
+
+	g_hash_table_iter_init (&iter, ctx_data->definitions);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &definition))
+	{
+		if (!g_hash_table_add (seen, definition))
+			continue;
+
+		if (definition->type == CONTEXT_TYPE_SIMPLE)
+		{
+			add_regex_stats (stats, definition->u.match);
+		}
+		else
+		{
+			add_regex_stats (stats, definition->u.start_end.start);
+			add_regex_stats (stats, definition->u.start_end.end);
+		}
+
+		add_regex_stats (stats, definition->reg_all);
+	}
+
+	g_hash_table_destroy (seen);
+}
+
+static gboolean
+compile_regex (ContextDefinition  *definition,
+               GtkSourceRegex     *regex,
+               GError            **error)
+{
+	if (regex == NULL || !_gtk_source_regex_is_resolved (regex))
+		return TRUE;
+
+	if (!_gtk_source_regex_compile (regex, error))
+	{
+		g_prefix_error (error, "in context '%s': ", definition->id);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * _gtk_source_context_data_compile_regexes:
+ * @ctx_data: a #GtkSourceContextData.
+ * @error: location to store the error occurring, or %NULL to ignore errors.
+ *
+ * Compiles every regex of the definitions of the language, which are
+ * otherwise only compiled when they are first matched, to check that
+ * they are all valid.
+ *
+ * Returns: %FALSE if a regex is invalid.
+ */
+gboolean
+_gtk_source_context_data_compile_regexes (GtkSourceContextData  *ctx_data,
+                                          GError               **error)
+{
+	GHashTableIter iter;
+	ContextDefinition *definition;
+
+	g_return_val_if_fail (ctx_data != NULL, FALSE);
+
+	g_hash_table_iter_init (&iter, ctx_data->definitions);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &definition))
+	{
+		if (definition->type == CONTEXT_TYPE_SIMPLE)
+		{
+			if (!compile_regex (definition, definition->u.match, error))
+				return FALSE;
+		}
+		else
+		{
+			if (!compile_regex (definition, definition->u.start_end.start, error) ||
+			    !compile_regex (definition, definition->u.start_end.end, error))
+				return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/* RECORDING -------------------------------------------------------------- */
+
+/**
+ * _gtk_source_context_data_start_recording:
+ * @ctx_data: a #GtkSourceContextData.
+ *
+ * Starts recording the calls filling @ctx_data, so that they can be
+ * replayed with _gtk_source_context_data_replay() without parsing the
+ * language files again.
+ */
+void
+_gtk_source_context_data_start_recording (GtkSourceContextData *ctx_data)
+{
+	g_return_if_fail (ctx_data != NULL);
+	g_return_if_fail (ctx_data->recording == NULL);
+
+	ctx_data->recording = g_variant_builder_new (G_VARIANT_TYPE ("a(yv)"));
+}
+
+/**
+ * _gtk_source_context_data_end_recording:
+ * @ctx_data: a #GtkSourceContextData.
+ *
+ * Returns: (transfer full): a floating #GVariant of type a(yv) with
+ * the calls made since _gtk_source_context_data_start_recording().
+ */
+GVariant *
+_gtk_source_context_data_end_recording (GtkSourceContextData *ctx_data)
+{
+	GVariant *ret;
+
+	g_return_val_if_fail (ctx_data != NULL, NULL);
+	g_return_val_if_fail (ctx_data->recording != NULL, NULL);
+
+	ret = g_variant_builder_end (ctx_data->recording);
+	g_variant_builder_unref (ctx_data->recording);
+	ctx_data->recording = NULL;
+
+	return ret;
+}
+
+static gboolean
+replay_op (GtkSourceContextData  *ctx_data,
+           guchar                 op,
+           GVariant              *args,
+           GList                **replacements,
+           GError               **error)
+{
+	const gchar *id, *parent_id, *name, *where, *style;
+	const gchar *match, *start, *end;
+	GVariant *classes_variant;
+	GSList *context_classes;
+	gboolean ret;
+
+	switch (op)
+	{
+		case 'c':
+			if (!g_variant_is_of_type (args, G_VARIANT_TYPE ("(smsmsmsmsmsa(sb)u)")))
+				break;
+
+			{
+				guint32 flags;
+
+				g_variant_get (args, "(&sm&sm&sm&sm&sm&s@a(sb)u)",
+					       &id, &parent_id, &match, &start, &end,
+					       &style, &classes_variant, &flags);
+				context_classes = context_classes_from_variant (classes_variant);
+				ret = _gtk_source_context_data_define_context (ctx_data, id, parent_id,
+									       match, start, end,
+									       style, context_classes,
+									       flags, error);
+			}
+
+			g_slist_free_full (context_classes, (GDestroyNotify) gtk_source_context_class_free);
+			g_variant_unref (classes_variant);
+			return ret;
+
+		case 'p':
+			if (!g_variant_is_of_type (args, G_VARIANT_TYPE ("(sssmsmsa(sb))")))
+				break;
+
+			g_variant_get (args, "(&s&s&sm&sm&s@a(sb))",
+				       &id, &parent_id, &name, &where, &style,
+				       &classes_variant);
+			context_classes = context_classes_from_variant (classes_variant);
+			ret = _gtk_source_context_data_add_sub_pattern (ctx_data, id, parent_id,
+									name, where, style,
+									context_classes, error);
+
+			g_slist_free_full (context_classes, (GDestroyNotify) gtk_source_context_class_free);
+			g_variant_unref (classes_variant);
+			return ret;
+
+		case 'r':
+			if (!g_variant_is_of_type (args, G_VARIANT_TYPE ("(ssumsb)")))
+				break;
+
+			{
+				guint32 options;
+				gboolean all;
+
+				g_variant_get (args, "(&s&sum&sb)",
+					       &parent_id, &id, &options, &style, &all);
+				return _gtk_source_context_data_add_ref (ctx_data, parent_id, id,
+									 options, style, all,
+									 error);
+			}
+
+		case 'k':
+			if (!g_variant_is_of_type (args, G_VARIANT_TYPE ("(sasb)")))
+				break;
+
+			{
+				ContextDefinition *definition;
+				const gchar **keywords;
+				gboolean caseless;
+				guint i;
+
+				g_variant_get (args, "(&s^a&sb)", &id, &keywords, &caseless);
+
+				/* The recording is not trusted, check what
+				 * _gtk_source_context_data_set_keywords() expects.
+				 */
+				definition = gtk_source_context_data_lookup (ctx_data, id);
+
+				if (definition == NULL || definition->type != CONTEXT_TYPE_SIMPLE)
+				{
+					g_set_error (error,
+						     GTK_SOURCE_CONTEXT_ENGINE_ERROR,
+						     GTK_SOURCE_CONTEXT_ENGINE_ERROR_BAD_FILE,
+						     "recorded keywords for invalid context '%s'",
+						     id);
+					g_free (keywords);
+					return FALSE;
+				}
+
+				for (i = 0; keywords[i] != NULL; i++)
+				{
+					if (!_gtk_source_keyword_is_literal (keywords[i]))
+					{
+						g_set_error (error,
+							     GTK_SOURCE_CONTEXT_ENGINE_ERROR,
+							     GTK_SOURCE_CONTEXT_ENGINE_ERROR_BAD_FILE,
+							     "recorded keyword '%s' of context '%s' is not literal",
+							     keywords[i], id);
+						g_free (keywords);
+						return FALSE;
+					}
+				}
+
+				_gtk_source_context_data_set_keywords (ctx_data, id, keywords, caseless);
+				g_free (keywords);
+			}
+
+			return TRUE;
+
+		case 'R':
+			if (!g_variant_is_of_type (args, G_VARIANT_TYPE ("(ss)")))
+				break;
+
+			g_variant_get (args, "(&s&s)", &id, &name);
+			*replacements = g_list_prepend (*replacements,
+							_gtk_source_context_replace_new (id, name));
+			return TRUE;
+
+		default:
+			break;
+	}
+
+	g_set_error (error,
+		     GTK_SOURCE_CONTEXT_ENGINE_ERROR,
+		     GTK_SOURCE_CONTEXT_ENGINE_ERROR_BAD_FILE,
+		     "invalid recorded call '%c' of type %s",
+		     op, g_variant_get_type_string (args));
+	return FALSE;
+}
+
+/**
+ * _gtk_source_context_data_replay:
+ * @ctx_data: an empty #GtkSourceContextData.
+ * @calls: the calls returned by _gtk_source_context_data_end_recording().
+ * @error: error location.
+ *
+ * Fills @ctx_data making the recorded calls again, and finishes it as
+ * _gtk_source_context_data_finish_parse() does. The regexes are compiled
+ * again, the recording only spares the parsing of the files.
+ *
+ * On failure, @ctx_data is emptied so that the files can be parsed into
+ * it instead.
+ *
+ * Returns: %TRUE on success.
+ */
+gboolean
+_gtk_source_context_data_replay (GtkSourceContextData  *ctx_data,
+                                 GVariant              *calls,
+                                 GError               **error)
+{
+	GVariantIter iter;
+	GVariant *args;
+	GList *replacements = NULL;
+	guchar op;
+	gboolean success = TRUE;
+
+	g_return_val_if_fail (ctx_data != NULL, FALSE);
+	g_return_val_if_fail (g_hash_table_size (ctx_data->definitions) == 0, FALSE);
+	g_return_val_if_fail (g_variant_is_of_type (calls, G_VARIANT_TYPE ("a(yv)")), FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	g_variant_iter_init (&iter, calls);
+
+	while (success && g_variant_iter_next (&iter, "(yv)", &op, &args))
+	{
+		success = replay_op (ctx_data, op, args, &replacements, error);
+		g_variant_unref (args);
+	}
+
+	replacements = g_list_reverse (replacements);
+
+	if (success)
+		success = _gtk_source_context_data_finish_parse (ctx_data, replacements, error);
+
+	g_list_free_full (replacements, (GDestroyNotify) _gtk_source_context_replace_free);
+
+	if (!success)
+		g_hash_table_remove_all (ctx_data->definitions);
+
+	return success;
+}
 
 /* DEBUG CODE ------------------------------------------------------------- */
 
@@ -6398,23 +8837,23 @@ check_segment (GtkSourceContextEngine *ce,
 
 	g_assert (segment != NULL);
 	g_assert (segment->start_at <= segment->end_at);
-	g_assert (!segment->next || segment->next->start_at >= segment->end_at);
+	g_assert (!segment->next || SEGMENT (ce, segment->next)->start_at >= segment->end_at);
 
 	if (SEGMENT_IS_INVALID (segment))
 		g_assert (g_slist_find (ce->invalid, segment) != NULL);
 	else
 		g_assert (g_slist_find (ce->invalid, segment) == NULL);
 
-	if (segment->children != NULL)
+	if (segment->children != 0)
 		g_assert (!SEGMENT_IS_INVALID (segment) && SEGMENT_IS_CONTAINER (segment));
 
-	for (child = segment->children; child != NULL; child = child->next)
+	for (child = SEGMENT (ce, segment->children); child != NULL; child = SEGMENT (ce, child->next))
 	{
-		g_assert (child->parent == segment);
+		g_assert (child->parent == SEGMENT_ID (segment));
 		g_assert (child->start_at >= segment->start_at);
 		g_assert (child->end_at <= segment->end_at);
-		g_assert (child->prev || child == segment->children);
-		g_assert (child->next || child == segment->last_child);
+		g_assert (child->prev || SEGMENT_ID (child) == segment->children);
+		g_assert (child->next || SEGMENT_ID (child) == segment->last_child);
 		check_segment (ce, child);
 	}
 }
@@ -6483,41 +8922,44 @@ check_tree (GtkSourceContextEngine *ce)
 }
 
 static void
-check_segment_children (Segment *segment)
+check_segment_children (GtkSourceContextEngine *ce,
+                        Segment                *segment)
 {
 	Segment *ch;
 
 	g_assert (segment != NULL);
-	check_segment_list (segment->parent);
+	check_segment_list (ce, SEGMENT (ce, segment->parent));
 
-	for (ch = segment->children; ch != NULL; ch = ch->next)
+	for (ch = SEGMENT (ce, segment->children); ch != NULL; ch = SEGMENT (ce, ch->next))
 	{
-		g_assert (ch->parent == segment);
+		g_assert (ch->parent == SEGMENT_ID (segment));
 		g_assert (ch->start_at <= ch->end_at);
-		g_assert (!ch->next || ch->next->start_at >= ch->end_at);
+		g_assert (!ch->next || SEGMENT (ce, ch->next)->start_at >= ch->end_at);
 		g_assert (ch->start_at >= segment->start_at);
 		g_assert (ch->end_at <= segment->end_at);
-		g_assert (ch->prev || ch == segment->children);
-		g_assert (ch->next || ch == segment->last_child);
+		g_assert (ch->prev || SEGMENT_ID (ch) == segment->children);
+		g_assert (ch->next || SEGMENT_ID (ch) == segment->last_child);
 	}
 }
 
 static void
-check_segment_list (Segment *segment)
+check_segment_list (GtkSourceContextEngine *ce,
+                    Segment                *segment)
 {
 	Segment *ch;
 
 	if (segment == NULL)
 		return;
 
-	for (ch = segment->children; ch != NULL; ch = ch->next)
+	for (ch = SEGMENT (ce, segment->children); ch != NULL; ch = SEGMENT (ce, ch->next))
 	{
-		g_assert (ch->parent == segment);
+		g_assert (ch->parent == SEGMENT_ID (segment));
 		g_assert (ch->start_at <= ch->end_at);
-		g_assert (!ch->next || ch->next->start_at >= ch->end_at);
-		g_assert (ch->prev || ch == segment->children);
-		g_assert (ch->next || ch == segment->last_child);
+		g_assert (!ch->next || SEGMENT (ce, ch->next)->start_at >= ch->end_at);
+		g_assert (ch->prev || SEGMENT_ID (ch) == segment->children);
+		g_assert (ch->next || SEGMENT_ID (ch) == segment->last_child);
 	}
 }
 
+
 #endif /* ENABLE_CHECK_TREE */
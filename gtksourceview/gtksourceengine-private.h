@@ -48,6 +48,18 @@ struct _GtkSourceEngineInterface
 	                           gboolean              synchronous);
 	void (* set_style_scheme) (GtkSourceEngine      *engine,
 	                           GtkSourceStyleScheme *scheme);
+
+	gboolean     (* has_context_class)         (GtkSourceEngine *engine,
+	                                            gint             offset,
+	                                            const gchar     *context_class);
+	gchar      **(* get_context_classes)       (GtkSourceEngine *engine,
+	                                            gint             offset);
+	gint         (* find_context_class_toggle) (GtkSourceEngine *engine,
+	                                            gint             offset,
+	                                            const gchar     *context_class,
+	                                            gboolean         forward);
+	GtkTextTag  *(* get_context_class_tag)     (GtkSourceEngine *engine,
+	                                            const gchar     *context_class);
 };
 
 G_GNUC_INTERNAL
@@ -69,5 +81,20 @@ void _gtk_source_engine_update_highlight (GtkSourceEngine      *engine,
 G_GNUC_INTERNAL
 void _gtk_source_engine_set_style_scheme (GtkSourceEngine      *engine,
                                           GtkSourceStyleScheme *scheme);
+G_GNUC_INTERNAL
+gboolean    _gtk_source_engine_has_context_class         (GtkSourceEngine *engine,
+                                                          gint             offset,
+                                                          const gchar     *context_class);
+G_GNUC_INTERNAL
+gchar     **_gtk_source_engine_get_context_classes       (GtkSourceEngine *engine,
+                                                          gint             offset);
+G_GNUC_INTERNAL
+gint        _gtk_source_engine_find_context_class_toggle (GtkSourceEngine *engine,
+                                                          gint             offset,
+                                                          const gchar     *context_class,
+                                                          gboolean         forward);
+G_GNUC_INTERNAL
+GtkTextTag *_gtk_source_engine_get_context_class_tag     (GtkSourceEngine *engine,
+                                                          const gchar     *context_class);
 
 G_END_DECLS
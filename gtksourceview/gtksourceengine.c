@@ -93,3 +93,67 @@ _gtk_source_engine_set_style_scheme (GtkSourceEngine      *engine,
 
 	GTK_SOURCE_ENGINE_GET_IFACE (engine)->set_style_scheme (engine, scheme);
 }
+
+gboolean
+_gtk_source_engine_has_context_class (GtkSourceEngine *engine,
+                                      gint             offset,
+                                      const gchar     *context_class)
+{
+	g_return_val_if_fail (GTK_SOURCE_IS_ENGINE (engine), FALSE);
+	g_return_val_if_fail (context_class != NULL, FALSE);
+
+	if (GTK_SOURCE_ENGINE_GET_IFACE (engine)->has_context_class == NULL)
+		return FALSE;
+
+	return GTK_SOURCE_ENGINE_GET_IFACE (engine)->has_context_class (engine, offset, context_class);
+}
+
+/* Returns: (transfer full): the context classes at @offset, %NULL-terminated. */
+gchar **
+_gtk_source_engine_get_context_classes (GtkSourceEngine *engine,
+                                        gint             offset)
+{
+	g_return_val_if_fail (GTK_SOURCE_IS_ENGINE (engine), NULL);
+
+	if (GTK_SOURCE_ENGINE_GET_IFACE (engine)->get_context_classes == NULL)
+		return g_new0 (gchar *, 1);
+
+	return GTK_SOURCE_ENGINE_GET_IFACE (engine)->get_context_classes (engine, offset);
+}
+
+/* Returns: the offset of the first toggle of @context_class after
+ * @offset, or before it if @forward is %FALSE, or -1.
+ */
+gint
+_gtk_source_engine_find_context_class_toggle (GtkSourceEngine *engine,
+                                              gint             offset,
+                                              const gchar     *context_class,
+                                              gboolean         forward)
+{
+	g_return_val_if_fail (GTK_SOURCE_IS_ENGINE (engine), -1);
+	g_return_val_if_fail (context_class != NULL, -1);
+
+	if (GTK_SOURCE_ENGINE_GET_IFACE (engine)->find_context_class_toggle == NULL)
+		return -1;
+
+	return GTK_SOURCE_ENGINE_GET_IFACE (engine)->find_context_class_toggle (engine,
+	                                                                      offset,
+	                                                                      context_class,
+	                                                                      forward);
+}
+
+/* Returns: (transfer none) (nullable): the tag kept applied to the
+ * text having @context_class.
+ */
+GtkTextTag *
+_gtk_source_engine_get_context_class_tag (GtkSourceEngine *engine,
+                                          const gchar     *context_class)
+{
+	g_return_val_if_fail (GTK_SOURCE_IS_ENGINE (engine), NULL);
+	g_return_val_if_fail (context_class != NULL, NULL);
+
+	if (GTK_SOURCE_ENGINE_GET_IFACE (engine)->get_context_class_tag == NULL)
+		return NULL;
+
+	return GTK_SOURCE_ENGINE_GET_IFACE (engine)->get_context_class_tag (engine, context_class);
+}
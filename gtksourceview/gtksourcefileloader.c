@@ -22,6 +22,8 @@
 
 #include "config.h"
 
+#include <string.h>
+
 #include <glib/gi18n-lib.h>
 
 #include "gtksourcefileloader.h"
@@ -55,6 +57,10 @@
  * saved somewhere (for example if you load from stdin), then you should
  * probably call [method@Gtk.TextBuffer.set_modified] with %TRUE after calling
  * [method@FileLoader.load_finish].
+ *
+ * For viewing files that are too big to be loaded completely, a paged mode is
+ * available with [method@FileLoader.load_page_async]. The file is then mapped
+ * in memory and only a window of lines is inserted into the buffer.
  */
 
 enum
@@ -109,6 +115,14 @@ struct _GtkSourceFileLoader
 	guint64 max_size;
 
 	gint64 load_begin_time;
+
+	/* Paged mode, see gtk_source_file_loader_load_page_async(). The
+	 * line_offsets array contains the byte offset of the start of each
+	 * line, followed by the length of the file.
+	 */
+	GMappedFile *mapped_file;
+	GArray *line_offsets;
+	guint page_line;
 };
 
 typedef struct
@@ -137,6 +151,19 @@ typedef struct
 	guint tried_mount : 1;
 } TaskData;
 
+typedef struct
+{
+	guint first_line;
+	guint n_lines;
+} PageData;
+
+typedef struct
+{
+	GFile *location;
+	GMappedFile *mapped_file;
+	GArray *line_offsets;
+} IndexData;
+
 G_DEFINE_TYPE (GtkSourceFileLoader, gtk_source_file_loader, G_TYPE_OBJECT)
 
 static void open_file           (GTask *task);
@@ -397,6 +424,9 @@ gtk_source_file_loader_dispose (GObject *object)
 	g_slist_free (loader->candidate_encodings);
 	loader->candidate_encodings = NULL;
 
+	g_clear_pointer (&loader->mapped_file, g_mapped_file_unref);
+	g_clear_pointer (&loader->line_offsets, g_array_unref);
+
 	G_OBJECT_CLASS (gtk_source_file_loader_parent_class)->dispose (object);
 }
 
@@ -1128,6 +1158,277 @@ read_file (GTask *task)
 	                   task);
 }
 
+static void
+index_data_free (gpointer data)
+{
+	IndexData *index_data = data;
+
+	g_clear_object (&index_data->location);
+	g_clear_pointer (&index_data->mapped_file, g_mapped_file_unref);
+	g_clear_pointer (&index_data->line_offsets, g_array_unref);
+	g_free (index_data);
+}
+
+static GArray *
+index_line_offsets (const gchar  *contents,
+                    gsize         length,
+                    GCancellable *cancellable)
+{
+	GArray *line_offsets;
+	const gchar *iter = contents;
+	const gchar *end = contents + length;
+	guint64 offset = 0;
+
+	line_offsets = g_array_new (FALSE, FALSE, sizeof (guint64));
+	g_array_append_val (line_offsets, offset);
+
+	while (iter < end)
+	{
+		const gchar *newline = memchr (iter, '\n', end - iter);
+
+		if (newline == NULL)
+		{
+			break;
+		}
+
+		iter = newline + 1;
+		offset = iter - contents;
+		g_array_append_val (line_offsets, offset);
+
+		if ((line_offsets->len % 65536) == 0 &&
+		    g_cancellable_is_cancelled (cancellable))
+		{
+			g_array_unref (line_offsets);
+			return NULL;
+		}
+	}
+
+	/* Terminate the last line if the file doesn't end with a newline. */
+	if (offset != length)
+	{
+		offset = length;
+		g_array_append_val (line_offsets, offset);
+	}
+
+	return line_offsets;
+}
+
+static void
+index_file_worker (GTask        *task,
+                   gpointer      source_object,
+                   gpointer      task_data,
+                   GCancellable *cancellable)
+{
+	IndexData *index_data = task_data;
+	GFileInfo *info;
+	gchar *path;
+	GError *error = NULL;
+
+	/* Opening a FIFO for mapping would block, so check the file type
+	 * first like the regular loading path does.
+	 */
+	info = g_file_query_info (index_data->location,
+	                          G_FILE_ATTRIBUTE_STANDARD_TYPE,
+	                          G_FILE_QUERY_INFO_NONE,
+	                          cancellable,
+	                          &error);
+
+	if (info == NULL || !check_file_is_regular (info, &error))
+	{
+		g_clear_object (&info);
+		g_task_return_error (task, error);
+		return;
+	}
+
+	g_object_unref (info);
+
+	path = g_file_get_path (index_data->location);
+	index_data->mapped_file = g_mapped_file_new (path, FALSE, &error);
+	g_free (path);
+
+	if (index_data->mapped_file == NULL)
+	{
+		g_task_return_error (task, error);
+		return;
+	}
+
+	index_data->line_offsets = index_line_offsets (g_mapped_file_get_contents (index_data->mapped_file),
+	                                               g_mapped_file_get_length (index_data->mapped_file),
+	                                               cancellable);
+
+	if (index_data->line_offsets == NULL)
+	{
+		g_task_return_error_if_cancelled (task);
+		return;
+	}
+
+	g_task_return_boolean (task, TRUE);
+}
+
+static void
+load_page (GTask *task)
+{
+	GtkSourceFileLoader *loader;
+	GtkTextBuffer *buffer;
+	PageData *page_data;
+	GtkTextIter start;
+	const gchar *contents;
+	gchar *valid_contents = NULL;
+	guint64 begin;
+	guint64 end;
+	guint n_lines;
+	guint first_line;
+	guint last_line;
+	gsize length;
+
+	loader = g_task_get_source_object (task);
+	page_data = g_task_get_task_data (task);
+
+	if (loader->source_buffer == NULL)
+	{
+		g_task_return_new_error (task,
+		                         G_IO_ERROR,
+		                         G_IO_ERROR_INVALID_ARGUMENT,
+		                         "Invalid argument");
+		return;
+	}
+
+	buffer = GTK_TEXT_BUFFER (loader->source_buffer);
+
+	n_lines = gtk_source_file_loader_get_n_lines (loader);
+	first_line = MIN (page_data->first_line, n_lines);
+	last_line = first_line + MIN (page_data->n_lines, n_lines - first_line);
+
+	begin = g_array_index (loader->line_offsets, guint64, first_line);
+	end = g_array_index (loader->line_offsets, guint64, last_line);
+	contents = g_mapped_file_get_contents (loader->mapped_file);
+
+	/* The buffer has no line after the last line of the page. */
+	if (end > begin && contents[end - 1] == '\n')
+	{
+		end--;
+	}
+
+	if (end > begin && contents[end - 1] == '\r')
+	{
+		end--;
+	}
+
+	length = end - begin;
+
+	if (length > G_MAXINT ||
+	    (loader->max_size > 0 && length > loader->max_size))
+	{
+		g_task_return_new_error (task,
+		                         GTK_SOURCE_FILE_LOADER_ERROR,
+		                         GTK_SOURCE_FILE_LOADER_ERROR_TOO_BIG,
+		                         _("File too big."));
+		return;
+	}
+
+	if (length > 0 && !g_utf8_validate_len (contents + begin, length, NULL))
+	{
+		valid_contents = g_utf8_make_valid (contents + begin, length);
+	}
+
+	gtk_text_buffer_begin_irreversible_action (buffer);
+
+	if (valid_contents != NULL)
+	{
+		gtk_text_buffer_set_text (buffer, valid_contents, -1);
+	}
+	else
+	{
+		gtk_text_buffer_set_text (buffer, length > 0 ? contents + begin : "", length);
+	}
+
+	gtk_text_buffer_set_modified (buffer, FALSE);
+	gtk_text_buffer_end_irreversible_action (buffer);
+
+	gtk_text_buffer_get_start_iter (buffer, &start);
+	gtk_text_buffer_place_cursor (buffer, &start);
+
+	loader->page_line = first_line;
+
+	if (loader->file != NULL)
+	{
+		GtkSourceNewlineType newline_type = GTK_SOURCE_NEWLINE_TYPE_LF;
+		guint64 first_line_end;
+
+		if (n_lines > 0)
+		{
+			first_line_end = g_array_index (loader->line_offsets, guint64, 1);
+
+			if (first_line_end >= 2 &&
+			    contents[first_line_end - 1] == '\n' &&
+			    contents[first_line_end - 2] == '\r')
+			{
+				newline_type = GTK_SOURCE_NEWLINE_TYPE_CR_LF;
+			}
+		}
+
+		loader->auto_detected_encoding = gtk_source_encoding_get_utf8 ();
+		loader->auto_detected_newline_type = newline_type;
+		loader->auto_detected_compression_type = GTK_SOURCE_COMPRESSION_TYPE_NONE;
+
+		_gtk_source_file_set_encoding (loader->file, loader->auto_detected_encoding);
+		_gtk_source_file_set_newline_type (loader->file, loader->auto_detected_newline_type);
+		_gtk_source_file_set_compression_type (loader->file, loader->auto_detected_compression_type);
+		_gtk_source_file_set_externally_modified (loader->file, FALSE);
+		_gtk_source_file_set_deleted (loader->file, FALSE);
+
+		/* Only a window of the file is in the buffer, so it must not
+		 * be saved back to the same location.
+		 */
+		_gtk_source_file_set_readonly (loader->file, TRUE);
+	}
+
+	if (valid_contents != NULL)
+	{
+		g_free (valid_contents);
+		g_task_return_new_error (task,
+		                         GTK_SOURCE_FILE_LOADER_ERROR,
+		                         GTK_SOURCE_FILE_LOADER_ERROR_CONVERSION_FALLBACK,
+		                         _("There was an encoding conversion error so a fallback character was used."));
+		return;
+	}
+
+	g_task_return_boolean (task, TRUE);
+}
+
+static void
+index_file_cb (GObject      *source_object,
+               GAsyncResult *result,
+               gpointer      user_data)
+{
+	GtkSourceFileLoader *loader = GTK_SOURCE_FILE_LOADER (source_object);
+	GTask *task = G_TASK (user_data);
+	IndexData *index_data;
+	GError *error = NULL;
+
+	GTK_SOURCE_PROFILER_BEGIN_MARK;
+
+	index_data = g_task_get_task_data (G_TASK (result));
+
+	if (!g_task_propagate_boolean (G_TASK (result), &error))
+	{
+		g_task_return_error (task, error);
+		goto cleanup;
+	}
+
+	g_clear_pointer (&loader->mapped_file, g_mapped_file_unref);
+	g_clear_pointer (&loader->line_offsets, g_array_unref);
+	loader->mapped_file = g_steal_pointer (&index_data->mapped_file);
+	loader->line_offsets = g_steal_pointer (&index_data->line_offsets);
+
+	load_page (task);
+
+cleanup:
+	g_object_unref (task);
+
+	GTK_SOURCE_PROFILER_END_MARK (G_STRFUNC, "");
+}
+
 GQuark
 gtk_source_file_loader_error_quark (void)
 {
@@ -1564,6 +1865,179 @@ gtk_source_file_loader_load_finish (GtkSourceFileLoader  *loader,
 	return ok;
 }
 
+/**
+ * gtk_source_file_loader_load_page_async:
+ * @loader: a #GtkSourceFileLoader.
+ * @first_line: the first line of the file to load, starting from 0.
+ * @n_lines: the number of lines to load.
+ * @io_priority: the I/O priority of the request. E.g. %G_PRIORITY_LOW,
+ *   %G_PRIORITY_DEFAULT or %G_PRIORITY_HIGH.
+ * @cancellable: (nullable): optional #GCancellable object, %NULL to ignore.
+ * @callback: (scope async): a #GAsyncReadyCallback to call when the request is
+ *   satisfied.
+ * @user_data: user data to pass to @callback.
+ *
+ * Loads asynchronously a window of @n_lines lines, starting at @first_line,
+ * into the [class@Buffer].
+ *
+ * This is a read-only loading mode for local files that are too big to be
+ * loaded completely with [method@FileLoader.load_async]. The first call maps
+ * the file in memory and indexes the line offsets in a worker thread. Later
+ * calls reuse the index, so moving the window only costs the size of the
+ * window. The [property@FileLoader:max-size] limit applies to the window
+ * rather than to the whole file.
+ *
+ * The file is expected to be UTF-8 and uncompressed, and must not be modified
+ * while it is mapped. The [class@File] is marked as read-only since the buffer
+ * only contains a part of the file. Searching and highlighting operate on the
+ * lines of the current window.
+ *
+ * Since: 5.22
+ */
+void
+gtk_source_file_loader_load_page_async (GtkSourceFileLoader *loader,
+                                        guint                first_line,
+                                        guint                n_lines,
+                                        gint                 io_priority,
+                                        GCancellable        *cancellable,
+                                        GAsyncReadyCallback  callback,
+                                        gpointer             user_data)
+{
+	PageData *page_data;
+	IndexData *index_data;
+	GTask *index_task;
+
+	g_return_if_fail (GTK_SOURCE_IS_FILE_LOADER (loader));
+	g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+	g_return_if_fail (loader->task == NULL);
+
+	loader->task = g_task_new (loader, cancellable, callback, user_data);
+	g_task_set_source_tag (loader->task, gtk_source_file_loader_load_page_async);
+	g_task_set_priority (loader->task, io_priority);
+
+	page_data = g_new0 (PageData, 1);
+	page_data->first_line = first_line;
+	page_data->n_lines = n_lines;
+	g_task_set_task_data (loader->task, page_data, g_free);
+
+	if (loader->source_buffer == NULL ||
+	    loader->file == NULL ||
+	    loader->location == NULL ||
+	    !g_file_is_native (loader->location))
+	{
+		g_task_return_new_error (loader->task,
+		                         G_IO_ERROR,
+		                         G_IO_ERROR_NOT_SUPPORTED,
+		                         _("Only local files can be loaded in paged mode."));
+		return;
+	}
+
+	_gtk_source_buffer_begin_loading (loader->source_buffer);
+	g_signal_connect_object (loader->task,
+	                         "notify::completed",
+	                         G_CALLBACK (_gtk_source_buffer_end_loading),
+	                         loader->source_buffer,
+	                         G_CONNECT_SWAPPED);
+
+	loader->load_begin_time = GTK_SOURCE_PROFILER_CURRENT_TIME;
+
+	gtk_source_file_set_location (loader->file, loader->location);
+
+	if (loader->line_offsets != NULL)
+	{
+		load_page (loader->task);
+		return;
+	}
+
+	index_data = g_new0 (IndexData, 1);
+	index_data->location = g_object_ref (loader->location);
+
+	index_task = g_task_new (loader, cancellable, index_file_cb, g_object_ref (loader->task));
+	g_task_set_source_tag (index_task, index_file_worker);
+	g_task_set_priority (index_task, io_priority);
+	g_task_set_task_data (index_task, index_data, index_data_free);
+	g_task_run_in_thread (index_task, index_file_worker);
+	g_object_unref (index_task);
+}
+
+/**
+ * gtk_source_file_loader_load_page_finish:
+ * @loader: a #GtkSourceFileLoader.
+ * @result: a #GAsyncResult.
+ * @error: a #GError, or %NULL.
+ *
+ * Finishes a file loading started with [method@FileLoader.load_page_async].
+ *
+ * Returns: whether the window has been loaded successfully.
+ *
+ * Since: 5.22
+ */
+gboolean
+gtk_source_file_loader_load_page_finish (GtkSourceFileLoader  *loader,
+                                         GAsyncResult         *result,
+                                         GError              **error)
+{
+	gboolean ok;
+
+	g_return_val_if_fail (GTK_SOURCE_IS_FILE_LOADER (loader), FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+	g_return_val_if_fail (g_task_is_valid (result, loader), FALSE);
+
+	ok = g_task_propagate_boolean (G_TASK (result), error);
+
+	g_clear_object (&loader->task);
+
+	GTK_SOURCE_PROFILER_MARK (GTK_SOURCE_PROFILER_CURRENT_TIME - loader->load_begin_time,
+				  "GtkSourceFileLoader.load-page",
+				  loader->location != NULL ? g_file_peek_path (loader->location) : NULL);
+
+	return ok;
+}
+
+/**
+ * gtk_source_file_loader_get_n_lines:
+ * @loader: a #GtkSourceFileLoader.
+ *
+ * Gets the number of lines of the file loaded in paged mode.
+ *
+ * Returns: the number of lines, or 0 if [method@FileLoader.load_page_async]
+ *   has not indexed the file yet.
+ *
+ * Since: 5.22
+ */
+guint
+gtk_source_file_loader_get_n_lines (GtkSourceFileLoader *loader)
+{
+	g_return_val_if_fail (GTK_SOURCE_IS_FILE_LOADER (loader), 0);
+
+	if (loader->line_offsets == NULL)
+	{
+		return 0;
+	}
+
+	return MIN (loader->line_offsets->len - 1, (guint)G_MAXINT);
+}
+
+/**
+ * gtk_source_file_loader_get_page_line:
+ * @loader: a #GtkSourceFileLoader.
+ *
+ * Gets the line of the file which is the first line of the buffer, after a
+ * successful [method@FileLoader.load_page_async]. This can be used to
+ * display the file line numbers.
+ *
+ * Returns: the first line of the current window.
+ *
+ * Since: 5.22
+ */
+guint
+gtk_source_file_loader_get_page_line (GtkSourceFileLoader *loader)
+{
+	g_return_val_if_fail (GTK_SOURCE_IS_FILE_LOADER (loader), 0);
+
+	return loader->page_line;
+}
+
 /**
  * gtk_source_file_loader_get_encoding:
  * @loader: a #GtkSourceFileLoader.
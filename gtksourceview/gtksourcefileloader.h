@@ -94,6 +94,22 @@ GTK_SOURCE_AVAILABLE_IN_ALL
 gboolean                  gtk_source_file_loader_load_finish             (GtkSourceFileLoader    *loader,
                                                                           GAsyncResult           *result,
                                                                           GError                **error);
+GTK_SOURCE_AVAILABLE_IN_5_22
+void                      gtk_source_file_loader_load_page_async         (GtkSourceFileLoader    *loader,
+                                                                          guint                   first_line,
+                                                                          guint                   n_lines,
+                                                                          gint                    io_priority,
+                                                                          GCancellable           *cancellable,
+                                                                          GAsyncReadyCallback     callback,
+                                                                          gpointer                user_data);
+GTK_SOURCE_AVAILABLE_IN_5_22
+gboolean                  gtk_source_file_loader_load_page_finish        (GtkSourceFileLoader    *loader,
+                                                                          GAsyncResult           *result,
+                                                                          GError                **error);
+GTK_SOURCE_AVAILABLE_IN_5_22
+guint                     gtk_source_file_loader_get_n_lines             (GtkSourceFileLoader    *loader);
+GTK_SOURCE_AVAILABLE_IN_5_22
+guint                     gtk_source_file_loader_get_page_line           (GtkSourceFileLoader    *loader);
 GTK_SOURCE_AVAILABLE_IN_ALL
 const GtkSourceEncoding  *gtk_source_file_loader_get_encoding            (GtkSourceFileLoader    *loader);
 GTK_SOURCE_AVAILABLE_IN_ALL
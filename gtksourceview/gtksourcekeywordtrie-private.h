@@ -0,0 +1,56 @@
+/*
+ * This file is part of GtkSourceView
+ *
+ * GtkSourceView is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GtkSourceView is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include "gtksourcetypes-private.h"
+
+G_BEGIN_DECLS
+
+GTK_SOURCE_INTERNAL
+gboolean              _gtk_source_keyword_is_literal        (const gchar          *keyword);
+GTK_SOURCE_INTERNAL
+GtkSourceKeywordTrie *_gtk_source_keyword_trie_new          (gboolean              caseless);
+GTK_SOURCE_INTERNAL
+GtkSourceKeywordTrie *_gtk_source_keyword_trie_ref          (GtkSourceKeywordTrie *trie);
+GTK_SOURCE_INTERNAL
+void                  _gtk_source_keyword_trie_unref        (GtkSourceKeywordTrie *trie);
+GTK_SOURCE_INTERNAL
+void                  _gtk_source_keyword_trie_add          (GtkSourceKeywordTrie *trie,
+                                                             const gchar          *keyword);
+GTK_SOURCE_INTERNAL
+void                  _gtk_source_keyword_trie_add_all      (GtkSourceKeywordTrie *trie,
+                                                             GtkSourceKeywordTrie *other);
+GTK_SOURCE_INTERNAL
+gboolean              _gtk_source_keyword_trie_is_caseless  (GtkSourceKeywordTrie *trie);
+GTK_SOURCE_INTERNAL
+gboolean              _gtk_source_keyword_trie_has_prefix   (GtkSourceKeywordTrie *trie,
+                                                             const gchar          *text,
+                                                             gint                  byte_length,
+                                                             gint                  byte_pos);
+GTK_SOURCE_INTERNAL
+gint                  _gtk_source_keyword_trie_find         (GtkSourceKeywordTrie *trie,
+                                                             const gchar          *text,
+                                                             gint                  byte_length,
+                                                             gint                  byte_pos,
+                                                             gint                  byte_limit);
+
+G_END_DECLS
@@ -0,0 +1,353 @@
+/*
+ * This file is part of GtkSourceView
+ *
+ * GtkSourceView is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GtkSourceView is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "gtksourcekeywordtrie-private.h"
+
+/*
+ * Trie of the literal keywords of a language definition, used by the
+ * context engine to skip the text where none of the keywords can start
+ * without running the huge alternations the keywords are compiled to.
+ *
+ * The trie only answers whether a keyword *may* match somewhere: the
+ * regex of the keyword context still decides, so the answers must
+ * never miss a match of the regex, but can be wrong the other way. That
+ * is why only the keywords made of ASCII word characters are handled,
+ * for which \b does not depend on the Unicode tables of PCRE.
+ */
+
+typedef struct
+{
+	/* Indexes in the nodes array, 0 (the root) meaning none. */
+	guint first_child;
+	guint next_sibling;
+	guchar byte;
+	guchar terminal;
+} TrieNode;
+
+struct _GtkSourceKeywordTrie
+{
+	/* TrieNode's, the root first. */
+	GArray *nodes;
+
+	/* The keywords, to merge tries. */
+	GPtrArray *keywords;
+
+	/* Bytes starting a keyword. */
+	guint8 first_bytes[256];
+
+	guint ref_count;
+	guint caseless : 1;
+};
+
+static inline gboolean
+is_word_byte (guchar c)
+{
+	return g_ascii_isalnum (c) || c == '_';
+}
+
+/* A non-ASCII character may or may not be a word character for PCRE,
+ * only the ASCII ones are known to prevent a \b.
+ */
+static inline gboolean
+is_ascii_word_at (const gchar *text,
+                  gint         byte_length,
+                  gint         pos)
+{
+	return pos >= 0 && pos < byte_length && is_word_byte (text[pos]);
+}
+
+/**
+ * _gtk_source_keyword_is_literal:
+ * @keyword: the content of a <keyword> element.
+ *
+ * Returns: whether @keyword matches itself as a regex, and can be added
+ * to a #GtkSourceKeywordTrie.
+ */
+gboolean
+_gtk_source_keyword_is_literal (const gchar *keyword)
+{
+	const gchar *p;
+
+	if (keyword == NULL || keyword[0] == '\0')
+		return FALSE;
+
+	for (p = keyword; *p != '\0'; p++)
+	{
+		if (!is_word_byte (*p))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+GtkSourceKeywordTrie *
+_gtk_source_keyword_trie_new (gboolean caseless)
+{
+	GtkSourceKeywordTrie *trie;
+	TrieNode root = { 0 };
+
+	trie = g_slice_new0 (GtkSourceKeywordTrie);
+	trie->ref_count = 1;
+	trie->caseless = caseless != FALSE;
+	trie->nodes = g_array_new (FALSE, FALSE, sizeof (TrieNode));
+	trie->keywords = g_ptr_array_new_with_free_func (g_free);
+
+	g_array_append_val (trie->nodes, root);
+
+	return trie;
+}
+
+GtkSourceKeywordTrie *
+_gtk_source_keyword_trie_ref (GtkSourceKeywordTrie *trie)
+{
+	if (trie != NULL)
+		trie->ref_count++;
+	return trie;
+}
+
+void
+_gtk_source_keyword_trie_unref (GtkSourceKeywordTrie *trie)
+{
+	if (trie != NULL && --trie->ref_count == 0)
+	{
+		g_array_unref (trie->nodes);
+		g_ptr_array_unref (trie->keywords);
+		g_slice_free (GtkSourceKeywordTrie, trie);
+	}
+}
+
+gboolean
+_gtk_source_keyword_trie_is_caseless (GtkSourceKeywordTrie *trie)
+{
+	return trie->caseless;
+}
+
+static guint
+find_child (GtkSourceKeywordTrie *trie,
+            guint                 node,
+            guchar                byte)
+{
+	guint child = g_array_index (trie->nodes, TrieNode, node).first_child;
+
+	while (child != 0)
+	{
+		const TrieNode *child_node = &g_array_index (trie->nodes, TrieNode, child);
+
+		if (child_node->byte == byte)
+			return child;
+
+		child = child_node->next_sibling;
+	}
+
+	return 0;
+}
+
+void
+_gtk_source_keyword_trie_add (GtkSourceKeywordTrie *trie,
+                              const gchar          *keyword)
+{
+	const gchar *p;
+	guint node = 0;
+
+	g_return_if_fail (trie != NULL);
+	g_return_if_fail (_gtk_source_keyword_is_literal (keyword));
+
+	for (p = keyword; *p != '\0'; p++)
+	{
+		guchar byte = trie->caseless ? g_ascii_tolower (*p) : *p;
+		guint child = find_child (trie, node, byte);
+
+		if (child == 0)
+		{
+			TrieNode new_node = { 0 };
+
+			new_node.byte = byte;
+			new_node.next_sibling = g_array_index (trie->nodes, TrieNode, node).first_child;
+			g_array_append_val (trie->nodes, new_node);
+
+			child = trie->nodes->len - 1;
+			g_array_index (trie->nodes, TrieNode, node).first_child = child;
+		}
+
+		node = child;
+	}
+
+	if (g_array_index (trie->nodes, TrieNode, node).terminal)
+		return;
+
+	g_array_index (trie->nodes, TrieNode, node).terminal = TRUE;
+	g_ptr_array_add (trie->keywords, g_strdup (keyword));
+
+	if (trie->caseless)
+	{
+		guchar first = g_ascii_tolower (keyword[0]);
+
+		trie->first_bytes[first] = TRUE;
+		trie->first_bytes[g_ascii_toupper (first)] = TRUE;
+
+		/* See next_byte(). */
+		if (first == 's')
+			trie->first_bytes[0xC5] = TRUE;
+		else if (first == 'k')
+			trie->first_bytes[0xE2] = TRUE;
+	}
+	else
+	{
+		trie->first_bytes[(guchar) keyword[0]] = TRUE;
+	}
+}
+
+/* Adds the keywords of @other to @trie. */
+void
+_gtk_source_keyword_trie_add_all (GtkSourceKeywordTrie *trie,
+                                  GtkSourceKeywordTrie *other)
+{
+	guint i;
+
+	g_return_if_fail (trie != NULL);
+	g_return_if_fail (other != NULL);
+	/* The folded keywords of @other would miss the other cases. */
+	g_return_if_fail (trie->caseless || !other->caseless);
+
+	for (i = 0; i < other->keywords->len; i++)
+		_gtk_source_keyword_trie_add (trie, g_ptr_array_index (other->keywords, i));
+}
+
+/* Returns the byte to look up in the trie for the character at @pos, and
+ * its length in @n_bytes, or 0 if the character cannot be in a keyword.
+ */
+static inline guchar
+next_byte (GtkSourceKeywordTrie *trie,
+           const gchar          *text,
+           gint                  byte_length,
+           gint                  pos,
+           gint                 *n_bytes)
+{
+	const guchar *s = (const guchar *) text + pos;
+
+	*n_bytes = 1;
+
+	if (!trie->caseless)
+		return s[0];
+
+	if (s[0] < 0x80)
+		return g_ascii_tolower (s[0]);
+
+	/* With Unicode case folding, PCRE also matches U+017F LATIN SMALL
+	 * LETTER LONG S for s and U+212A KELVIN SIGN for k.
+	 */
+	if (s[0] == 0xC5 && pos + 1 < byte_length && s[1] == 0xBF)
+	{
+		*n_bytes = 2;
+		return 's';
+	}
+
+	if (s[0] == 0xE2 && pos + 2 < byte_length && s[1] == 0x84 && s[2] == 0xAA)
+	{
+		*n_bytes = 3;
+		return 'k';
+	}
+
+	return 0;
+}
+
+/**
+ * _gtk_source_keyword_trie_has_prefix:
+ * @trie: a #GtkSourceKeywordTrie.
+ * @text: the text.
+ * @byte_length: the length of @text.
+ * @byte_pos: a position in @text.
+ *
+ * Returns: whether a keyword of @trie starts @text at @byte_pos, and is
+ * not followed by an ASCII word character.
+ */
+gboolean
+_gtk_source_keyword_trie_has_prefix (GtkSourceKeywordTrie *trie,
+                                     const gchar          *text,
+                                     gint                  byte_length,
+                                     gint                  byte_pos)
+{
+	guint node = 0;
+	gint pos = byte_pos;
+
+	while (pos < byte_length)
+	{
+		gint n_bytes;
+		guchar byte = next_byte (trie, text, byte_length, pos, &n_bytes);
+
+		if (byte == 0 || (node = find_child (trie, node, byte)) == 0)
+			return FALSE;
+
+		pos += n_bytes;
+
+		/* Otherwise a longer keyword may still match. */
+		if (g_array_index (trie->nodes, TrieNode, node).terminal &&
+		    !is_ascii_word_at (text, byte_length, pos))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/**
+ * _gtk_source_keyword_trie_find:
+ * @trie: a #GtkSourceKeywordTrie.
+ * @text: the text.
+ * @byte_length: the length of @text.
+ * @byte_pos: where to start looking.
+ * @byte_limit: where to stop looking.
+ *
+ * Finds the first position in [@byte_pos; @byte_limit) where a keyword
+ * of @trie may match, that is not preceded by an ASCII word character
+ * and starting with a whole keyword. The keyword may end after
+ * @byte_limit.
+ *
+ * Returns: the position, or -1.
+ */
+gint
+_gtk_source_keyword_trie_find (GtkSourceKeywordTrie *trie,
+                               const gchar          *text,
+                               gint                  byte_length,
+                               gint                  byte_pos,
+                               gint                  byte_limit)
+{
+	const guchar *s = (const guchar *) text;
+	gint pos;
+
+	g_return_val_if_fail (trie != NULL, -1);
+	g_return_val_if_fail (byte_limit <= byte_length, -1);
+
+	for (pos = byte_pos; pos < byte_limit; pos++)
+	{
+		if (!trie->first_bytes[s[pos]])
+			continue;
+
+		if (is_ascii_word_at (text, byte_length, pos - 1))
+			continue;
+
+		if (_gtk_source_keyword_trie_has_prefix (trie, text, byte_length, pos))
+			return pos;
+	}
+
+	return -1;
+}
@@ -33,11 +33,14 @@
 #include "gtksourcelanguage.h"
 #include "gtksourcelanguage-private.h"
 #include "gtksourcecontextengine-private.h"
+#include "gtksourcekeywordtrie-private.h"
+#include "gtksourceutils-private.h"
 
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <glib/gi18n-lib.h>
 
+#include <errno.h>
 #include <string.h>
 #include <fcntl.h>
 #ifdef HAVE_UNISTD_H
@@ -51,6 +54,14 @@
 #define PARSER_ERROR (parser_error_quark ())
 #define ATTR_NO_STYLE ""
 
+/* Bump when the recorded calls change. */
+#define CACHE_FORMAT_VERSION 2
+/* Format version, library version, the files with their id, size and
+ * mtime in nanoseconds, the recorded calls and the styles with their name
+ * and map-to.
+ */
+#define CACHE_TYPE "(uuuua(sstx)a(yv)a(smsms))"
+
 typedef enum _ParserError {
 	PARSER_ERROR_CANNOT_OPEN     = 0,
 	PARSER_ERROR_CANNOT_VALIDATE,
@@ -362,6 +373,8 @@ create_definition (ParserState *parser_state,
 	xmlNode *context_node, *child;
 
 	GString *all_items = NULL;
+	GPtrArray *keywords = NULL;
+	gboolean literal_keywords = TRUE;
 
 	GRegexCompileFlags match_flags = 0, start_flags = 0, end_flags = 0;
 
@@ -468,6 +481,13 @@ create_definition (ParserState *parser_state,
 				g_string_append (all_items, "|");
 				g_string_append (all_items, (gchar*) child->children->content);
 			}
+
+			if (keywords == NULL)
+				keywords = g_ptr_array_new ();
+
+			g_ptr_array_add (keywords, child->children->content);
+			literal_keywords = literal_keywords &&
+				_gtk_source_keyword_is_literal ((gchar*) child->children->content);
 		}
 	}
 
@@ -526,6 +546,27 @@ create_definition (ParserState *parser_state,
 							 &tmp_error);
 	}
 
+	/* Plain words between the default delimiters can be looked up
+	 * without the regex by the engine.
+	 */
+	if (tmp_error == NULL &&
+	    keywords != NULL &&
+	    literal_keywords &&
+	    prefix == NULL &&
+	    suffix == NULL &&
+	    g_str_equal (parser_state->opening_delimiter, "\\b") &&
+	    g_str_equal (parser_state->closing_delimiter, "\\b"))
+	{
+		g_ptr_array_add (keywords, NULL);
+		_gtk_source_context_data_set_keywords (parser_state->ctx_data,
+						       id,
+						       (const gchar * const *) keywords->pdata,
+						       (match_flags & G_REGEX_CASELESS) != 0);
+	}
+
+	if (keywords != NULL)
+		g_ptr_array_free (keywords, TRUE);
+
 	g_free (match);
 	g_free (start);
 	g_free (end);
@@ -1806,6 +1847,250 @@ steal_styles_mapping (gchar              *style_id,
 	return TRUE;
 }
 
+/* LANGUAGE CACHE ----------------------------------------------------------
+ *
+ * Parsing and validating the language files, and expanding their regexes,
+ * is done again each time a language is used, for every file it imports.
+ * Instead, the calls made to the context engine are recorded, and saved
+ * with the styles in the user cache dir. They are replayed the next times
+ * as long as the files are unchanged.
+ */
+
+/* The number of languages replayed from the cache, for the tests. */
+static guint n_cache_replays;
+
+guint
+_gtk_source_language_get_n_cache_replays (void)
+{
+	return n_cache_replays;
+}
+
+static gchar *
+get_cache_filename (GtkSourceLanguage *language)
+{
+	gchar *key;
+	gchar *checksum;
+	gchar *basename;
+	gchar *cache_filename;
+
+	/* Style names are translated while parsing. */
+	key = g_strconcat (_gtk_source_language_get_file_name (language), "\n",
+			   g_get_language_names ()[0], NULL);
+	checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA1, key, -1);
+	basename = g_strconcat (checksum, ".cache", NULL);
+
+	cache_filename = g_build_filename (g_get_user_cache_dir (),
+					   "gtksourceview-" GSV_API_VERSION_S,
+					   "language-specs",
+					   basename,
+					   NULL);
+
+	g_free (basename);
+	g_free (checksum);
+	g_free (key);
+
+	return cache_filename;
+}
+
+static const gchar *
+get_language_file_name (GtkSourceLanguage *language,
+			const gchar       *lang_id)
+{
+	GtkSourceLanguageManager *lm;
+	GtkSourceLanguage *imported_language;
+
+	if (g_strcmp0 (lang_id, gtk_source_language_get_id (language)) == 0)
+		return _gtk_source_language_get_file_name (language);
+
+	lm = _gtk_source_language_get_language_manager (language);
+	imported_language = gtk_source_language_manager_get_language (lm, lang_id);
+
+	if (imported_language == NULL)
+		return NULL;
+
+	return _gtk_source_language_get_file_name (imported_language);
+}
+
+static void
+save_cache (GtkSourceLanguage *language,
+	    GHashTable        *loaded_lang_ids,
+	    GHashTable        *styles,
+	    GVariant          *calls)
+{
+	GVariantBuilder files_builder;
+	GVariantBuilder styles_builder;
+	GHashTableIter iter;
+	gpointer key, value;
+	GVariant *cache;
+	gchar *cache_filename;
+	gchar *dirname;
+	GError *error = NULL;
+
+	g_variant_builder_init (&files_builder, G_VARIANT_TYPE ("a(sstx)"));
+
+	g_hash_table_iter_init (&iter, loaded_lang_ids);
+	while (g_hash_table_iter_next (&iter, &key, NULL))
+	{
+		const gchar *lang_id = key;
+		const gchar *filename = get_language_file_name (language, lang_id);
+		guint64 size;
+		gint64 mtime;
+
+		if (filename == NULL || !_gtk_source_utils_get_file_stamp (filename, &size, &mtime))
+		{
+			g_variant_builder_clear (&files_builder);
+			return;
+		}
+
+		g_variant_builder_add (&files_builder, "(sstx)", lang_id, filename, size, mtime);
+	}
+
+	g_variant_builder_init (&styles_builder, G_VARIANT_TYPE ("a(smsms)"));
+
+	g_hash_table_iter_init (&iter, styles);
+	while (g_hash_table_iter_next (&iter, &key, &value))
+	{
+		GtkSourceStyleInfo *info = value;
+
+		g_variant_builder_add (&styles_builder, "(smsms)", key, info->name, info->map_to);
+	}
+
+	cache = g_variant_ref_sink (g_variant_new ("(uuuu@a(sstx)@a(yv)@a(smsms))",
+						   CACHE_FORMAT_VERSION,
+						   GTK_SOURCE_MAJOR_VERSION,
+						   GTK_SOURCE_MINOR_VERSION,
+						   GTK_SOURCE_MICRO_VERSION,
+						   g_variant_builder_end (&files_builder),
+						   calls,
+						   g_variant_builder_end (&styles_builder)));
+
+	cache_filename = get_cache_filename (language);
+	dirname = g_path_get_dirname (cache_filename);
+
+	if (g_mkdir_with_parents (dirname, 0700) != 0 ||
+	    !g_file_set_contents (cache_filename,
+				  g_variant_get_data (cache),
+				  g_variant_get_size (cache),
+				  &error))
+	{
+		g_debug ("Could not save the language cache '%s': %s",
+			 cache_filename,
+			 error != NULL ? error->message : g_strerror (errno));
+		g_clear_error (&error);
+	}
+
+	g_free (dirname);
+	g_free (cache_filename);
+	g_variant_unref (cache);
+}
+
+static gboolean
+cached_files_are_unchanged (GtkSourceLanguage *language,
+			    GVariant          *files)
+{
+	GVariantIter iter;
+	const gchar *lang_id;
+	const gchar *cached_filename;
+	guint64 cached_size;
+	gint64 cached_mtime;
+
+	g_variant_iter_init (&iter, files);
+	while (g_variant_iter_next (&iter, "(&s&stx)",
+				    &lang_id, &cached_filename,
+				    &cached_size, &cached_mtime))
+	{
+		const gchar *filename = get_language_file_name (language, lang_id);
+		guint64 size;
+		gint64 mtime;
+
+		/* A language may now be found in another file. */
+		if (g_strcmp0 (filename, cached_filename) != 0)
+			return FALSE;
+
+		if (!_gtk_source_utils_get_file_stamp (filename, &size, &mtime) ||
+		    size != cached_size ||
+		    mtime != cached_mtime)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean
+load_cache (GtkSourceLanguage    *language,
+	    GtkSourceContextData *ctx_data)
+{
+	gchar *cache_filename;
+	gchar *contents;
+	gsize length;
+	GBytes *bytes;
+	GVariant *cache;
+	GVariant *files;
+	GVariant *calls;
+	GVariant *styles;
+	guint32 format, major, minor, micro;
+	gboolean success = FALSE;
+	GError *error = NULL;
+
+	cache_filename = get_cache_filename (language);
+
+	if (!g_file_get_contents (cache_filename, &contents, &length, NULL))
+	{
+		g_free (cache_filename);
+		return FALSE;
+	}
+
+	/* Not trusted: a corrupted file gives default values. */
+	bytes = g_bytes_new_take (contents, length);
+	cache = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (CACHE_TYPE), bytes, FALSE));
+	g_bytes_unref (bytes);
+
+	g_variant_get (cache, "(uuuu@a(sstx)@a(yv)@a(smsms))",
+		       &format, &major, &minor, &micro,
+		       &files, &calls, &styles);
+
+	if (format == CACHE_FORMAT_VERSION &&
+	    major == GTK_SOURCE_MAJOR_VERSION &&
+	    minor == GTK_SOURCE_MINOR_VERSION &&
+	    micro == GTK_SOURCE_MICRO_VERSION &&
+	    g_variant_n_children (files) > 0 &&
+	    cached_files_are_unchanged (language, files))
+	{
+		if (_gtk_source_context_data_replay (ctx_data, calls, &error))
+		{
+			GHashTable *language_styles = _gtk_source_language_get_styles (language);
+			GVariantIter iter;
+			const gchar *style_id, *name, *map_to;
+
+			g_variant_iter_init (&iter, styles);
+			while (g_variant_iter_next (&iter, "(&sm&sm&s)", &style_id, &name, &map_to))
+			{
+				g_hash_table_insert (language_styles,
+						     g_strdup (style_id),
+						     _gtk_source_style_info_new (name, map_to));
+			}
+
+			n_cache_replays++;
+			success = TRUE;
+		}
+		else
+		{
+			g_debug ("Discarding the language cache '%s': %s",
+				 cache_filename, error->message);
+			g_clear_error (&error);
+			g_unlink (cache_filename);
+		}
+	}
+
+	g_variant_unref (files);
+	g_variant_unref (calls);
+	g_variant_unref (styles);
+	g_variant_unref (cache);
+	g_free (cache_filename);
+
+	return success;
+}
+
 gboolean
 _gtk_source_language_file_parse_version2 (GtkSourceLanguage       *language,
 					  GtkSourceContextData    *ctx_data)
@@ -1816,11 +2101,15 @@ _gtk_source_language_file_parse_version2 (GtkSourceLanguage       *language,
 	const gchar *filename;
 	GHashTable *loaded_lang_ids;
 	GQueue *replacements;
+	GVariant *calls;
 
 	g_return_val_if_fail (ctx_data != NULL, FALSE);
 
 	filename = _gtk_source_language_get_file_name (language);
 
+	if (load_cache (language, ctx_data))
+		return TRUE;
+
         G_GNUC_BEGIN_IGNORE_DEPRECATIONS
 	/* TODO: as an optimization tell the parser to merge CDATA
 	 * as text nodes (XML_PARSE_NOCDATA), and to ignore blank
@@ -1843,6 +2132,8 @@ _gtk_source_language_file_parse_version2 (GtkSourceLanguage       *language,
 						 NULL);
 	replacements = g_queue_new ();
 
+	_gtk_source_context_data_start_recording (ctx_data);
+
 	success = file_parse (filename, language, ctx_data,
 			      defined_regexes, styles,
 			      loaded_lang_ids, replacements,
@@ -1851,6 +2142,13 @@ _gtk_source_language_file_parse_version2 (GtkSourceLanguage       *language,
 	if (success)
 		success = _gtk_source_context_data_finish_parse (ctx_data, replacements->head, &error);
 
+	calls = g_variant_ref_sink (_gtk_source_context_data_end_recording (ctx_data));
+
+	if (success)
+		save_cache (language, loaded_lang_ids, styles, calls);
+
+	g_variant_unref (calls);
+
 	if (success)
 		g_hash_table_foreach_steal (styles,
 					    (GHRFunc) steal_styles_mapping,
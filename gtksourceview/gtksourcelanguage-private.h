@@ -53,11 +53,16 @@ G_GNUC_INTERNAL
 gboolean                  _gtk_source_language_file_parse_version2    (GtkSourceLanguage        *language,
                                                                        GtkSourceContextData     *ctx_data);
 G_GNUC_INTERNAL
+guint                     _gtk_source_language_get_n_cache_replays    (void);
+G_GNUC_INTERNAL
 GtkSourceEngine          *_gtk_source_language_create_engine          (GtkSourceLanguage        *language);
 G_GNUC_INTERNAL
 void                      _gtk_source_language_clear_ctx_data         (GtkSourceLanguage        *language,
                                                                        GtkSourceContextData     *ctx_data);
 G_GNUC_INTERNAL
+gboolean                  _gtk_source_language_compile_regexes        (GtkSourceLanguage        *language,
+                                                                       GError                  **error);
+G_GNUC_INTERNAL
 GHashTable               *_gtk_source_language_get_styles             (GtkSourceLanguage        *language);
 G_GNUC_INTERNAL
 GtkSourceStyleInfo       *_gtk_source_style_info_new                  (const gchar              *name,
@@ -821,6 +821,42 @@ _gtk_source_language_create_engine (GtkSourceLanguage *language)
 	return ce ? GTK_SOURCE_ENGINE (ce) : NULL;
 }
 
+/*
+ * _gtk_source_language_compile_regexes:
+ * @language: a #GtkSourceLanguage.
+ * @error: location to store the error occurring, or %NULL to ignore errors.
+ *
+ * Loads the definitions of @language and compiles all their regexes, for
+ * the tests, since they are otherwise only compiled when first matched.
+ *
+ * Returns: %FALSE if the definitions could not be loaded or a regex
+ *   is invalid.
+ */
+gboolean
+_gtk_source_language_compile_regexes (GtkSourceLanguage  *language,
+                                      GError            **error)
+{
+	GtkSourceContextData *ctx_data;
+	gboolean ret;
+
+	g_return_val_if_fail (GTK_SOURCE_IS_LANGUAGE (language), FALSE);
+
+	ctx_data = gtk_source_language_parse_file (language);
+
+	if (ctx_data == NULL)
+	{
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+		             "the definitions of %s could not be loaded",
+		             language->id);
+		return FALSE;
+	}
+
+	ret = _gtk_source_context_data_compile_regexes (ctx_data, error);
+	_gtk_source_context_data_unref (ctx_data);
+
+	return ret;
+}
+
 typedef struct
 {
 	gchar     *language_id;
@@ -24,6 +24,7 @@
 #include "gtksourcemap.h"
 #include "gtksourcebuffer.h"
 #include "gtksourcecompletion.h"
+#include "gtksourcemapraster-private.h"
 #include "gtksourcestyle-private.h"
 #include "gtksourcestylescheme.h"
 #include "gtksourceutils-private.h"
@@ -58,6 +59,9 @@
  *
  * When FontConfig is available, `GtkSourceMap` will try to use a bundled
  * "block" font to make the map more legible.
+ *
+ * On large documents, [property@Map:raster] can be set so that the map
+ * draws a cached summary of the lines instead of laying out their text.
  */
 
 /*
@@ -217,6 +221,20 @@ typedef struct
 
 	/* How much the slider should be shifted from the position of the cursor */
 	double slider_y_shift;
+
+	/* The renderer of the raster mode, or NULL if we display the text */
+	GtkSourceMapRaster *raster;
+
+	/* The scroll position of the raster, in pixels */
+	double raster_offset;
+
+	/* The size of a character in our font, or 0 if not measured yet */
+	int char_width;
+	int char_height;
+
+	/* The foreground of the "text" style, for the raster mode */
+	GdkRGBA text_fg;
+	guint has_text_fg : 1;
 } GtkSourceMapPrivate;
 
 enum
@@ -224,6 +242,7 @@ enum
 	PROP_0,
 	PROP_VIEW,
 	PROP_FONT_DESC,
+	PROP_RASTER,
 	N_PROPERTIES
 };
 
@@ -231,6 +250,57 @@ G_DEFINE_TYPE_WITH_PRIVATE (GtkSourceMap, gtk_source_map, GTK_SOURCE_TYPE_VIEW)
 
 static GParamSpec *properties[N_PROPERTIES];
 
+static void
+ensure_char_size (GtkSourceMap *map)
+{
+	GtkSourceMapPrivate *priv = gtk_source_map_get_instance_private (map);
+	PangoLayout *layout;
+
+	if (priv->char_width > 0)
+	{
+		return;
+	}
+
+	layout = gtk_widget_create_pango_layout (GTK_WIDGET (map), "X");
+	pango_layout_get_pixel_size (layout, &priv->char_width, &priv->char_height);
+	g_object_unref (layout);
+
+	priv->char_width = MAX (priv->char_width, 1);
+	priv->char_height = MAX (priv->char_height, 1);
+}
+
+/* The height of the whole document in the raster mode. */
+static int
+get_raster_height (GtkSourceMap *map)
+{
+	GtkSourceMapPrivate *priv = gtk_source_map_get_instance_private (map);
+
+	ensure_char_size (map);
+
+	return gtk_text_view_get_top_margin (GTK_TEXT_VIEW (map)) +
+	       _gtk_source_map_raster_get_n_lines (priv->raster) * priv->char_height +
+	       gtk_text_view_get_bottom_margin (GTK_TEXT_VIEW (map));
+}
+
+/* Like gtk_text_view_get_iter_at_location() with buffer coordinates,
+ * in the raster mode.
+ */
+static void
+get_raster_iter_at_y (GtkSourceMap *map,
+                      GtkTextIter  *iter,
+                      double        y)
+{
+	GtkSourceMapPrivate *priv = gtk_source_map_get_instance_private (map);
+	int line;
+
+	ensure_char_size (map);
+
+	y -= gtk_text_view_get_top_margin (GTK_TEXT_VIEW (map));
+	line = MAX (y, 0) / priv->char_height;
+
+	gtk_text_buffer_get_iter_at_line (priv->buffer, iter, line);
+}
+
 static void
 get_slider_position (GtkSourceMap *map,
                      int           width,
@@ -254,7 +324,7 @@ get_slider_position (GtkSourceMap *map,
 
 	us_width = gtk_widget_get_width (GTK_WIDGET (map));
 
-	buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (map));
+	buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (priv->view));
 
 	G_GNUC_BEGIN_IGNORE_DEPRECATIONS {
 		GtkStyleContext *style_context;
@@ -264,13 +334,23 @@ get_slider_position (GtkSourceMap *map,
 	} G_GNUC_END_IGNORE_DEPRECATIONS
 
 	gtk_text_buffer_get_end_iter (buffer, &end_iter);
-	gtk_text_view_get_iter_location (GTK_TEXT_VIEW (map), &end_iter, &end_rect);
-	us_height = end_rect.y + end_rect.height;
+
+	if (priv->raster != NULL)
+	{
+		us_height = get_raster_height (map);
+		us_visible_rect.y = priv->raster_offset;
+	}
+	else
+	{
+		gtk_text_view_get_iter_location (GTK_TEXT_VIEW (map), &end_iter, &end_rect);
+		us_height = end_rect.y + end_rect.height;
+		gtk_text_view_get_visible_rect (GTK_TEXT_VIEW (map), &us_visible_rect);
+	}
+
 	gtk_text_view_get_iter_location (GTK_TEXT_VIEW (priv->view), &end_iter, &end_rect);
 	them_height = end_rect.y + end_rect.height;
 
 	gtk_text_view_get_visible_rect (GTK_TEXT_VIEW (priv->view), &them_visible_rect);
-	gtk_text_view_get_visible_rect (GTK_TEXT_VIEW (map), &us_visible_rect);
 
 	slider_area->x = 0;
 	slider_area->width = us_width - border.left - border.right;
@@ -327,6 +407,8 @@ gtk_source_map_rebuild_css (GtkSourceMap *map)
 		return;
 	}
 
+	priv->has_text_fg = FALSE;
+
 	/*
 	 * This is where we calculate the CSS that maps the font for the
 	 * minimap as well as the styling for the slider.
@@ -380,9 +462,13 @@ gtk_source_map_rebuild_css (GtkSourceMap *map)
 		if ((text = gtk_source_style_scheme_get_style (style_scheme, "text")))
 		{
 			char *str;
+			char *fg_str = NULL;
+			gboolean fg_set = FALSE;
 
 			g_object_get (text,
 				      "background", &str,
+				      "foreground", &fg_str,
+				      "foreground-set", &fg_set,
 				      NULL);
 
 			if (str != NULL)
@@ -390,6 +476,14 @@ gtk_source_map_rebuild_css (GtkSourceMap *map)
 				gdk_rgba_parse (&real_bg, str);
 				g_free (str);
 			}
+
+			/* Used as the color of the untagged text in the raster mode */
+			if (fg_set && fg_str != NULL)
+			{
+				priv->has_text_fg = gdk_rgba_parse (&priv->text_fg, fg_str);
+			}
+
+			g_free (fg_str);
 		}
 
 		if (!(style = gtk_source_style_scheme_get_style (style_scheme, "map-overlay")) &&
@@ -542,6 +636,23 @@ update_child_vadjustment (GtkSourceMap *map)
 	              "page-size", &page_size,
 	              NULL);
 
+	if (priv->raster != NULL)
+	{
+		int raster_height = get_raster_height (map);
+		int height = gtk_widget_get_height (GTK_WIDGET (map));
+
+		priv->raster_offset = 0.0;
+
+		if (raster_height > height && upper > page_size)
+		{
+			priv->raster_offset = (value / (upper - page_size)) * (raster_height - height);
+		}
+
+		gtk_widget_queue_draw (GTK_WIDGET (map));
+		gtk_source_map_allocate_slider (map);
+		return;
+	}
+
 	child_vadj = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (map));
 	g_object_get (child_vadj,
 	              "upper", &child_upper,
@@ -626,7 +737,15 @@ buffer_notify_style_scheme (GtkSourceMap  *map,
                             GParamSpec    *pspec,
                             GtkTextBuffer *buffer)
 {
+	GtkSourceMapPrivate *priv = gtk_source_map_get_instance_private (map);
+
 	gtk_source_map_rebuild_css (map);
+
+	/* The colors of the highlighting tags changed */
+	if (priv->raster != NULL)
+	{
+		_gtk_source_map_raster_invalidate (priv->raster);
+	}
 }
 
 static void
@@ -640,6 +759,11 @@ connect_buffer (GtkSourceMap  *map,
 	priv->buffer = buffer;
 	g_object_add_weak_pointer (G_OBJECT (buffer), (gpointer *)&priv->buffer);
 
+	if (priv->raster != NULL)
+	{
+		_gtk_source_map_raster_set_buffer (priv->raster, buffer);
+	}
+
 	priv->buffer_notify_style_scheme_handler =
 		g_signal_connect_object (buffer,
 		                         "notify::style-scheme",
@@ -669,6 +793,11 @@ disconnect_buffer (GtkSourceMap  *map)
 		priv->buffer_notify_style_scheme_handler = 0;
 	}
 
+	if (priv->raster != NULL)
+	{
+		_gtk_source_map_raster_set_buffer (priv->raster, NULL);
+	}
+
 	g_object_remove_weak_pointer (G_OBJECT (priv->buffer), (gpointer *)&priv->buffer);
 	priv->buffer = NULL;
 }
@@ -828,7 +957,15 @@ scroll_to_child_point (GtkSourceMap *map,
 	{
 		GtkTextIter iter;
 
-		gtk_text_view_get_iter_at_location (GTK_TEXT_VIEW (map), &iter, x, y);
+		if (priv->raster != NULL)
+		{
+			get_raster_iter_at_y (map, &iter, y);
+		}
+		else
+		{
+			gtk_text_view_get_iter_at_location (GTK_TEXT_VIEW (map), &iter, x, y);
+		}
+
 		_gtk_source_view_jump_to_iter (GTK_TEXT_VIEW (priv->view), &iter,
 		                               0.0, TRUE, 1.0, 0.5);
 	}
@@ -846,6 +983,33 @@ scale_margin (GBinding *binding,
 	return TRUE;
 }
 
+static void
+bind_buffer (GtkSourceMap *map)
+{
+	GtkSourceMapPrivate *priv = gtk_source_map_get_instance_private (map);
+
+	priv->buffer_binding =
+		g_object_bind_property (priv->view, "buffer",
+		                        map, "buffer",
+		                        G_BINDING_SYNC_CREATE);
+	g_object_add_weak_pointer (G_OBJECT (priv->buffer_binding),
+	                           (gpointer *)&priv->buffer_binding);
+}
+
+static void
+unbind_buffer (GtkSourceMap *map)
+{
+	GtkSourceMapPrivate *priv = gtk_source_map_get_instance_private (map);
+
+	if (priv->buffer_binding != NULL)
+	{
+		g_object_remove_weak_pointer (G_OBJECT (priv->buffer_binding),
+		                              (gpointer *)&priv->buffer_binding);
+		g_binding_unbind (priv->buffer_binding);
+		priv->buffer_binding = NULL;
+	}
+}
+
 static void
 connect_view (GtkSourceMap  *map,
               GtkSourceView *view)
@@ -860,12 +1024,11 @@ connect_view (GtkSourceMap  *map,
 
 	vadj = gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (view));
 
-	priv->buffer_binding =
-		g_object_bind_property (view, "buffer",
-		                        map, "buffer",
-		                        G_BINDING_SYNC_CREATE);
-	g_object_add_weak_pointer (G_OBJECT (priv->buffer_binding),
-	                           (gpointer *)&priv->buffer_binding);
+	/* In the raster mode, we do not display the buffer ourselves */
+	if (priv->raster == NULL)
+	{
+		bind_buffer (map);
+	}
 
 	priv->indent_width_binding =
 		g_object_bind_property (view, "indent-width",
@@ -958,14 +1121,7 @@ disconnect_view (GtkSourceMap *map)
 	}
 
 	disconnect_buffer (map);
-
-	if (priv->buffer_binding != NULL)
-	{
-		g_object_remove_weak_pointer (G_OBJECT (priv->buffer_binding),
-		                              (gpointer *)&priv->buffer_binding);
-		g_binding_unbind (priv->buffer_binding);
-		priv->buffer_binding = NULL;
-	}
+	unbind_buffer (map);
 
 	if (priv->indent_width_binding != NULL)
 	{
@@ -1025,6 +1181,7 @@ gtk_source_map_dispose (GObject *object)
 	disconnect_buffer (map);
 	disconnect_view (map);
 
+	g_clear_pointer (&priv->raster, _gtk_source_map_raster_free);
 	g_clear_object (&priv->css_provider);
 	g_clear_pointer (&priv->font_desc, pango_font_description_free);
 
@@ -1071,6 +1228,10 @@ gtk_source_map_get_property (GObject    *object,
 			g_value_set_object (value, gtk_source_map_get_view (map));
 			break;
 
+		case PROP_RASTER:
+			g_value_set_boolean (value, gtk_source_map_get_raster (map));
+			break;
+
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 	}
@@ -1094,6 +1255,10 @@ gtk_source_map_set_property (GObject      *object,
 			gtk_source_map_set_font_desc (map, g_value_get_boxed (value));
 			break;
 
+		case PROP_RASTER:
+			gtk_source_map_set_raster (map, g_value_get_boolean (value));
+			break;
+
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 	}
@@ -1129,10 +1294,17 @@ gtk_source_map_drag_update (GtkSourceMap   *map,
 	gtk_gesture_drag_get_start_point (drag, &begin_x, &begin_y);
 	y = CLAMP (ceil (begin_y + y), 0, widget_height);
 
-	GTK_WIDGET_CLASS (gtk_source_map_parent_class)->measure (GTK_WIDGET (map),
-	                                                         GTK_ORIENTATION_VERTICAL,
-	                                                         gtk_widget_get_width (GTK_WIDGET (map)),
-	                                                         &ignored, &real_height, &ignored, &ignored);
+	if (priv->raster != NULL)
+	{
+		real_height = get_raster_height (map);
+	}
+	else
+	{
+		GTK_WIDGET_CLASS (gtk_source_map_parent_class)->measure (GTK_WIDGET (map),
+		                                                         GTK_ORIENTATION_VERTICAL,
+		                                                         gtk_widget_get_width (GTK_WIDGET (map)),
+		                                                         &ignored, &real_height, &ignored, &ignored);
+	}
 
 	height = MIN (real_height, widget_height) - gtk_text_view_get_bottom_margin (GTK_TEXT_VIEW (map));
 
@@ -1240,10 +1412,18 @@ gtk_source_map_click_pressed (GtkSourceMap *map,
 
 	gtk_gesture_set_state (click, GTK_EVENT_SEQUENCE_CLAIMED);
 
-	gtk_text_view_window_to_buffer_coords (GTK_TEXT_VIEW (map),
-	                                       GTK_TEXT_WINDOW_WIDGET,
-	                                       x, y, &buffer_x, &buffer_y);
-	gtk_text_view_get_iter_at_location (GTK_TEXT_VIEW (map), &iter, 0, buffer_y);
+	if (priv->raster != NULL)
+	{
+		get_raster_iter_at_y (map, &iter, y + priv->raster_offset);
+	}
+	else
+	{
+		gtk_text_view_window_to_buffer_coords (GTK_TEXT_VIEW (map),
+		                                       GTK_TEXT_WINDOW_WIDGET,
+		                                       x, y, &buffer_x, &buffer_y);
+		gtk_text_view_get_iter_at_location (GTK_TEXT_VIEW (map), &iter, 0, buffer_y);
+	}
+
 	gtk_text_view_scroll_to_iter (GTK_TEXT_VIEW (priv->view), &iter,
 	                              0.0, TRUE, 1.0, 0.5);
 }
@@ -1351,10 +1531,17 @@ static void
 gtk_source_map_css_changed (GtkWidget         *widget,
                             GtkCssStyleChange *change)
 {
+	GtkSourceMap *map = GTK_SOURCE_MAP (widget);
+	GtkSourceMapPrivate *priv = gtk_source_map_get_instance_private (map);
+
 	g_assert (GTK_IS_WIDGET (widget));
 
 	GTK_WIDGET_CLASS (gtk_source_map_parent_class)->css_changed (widget, change);
 
+	/* The font may have changed, measure it again when needed */
+	priv->char_width = 0;
+	priv->char_height = 0;
+
 #if GTK_CHECK_VERSION(4,3,1)
 	{
 		PangoContext *rtl_context;
@@ -1380,12 +1567,21 @@ gtk_source_map_size_allocate (GtkWidget *widget,
                               int        baseline)
 {
 	GtkSourceMap *map = (GtkSourceMap *)widget;
+	GtkSourceMapPrivate *priv = gtk_source_map_get_instance_private (map);
 
 	g_assert (GTK_SOURCE_IS_MAP (map));
 
 	GTK_WIDGET_CLASS (gtk_source_map_parent_class)->size_allocate (widget, width, height, baseline);
 
-	gtk_source_map_allocate_slider (map);
+	/* The scroll position of the raster depends on our height */
+	if (priv->raster != NULL && priv->view != NULL)
+	{
+		update_child_vadjustment (map);
+	}
+	else
+	{
+		gtk_source_map_allocate_slider (map);
+	}
 }
 
 static void
@@ -1404,6 +1600,43 @@ gtk_source_map_snapshot (GtkWidget   *widget,
 	gtk_widget_snapshot_child (GTK_WIDGET (map), GTK_WIDGET (priv->slider), snapshot);
 
 	GTK_WIDGET_CLASS (gtk_source_map_parent_class)->snapshot (widget, snapshot);
+
+	if (priv->raster != NULL)
+	{
+		int width = gtk_widget_get_width (widget);
+		int height = gtk_widget_get_height (widget);
+		int left_margin = gtk_text_view_get_left_margin (GTK_TEXT_VIEW (map));
+		int top_margin = gtk_text_view_get_top_margin (GTK_TEXT_VIEW (map));
+		GdkRGBA fg;
+
+		ensure_char_size (map);
+
+		if (priv->has_text_fg)
+		{
+			fg = priv->text_fg;
+		}
+		else
+		{
+			gtk_widget_get_color (widget, &fg);
+		}
+
+		_gtk_source_map_raster_set_foreground (priv->raster, &fg);
+		_gtk_source_map_raster_set_tab_width (priv->raster,
+		                                      gtk_source_view_get_tab_width (GTK_SOURCE_VIEW (map)));
+		_gtk_source_map_raster_set_metrics (priv->raster,
+		                                    priv->char_width,
+		                                    priv->char_height,
+		                                    MAX (width - left_margin, 0) / priv->char_width + 1);
+
+		gtk_snapshot_save (snapshot);
+		gtk_snapshot_translate (snapshot, &GRAPHENE_POINT_INIT (left_margin, 0));
+		_gtk_source_map_raster_snapshot (priv->raster,
+		                                 snapshot,
+		                                 priv->raster_offset - top_margin,
+		                                 width - left_margin,
+		                                 height);
+		gtk_snapshot_restore (snapshot);
+	}
 }
 
 static void
@@ -1458,6 +1691,29 @@ gtk_source_map_class_init (GtkSourceMapClass *klass)
 		                    PANGO_TYPE_FONT_DESCRIPTION,
 		                    (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+	/**
+	 * GtkSourceMap:raster:
+	 *
+	 * Whether the map draws a summary of the lines instead of their text.
+	 *
+	 * In the raster mode, the non-blank characters of each line are drawn
+	 * as blocks, with the foreground color of their highlighting. The
+	 * blocks are cached and only drawn again for the lines which are
+	 * edited or highlighted again, so the map does not depend on the text
+	 * layout of the whole document.
+	 *
+	 * The map does not display the buffer itself in this mode, so the
+	 * [class@GutterRenderer]s added to it show nothing.
+	 *
+	 * Since: 5.22
+	 */
+	properties[PROP_RASTER] =
+		g_param_spec_boolean ("raster",
+		                      "Raster",
+		                      "Whether to draw a summary of the lines instead of their text.",
+		                      FALSE,
+		                      (G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
+
 	g_object_class_install_properties (object_class, N_PROPERTIES, properties);
 }
 
@@ -1608,3 +1864,80 @@ gtk_source_map_get_view (GtkSourceMap *map)
 
 	return priv->view;
 }
+
+/**
+ * gtk_source_map_set_raster:
+ * @map: a #GtkSourceMap.
+ * @raster: whether to draw a summary of the lines.
+ *
+ * Sets the [property@Map:raster] property.
+ *
+ * Since: 5.22
+ */
+void
+gtk_source_map_set_raster (GtkSourceMap *map,
+                           gboolean      raster)
+{
+	GtkSourceMapPrivate *priv;
+
+	g_return_if_fail (GTK_SOURCE_IS_MAP (map));
+
+	priv = gtk_source_map_get_instance_private (map);
+
+	raster = raster != FALSE;
+
+	if (raster == (priv->raster != NULL))
+	{
+		return;
+	}
+
+	if (raster)
+	{
+		priv->raster = _gtk_source_map_raster_new (GTK_WIDGET (map));
+
+		/* Let the text view lay out an empty buffer */
+		unbind_buffer (map);
+		gtk_text_view_set_buffer (GTK_TEXT_VIEW (map), NULL);
+
+		if (priv->buffer != NULL)
+		{
+			_gtk_source_map_raster_set_buffer (priv->raster, priv->buffer);
+		}
+	}
+	else
+	{
+		g_clear_pointer (&priv->raster, _gtk_source_map_raster_free);
+		priv->raster_offset = 0.0;
+
+		if (priv->view != NULL)
+		{
+			bind_buffer (map);
+		}
+	}
+
+	gtk_source_map_queue_update (map);
+	gtk_widget_queue_draw (GTK_WIDGET (map));
+
+	g_object_notify_by_pspec (G_OBJECT (map), properties[PROP_RASTER]);
+}
+
+/**
+ * gtk_source_map_get_raster:
+ * @map: a #GtkSourceMap.
+ *
+ * Returns: whether @map draws a summary of the lines instead of their
+ * text.
+ *
+ * Since: 5.22
+ */
+gboolean
+gtk_source_map_get_raster (GtkSourceMap *map)
+{
+	GtkSourceMapPrivate *priv;
+
+	g_return_val_if_fail (GTK_SOURCE_IS_MAP (map), FALSE);
+
+	priv = gtk_source_map_get_instance_private (map);
+
+	return priv->raster != NULL;
+}
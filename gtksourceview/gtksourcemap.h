@@ -43,11 +43,16 @@ struct _GtkSourceMapClass
 };
 
 GTK_SOURCE_AVAILABLE_IN_ALL
-GtkWidget     *gtk_source_map_new      (void);
+GtkWidget     *gtk_source_map_new        (void);
 GTK_SOURCE_AVAILABLE_IN_ALL
-void           gtk_source_map_set_view (GtkSourceMap  *map,
-                                        GtkSourceView *view);
+void           gtk_source_map_set_view   (GtkSourceMap  *map,
+                                          GtkSourceView *view);
 GTK_SOURCE_AVAILABLE_IN_ALL
-GtkSourceView *gtk_source_map_get_view (GtkSourceMap  *map);
+GtkSourceView *gtk_source_map_get_view   (GtkSourceMap  *map);
+GTK_SOURCE_AVAILABLE_IN_5_22
+void           gtk_source_map_set_raster (GtkSourceMap  *map,
+                                          gboolean       raster);
+GTK_SOURCE_AVAILABLE_IN_5_22
+gboolean       gtk_source_map_get_raster (GtkSourceMap  *map);
 
 G_END_DECLS
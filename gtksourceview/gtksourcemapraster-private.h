@@ -0,0 +1,70 @@
+/*
+ * This file is part of GtkSourceView
+ *
+ * GtkSourceView is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GtkSourceView is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#pragma once
+
+#include <gtk/gtk.h>
+
+#include "gtksourcetypes-private.h"
+
+G_BEGIN_DECLS
+
+GTK_SOURCE_INTERNAL
+GtkSourceMapRaster *_gtk_source_map_raster_new            (GtkWidget          *widget);
+GTK_SOURCE_INTERNAL
+void                _gtk_source_map_raster_free           (GtkSourceMapRaster *raster);
+GTK_SOURCE_INTERNAL
+void                _gtk_source_map_raster_set_buffer     (GtkSourceMapRaster *raster,
+                                                           GtkTextBuffer      *buffer);
+GTK_SOURCE_INTERNAL
+void                _gtk_source_map_raster_set_tab_width  (GtkSourceMapRaster *raster,
+                                                           guint               tab_width);
+GTK_SOURCE_INTERNAL
+void                _gtk_source_map_raster_set_metrics    (GtkSourceMapRaster *raster,
+                                                           double              column_width,
+                                                           double              row_height,
+                                                           guint               max_columns);
+GTK_SOURCE_INTERNAL
+void                _gtk_source_map_raster_set_foreground (GtkSourceMapRaster *raster,
+                                                           const GdkRGBA      *foreground);
+GTK_SOURCE_INTERNAL
+void                _gtk_source_map_raster_invalidate     (GtkSourceMapRaster *raster);
+GTK_SOURCE_INTERNAL
+guint               _gtk_source_map_raster_get_n_lines    (GtkSourceMapRaster *raster);
+GTK_SOURCE_INTERNAL
+gboolean            _gtk_source_map_raster_is_cached      (GtkSourceMapRaster *raster,
+                                                           guint               line);
+GTK_SOURCE_INTERNAL
+guint               _gtk_source_map_raster_get_n_runs     (GtkSourceMapRaster *raster,
+                                                           guint               line);
+GTK_SOURCE_INTERNAL
+gboolean            _gtk_source_map_raster_get_run        (GtkSourceMapRaster *raster,
+                                                           guint               line,
+                                                           guint               n,
+                                                           guint              *column,
+                                                           guint              *length,
+                                                           GdkRGBA            *color);
+GTK_SOURCE_INTERNAL
+void                _gtk_source_map_raster_snapshot       (GtkSourceMapRaster *raster,
+                                                           GtkSnapshot        *snapshot,
+                                                           double              y_offset,
+                                                           int                 width,
+                                                           int                 height);
+
+G_END_DECLS
@@ -0,0 +1,966 @@
+/*
+ * This file is part of GtkSourceView
+ *
+ * GtkSourceView is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GtkSourceView is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "gtksourcebuffer.h"
+#include "gtksourcebuffer-private.h"
+#include "gtksourcebufferinternal-private.h"
+#include "gtksourcemapraster-private.h"
+
+/*
+ * Renderer of the raster mode of GtkSourceMap.
+ *
+ * Instead of laying out the text with a tiny font, each line is reduced
+ * to a summary: the runs of non-blank characters by column, with the
+ * foreground color of the tags applied to them. The summaries are drawn
+ * as colored blocks into tiles of TILE_LINES lines, which are kept as
+ * render nodes and reused from one frame to the next.
+ *
+ * The summaries are computed lazily, when a tile is drawn. When the
+ * buffer changes, only the summaries of the edited lines are dropped, the
+ * other ones move along with their lines. The tiles from the edited line
+ * to the end are dropped since their lines moved, but drawing them again
+ * from the summaries does not involve any text layout. When a tag with a
+ * foreground is applied or removed, for example by the highlighting, only
+ * the summaries and the tiles of its lines are dropped.
+ */
+
+#define TILE_LINES 64
+
+typedef struct
+{
+	guint16 column;
+	guint16 length;
+
+	/* 0 for the default foreground, otherwise an index + 1 in the palette. */
+	guint16 color;
+} Run;
+
+typedef struct
+{
+	guint n_runs;
+	Run runs[];
+} LineSummary;
+
+struct _GtkSourceMapRaster
+{
+	/* Unowned, to queue a redraw when the buffer changes. */
+	GtkWidget *widget;
+
+	GtkTextBuffer *buffer;
+	gulong insert_text_handler;
+	gulong delete_range_handler;
+	gulong apply_tag_handler;
+	gulong remove_tag_handler;
+	gulong text_replaced_handler;
+
+	/* A LineSummary per line, NULL for the lines to summarize again. */
+	GPtrArray *summaries;
+
+	/* A GskRenderNode per tile, NULL for the tiles to draw again. */
+	GPtrArray *tiles;
+
+	/* The GdkRGBA used by the runs. */
+	GArray *palette;
+
+	/* GtkTextTag to its color in the palette, 0 if it has no foreground. */
+	GHashTable *tag_colors;
+
+	/* The runs of the line being summarized. */
+	GArray *scratch;
+
+	GdkRGBA foreground;
+	double column_width;
+	double row_height;
+	guint max_columns;
+	guint tab_width;
+};
+
+static void
+tile_free (gpointer data)
+{
+	if (data != NULL)
+	{
+		gsk_render_node_unref (data);
+	}
+}
+
+static void
+queue_draw (GtkSourceMapRaster *raster)
+{
+	if (raster->widget != NULL)
+	{
+		gtk_widget_queue_draw (raster->widget);
+	}
+}
+
+static void
+clear_summaries (GtkSourceMapRaster *raster)
+{
+	guint i;
+
+	for (i = 0; i < raster->summaries->len; i++)
+	{
+		g_clear_pointer (&g_ptr_array_index (raster->summaries, i), g_free);
+	}
+}
+
+static void
+reset_lines (GtkSourceMapRaster *raster)
+{
+	g_ptr_array_set_size (raster->summaries, 0);
+	g_ptr_array_set_size (raster->tiles, 0);
+
+	if (raster->buffer != NULL)
+	{
+		g_ptr_array_set_size (raster->summaries,
+		                      gtk_text_buffer_get_line_count (raster->buffer));
+	}
+}
+
+/* Drops the tiles from the one of @line to the end. */
+static void
+invalidate_tiles_from (GtkSourceMapRaster *raster,
+                       guint               line)
+{
+	guint tile = line / TILE_LINES;
+
+	if (tile < raster->tiles->len)
+	{
+		g_ptr_array_set_size (raster->tiles, tile);
+	}
+}
+
+static void
+invalidate_lines (GtkSourceMapRaster *raster,
+                  guint               first,
+                  guint               last)
+{
+	guint line;
+	guint tile;
+
+	for (line = first; line <= last && line < raster->summaries->len; line++)
+	{
+		g_clear_pointer (&g_ptr_array_index (raster->summaries, line), g_free);
+	}
+
+	for (tile = first / TILE_LINES;
+	     tile <= last / TILE_LINES && tile < raster->tiles->len;
+	     tile++)
+	{
+		g_clear_pointer (&g_ptr_array_index (raster->tiles, tile), gsk_render_node_unref);
+	}
+}
+
+/* The changes held by a GtkSourceBuffer are handled at once by
+ * text_replaced_cb().
+ */
+static gboolean
+changes_held (GtkTextBuffer *buffer)
+{
+	return GTK_SOURCE_IS_BUFFER (buffer) &&
+	       _gtk_source_buffer_get_changes_held (GTK_SOURCE_BUFFER (buffer));
+}
+
+static void
+insert_text_cb (GtkTextBuffer      *buffer,
+                GtkTextIter        *location,
+                const char         *text,
+                int                 len,
+                GtkSourceMapRaster *raster)
+{
+	guint n_lines = gtk_text_buffer_get_line_count (buffer);
+	guint old_n_lines = raster->summaries->len;
+	guint n_added;
+	guint line;
+
+	if (changes_held (buffer))
+	{
+		return;
+	}
+
+	/* @location has been moved to the end of the inserted text. */
+	line = gtk_text_iter_get_line (location);
+
+	if (n_lines < old_n_lines || n_lines - old_n_lines > line)
+	{
+		reset_lines (raster);
+		queue_draw (raster);
+		return;
+	}
+
+	n_added = n_lines - old_n_lines;
+	line -= n_added;
+
+	if (n_added > 0)
+	{
+		gpointer *pdata;
+
+		g_ptr_array_set_size (raster->summaries, n_lines);
+
+		pdata = raster->summaries->pdata;
+		memmove (pdata + line + 1 + n_added,
+		         pdata + line + 1,
+		         (old_n_lines - line - 1) * sizeof (gpointer));
+		memset (pdata + line + 1, 0, n_added * sizeof (gpointer));
+
+		invalidate_tiles_from (raster, line);
+	}
+
+	invalidate_lines (raster, line, line);
+	queue_draw (raster);
+}
+
+static void
+delete_range_cb (GtkTextBuffer      *buffer,
+                 GtkTextIter        *start,
+                 GtkTextIter        *end,
+                 GtkSourceMapRaster *raster)
+{
+	guint n_lines = gtk_text_buffer_get_line_count (buffer);
+	guint old_n_lines = raster->summaries->len;
+	guint line;
+
+	if (changes_held (buffer))
+	{
+		return;
+	}
+
+	/* @start and @end have been revalidated to the deletion point. */
+	line = gtk_text_iter_get_line (start);
+
+	if (n_lines > old_n_lines || line >= n_lines)
+	{
+		reset_lines (raster);
+		queue_draw (raster);
+		return;
+	}
+
+	if (n_lines < old_n_lines)
+	{
+		g_ptr_array_remove_range (raster->summaries, line + 1, old_n_lines - n_lines);
+		invalidate_tiles_from (raster, line);
+	}
+
+	invalidate_lines (raster, line, line);
+	queue_draw (raster);
+}
+
+static void
+text_replaced_cb (GtkSourceBufferInternal *buffer_internal,
+                  gint                     start_offset,
+                  gint                     old_end_offset,
+                  gint                     new_end_offset,
+                  GtkSourceMapRaster      *raster)
+{
+	guint n_lines = gtk_text_buffer_get_line_count (raster->buffer);
+	guint old_n_lines = raster->summaries->len;
+	GtkTextIter iter;
+	guint first;
+	guint last;
+	guint old_last;
+
+	gtk_text_buffer_get_iter_at_offset (raster->buffer, &iter, start_offset);
+	first = gtk_text_iter_get_line (&iter);
+	gtk_text_buffer_get_iter_at_offset (raster->buffer, &iter, new_end_offset);
+	last = gtk_text_iter_get_line (&iter);
+
+	/* The lines after the new text are the ones after the old text. */
+	if (last + old_n_lines < first + n_lines)
+	{
+		reset_lines (raster);
+		queue_draw (raster);
+		return;
+	}
+
+	old_last = last + old_n_lines - n_lines;
+
+	/* The lines [@first, @old_last] become [@first, @last]. */
+	if (old_last > last)
+	{
+		g_ptr_array_remove_range (raster->summaries, last + 1, old_last - last);
+		invalidate_tiles_from (raster, first);
+	}
+	else if (old_last < last)
+	{
+		guint n_added = last - old_last;
+		gpointer *pdata;
+
+		g_ptr_array_set_size (raster->summaries, n_lines);
+
+		pdata = raster->summaries->pdata;
+		memmove (pdata + last + 1,
+		         pdata + old_last + 1,
+		         (old_n_lines - old_last - 1) * sizeof (gpointer));
+		memset (pdata + old_last + 1, 0, n_added * sizeof (gpointer));
+
+		invalidate_tiles_from (raster, first);
+	}
+
+	invalidate_lines (raster, first, last);
+	queue_draw (raster);
+}
+
+static guint16
+get_tag_color (GtkSourceMapRaster *raster,
+               GtkTextTag         *tag)
+{
+	GdkRGBA *rgba = NULL;
+	gboolean foreground_set = FALSE;
+	gpointer value;
+	guint16 color = 0;
+
+	if (g_hash_table_lookup_extended (raster->tag_colors, tag, NULL, &value))
+	{
+		return GPOINTER_TO_UINT (value);
+	}
+
+	g_object_get (tag,
+	              "foreground-set", &foreground_set,
+	              "foreground-rgba", &rgba,
+	              NULL);
+
+	if (foreground_set && rgba != NULL)
+	{
+		guint i;
+
+		for (i = 0; i < raster->palette->len; i++)
+		{
+			if (gdk_rgba_equal (&g_array_index (raster->palette, GdkRGBA, i), rgba))
+				break;
+		}
+
+		if (i == raster->palette->len && i < G_MAXUINT16 - 1)
+		{
+			g_array_append_val (raster->palette, *rgba);
+		}
+
+		if (i < raster->palette->len)
+		{
+			color = i + 1;
+		}
+	}
+
+	g_clear_pointer (&rgba, gdk_rgba_free);
+
+	g_hash_table_insert (raster->tag_colors,
+	                     g_object_ref (tag),
+	                     GUINT_TO_POINTER (color));
+
+	return color;
+}
+
+static void
+tag_changed_cb (GtkTextBuffer      *buffer,
+                GtkTextTag         *tag,
+                GtkTextIter        *start,
+                GtkTextIter        *end,
+                GtkSourceMapRaster *raster)
+{
+	/* The tags without a foreground, like the search matches, are not
+	 * drawn.
+	 */
+	if (get_tag_color (raster, tag) == 0)
+	{
+		return;
+	}
+
+	invalidate_lines (raster,
+	                  gtk_text_iter_get_line (start),
+	                  gtk_text_iter_get_line (end));
+	queue_draw (raster);
+}
+
+/* The color of the tag with the highest priority having a foreground. */
+static guint16
+get_color_at (GtkSourceMapRaster *raster,
+              const GtkTextIter  *iter)
+{
+	GSList *tags;
+	GSList *l;
+	guint16 color = 0;
+
+	tags = gtk_text_iter_get_tags (iter);
+
+	for (l = tags; l != NULL; l = l->next)
+	{
+		guint16 tag_color = get_tag_color (raster, l->data);
+
+		if (tag_color != 0)
+		{
+			color = tag_color;
+		}
+	}
+
+	g_slist_free (tags);
+
+	return color;
+}
+
+static LineSummary *
+summarize_line (GtkSourceMapRaster *raster,
+                guint               line)
+{
+	LineSummary *summary;
+	GtkTextIter iter;
+	GtkTextIter line_end;
+	guint column = 0;
+	gboolean in_run = FALSE;
+
+	g_array_set_size (raster->scratch, 0);
+
+	gtk_text_buffer_get_iter_at_line (raster->buffer, &iter, line);
+	line_end = iter;
+
+	if (!gtk_text_iter_ends_line (&line_end))
+	{
+		gtk_text_iter_forward_to_line_end (&line_end);
+	}
+
+	/* Walk the line by the segments between tag toggles, which all
+	 * have the same color.
+	 */
+	while (column < raster->max_columns &&
+	       gtk_text_iter_compare (&iter, &line_end) < 0)
+	{
+		GtkTextIter next = iter;
+		GtkTextIter limit = iter;
+		const char *p;
+		char *text;
+		guint16 color;
+
+		/* Each character takes at least one column. */
+		gtk_text_iter_forward_chars (&limit, raster->max_columns - column);
+
+		if (!gtk_text_iter_forward_to_tag_toggle (&next, NULL) ||
+		    gtk_text_iter_compare (&next, &line_end) > 0)
+		{
+			next = line_end;
+		}
+
+		if (gtk_text_iter_compare (&next, &limit) > 0)
+		{
+			next = limit;
+		}
+
+		color = get_color_at (raster, &iter);
+		text = gtk_text_iter_get_slice (&iter, &next);
+
+		for (p = text;
+		     *p != '\0' && column < raster->max_columns;
+		     p = g_utf8_next_char (p))
+		{
+			gunichar ch = g_utf8_get_char (p);
+
+			if (ch == '\t')
+			{
+				column = (column / raster->tab_width + 1) * raster->tab_width;
+				in_run = FALSE;
+			}
+			else if (g_unichar_isspace (ch))
+			{
+				column++;
+				in_run = FALSE;
+			}
+			else
+			{
+				Run *last = NULL;
+
+				if (in_run)
+				{
+					last = &g_array_index (raster->scratch, Run, raster->scratch->len - 1);
+				}
+
+				if (last != NULL && last->color == color)
+				{
+					last->length++;
+				}
+				else
+				{
+					Run run = { column, 1, color };
+
+					g_array_append_val (raster->scratch, run);
+				}
+
+				in_run = TRUE;
+				column++;
+			}
+		}
+
+		g_free (text);
+		iter = next;
+	}
+
+	summary = g_malloc (sizeof (LineSummary) + raster->scratch->len * sizeof (Run));
+	summary->n_runs = raster->scratch->len;
+	memcpy (summary->runs, raster->scratch->data, raster->scratch->len * sizeof (Run));
+
+	return summary;
+}
+
+static const LineSummary *
+ensure_summary (GtkSourceMapRaster *raster,
+                guint               line)
+{
+	LineSummary *summary = g_ptr_array_index (raster->summaries, line);
+
+	if (summary == NULL)
+	{
+		summary = summarize_line (raster, line);
+		g_ptr_array_index (raster->summaries, line) = summary;
+	}
+
+	return summary;
+}
+
+static const GdkRGBA *
+get_run_color (GtkSourceMapRaster *raster,
+               const Run          *run)
+{
+	if (run->color == 0)
+	{
+		return &raster->foreground;
+	}
+
+	return &g_array_index (raster->palette, GdkRGBA, run->color - 1);
+}
+
+static GskRenderNode *
+render_tile (GtkSourceMapRaster *raster,
+             guint               tile)
+{
+	GtkSnapshot *snapshot;
+	GskRenderNode *node;
+	guint first = tile * TILE_LINES;
+	guint last = MIN (first + TILE_LINES, raster->summaries->len);
+	float block_height;
+	guint line;
+
+	/* Leave a gap between the lines, like the BuilderBlocks font does. */
+	block_height = MAX (1.0, raster->row_height * .75);
+
+	snapshot = gtk_snapshot_new ();
+
+	for (line = first; line < last; line++)
+	{
+		const LineSummary *summary = ensure_summary (raster, line);
+		float y = (line - first) * raster->row_height;
+		guint i;
+
+		for (i = 0; i < summary->n_runs; i++)
+		{
+			const Run *run = &summary->runs[i];
+
+			gtk_snapshot_append_color (snapshot,
+			                           get_run_color (raster, run),
+			                           &GRAPHENE_RECT_INIT (run->column * raster->column_width,
+			                                                y,
+			                                                run->length * raster->column_width,
+			                                                block_height));
+		}
+	}
+
+	node = gtk_snapshot_free_to_node (snapshot);
+
+	/* Keep an empty node so that the tile is not drawn again. */
+	if (node == NULL)
+	{
+		node = gsk_container_node_new (NULL, 0);
+	}
+
+	return node;
+}
+
+GtkSourceMapRaster *
+_gtk_source_map_raster_new (GtkWidget *widget)
+{
+	GtkSourceMapRaster *raster;
+
+	g_return_val_if_fail (widget == NULL || GTK_IS_WIDGET (widget), NULL);
+
+	raster = g_slice_new0 (GtkSourceMapRaster);
+	raster->widget = widget;
+	raster->summaries = g_ptr_array_new_with_free_func (g_free);
+	raster->tiles = g_ptr_array_new_with_free_func (tile_free);
+	raster->palette = g_array_new (FALSE, FALSE, sizeof (GdkRGBA));
+	raster->tag_colors = g_hash_table_new_full (NULL, NULL, g_object_unref, NULL);
+	raster->scratch = g_array_new (FALSE, FALSE, sizeof (Run));
+	raster->foreground = (GdkRGBA) { 0., 0., 0., 1. };
+	raster->column_width = 1.;
+	raster->row_height = 1.;
+	raster->max_columns = 80;
+	raster->tab_width = 8;
+
+	return raster;
+}
+
+void
+_gtk_source_map_raster_free (GtkSourceMapRaster *raster)
+{
+	if (raster != NULL)
+	{
+		_gtk_source_map_raster_set_buffer (raster, NULL);
+
+		g_ptr_array_unref (raster->summaries);
+		g_ptr_array_unref (raster->tiles);
+		g_array_unref (raster->palette);
+		g_hash_table_unref (raster->tag_colors);
+		g_array_unref (raster->scratch);
+
+		g_slice_free (GtkSourceMapRaster, raster);
+	}
+}
+
+void
+_gtk_source_map_raster_set_buffer (GtkSourceMapRaster *raster,
+                                   GtkTextBuffer      *buffer)
+{
+	g_return_if_fail (raster != NULL);
+	g_return_if_fail (buffer == NULL || GTK_IS_TEXT_BUFFER (buffer));
+
+	if (raster->buffer == buffer)
+	{
+		return;
+	}
+
+	if (raster->buffer != NULL)
+	{
+		if (GTK_SOURCE_IS_BUFFER (raster->buffer))
+		{
+			g_clear_signal_handler (&raster->text_replaced_handler,
+			                        _gtk_source_buffer_internal_get_from_buffer (GTK_SOURCE_BUFFER (raster->buffer)));
+		}
+
+		g_clear_signal_handler (&raster->insert_text_handler, raster->buffer);
+		g_clear_signal_handler (&raster->delete_range_handler, raster->buffer);
+		g_clear_signal_handler (&raster->apply_tag_handler, raster->buffer);
+		g_clear_signal_handler (&raster->remove_tag_handler, raster->buffer);
+		g_clear_object (&raster->buffer);
+	}
+
+	/* The tags belong to the buffer. */
+	g_hash_table_remove_all (raster->tag_colors);
+	g_array_set_size (raster->palette, 0);
+
+	if (buffer != NULL)
+	{
+		raster->buffer = g_object_ref (buffer);
+
+		/* After the default handlers, once the buffer is modified. */
+		raster->insert_text_handler =
+			g_signal_connect_after (buffer,
+			                        "insert-text",
+			                        G_CALLBACK (insert_text_cb),
+			                        raster);
+
+		raster->delete_range_handler =
+			g_signal_connect_after (buffer,
+			                        "delete-range",
+			                        G_CALLBACK (delete_range_cb),
+			                        raster);
+
+		raster->apply_tag_handler =
+			g_signal_connect_after (buffer,
+			                        "apply-tag",
+			                        G_CALLBACK (tag_changed_cb),
+			                        raster);
+
+		raster->remove_tag_handler =
+			g_signal_connect_after (buffer,
+			                        "remove-tag",
+			                        G_CALLBACK (tag_changed_cb),
+			                        raster);
+
+		if (GTK_SOURCE_IS_BUFFER (buffer))
+		{
+			raster->text_replaced_handler =
+				g_signal_connect (_gtk_source_buffer_internal_get_from_buffer (GTK_SOURCE_BUFFER (buffer)),
+				                  "text-replaced",
+				                  G_CALLBACK (text_replaced_cb),
+				                  raster);
+		}
+	}
+
+	reset_lines (raster);
+}
+
+void
+_gtk_source_map_raster_set_tab_width (GtkSourceMapRaster *raster,
+                                      guint               tab_width)
+{
+	g_return_if_fail (raster != NULL);
+
+	tab_width = MAX (tab_width, 1);
+
+	if (raster->tab_width != tab_width)
+	{
+		raster->tab_width = tab_width;
+		clear_summaries (raster);
+		g_ptr_array_set_size (raster->tiles, 0);
+	}
+}
+
+/**
+ * _gtk_source_map_raster_set_metrics:
+ * @raster: a #GtkSourceMapRaster.
+ * @column_width: the width of a column, in pixels.
+ * @row_height: the height of a line, in pixels.
+ * @max_columns: the number of columns to summarize.
+ *
+ * Sets the size of the blocks drawn for the characters. This does not
+ * queue a redraw, so it can be called when drawing.
+ */
+void
+_gtk_source_map_raster_set_metrics (GtkSourceMapRaster *raster,
+                                    double              column_width,
+                                    double              row_height,
+                                    guint               max_columns)
+{
+	g_return_if_fail (raster != NULL);
+	g_return_if_fail (column_width > 0);
+	g_return_if_fail (row_height > 0);
+
+	max_columns = CLAMP (max_columns, 1, G_MAXUINT16);
+
+	if (raster->max_columns != max_columns)
+	{
+		raster->max_columns = max_columns;
+		clear_summaries (raster);
+		g_ptr_array_set_size (raster->tiles, 0);
+	}
+
+	if (raster->column_width != column_width ||
+	    raster->row_height != row_height)
+	{
+		raster->column_width = column_width;
+		raster->row_height = row_height;
+		g_ptr_array_set_size (raster->tiles, 0);
+	}
+}
+
+/**
+ * _gtk_source_map_raster_set_foreground:
+ * @raster: a #GtkSourceMapRaster.
+ * @foreground: the color of the text without a foreground tag.
+ *
+ * This does not queue a redraw, so it can be called when drawing.
+ */
+void
+_gtk_source_map_raster_set_foreground (GtkSourceMapRaster *raster,
+                                       const GdkRGBA      *foreground)
+{
+	g_return_if_fail (raster != NULL);
+	g_return_if_fail (foreground != NULL);
+
+	if (!gdk_rgba_equal (&raster->foreground, foreground))
+	{
+		raster->foreground = *foreground;
+		g_ptr_array_set_size (raster->tiles, 0);
+	}
+}
+
+/**
+ * _gtk_source_map_raster_invalidate:
+ * @raster: a #GtkSourceMapRaster.
+ *
+ * Summarizes all the lines again, for example because the colors of the
+ * tags changed with the style scheme.
+ */
+void
+_gtk_source_map_raster_invalidate (GtkSourceMapRaster *raster)
+{
+	g_return_if_fail (raster != NULL);
+
+	g_hash_table_remove_all (raster->tag_colors);
+	g_array_set_size (raster->palette, 0);
+	clear_summaries (raster);
+	g_ptr_array_set_size (raster->tiles, 0);
+
+	queue_draw (raster);
+}
+
+guint
+_gtk_source_map_raster_get_n_lines (GtkSourceMapRaster *raster)
+{
+	g_return_val_if_fail (raster != NULL, 0);
+
+	return raster->summaries->len;
+}
+
+/**
+ * _gtk_source_map_raster_is_cached:
+ * @raster: a #GtkSourceMapRaster.
+ * @line: a line number.
+ *
+ * Returns: whether the summary of @line is up to date.
+ */
+gboolean
+_gtk_source_map_raster_is_cached (GtkSourceMapRaster *raster,
+                                  guint               line)
+{
+	g_return_val_if_fail (raster != NULL, FALSE);
+
+	return line < raster->summaries->len &&
+	       g_ptr_array_index (raster->summaries, line) != NULL;
+}
+
+guint
+_gtk_source_map_raster_get_n_runs (GtkSourceMapRaster *raster,
+                                   guint               line)
+{
+	g_return_val_if_fail (raster != NULL, 0);
+
+	if (line >= raster->summaries->len)
+	{
+		return 0;
+	}
+
+	return ensure_summary (raster, line)->n_runs;
+}
+
+/**
+ * _gtk_source_map_raster_get_run:
+ * @raster: a #GtkSourceMapRaster.
+ * @line: a line number.
+ * @n: the index of the run in the line.
+ * @column: (out) (optional): return location for the first column.
+ * @length: (out) (optional): return location for the number of columns.
+ * @color: (out) (optional): return location for the color.
+ *
+ * Returns: whether @line has more than @n runs of non-blank characters.
+ */
+gboolean
+_gtk_source_map_raster_get_run (GtkSourceMapRaster *raster,
+                                guint               line,
+                                guint               n,
+                                guint              *column,
+                                guint              *length,
+                                GdkRGBA            *color)
+{
+	const LineSummary *summary;
+
+	g_return_val_if_fail (raster != NULL, FALSE);
+
+	if (line >= raster->summaries->len)
+	{
+		return FALSE;
+	}
+
+	summary = ensure_summary (raster, line);
+
+	if (n >= summary->n_runs)
+	{
+		return FALSE;
+	}
+
+	if (column != NULL)
+		*column = summary->runs[n].column;
+	if (length != NULL)
+		*length = summary->runs[n].length;
+	if (color != NULL)
+		*color = *get_run_color (raster, &summary->runs[n]);
+
+	return TRUE;
+}
+
+/**
+ * _gtk_source_map_raster_snapshot:
+ * @raster: a #GtkSourceMapRaster.
+ * @snapshot: a #GtkSnapshot.
+ * @y_offset: the position of the area to draw from the top of the first
+ *   line, in pixels. It is negative if the area starts above it.
+ * @width: the width of the area to draw.
+ * @height: the height of the area to draw.
+ *
+ * Draws the lines in the area at (0, 0), and asks the buffer to highlight
+ * them.
+ */
+void
+_gtk_source_map_raster_snapshot (GtkSourceMapRaster *raster,
+                                 GtkSnapshot        *snapshot,
+                                 double              y_offset,
+                                 int                 width,
+                                 int                 height)
+{
+	guint n_lines;
+	guint first_line;
+	guint last_line;
+	guint tile;
+
+	g_return_if_fail (raster != NULL);
+	g_return_if_fail (GTK_IS_SNAPSHOT (snapshot));
+
+	n_lines = raster->summaries->len;
+
+	if (raster->buffer == NULL || n_lines == 0 || width <= 0 || height <= 0)
+	{
+		return;
+	}
+
+	first_line = MIN (MAX (y_offset, 0.) / raster->row_height, n_lines - 1);
+	last_line = MIN (MAX (y_offset + height, 0.) / raster->row_height, n_lines - 1);
+
+	if (GTK_SOURCE_IS_BUFFER (raster->buffer))
+	{
+		GtkTextIter start;
+		GtkTextIter end;
+
+		gtk_text_buffer_get_iter_at_line (raster->buffer, &start, first_line);
+		gtk_text_buffer_get_iter_at_line (raster->buffer, &end, last_line);
+
+		if (!gtk_text_iter_ends_line (&end))
+		{
+			gtk_text_iter_forward_to_line_end (&end);
+		}
+
+		_gtk_source_buffer_update_syntax_highlight (GTK_SOURCE_BUFFER (raster->buffer),
+		                                            &start,
+		                                            &end,
+		                                            FALSE);
+	}
+
+	if (raster->tiles->len < (n_lines + TILE_LINES - 1) / TILE_LINES)
+	{
+		g_ptr_array_set_size (raster->tiles, (n_lines + TILE_LINES - 1) / TILE_LINES);
+	}
+
+	gtk_snapshot_push_clip (snapshot, &GRAPHENE_RECT_INIT (0, 0, width, height));
+
+	for (tile = first_line / TILE_LINES; tile <= last_line / TILE_LINES; tile++)
+	{
+		GskRenderNode *node = g_ptr_array_index (raster->tiles, tile);
+
+		if (node == NULL)
+		{
+			node = render_tile (raster, tile);
+			g_ptr_array_index (raster->tiles, tile) = node;
+		}
+
+		gtk_snapshot_save (snapshot);
+		gtk_snapshot_translate (snapshot,
+		                        &GRAPHENE_POINT_INIT (0, (double)tile * TILE_LINES * raster->row_height - y_offset));
+		gtk_snapshot_append_node (snapshot, node);
+		gtk_snapshot_restore (snapshot);
+	}
+
+	gtk_snapshot_pop (snapshot);
+}
@@ -0,0 +1,61 @@
+/*
+ * This file is part of GtkSourceView
+ *
+ * GtkSourceView is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GtkSourceView is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include "gtksourcetypes-private.h"
+
+G_BEGIN_DECLS
+
+GTK_SOURCE_INTERNAL
+GtkSourceOccurrenceIndex *_gtk_source_occurrence_index_new          (void);
+GTK_SOURCE_INTERNAL
+void                      _gtk_source_occurrence_index_free         (GtkSourceOccurrenceIndex *index);
+GTK_SOURCE_INTERNAL
+void                      _gtk_source_occurrence_index_clear        (GtkSourceOccurrenceIndex *index);
+GTK_SOURCE_INTERNAL
+guint                     _gtk_source_occurrence_index_get_count    (GtkSourceOccurrenceIndex *index);
+GTK_SOURCE_INTERNAL
+void                      _gtk_source_occurrence_index_add          (GtkSourceOccurrenceIndex *index,
+                                                                     gint                      start,
+                                                                     gint                      end);
+GTK_SOURCE_INTERNAL
+guint                     _gtk_source_occurrence_index_remove_range (GtkSourceOccurrenceIndex *index,
+                                                                     gint                      start,
+                                                                     gint                      end);
+GTK_SOURCE_INTERNAL
+void                      _gtk_source_occurrence_index_shift        (GtkSourceOccurrenceIndex *index,
+                                                                     gint                      offset,
+                                                                     gint                      delta);
+GTK_SOURCE_INTERNAL
+guint                     _gtk_source_occurrence_index_count_before (GtkSourceOccurrenceIndex *index,
+                                                                     gint                      offset);
+GTK_SOURCE_INTERNAL
+gboolean                  _gtk_source_occurrence_index_get_nth      (GtkSourceOccurrenceIndex *index,
+                                                                     guint                     n,
+                                                                     gint                     *start,
+                                                                     gint                     *end);
+GTK_SOURCE_INTERNAL
+guint                     _gtk_source_occurrence_index_get_position (GtkSourceOccurrenceIndex *index,
+                                                                     gint                      start,
+                                                                     gint                      end);
+
+G_END_DECLS
@@ -0,0 +1,390 @@
+/*
+ * This file is part of GtkSourceView
+ *
+ * GtkSourceView is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GtkSourceView is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "gtksourceoccurrenceindex-private.h"
+
+/*
+ * Ordered set of the search occurrences of a GtkSourceSearchContext, as
+ * character offsets, which answers "how many occurrences before this one"
+ * and "which is the n-th occurrence" in O(log n).
+ *
+ * The occurrences never overlap, so they are sorted both by their start
+ * and by their end. They are packed in an array of Range, eight bytes
+ * each, with a gap somewhere in the middle, like the text of a gap
+ * buffer. The gap is moved where occurrences are added or removed, so a
+ * scan which adds them in order, or edits at the same place, only touch
+ * the ranges around the gap.
+ *
+ * When text is inserted or deleted, the offsets of all the following
+ * occurrences change. The gap is moved before the first of them, and
+ * the change is only added to @delta: the ranges after the gap are
+ * stored without it, and it is added or removed when the gap moves over
+ * them.
+ */
+
+#define MIN_SIZE 16
+
+typedef struct _Range Range;
+
+struct _Range
+{
+	gint start;
+	gint end;
+};
+
+struct _GtkSourceOccurrenceIndex
+{
+	Range *ranges;
+
+	/* Number of ranges allocated. */
+	guint size;
+
+	/* The gap is [gap_start; gap_end[. */
+	guint gap_start;
+	guint gap_end;
+
+	/* To add to the offsets of the ranges after the gap. */
+	gint delta;
+};
+
+static inline guint
+get_count (GtkSourceOccurrenceIndex *index)
+{
+	return index->size - (index->gap_end - index->gap_start);
+}
+
+static inline Range
+get_range (GtkSourceOccurrenceIndex *index,
+           guint                     n)
+{
+	Range range;
+
+	if (n < index->gap_start)
+	{
+		return index->ranges[n];
+	}
+
+	range = index->ranges[n + index->gap_end - index->gap_start];
+	range.start += index->delta;
+	range.end += index->delta;
+
+	return range;
+}
+
+/* The number of occurrences starting before @offset. */
+static guint
+lower_bound_start (GtkSourceOccurrenceIndex *index,
+                   gint                      offset)
+{
+	guint low = 0;
+	guint high = get_count (index);
+
+	while (low < high)
+	{
+		guint mid = low + (high - low) / 2;
+
+		if (get_range (index, mid).start < offset)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return low;
+}
+
+/* The number of occurrences ending before or at @offset. */
+static guint
+lower_bound_end (GtkSourceOccurrenceIndex *index,
+                 gint                      offset)
+{
+	guint low = 0;
+	guint high = get_count (index);
+
+	while (low < high)
+	{
+		guint mid = low + (high - low) / 2;
+
+		if (get_range (index, mid).end <= offset)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return low;
+}
+
+/* Moves the gap so that the @n first occurrences are before it. */
+static void
+move_gap (GtkSourceOccurrenceIndex *index,
+          guint                     n)
+{
+	while (index->gap_start > n)
+	{
+		Range *range;
+
+		index->gap_start--;
+		index->gap_end--;
+
+		range = &index->ranges[index->gap_end];
+		*range = index->ranges[index->gap_start];
+		range->start -= index->delta;
+		range->end -= index->delta;
+	}
+
+	while (index->gap_start < n)
+	{
+		Range *range;
+
+		range = &index->ranges[index->gap_start];
+		*range = index->ranges[index->gap_end];
+		range->start += index->delta;
+		range->end += index->delta;
+
+		index->gap_start++;
+		index->gap_end++;
+	}
+}
+
+static void
+grow (GtkSourceOccurrenceIndex *index)
+{
+	guint n_after = index->size - index->gap_end;
+	guint new_size = MAX (MIN_SIZE, index->size * 2);
+
+	index->ranges = g_renew (Range, index->ranges, new_size);
+
+	memmove (index->ranges + new_size - n_after,
+	         index->ranges + index->gap_end,
+	         n_after * sizeof (Range));
+
+	index->size = new_size;
+	index->gap_end = new_size - n_after;
+}
+
+GtkSourceOccurrenceIndex *
+_gtk_source_occurrence_index_new (void)
+{
+	return g_slice_new0 (GtkSourceOccurrenceIndex);
+}
+
+void
+_gtk_source_occurrence_index_free (GtkSourceOccurrenceIndex *index)
+{
+	if (index != NULL)
+	{
+		g_free (index->ranges);
+		g_slice_free (GtkSourceOccurrenceIndex, index);
+	}
+}
+
+void
+_gtk_source_occurrence_index_clear (GtkSourceOccurrenceIndex *index)
+{
+	g_return_if_fail (index != NULL);
+
+	g_clear_pointer (&index->ranges, g_free);
+	index->size = 0;
+	index->gap_start = 0;
+	index->gap_end = 0;
+	index->delta = 0;
+}
+
+guint
+_gtk_source_occurrence_index_get_count (GtkSourceOccurrenceIndex *index)
+{
+	g_return_val_if_fail (index != NULL, 0);
+
+	return get_count (index);
+}
+
+/**
+ * _gtk_source_occurrence_index_add:
+ * @index: a #GtkSourceOccurrenceIndex.
+ * @start: the start of the occurrence.
+ * @end: the end of the occurrence.
+ *
+ * Adds an occurrence, which must not overlap the ones of @index.
+ */
+void
+_gtk_source_occurrence_index_add (GtkSourceOccurrenceIndex *index,
+                                  gint                      start,
+                                  gint                      end)
+{
+	Range *range;
+
+	g_return_if_fail (index != NULL);
+	g_return_if_fail (start < end);
+
+	move_gap (index, lower_bound_start (index, start));
+
+	if (index->gap_start == index->gap_end)
+	{
+		grow (index);
+	}
+
+	range = &index->ranges[index->gap_start++];
+	range->start = start;
+	range->end = end;
+}
+
+/**
+ * _gtk_source_occurrence_index_remove_range:
+ * @index: a #GtkSourceOccurrenceIndex.
+ * @start: the start of the range.
+ * @end: the end of the range.
+ *
+ * Removes the occurrences overlapping [@start; @end], or containing
+ * @start if the range is empty.
+ *
+ * Returns: the number of occurrences removed.
+ */
+guint
+_gtk_source_occurrence_index_remove_range (GtkSourceOccurrenceIndex *index,
+                                           gint                      start,
+                                           gint                      end)
+{
+	guint first;
+	guint last;
+
+	g_return_val_if_fail (index != NULL, 0);
+	g_return_val_if_fail (start <= end, 0);
+
+	first = lower_bound_end (index, start);
+	last = lower_bound_start (index, end);
+
+	if (last <= first)
+	{
+		return 0;
+	}
+
+	/* The removed occurrences become part of the gap. */
+	move_gap (index, last);
+	index->gap_start = first;
+
+	return last - first;
+}
+
+/**
+ * _gtk_source_occurrence_index_shift:
+ * @index: a #GtkSourceOccurrenceIndex.
+ * @offset: an offset.
+ * @delta: the number of characters inserted or, if negative, deleted at
+ *   @offset.
+ *
+ * Moves the occurrences starting at or after @offset by @delta. The
+ * occurrences in the deleted text must have been removed.
+ */
+void
+_gtk_source_occurrence_index_shift (GtkSourceOccurrenceIndex *index,
+                                    gint                      offset,
+                                    gint                      delta)
+{
+	g_return_if_fail (index != NULL);
+
+	if (delta == 0)
+		return;
+
+	move_gap (index, lower_bound_start (index, offset));
+	index->delta += delta;
+}
+
+/**
+ * _gtk_source_occurrence_index_count_before:
+ * @index: a #GtkSourceOccurrenceIndex.
+ * @offset: an offset.
+ *
+ * Returns: the number of occurrences starting before @offset.
+ */
+guint
+_gtk_source_occurrence_index_count_before (GtkSourceOccurrenceIndex *index,
+                                           gint                      offset)
+{
+	g_return_val_if_fail (index != NULL, 0);
+
+	return lower_bound_start (index, offset);
+}
+
+/**
+ * _gtk_source_occurrence_index_get_nth:
+ * @index: a #GtkSourceOccurrenceIndex.
+ * @n: the position of the occurrence, starting at 0.
+ * @start: (out) (optional): return location for the start of the occurrence.
+ * @end: (out) (optional): return location for the end of the occurrence.
+ *
+ * Returns: whether there are more than @n occurrences.
+ */
+gboolean
+_gtk_source_occurrence_index_get_nth (GtkSourceOccurrenceIndex *index,
+                                      guint                     n,
+                                      gint                     *start,
+                                      gint                     *end)
+{
+	Range range;
+
+	g_return_val_if_fail (index != NULL, FALSE);
+
+	if (n >= get_count (index))
+	{
+		return FALSE;
+	}
+
+	range = get_range (index, n);
+
+	if (start != NULL)
+		*start = range.start;
+	if (end != NULL)
+		*end = range.end;
+
+	return TRUE;
+}
+
+/**
+ * _gtk_source_occurrence_index_get_position:
+ * @index: a #GtkSourceOccurrenceIndex.
+ * @start: the start of an occurrence.
+ * @end: the end of the occurrence.
+ *
+ * Returns: the position of the occurrence, starting at 1, or 0 if there
+ * is no such occurrence in @index.
+ */
+guint
+_gtk_source_occurrence_index_get_position (GtkSourceOccurrenceIndex *index,
+                                           gint                      start,
+                                           gint                      end)
+{
+	guint n;
+	Range range;
+
+	g_return_val_if_fail (index != NULL, 0);
+
+	n = lower_bound_start (index, start);
+
+	if (n >= get_count (index))
+	{
+		return 0;
+	}
+
+	range = get_range (index, n);
+
+	return range.start == start && range.end == end ? n + 1 : 0;
+}
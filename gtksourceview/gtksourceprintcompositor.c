@@ -66,6 +66,10 @@
 /* Number of pages paginated on each invocation of the paginate() method. */
 #define PAGINATION_CHUNK_SIZE 3
 
+/* Number of lines paginated on each invocation of the paginate() method,
+ * when the text is not wrapped. */
+#define PAGINATION_UNWRAPPED_CHUNK_SIZE 1000
+
 typedef enum _PaginatorState
 {
 	/* Initial state: properties can be changed only when the paginator
@@ -156,6 +160,16 @@ typedef struct
 
 	GHashTable              *ignored_tags;
 
+	/* Pango attributes of each tag, so that the tag properties are only
+	 * queried once per print job. */
+	GHashTable              *tag_attrs;
+
+	/* Height of the current page and extents of the body font in each
+	 * style and weight, kept between the chunks of the pagination when
+	 * the text is not wrapped. */
+	gdouble                  pagination_height;
+	GHashTable              *font_extents;
+
 #ifdef GTK_SOURCE_PROFILER_ENABLED
 	gint64                   pagination_timer;
 #endif
@@ -369,6 +383,8 @@ gtk_source_print_compositor_finalize (GObject *object)
 	GtkSourcePrintCompositorPrivate *priv = gtk_source_print_compositor_get_instance_private (compositor);
 
 	g_clear_pointer (&priv->ignored_tags, g_hash_table_unref);
+	g_clear_pointer (&priv->tag_attrs, g_hash_table_unref);
+	g_clear_pointer (&priv->font_extents, g_hash_table_unref);
 
 	if (priv->pages != NULL)
 		g_array_free (priv->pages, TRUE);
@@ -2165,6 +2181,116 @@ calculate_page_size_and_margins (GtkSourcePrintCompositor *compositor,
 	                         convert_to_mm (get_text_height (compositor), GTK_UNIT_POINTS));
 }
 
+typedef struct
+{
+	PangoAttribute *bg;
+	PangoAttribute *fg;
+	PangoAttribute *style;
+	PangoAttribute *ul;
+	PangoAttribute *weight;
+	PangoAttribute *st;
+} TagAttrs;
+
+static void
+tag_attrs_free (gpointer data)
+{
+	TagAttrs *tag_attrs = data;
+
+	g_clear_pointer (&tag_attrs->bg, pango_attribute_destroy);
+	g_clear_pointer (&tag_attrs->fg, pango_attribute_destroy);
+	g_clear_pointer (&tag_attrs->style, pango_attribute_destroy);
+	g_clear_pointer (&tag_attrs->ul, pango_attribute_destroy);
+	g_clear_pointer (&tag_attrs->weight, pango_attribute_destroy);
+	g_clear_pointer (&tag_attrs->st, pango_attribute_destroy);
+	g_free (tag_attrs);
+}
+
+static const TagAttrs *
+get_tag_attrs (GtkSourcePrintCompositor *compositor,
+               GtkTextTag               *tag)
+{
+	GtkSourcePrintCompositorPrivate *priv = gtk_source_print_compositor_get_instance_private (compositor);
+	TagAttrs *tag_attrs;
+	gboolean bg_set, fg_set, style_set, ul_set, weight_set, st_set;
+
+	if (priv->tag_attrs == NULL)
+	{
+		priv->tag_attrs = g_hash_table_new_full (NULL, NULL, g_object_unref, tag_attrs_free);
+	}
+
+	tag_attrs = g_hash_table_lookup (priv->tag_attrs, tag);
+
+	if (tag_attrs != NULL)
+	{
+		return tag_attrs;
+	}
+
+	tag_attrs = g_new0 (TagAttrs, 1);
+
+	g_object_get (tag,
+		     "background-set", &bg_set,
+		     "foreground-set", &fg_set,
+		     "style-set", &style_set,
+		     "underline-set", &ul_set,
+		     "weight-set", &weight_set,
+		     "strikethrough-set", &st_set,
+		     NULL);
+
+	if (bg_set)
+	{
+		GdkRGBA *color = NULL;
+
+		g_object_get (tag, "background-rgba", &color, NULL);
+		tag_attrs->bg = pango_attr_background_new (color->red * 65535,
+							   color->green * 65535,
+							   color->blue * 65535);
+		gdk_rgba_free (color);
+	}
+
+	if (fg_set)
+	{
+		GdkRGBA *color = NULL;
+
+		g_object_get (tag, "foreground-rgba", &color, NULL);
+		tag_attrs->fg = pango_attr_foreground_new (color->red * 65535,
+							   color->green * 65535,
+							   color->blue * 65535);
+		gdk_rgba_free (color);
+	}
+
+	if (style_set)
+	{
+		PangoStyle style_value;
+		g_object_get (tag, "style", &style_value, NULL);
+		tag_attrs->style = pango_attr_style_new (style_value);
+	}
+
+	if (ul_set)
+	{
+		PangoUnderline underline;
+		g_object_get (tag, "underline", &underline, NULL);
+		tag_attrs->ul = pango_attr_underline_new (underline);
+	}
+
+	if (weight_set)
+	{
+		PangoWeight weight_value;
+		g_object_get (tag, "weight", &weight_value, NULL);
+		tag_attrs->weight = pango_attr_weight_new (weight_value);
+	}
+
+	if (st_set)
+	{
+		gboolean strikethrough;
+		g_object_get (tag, "strikethrough", &strikethrough, NULL);
+		tag_attrs->st = pango_attr_strikethrough_new (strikethrough);
+	}
+
+	g_hash_table_insert (priv->tag_attrs, g_object_ref (tag), tag_attrs);
+
+	return tag_attrs;
+}
+
 static gboolean
 ignore_tag (GtkSourcePrintCompositor *compositor,
             GtkTextTag               *tag)
@@ -2180,8 +2306,8 @@ get_iter_attrs (GtkSourcePrintCompositor *compositor,
 {
 	GSList *attrs = NULL;
 	GSList *tags;
-	PangoAttribute *bg = NULL, *fg = NULL, *style = NULL, *ul = NULL;
-	PangoAttribute *weight = NULL, *st = NULL;
+	const PangoAttribute *bg = NULL, *fg = NULL, *style = NULL, *ul = NULL;
+	const PangoAttribute *weight = NULL, *st = NULL;
 
 	tags = gtk_text_iter_get_tags (iter);
 	gtk_text_iter_forward_to_tag_toggle (iter, NULL);
@@ -2189,10 +2315,11 @@ get_iter_attrs (GtkSourcePrintCompositor *compositor,
 	if (gtk_text_iter_compare (iter, limit) > 0)
 		*iter = *limit;
 
+	/* Tags are sorted by priority, the last one wins. */
 	while (tags)
 	{
 		GtkTextTag *tag;
-		gboolean bg_set, fg_set, style_set, ul_set, weight_set, st_set;
+		const TagAttrs *tag_attrs;
 
 		tag = tags->data;
 		tags = g_slist_delete_link (tags, tags);
@@ -2200,92 +2327,34 @@ get_iter_attrs (GtkSourcePrintCompositor *compositor,
 		if (ignore_tag (compositor, tag))
 			continue;
 
-		g_object_get (tag,
-			     "background-set", &bg_set,
-			     "foreground-set", &fg_set,
-			     "style-set", &style_set,
-			     "underline-set", &ul_set,
-			     "weight-set", &weight_set,
-			     "strikethrough-set", &st_set,
-			     NULL);
-
-		if (bg_set)
-		{
-			GdkRGBA *color = NULL;
-
-			if (bg != NULL)
-			{
-				pango_attribute_destroy (bg);
-			}
-
-			g_object_get (tag, "background-rgba", &color, NULL);
-			bg = pango_attr_background_new (color->red * 65535,
-							color->green * 65535,
-							color->blue * 65535);
-			gdk_rgba_free (color);
-		}
-
-		if (fg_set)
-		{
-			GdkRGBA *color = NULL;
-
-			if (fg != NULL)
-			{
-				pango_attribute_destroy (fg);
-			}
-
-			g_object_get (tag, "foreground-rgba", &color, NULL);
-			fg = pango_attr_foreground_new (color->red * 65535,
-							color->green * 65535,
-							color->blue * 65535);
-			gdk_rgba_free (color);
-		}
-
-		if (style_set)
-		{
-			PangoStyle style_value;
-			if (style) pango_attribute_destroy (style);
-			g_object_get (tag, "style", &style_value, NULL);
-			style = pango_attr_style_new (style_value);
-		}
-
-		if (ul_set)
-		{
-			PangoUnderline underline;
-			if (ul) pango_attribute_destroy (ul);
-			g_object_get (tag, "underline", &underline, NULL);
-			ul = pango_attr_underline_new (underline);
-		}
-
-		if (weight_set)
-		{
-			PangoWeight weight_value;
-			if (weight) pango_attribute_destroy (weight);
-			g_object_get (tag, "weight", &weight_value, NULL);
-			weight = pango_attr_weight_new (weight_value);
-		}
-
-		if (st_set)
-		{
-			gboolean strikethrough;
-			if (st) pango_attribute_destroy (st);
-			g_object_get (tag, "strikethrough", &strikethrough, NULL);
-			st = pango_attr_strikethrough_new (strikethrough);
-		}
+		tag_attrs = get_tag_attrs (compositor, tag);
+
+		if (tag_attrs->bg)
+			bg = tag_attrs->bg;
+		if (tag_attrs->fg)
+			fg = tag_attrs->fg;
+		if (tag_attrs->style)
+			style = tag_attrs->style;
+		if (tag_attrs->ul)
+			ul = tag_attrs->ul;
+		if (tag_attrs->weight)
+			weight = tag_attrs->weight;
+		if (tag_attrs->st)
+			st = tag_attrs->st;
 	}
 
 	if (bg)
-		attrs = g_slist_prepend (attrs, bg);
+		attrs = g_slist_prepend (attrs, pango_attribute_copy (bg));
 	if (fg)
-		attrs = g_slist_prepend (attrs, fg);
+		attrs = g_slist_prepend (attrs, pango_attribute_copy (fg));
 	if (style)
-		attrs = g_slist_prepend (attrs, style);
+		attrs = g_slist_prepend (attrs, pango_attribute_copy (style));
 	if (ul)
-		attrs = g_slist_prepend (attrs, ul);
+		attrs = g_slist_prepend (attrs, pango_attribute_copy (ul));
 	if (weight)
-		attrs = g_slist_prepend (attrs, weight);
+		attrs = g_slist_prepend (attrs, pango_attribute_copy (weight));
 	if (st)
-		attrs = g_slist_prepend (attrs, st);
+		attrs = g_slist_prepend (attrs, pango_attribute_copy (st));
 
 	return attrs;
 }
@@ -2309,6 +2378,57 @@ is_empty_line (const gchar *text)
 	return TRUE;
 }
 
+static PangoAttrList *
+get_paragraph_attrs (GtkSourcePrintCompositor *compositor,
+                     GtkTextIter              *start,
+                     GtkTextIter              *end)
+{
+	GtkSourcePrintCompositorPrivate *priv = gtk_source_print_compositor_get_instance_private (compositor);
+	PangoAttrList *attr_list;
+	GtkTextIter segm_start, segm_end;
+	int start_index;
+
+	attr_list = pango_attr_list_new ();
+
+	/* Make sure it is highlighted even if it was not shown yet */
+	gtk_source_buffer_ensure_highlight (priv->buffer,
+					    start,
+					    end);
+
+	segm_start = *start;
+	start_index = gtk_text_iter_get_line_index (start);
+
+	while (gtk_text_iter_compare (&segm_start, end) < 0)
+	{
+		GSList *attrs;
+		int si, ei;
+
+		segm_end = segm_start;
+		attrs = get_iter_attrs (compositor, &segm_end, end);
+		if (attrs)
+		{
+			si = gtk_text_iter_get_line_index (&segm_start) - start_index;
+			ei = gtk_text_iter_get_line_index (&segm_end) - start_index;
+		}
+
+		while (attrs)
+		{
+			PangoAttribute *a = attrs->data;
+
+			a->start_index = si;
+			a->end_index = ei;
+
+			pango_attr_list_insert (attr_list, a);
+
+			attrs = g_slist_delete_link (attrs, attrs);
+		}
+
+		segm_start = segm_end;
+	}
+
+	return attr_list;
+}
+
 static void
 layout_paragraph (GtkSourcePrintCompositor *compositor,
                   GtkTextIter              *start,
@@ -2327,6 +2447,7 @@ layout_paragraph (GtkSourcePrintCompositor *compositor,
 	    is_empty_line (text))
 	{
 		pango_layout_set_text (priv->layout, " ", 1);
+		pango_layout_set_attributes (priv->layout, NULL);
 		g_free (text);
 		return;
 	}
@@ -2336,54 +2457,11 @@ layout_paragraph (GtkSourcePrintCompositor *compositor,
 
 	if (priv->highlight_syntax)
 	{
-		PangoAttrList *attr_list = NULL;
-		GtkTextIter segm_start, segm_end;
-		int start_index;
+		PangoAttrList *attr_list;
 
-		/* Make sure it is highlighted even if it was not shown yet */
-		gtk_source_buffer_ensure_highlight (priv->buffer,
-						    start,
-						    end);
-
-		segm_start = *start;
-		start_index = gtk_text_iter_get_line_index (start);
-
-		while (gtk_text_iter_compare (&segm_start, end) < 0)
-		{
-			GSList *attrs;
-			int si, ei;
-
-			segm_end = segm_start;
-			attrs = get_iter_attrs (compositor, &segm_end, end);
-			if (attrs)
-			{
-				si = gtk_text_iter_get_line_index (&segm_start) - start_index;
-				ei = gtk_text_iter_get_line_index (&segm_end) - start_index;
-			}
-
-			while (attrs)
-			{
-				PangoAttribute *a = attrs->data;
-
-				a->start_index = si;
-				a->end_index = ei;
-
-				if (!attr_list)
-					attr_list = pango_attr_list_new ();
-
-				pango_attr_list_insert (attr_list, a);
-
-				attrs = g_slist_delete_link (attrs, attrs);
-			}
-
-			segm_start = segm_end;
-		}
-
-		pango_layout_set_attributes (priv->layout,
-					     attr_list);
-
-		if (attr_list)
-			pango_attr_list_unref (attr_list);
+		attr_list = get_paragraph_attrs (compositor, start, end);
+		pango_layout_set_attributes (priv->layout, attr_list);
+		pango_attr_list_unref (attr_list);
 	}
 }
 
@@ -2414,6 +2492,282 @@ set_pango_layouts_width (GtkSourcePrintCompositor *compositor)
 	}
 }
 
+static void
+finish_pagination (GtkSourcePrintCompositor *compositor)
+{
+	GtkSourcePrintCompositorPrivate *priv = gtk_source_print_compositor_get_instance_private (compositor);
+
+#ifdef GTK_SOURCE_PROFILER_ENABLED
+	if (GTK_SOURCE_PROFILER_ACTIVE)
+	{
+		gint64 duration = GTK_SOURCE_PROFILER_CURRENT_TIME - priv->pagination_timer;
+		char *message = g_strdup_printf ("Paginated in %lf seconds",
+						 (duration / 1000L) / (double)G_USEC_PER_SEC);
+		GTK_SOURCE_PROFILER_MARK (duration, "Print Pagination", message);
+		g_free (message);
+
+		for (guint i = 0; i < priv->pages->len; i += 1)
+		{
+			gint offset;
+			GtkTextIter iter;
+
+			offset = g_array_index (priv->pages, int, i);
+			gtk_text_buffer_get_iter_at_offset (GTK_TEXT_BUFFER (priv->buffer), &iter, offset);
+
+			GTK_SOURCE_PROFILER_LOG ("page %d starts at line %d (offset %d)",
+			                         i, gtk_text_iter_get_line (&iter), offset);
+		}
+	}
+#endif
+
+	priv->state = DONE;
+
+	priv->n_pages = priv->pages->len;
+
+	/* Remove the pagination mark */
+	if (priv->pagination_mark != NULL)
+	{
+		gtk_text_buffer_delete_mark (GTK_TEXT_BUFFER (priv->buffer),
+					     priv->pagination_mark);
+		priv->pagination_mark = NULL;
+	}
+}
+
+typedef struct
+{
+	gdouble ascent;
+	gdouble descent;
+} FontExtents;
+
+/* Returns the extents of the body font with the style and weight
+ * attributes @style and @weight, which may be NULL.
+ */
+static const FontExtents *
+get_font_extents (GtkSourcePrintCompositor *compositor,
+                  GHashTable               *cache,
+                  const PangoAttribute     *style,
+                  const PangoAttribute     *weight)
+{
+	GtkSourcePrintCompositorPrivate *priv = gtk_source_print_compositor_get_instance_private (compositor);
+	FontExtents *extents;
+	PangoAttrList *attr_list;
+	gdouble height;
+	guint key;
+
+	key = (style != NULL ? ((const PangoAttrInt *) style)->value + 1 : 0) |
+	      (weight != NULL ? ((const PangoAttrInt *) weight)->value << 2 : 0);
+
+	extents = g_hash_table_lookup (cache, GUINT_TO_POINTER (key));
+
+	if (extents != NULL)
+	{
+		return extents;
+	}
+
+	attr_list = pango_attr_list_new ();
+
+	if (style != NULL)
+	{
+		pango_attr_list_insert (attr_list, pango_attribute_copy (style));
+	}
+
+	if (weight != NULL)
+	{
+		pango_attr_list_insert (attr_list, pango_attribute_copy (weight));
+	}
+
+	pango_layout_set_text (priv->layout, " ", 1);
+	pango_layout_set_attributes (priv->layout, attr_list);
+	pango_attr_list_unref (attr_list);
+
+	get_layout_size (priv->layout, NULL, &height);
+
+	extents = g_new (FontExtents, 1);
+	extents->ascent = (gdouble) pango_layout_get_baseline (priv->layout) / PANGO_SCALE;
+	extents->descent = height - extents->ascent;
+
+	pango_layout_set_attributes (priv->layout, NULL);
+
+	g_hash_table_insert (cache, GUINT_TO_POINTER (key), extents);
+
+	return extents;
+}
+
+/* Returns the height of the paragraph [@start, @end] without wrapping.
+ * An ASCII paragraph only uses the body font, in the styles and weights of
+ * its attributes, and the height of its single line is then the largest
+ * ascent plus the largest descent of these fonts, which avoids laying it
+ * out. Other paragraphs may use fallback fonts, so they are laid out.
+ */
+static gdouble
+get_unwrapped_paragraph_height (GtkSourcePrintCompositor *compositor,
+                                GHashTable               *font_extents,
+                                GtkTextIter              *start,
+                                GtkTextIter              *end)
+{
+	GtkSourcePrintCompositorPrivate *priv = gtk_source_print_compositor_get_instance_private (compositor);
+	const FontExtents *extents;
+	gdouble ascent;
+	gdouble descent;
+	gdouble height;
+	gchar *text;
+
+	text = gtk_text_iter_get_slice (start, end);
+
+	/* Like in layout_paragraph(). */
+	if (gtk_text_iter_ends_line (start) ||
+	    is_empty_line (text) ||
+	    (g_str_is_ascii (text) && !priv->highlight_syntax))
+	{
+		extents = get_font_extents (compositor, font_extents, NULL, NULL);
+		height = extents->ascent + extents->descent;
+	}
+	else if (g_str_is_ascii (text))
+	{
+		PangoAttrList *attr_list;
+		PangoAttrIterator *attr_iter;
+		gsize length = strlen (text);
+
+		ascent = 0;
+		descent = 0;
+
+		attr_list = get_paragraph_attrs (compositor, start, end);
+		attr_iter = pango_attr_list_get_iterator (attr_list);
+
+		do
+		{
+			gint range_start;
+
+			pango_attr_iterator_range (attr_iter, &range_start, NULL);
+
+			if ((gsize) range_start >= length)
+			{
+				break;
+			}
+
+			extents = get_font_extents (compositor,
+						    font_extents,
+						    pango_attr_iterator_get (attr_iter, PANGO_ATTR_STYLE),
+						    pango_attr_iterator_get (attr_iter, PANGO_ATTR_WEIGHT));
+
+			ascent = MAX (ascent, extents->ascent);
+			descent = MAX (descent, extents->descent);
+		}
+		while (pango_attr_iterator_next (attr_iter));
+
+		pango_attr_iterator_destroy (attr_iter);
+		pango_attr_list_unref (attr_list);
+
+		height = ascent + descent;
+	}
+	else
+	{
+		layout_paragraph (compositor, start, end);
+		get_layout_size (priv->layout, NULL, &height);
+	}
+
+	g_free (text);
+
+	return height;
+}
+
+/* Without wrapping every paragraph is a single layout line, so a page
+ * never breaks inside a paragraph. The paragraphs are measured without
+ * laying them out when possible, PAGINATION_UNWRAPPED_CHUNK_SIZE lines
+ * at a time.
+ *
+ * Returns: whether the whole buffer has been paginated.
+ */
+static gboolean
+paginate_unwrapped (GtkSourcePrintCompositor *compositor)
+{
+	GtkSourcePrintCompositorPrivate *priv = gtk_source_print_compositor_get_instance_private (compositor);
+	GtkTextIter start;
+	GtkTextIter end;
+	gdouble text_height;
+	gint page_start_offset;
+	gint lines_count;
+	gboolean done;
+
+	g_assert (priv->wrap_mode == GTK_WRAP_NONE);
+
+	if (priv->pagination_mark == NULL)
+	{
+		gtk_text_buffer_get_start_iter (GTK_TEXT_BUFFER (priv->buffer), &start);
+
+		priv->pagination_mark = gtk_text_buffer_create_mark (GTK_TEXT_BUFFER (priv->buffer),
+								     NULL,
+								     &start,
+								     TRUE);
+
+		page_start_offset = gtk_text_iter_get_offset (&start);
+		g_array_append_val (priv->pages, page_start_offset);
+
+		priv->pagination_height = 0;
+		priv->font_extents = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+	}
+	else
+	{
+		gtk_text_buffer_get_iter_at_mark (GTK_TEXT_BUFFER (priv->buffer),
+						  &start,
+						  priv->pagination_mark);
+	}
+
+	gtk_text_buffer_get_end_iter (GTK_TEXT_BUFFER (priv->buffer), &end);
+	text_height = get_text_height (compositor);
+
+	/* Like in the wrapped pagination, a trailing newline doesn't start
+	 * a new page. */
+	done = gtk_text_iter_compare (&start, &end) >= 0;
+	lines_count = 0;
+
+	while (!done && (lines_count < PAGINATION_UNWRAPPED_CHUNK_SIZE))
+	{
+		GtkTextIter line_end;
+		gdouble line_height;
+
+		line_end = start;
+		if (!gtk_text_iter_ends_line (&line_end))
+			gtk_text_iter_forward_to_line_end (&line_end);
+
+		line_height = get_unwrapped_paragraph_height (compositor, priv->font_extents, &start, &line_end);
+
+		if (line_is_numbered (compositor, gtk_text_iter_get_line (&start)))
+		{
+			line_height = MAX (line_height, priv->line_numbers_height);
+		}
+
+#define EPS (.1)
+		/* A line taller than a page gets its own page. */
+		if (priv->pagination_height > 0 &&
+		    priv->pagination_height + line_height > text_height + EPS)
+		{
+			page_start_offset = gtk_text_iter_get_offset (&start);
+			g_array_append_val (priv->pages, page_start_offset);
+
+			priv->pagination_height = 0;
+		}
+#undef EPS
+
+		priv->pagination_height += line_height;
+		gtk_text_iter_forward_line (&start);
+
+		++lines_count;
+		done = gtk_text_iter_compare (&start, &end) >= 0;
+	}
+
+	gtk_text_buffer_move_mark (GTK_TEXT_BUFFER (priv->buffer),
+				   priv->pagination_mark,
+				   &start);
+
+	if (done)
+	{
+		g_clear_pointer (&priv->font_extents, g_hash_table_unref);
+	}
+
+	return done;
+}
+
 /* If you want
    to use the ::paginate signal to perform pagination in async way, it is suggested to
    ensure the buffer is not modified until pagination terminates. */
@@ -2561,6 +2915,18 @@ gtk_source_print_compositor_paginate (GtkSourcePrintCompositor *compositor,
 	g_return_val_if_fail (priv->state == PAGINATING, FALSE);
 	g_return_val_if_fail (priv->layout != NULL, FALSE);
 
+	if (priv->wrap_mode == GTK_WRAP_NONE)
+	{
+		done = paginate_unwrapped (compositor);
+
+		if (done)
+		{
+			finish_pagination (compositor);
+		}
+
+		return done;
+	}
+
 	if (priv->pagination_mark == NULL)
 	{
 		gtk_text_buffer_get_start_iter (GTK_TEXT_BUFFER (priv->buffer), &start);
@@ -2716,38 +3082,7 @@ gtk_source_print_compositor_paginate (GtkSourcePrintCompositor *compositor,
 
 	if (done)
 	{
-
-#ifdef GTK_SOURCE_PROFILER_ENABLED
-		if (GTK_SOURCE_PROFILER_ACTIVE)
-		{
-			gint64 duration = GTK_SOURCE_PROFILER_CURRENT_TIME - priv->pagination_timer;
-			char *message = g_strdup_printf ("Paginated in %lf seconds",
-							 (duration / 1000L) / (double)G_USEC_PER_SEC);
-			GTK_SOURCE_PROFILER_MARK (duration, "Print Pagination", message);
-			g_free (message);
-
-			for (guint i = 0; i < priv->pages->len; i += 1)
-			{
-				gint offset;
-				GtkTextIter iter;
-
-				offset = g_array_index (priv->pages, int, i);
-				gtk_text_buffer_get_iter_at_offset (GTK_TEXT_BUFFER (priv->buffer), &iter, offset);
-
-				GTK_SOURCE_PROFILER_LOG ("page %d starts at line %d (offset %d)",
-				                         i, gtk_text_iter_get_line (&iter), offset);
-			}
-		}
-#endif
-
-		priv->state = DONE;
-
-		priv->n_pages = priv->pages->len;
-
-		/* Remove the pagination mark */
-		gtk_text_buffer_delete_mark (GTK_TEXT_BUFFER (priv->buffer),
-					     priv->pagination_mark);
-		priv->pagination_mark = NULL;
+		finish_pagination (compositor);
 	}
 
 	return (done != FALSE);
@@ -3265,6 +3600,483 @@ gtk_source_print_compositor_draw_page (GtkSourcePrintCompositor *compositor,
 	}
 }
 
+typedef struct
+{
+	gchar         *text;
+	PangoAttrList *attrs;
+	gint           line_number;
+} RenderParagraph;
+
+typedef struct
+{
+	GArray          *paragraphs;
+	cairo_surface_t *recording;
+} RenderPage;
+
+typedef struct
+{
+	GtkSourcePrintCompositor *compositor;
+	GTask                    *task;
+	cairo_surface_t          *surface;
+
+	RenderPage               *pages;
+	guint                     n_pages;
+	gint                      first_page;
+	guint                     n_workers;
+	gint                      n_running_workers;
+
+	/* Copied from the layouts of the main thread, so that each worker
+	 * can create its own PangoContext with the same settings. */
+	PangoFontDescription     *body_font;
+	PangoFontDescription     *line_numbers_font;
+	PangoTabArray            *tabs;
+	cairo_font_options_t     *font_options;
+	PangoLanguage            *language;
+	gdouble                   resolution;
+	PangoWrapMode             wrap;
+	PangoEllipsizeMode        ellipsize;
+	gint                      width;
+	gint                      line_numbers_width;
+
+	gdouble                   x;
+	gdouble                   y;
+	gdouble                   ln_x;
+	gdouble                   line_numbers_height;
+} RenderJob;
+
+static void
+render_paragraph_clear (gpointer data)
+{
+	RenderParagraph *paragraph = data;
+
+	g_free (paragraph->text);
+	g_clear_pointer (&paragraph->attrs, pango_attr_list_unref);
+}
+
+static void
+render_job_free (RenderJob *job)
+{
+	guint i;
+
+	for (i = 0; i < job->n_pages; i++)
+	{
+		g_clear_pointer (&job->pages[i].paragraphs, g_array_unref);
+		g_clear_pointer (&job->pages[i].recording, cairo_surface_destroy);
+	}
+
+	g_free (job->pages);
+	g_clear_pointer (&job->surface, cairo_surface_destroy);
+	g_clear_pointer (&job->body_font, pango_font_description_free);
+	g_clear_pointer (&job->line_numbers_font, pango_font_description_free);
+	g_clear_pointer (&job->tabs, pango_tab_array_free);
+	g_clear_pointer (&job->font_options, cairo_font_options_destroy);
+	g_clear_object (&job->compositor);
+	g_free (job);
+}
+
+static void
+snapshot_page (GtkSourcePrintCompositor *compositor,
+               gint                      page_nr,
+               RenderPage               *page)
+{
+	GtkSourcePrintCompositorPrivate *priv = gtk_source_print_compositor_get_instance_private (compositor);
+	GtkTextIter start, end;
+	gint offset;
+
+	page->paragraphs = g_array_new (FALSE, TRUE, sizeof (RenderParagraph));
+	g_array_set_clear_func (page->paragraphs, render_paragraph_clear);
+
+	offset = g_array_index (priv->pages, int, page_nr);
+	gtk_text_buffer_get_iter_at_offset (GTK_TEXT_BUFFER (priv->buffer), &start, offset);
+
+	if ((guint) page_nr + 1 < priv->pages->len)
+	{
+		offset = g_array_index (priv->pages, int, page_nr + 1);
+		gtk_text_buffer_get_iter_at_offset (GTK_TEXT_BUFFER (priv->buffer), &end, offset);
+	}
+	else
+	{
+		gtk_text_buffer_get_end_iter (GTK_TEXT_BUFFER (priv->buffer), &end);
+	}
+
+	/* Same iteration as in draw_page(), only the text and attributes are
+	 * collected since the buffer can't be accessed from the workers. */
+	while (gtk_text_iter_compare (&start, &end) < 0)
+	{
+		RenderParagraph paragraph = { NULL, NULL, -1 };
+		GtkTextIter line_end;
+
+		line_end = start;
+		if (!gtk_text_iter_ends_line (&line_end))
+			gtk_text_iter_forward_to_line_end (&line_end);
+		if (gtk_text_iter_compare (&line_end, &end) > 0)
+			line_end = end;
+
+		if (gtk_text_iter_starts_line (&start) &&
+		    line_is_numbered (compositor, gtk_text_iter_get_line (&start)))
+		{
+			paragraph.line_number = gtk_text_iter_get_line (&start);
+		}
+
+		paragraph.text = gtk_text_iter_get_slice (&start, &line_end);
+
+		if (gtk_text_iter_ends_line (&start) || is_empty_line (paragraph.text))
+		{
+			g_free (paragraph.text);
+			paragraph.text = g_strdup (" ");
+		}
+		else if (priv->highlight_syntax)
+		{
+			paragraph.attrs = get_paragraph_attrs (compositor, &start, &line_end);
+		}
+
+		g_array_append_val (page->paragraphs, paragraph);
+
+		gtk_text_iter_forward_line (&start);
+	}
+}
+
+static PangoLayout *
+create_worker_layout (PangoContext               *context,
+                      const PangoFontDescription *font)
+{
+	PangoLayout *layout;
+
+	layout = pango_layout_new (context);
+	pango_layout_set_font_description (layout, font);
+
+	return layout;
+}
+
+static void
+render_page_body (RenderJob   *job,
+                  PangoLayout *layout,
+                  PangoLayout *line_numbers_layout,
+                  RenderPage  *page)
+{
+	cairo_t *cr;
+	gdouble y = job->y;
+	guint i;
+
+	page->recording = cairo_recording_surface_create (CAIRO_CONTENT_COLOR_ALPHA, NULL);
+	cr = cairo_create (page->recording);
+	cairo_set_source_rgb (cr, 0, 0, 0);
+
+	pango_cairo_update_layout (cr, layout);
+
+	if (line_numbers_layout != NULL)
+	{
+		pango_cairo_update_layout (cr, line_numbers_layout);
+	}
+
+	for (i = 0; i < page->paragraphs->len; i++)
+	{
+		const RenderParagraph *paragraph = &g_array_index (page->paragraphs, RenderParagraph, i);
+		gdouble line_height;
+		gdouble baseline_offset = 0;
+
+		pango_layout_set_text (layout, paragraph->text, -1);
+		pango_layout_set_attributes (layout, paragraph->attrs);
+
+		get_layout_size (layout, NULL, &line_height);
+
+		if (paragraph->line_number >= 0 && line_numbers_layout != NULL)
+		{
+			PangoLayoutIter *iter;
+			gdouble baseline;
+			gdouble ln_baseline;
+			gdouble ln_baseline_offset;
+			gchar *str;
+
+			str = g_strdup_printf ("%d", paragraph->line_number + 1);
+			pango_layout_set_text (line_numbers_layout, str, -1);
+			g_free (str);
+
+			iter = pango_layout_get_iter (layout);
+			baseline = (gdouble) pango_layout_iter_get_baseline (iter) / (gdouble) PANGO_SCALE;
+			pango_layout_iter_free (iter);
+
+			iter = pango_layout_get_iter (line_numbers_layout);
+			ln_baseline = (gdouble) pango_layout_iter_get_baseline (iter) / (gdouble) PANGO_SCALE;
+			pango_layout_iter_free (iter);
+
+			ln_baseline_offset = baseline - ln_baseline;
+
+			if (ln_baseline_offset < 0)
+			{
+				baseline_offset = -ln_baseline_offset;
+				ln_baseline_offset = 0;
+			}
+
+			cairo_move_to (cr, job->ln_x, y + ln_baseline_offset);
+			pango_cairo_show_layout (cr, line_numbers_layout);
+		}
+
+		cairo_move_to (cr, job->x, y + baseline_offset);
+		pango_cairo_show_layout (cr, layout);
+
+		y += MAX (line_height, job->line_numbers_height);
+	}
+
+	cairo_destroy (cr);
+}
+
+static gboolean
+render_pages_finish_cb (gpointer data)
+{
+	RenderJob *job = data;
+	GtkSourcePrintCompositorPrivate *priv = gtk_source_print_compositor_get_instance_private (job->compositor);
+	cairo_t *cr;
+	cairo_status_t status;
+	guint i;
+
+	if (g_task_return_error_if_cancelled (job->task))
+	{
+		goto cleanup;
+	}
+
+	cr = cairo_create (job->surface);
+
+	/* Headers and footers use the layouts of the main thread, they are
+	 * drawn while stitching the pages together. */
+	for (i = 0; i < job->n_pages; i++)
+	{
+		priv->current_page = job->first_page + i;
+
+		cairo_save (cr);
+		cairo_set_source_rgb (cr, 0, 0, 0);
+		cairo_translate (cr,
+				 -1 * priv->page_margin_left,
+				 -1 * priv->page_margin_top);
+
+		if (is_header_to_print (job->compositor))
+		{
+			print_header (job->compositor, cr);
+		}
+
+		if (is_footer_to_print (job->compositor))
+		{
+			print_footer (job->compositor, cr);
+		}
+
+		cairo_set_source_surface (cr, job->pages[i].recording, 0, 0);
+		cairo_paint (cr);
+		cairo_restore (cr);
+
+		cairo_show_page (cr);
+	}
+
+	cairo_destroy (cr);
+	cairo_surface_flush (job->surface);
+
+	status = cairo_surface_status (job->surface);
+
+	if (status != CAIRO_STATUS_SUCCESS)
+	{
+		g_task_return_new_error (job->task,
+		                         G_IO_ERROR,
+		                         G_IO_ERROR_FAILED,
+		                         "%s",
+		                         cairo_status_to_string (status));
+		goto cleanup;
+	}
+
+	g_task_return_boolean (job->task, TRUE);
+
+cleanup:
+	g_clear_object (&job->task);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+render_pages_worker (gpointer data,
+                     gpointer user_data)
+{
+	RenderJob *job = user_data;
+	guint worker = GPOINTER_TO_UINT (data) - 1;
+	GCancellable *cancellable;
+	PangoFontMap *font_map;
+	PangoContext *context;
+	PangoLayout *layout;
+	PangoLayout *line_numbers_layout = NULL;
+	guint i;
+
+	cancellable = g_task_get_cancellable (job->task);
+
+	/* Each thread has its own default font map. */
+	font_map = pango_cairo_font_map_get_default ();
+	context = pango_font_map_create_context (font_map);
+	pango_context_set_language (context, job->language);
+	pango_cairo_context_set_resolution (context, job->resolution);
+	pango_cairo_context_set_font_options (context, job->font_options);
+
+	layout = create_worker_layout (context, job->body_font);
+	pango_layout_set_width (layout, job->width);
+	pango_layout_set_wrap (layout, job->wrap);
+	pango_layout_set_ellipsize (layout, job->ellipsize);
+	pango_layout_set_tabs (layout, job->tabs);
+
+	if (job->line_numbers_font != NULL)
+	{
+		line_numbers_layout = create_worker_layout (context, job->line_numbers_font);
+		pango_layout_set_alignment (line_numbers_layout, PANGO_ALIGN_RIGHT);
+		pango_layout_set_width (line_numbers_layout, job->line_numbers_width);
+	}
+
+	/* Workers take every n_workers-th page. */
+	for (i = worker; i < job->n_pages; i += job->n_workers)
+	{
+		if (g_cancellable_is_cancelled (cancellable))
+		{
+			break;
+		}
+
+		render_page_body (job, layout, line_numbers_layout, &job->pages[i]);
+	}
+
+	g_clear_object (&line_numbers_layout);
+	g_object_unref (layout);
+	g_object_unref (context);
+
+	if (g_atomic_int_dec_and_test (&job->n_running_workers))
+	{
+		g_main_context_invoke_full (g_task_get_context (job->task),
+		                            G_PRIORITY_DEFAULT,
+		                            render_pages_finish_cb,
+		                            job,
+		                            (GDestroyNotify) render_job_free);
+	}
+}
+
+/**
+ * gtk_source_print_compositor_render_pages_async:
+ * @compositor: a #GtkSourcePrintCompositor.
+ * @surface: a #cairo_surface_t, for example a PDF, PostScript or SVG surface.
+ * @first_page: the number of the first page to render.
+ * @n_pages: the number of pages to render, or -1 to render until the last page.
+ * @cancellable: (nullable): optional #GCancellable object, %NULL to ignore.
+ * @callback: (scope async): a #GAsyncReadyCallback to call when the pages
+ *   have been rendered.
+ * @user_data: user data to pass to @callback.
+ *
+ * Renders a range of pages to @surface, one page of @surface for each page of
+ * the document, without a #GtkPrintOperation.
+ *
+ * The text and attributes of the pages are collected on the calling thread,
+ * then the pages are laid out and drawn in parallel by a pool of worker
+ * threads, each with its own #PangoContext. The pages are finally copied in
+ * order to @surface, together with the header and footer.
+ *
+ * The document must have been completely paginated with
+ * [method@PrintCompositor.paginate] beforehand, and the buffer must not be
+ * modified until the operation finishes. Since SVG surfaces only have one
+ * page, render one page at a time to those.
+ *
+ * Since: 5.22
+ */
+void
+gtk_source_print_compositor_render_pages_async (GtkSourcePrintCompositor *compositor,
+                                                cairo_surface_t          *surface,
+                                                gint                      first_page,
+                                                gint                      n_pages,
+                                                GCancellable             *cancellable,
+                                                GAsyncReadyCallback       callback,
+                                                gpointer                  user_data)
+{
+	GtkSourcePrintCompositorPrivate *priv = gtk_source_print_compositor_get_instance_private (compositor);
+	PangoContext *context;
+	const cairo_font_options_t *font_options;
+	GThreadPool *pool;
+	RenderJob *job;
+	guint i;
+
+	g_return_if_fail (GTK_SOURCE_IS_PRINT_COMPOSITOR (compositor));
+	g_return_if_fail (surface != NULL);
+	g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+	g_return_if_fail (priv->state == DONE);
+	g_return_if_fail (first_page >= 0 && first_page < priv->n_pages);
+
+	if (n_pages < 0 || n_pages > priv->n_pages - first_page)
+	{
+		n_pages = priv->n_pages - first_page;
+	}
+
+	job = g_new0 (RenderJob, 1);
+	job->compositor = g_object_ref (compositor);
+	job->task = g_task_new (compositor, cancellable, callback, user_data);
+	g_task_set_source_tag (job->task, gtk_source_print_compositor_render_pages_async);
+	job->surface = cairo_surface_reference (surface);
+	job->first_page = first_page;
+	job->n_pages = n_pages;
+	job->pages = g_new0 (RenderPage, n_pages);
+
+	for (i = 0; i < job->n_pages; i++)
+	{
+		snapshot_page (compositor, first_page + i, &job->pages[i]);
+	}
+
+	context = pango_layout_get_context (priv->layout);
+	font_options = pango_cairo_context_get_font_options (context);
+
+	job->body_font = pango_font_description_copy (priv->body_font);
+	job->tabs = pango_layout_get_tabs (priv->layout);
+	job->font_options = font_options != NULL ? cairo_font_options_copy (font_options) : cairo_font_options_create ();
+	job->language = pango_context_get_language (context);
+	job->resolution = pango_cairo_context_get_resolution (context);
+	job->wrap = pango_layout_get_wrap (priv->layout);
+	job->ellipsize = pango_layout_get_ellipsize (priv->layout);
+	job->width = pango_layout_get_width (priv->layout);
+
+	if (priv->line_numbers_layout != NULL)
+	{
+		job->line_numbers_font = pango_font_description_copy (priv->line_numbers_font);
+		job->line_numbers_width = pango_layout_get_width (priv->line_numbers_layout);
+	}
+
+	job->x = get_text_x (compositor);
+	job->y = get_text_y (compositor);
+	job->ln_x = get_line_numbers_x (compositor);
+	job->line_numbers_height = priv->line_numbers_height;
+
+	job->n_workers = CLAMP (g_get_num_processors (), 1, MAX (job->n_pages, 1));
+	job->n_running_workers = job->n_workers;
+
+	pool = g_thread_pool_new (render_pages_worker, job, job->n_workers, FALSE, NULL);
+
+	for (i = 0; i < job->n_workers; i++)
+	{
+		g_thread_pool_push (pool, GUINT_TO_POINTER (i + 1), NULL);
+	}
+
+	/* The pool is freed once the pushed workers are done. */
+	g_thread_pool_free (pool, FALSE, FALSE);
+}
+
+/**
+ * gtk_source_print_compositor_render_pages_finish:
+ * @compositor: a #GtkSourcePrintCompositor.
+ * @result: a #GAsyncResult.
+ * @error: a #GError, or %NULL.
+ *
+ * Finishes an operation started with
+ * [method@PrintCompositor.render_pages_async].
+ *
+ * Returns: %TRUE if the pages have been rendered.
+ *
+ * Since: 5.22
+ */
+gboolean
+gtk_source_print_compositor_render_pages_finish (GtkSourcePrintCompositor  *compositor,
+                                                 GAsyncResult              *result,
+                                                 GError                   **error)
+{
+	g_return_val_if_fail (GTK_SOURCE_IS_PRINT_COMPOSITOR (compositor), FALSE);
+	g_return_val_if_fail (g_task_is_valid (result, compositor), FALSE);
+
+	return g_task_propagate_boolean (G_TASK (result), error);
+}
+
 /**
  * gtk_source_print_compositor_ignore_tag:
  * @compositor: a #GtkSourcePrintCompositor
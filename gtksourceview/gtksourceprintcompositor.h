@@ -150,6 +150,18 @@ GTK_SOURCE_AVAILABLE_IN_ALL
 void                      gtk_source_print_compositor_draw_page                  (GtkSourcePrintCompositor *compositor,
                                                                                   GtkPrintContext          *context,
                                                                                   gint                      page_nr);
+GTK_SOURCE_AVAILABLE_IN_5_22
+void                      gtk_source_print_compositor_render_pages_async         (GtkSourcePrintCompositor *compositor,
+                                                                                  cairo_surface_t          *surface,
+                                                                                  gint                      first_page,
+                                                                                  gint                      n_pages,
+                                                                                  GCancellable             *cancellable,
+                                                                                  GAsyncReadyCallback       callback,
+                                                                                  gpointer                  user_data);
+GTK_SOURCE_AVAILABLE_IN_5_22
+gboolean                  gtk_source_print_compositor_render_pages_finish        (GtkSourcePrintCompositor *compositor,
+                                                                                  GAsyncResult             *result,
+                                                                                  GError                  **error);
 GTK_SOURCE_AVAILABLE_IN_5_2
 void                      gtk_source_print_compositor_ignore_tag                 (GtkSourcePrintCompositor *compositor,
                                                                                   GtkTextTag               *tag);
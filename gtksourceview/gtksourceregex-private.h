@@ -41,6 +41,15 @@ GtkSourceRegex *_gtk_source_regex_resolve         (GtkSourceRegex      *regex,
 GTK_SOURCE_INTERNAL
 gboolean        _gtk_source_regex_is_resolved     (GtkSourceRegex      *regex);
 GTK_SOURCE_INTERNAL
+gboolean        _gtk_source_regex_uses_offset     (GtkSourceRegex      *regex);
+GTK_SOURCE_INTERNAL
+gboolean        _gtk_source_regex_compile         (GtkSourceRegex      *regex,
+                                                   GError             **error);
+GTK_SOURCE_INTERNAL
+gboolean        _gtk_source_regex_is_compiled     (GtkSourceRegex      *regex);
+GTK_SOURCE_INTERNAL
+gboolean        _gtk_source_regex_is_jit_compiled (GtkSourceRegex      *regex);
+GTK_SOURCE_INTERNAL
 gboolean        _gtk_source_regex_match           (GtkSourceRegex      *regex,
                                                    const gchar         *line,
                                                    gint                 byte_length,
@@ -67,5 +76,7 @@ void            _gtk_source_regex_fetch_named_pos (GtkSourceRegex      *regex,
                                                    gint                *end_pos);
 GTK_SOURCE_INTERNAL
 const gchar    *_gtk_source_regex_get_pattern     (GtkSourceRegex      *regex);
+GTK_SOURCE_INTERNAL
+guint64         _gtk_source_regex_get_n_matches   (void);
 
 G_END_DECLS
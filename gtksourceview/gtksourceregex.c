@@ -32,8 +32,19 @@
 /*
  * ImplRegex wrapper which adds a few features needed for syntax highlighting,
  * in particular resolving "\%{...@start}" and forbidding the use of \C.
+ *
+ * Most of the regexes of a language definition are never used for a given
+ * file, so they are only compiled the first time they are matched, and JIT
+ * compiled once they have been matched JIT_THRESHOLD times.
  */
 
+#define JIT_THRESHOLD 64
+
+/* Number of calls to _gtk_source_regex_match(), for the benchmarks. Only
+ * the context engine matches, from the main thread.
+ */
+static guint64 n_matches_total;
+
 /* Regex used to match "\%{...@start}". */
 static ImplRegex *
 get_start_ref_regex (void)
@@ -51,31 +62,31 @@ get_start_ref_regex (void)
 
 struct _GtkSourceRegex
 {
-	union {
-		struct {
-			gchar *pattern;
-			GRegexCompileFlags flags;
-		} info;
-		struct {
-			ImplRegex *regex;
-			ImplMatchInfo *match;
-		} regex;
-	} u;
+	/* The pattern, until the regex is compiled. */
+	gchar *pattern;
+	GRegexCompileFlags flags;
+
+	/* NULL until the regex is matched for the first time. */
+	ImplRegex *regex;
+	ImplMatchInfo *match;
+
+	guint n_matches;
 
 	guint ref_count;
 	guint resolved : 1;
+	guint failed : 1;
+	guint uses_offset : 1;
 };
 
-/* Check whether pattern contains \C escape sequence,
- * which means "single byte" in pcre and naturally leads
- * to crash if used for highlighting.
- */
+/* Check whether pattern contains an unescaped backslash followed by @c. */
 static gboolean
-find_single_byte_escape (const gchar *string)
+find_escape (const gchar *string,
+             gchar        c)
 {
+	const char escape[] = { '\\', c, '\0' };
 	const char *p = string;
 
-	while ((p = strstr (p, "\\C")))
+	while ((p = strstr (p, escape)))
 	{
 		const char *slash;
 		gboolean found;
@@ -107,7 +118,9 @@ find_single_byte_escape (const gchar *string)
  * @flags: compile options for @pattern.
  * @error: location to store the error occurring, or %NULL to ignore errors.
  *
- * Creates a new regex.
+ * Creates a new regex. The pattern is compiled when the regex is first
+ * matched, so only the use of \C is reported in @error, see
+ * _gtk_source_regex_compile().
  *
  * Returns: a newly-allocated #GtkSourceRegex.
  */
@@ -121,7 +134,10 @@ _gtk_source_regex_new (const gchar         *pattern,
 	g_return_val_if_fail (pattern != NULL, NULL);
 	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
 
-	if (find_single_byte_escape (pattern))
+	/* \C means "single byte" in pcre and naturally leads to crash
+	 * if used for highlighting.
+	 */
+	if (find_escape (pattern, 'C'))
 	{
 		g_set_error_literal (error, G_REGEX_ERROR,
 		                     G_REGEX_ERROR_COMPILE,
@@ -131,28 +147,88 @@ _gtk_source_regex_new (const gchar         *pattern,
 
 	regex = g_slice_new0 (GtkSourceRegex);
 	regex->ref_count = 1;
+	regex->pattern = g_strdup (pattern);
+	regex->flags = flags;
+	regex->resolved = !impl_regex_match (get_start_ref_regex (), pattern, 0, NULL);
+	regex->uses_offset = find_escape (pattern, 'G');
 
-	if (impl_regex_match (get_start_ref_regex (), pattern, 0, NULL))
+	return regex;
+}
+
+static gboolean
+ensure_compiled (GtkSourceRegex  *regex,
+                 GError         **error)
+{
+	g_assert (regex->resolved);
+
+	if (regex->regex != NULL)
+		return TRUE;
+
+	if (regex->failed)
 	{
-		regex->resolved = FALSE;
-		regex->u.info.pattern = g_strdup (pattern);
-		regex->u.info.flags = flags;
+		g_set_error (error, G_REGEX_ERROR, G_REGEX_ERROR_COMPILE,
+		             "the pattern %s was already found invalid",
+		             regex->pattern);
+		return FALSE;
 	}
-	else
-	{
-		regex->resolved = TRUE;
-		regex->u.regex.regex = impl_regex_new (pattern,
-		                                       flags | G_REGEX_OPTIMIZE | G_REGEX_NEWLINE_LF, 0,
-		                                       error);
 
-		if (regex->u.regex.regex == NULL)
-		{
-			g_slice_free (GtkSourceRegex, regex);
-			regex = NULL;
-		}
+	regex->regex = impl_regex_new (regex->pattern,
+	                               regex->flags | G_REGEX_NEWLINE_LF, 0,
+	                               error);
+
+	if (regex->regex == NULL)
+	{
+		regex->failed = TRUE;
+		return FALSE;
 	}
 
-	return regex;
+	g_clear_pointer (&regex->pattern, g_free);
+
+	return TRUE;
+}
+
+/**
+ * _gtk_source_regex_compile:
+ * @regex: a resolved #GtkSourceRegex.
+ * @error: location to store the error occurring, or %NULL to ignore errors.
+ *
+ * Compiles @regex now instead of when it is first matched, to check
+ * whether the pattern is valid.
+ *
+ * Returns: whether @regex is valid.
+ */
+gboolean
+_gtk_source_regex_compile (GtkSourceRegex  *regex,
+                           GError         **error)
+{
+	g_return_val_if_fail (regex != NULL, FALSE);
+	g_return_val_if_fail (regex->resolved, FALSE);
+
+	return ensure_compiled (regex, error);
+}
+
+gboolean
+_gtk_source_regex_is_compiled (GtkSourceRegex *regex)
+{
+	return regex->regex != NULL;
+}
+
+gboolean
+_gtk_source_regex_is_jit_compiled (GtkSourceRegex *regex)
+{
+	return regex->regex != NULL && impl_regex_is_jit_compiled (regex->regex);
+}
+
+/**
+ * _gtk_source_regex_get_n_matches:
+ *
+ * Returns: the number of times a #GtkSourceRegex was matched against some
+ * text since the start of the process.
+ */
+guint64
+_gtk_source_regex_get_n_matches (void)
+{
+	return n_matches_total;
 }
 
 GtkSourceRegex *
@@ -168,16 +244,11 @@ _gtk_source_regex_unref (GtkSourceRegex *regex)
 {
 	if (regex != NULL && --regex->ref_count == 0)
 	{
-		if (regex->resolved)
-		{
-			impl_regex_unref (regex->u.regex.regex);
-			if (regex->u.regex.match)
-				impl_match_info_free (regex->u.regex.match);
-		}
-		else
-		{
-			g_free (regex->u.info.pattern);
-		}
+		g_free (regex->pattern);
+		if (regex->regex != NULL)
+			impl_regex_unref (regex->regex);
+		if (regex->match != NULL)
+			impl_match_info_free (regex->match);
 		g_slice_free (GtkSourceRegex, regex);
 	}
 }
@@ -202,11 +273,11 @@ replace_start_regex (const ImplMatchInfo *match_info,
 
 	if (num < 0)
 	{
-		subst = impl_match_info_fetch_named (data->start_regex->u.regex.match, num_string);
+		subst = impl_match_info_fetch_named (data->start_regex->match, num_string);
 	}
 	else
 	{
-		subst = impl_match_info_fetch (data->start_regex->u.regex.match, num);
+		subst = impl_match_info_fetch (data->start_regex->match, num);
 	}
 
 	if (subst != NULL)
@@ -262,16 +333,16 @@ _gtk_source_regex_resolve (GtkSourceRegex *regex,
 	data.start_regex = start_regex;
 	data.matched_text = matched_text;
 	expanded_regex = impl_regex_replace_eval (get_start_ref_regex (),
-	                                          regex->u.info.pattern,
+	                                          regex->pattern,
 	                                          -1, 0, 0,
 	                                          replace_start_regex,
 	                                          &data, NULL);
-	new_regex = _gtk_source_regex_new (expanded_regex, regex->u.info.flags, NULL);
-	if (new_regex == NULL || !new_regex->resolved)
+	new_regex = _gtk_source_regex_new (expanded_regex, regex->flags, NULL);
+	if (new_regex == NULL || !new_regex->resolved || !ensure_compiled (new_regex, NULL))
 	{
 		_gtk_source_regex_unref (new_regex);
 		g_warning ("Regular expression %s cannot be expanded.",
-			   regex->u.info.pattern);
+			   regex->pattern);
 		/* Returns a regex that never matches. */
 		new_regex = _gtk_source_regex_new ("$never-match^", 0, NULL);
 	}
@@ -287,6 +358,15 @@ _gtk_source_regex_is_resolved (GtkSourceRegex *regex)
 	return regex->resolved;
 }
 
+/* Whether the pattern uses \G, so that a match from a position cannot
+ * be reused from a later one.
+ */
+gboolean
+_gtk_source_regex_uses_offset (GtkSourceRegex *regex)
+{
+	return regex->uses_offset;
+}
+
 gboolean
 _gtk_source_regex_match (GtkSourceRegex *regex,
 			 const gchar    *line,
@@ -297,15 +377,36 @@ _gtk_source_regex_match (GtkSourceRegex *regex,
 
 	g_assert (regex->resolved);
 
-	if (regex->u.regex.match)
+	if (regex->match)
+	{
+		impl_match_info_free (regex->match);
+		regex->match = NULL;
+	}
+
+	if (G_UNLIKELY (regex->regex == NULL))
 	{
-		impl_match_info_free (regex->u.regex.match);
-		regex->u.regex.match = NULL;
+		GError *error = NULL;
+
+		if (regex->failed)
+			return FALSE;
+
+		if (!ensure_compiled (regex, &error))
+		{
+			/* Reported once, the regex never matches afterwards. */
+			g_warning ("%s", error->message);
+			g_clear_error (&error);
+			return FALSE;
+		}
 	}
 
-	result = impl_regex_match_full (regex->u.regex.regex, line,
+	n_matches_total++;
+
+	if (regex->n_matches < JIT_THRESHOLD && ++regex->n_matches == JIT_THRESHOLD)
+		impl_regex_jit_compile (regex->regex);
+
+	result = impl_regex_match_full (regex->regex, line,
 	                                byte_length, byte_pos,
-	                                0, &regex->u.regex.match,
+	                                0, &regex->match,
 	                                NULL);
 
 	return result;
@@ -317,7 +418,7 @@ _gtk_source_regex_fetch (GtkSourceRegex *regex,
 {
 	g_assert (regex->resolved);
 
-	return impl_match_info_fetch (regex->u.regex.match, num);
+	return impl_match_info_fetch (regex->match, num);
 }
 
 void
@@ -332,7 +433,7 @@ _gtk_source_regex_fetch_pos (GtkSourceRegex *regex,
 	g_assert (regex->resolved);
 
 	/* impl_match_info_fetch_pos() can return TRUE with start_pos/end_pos set to -1 */
-	if (!impl_match_info_fetch_pos (regex->u.regex.match, num, &byte_start_pos, &byte_end_pos))
+	if (!impl_match_info_fetch_pos (regex->match, num, &byte_start_pos, &byte_end_pos))
 	{
 		if (start_pos != NULL)
 			*start_pos = -1;
@@ -359,7 +460,7 @@ _gtk_source_regex_fetch_pos_bytes (GtkSourceRegex *regex,
 
 	g_assert (regex->resolved);
 
-	if (!impl_match_info_fetch_pos (regex->u.regex.match, num, &start_pos, &end_pos))
+	if (!impl_match_info_fetch_pos (regex->match, num, &start_pos, &end_pos))
 	{
 		start_pos = -1;
 		end_pos = -1;
@@ -382,7 +483,7 @@ _gtk_source_regex_fetch_named_pos (GtkSourceRegex *regex,
 
 	g_assert (regex->resolved);
 
-	if (!impl_match_info_fetch_named_pos (regex->u.regex.match, name, &byte_start_pos, &byte_end_pos))
+	if (!impl_match_info_fetch_named_pos (regex->match, name, &byte_start_pos, &byte_end_pos))
 	{
 		if (start_pos != NULL)
 			*start_pos = -1;
@@ -403,6 +504,9 @@ _gtk_source_regex_get_pattern (GtkSourceRegex *regex)
 {
 	g_assert (regex->resolved);
 
-	return impl_regex_get_pattern (regex->u.regex.regex);
+	if (regex->regex != NULL)
+		return impl_regex_get_pattern (regex->regex);
+
+	return regex->pattern;
 }
 
@@ -0,0 +1,66 @@
+/*
+ * This file is part of GtkSourceView
+ *
+ * GtkSourceView is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GtkSourceView is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#pragma once
+
+#include "gtksourcescheduler.h"
+#include "gtksourcetypes-private.h"
+
+G_BEGIN_DECLS
+
+/* The work of the owners shown in a view is done first, then the work of
+ * the owners having the keyboard focus, then the rest.
+ */
+typedef enum _GtkSourceSchedulerPriority
+{
+	GTK_SOURCE_SCHEDULER_PRIORITY_VISIBLE,
+	GTK_SOURCE_SCHEDULER_PRIORITY_FOCUSED,
+	GTK_SOURCE_SCHEDULER_PRIORITY_BACKGROUND,
+	GTK_SOURCE_SCHEDULER_N_PRIORITIES
+} GtkSourceSchedulerPriority;
+
+/* Only used for the statistics. */
+typedef enum _GtkSourceSchedulerTaskType
+{
+	GTK_SOURCE_SCHEDULER_TASK_OTHER,
+	GTK_SOURCE_SCHEDULER_TASK_HIGHLIGHTING,
+	GTK_SOURCE_SCHEDULER_TASK_SEARCH,
+	GTK_SOURCE_SCHEDULER_TASK_WORDS,
+	GTK_SOURCE_SCHEDULER_N_TASK_TYPES
+} GtkSourceSchedulerTaskType;
+
+GTK_SOURCE_INTERNAL
+gsize _gtk_source_scheduler_add_for_owner (gpointer                    owner,
+                                           GtkSourceSchedulerTaskType  type,
+                                           GtkSourceSchedulerCallback  callback,
+                                           gpointer                    user_data,
+                                           GDestroyNotify              notify);
+GTK_SOURCE_INTERNAL
+gsize _gtk_source_scheduler_add_visible   (GtkSourceSchedulerTaskType  type,
+                                           GtkSourceSchedulerCallback  callback,
+                                           gpointer                    user_data,
+                                           GDestroyNotify              notify);
+GTK_SOURCE_INTERNAL
+void  _gtk_source_scheduler_hold_owner    (gpointer                    owner,
+                                           GtkSourceSchedulerPriority  priority);
+GTK_SOURCE_INTERNAL
+void  _gtk_source_scheduler_release_owner (gpointer                    owner,
+                                           GtkSourceSchedulerPriority  priority);
+
+G_END_DECLS
@@ -23,7 +23,7 @@
 
 #include <gtk/gtk.h>
 
-#include "gtksourcescheduler.h"
+#include "gtksourcescheduler-private.h"
 
 /**
  * SECTION:scheduler
@@ -37,24 +37,51 @@
  * important when you have multiple documents open all competing to do
  * background work and potentially stalling the main loop.
  *
- * Instead, we only do 1 msec of work at a time and then wait for the next
- * frame to come in.
+ * Instead, we only do a small budget of work per frame and then wait for the
+ * next frame to come in. The budget starts at 1 msec and adapts to the slack
+ * of the main loop: when the source is dispatched on time for a new frame,
+ * nothing else was waiting and the budget grows, up to half a frame. When it
+ * is dispatched late, the budget shrinks back.
  *
  * Since we don't have access to the widgets, we need to base this work off the
  * shortest delay between frames among the available monitors. Some aliasing is
  * still possible depending on per-monitor scan-outs, but we already have that
  * issue without this.
+ *
+ * The internal background work (syntax highlighting, search occurrences,
+ * completion words) is registered with the buffer as owner. Owners are
+ * served in priority classes: the buffers shown in a view first, then the
+ * buffer having the focus, then the others. Within a class the owners are
+ * served in turn, so that a buffer with several tasks does not get a bigger
+ * share than the others.
+ *
+ * Some work is needed for the next redraw, like highlighting the lines that
+ * were just edited. It is added as visible work, done before all the other
+ * work: while there is some, the source is dispatched at a priority higher
+ * than the redraw, with a budget of its own.
  */
 
 #define _1_MSEC (G_USEC_PER_SEC / 1000L)
+#define MIN_BUDGET _1_MSEC
+#define VISIBLE_BUDGET (10 * _1_MSEC)
+#define VISIBLE_PRIORITY G_PRIORITY_HIGH_IDLE
 
 typedef struct
 {
-  GSource source;
-  GQueue queue;
-  gint64 interval;
-  gsize last_handler_id;
-} GtkSourceScheduler;
+  guint n_tasks;
+  guint64 n_runs;
+  gint64 time_spent;
+} GtkSourceTaskStats;
+
+typedef struct
+{
+  GList link;
+  gpointer key;
+  GQueue tasks;
+  guint holds[GTK_SOURCE_SCHEDULER_N_PRIORITIES];
+  GtkSourceSchedulerPriority priority;
+  guint queued : 1;
+} GtkSourceOwner;
 
 typedef struct
 {
@@ -62,10 +89,38 @@ typedef struct
   GtkSourceSchedulerCallback callback;
   gpointer user_data;
   GDestroyNotify notify;
-  gint64 ready_time;
+  GtkSourceOwner *owner;
+  GtkSourceSchedulerTaskType type;
   gsize id;
+  guint removed : 1;
+  guint visible : 1;
 } GtkSourceTask;
 
+typedef struct
+{
+  GSource source;
+  GQueue owners[GTK_SOURCE_SCHEDULER_N_PRIORITIES];
+  GQueue visible;
+  GHashTable *owners_by_key;
+  GHashTable *tasks_by_id;
+  GtkSourceTask *running;
+  gint64 interval;
+  gint64 budget;
+  gint64 frame_start;
+  gint64 frame_used;
+  gint64 expected_frame;
+  guint n_tasks;
+  gsize last_handler_id;
+  GtkSourceTaskStats stats[GTK_SOURCE_SCHEDULER_N_TASK_TYPES];
+} GtkSourceScheduler;
+
+static const gchar *task_type_names[GTK_SOURCE_SCHEDULER_N_TASK_TYPES] = {
+	"other",
+	"highlighting",
+	"search",
+	"words",
+};
+
 static GSource *the_source;
 
 static void
@@ -99,31 +154,97 @@ gtk_source_task_new (GtkSourceSchedulerCallback callback,
 	task->callback = callback;
 	task->user_data = user_data;
 	task->notify = notify;
-	task->ready_time = 0; /* Now */
 	task->id = 0;
 
 	return task;
 }
 
+static GtkSourceSchedulerPriority
+gtk_source_owner_get_priority (GtkSourceOwner *owner)
+{
+	if (owner->holds[GTK_SOURCE_SCHEDULER_PRIORITY_VISIBLE] > 0)
+		return GTK_SOURCE_SCHEDULER_PRIORITY_VISIBLE;
+
+	if (owner->holds[GTK_SOURCE_SCHEDULER_PRIORITY_FOCUSED] > 0)
+		return GTK_SOURCE_SCHEDULER_PRIORITY_FOCUSED;
+
+	return GTK_SOURCE_SCHEDULER_PRIORITY_BACKGROUND;
+}
+
+static GtkSourceOwner *
+get_owner (GtkSourceScheduler *self,
+           gpointer            key)
+{
+	GtkSourceOwner *owner = g_hash_table_lookup (self->owners_by_key, key);
+
+	if (owner == NULL)
+	{
+		owner = g_slice_new0 (GtkSourceOwner);
+		owner->link.data = owner;
+		owner->key = key;
+		owner->priority = GTK_SOURCE_SCHEDULER_PRIORITY_BACKGROUND;
+		g_hash_table_insert (self->owners_by_key, key, owner);
+	}
+
+	return owner;
+}
+
+/* Puts @owner in the queue of its priority class if it has work, and frees
+ * it if it is not needed anymore.
+ */
+static void
+update_owner (GtkSourceScheduler *self,
+              GtkSourceOwner     *owner)
+{
+	GtkSourceSchedulerPriority priority = gtk_source_owner_get_priority (owner);
+
+	if (owner->queued &&
+	    (priority != owner->priority || owner->tasks.length == 0))
+	{
+		g_queue_unlink (&self->owners[owner->priority], &owner->link);
+		owner->queued = FALSE;
+	}
+
+	owner->priority = priority;
+
+	if (!owner->queued && owner->tasks.length > 0)
+	{
+		g_queue_push_tail_link (&self->owners[priority], &owner->link);
+		owner->queued = TRUE;
+	}
+
+	if (owner->tasks.length == 0 &&
+	    priority == GTK_SOURCE_SCHEDULER_PRIORITY_BACKGROUND &&
+	    (self->running == NULL || self->running->owner != owner))
+	{
+		g_hash_table_remove (self->owners_by_key, owner->key);
+		g_slice_free (GtkSourceOwner, owner);
+	}
+}
+
 static gint64
 get_interval (GtkSourceScheduler *self)
 {
 	if G_UNLIKELY (self->interval == 0)
 	{
 		GdkDisplay *display = gdk_display_get_default ();
-		GListModel *monitors = gdk_display_get_monitors (display);
-		guint n_items = g_list_model_get_n_items (monitors);
 		gint64 lowest_interval = 60000;
 
-		for (guint i = 0; i < n_items; i++)
+		if (display != NULL)
 		{
-			GdkMonitor *monitor = g_list_model_get_item (monitors, i);
-			gint64 interval = gdk_monitor_get_refresh_rate (monitor);
+			GListModel *monitors = gdk_display_get_monitors (display);
+			guint n_items = g_list_model_get_n_items (monitors);
+
+			for (guint i = 0; i < n_items; i++)
+			{
+				GdkMonitor *monitor = g_list_model_get_item (monitors, i);
+				gint64 interval = gdk_monitor_get_refresh_rate (monitor);
 
-			if (interval != 0 && interval < lowest_interval)
-				lowest_interval = interval;
+				if (interval != 0 && interval < lowest_interval)
+					lowest_interval = interval;
 
-			g_object_unref (monitor);
+				g_object_unref (monitor);
+			}
 		}
 
 		self->interval = (double)G_USEC_PER_SEC / (double)lowest_interval * 1000.0;
@@ -132,6 +253,142 @@ get_interval (GtkSourceScheduler *self)
 	return self->interval;
 }
 
+/* Called when a new frame starts at @now. */
+static void
+update_budget (GtkSourceScheduler *self,
+               gint64              now,
+               gint64              interval)
+{
+	gint64 lateness;
+
+	/* We only know about the slack when we waited for this frame. */
+	if (self->expected_frame == 0)
+		return;
+
+	lateness = now - self->expected_frame;
+
+	if (lateness < interval / 8)
+		self->budget = MIN (self->budget * 2, interval / 2);
+	else if (lateness > interval / 2)
+		self->budget = MAX (self->budget / 2, MIN_BUDGET);
+}
+
+static void
+update_ready_time (GtkSourceScheduler *self)
+{
+	GSource *source = (GSource *)self;
+	gint priority = self->visible.length > 0 ? VISIBLE_PRIORITY : G_PRIORITY_LOW;
+
+	if (g_source_get_priority (source) != priority)
+	{
+		g_source_set_priority (source, priority);
+	}
+
+	if (self->visible.length > 0)
+	{
+		/* Before the next redraw */
+		self->expected_frame = 0;
+		g_source_set_ready_time (source, 0);
+	}
+	else if (self->n_tasks == 0)
+	{
+		self->expected_frame = 0;
+		g_source_set_ready_time (source, -1);
+	}
+	else if (self->frame_used >= self->budget)
+	{
+		/* Wait for the next frame */
+		self->expected_frame = MAX (self->frame_start + get_interval (self),
+		                            g_get_monotonic_time ());
+		g_source_set_ready_time (source, self->expected_frame);
+	}
+	else
+	{
+		self->expected_frame = 0;
+		g_source_set_ready_time (source, 0);
+	}
+}
+
+static GtkSourceTask *
+pop_next_task (GtkSourceScheduler *self)
+{
+	for (guint i = 0; i < GTK_SOURCE_SCHEDULER_N_PRIORITIES; i++)
+	{
+		GtkSourceOwner *owner = g_queue_peek_head (&self->owners[i]);
+		GtkSourceTask *task;
+
+		if (owner == NULL)
+			continue;
+
+		task = g_queue_peek_head (&owner->tasks);
+		g_queue_unlink (&owner->tasks, &task->link);
+
+		/* Keeps the owner alive while the task runs */
+		self->running = task;
+
+		/* Next time, serve the other owners of the same class first. */
+		g_queue_unlink (&self->owners[i], &owner->link);
+		owner->queued = FALSE;
+		update_owner (self, owner);
+
+		return task;
+	}
+
+	return NULL;
+}
+
+static void
+remove_task (GtkSourceScheduler *self,
+             GtkSourceTask      *task)
+{
+	GtkSourceOwner *owner = task->owner;
+
+	g_hash_table_remove (self->tasks_by_id, GSIZE_TO_POINTER (task->id));
+	self->stats[task->type].n_tasks--;
+	self->n_tasks--;
+
+	if (owner != NULL)
+	{
+		update_owner (self, owner);
+	}
+
+	gtk_source_task_free (task);
+}
+
+static void
+run_task (GtkSourceScheduler *self,
+          GtkSourceTask      *task,
+          gint64              deadline)
+{
+	gint64 begin;
+	gboolean again;
+
+	begin = g_get_monotonic_time ();
+	self->running = task;
+	again = task->callback (deadline, task->user_data);
+	self->running = NULL;
+
+	self->stats[task->type].n_runs++;
+	self->stats[task->type].time_spent += g_get_monotonic_time () - begin;
+
+	if (again && !task->removed)
+	{
+		if (task->visible)
+		{
+			g_queue_push_tail_link (&self->visible, &task->link);
+		}
+		else
+		{
+			g_queue_push_tail_link (&task->owner->tasks, &task->link);
+			update_owner (self, task->owner);
+		}
+
+		return;
+	}
+
+	remove_task (self, task);
+}
+
 static gboolean
 gtk_source_scheduler_prepare (GSource *source,
                               int     *timeout)
@@ -143,10 +400,7 @@ gtk_source_scheduler_prepare (GSource *source,
 static gboolean
 gtk_source_scheduler_check (GSource *source)
 {
-	GtkSourceScheduler *self = (GtkSourceScheduler *)source;
-	GtkSourceTask *task = g_queue_peek_head (&self->queue);
-
-	return task != NULL && task->ready_time <= g_source_get_time (source);
+	return FALSE;
 }
 
 static gboolean
@@ -155,50 +409,64 @@ gtk_source_scheduler_dispatch (GSource     *source,
                                gpointer     user_data)
 {
 	GtkSourceScheduler *self = (GtkSourceScheduler *)source;
-	gint64 current = g_source_get_time (source);
-	gint64 deadline = current + _1_MSEC;
 	gint64 interval = get_interval (self);
+	gint64 current = g_get_monotonic_time ();
+	gint64 deadline;
 
-	/* Try to process as many items within our quanta if they */
-	while (g_get_monotonic_time () < deadline)
+	if (current >= self->frame_start + interval)
 	{
-		GtkSourceTask *task = g_queue_peek_head (&self->queue);
-
-		if (task == NULL)
-			break;
+		update_budget (self, current, interval);
+		self->frame_start = current;
+		self->frame_used = 0;
+	}
 
-		g_queue_unlink (&self->queue, &task->link);
+	/* The visible work first, with its own budget. */
+	if (self->visible.length > 0)
+	{
+		deadline = current + VISIBLE_BUDGET;
 
-		if (task->callback (deadline, task->user_data))
+		while (self->visible.length > 0 && g_get_monotonic_time () < deadline)
 		{
-			task->ready_time = current + interval;
-			g_queue_push_tail_link (&self->queue, &task->link);
-			continue;
+			GList *link = g_queue_pop_head_link (&self->visible);
+
+			run_task (self, link->data, deadline);
 		}
 
-		gtk_source_task_free (task);
+		/* The rest is done once the views are drawn. */
+		self->frame_used += g_get_monotonic_time () - current;
+		update_ready_time (self);
+
+		return G_SOURCE_CONTINUE;
 	}
 
-	if (self->queue.head != NULL)
+	deadline = current + MAX (0, self->budget - self->frame_used);
+
+	/* Try to process as many items within our quanta if they */
+	while (g_get_monotonic_time () < deadline)
 	{
-		GtkSourceTask *task = g_queue_peek_head (&self->queue);
-		g_source_set_ready_time (source, task->ready_time);
-		return G_SOURCE_CONTINUE;
+		GtkSourceTask *task = pop_next_task (self);
+
+		if (task == NULL)
+			break;
+
+		run_task (self, task, deadline);
 	}
 
-	return G_SOURCE_REMOVE;
+	self->frame_used += g_get_monotonic_time () - current;
+	update_ready_time (self);
+
+	return G_SOURCE_CONTINUE;
 }
 
 static void
 gtk_source_scheduler_finalize (GSource *source)
 {
-#ifndef G_DISABLE_ASSERT
 	GtkSourceScheduler *self = (GtkSourceScheduler *)source;
 
-	g_assert (self->queue.length == 0);
-	g_assert (self->queue.head == NULL);
-	g_assert (self->queue.tail == NULL);
-#endif
+	g_assert (self->n_tasks == 0);
+
+	g_clear_pointer (&self->tasks_by_id, g_hash_table_unref);
+	g_clear_pointer (&self->owners_by_key, g_hash_table_unref);
 
 	if (source == the_source)
 	{
@@ -218,10 +486,18 @@ get_scheduler (void)
 {
 	if (the_source == NULL)
 	{
+		GtkSourceScheduler *self;
+
 		the_source = g_source_new (&source_funcs, sizeof (GtkSourceScheduler));
 		g_source_set_name (the_source, "GtkSourceScheduler");
 		g_source_set_priority (the_source, G_PRIORITY_LOW);
-		g_source_set_ready_time (the_source, 0);
+		g_source_set_ready_time (the_source, -1);
+
+		self = (GtkSourceScheduler *)the_source;
+		self->owners_by_key = g_hash_table_new (NULL, NULL);
+		self->tasks_by_id = g_hash_table_new (NULL, NULL);
+		self->budget = MIN_BUDGET;
+
 		g_source_attach (the_source, g_main_context_default ());
 		g_source_unref (the_source);
 	}
@@ -259,6 +535,9 @@ gtk_source_scheduler_add (GtkSourceSchedulerCallback callback,
  * @callback will be provided a deadline that it should complete it's work by
  * (or near) and can be checked using [func@GLib.get_monotonic_time] for comparison.
  *
+ * The callback shares the per-frame budget with the background work of the
+ * buffers, after the buffers that are shown in a view.
+ *
  * Use [func@scheduler_remove] to remove the handler.
  *
  * Since: 5.2
@@ -267,19 +546,46 @@ gsize
 gtk_source_scheduler_add_full (GtkSourceSchedulerCallback callback,
                                gpointer                   user_data,
                                GDestroyNotify             notify)
+{
+	return _gtk_source_scheduler_add_for_owner (NULL,
+	                                            GTK_SOURCE_SCHEDULER_TASK_OTHER,
+	                                            callback,
+	                                            user_data,
+	                                            notify);
+}
+
+/* Same as gtk_source_scheduler_add_full(), for the work related to @owner,
+ * usually a #GtkTextBuffer. The work is prioritized with the holds on
+ * @owner.
+ */
+gsize
+_gtk_source_scheduler_add_for_owner (gpointer                    owner,
+                                     GtkSourceSchedulerTaskType  type,
+                                     GtkSourceSchedulerCallback  callback,
+                                     gpointer                    user_data,
+                                     GDestroyNotify              notify)
 {
 	GtkSourceScheduler *self;
 	GtkSourceTask *task;
 
 	g_return_val_if_fail (callback != NULL, 0);
+	g_return_val_if_fail (type < GTK_SOURCE_SCHEDULER_N_TASK_TYPES, 0);
 
 	self = get_scheduler ();
 	task = gtk_source_task_new (callback, user_data, notify);
 	task->id = ++self->last_handler_id;
+	task->type = type;
+	task->owner = get_owner (self, owner);
 
-	/* Request progress immediately */
-	g_queue_push_head_link (&self->queue, &task->link);
-	g_source_set_ready_time ((GSource *)self, g_source_get_time ((GSource *)self));
+	g_hash_table_insert (self->tasks_by_id, GSIZE_TO_POINTER (task->id), task);
+	self->stats[type].n_tasks++;
+	self->n_tasks++;
+
+	g_queue_push_tail_link (&task->owner->tasks, &task->link);
+	update_owner (self, task->owner);
+
+	/* Request progress as soon as the budget allows it */
+	update_ready_time (self);
 
 	return task->id;
 }
@@ -297,30 +603,145 @@ void
 gtk_source_scheduler_remove (gsize handler_id)
 {
 	GtkSourceScheduler *self;
+	GtkSourceTask *task;
 
 	g_return_if_fail (handler_id != 0);
 
 	self = get_scheduler ();
+	task = g_hash_table_lookup (self->tasks_by_id, GSIZE_TO_POINTER (handler_id));
 
-	for (const GList *iter = self->queue.head; iter != NULL; iter = iter->next)
+	if (task == NULL)
 	{
-		GtkSourceTask *task = iter->data;
-
-		if (task->id == handler_id)
-		{
-			g_queue_unlink (&self->queue, &task->link);
-			gtk_source_task_free (task);
-			break;
-		}
+		return;
 	}
 
-	if (self->queue.head != NULL)
+	/* Removed from its own callback, it is freed when it returns. */
+	if (task == self->running)
 	{
-		GtkSourceTask *task = g_queue_peek_head (&self->queue);
-		g_source_set_ready_time ((GSource *)self, task->ready_time);
+		task->removed = TRUE;
+		return;
 	}
-	else
+
+	g_queue_unlink (task->visible ? &self->visible : &task->owner->tasks, &task->link);
+	remove_task (self, task);
+	update_ready_time (self);
+}
+
+/* Same as _gtk_source_scheduler_add_for_owner(), for work needed by the
+ * next redraw. It is done before all the other work, at a higher priority
+ * than the redraw. The callback should do the minimum and add the rest as
+ * normal work.
+ */
+gsize
+_gtk_source_scheduler_add_visible (GtkSourceSchedulerTaskType  type,
+                                   GtkSourceSchedulerCallback  callback,
+                                   gpointer                    user_data,
+                                   GDestroyNotify              notify)
+{
+	GtkSourceScheduler *self;
+	GtkSourceTask *task;
+
+	g_return_val_if_fail (callback != NULL, 0);
+	g_return_val_if_fail (type < GTK_SOURCE_SCHEDULER_N_TASK_TYPES, 0);
+
+	self = get_scheduler ();
+	task = gtk_source_task_new (callback, user_data, notify);
+	task->id = ++self->last_handler_id;
+	task->type = type;
+	task->visible = TRUE;
+
+	g_hash_table_insert (self->tasks_by_id, GSIZE_TO_POINTER (task->id), task);
+	self->stats[type].n_tasks++;
+	self->n_tasks++;
+
+	g_queue_push_tail_link (&self->visible, &task->link);
+	update_ready_time (self);
+
+	return task->id;
+}
+
+/* Raises the priority of the work of @owner, until the hold is released
+ * with _gtk_source_scheduler_release_owner(). The views hold the buffer
+ * they show.
+ */
+void
+_gtk_source_scheduler_hold_owner (gpointer                   owner,
+                                  GtkSourceSchedulerPriority priority)
+{
+	GtkSourceScheduler *self;
+	GtkSourceOwner *source_owner;
+
+	g_return_if_fail (owner != NULL);
+	g_return_if_fail (priority < GTK_SOURCE_SCHEDULER_PRIORITY_BACKGROUND);
+
+	self = get_scheduler ();
+	source_owner = get_owner (self, owner);
+	source_owner->holds[priority]++;
+	update_owner (self, source_owner);
+}
+
+void
+_gtk_source_scheduler_release_owner (gpointer                   owner,
+                                     GtkSourceSchedulerPriority priority)
+{
+	GtkSourceScheduler *self;
+	GtkSourceOwner *source_owner;
+
+	g_return_if_fail (owner != NULL);
+	g_return_if_fail (priority < GTK_SOURCE_SCHEDULER_PRIORITY_BACKGROUND);
+
+	self = get_scheduler ();
+	source_owner = g_hash_table_lookup (self->owners_by_key, owner);
+
+	g_return_if_fail (source_owner != NULL);
+	g_return_if_fail (source_owner->holds[priority] > 0);
+
+	source_owner->holds[priority]--;
+	update_owner (self, source_owner);
+}
+
+/**
+ * gtk_source_scheduler_get_stats:
+ *
+ * Gets statistics about the work done by the scheduler, for profiling.
+ *
+ * The result is a `a{sv}` dictionary with the following keys:
+ *
+ * - `queue-depth` (`u`): the number of registered callbacks.
+ * - `budget` (`x`): the time allowed per frame, in microseconds.
+ * - `frame-interval` (`x`): the time between two frames, in microseconds.
+ * - `tasks` (`a{s(utx)}`): per type of work ("highlighting", "search",
+ *   "words" and "other" for [func@scheduler_add]), the number of registered
+ *   callbacks, the number of times they have been called and the total time
+ *   spent in them, in microseconds.
+ *
+ * Returns: (transfer full): a new floating #GVariant.
+ *
+ * Since: 5.22
+ */
+GVariant *
+gtk_source_scheduler_get_stats (void)
+{
+	GtkSourceScheduler *self = get_scheduler ();
+	GVariantBuilder builder;
+	GVariantBuilder tasks;
+
+	g_variant_builder_init (&tasks, G_VARIANT_TYPE ("a{s(utx)}"));
+
+	for (guint i = 0; i < GTK_SOURCE_SCHEDULER_N_TASK_TYPES; i++)
 	{
-		g_source_destroy ((GSource *)self);
+		g_variant_builder_add (&tasks, "{s(utx)}",
+		                       task_type_names[i],
+		                       self->stats[i].n_tasks,
+		                       self->stats[i].n_runs,
+		                       self->stats[i].time_spent);
 	}
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+	g_variant_builder_add (&builder, "{sv}", "queue-depth", g_variant_new_uint32 (self->n_tasks));
+	g_variant_builder_add (&builder, "{sv}", "budget", g_variant_new_int64 (self->budget));
+	g_variant_builder_add (&builder, "{sv}", "frame-interval", g_variant_new_int64 (get_interval (self)));
+	g_variant_builder_add (&builder, "{sv}", "tasks", g_variant_builder_end (&tasks));
+
+	return g_variant_builder_end (&builder);
 }
@@ -60,6 +60,8 @@ gsize gtk_source_scheduler_add_full (GtkSourceSchedulerCallback callback,
                                      GDestroyNotify             notify);
 GTK_SOURCE_AVAILABLE_IN_5_2
 void gtk_source_scheduler_remove    (gsize                      handler_id);
+GTK_SOURCE_AVAILABLE_IN_5_22
+GVariant *gtk_source_scheduler_get_stats (void);
 
 static inline void
 gtk_source_scheduler_clear (gsize *handler_id_ptr)
@@ -28,5 +28,28 @@ void _gtk_source_search_context_update_highlight (GtkSourceSearchContext *search
                                                   const GtkTextIter      *start,
                                                   const GtkTextIter      *end,
                                                   gboolean                synchronous);
+G_GNUC_INTERNAL
+gchar *_gtk_source_search_context_get_replacement (GtkSourceSearchContext  *search,
+                                                   const GtkTextIter       *match_start,
+                                                   const GtkTextIter       *match_end,
+                                                   const gchar             *replace,
+                                                   gint                     replace_length,
+                                                   GError                 **error);
+G_GNUC_INTERNAL
+void _gtk_source_search_context_replace_ranges (GtkSourceSearchContext *search,
+                                                const gint             *starts,
+                                                const gint             *ends,
+                                                const gchar * const    *replacements,
+                                                guint                   n_ranges);
+G_GNUC_INTERNAL
+gboolean _gtk_source_search_context_get_match_background (GtkSourceSearchContext *search,
+                                                          GdkRGBA                *rgba);
+G_GNUC_INTERNAL
+void     _gtk_source_search_context_get_matches          (GtkSourceSearchContext *search,
+                                                          const GtkTextIter      *start,
+                                                          const GtkTextIter      *end,
+                                                          GArray                 *matches);
+G_GNUC_INTERNAL
+guint    _gtk_source_search_context_get_shared_chunks    (GtkSourceSearchContext *search);
 
 G_END_DECLS
@@ -27,10 +27,13 @@
 #include "gtksourcebuffer-private.h"
 #include "gtksourcebufferinternal-private.h"
 #include "gtksourcestyle.h"
+#include "gtksourcestyle-private.h"
 #include "gtksourcestylescheme.h"
 #include "gtksourceutils.h"
 #include "gtksourceregion.h"
 #include "gtksourceiter-private.h"
+#include "gtksourceoccurrenceindex-private.h"
+#include "gtksourcescheduler-private.h"
 #include "gtksource-enumtypes.h"
 
 #include "implregex-private.h"
@@ -144,21 +147,34 @@
  * general case we can not say how many occurrences there are in this region,
  * since a found_tag region can contain contiguous matches. Take for example the
  * found_tag region "aa": was it the "aa" search match, or two times "a"?
- * The implemented solution is to set occurrences_count to 0 when the search
- * state changes, even if old matches are still there. Because it is not
- * possible to count the old matches to decrement occurrences_count (and storing
- * the previous search text would not be sufficient, because even older matches
- * can still be there). To increment and decrement occurrences_count, there is
- * the scan_region, the region to scan. If an occurrence is contained in
- * scan_region, it means that it has not already been scanned, so
- * occurrences_count doesn't take into account this occurrence. On the other
- * hand, if we find an occurrence outside scan_region, the occurrence is
- * normally correctly highlighted, and occurrences_count take it into account.
- *
- * So when we highlight or when we remove the highlight of an occurrence (on
- * text insertion, deletion, when scanning, etc.), we increment or decrement
- * occurrences_count depending on whether the occurrence was already taken into
- * account by occurrences_count.
+ * The implemented solution is to keep, besides the found_tag, the offsets of
+ * the occurrences found by the scan in a GtkSourceOccurrenceIndex, which is
+ * cleared when the search state changes, even if old matches are still there.
+ * An occurrence is added to the index when it is highlighted by the scan, and
+ * removed when its highlight is removed (on text insertion, deletion, when
+ * re-scanning a region, etc.). Old found_tag's are thus never counted. On text
+ * insertion and deletion, the offsets of the following occurrences are shifted.
+ *
+ * The index is a sorted array of packed offset ranges, so the number of
+ * occurrences, the position of an occurrence and the n-th occurrence are
+ * known in O(log n), with n the number of occurrences, instead of walking
+ * the found_tag's from the start of the buffer.
+ *
+ * With a common pattern in a big buffer, applying and removing the found_tag
+ * creates a huge number of tag toggles in the GtkTextBTree. If the
+ * use-text-tags property is FALSE, the found_tag is not applied at all: the
+ * occurrences are only in the index, the GtkSourceViews paint the visible
+ * ones, and the navigation walks through the runs of contiguous occurrences
+ * of the index instead of the found_tag toggles. Since there are no old
+ * found_tag's in that case, the old occurrences disappear as soon as the
+ * search state changes.
+ *
+ * The search can be limited to a search_region, for a "find in selection"
+ * feature. The scan_region is then always intersected with it, so the work
+ * depends on the size of the search_region, not on the size of the buffer.
+ * The lines around the search_region may still be scanned, but only the
+ * matches entirely contained in a subregion of the search_region become
+ * occurrences.
  *
  * If the code seems too complicated and contains strange bugs, you have two
  * choices:
@@ -204,7 +220,14 @@
  * regex "(aa)+" with the buffer contents "aaa". There is one occurrence: the
  * first two letters. If we insert an extra 'a' at the end of the buffer, the
  * occurrence is modified to take the next two letters. That's why the buffer
- * is re-scanned entirely on each insertion or deletion in the buffer.
+ * is re-scanned entirely on each insertion or deletion in the buffer, unless
+ * the regex cannot match a line terminator (see
+ * impl_regex_can_match_newline()): then only the modified lines are
+ * re-scanned. When a match can only contain a known number of line
+ * terminators (see impl_regex_get_max_newlines()), that many lines around
+ * the modified ones are re-scanned too. In all cases the occurrences are
+ * updated in place, the occurrences after the modification being moved in
+ * the index.
  *
  * For searching the matches, the easiest solution is to retrieve all the buffer
  * contents, and search the occurrences on this big string. But it takes a lot
@@ -221,6 +244,19 @@
  * match nor a partial match), we take the next segment, with the last
  * max_lookbehind characters from the previous segment.
  *
+ * Several regex search contexts on the same buffer, for example one per
+ * highlighted pattern, usually need to scan the same lines at the same time.
+ * When their scans are at the same place, the text of each segment is
+ * retrieved once, with the largest max_lookbehind, and matched against each
+ * regex. A search context that gets a partial match continues its scan
+ * alone from there.
+ *
+ * The non-regex search contexts share their scan the same way: the text of
+ * the chunk is retrieved once, and the search texts of all the search
+ * contexts are matched against it in a single pass, instead of running one
+ * GtkTextIter search per search context. shared_chunks counts the chunks
+ * scanned that way.
+ *
  * Improvement idea
  * ----------------
  *
@@ -298,6 +334,8 @@ enum
 	PROP_SETTINGS,
 	PROP_HIGHLIGHT,
 	PROP_MATCH_STYLE,
+	PROP_USE_TEXT_TAGS,
+	PROP_SEARCH_REGION,
 	PROP_OCCURRENCES_COUNT,
 	PROP_REGEX_ERROR,
 	N_PROPS
@@ -316,7 +354,7 @@ struct _GtkSourceSearchContext
 	GtkSourceSearchSettings *settings;
 
 	/* The tag to apply to search occurrences. Even if the highlighting is
-	 * disabled, the tag is applied.
+	 * disabled, the tag is applied, unless use_text_tags is FALSE.
 	 */
 	GtkTextTag *found_tag;
 
@@ -348,11 +386,31 @@ struct _GtkSourceSearchContext
 	ImplRegex *regex;
 	GError *regex_error;
 
-	gint occurrences_count;
-	gulong idle_scan_id;
+	/* The largest number of line terminators that a match of the regex
+	 * can contain, or -1 if it is not known. An insertion or deletion only
+	 * changes the occurrences of the modified lines and of that many lines
+	 * around them.
+	 */
+	gint regex_max_newlines;
+
+	/* The occurrences found by the scan. */
+	GtkSourceOccurrenceIndex *occurrences;
+
+	gsize idle_scan_id;
 
 	GtkSourceStyle *match_style;
 	guint highlight : 1;
+
+	/* If FALSE, the found_tag is not applied, the occurrences are only
+	 * in the occurrences index and the views paint them.
+	 */
+	guint use_text_tags : 1;
+
+	/* If not NULL, the search is limited to this region. */
+	GtkSourceRegion *search_region;
+
+	/* The number of chunks scanned together with other search contexts. */
+	guint shared_chunks;
 };
 
 /* Data for the asynchronous forward and backward search tasks. */
@@ -386,32 +444,62 @@ print_region (GtkSourceRegion *region)
 }
 #endif
 
+/* Notifies the views that they must paint again the occurrences, which is
+ * done by GtkTextView when the found_tag is used.
+ */
 static void
-sync_found_tag (GtkSourceSearchContext *search)
+matches_changed (GtkSourceSearchContext *search)
+{
+	GtkSourceBufferInternal *buffer_internal;
+
+	if (search->use_text_tags || search->buffer == NULL)
+	{
+		return;
+	}
+
+	buffer_internal = _gtk_source_buffer_internal_get_from_buffer (GTK_SOURCE_BUFFER (search->buffer));
+	_gtk_source_buffer_internal_emit_search_matches_changed (buffer_internal, search);
+}
+
+static GtkSourceStyle *
+get_match_style (GtkSourceSearchContext *search)
 {
-	GtkSourceStyle *style = search->match_style;
 	GtkSourceStyleScheme *style_scheme;
 
+	if (search->match_style != NULL)
+	{
+		return search->match_style;
+	}
+
+	style_scheme = gtk_source_buffer_get_style_scheme (GTK_SOURCE_BUFFER (search->buffer));
+
+	if (style_scheme != NULL)
+	{
+		return gtk_source_style_scheme_get_style (style_scheme, "search-match");
+	}
+
+	return NULL;
+}
+
+static void
+sync_found_tag (GtkSourceSearchContext *search)
+{
+	GtkSourceStyle *style;
+
 	if (search->buffer == NULL)
 	{
 		return;
 	}
 
+	matches_changed (search);
+
 	if (!search->highlight)
 	{
 		gtk_source_style_apply (NULL, search->found_tag);
 		return;
 	}
 
-	if (style == NULL)
-	{
-		style_scheme = gtk_source_buffer_get_style_scheme (GTK_SOURCE_BUFFER (search->buffer));
-
-		if (style_scheme != NULL)
-		{
-			style = gtk_source_style_scheme_get_style (style_scheme, "search-match");
-		}
-	}
+	style = get_match_style (search);
 
 	if (style == NULL)
 	{
@@ -433,6 +521,195 @@ text_tag_set_highest_priority (GtkTextTag    *tag,
 	gtk_text_tag_set_priority (tag, n - 1);
 }
 
+/* The functions below walk through the found_tag toggles. When the found_tag
+ * is not used, they walk through the boundaries of the runs of contiguous
+ * occurrences in the occurrences index instead, which are the toggles that
+ * the found_tag would have.
+ */
+
+static gboolean
+get_occurrence_at_offset (GtkSourceSearchContext *search,
+                          gint                    offset,
+                          gint                   *start,
+                          gint                   *end,
+                          guint                  *n)
+{
+	guint count;
+	gint occurrence_start;
+	gint occurrence_end;
+
+	count = _gtk_source_occurrence_index_count_before (search->occurrences, offset + 1);
+
+	if (count == 0 ||
+	    !_gtk_source_occurrence_index_get_nth (search->occurrences,
+						   count - 1,
+						   &occurrence_start,
+						   &occurrence_end) ||
+	    occurrence_end <= offset)
+	{
+		return FALSE;
+	}
+
+	if (start != NULL)
+	{
+		*start = occurrence_start;
+	}
+
+	if (end != NULL)
+	{
+		*end = occurrence_end;
+	}
+
+	if (n != NULL)
+	{
+		*n = count - 1;
+	}
+
+	return TRUE;
+}
+
+static gboolean
+iter_has_match (GtkSourceSearchContext *search,
+                const GtkTextIter      *iter)
+{
+	if (search->use_text_tags)
+	{
+		return gtk_text_iter_has_tag (iter, search->found_tag);
+	}
+
+	return get_occurrence_at_offset (search, gtk_text_iter_get_offset (iter), NULL, NULL, NULL);
+}
+
+static gboolean
+iter_starts_match (GtkSourceSearchContext *search,
+                   const GtkTextIter      *iter)
+{
+	gint offset;
+
+	if (search->use_text_tags)
+	{
+		return gtk_text_iter_starts_tag (iter, search->found_tag);
+	}
+
+	offset = gtk_text_iter_get_offset (iter);
+
+	return (get_occurrence_at_offset (search, offset, NULL, NULL, NULL) &&
+		(offset == 0 || !get_occurrence_at_offset (search, offset - 1, NULL, NULL, NULL)));
+}
+
+static gboolean
+iter_ends_match (GtkSourceSearchContext *search,
+                 const GtkTextIter      *iter)
+{
+	gint offset;
+
+	if (search->use_text_tags)
+	{
+		return gtk_text_iter_ends_tag (iter, search->found_tag);
+	}
+
+	offset = gtk_text_iter_get_offset (iter);
+
+	return (offset > 0 &&
+		get_occurrence_at_offset (search, offset - 1, NULL, NULL, NULL) &&
+		!get_occurrence_at_offset (search, offset, NULL, NULL, NULL));
+}
+
+static void
+forward_to_match_toggle (GtkSourceSearchContext *search,
+                         GtkTextIter            *iter)
+{
+	gint offset;
+	gint start;
+	gint end;
+	guint n;
+
+	if (search->use_text_tags)
+	{
+		gtk_text_iter_forward_to_tag_toggle (iter, search->found_tag);
+		return;
+	}
+
+	offset = gtk_text_iter_get_offset (iter);
+
+	if (get_occurrence_at_offset (search, offset, NULL, &end, &n))
+	{
+		gint next_end;
+
+		while (_gtk_source_occurrence_index_get_nth (search->occurrences, n + 1, &start, &next_end) &&
+		       start == end)
+		{
+			end = next_end;
+			n++;
+		}
+
+		gtk_text_iter_set_offset (iter, end);
+	}
+	else if (_gtk_source_occurrence_index_get_nth (search->occurrences,
+						       _gtk_source_occurrence_index_count_before (search->occurrences, offset + 1),
+						       &start,
+						       NULL))
+	{
+		gtk_text_iter_set_offset (iter, start);
+	}
+	else
+	{
+		gtk_text_iter_forward_to_end (iter);
+	}
+}
+
+static void
+backward_to_match_toggle (GtkSourceSearchContext *search,
+                          GtkTextIter            *iter)
+{
+	gint offset;
+	gint start;
+	gint end;
+	guint n;
+
+	if (search->use_text_tags)
+	{
+		gtk_text_iter_backward_to_tag_toggle (iter, search->found_tag);
+		return;
+	}
+
+	offset = gtk_text_iter_get_offset (iter);
+
+	if (offset == 0)
+	{
+		return;
+	}
+
+	if (get_occurrence_at_offset (search, offset - 1, &start, NULL, &n))
+	{
+		gint prev_start;
+
+		while (n > 0 &&
+		       _gtk_source_occurrence_index_get_nth (search->occurrences, n - 1, &prev_start, &end) &&
+		       end == start)
+		{
+			start = prev_start;
+			n--;
+		}
+
+		gtk_text_iter_set_offset (iter, start);
+	}
+	else
+	{
+		n = _gtk_source_occurrence_index_count_before (search->occurrences, offset);
+
+		if (n > 0 &&
+		    _gtk_source_occurrence_index_get_nth (search->occurrences, n - 1, NULL, &end))
+		{
+			gtk_text_iter_set_offset (iter, end);
+		}
+		else
+		{
+			gtk_text_iter_set_offset (iter, 0);
+		}
+	}
+}
+
 /* Sets @start and @end to the first non-empty subregion.
  * Returns FALSE if the region is empty.
  */
@@ -468,6 +745,51 @@ get_first_subregion (GtkSourceRegion *region,
 	return FALSE;
 }
 
+/* Returns whether the match is entirely in a subregion of the search_region.
+ * The subregions are sorted and don't overlap.
+ */
+static gboolean
+match_in_search_region (GtkSourceSearchContext *search,
+                        const GtkTextIter      *match_start,
+                        const GtkTextIter      *match_end)
+{
+	GtkSourceRegionIter region_iter;
+
+	if (search->search_region == NULL)
+	{
+		return TRUE;
+	}
+
+	gtk_source_region_get_start_region_iter (search->search_region, &region_iter);
+
+	while (!gtk_source_region_iter_is_end (&region_iter))
+	{
+		GtkTextIter subregion_start;
+		GtkTextIter subregion_end;
+
+		if (!gtk_source_region_iter_get_subregion (&region_iter,
+							   &subregion_start,
+							   &subregion_end))
+		{
+			break;
+		}
+
+		if (gtk_text_iter_compare (match_start, &subregion_start) < 0)
+		{
+			break;
+		}
+
+		if (gtk_text_iter_compare (match_end, &subregion_end) <= 0)
+		{
+			return TRUE;
+		}
+
+		gtk_source_region_iter_next (&region_iter);
+	}
+
+	return FALSE;
+}
+
 /* Sets @start and @end to the last non-empty subregion.
  * Returns FALSE if the region is empty.
  */
@@ -589,11 +911,7 @@ clear_search (GtkSourceSearchContext *search)
 	g_clear_object (&search->scan_region);
 	g_clear_object (&search->high_priority_region);
 
-	if (search->idle_scan_id != 0)
-	{
-		g_source_remove (search->idle_scan_id);
-		search->idle_scan_id = 0;
-	}
+	gtk_source_scheduler_clear (&search->idle_scan_id);
 
 	if (search->regex_error != NULL)
 	{
@@ -603,7 +921,11 @@ clear_search (GtkSourceSearchContext *search)
 
 	clear_task (search);
 
-	search->occurrences_count = 0;
+	if (_gtk_source_occurrence_index_get_count (search->occurrences) > 0)
+	{
+		_gtk_source_occurrence_index_clear (search->occurrences);
+		matches_changed (search);
+	}
 }
 
 static GtkTextSearchFlags
@@ -625,12 +947,11 @@ get_text_search_flags (GtkSourceSearchContext *search)
 
 /* @start_pos is in bytes. */
 static void
-regex_search_get_real_start (GtkSourceSearchContext *search,
-                             const GtkTextIter      *start,
-                             GtkTextIter            *real_start,
-                             gint                   *start_pos)
+get_real_start (const GtkTextIter *start,
+                gint               max_lookbehind,
+                GtkTextIter       *real_start,
+                gint              *start_pos)
 {
-	gint max_lookbehind = impl_regex_get_max_lookbehind (search->regex);
 	gint i;
 	gchar *text;
 
@@ -650,6 +971,18 @@ regex_search_get_real_start (GtkSourceSearchContext *search,
 	g_free (text);
 }
 
+static void
+regex_search_get_real_start (GtkSourceSearchContext *search,
+                             const GtkTextIter      *start,
+                             GtkTextIter            *real_start,
+                             gint                   *start_pos)
+{
+	get_real_start (start,
+			impl_regex_get_max_lookbehind (search->regex),
+			real_start,
+			start_pos);
+}
+
 static GRegexMatchFlags
 regex_search_get_match_options (const GtkTextIter *real_start,
                                 const GtkTextIter *end)
@@ -1071,18 +1404,18 @@ smart_forward_search_async_step (GtkSourceSearchContext *search,
 		return TRUE;
 	}
 
-	if (!gtk_text_iter_has_tag (&iter, search->found_tag))
+	if (!iter_has_match (search, &iter))
 	{
-		gtk_text_iter_forward_to_tag_toggle (&iter, search->found_tag);
+		forward_to_match_toggle (search, &iter);
 	}
-	else if (!gtk_text_iter_starts_tag (&iter, search->found_tag))
+	else if (!iter_starts_match (search, &iter))
 	{
-		gtk_text_iter_backward_to_tag_toggle (&iter, search->found_tag);
+		backward_to_match_toggle (search, &iter);
 		region_start = iter;
 	}
 
 	limit = iter;
-	gtk_text_iter_forward_to_tag_toggle (&limit, search->found_tag);
+	forward_to_match_toggle (search, &limit);
 
 	if (search->scan_region != NULL)
 	{
@@ -1208,20 +1541,20 @@ smart_backward_search_async_step (GtkSourceSearchContext *search,
 		return TRUE;
 	}
 
-	if (gtk_text_iter_starts_tag (&iter, search->found_tag) ||
-	    (!gtk_text_iter_has_tag (&iter, search->found_tag) &&
-	     !gtk_text_iter_ends_tag (&iter, search->found_tag)))
+	if (iter_starts_match (search, &iter) ||
+	    (!iter_has_match (search, &iter) &&
+	     !iter_ends_match (search, &iter)))
 	{
-		gtk_text_iter_backward_to_tag_toggle (&iter, search->found_tag);
+		backward_to_match_toggle (search, &iter);
 	}
-	else if (gtk_text_iter_has_tag (&iter, search->found_tag))
+	else if (iter_has_match (search, &iter))
 	{
-		gtk_text_iter_forward_to_tag_toggle (&iter, search->found_tag);
+		forward_to_match_toggle (search, &iter);
 		region_end = iter;
 	}
 
 	limit = iter;
-	gtk_text_iter_backward_to_tag_toggle (&limit, search->found_tag);
+	backward_to_match_toggle (search, &limit);
 
 	if (search->scan_region != NULL)
 	{
@@ -1344,24 +1677,24 @@ adjust_subregion (GtkSourceSearchContext *search,
 	 * not.
 	 */
 
-	if (gtk_text_iter_has_tag (start, search->found_tag))
+	if (iter_has_match (search, start))
 	{
 		if (gtk_source_region_is_empty (search->scan_region))
 		{
 			/* 'start' is in a correct match, we can skip it. */
-			gtk_text_iter_forward_to_tag_toggle (start, search->found_tag);
+			forward_to_match_toggle (search, start);
 		}
 		else
 		{
 			GtkTextIter tag_start = *start;
 			GtkTextIter tag_end = *start;
 
-			if (!gtk_text_iter_starts_tag (&tag_start, search->found_tag))
+			if (!iter_starts_match (search, &tag_start))
 			{
-				gtk_text_iter_backward_to_tag_toggle (&tag_start, search->found_tag);
+				backward_to_match_toggle (search, &tag_start);
 			}
 
-			gtk_text_iter_forward_to_tag_toggle (&tag_end, search->found_tag);
+			forward_to_match_toggle (search, &tag_end);
 
 			if (!region_intersects_subregion (search->scan_region,
 							  &tag_start,
@@ -1385,15 +1718,15 @@ adjust_subregion (GtkSourceSearchContext *search,
 
 	/* Symmetric for 'end'. */
 
-	if (gtk_text_iter_has_tag (end, search->found_tag))
+	if (iter_has_match (search, end))
 	{
 		if (gtk_source_region_is_empty (search->scan_region))
 		{
 			/* 'end' is in a correct match, we can skip it. */
 
-			if (!gtk_text_iter_starts_tag (end, search->found_tag))
+			if (!iter_starts_match (search, end))
 			{
-				gtk_text_iter_backward_to_tag_toggle (end, search->found_tag);
+				backward_to_match_toggle (search, end);
 			}
 		}
 		else
@@ -1401,12 +1734,12 @@ adjust_subregion (GtkSourceSearchContext *search,
 			GtkTextIter tag_start = *end;
 			GtkTextIter tag_end = *end;
 
-			if (!gtk_text_iter_starts_tag (&tag_start, search->found_tag))
+			if (!iter_starts_match (search, &tag_start))
 			{
-				gtk_text_iter_backward_to_tag_toggle (&tag_start, search->found_tag);
+				backward_to_match_toggle (search, &tag_start);
 			}
 
-			gtk_text_iter_forward_to_tag_toggle (&tag_end, search->found_tag);
+			forward_to_match_toggle (search, &tag_end);
 
 			if (!region_intersects_subregion (search->scan_region,
 							  &tag_start,
@@ -1465,17 +1798,17 @@ smart_forward_search_without_scanning (GtkSourceSearchContext *search,
 	{
 		GtkTextIter limit;
 
-		if (!gtk_text_iter_has_tag (&iter, search->found_tag))
+		if (!iter_has_match (search, &iter))
 		{
-			gtk_text_iter_forward_to_tag_toggle (&iter, search->found_tag);
+			forward_to_match_toggle (search, &iter);
 		}
-		else if (!gtk_text_iter_starts_tag (&iter, search->found_tag))
+		else if (!iter_starts_match (search, &iter))
 		{
-			gtk_text_iter_backward_to_tag_toggle (&iter, search->found_tag);
+			backward_to_match_toggle (search, &iter);
 		}
 
 		limit = iter;
-		gtk_text_iter_forward_to_tag_toggle (&limit, search->found_tag);
+		forward_to_match_toggle (search, &limit);
 
 		if (gtk_text_iter_compare (stop_at, &limit) < 0)
 		{
@@ -1506,63 +1839,52 @@ remove_occurrences_in_range (GtkSourceSearchContext *search,
                              GtkTextIter            *start,
                              GtkTextIter            *end)
 {
-	GtkTextIter iter;
-	GtkTextIter match_start;
-	GtkTextIter match_end;
-
-	if ((gtk_text_iter_has_tag (start, search->found_tag) &&
-	     !gtk_text_iter_starts_tag (start, search->found_tag)) ||
+	if ((iter_has_match (search, start) &&
+	     !iter_starts_match (search, start)) ||
 	    (gtk_source_search_settings_get_at_word_boundaries (search->settings) &&
-	     gtk_text_iter_ends_tag (start, search->found_tag)))
+	     iter_ends_match (search, start)))
 	{
-		gtk_text_iter_backward_to_tag_toggle (start, search->found_tag);
+		backward_to_match_toggle (search, start);
 	}
 
-	if ((gtk_text_iter_has_tag (end, search->found_tag) &&
-	     !gtk_text_iter_starts_tag (end, search->found_tag)) ||
+	if ((iter_has_match (search, end) &&
+	     !iter_starts_match (search, end)) ||
 	    (gtk_source_search_settings_get_at_word_boundaries (search->settings) &&
-	     gtk_text_iter_starts_tag (end, search->found_tag)))
+	     iter_starts_match (search, end)))
 	{
-		gtk_text_iter_forward_to_tag_toggle (end, search->found_tag);
+		forward_to_match_toggle (search, end);
 	}
 
-	iter = *start;
-
-	while (smart_forward_search_without_scanning (search, &iter, &match_start, &match_end, end))
+	if (_gtk_source_occurrence_index_remove_range (search->occurrences,
+						       gtk_text_iter_get_offset (start),
+						       gtk_text_iter_get_offset (end)) > 0)
 	{
-		if (search->scan_region == NULL)
-		{
-			/* The occurrence has already been scanned, and thus
-			 * occurrence_count take it into account. */
-			search->occurrences_count--;
-		}
-		else
-		{
-			if (!region_intersects_subregion (search->scan_region,
-							  &match_start,
-							  &match_end))
-			{
-				search->occurrences_count--;
-			}
-		}
-
-		iter = match_end;
+		matches_changed (search);
 	}
 
-	gtk_text_buffer_remove_tag (search->buffer,
-				    search->found_tag,
-				    start,
-				    end);
+	if (search->use_text_tags)
+	{
+		gtk_text_buffer_remove_tag (search->buffer,
+					    search->found_tag,
+					    start,
+					    end);
+	}
 }
 
+/* @matches, if not %NULL, contains the start and end offsets of the
+ * occurrences already found in the subregion, as pairs of gint, instead of
+ * searching them with the GtkTextIter search.
+ */
 static void
-scan_subregion (GtkSourceSearchContext *search,
-                GtkTextIter            *start,
-                GtkTextIter            *end)
+scan_subregion_full (GtkSourceSearchContext *search,
+                     GtkTextIter            *start,
+                     GtkTextIter            *end,
+                     const GArray           *matches)
 {
 	GtkTextIter iter;
 	GtkTextIter *limit;
 	gboolean found = TRUE;
+	guint n_found = 0;
 	const gchar *search_text = gtk_source_search_settings_get_search_text (search->settings);
 
 	/* Make sure the 'found' tag has the priority over syntax highlighting
@@ -1599,6 +1921,66 @@ scan_subregion (GtkSourceSearchContext *search,
 		return;
 	}
 
+	if (matches != NULL)
+	{
+		gint start_offset = gtk_text_iter_get_offset (start);
+		gint end_offset = gtk_text_iter_get_offset (end);
+		guint i;
+
+		for (i = 0; i + 1 < matches->len; i += 2)
+		{
+			gint match_start_offset = g_array_index (matches, gint, i);
+			gint match_end_offset = g_array_index (matches, gint, i + 1);
+			GtkTextIter match_start;
+			GtkTextIter match_end;
+
+			if (match_start_offset < start_offset ||
+			    match_end_offset > end_offset)
+			{
+				continue;
+			}
+
+			gtk_text_buffer_get_iter_at_offset (search->buffer, &match_start, match_start_offset);
+			gtk_text_buffer_get_iter_at_offset (search->buffer, &match_end, match_end_offset);
+
+			/* Like basic_forward_search(). */
+			if (gtk_source_search_settings_get_at_word_boundaries (search->settings) &&
+			    (!_gtk_source_iter_starts_extra_natural_word (&match_start, FALSE) ||
+			     !_gtk_source_iter_ends_extra_natural_word (&match_end, FALSE)))
+			{
+				continue;
+			}
+
+			if (!match_in_search_region (search, &match_start, &match_end))
+			{
+				continue;
+			}
+
+			if (search->use_text_tags)
+			{
+				gtk_text_buffer_apply_tag (search->buffer,
+							   search->found_tag,
+							   &match_start,
+							   &match_end);
+			}
+			else
+			{
+				n_found++;
+			}
+
+			_gtk_source_occurrence_index_add (search->occurrences,
+							  match_start_offset,
+							  match_end_offset);
+		}
+
+		if (n_found > 0)
+		{
+			matches_changed (search);
+		}
+
+		return;
+	}
+
 	iter = *start;
 
 	if (gtk_text_iter_is_end (end))
@@ -1617,19 +1999,41 @@ scan_subregion (GtkSourceSearchContext *search,
 
 		found = basic_forward_search (search, &iter, &match_start, &match_end, limit);
 
-		if (found)
+		if (found && match_in_search_region (search, &match_start, &match_end))
 		{
-			gtk_text_buffer_apply_tag (search->buffer,
-						   search->found_tag,
-						   &match_start,
-						   &match_end);
-
-			search->occurrences_count++;
+			if (search->use_text_tags)
+			{
+				gtk_text_buffer_apply_tag (search->buffer,
+							   search->found_tag,
+							   &match_start,
+							   &match_end);
+			}
+			else
+			{
+				n_found++;
+			}
+
+			_gtk_source_occurrence_index_add (search->occurrences,
+							  gtk_text_iter_get_offset (&match_start),
+							  gtk_text_iter_get_offset (&match_end));
 		}
 
 		iter = match_end;
 
 	} while (found);
+
+	if (n_found > 0)
+	{
+		matches_changed (search);
+	}
+}
+
+static void
+scan_subregion (GtkSourceSearchContext *search,
+                GtkTextIter            *start,
+                GtkTextIter            *end)
+{
+	scan_subregion_full (search, start, end, NULL);
 }
 
 static void
@@ -1731,6 +2135,323 @@ scan_region_backward (GtkSourceSearchContext *search,
 	}
 }
 
+typedef struct
+{
+	GtkSourceSearchContext *search;
+	GtkTextIter limit;
+
+	/* The adjusted subregion, in characters from the start of the
+	 * shared text.
+	 */
+	gint start_pos;
+	gint end_pos;
+
+	/* Where the next occurrence can start, occurrences don't overlap,
+	 * like with the GtkTextIter search.
+	 */
+	gint next_pos;
+
+	const gchar *search_text;
+	gsize search_len;
+	gint search_chars;
+	guint case_sensitive : 1;
+
+	/* Pairs of offsets of the occurrences found in the shared text, or
+	 * %NULL if the GtkTextIter search must be used.
+	 */
+	GArray *matches;
+} SharedTextScan;
+
+/* Whether @search can take part in a scan of the chunk starting at
+ * @chunk_start, done for another non-regex search context of the buffer.
+ *
+ * The search texts are matched in the slice of the chunk, so the search
+ * text must not contain a line terminator, the GtkTextIter search matching
+ * each line on its own. A case insensitive search folds the case and
+ * normalizes the text, which only gives the same result as an ASCII
+ * comparison with an ASCII search text. The visible-only search contexts
+ * don't share their scan, the offsets in the visible text can't be
+ * mapped back to the buffer.
+ */
+static gboolean
+normal_search_can_share_scan (GtkSourceSearchContext *search,
+                              const GtkTextIter      *chunk_start)
+{
+	const gchar *search_text;
+	GtkTextIter scan_start;
+	GtkTextIter scan_end;
+
+	if (search->buffer == NULL ||
+	    search->scan_region == NULL ||
+	    gtk_source_search_settings_get_regex_enabled (search->settings) ||
+	    gtk_source_search_settings_get_visible_only (search->settings))
+	{
+		return FALSE;
+	}
+
+	search_text = gtk_source_search_settings_get_search_text (search->settings);
+
+	if (search_text == NULL ||
+	    strpbrk (search_text, "\n\r") != NULL ||
+	    strstr (search_text, "\xe2\x80\xa9") != NULL ||
+	    (!gtk_source_search_settings_get_case_sensitive (search->settings) &&
+	     !g_str_is_ascii (search_text)))
+	{
+		return FALSE;
+	}
+
+	if (!get_first_subregion (search->scan_region, &scan_start, &scan_end))
+	{
+		return FALSE;
+	}
+
+	return gtk_text_iter_equal (&scan_start, chunk_start);
+}
+
+/* Finds the occurrences of the search texts of all the @scans in @text,
+ * in one pass. Only the scans with a matches array take part.
+ * @text_offset is the offset of @text in the buffer.
+ */
+static void
+match_shared_text (GArray      *scans,
+                   const gchar *text,
+                   gint         text_offset)
+{
+	gboolean first_bytes[256] = { FALSE };
+	const gchar *p;
+	gint pos = 0;
+	guint i;
+
+	for (i = 0; i < scans->len; i++)
+	{
+		SharedTextScan *scan = &g_array_index (scans, SharedTextScan, i);
+		guchar c = scan->search_text[0];
+
+		if (scan->matches == NULL)
+		{
+			continue;
+		}
+
+		if (scan->case_sensitive)
+		{
+			first_bytes[c] = TRUE;
+		}
+		else
+		{
+			first_bytes[(guchar) g_ascii_tolower (c)] = TRUE;
+			first_bytes[(guchar) g_ascii_toupper (c)] = TRUE;
+		}
+	}
+
+	/* A search text starts with a whole character, so a match can only
+	 * start on a character boundary.
+	 */
+	for (p = text; *p != '\0'; p++)
+	{
+		if (first_bytes[(guchar) *p])
+		{
+			for (i = 0; i < scans->len; i++)
+			{
+				SharedTextScan *scan = &g_array_index (scans, SharedTextScan, i);
+				gint match_end;
+
+				if (scan->matches == NULL ||
+				    pos < scan->start_pos ||
+				    pos < scan->next_pos)
+				{
+					continue;
+				}
+
+				match_end = pos + scan->search_chars;
+
+				if (match_end > scan->end_pos)
+				{
+					continue;
+				}
+
+				if (scan->case_sensitive ?
+				    strncmp (p, scan->search_text, scan->search_len) == 0 :
+				    g_ascii_strncasecmp (p, scan->search_text, scan->search_len) == 0)
+				{
+					gint match_start = text_offset + pos;
+
+					match_end += text_offset;
+					g_array_append_val (scan->matches, match_start);
+					g_array_append_val (scan->matches, match_end);
+
+					scan->next_pos = match_end - text_offset;
+				}
+			}
+		}
+
+		if ((*p & 0xC0) != 0x80)
+		{
+			pos++;
+		}
+	}
+}
+
+/* Scans the first chunk of the scan region for @search, and for the other
+ * non-regex search contexts of the buffer whose scan is at the same place.
+ * The slice of the chunk is retrieved once, and the search texts are all
+ * matched against it in one pass, the search contexts then only add the
+ * occurrences found.
+ */
+static void
+scan_shared_chunk (GtkSourceSearchContext *search)
+{
+	GArray *scans;
+	const GList *l;
+	GtkTextIter chunk_start;
+	GtkTextIter chunk_end;
+	GtkTextIter chunk_limit;
+	GtkTextIter text_start;
+	GtkTextIter text_end;
+	gboolean has_objects;
+	gboolean is_ascii;
+	gchar *text;
+	guint i;
+
+	if (!get_first_subregion (search->scan_region, &chunk_start, &chunk_end) ||
+	    !normal_search_can_share_scan (search, &chunk_start))
+	{
+		scan_region_forward (search, search->scan_region);
+		return;
+	}
+
+	chunk_limit = chunk_start;
+	gtk_text_iter_forward_lines (&chunk_limit, SCAN_BATCH_SIZE);
+
+	scans = g_array_new (FALSE, TRUE, sizeof (SharedTextScan));
+
+	for (l = _gtk_source_buffer_get_search_contexts (GTK_SOURCE_BUFFER (search->buffer));
+	     l != NULL;
+	     l = l->next)
+	{
+		GtkSourceSearchContext *cur = l->data;
+		SharedTextScan scan = { NULL };
+		GtkTextIter scan_start;
+
+		if (!normal_search_can_share_scan (cur, &chunk_start))
+		{
+			continue;
+		}
+
+		scan.search = g_object_ref (cur);
+
+		get_first_subregion (cur->scan_region, &scan_start, &scan.limit);
+
+		if (gtk_text_iter_compare (&chunk_limit, &scan.limit) < 0)
+		{
+			scan.limit = chunk_limit;
+		}
+
+		g_array_append_val (scans, scan);
+	}
+
+	if (scans->len == 1)
+	{
+		g_object_unref (g_array_index (scans, SharedTextScan, 0).search);
+		g_array_free (scans, TRUE);
+
+		scan_region_forward (search, search->scan_region);
+		return;
+	}
+
+	/* The text covers the adjusted subregions of all the search
+	 * contexts.
+	 */
+	text_start = chunk_start;
+	text_end = chunk_start;
+
+	for (i = 0; i < scans->len; i++)
+	{
+		SharedTextScan *scan = &g_array_index (scans, SharedTextScan, i);
+		GtkTextIter start = chunk_start;
+		GtkTextIter end = scan->limit;
+
+		adjust_subregion (scan->search, &start, &end);
+
+		scan->start_pos = gtk_text_iter_get_offset (&start);
+		scan->end_pos = gtk_text_iter_get_offset (&end);
+
+		if (gtk_text_iter_compare (&start, &text_start) < 0)
+		{
+			text_start = start;
+		}
+
+		if (gtk_text_iter_compare (&text_end, &end) < 0)
+		{
+			text_end = end;
+		}
+	}
+
+	/* The slice has one character per buffer position, so that the
+	 * offsets of the occurrences are the ones of the buffer. With
+	 * paintables or child anchors, the GtkTextIter search skips them.
+	 */
+	text = gtk_text_iter_get_slice (&text_start, &text_end);
+	has_objects = strstr (text, "\xef\xbf\xbc") != NULL;
+	is_ascii = g_str_is_ascii (text);
+
+	for (i = 0; i < scans->len; i++)
+	{
+		SharedTextScan *scan = &g_array_index (scans, SharedTextScan, i);
+		GtkSourceSearchSettings *settings = scan->search->settings;
+
+		scan->search_text = gtk_source_search_settings_get_search_text (settings);
+		scan->search_len = strlen (scan->search_text);
+		scan->search_chars = g_utf8_strlen (scan->search_text, -1);
+		scan->case_sensitive = gtk_source_search_settings_get_case_sensitive (settings);
+		scan->start_pos -= gtk_text_iter_get_offset (&text_start);
+		scan->end_pos -= gtk_text_iter_get_offset (&text_start);
+		scan->next_pos = scan->start_pos;
+
+		if (!has_objects && (scan->case_sensitive || is_ascii))
+		{
+			scan->matches = g_array_new (FALSE, FALSE, sizeof (gint));
+		}
+	}
+
+	match_shared_text (scans, text, gtk_text_iter_get_offset (&text_start));
+
+	for (i = 0; i < scans->len; i++)
+	{
+		SharedTextScan *scan = &g_array_index (scans, SharedTextScan, i);
+		GtkSourceSearchContext *cur = scan->search;
+		GtkTextIter start = chunk_start;
+
+		/* A previous scan may have emitted a signal destroying the
+		 * buffer.
+		 */
+		if (cur->buffer != NULL && cur->scan_region != NULL)
+		{
+			GtkTextIter end = scan->limit;
+
+			if (scan->matches != NULL)
+			{
+				cur->shared_chunks++;
+			}
+
+			scan_subregion_full (cur, &start, &end, scan->matches);
+
+			/* The adjusted subregion may start after the chunk. */
+			if (cur->scan_region != NULL)
+			{
+				gtk_source_region_subtract_subregion (cur->scan_region,
+								      &chunk_start,
+								      &scan->limit);
+			}
+		}
+
+		g_clear_pointer (&scan->matches, g_array_unref);
+		g_object_unref (cur);
+	}
+
+	g_free (text);
+	g_array_free (scans, TRUE);
+}
+
 static void
 resume_task (GtkSourceSearchContext *search)
 {
@@ -1795,7 +2516,7 @@ idle_scan_normal_search (GtkSourceSearchContext *search)
 		return G_SOURCE_CONTINUE;
 	}
 
-	scan_region_forward (search, search->scan_region);
+	scan_shared_chunk (search);
 
 	if (gtk_source_region_is_empty (search->scan_region))
 	{
@@ -1818,6 +2539,7 @@ idle_scan_normal_search (GtkSourceSearchContext *search)
  * pattern matches the old occurrences.
  * The drawback of clearing the highlighting is that for small documents, there
  * is some flickering.
+ * Without the found_tag, the old occurrences are not kept at all.
  */
 static void
 regex_search_handle_high_priority_region (GtkSourceSearchContext *search)
@@ -1825,6 +2547,11 @@ regex_search_handle_high_priority_region (GtkSourceSearchContext *search)
 	GtkSourceRegion *region;
 	GtkSourceRegionIter region_iter;
 
+	if (!search->use_text_tags)
+	{
+		return;
+	}
+
 	region = gtk_source_region_intersect_region (search->high_priority_region,
 						     search->scan_region);
 
@@ -1858,51 +2585,62 @@ regex_search_handle_high_priority_region (GtkSourceSearchContext *search)
 	g_clear_object (&region);
 }
 
-/* Returns TRUE if the segment is finished, and FALSE on partial match. */
+/* Scans [@segment_start, @segment_end]. @subject is the text between
+ * @real_start and @segment_end, @start_pos being the position of
+ * @segment_start in @subject, in bytes. It is NULL if there is no regex.
+ * Returns TRUE if the segment is finished, and FALSE on partial match.
+ */
 static gboolean
-regex_search_scan_segment (GtkSourceSearchContext *search,
+regex_search_scan_subject (GtkSourceSearchContext *search,
                            const GtkTextIter      *segment_start,
                            const GtkTextIter      *segment_end,
+                           const GtkTextIter      *real_start,
+                           const gchar            *subject,
+                           gssize                  subject_length,
+                           gint                    start_pos,
+                           GRegexMatchFlags        match_options,
                            GtkTextIter            *stopped_at)
 {
-	GtkTextIter real_start;
-	gint start_pos;
-	gchar *subject;
-	gssize subject_length;
-	GRegexMatchFlags match_options;
 	ImplMatchInfo *match_info;
 	GtkTextIter iter;
 	gint iter_byte_pos;
 	gboolean segment_finished;
 	GtkTextIter match_start;
 	GtkTextIter match_end;
+	guint n_changed;
 
 	g_assert (stopped_at != NULL);
 
-	gtk_text_buffer_remove_tag (search->buffer,
-				    search->found_tag,
-				    segment_start,
-				    segment_end);
+	if (search->use_text_tags)
+	{
+		gtk_text_buffer_remove_tag (search->buffer,
+					    search->found_tag,
+					    segment_start,
+					    segment_end);
+	}
+
+	n_changed = _gtk_source_occurrence_index_remove_range (search->occurrences,
+							       gtk_text_iter_get_offset (segment_start),
+							       gtk_text_iter_get_offset (segment_end));
 
 	if (search->regex == NULL ||
-	    search->regex_error != NULL)
+	    search->regex_error != NULL ||
+	    subject == NULL)
 	{
+		if (n_changed > 0)
+		{
+			matches_changed (search);
+		}
+
 		*stopped_at = *segment_end;
 		return TRUE;
 	}
 
-	regex_search_get_real_start (search,
-				     segment_start,
-				     &real_start,
-				     &start_pos);
-
 	DEBUG ({
 	       g_print ("\n*** regex search - scan segment ***\n");
 	       g_print ("start position in the subject (in bytes): %d\n", start_pos);
 	});
 
-	match_options = regex_search_get_match_options (&real_start, segment_end);
-
 	if (match_options & G_REGEX_MATCH_NOTBOL)
 	{
 		DEBUG ({
@@ -1924,9 +2662,6 @@ regex_search_scan_segment (GtkSourceSearchContext *search,
 		});
 	}
 
-	subject = gtk_text_iter_get_visible_text (&real_start, segment_end);
-	subject_length = strlen (subject);
-
 	DEBUG ({
 	       gchar *subject_escaped = gtk_source_utils_escape_search_text (subject);
 	       g_print ("subject (escaped): %s\n", subject_escaped);
@@ -1941,7 +2676,7 @@ regex_search_scan_segment (GtkSourceSearchContext *search,
 	                       &match_info,
 	                       &search->regex_error);
 
-	iter = real_start;
+	iter = *real_start;
 	iter_byte_pos = 0;
 
 	while (regex_search_fetch_match (match_info,
@@ -1952,10 +2687,23 @@ regex_search_scan_segment (GtkSourceSearchContext *search,
 					 &match_start,
 					 &match_end))
 	{
-		gtk_text_buffer_apply_tag (search->buffer,
-					   search->found_tag,
-					   &match_start,
-					   &match_end);
+		if (!match_in_search_region (search, &match_start, &match_end))
+		{
+			impl_match_info_next (match_info, &search->regex_error);
+			continue;
+		}
+
+		if (search->use_text_tags)
+		{
+			gtk_text_buffer_apply_tag (search->buffer,
+						   search->found_tag,
+						   &match_start,
+						   &match_end);
+		}
+		else
+		{
+			n_changed++;
+		}
 
 		DEBUG ({
 			 gchar *match_text = gtk_text_iter_get_visible_text (&match_start, &match_end);
@@ -1965,11 +2713,18 @@ regex_search_scan_segment (GtkSourceSearchContext *search,
 			 g_free (match_escaped);
 		});
 
-		search->occurrences_count++;
+		_gtk_source_occurrence_index_add (search->occurrences,
+						  gtk_text_iter_get_offset (&match_start),
+						  gtk_text_iter_get_offset (&match_end));
 
 		impl_match_info_next (match_info, &search->regex_error);
 	}
 
+	if (n_changed > 0)
+	{
+		matches_changed (search);
+	}
+
 	if (search->regex_error != NULL)
 	{
 		g_object_notify_by_pspec (G_OBJECT (search), properties [PROP_REGEX_ERROR]);
@@ -1998,12 +2753,54 @@ regex_search_scan_segment (GtkSourceSearchContext *search,
 		segment_finished = TRUE;
 	}
 
-	g_free (subject);
 	impl_match_info_free (match_info);
 
 	return segment_finished;
 }
 
+/* Returns TRUE if the segment is finished, and FALSE on partial match. */
+static gboolean
+regex_search_scan_segment (GtkSourceSearchContext *search,
+                           const GtkTextIter      *segment_start,
+                           const GtkTextIter      *segment_end,
+                           GtkTextIter            *stopped_at)
+{
+	GtkTextIter real_start = *segment_start;
+	gint start_pos = 0;
+	gchar *subject = NULL;
+	gssize subject_length = 0;
+	GRegexMatchFlags match_options = 0;
+	gboolean segment_finished;
+
+	if (search->regex != NULL &&
+	    search->regex_error == NULL)
+	{
+		regex_search_get_real_start (search,
+					     segment_start,
+					     &real_start,
+					     &start_pos);
+
+		match_options = regex_search_get_match_options (&real_start, segment_end);
+
+		subject = gtk_text_iter_get_visible_text (&real_start, segment_end);
+		subject_length = strlen (subject);
+	}
+
+	segment_finished = regex_search_scan_subject (search,
+						      segment_start,
+						      segment_end,
+						      &real_start,
+						      subject,
+						      subject_length,
+						      start_pos,
+						      match_options,
+						      stopped_at);
+
+	g_free (subject);
+
+	return segment_finished;
+}
+
 static void
 regex_search_scan_chunk (GtkSourceSearchContext *search,
                          const GtkTextIter      *chunk_start,
@@ -2049,26 +2846,207 @@ regex_search_scan_chunk (GtkSourceSearchContext *search,
 	}
 }
 
+typedef struct
+{
+	GtkSourceSearchContext *search;
+
+	/* Where the scan stopped on a partial match. */
+	GtkTextIter stopped_at;
+	guint partial : 1;
+} SharedScan;
+
+/* Whether @search can take part in a scan of the chunk starting at
+ * @chunk_start, done for another regex search context of the buffer.
+ */
+static gboolean
+regex_search_can_share_scan (GtkSourceSearchContext *search,
+                             const GtkTextIter      *chunk_start)
+{
+	GtkTextIter scan_start;
+
+	if (search->buffer == NULL ||
+	    search->regex == NULL ||
+	    search->regex_error != NULL ||
+	    search->scan_region == NULL ||
+	    !gtk_source_search_settings_get_regex_enabled (search->settings))
+	{
+		return FALSE;
+	}
+
+	if (!gtk_source_region_get_bounds (search->scan_region, &scan_start, NULL))
+	{
+		return FALSE;
+	}
+
+	return gtk_text_iter_equal (&scan_start, chunk_start);
+}
+
+/* Scans the chunk for @search, and for the other regex search contexts of
+ * the buffer whose scan is at the same place, which is the common case when
+ * the search contexts are created at the same time or when text is inserted
+ * or deleted. The text of each line is fetched only once, and matched
+ * against each regex. A search context which has a partial match leaves the
+ * shared scan and continues alone.
+ */
 static void
-regex_search_scan_next_chunk (GtkSourceSearchContext *search)
+regex_search_scan_shared_chunk (GtkSourceSearchContext *search,
+                                const GtkTextIter      *chunk_start,
+                                const GtkTextIter      *chunk_end)
 {
-	GtkTextIter chunk_start;
-	GtkTextIter chunk_end;
+	GArray *scans;
+	const GList *l;
+	GtkTextIter segment_start = *chunk_start;
+	gint max_lookbehind = 0;
+	guint n_active;
+	guint i;
 
-	if (gtk_source_region_is_empty (search->scan_region))
+	if (!regex_search_can_share_scan (search, chunk_start))
 	{
+		regex_search_scan_chunk (search, chunk_start, chunk_end);
 		return;
 	}
 
-	if (!gtk_source_region_get_bounds (search->scan_region, &chunk_start, NULL))
+	scans = g_array_new (FALSE, TRUE, sizeof (SharedScan));
+
+	for (l = _gtk_source_buffer_get_search_contexts (GTK_SOURCE_BUFFER (search->buffer));
+	     l != NULL;
+	     l = l->next)
+	{
+		GtkSourceSearchContext *cur = l->data;
+
+		if (cur == search ||
+		    regex_search_can_share_scan (cur, chunk_start))
+		{
+			SharedScan scan = { g_object_ref (cur) };
+
+			g_array_append_val (scans, scan);
+
+			max_lookbehind = MAX (max_lookbehind,
+					      impl_regex_get_max_lookbehind (cur->regex));
+		}
+	}
+
+	if (scans->len == 1)
+	{
+		g_object_unref (search);
+		g_array_free (scans, TRUE);
+
+		regex_search_scan_chunk (search, chunk_start, chunk_end);
+		return;
+	}
+
+	for (i = 0; i < scans->len; i++)
+	{
+		g_array_index (scans, SharedScan, i).search->shared_chunks++;
+	}
+
+	n_active = scans->len;
+
+	while (n_active > 0 &&
+	       gtk_text_iter_compare (&segment_start, chunk_end) < 0)
+	{
+		GtkTextIter segment_end;
+		GtkTextIter real_start;
+		gint start_pos;
+		GRegexMatchFlags match_options;
+		gchar *subject;
+		gssize subject_length;
+
+		segment_end = segment_start;
+		gtk_text_iter_forward_line (&segment_end);
+
+		/* With the largest lookbehind, the subject is suitable for all
+		 * the regexes.
+		 */
+		get_real_start (&segment_start, max_lookbehind, &real_start, &start_pos);
+		match_options = regex_search_get_match_options (&real_start, &segment_end);
+		subject = gtk_text_iter_get_visible_text (&real_start, &segment_end);
+		subject_length = strlen (subject);
+
+		for (i = 0; i < scans->len; i++)
+		{
+			SharedScan *scan = &g_array_index (scans, SharedScan, i);
+
+			if (scan->partial)
+			{
+				continue;
+			}
+
+			if (!regex_search_scan_subject (scan->search,
+							&segment_start,
+							&segment_end,
+							&real_start,
+							subject,
+							subject_length,
+							start_pos,
+							match_options,
+							&scan->stopped_at))
+			{
+				scan->partial = TRUE;
+				n_active--;
+			}
+		}
+
+		g_free (subject);
+
+		segment_start = segment_end;
+	}
+
+	for (i = 0; i < scans->len; i++)
+	{
+		SharedScan *scan = &g_array_index (scans, SharedScan, i);
+		GtkSourceSearchContext *cur = scan->search;
+		GtkTextIter *scanned_end = scan->partial ? &scan->stopped_at : &segment_start;
+
+		if (cur->buffer != NULL && cur->scan_region != NULL)
+		{
+			gtk_source_region_subtract_subregion (cur->scan_region,
+							      chunk_start,
+							      scanned_end);
+
+			if (cur->task_region != NULL)
+			{
+				gtk_source_region_subtract_subregion (cur->task_region,
+								      chunk_start,
+								      scanned_end);
+			}
+
+			if (scan->partial)
+			{
+				regex_search_scan_chunk (cur, &scan->stopped_at, &segment_start);
+			}
+		}
+
+		g_object_unref (cur);
+	}
+
+	g_array_free (scans, TRUE);
+}
+
+static void
+regex_search_scan_next_chunk (GtkSourceSearchContext *search)
+{
+	GtkTextIter chunk_start;
+	GtkTextIter chunk_end;
+	GtkTextIter subregion_end;
+
+	if (!get_first_subregion (search->scan_region, &chunk_start, &subregion_end))
 	{
 		return;
 	}
 
+	/* Don't scan the lines between the subregions, which can be far from
+	 * each other with a search_region or after some modifications.
+	 */
 	chunk_end = chunk_start;
 	gtk_text_iter_forward_lines (&chunk_end, SCAN_BATCH_SIZE);
 
-	regex_search_scan_chunk (search, &chunk_start, &chunk_end);
+	if (gtk_text_iter_compare (&subregion_end, &chunk_end) < 0)
+	{
+		chunk_end = subregion_end;
+	}
+
+	regex_search_scan_shared_chunk (search, &chunk_start, &chunk_end);
 }
 
 static gboolean
@@ -2112,18 +3090,32 @@ idle_scan_regex_search (GtkSourceSearchContext *search)
 }
 
 static gboolean
-idle_scan_cb (GtkSourceSearchContext *search)
+idle_scan_cb (gint64   deadline,
+              gpointer user_data)
 {
-	if (search->buffer == NULL)
+	GtkSourceSearchContext *search = user_data;
+	gsize handler_id = search->idle_scan_id;
+	gboolean ret;
+
+	/* Scan batches until the deadline, unless the scan is reinstalled. */
+	do
 	{
-		search->idle_scan_id = 0;
-		clear_search (search);
-		return G_SOURCE_REMOVE;
+		if (search->buffer == NULL)
+		{
+			search->idle_scan_id = 0;
+			clear_search (search);
+			return G_SOURCE_REMOVE;
+		}
+
+		ret = gtk_source_search_settings_get_regex_enabled (search->settings) ?
+		      idle_scan_regex_search (search) :
+		      idle_scan_normal_search (search);
 	}
+	while (ret == G_SOURCE_CONTINUE &&
+	       search->idle_scan_id == handler_id &&
+	       g_get_monotonic_time () < deadline);
 
-	return gtk_source_search_settings_get_regex_enabled (search->settings) ?
-	       idle_scan_regex_search (search) :
-	       idle_scan_normal_search (search);
+	return ret;
 }
 
 static void
@@ -2131,7 +3123,12 @@ install_idle_scan (GtkSourceSearchContext *search)
 {
 	if (search->idle_scan_id == 0)
 	{
-		search->idle_scan_id = g_idle_add ((GSourceFunc)idle_scan_cb, search);
+		search->idle_scan_id =
+			_gtk_source_scheduler_add_for_owner (search->buffer,
+			                                     GTK_SOURCE_SCHEDULER_TASK_SEARCH,
+			                                     idle_scan_cb,
+			                                     search,
+			                                     NULL);
 	}
 }
 
@@ -2147,18 +3144,18 @@ smart_forward_search_step (GtkSourceSearchContext *search,
 	GtkTextIter region_start = *start_at;
 	GtkSourceRegion *region = NULL;
 
-	if (!gtk_text_iter_has_tag (&iter, search->found_tag))
+	if (!iter_has_match (search, &iter))
 	{
-		gtk_text_iter_forward_to_tag_toggle (&iter, search->found_tag);
+		forward_to_match_toggle (search, &iter);
 	}
-	else if (!gtk_text_iter_starts_tag (&iter, search->found_tag))
+	else if (!iter_starts_match (search, &iter))
 	{
-		gtk_text_iter_backward_to_tag_toggle (&iter, search->found_tag);
+		backward_to_match_toggle (search, &iter);
 		region_start = iter;
 	}
 
 	limit = iter;
-	gtk_text_iter_forward_to_tag_toggle (&limit, search->found_tag);
+	forward_to_match_toggle (search, &limit);
 
 	if (search->scan_region != NULL)
 	{
@@ -2243,20 +3240,20 @@ smart_backward_search_step (GtkSourceSearchContext *search,
 	GtkTextIter region_end = *start_at;
 	GtkSourceRegion *region = NULL;
 
-	if (gtk_text_iter_starts_tag (&iter, search->found_tag) ||
-	    (!gtk_text_iter_has_tag (&iter, search->found_tag) &&
-	     !gtk_text_iter_ends_tag (&iter, search->found_tag)))
+	if (iter_starts_match (search, &iter) ||
+	    (!iter_has_match (search, &iter) &&
+	     !iter_ends_match (search, &iter)))
 	{
-		gtk_text_iter_backward_to_tag_toggle (&iter, search->found_tag);
+		backward_to_match_toggle (search, &iter);
 	}
-	else if (gtk_text_iter_has_tag (&iter, search->found_tag))
+	else if (iter_has_match (search, &iter))
 	{
-		gtk_text_iter_forward_to_tag_toggle (&iter, search->found_tag);
+		forward_to_match_toggle (search, &iter);
 		region_end = iter;
 	}
 
 	limit = iter;
-	gtk_text_iter_backward_to_tag_toggle (&limit, search->found_tag);
+	backward_to_match_toggle (search, &limit);
 
 	if (search->scan_region != NULL)
 	{
@@ -2347,7 +3344,24 @@ add_subregion_to_scan (GtkSourceSearchContext *search,
 		print_region (search->scan_region);
 	});
 
-	gtk_source_region_add_subregion (search->scan_region, &start, &end);
+	if (search->search_region != NULL)
+	{
+		GtkSourceRegion *region;
+
+		region = gtk_source_region_intersect_subregion (search->search_region,
+								&start,
+								&end);
+
+		if (region != NULL)
+		{
+			gtk_source_region_add_region (search->scan_region, region);
+			g_object_unref (region);
+		}
+	}
+	else
+	{
+		gtk_source_region_add_subregion (search->scan_region, &start, &end);
+	}
 
 	DEBUG ({
 		g_print ("add_subregion_to_scan(): region to scan, after:\n");
@@ -2375,6 +3389,8 @@ update_regex (GtkSourceSearchContext *search)
 		regex_error_changed = TRUE;
 	}
 
+	search->regex_max_newlines = -1;
+
 	if (search_text != NULL &&
 	    gtk_source_search_settings_get_regex_enabled (search->settings))
 	{
@@ -2402,6 +3418,12 @@ update_regex (GtkSourceSearchContext *search)
 		{
 			regex_error_changed = TRUE;
 		}
+		else
+		{
+			search->regex_max_newlines = impl_regex_can_match_newline (search->regex) ?
+			                             impl_regex_get_max_newlines (search->regex) :
+			                             0;
+		}
 
 		if (gtk_source_search_settings_get_at_word_boundaries (search->settings))
 		{
@@ -2443,6 +3465,172 @@ update (GtkSourceSearchContext *search)
 	_gtk_source_buffer_internal_emit_search_start (buffer_internal, search);
 }
 
+/* Extends [@start, @end] to whole lines. */
+static void
+extend_to_lines (GtkTextIter *start,
+                 GtkTextIter *end)
+{
+	gtk_text_iter_set_line_offset (start, 0);
+
+	if (!gtk_text_iter_ends_line (end))
+	{
+		gtk_text_iter_forward_to_line_end (end);
+	}
+}
+
+/* Before an insertion or deletion in [@start, @end], with a regex search.
+ * The occurrences of the modified lines are removed, and the following ones
+ * are moved, so that the count and the positions stay right while the
+ * modified text is re-scanned.
+ */
+static void
+regex_search_text_will_change (GtkSourceSearchContext *search,
+                               const GtkTextIter      *start,
+                               const GtkTextIter      *end,
+                               gint                    delta)
+{
+	GtkTextIter lines_start = *start;
+	GtkTextIter lines_end = *end;
+
+	extend_to_lines (&lines_start, &lines_end);
+	remove_occurrences_in_range (search, &lines_start, &lines_end);
+
+	_gtk_source_occurrence_index_shift (search->occurrences,
+					    gtk_text_iter_get_offset (end),
+					    delta);
+}
+
+/* After an insertion or deletion, [@start, @end] being the new text, or
+ * the place of the deleted text. The occurrences are updated in place: if
+ * a match cannot span several lines, only the modified lines are
+ * re-scanned. If a match can contain at most n line terminators, only the
+ * n lines around them are added, and the following lines that a
+ * lookbehind can see. Otherwise a modification can change any occurrence,
+ * for example with the regex "(a\n)+", so the whole buffer is re-scanned.
+ */
+static void
+regex_search_text_changed (GtkSourceSearchContext *search,
+                           const GtkTextIter      *start,
+                           const GtkTextIter      *end)
+{
+	GtkTextIter scan_start = *start;
+	GtkTextIter scan_end = *end;
+
+	if (search->regex_max_newlines == 0)
+	{
+		extend_to_lines (&scan_start, &scan_end);
+	}
+	else if (search->regex_max_newlines > 0)
+	{
+		gtk_text_iter_forward_chars (&scan_end,
+					     impl_regex_get_max_lookbehind (search->regex));
+
+		gtk_text_iter_backward_lines (&scan_start, search->regex_max_newlines);
+		gtk_text_iter_forward_lines (&scan_end, search->regex_max_newlines);
+		extend_to_lines (&scan_start, &scan_end);
+
+		/* The scan removes the occurrences it overlaps, so it must
+		 * find them again from their start.
+		 */
+		if (iter_has_match (search, &scan_start) &&
+		    !iter_starts_match (search, &scan_start))
+		{
+			backward_to_match_toggle (search, &scan_start);
+			gtk_text_iter_set_line_offset (&scan_start, 0);
+		}
+	}
+	else
+	{
+		gtk_text_buffer_get_bounds (search->buffer, &scan_start, &scan_end);
+	}
+
+	add_subregion_to_scan (search, &scan_start, &scan_end);
+}
+
+/* Whether the buffer holds its changes, to report them at once with
+ * text_replaced_cb().
+ */
+static gboolean
+changes_held (GtkSourceSearchContext *search)
+{
+	return _gtk_source_buffer_get_changes_held (GTK_SOURCE_BUFFER (search->buffer));
+}
+
+/* Searching while the buffer holds its changes, e.g. from a Vim macro,
+ * needs the occurrences of the text as it is now.
+ */
+static void
+flush_held_changes (GtkSourceSearchContext *search)
+{
+	_gtk_source_buffer_flush_held_changes (GTK_SOURCE_BUFFER (search->buffer));
+}
+
+static void
+text_replaced_cb (GtkSourceSearchContext *search,
+                  gint                    start_offset,
+                  gint                    old_end_offset,
+                  gint                    new_end_offset)
+{
+	const gchar *search_text = gtk_source_search_settings_get_search_text (search->settings);
+	GtkTextIter start;
+	GtkTextIter end;
+
+	clear_task (search);
+
+	if (gtk_source_search_settings_get_regex_enabled (search->settings) &&
+	    search->regex == NULL)
+	{
+		update (search);
+		return;
+	}
+
+	if (search_text == NULL)
+	{
+		return;
+	}
+
+	/* The occurrences are still at their offsets from before the
+	 * changes: drop the ones of the replaced text and move the following
+	 * ones.
+	 */
+	if (_gtk_source_occurrence_index_remove_range (search->occurrences,
+						       start_offset,
+						       old_end_offset) > 0)
+	{
+		matches_changed (search);
+	}
+
+	_gtk_source_occurrence_index_shift (search->occurrences,
+					    old_end_offset,
+					    new_end_offset - old_end_offset);
+
+	gtk_text_buffer_get_iter_at_offset (search->buffer, &start, start_offset);
+	gtk_text_buffer_get_iter_at_offset (search->buffer, &end, new_end_offset);
+
+	/* Then as for a single insertion or deletion, on the new text. */
+	if (gtk_source_search_settings_get_regex_enabled (search->settings))
+	{
+		GtkTextIter lines_start = start;
+		GtkTextIter lines_end = end;
+
+		extend_to_lines (&lines_start, &lines_end);
+		remove_occurrences_in_range (search, &lines_start, &lines_end);
+
+		regex_search_text_changed (search, &start, &end);
+	}
+	else
+	{
+		GtkTextIter lines_start = start;
+		GtkTextIter lines_end = end;
+
+		gtk_text_iter_backward_lines (&lines_start, search->text_nb_lines);
+		gtk_text_iter_forward_lines (&lines_end, search->text_nb_lines);
+
+		remove_occurrences_in_range (search, &lines_start, &lines_end);
+		add_subregion_to_scan (search, &lines_start, &lines_end);
+	}
+}
+
 static void
 insert_text_before_cb (GtkSourceSearchContext *search,
                        GtkTextIter            *location,
@@ -2453,14 +3641,32 @@ insert_text_before_cb (GtkSourceSearchContext *search,
 
 	clear_task (search);
 
-	if (search_text != NULL &&
-	    !gtk_source_search_settings_get_regex_enabled (search->settings))
+	if (changes_held (search))
+	{
+		return;
+	}
+
+	if (gtk_source_search_settings_get_regex_enabled (search->settings))
+	{
+		if (search->regex != NULL)
+		{
+			regex_search_text_will_change (search,
+						       location,
+						       location,
+						       g_utf8_strlen (text, length));
+		}
+	}
+	else if (search_text != NULL)
 	{
 		GtkTextIter start = *location;
 		GtkTextIter end = *location;
 
 		remove_occurrences_in_range (search, &start, &end);
 		add_subregion_to_scan (search, &start, &end);
+
+		_gtk_source_occurrence_index_shift (search->occurrences,
+						    gtk_text_iter_get_offset (location),
+						    g_utf8_strlen (text, length));
 	}
 }
 
@@ -2470,20 +3676,32 @@ insert_text_after_cb (GtkSourceSearchContext *search,
                       gchar                  *text,
                       gint                    length)
 {
-	if (gtk_source_search_settings_get_regex_enabled (search->settings))
+	GtkTextIter start;
+	GtkTextIter end;
+
+	if (changes_held (search))
 	{
-		update (search);
+		return;
 	}
-	else
+
+	if (gtk_source_search_settings_get_regex_enabled (search->settings) &&
+	    search->regex == NULL)
 	{
-		GtkTextIter start;
-		GtkTextIter end;
+		update (search);
+		return;
+	}
 
-		start = end = *location;
+	start = end = *location;
 
-		gtk_text_iter_backward_chars (&start,
-					      g_utf8_strlen (text, length));
+	gtk_text_iter_backward_chars (&start,
+				      g_utf8_strlen (text, length));
 
+	if (gtk_source_search_settings_get_regex_enabled (search->settings))
+	{
+		regex_search_text_changed (search, &start, &end);
+	}
+	else
+	{
 		add_subregion_to_scan (search, &start, &end);
 	}
 }
@@ -2499,7 +3717,9 @@ delete_range_before_cb (GtkSourceSearchContext *search,
 
 	clear_task (search);
 
-	if (gtk_source_search_settings_get_regex_enabled (search->settings))
+	if (changes_held (search) ||
+	    (gtk_source_search_settings_get_regex_enabled (search->settings) &&
+	     search->regex == NULL))
 	{
 		return;
 	}
@@ -2509,12 +3729,22 @@ delete_range_before_cb (GtkSourceSearchContext *search,
 	if (gtk_text_iter_equal (delete_start, &start_buffer) &&
 	    gtk_text_iter_equal (delete_end, &end_buffer))
 	{
-		/* Special case when removing all the text. */
-		search->occurrences_count = 0;
+		/* Special case when removing all the text. The text deletion
+		 * redraws the views.
+		 */
+		_gtk_source_occurrence_index_clear (search->occurrences);
 		return;
 	}
 
-	if (search_text != NULL)
+	if (gtk_source_search_settings_get_regex_enabled (search->settings))
+	{
+		regex_search_text_will_change (search,
+					       delete_start,
+					       delete_end,
+					       gtk_text_iter_get_offset (delete_start) -
+					       gtk_text_iter_get_offset (delete_end));
+	}
+	else if (search_text != NULL)
 	{
 		GtkTextIter start = *delete_start;
 		GtkTextIter end = *delete_end;
@@ -2524,6 +3754,11 @@ delete_range_before_cb (GtkSourceSearchContext *search,
 
 		remove_occurrences_in_range (search, &start, &end);
 		add_subregion_to_scan (search, &start, &end);
+
+		_gtk_source_occurrence_index_shift (search->occurrences,
+						    gtk_text_iter_get_offset (delete_end),
+						    gtk_text_iter_get_offset (delete_start) -
+						    gtk_text_iter_get_offset (delete_end));
 	}
 }
 
@@ -2532,13 +3767,22 @@ delete_range_after_cb (GtkSourceSearchContext *search,
                        GtkTextIter            *start,
                        GtkTextIter            *end)
 {
-	if (gtk_source_search_settings_get_regex_enabled (search->settings))
+	if (changes_held (search))
+	{
+		return;
+	}
+
+	if (!gtk_source_search_settings_get_regex_enabled (search->settings))
+	{
+		add_subregion_to_scan (search, start, end);
+	}
+	else if (search->regex == NULL)
 	{
 		update (search);
 	}
 	else
 	{
-		add_subregion_to_scan (search, start, end);
+		regex_search_text_changed (search, start, end);
 	}
 }
 
@@ -2581,6 +3825,12 @@ set_buffer (GtkSourceSearchContext *search,
 				 search,
 				 G_CONNECT_AFTER | G_CONNECT_SWAPPED);
 
+	g_signal_connect_object (_gtk_source_buffer_internal_get_from_buffer (buffer),
+				 "text-replaced",
+				 G_CALLBACK (text_replaced_cb),
+				 search,
+				 G_CONNECT_SWAPPED);
+
 	search->found_tag = gtk_text_buffer_create_tag (search->buffer, NULL, NULL);
 	g_object_ref (search->found_tag);
 
@@ -2714,6 +3964,7 @@ gtk_source_search_context_dispose (GObject *object)
 	}
 
 	g_clear_object (&search->settings);
+	g_clear_object (&search->search_region);
 
 	G_OBJECT_CLASS (gtk_source_search_context_parent_class)->dispose (object);
 }
@@ -2725,6 +3976,7 @@ gtk_source_search_context_finalize (GObject *object)
 
 	g_clear_pointer (&search->regex, impl_regex_unref);
 	g_clear_error (&search->regex_error);
+	g_clear_pointer (&search->occurrences, _gtk_source_occurrence_index_free);
 
 	G_OBJECT_CLASS (gtk_source_search_context_parent_class)->finalize (object);
 }
@@ -2759,6 +4011,14 @@ gtk_source_search_context_get_property (GObject    *object,
 			g_value_set_object (value, search->match_style);
 			break;
 
+		case PROP_USE_TEXT_TAGS:
+			g_value_set_boolean (value, search->use_text_tags);
+			break;
+
+		case PROP_SEARCH_REGION:
+			g_value_set_object (value, search->search_region);
+			break;
+
 		case PROP_OCCURRENCES_COUNT:
 			g_value_set_int (value, gtk_source_search_context_get_occurrences_count (search));
 			break;
@@ -2803,6 +4063,14 @@ gtk_source_search_context_set_property (GObject      *object,
 			gtk_source_search_context_set_match_style (search, g_value_get_object (value));
 			break;
 
+		case PROP_USE_TEXT_TAGS:
+			gtk_source_search_context_set_use_text_tags (search, g_value_get_boolean (value));
+			break;
+
+		case PROP_SEARCH_REGION:
+			gtk_source_search_context_set_search_region (search, g_value_get_object (value));
+			break;
+
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 			break;
@@ -2877,6 +4145,46 @@ gtk_source_search_context_class_init (GtkSourceSearchContextClass *klass)
 		                      G_PARAM_CONSTRUCT |
 		                      G_PARAM_STATIC_STRINGS));
 
+	/**
+	 * GtkSourceSearchContext:use-text-tags:
+	 *
+	 * Whether the search occurrences are marked with a [class@Gtk.TextTag].
+	 *
+	 * If %FALSE, the occurrences are only kept in a compact index of the
+	 * search context, and the [class@View]s paint the background of the
+	 * match style for the visible occurrences. This is much lighter for
+	 * the buffer when there are many occurrences, but the other attributes
+	 * of the match style are not applied.
+	 *
+	 * Since: 5.22
+	 */
+	properties [PROP_USE_TEXT_TAGS] =
+		g_param_spec_boolean ("use-text-tags",
+		                      "Use text tags",
+		                      "Whether to mark the search occurrences with a text tag",
+		                      TRUE,
+		                      (G_PARAM_READWRITE |
+		                       G_PARAM_CONSTRUCT |
+		                       G_PARAM_STATIC_STRINGS));
+
+	/**
+	 * GtkSourceSearchContext:search-region:
+	 *
+	 * The region of the buffer where the search occurrences are searched,
+	 * or %NULL to search the whole buffer. See
+	 * [method@SearchContext.set_search_region].
+	 *
+	 * Since: 5.22
+	 */
+	properties [PROP_SEARCH_REGION] =
+		g_param_spec_object ("search-region",
+		                     "Search region",
+		                     "The region where the search occurrences are searched",
+		                     GTK_SOURCE_TYPE_REGION,
+		                     (G_PARAM_READWRITE |
+		                      G_PARAM_EXPLICIT_NOTIFY |
+		                      G_PARAM_STATIC_STRINGS));
+
 	/**
 	 * GtkSourceSearchContext:occurrences-count:
 	 *
@@ -2917,6 +4225,8 @@ gtk_source_search_context_class_init (GtkSourceSearchContextClass *klass)
 static void
 gtk_source_search_context_init (GtkSourceSearchContext *search)
 {
+	search->occurrences = _gtk_source_occurrence_index_new ();
+	search->use_text_tags = TRUE;
 }
 
 /**
@@ -3002,64 +4312,191 @@ gtk_source_search_context_set_highlight (GtkSourceSearchContext *search,
 
 	highlight = highlight != FALSE;
 
-	if (search->highlight != highlight)
+	if (search->highlight != highlight)
+	{
+		search->highlight = highlight;
+		sync_found_tag (search);
+
+		g_object_notify_by_pspec (G_OBJECT (search), properties [PROP_HIGHLIGHT]);
+	}
+}
+
+/**
+ * gtk_source_search_context_get_match_style:
+ * @search: a #GtkSourceSearchContext.
+ *
+ * Returns: (nullable) (transfer none): the #GtkSourceStyle to apply on search matches.
+ */
+GtkSourceStyle *
+gtk_source_search_context_get_match_style (GtkSourceSearchContext *search)
+{
+	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), NULL);
+
+	return search->match_style;
+}
+
+/**
+ * gtk_source_search_context_set_match_style:
+ * @search: a #GtkSourceSearchContext.
+ * @match_style: (nullable): a #GtkSourceStyle, or %NULL.
+ *
+ * Set the style to apply on search matches.
+ *
+ * If @match_style is %NULL, default theme's scheme 'match-style' will be used.
+ * To enable or disable the search highlighting, use [method@SearchContext.set_highlight].
+ */
+void
+gtk_source_search_context_set_match_style (GtkSourceSearchContext *search,
+                                           GtkSourceStyle         *match_style)
+{
+	g_return_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search));
+	g_return_if_fail (match_style == NULL || GTK_SOURCE_IS_STYLE (match_style));
+
+	if (search->match_style == match_style)
+	{
+		return;
+	}
+
+	if (search->match_style != NULL)
+	{
+		g_object_unref (search->match_style);
+	}
+
+	search->match_style = match_style;
+
+	if (match_style != NULL)
+	{
+		g_object_ref (match_style);
+	}
+
+	matches_changed (search);
+
+	g_object_notify_by_pspec (G_OBJECT (search), properties [PROP_MATCH_STYLE]);
+}
+
+/**
+ * gtk_source_search_context_get_use_text_tags:
+ * @search: a #GtkSourceSearchContext.
+ *
+ * Returns: whether the search occurrences are marked with a text tag.
+ * Since: 5.22
+ */
+gboolean
+gtk_source_search_context_get_use_text_tags (GtkSourceSearchContext *search)
+{
+	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), TRUE);
+
+	return search->use_text_tags;
+}
+
+/**
+ * gtk_source_search_context_set_use_text_tags:
+ * @search: a #GtkSourceSearchContext.
+ * @use_text_tags: the setting.
+ *
+ * Sets whether the search occurrences are marked with a text tag. See the
+ * [property@SearchContext:use-text-tags] property.
+ *
+ * Since: 5.22
+ */
+void
+gtk_source_search_context_set_use_text_tags (GtkSourceSearchContext *search,
+                                             gboolean                use_text_tags)
+{
+	g_return_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search));
+
+	use_text_tags = use_text_tags != FALSE;
+
+	if (search->use_text_tags == use_text_tags)
+	{
+		return;
+	}
+
+	if (search->buffer != NULL && !use_text_tags)
 	{
-		search->highlight = highlight;
-		sync_found_tag (search);
+		GtkTextIter start;
+		GtkTextIter end;
 
-		g_object_notify_by_pspec (G_OBJECT (search), properties [PROP_HIGHLIGHT]);
+		gtk_text_buffer_get_bounds (search->buffer, &start, &end);
+		gtk_text_buffer_remove_tag (search->buffer, search->found_tag, &start, &end);
 	}
+
+	search->use_text_tags = use_text_tags;
+
+	/* Scan the buffer again, to apply the found_tag or to paint the
+	 * occurrences.
+	 */
+	update (search);
+
+	g_object_notify_by_pspec (G_OBJECT (search), properties [PROP_USE_TEXT_TAGS]);
 }
 
 /**
- * gtk_source_search_context_get_match_style:
+ * gtk_source_search_context_get_search_region:
  * @search: a #GtkSourceSearchContext.
  *
- * Returns: (nullable) (transfer none): the #GtkSourceStyle to apply on search matches.
+ * Returns: (transfer none) (nullable): the region where the search
+ *   occurrences are searched, or %NULL if the whole buffer is searched.
+ *   The region must not be modified.
+ * Since: 5.22
  */
-GtkSourceStyle *
-gtk_source_search_context_get_match_style (GtkSourceSearchContext *search)
+GtkSourceRegion *
+gtk_source_search_context_get_search_region (GtkSourceSearchContext *search)
 {
 	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), NULL);
 
-	return search->match_style;
+	return search->search_region;
 }
 
 /**
- * gtk_source_search_context_set_match_style:
+ * gtk_source_search_context_set_search_region:
  * @search: a #GtkSourceSearchContext.
- * @match_style: (nullable): a #GtkSourceStyle, or %NULL.
+ * @region: (nullable): a #GtkSourceRegion of the buffer, or %NULL.
  *
- * Set the style to apply on search matches.
+ * Limits the search to @region, for example the selection for a "find in
+ * selection" feature. If @region is %NULL, the whole buffer is searched.
  *
- * If @match_style is %NULL, default theme's scheme 'match-style' will be used.
- * To enable or disable the search highlighting, use [method@SearchContext.set_highlight].
+ * Only the matches entirely contained in a subregion of @region are search
+ * occurrences: they are the only ones highlighted, counted, found by the
+ * forward and backward searches, and replaced. The buffer is only scanned
+ * around @region, so the scan is fast even with a big buffer.
+ *
+ * @region is copied. The copy follows the modifications of the buffer, and
+ * the text inserted at its bounds is part of it.
+ *
+ * Since: 5.22
  */
 void
-gtk_source_search_context_set_match_style (GtkSourceSearchContext *search,
-                                           GtkSourceStyle         *match_style)
+gtk_source_search_context_set_search_region (GtkSourceSearchContext *search,
+                                             GtkSourceRegion        *region)
 {
 	g_return_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search));
-	g_return_if_fail (match_style == NULL || GTK_SOURCE_IS_STYLE (match_style));
+	g_return_if_fail (region == NULL || GTK_SOURCE_IS_REGION (region));
 
-	if (search->match_style == match_style)
+	if (search->buffer == NULL)
 	{
 		return;
 	}
 
-	if (search->match_style != NULL)
+	g_return_if_fail (region == NULL ||
+			  gtk_source_region_get_buffer (region) == search->buffer);
+
+	if (region == NULL && search->search_region == NULL)
 	{
-		g_object_unref (search->match_style);
+		return;
 	}
 
-	search->match_style = match_style;
+	g_clear_object (&search->search_region);
 
-	if (match_style != NULL)
+	if (region != NULL)
 	{
-		g_object_ref (match_style);
+		search->search_region = gtk_source_region_new (search->buffer);
+		gtk_source_region_add_region (search->search_region, region);
 	}
 
-	g_object_notify_by_pspec (G_OBJECT (search), properties [PROP_MATCH_STYLE]);
+	update (search);
+
+	g_object_notify_by_pspec (G_OBJECT (search), properties [PROP_SEARCH_REGION]);
 }
 
 /**
@@ -3111,7 +4548,7 @@ gtk_source_search_context_get_occurrences_count (GtkSourceSearchContext *search)
 		return -1;
 	}
 
-	return search->occurrences_count;
+	return _gtk_source_occurrence_index_get_count (search->occurrences);
 }
 
 /**
@@ -3135,11 +4572,8 @@ gtk_source_search_context_get_occurrence_position (GtkSourceSearchContext *searc
                                                    const GtkTextIter      *match_start,
                                                    const GtkTextIter      *match_end)
 {
-	GtkTextIter m_start;
-	GtkTextIter m_end;
 	GtkTextIter iter;
-	gboolean found;
-	gint position = 0;
+	gint position;
 
 	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), -1);
 	g_return_val_if_fail (match_start != NULL, -1);
@@ -3150,6 +4584,8 @@ gtk_source_search_context_get_occurrence_position (GtkSourceSearchContext *searc
 		return -1;
 	}
 
+	flush_held_changes (search);
+
 	/* Verify that the [match_start; match_end] region has been scanned. */
 
 	if (search->scan_region != NULL)
@@ -3164,21 +4600,18 @@ gtk_source_search_context_get_occurrence_position (GtkSourceSearchContext *searc
 
 	/* Verify that the occurrence is correct. */
 
-	found = smart_forward_search_without_scanning (search,
-						       match_start,
-						       &m_start,
-						       &m_end,
-						       match_end);
+	position = _gtk_source_occurrence_index_get_position (search->occurrences,
+							      gtk_text_iter_get_offset (match_start),
+							      gtk_text_iter_get_offset (match_end));
 
-	if (!found ||
-	    !gtk_text_iter_equal (match_start, &m_start) ||
-	    !gtk_text_iter_equal (match_end, &m_end))
+	if (position == 0)
 	{
 		return 0;
 	}
 
 	/* Verify that the scan region is empty between the start of the buffer
-	 * and the end of the occurrence.
+	 * and the end of the occurrence, so that the previous occurrences are
+	 * all in the index.
 	 */
 
 	gtk_text_buffer_get_start_iter (search->buffer, &iter);
@@ -3193,15 +4626,79 @@ gtk_source_search_context_get_occurrence_position (GtkSourceSearchContext *searc
 		}
 	}
 
-	/* Everything is fine, count the number of previous occurrences. */
+	return position;
+}
+
+/**
+ * gtk_source_search_context_get_nth_occurrence:
+ * @search: a #GtkSourceSearchContext.
+ * @n: the position of the occurrence, the first occurrence having the
+ *   position 1.
+ * @match_start: (out) (optional): return location for start of the occurrence, or %NULL.
+ * @match_end: (out) (optional): return location for end of the occurrence, or %NULL.
+ *
+ * Gets the search occurrence at the position @n, as returned by
+ * [method@SearchContext.get_occurrence_position], without searching the
+ * buffer.
+ *
+ * If the buffer is not already scanned up to that occurrence, it is unknown
+ * and %FALSE is returned.
+ *
+ * Returns: whether the occurrence is known.
+ * Since: 5.22
+ */
+gboolean
+gtk_source_search_context_get_nth_occurrence (GtkSourceSearchContext *search,
+                                              gint                    n,
+                                              GtkTextIter            *match_start,
+                                              GtkTextIter            *match_end)
+{
+	GtkTextIter start_buffer;
+	GtkTextIter m_start;
+	GtkTextIter m_end;
+	gint start;
+	gint end;
+
+	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), FALSE);
+
+	if (search->buffer == NULL || n < 1)
+	{
+		return FALSE;
+	}
+
+	if (!_gtk_source_occurrence_index_get_nth (search->occurrences, n - 1, &start, &end))
+	{
+		return FALSE;
+	}
+
+	gtk_text_buffer_get_iter_at_offset (search->buffer, &m_start, start);
+	gtk_text_buffer_get_iter_at_offset (search->buffer, &m_end, end);
+
+	/* The previous occurrences may not all be in the index yet. */
+
+	gtk_text_buffer_get_start_iter (search->buffer, &start_buffer);
+
+	if (search->scan_region != NULL)
+	{
+		if (region_intersects_subregion (search->scan_region,
+						 &start_buffer,
+						 &m_end))
+		{
+			return FALSE;
+		}
+	}
+
+	if (match_start != NULL)
+	{
+		*match_start = m_start;
+	}
 
-	while (smart_forward_search_without_scanning (search, &iter, &m_start, &m_end, match_start))
+	if (match_end != NULL)
 	{
-		position++;
-		iter = m_end;
+		*match_end = m_end;
 	}
 
-	return position + 1;
+	return TRUE;
 }
 
 /**
@@ -3251,6 +4748,8 @@ gtk_source_search_context_forward (GtkSourceSearchContext *search,
 		return FALSE;
 	}
 
+	flush_held_changes (search);
+
 	found = smart_forward_search (search, iter, &m_start, &m_end);
 
 	if (!found && gtk_source_search_settings_get_wrap_around (search->settings))
@@ -3310,6 +4809,8 @@ gtk_source_search_context_forward_async (GtkSourceSearchContext *search,
 		return;
 	}
 
+	flush_held_changes (search);
+
 	clear_task (search);
 	search->task = g_task_new (search, cancellable, callback, user_data);
 
@@ -3440,6 +4941,8 @@ gtk_source_search_context_backward (GtkSourceSearchContext *search,
 		return FALSE;
 	}
 
+	flush_held_changes (search);
+
 	found = smart_backward_search (search, iter, &m_start, &m_end);
 
 	if (!found && gtk_source_search_settings_get_wrap_around (search->settings))
@@ -3500,6 +5003,8 @@ gtk_source_search_context_backward_async (GtkSourceSearchContext *search,
 		return;
 	}
 
+	flush_held_changes (search);
+
 	clear_task (search);
 	search->task = g_task_new (search, cancellable, callback, user_data);
 
@@ -3540,44 +5045,46 @@ gtk_source_search_context_backward_finish (GtkSourceSearchContext  *search,
 							 error);
 }
 
-/* If correctly replaced, returns %TRUE and @match_end is updated to point to
- * the replacement end.
+/* Returns the replacement text of the [match_start, match_end] regex match,
+ * with the references to the match expanded, or %NULL on error.
  */
-static gboolean
-regex_replace (GtkSourceSearchContext  *search,
-	       const GtkTextIter       *match_start,
-	       GtkTextIter             *match_end,
-	       const gchar             *replace,
-	       GError                 **error)
+static gchar *
+regex_get_replacement (GtkSourceSearchContext  *search,
+                       const GtkTextIter       *match_start,
+                       const GtkTextIter       *match_end,
+                       const gchar             *replace,
+                       GError                 **error)
 {
 	GtkTextIter real_start;
 	GtkTextIter real_end;
 	GtkTextIter match_start_check;
 	GtkTextIter match_end_check;
-	GtkTextIter match_start_copy;
+	GtkTextIter match_end_copy;
 	gint start_pos;
 	gchar *subject;
 	gchar *suffix;
 	gchar *subject_replaced;
+	gchar *replacement = NULL;
 	GRegexMatchFlags match_options;
 	GError *tmp_error = NULL;
-	gboolean replaced = FALSE;
 
 	if (search->regex == NULL ||
 	    search->regex_error != NULL)
 	{
-		return FALSE;
+		return NULL;
 	}
 
 	regex_search_get_real_start (search, match_start, &real_start, &start_pos);
 	g_assert_cmpint (start_pos, >=, 0);
 
+	match_end_copy = *match_end;
+
 	if (!basic_forward_regex_search (search,
 					 match_start,
 					 &match_start_check,
 					 &match_end_check,
 					 &real_end,
-					 match_end))
+					 &match_end_copy))
 	{
 		g_assert_not_reached ();
 	}
@@ -3610,7 +5117,7 @@ regex_replace (GtkSourceSearchContext  *search,
 		goto end;
 	}
 
-	g_return_val_if_fail (g_str_has_suffix (subject_replaced, suffix), FALSE);
+	g_return_val_if_fail (g_str_has_suffix (subject_replaced, suffix), NULL);
 
 	/* Truncate subject_replaced to not contain the suffix, so we can
 	 * replace only [match_start, match_end], not [match_start, real_end].
@@ -3619,22 +5126,46 @@ regex_replace (GtkSourceSearchContext  *search,
 	 * replace all.
 	 */
 	subject_replaced[strlen (subject_replaced) - strlen (suffix)] = '\0';
-	g_return_val_if_fail (strlen (subject_replaced) >= (guint)start_pos, FALSE);
+	g_return_val_if_fail (strlen (subject_replaced) >= (guint)start_pos, NULL);
+
+	replacement = g_strdup (subject_replaced + start_pos);
+
+end:
+	g_free (subject);
+	g_free (suffix);
+	g_free (subject_replaced);
+	return replacement;
+}
+
+/* If correctly replaced, returns %TRUE and @match_end is updated to point to
+ * the replacement end.
+ */
+static gboolean
+regex_replace (GtkSourceSearchContext  *search,
+	       const GtkTextIter       *match_start,
+	       GtkTextIter             *match_end,
+	       const gchar             *replace,
+	       GError                 **error)
+{
+	GtkTextIter match_start_copy;
+	gchar *replacement;
+
+	replacement = regex_get_replacement (search, match_start, match_end, replace, error);
+
+	if (replacement == NULL)
+	{
+		return FALSE;
+	}
 
 	match_start_copy = *match_start;
 
 	gtk_text_buffer_begin_user_action (search->buffer);
 	gtk_text_buffer_delete (search->buffer, &match_start_copy, match_end);
-	gtk_text_buffer_insert (search->buffer, match_end, subject_replaced + start_pos, -1);
+	gtk_text_buffer_insert (search->buffer, match_end, replacement, -1);
 	gtk_text_buffer_end_user_action (search->buffer);
 
-	replaced = TRUE;
-
-end:
-	g_free (subject);
-	g_free (suffix);
-	g_free (subject_replaced);
-	return replaced;
+	g_free (replacement);
+	return TRUE;
 }
 
 /**
@@ -3682,6 +5213,8 @@ gtk_source_search_context_replace (GtkSourceSearchContext  *search,
 		return FALSE;
 	}
 
+	flush_held_changes (search);
+
 	if (!smart_forward_search (search, match_start, &start, &end))
 	{
 		return FALSE;
@@ -3731,6 +5264,9 @@ gtk_source_search_context_replace (GtkSourceSearchContext  *search,
  *
  * It is a synchronous function, so it can block the user interface.
  *
+ * All the matches are replaced at once with
+ * [method@Buffer.replace_ranges], in a single user action.
+ *
  * For a regular expression replacement, you can check if @replace is valid by
  * calling [func@GLib.Regex.check_replacement]. The @replace text can contain
  * backreferences.
@@ -3746,8 +5282,10 @@ gtk_source_search_context_replace_all (GtkSourceSearchContext  *search,
 	GtkTextIter iter;
 	GtkTextIter match_start;
 	GtkTextIter match_end;
+	GArray *starts;
+	GArray *ends;
+	GPtrArray *replacements;
 	guint nb_matches_replaced = 0;
-	gboolean highlight_matching_brackets;
 	gboolean has_regex_references = FALSE;
 
 	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), 0);
@@ -3780,43 +5318,116 @@ gtk_source_search_context_replace_all (GtkSourceSearchContext  *search,
 		}
 	}
 
-	g_signal_handlers_block_by_func (search->buffer, insert_text_before_cb, search);
-	g_signal_handlers_block_by_func (search->buffer, insert_text_after_cb, search);
-	g_signal_handlers_block_by_func (search->buffer, delete_range_before_cb, search);
-	g_signal_handlers_block_by_func (search->buffer, delete_range_after_cb, search);
-
-	highlight_matching_brackets =
-		gtk_source_buffer_get_highlight_matching_brackets (GTK_SOURCE_BUFFER (search->buffer));
-
-	gtk_source_buffer_set_highlight_matching_brackets (GTK_SOURCE_BUFFER (search->buffer),
-							   FALSE);
-
-	_gtk_source_buffer_save_and_clear_selection (GTK_SOURCE_BUFFER (search->buffer));
+	/* Collect all the matches first, the search is not disturbed by the
+	 * modifications and they are applied at once.
+	 */
+	starts = g_array_new (FALSE, FALSE, sizeof (gint));
+	ends = g_array_new (FALSE, FALSE, sizeof (gint));
+	replacements = g_ptr_array_new_with_free_func (g_free);
 
 	gtk_text_buffer_get_start_iter (search->buffer, &iter);
 
-	gtk_text_buffer_begin_user_action (search->buffer);
-
 	while (smart_forward_search (search, &iter, &match_start, &match_end))
 	{
+		gchar *replacement;
+		gint offset;
+
 		if (has_regex_references)
 		{
-			if (!regex_replace (search, &match_start, &match_end, replace, error))
+			replacement = regex_get_replacement (search, &match_start, &match_end, replace, error);
+
+			if (replacement == NULL)
 			{
 				break;
 			}
 		}
+		else if (replace_length < 0)
+		{
+			replacement = g_strdup (replace);
+		}
 		else
 		{
-			gtk_text_buffer_delete (search->buffer, &match_start, &match_end);
-			gtk_text_buffer_insert (search->buffer, &match_end, replace, replace_length);
+			replacement = g_strndup (replace, replace_length);
 		}
 
-		nb_matches_replaced++;
+		offset = gtk_text_iter_get_offset (&match_start);
+		g_array_append_val (starts, offset);
+		offset = gtk_text_iter_get_offset (&match_end);
+		g_array_append_val (ends, offset);
+		g_ptr_array_add (replacements, replacement);
+
 		iter = match_end;
+
+		/* Do not find the same empty match again. */
+		if (gtk_text_iter_equal (&match_start, &match_end) &&
+		    !gtk_text_iter_forward_char (&iter))
+		{
+			break;
+		}
 	}
 
-	gtk_text_buffer_end_user_action (search->buffer);
+	nb_matches_replaced = starts->len;
+
+	_gtk_source_search_context_replace_ranges (search,
+	                                           (const gint *)(gpointer)starts->data,
+	                                           (const gint *)(gpointer)ends->data,
+	                                           (const gchar * const *)replacements->pdata,
+	                                           nb_matches_replaced);
+
+	g_array_unref (starts);
+	g_array_unref (ends);
+	g_ptr_array_unref (replacements);
+
+	return nb_matches_replaced;
+}
+
+/* Replaces the ranges with gtk_source_buffer_replace_ranges(), without
+ * updating the occurrences, the selection and the bracket matching for each
+ * of them. The whole buffer is scanned again afterwards.
+ */
+void
+_gtk_source_search_context_replace_ranges (GtkSourceSearchContext *search,
+                                           const gint             *starts,
+                                           const gint             *ends,
+                                           const gchar * const    *replacements,
+                                           guint                   n_ranges)
+{
+	GtkSourceBufferInternal *buffer_internal;
+	gboolean highlight_matching_brackets;
+
+	g_return_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search));
+
+	if (search->buffer == NULL)
+	{
+		return;
+	}
+
+	buffer_internal = _gtk_source_buffer_internal_get_from_buffer (GTK_SOURCE_BUFFER (search->buffer));
+
+	g_signal_handlers_block_by_func (search->buffer, insert_text_before_cb, search);
+	g_signal_handlers_block_by_func (search->buffer, insert_text_after_cb, search);
+	g_signal_handlers_block_by_func (search->buffer, delete_range_before_cb, search);
+	g_signal_handlers_block_by_func (search->buffer, delete_range_after_cb, search);
+	g_signal_handlers_block_by_func (buffer_internal, text_replaced_cb, search);
+
+	highlight_matching_brackets =
+		gtk_source_buffer_get_highlight_matching_brackets (GTK_SOURCE_BUFFER (search->buffer));
+
+	gtk_source_buffer_set_highlight_matching_brackets (GTK_SOURCE_BUFFER (search->buffer),
+							   FALSE);
+
+	_gtk_source_buffer_save_and_clear_selection (GTK_SOURCE_BUFFER (search->buffer));
+
+	gtk_source_buffer_replace_ranges (GTK_SOURCE_BUFFER (search->buffer),
+	                                  starts,
+	                                  ends,
+	                                  replacements,
+	                                  n_ranges);
+
+	/* Nested in held changes, the replacements are reported now, while
+	 * the handlers are blocked, as update() rescans the buffer anyway.
+	 */
+	flush_held_changes (search);
 
 	_gtk_source_buffer_restore_selection (GTK_SOURCE_BUFFER (search->buffer));
 
@@ -3827,10 +5438,43 @@ gtk_source_search_context_replace_all (GtkSourceSearchContext  *search,
 	g_signal_handlers_unblock_by_func (search->buffer, insert_text_after_cb, search);
 	g_signal_handlers_unblock_by_func (search->buffer, delete_range_before_cb, search);
 	g_signal_handlers_unblock_by_func (search->buffer, delete_range_after_cb, search);
+	g_signal_handlers_unblock_by_func (buffer_internal, text_replaced_cb, search);
 
 	update (search);
+}
 
-	return nb_matches_replaced;
+/* Returns the text that gtk_source_search_context_replace() would insert in
+ * place of the [match_start, match_end] match, without modifying the buffer.
+ */
+gchar *
+_gtk_source_search_context_get_replacement (GtkSourceSearchContext  *search,
+                                            const GtkTextIter       *match_start,
+                                            const GtkTextIter       *match_end,
+                                            const gchar             *replace,
+                                            gint                     replace_length,
+                                            GError                 **error)
+{
+	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), NULL);
+	g_return_val_if_fail (match_start != NULL, NULL);
+	g_return_val_if_fail (match_end != NULL, NULL);
+	g_return_val_if_fail (replace != NULL, NULL);
+
+	if (search->buffer == NULL)
+	{
+		return NULL;
+	}
+
+	if (gtk_source_search_settings_get_regex_enabled (search->settings))
+	{
+		return regex_get_replacement (search, match_start, match_end, replace, error);
+	}
+
+	if (replace_length < 0)
+	{
+		return g_strdup (replace);
+	}
+
+	return g_strndup (replace, replace_length);
 }
 
 /* Highlight the [start,end] region in priority. */
@@ -3900,3 +5544,85 @@ _gtk_source_search_context_update_highlight (GtkSourceSearchContext *search,
 out:
 	g_clear_object (&region_to_highlight);
 }
+
+/* Gets the color to paint the occurrences with, if they are painted by the
+ * views, that is if the found_tag is not used.
+ */
+gboolean
+_gtk_source_search_context_get_match_background (GtkSourceSearchContext *search,
+                                                 GdkRGBA                *rgba)
+{
+	GtkSourceStyle *style;
+
+	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), FALSE);
+	g_return_val_if_fail (rgba != NULL, FALSE);
+
+	if (search->buffer == NULL ||
+	    search->use_text_tags ||
+	    !search->highlight)
+	{
+		return FALSE;
+	}
+
+	style = get_match_style (search);
+
+	return (style != NULL &&
+		(style->mask & GTK_SOURCE_STYLE_USE_BACKGROUND) != 0 &&
+		style->background != NULL &&
+		gdk_rgba_parse (rgba, style->background));
+}
+
+/* Appends to @matches the start and end offsets of the occurrences already
+ * found in [start,end].
+ */
+void
+_gtk_source_search_context_get_matches (GtkSourceSearchContext *search,
+                                        const GtkTextIter      *start,
+                                        const GtkTextIter      *end,
+                                        GArray                 *matches)
+{
+	gint start_offset;
+	gint end_offset;
+	gint match_start;
+	gint match_end;
+	guint n;
+
+	g_return_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search));
+	g_return_if_fail (start != NULL);
+	g_return_if_fail (end != NULL);
+	g_return_if_fail (matches != NULL);
+
+	start_offset = gtk_text_iter_get_offset (start);
+	end_offset = gtk_text_iter_get_offset (end);
+
+	n = _gtk_source_occurrence_index_count_before (search->occurrences, start_offset);
+
+	/* The occurrence starting before @start can end after it. */
+	if (n > 0)
+	{
+		n--;
+	}
+
+	while (_gtk_source_occurrence_index_get_nth (search->occurrences, n, &match_start, &match_end) &&
+	       match_start < end_offset)
+	{
+		if (match_end > start_offset)
+		{
+			g_array_append_val (matches, match_start);
+			g_array_append_val (matches, match_end);
+		}
+
+		n++;
+	}
+}
+
+/* Returns: the number of chunks that @search scanned together with other
+ * search contexts of its buffer, for the tests.
+ */
+guint
+_gtk_source_search_context_get_shared_chunks (GtkSourceSearchContext *search)
+{
+	g_return_val_if_fail (GTK_SOURCE_IS_SEARCH_CONTEXT (search), 0);
+
+	return search->shared_chunks;
+}
@@ -25,6 +25,7 @@
 
 #include <gtk/gtk.h>
 
+#include "gtksourceregion.h"
 #include "gtksourcetypes.h"
 
 G_BEGIN_DECLS
@@ -51,6 +52,16 @@ GtkSourceStyle          *gtk_source_search_context_get_match_style         (GtkS
 GTK_SOURCE_AVAILABLE_IN_ALL
 void                     gtk_source_search_context_set_match_style         (GtkSourceSearchContext   *search,
                                                                             GtkSourceStyle           *match_style);
+GTK_SOURCE_AVAILABLE_IN_5_22
+gboolean                 gtk_source_search_context_get_use_text_tags       (GtkSourceSearchContext   *search);
+GTK_SOURCE_AVAILABLE_IN_5_22
+void                     gtk_source_search_context_set_use_text_tags       (GtkSourceSearchContext   *search,
+                                                                            gboolean                  use_text_tags);
+GTK_SOURCE_AVAILABLE_IN_5_22
+GtkSourceRegion         *gtk_source_search_context_get_search_region       (GtkSourceSearchContext   *search);
+GTK_SOURCE_AVAILABLE_IN_5_22
+void                     gtk_source_search_context_set_search_region       (GtkSourceSearchContext   *search,
+                                                                            GtkSourceRegion          *region);
 GTK_SOURCE_AVAILABLE_IN_ALL
 GError                  *gtk_source_search_context_get_regex_error         (GtkSourceSearchContext   *search);
 GTK_SOURCE_AVAILABLE_IN_ALL
@@ -59,6 +70,11 @@ GTK_SOURCE_AVAILABLE_IN_ALL
 gint                     gtk_source_search_context_get_occurrence_position (GtkSourceSearchContext   *search,
                                                                             const GtkTextIter        *match_start,
                                                                             const GtkTextIter        *match_end);
+GTK_SOURCE_AVAILABLE_IN_5_22
+gboolean                 gtk_source_search_context_get_nth_occurrence      (GtkSourceSearchContext   *search,
+                                                                            gint                      n,
+                                                                            GtkTextIter              *match_start,
+                                                                            GtkTextIter              *match_end);
 GTK_SOURCE_AVAILABLE_IN_ALL
 gboolean                 gtk_source_search_context_forward                 (GtkSourceSearchContext   *search,
                                                                             const GtkTextIter        *iter,
@@ -39,11 +39,19 @@ typedef struct
 
 #define GTK_SOURCE_TYPE_SNIPPET_BUNDLE (_gtk_source_snippet_bundle_get_type())
 
+#define GTK_SOURCE_SNIPPET_BUNDLE_VARIANT_TYPE "(a(imsmsmsmsmsms)a(uums))"
+
 G_DECLARE_FINAL_TYPE (GtkSourceSnippetBundle, _gtk_source_snippet_bundle, GTK_SOURCE, SNIPPET_BUNDLE, GObject)
 
 GtkSourceSnippetBundle  *_gtk_source_snippet_bundle_new            (void);
 GtkSourceSnippetBundle  *_gtk_source_snippet_bundle_new_from_file  (const char                  *path,
                                                                     GtkSourceSnippetManager     *manager);
+GtkSourceSnippetBundle  *_gtk_source_snippet_bundle_deserialize    (GVariant                    *variant,
+                                                                    GtkSourceSnippetManager     *manager);
+GVariant                *_gtk_source_snippet_bundle_serialize      (GtkSourceSnippetBundle      *self);
+GPtrArray               *_gtk_source_snippet_bundle_scan_languages (const char                  *path,
+                                                                    GtkSourceSnippetManager     *manager);
+void                     _gtk_source_snippet_bundle_clear          (GtkSourceSnippetBundle      *self);
 void                     _gtk_source_snippet_bundle_merge          (GtkSourceSnippetBundle      *self,
                                                                     GtkSourceSnippetBundle      *other);
 const char             **_gtk_source_snippet_bundle_list_groups    (GtkSourceSnippetBundle      *self);
@@ -19,6 +19,8 @@
 
 #include "config.h"
 
+#include <string.h>
+
 #include "gtksourcesnippet.h"
 #include "gtksourcesnippetchunk-private.h"
 #include "gtksourcesnippetbundle-private.h"
@@ -31,11 +33,48 @@ typedef struct
 	const char *text;
 } GtkSourceSnippetTooltip;
 
+typedef struct
+{
+	/* Interned language, or %NULL for the snippets without language */
+	const char *language;
+
+	/* Range of the snippets of the language in the infos, which are
+	 * sorted by language and then by trigger.
+	 */
+	guint       begin;
+	guint       end;
+
+	/* Positions in the infos of the first snippet of each trigger, in
+	 * the order of the triggers.
+	 */
+	GArray     *triggers;
+
+	/* Cached result of querying all the snippets of the language */
+	GtkSourceSnippetBundle *all;
+} LanguageIndex;
+
 struct _GtkSourceSnippetBundle
 {
 	GObject     parent_instance;
 	GArray     *infos;
 	GArray     *tooltips;
+
+	/* When the bundle is the result of a query, @infos and @tooltips are
+	 * shared with the queried bundle and @positions contains the positions
+	 * in @infos of the snippets of the result, starting at @offset.
+	 */
+	GArray     *positions;
+	guint       offset;
+	guint       n_positions;
+
+	/* Index of @infos for the queries, built on the first query. The
+	 * LanguageIndex are sorted by language and also referenced by
+	 * language id in @languages_by_id. @groups maps the group names to
+	 * the interned group names so that they can be compared by pointer.
+	 */
+	GPtrArray  *languages;
+	GHashTable *languages_by_id;
+	GHashTable *groups;
 };
 
 typedef struct
@@ -77,6 +116,14 @@ find_tooltip (GtkSourceSnippetBundle *self,
 	return NULL;
 }
 
+static void
+language_index_free (LanguageIndex *index)
+{
+	g_clear_pointer (&index->triggers, g_array_unref);
+	g_clear_object (&index->all);
+	g_free (index);
+}
+
 static gint
 compare_infos (const GtkSourceSnippetInfo *info_a,
 	       const GtkSourceSnippetInfo *info_b)
@@ -91,12 +138,90 @@ compare_infos (const GtkSourceSnippetInfo *info_a,
 	return ret;
 }
 
+static void
+clear_index (GtkSourceSnippetBundle *self)
+{
+	g_clear_pointer (&self->languages, g_ptr_array_unref);
+	g_clear_pointer (&self->languages_by_id, g_hash_table_unref);
+	g_clear_pointer (&self->groups, g_hash_table_unref);
+}
+
+static void
+ensure_index (GtkSourceSnippetBundle *self)
+{
+	LanguageIndex *index = NULL;
+
+	g_assert (GTK_SOURCE_IS_SNIPPET_BUNDLE (self));
+	g_assert (self->positions == NULL);
+
+	if (self->languages != NULL)
+	{
+		return;
+	}
+
+	self->languages = g_ptr_array_new_with_free_func ((GDestroyNotify)language_index_free);
+	self->languages_by_id = g_hash_table_new (g_str_hash, g_str_equal);
+	self->groups = g_hash_table_new (g_str_hash, g_str_equal);
+
+	for (guint i = 0; i < self->infos->len; i++)
+	{
+		const GtkSourceSnippetInfo *info = &g_array_index (self->infos, GtkSourceSnippetInfo, i);
+
+		if (index == NULL || g_strcmp0 (index->language, info->language) != 0)
+		{
+			index = g_new0 (LanguageIndex, 1);
+			index->language = info->language;
+			index->begin = i;
+			index->triggers = g_array_new (FALSE, FALSE, sizeof (guint));
+			g_ptr_array_add (self->languages, index);
+
+			if (info->language != NULL)
+			{
+				g_hash_table_insert (self->languages_by_id,
+				                     (char *)info->language,
+				                     index);
+			}
+		}
+
+		index->end = i + 1;
+
+		if (info->trigger != NULL)
+		{
+			const GtkSourceSnippetInfo *last = NULL;
+
+			if (index->triggers->len > 0)
+			{
+				guint last_position = g_array_index (index->triggers, guint, index->triggers->len - 1);
+				last = &g_array_index (self->infos, GtkSourceSnippetInfo, last_position);
+			}
+
+			if (last == NULL || !g_str_equal (last->trigger, info->trigger))
+			{
+				g_array_append_val (index->triggers, i);
+			}
+		}
+
+		if (info->group != NULL)
+		{
+			g_hash_table_insert (self->groups,
+			                     (char *)info->group,
+			                     (char *)info->group);
+		}
+	}
+}
+
 static void
 gtk_source_snippet_bundle_dispose (GObject *object)
 {
 	GtkSourceSnippetBundle *self = (GtkSourceSnippetBundle *)object;
 
-	if (self->infos->len > 0)
+	clear_index (self);
+
+	/* The results of the queries share the infos, so this also empties
+	 * them rather than leaving them with the strings of a finalized
+	 * snippet manager.
+	 */
+	if (self->positions == NULL && self->infos->len > 0)
 	{
 		g_array_remove_range (self->infos, 0, self->infos->len);
 	}
@@ -111,6 +236,7 @@ gtk_source_snippet_bundle_finalize (GObject *object)
 
 	g_clear_pointer (&self->infos, g_array_unref);
 	g_clear_pointer (&self->tooltips, g_array_unref);
+	g_clear_pointer (&self->positions, g_array_unref);
 
 	G_OBJECT_CLASS (_gtk_source_snippet_bundle_parent_class)->finalize (object);
 }
@@ -431,6 +557,26 @@ static const GMarkupParser snippets_parser = {
 	.end_element = snippets_end_element,
 };
 
+static gboolean
+load_contents (const char  *path,
+               char       **contents,
+               gsize       *length)
+{
+	GFile *file;
+	gboolean ret;
+
+	if (g_str_has_prefix (path, "resource://"))
+		file = g_file_new_for_uri (path);
+	else
+		file = g_file_new_for_path (path);
+
+	ret = g_file_load_contents (file, NULL, contents, length, NULL, NULL);
+
+	g_object_unref (file);
+
+	return ret;
+}
+
 static gboolean
 gtk_source_snippet_bundle_parse (GtkSourceSnippetBundle  *self,
                                  GtkSourceSnippetManager *manager,
@@ -439,17 +585,11 @@ gtk_source_snippet_bundle_parse (GtkSourceSnippetBundle  *self,
 	gchar *contents = NULL;
 	gsize length = 0;
 	gboolean ret = FALSE;
-	GFile *file;
 
 	g_assert (GTK_SOURCE_IS_SNIPPET_BUNDLE (self));
 	g_assert (path != NULL);
 
-	if (g_str_has_prefix (path, "resource://"))
-		file = g_file_new_for_uri (path);
-	else
-		file = g_file_new_for_path (path);
-
-	if (g_file_load_contents (file, NULL, &contents, &length, NULL, NULL))
+	if (load_contents (path, &contents, &length))
 	{
 		GMarkupParseContext *context;
 		ParseState state = {0};
@@ -488,8 +628,6 @@ gtk_source_snippet_bundle_parse (GtkSourceSnippetBundle  *self,
 #endif
 	}
 
-	g_object_unref (file);
-
 	return ret;
 }
 
@@ -519,20 +657,245 @@ _gtk_source_snippet_bundle_new_from_file (const gchar             *path,
 	return g_steal_pointer (&self);
 }
 
+/**
+ * _gtk_source_snippet_bundle_deserialize:
+ * @variant: a #GVariant of type %GTK_SOURCE_SNIPPET_BUNDLE_VARIANT_TYPE.
+ * @manager: the #GtkSourceSnippetManager interning the strings.
+ *
+ * Creates a bundle from the snippets saved with
+ * _gtk_source_snippet_bundle_serialize().
+ *
+ * Returns: (transfer full): a #GtkSourceSnippetBundle.
+ */
+GtkSourceSnippetBundle *
+_gtk_source_snippet_bundle_deserialize (GVariant                *variant,
+                                        GtkSourceSnippetManager *manager)
+{
+	GtkSourceSnippetBundle *self;
+	GVariant *infos;
+	GVariant *tooltips;
+	GVariantIter iter;
+	GtkSourceSnippetInfo info = {0};
+	GtkSourceSnippetTooltip tooltip;
+	const char *group, *name, *trigger, *language, *description, *text;
+
+	g_return_val_if_fail (variant != NULL, NULL);
+	g_return_val_if_fail (g_variant_is_of_type (variant, G_VARIANT_TYPE (GTK_SOURCE_SNIPPET_BUNDLE_VARIANT_TYPE)), NULL);
+	g_return_val_if_fail (GTK_SOURCE_IS_SNIPPET_MANAGER (manager), NULL);
+
+	self = _gtk_source_snippet_bundle_new ();
+
+	infos = g_variant_get_child_value (variant, 0);
+	tooltips = g_variant_get_child_value (variant, 1);
+
+	g_variant_iter_init (&iter, infos);
+	while (g_variant_iter_next (&iter, "(im&sm&sm&sm&sm&sm&s)",
+	                            &info.identifier,
+	                            &group, &name, &trigger,
+	                            &language, &description, &text))
+	{
+		info.group = _gtk_source_snippet_manager_intern (manager, group);
+		info.name = _gtk_source_snippet_manager_intern (manager, name);
+		info.trigger = _gtk_source_snippet_manager_intern (manager, trigger);
+		info.language = _gtk_source_snippet_manager_intern (manager, language);
+		info.description = _gtk_source_snippet_manager_intern (manager, description);
+		info.text = _gtk_source_snippet_manager_intern (manager, text);
+
+		gtk_source_snippet_bundle_add (self, &info);
+	}
+
+	g_variant_iter_init (&iter, tooltips);
+	while (g_variant_iter_next (&iter, "(uum&s)",
+	                            &tooltip.identifier,
+	                            &tooltip.focus_position,
+	                            &text))
+	{
+		tooltip.text = _gtk_source_snippet_manager_intern (manager, text);
+		g_array_append_val (self->tooltips, tooltip);
+	}
+
+	g_array_sort (self->infos, (GCompareFunc) compare_infos);
+
+	g_variant_unref (infos);
+	g_variant_unref (tooltips);
+
+	return self;
+}
+
+/**
+ * _gtk_source_snippet_bundle_serialize:
+ * @self: a #GtkSourceSnippetBundle.
+ *
+ * Saves the snippets of @self, to be loaded again with
+ * _gtk_source_snippet_bundle_deserialize() without parsing the
+ * snippet files.
+ *
+ * Returns: (transfer floating): a #GVariant of type
+ *   %GTK_SOURCE_SNIPPET_BUNDLE_VARIANT_TYPE.
+ */
+GVariant *
+_gtk_source_snippet_bundle_serialize (GtkSourceSnippetBundle *self)
+{
+	GVariantBuilder infos;
+	GVariantBuilder tooltips;
+
+	g_return_val_if_fail (GTK_SOURCE_IS_SNIPPET_BUNDLE (self), NULL);
+	g_return_val_if_fail (self->positions == NULL, NULL);
+
+	g_variant_builder_init (&infos, G_VARIANT_TYPE ("a(imsmsmsmsmsms)"));
+
+	for (guint i = 0; i < self->infos->len; i++)
+	{
+		const GtkSourceSnippetInfo *info = &g_array_index (self->infos, GtkSourceSnippetInfo, i);
+
+		g_variant_builder_add (&infos, "(imsmsmsmsmsms)",
+		                       info->identifier,
+		                       info->group,
+		                       info->name,
+		                       info->trigger,
+		                       info->language,
+		                       info->description,
+		                       info->text);
+	}
+
+	g_variant_builder_init (&tooltips, G_VARIANT_TYPE ("a(uums)"));
+
+	for (guint i = 0; i < self->tooltips->len; i++)
+	{
+		const GtkSourceSnippetTooltip *tooltip = &g_array_index (self->tooltips, GtkSourceSnippetTooltip, i);
+
+		g_variant_builder_add (&tooltips, "(uums)",
+		                       tooltip->identifier,
+		                       tooltip->focus_position,
+		                       tooltip->text);
+	}
+
+	return g_variant_new ("(@a(imsmsmsmsmsms)@a(uums))",
+	                      g_variant_builder_end (&infos),
+	                      g_variant_builder_end (&tooltips));
+}
+
+/**
+ * _gtk_source_snippet_bundle_scan_languages:
+ * @path: the path of a snippet file.
+ * @manager: the #GtkSourceSnippetManager interning the strings.
+ *
+ * Finds the languages of the snippets of a file without parsing it, by
+ * looking for the "languages" attributes. It may find a language without
+ * snippets if the text of a snippet contains such an attribute, but it
+ * never misses one.
+ *
+ * Returns: (transfer container) (nullable): the interned languages, or
+ *   %NULL if the file cannot be read.
+ */
+GPtrArray *
+_gtk_source_snippet_bundle_scan_languages (const char              *path,
+                                           GtkSourceSnippetManager *manager)
+{
+	GPtrArray *languages;
+	char *contents = NULL;
+	gsize length = 0;
+	const char *p;
+
+	g_return_val_if_fail (path != NULL, NULL);
+	g_return_val_if_fail (GTK_SOURCE_IS_SNIPPET_MANAGER (manager), NULL);
+
+	if (!load_contents (path, &contents, &length))
+	{
+		return NULL;
+	}
+
+	languages = g_ptr_array_new ();
+
+	for (p = strstr (contents, "languages"); p != NULL; p = strstr (p, "languages"))
+	{
+		const char *attribute = p;
+		const char *end;
+		char quote;
+		char *value;
+		char **strv;
+
+		p += strlen ("languages");
+
+		if (attribute == contents || !g_ascii_isspace (attribute[-1]))
+			continue;
+
+		while (g_ascii_isspace (*p))
+			p++;
+
+		if (*p != '=')
+			continue;
+
+		p++;
+
+		while (g_ascii_isspace (*p))
+			p++;
+
+		if (*p != '"' && *p != '\'')
+			continue;
+
+		quote = *p++;
+		end = strchr (p, quote);
+
+		if (end == NULL)
+			break;
+
+		value = g_strndup (p, end - p);
+		strv = g_strsplit (value, ";", 0);
+		g_free (value);
+
+		for (guint i = 0; strv[i] != NULL; i++)
+		{
+			const char *language;
+
+			g_strstrip (strv[i]);
+
+			if (strv[i][0] == 0)
+				continue;
+
+			language = _gtk_source_snippet_manager_intern (manager, strv[i]);
+
+			if (!g_ptr_array_find (languages, language, NULL))
+			{
+				g_ptr_array_add (languages, (char *)language);
+			}
+		}
+
+		g_strfreev (strv);
+
+		p = end + 1;
+	}
+
+	g_free (contents);
+
+	return languages;
+}
+
 void
 _gtk_source_snippet_bundle_merge (GtkSourceSnippetBundle *self,
                                   GtkSourceSnippetBundle *other)
 {
+	GArray *infos;
 	guint max_id = 0;
 
 	g_return_if_fail (GTK_SOURCE_IS_SNIPPET_BUNDLE (self));
 	g_return_if_fail (!other || GTK_SOURCE_IS_SNIPPET_BUNDLE (other));
+	g_return_if_fail (self->positions == NULL);
+	g_return_if_fail (!other || other->positions == NULL);
 
 	if (other == NULL || other->infos->len == 0)
 	{
 		return;
 	}
 
+	/* The results of the previous queries share the infos, so build a
+	 * new array rather than reordering the shared one.
+	 */
+	infos = g_array_sized_new (FALSE, FALSE,
+	                           sizeof (GtkSourceSnippetInfo),
+	                           self->infos->len + other->infos->len);
+	g_array_append_vals (infos, self->infos->data, self->infos->len);
+
 	for (guint i = 0; i < self->infos->len; i++)
 	{
 		const GtkSourceSnippetInfo *info = &g_array_index (self->infos, GtkSourceSnippetInfo, i);
@@ -543,10 +906,15 @@ _gtk_source_snippet_bundle_merge (GtkSourceSnippetBundle *self,
 	{
 		GtkSourceSnippetInfo info = g_array_index (other->infos, GtkSourceSnippetInfo, i);
 		info.identifier += max_id;
-		g_array_append_val (self->infos, info);
+		g_array_append_val (infos, info);
 	}
 
-	g_array_sort (self->infos, (GCompareFunc) compare_infos);
+	g_array_sort (infos, (GCompareFunc) compare_infos);
+
+	g_array_unref (self->infos);
+	self->infos = infos;
+
+	clear_index (self);
 
 	for (guint i = 0; i < other->tooltips->len; i++)
 	{
@@ -556,6 +924,28 @@ _gtk_source_snippet_bundle_merge (GtkSourceSnippetBundle *self,
 	}
 }
 
+/**
+ * _gtk_source_snippet_bundle_clear:
+ * @self: a #GtkSourceSnippetBundle.
+ *
+ * Removes all the snippets of @self, to merge other bundles again. The
+ * results of the previous queries are not affected.
+ */
+void
+_gtk_source_snippet_bundle_clear (GtkSourceSnippetBundle *self)
+{
+	g_return_if_fail (GTK_SOURCE_IS_SNIPPET_BUNDLE (self));
+	g_return_if_fail (self->positions == NULL);
+
+	g_array_unref (self->infos);
+	g_array_unref (self->tooltips);
+
+	self->infos = g_array_new (FALSE, FALSE, sizeof (GtkSourceSnippetInfo));
+	self->tooltips = g_array_new (FALSE, FALSE, sizeof (GtkSourceSnippetTooltip));
+
+	clear_index (self);
+}
+
 const gchar **
 _gtk_source_snippet_bundle_list_groups (GtkSourceSnippetBundle *self)
 {
@@ -657,9 +1047,7 @@ _gtk_source_snippet_bundle_create_snippet (GtkSourceSnippetBundle     *self,
 static gboolean
 info_matches (const GtkSourceSnippetInfo *info,
               const gchar                *group,
-              const gchar                *language_id,
-              const gchar                *trigger,
-              gboolean                    trigger_prefix_only)
+              const gchar                *language_id)
 {
 	g_assert (info != NULL);
 
@@ -676,24 +1064,172 @@ info_matches (const GtkSourceSnippetInfo *info,
 			return FALSE;
 	}
 
-	if (trigger != NULL)
+	return TRUE;
+}
+
+static inline const char *
+get_nth_trigger (GtkSourceSnippetBundle *self,
+                 GArray                 *positions,
+                 guint                   n)
+{
+	if (positions != NULL)
 	{
-		if (info->trigger == NULL)
-			return FALSE;
+		n = g_array_index (positions, guint, n);
+	}
 
-		if (trigger_prefix_only)
+	return g_array_index (self->infos, GtkSourceSnippetInfo, n).trigger;
+}
+
+/* Binary search in [@begin; @end) of @positions, or of the infos if
+ * @positions is %NULL, for the first snippet whose trigger is not before
+ * @trigger or, if @past_prefix, which comes after all the triggers
+ * starting with @trigger. The snippets without trigger come first.
+ */
+static guint
+search_trigger (GtkSourceSnippetBundle *self,
+                GArray                 *positions,
+                guint                   begin,
+                guint                   end,
+                const char             *trigger,
+                gboolean                past_prefix)
+{
+	gsize len = past_prefix ? strlen (trigger) : 0;
+
+	while (begin < end)
+	{
+		guint middle = begin + (end - begin) / 2;
+		const char *middle_trigger = get_nth_trigger (self, positions, middle);
+		gboolean before;
+
+		if (middle_trigger == NULL)
+			before = TRUE;
+		else if (past_prefix)
+			before = strncmp (middle_trigger, trigger, len) <= 0;
+		else
+			before = strcmp (middle_trigger, trigger) < 0;
+
+		if (before)
+			begin = middle + 1;
+		else
+			end = middle;
+	}
+
+	return begin;
+}
+
+static const GtkSourceSnippetInfo *
+find_info (GtkSourceSnippetBundle *self,
+           const LanguageIndex    *index,
+           const char             *group,
+           const char             *trigger)
+{
+	guint i;
+
+	for (i = search_trigger (self, NULL, index->begin, index->end, trigger, FALSE);
+	     i < index->end;
+	     i++)
+	{
+		const GtkSourceSnippetInfo *info = &g_array_index (self->infos, GtkSourceSnippetInfo, i);
+
+		if (!g_str_equal (info->trigger, trigger))
+			break;
+
+		/* @group is interned, like the groups of the infos */
+		if (group == NULL || group == info->group)
+			return info;
+	}
+
+	return NULL;
+}
+
+/* Adds to @positions the first snippet of each trigger of @index starting
+ * with @trigger_prefix, and in @group if it is not %NULL.
+ */
+static void
+add_matching (GtkSourceSnippetBundle *self,
+              const LanguageIndex    *index,
+              const char             *group,
+              const char             *trigger_prefix,
+              GArray                 *positions)
+{
+	const char *last = NULL;
+	guint begin;
+	guint end;
+
+	if (group == NULL)
+	{
+		begin = 0;
+		end = index->triggers->len;
+
+		if (trigger_prefix != NULL)
 		{
-			if (!g_str_has_prefix (info->trigger, trigger))
-				return FALSE;
+			begin = search_trigger (self, index->triggers, begin, end, trigger_prefix, FALSE);
+			end = search_trigger (self, index->triggers, begin, end, trigger_prefix, TRUE);
 		}
-		else
+
+		if (end > begin)
 		{
-			if (!g_str_equal (trigger, info->trigger))
-				return FALSE;
+			g_array_append_vals (positions,
+			                     &g_array_index (index->triggers, guint, begin),
+			                     end - begin);
 		}
+
+		return;
 	}
 
-	return TRUE;
+	/* The first snippet of a trigger may be in another group, so look
+	 * at all the snippets of the triggers.
+	 */
+	begin = index->begin;
+	end = index->end;
+
+	if (trigger_prefix != NULL)
+	{
+		begin = search_trigger (self, NULL, begin, end, trigger_prefix, FALSE);
+		end = search_trigger (self, NULL, begin, end, trigger_prefix, TRUE);
+	}
+
+	for (guint i = begin; i < end; i++)
+	{
+		const GtkSourceSnippetInfo *info = &g_array_index (self->infos, GtkSourceSnippetInfo, i);
+
+		if (info->trigger != NULL &&
+		    info->group == group &&
+		    (last == NULL || !g_str_equal (last, info->trigger)))
+		{
+			g_array_append_val (positions, i);
+			last = info->trigger;
+		}
+	}
+}
+
+/* Creates a bundle for the result of a query on @self, which shares the
+ * snippets of @self instead of copying them.
+ */
+static GtkSourceSnippetBundle *
+gtk_source_snippet_bundle_new_result (GtkSourceSnippetBundle *self,
+                                      GArray                 *positions,
+                                      guint                   offset,
+                                      guint                   n_positions)
+{
+	GtkSourceSnippetBundle *ret;
+
+	g_assert (GTK_SOURCE_IS_SNIPPET_BUNDLE (self));
+	g_assert (positions != NULL);
+	g_assert (offset + n_positions <= positions->len);
+
+	ret = _gtk_source_snippet_bundle_new ();
+
+	g_array_unref (ret->infos);
+	g_array_unref (ret->tooltips);
+
+	ret->infos = g_array_ref (self->infos);
+	ret->tooltips = g_array_ref (self->tooltips);
+	ret->positions = g_array_ref (positions);
+	ret->offset = offset;
+	ret->n_positions = n_positions;
+
+	return ret;
 }
 
 GtkSourceSnippet *
@@ -702,24 +1238,60 @@ _gtk_source_snippet_bundle_get_snippet (GtkSourceSnippetBundle *self,
                                         const gchar            *language_id,
                                         const gchar            *trigger)
 {
+	const GtkSourceSnippetInfo *info = NULL;
+
 	g_return_val_if_fail (GTK_SOURCE_IS_SNIPPET_BUNDLE (self), NULL);
+	g_return_val_if_fail (self->positions == NULL, NULL);
 
-	/* TODO: This could use bsearch(), but the complication here is that
-	 *       we want to ignore fields when the key field is NULL and the
-	 *       sort order for infos doesn't match what we are querying, so
-	 *       we would need an alternate index.
-	 */
+	if (trigger == NULL)
+	{
+		for (guint i = 0; i < self->infos->len; i++)
+		{
+			info = &g_array_index (self->infos, GtkSourceSnippetInfo, i);
 
-	for (guint i = 0; i < self->infos->len; i++)
+			if (info_matches (info, group, language_id))
+			{
+				return create_snippet_from_info (self, info);
+			}
+		}
+
+		return NULL;
+	}
+
+	ensure_index (self);
+
+	if (group != NULL)
 	{
-		const GtkSourceSnippetInfo *info = &g_array_index (self->infos, GtkSourceSnippetInfo, i);
+		group = g_hash_table_lookup (self->groups, group);
+
+		if (group == NULL)
+		{
+			return NULL;
+		}
+	}
+
+	if (language_id != NULL)
+	{
+		const LanguageIndex *index = g_hash_table_lookup (self->languages_by_id, language_id);
 
-		if (info_matches (info, group, language_id, trigger, FALSE))
+		if (index != NULL)
+		{
+			info = find_info (self, index, group, trigger);
+		}
+	}
+	else
+	{
+		for (guint i = 0; info == NULL && i < self->languages->len; i++)
 		{
-			return create_snippet_from_info (self, info);
+			info = find_info (self, g_ptr_array_index (self->languages, i), group, trigger);
 		}
 	}
 
+	if (info != NULL)
+	{
+		return create_snippet_from_info (self, info);
+	}
+
 	return NULL;
 }
 
@@ -730,36 +1302,109 @@ _gtk_source_snippet_bundle_list_matching (GtkSourceSnippetBundle *self,
                                           const gchar            *trigger_prefix)
 {
 	GtkSourceSnippetBundle *ret;
-	const char *last = NULL;
+	const char *interned_group = NULL;
+	GArray *positions;
 
 	g_return_val_if_fail (GTK_SOURCE_IS_SNIPPET_BUNDLE (self), NULL);
+	g_return_val_if_fail (self->positions == NULL, NULL);
 
-	ret = _gtk_source_snippet_bundle_new ();
+	ensure_index (self);
 
-	for (guint i = 0; i < self->infos->len; i++)
+	if (trigger_prefix != NULL && trigger_prefix[0] == 0)
 	{
-		const GtkSourceSnippetInfo *info = &g_array_index (self->infos, GtkSourceSnippetInfo, i);
+		trigger_prefix = NULL;
+	}
+
+	positions = g_array_new (FALSE, FALSE, sizeof (guint));
+
+	if (group != NULL)
+	{
+		interned_group = g_hash_table_lookup (self->groups, group);
 
-		if (info_matches (info, group, language_id, trigger_prefix, TRUE))
+		if (interned_group == NULL)
 		{
-			if (info->trigger != NULL && last != info->trigger)
+			goto finish;
+		}
+	}
+
+	if (language_id != NULL)
+	{
+		LanguageIndex *index = g_hash_table_lookup (self->languages_by_id, language_id);
+
+		if (index == NULL)
+		{
+			goto finish;
+		}
+
+		/* Without group, the result is a slice of the triggers of
+		 * the language, there is nothing to collect.
+		 */
+		if (interned_group == NULL)
+		{
+			guint begin = 0;
+			guint end = index->triggers->len;
+
+			if (trigger_prefix == NULL)
 			{
-				g_array_append_vals (ret->infos, info, 1);
-				last = info->trigger;
+				if (index->all == NULL)
+				{
+					index->all = gtk_source_snippet_bundle_new_result (self, index->triggers, begin, end);
+				}
+
+				g_array_unref (positions);
+
+				return G_LIST_MODEL (g_object_ref (index->all));
 			}
+
+			begin = search_trigger (self, index->triggers, begin, end, trigger_prefix, FALSE);
+			end = search_trigger (self, index->triggers, begin, end, trigger_prefix, TRUE);
+
+			g_array_unref (positions);
+
+			return G_LIST_MODEL (gtk_source_snippet_bundle_new_result (self, index->triggers, begin, end - begin));
 		}
+
+		add_matching (self, index, interned_group, trigger_prefix, positions);
 	}
+	else
+	{
+		for (guint i = 0; i < self->languages->len; i++)
+		{
+			add_matching (self,
+			              g_ptr_array_index (self->languages, i),
+			              interned_group,
+			              trigger_prefix,
+			              positions);
+		}
+	}
+
+finish:
+	ret = gtk_source_snippet_bundle_new_result (self, positions, 0, positions->len);
+	g_array_unref (positions);
+
+	return G_LIST_MODEL (g_steal_pointer (&ret));
+}
+
+static const GtkSourceSnippetInfo *
+get_nth_info (GtkSourceSnippetBundle *self,
+              guint                   position)
+{
+	if (self->positions != NULL)
+	{
+		if (position >= self->n_positions)
+		{
+			return NULL;
+		}
 
-	g_array_set_size (ret->tooltips, self->tooltips->len);
+		position = g_array_index (self->positions, guint, self->offset + position);
+	}
 
-	if (self->tooltips->len > 0)
+	if (position >= self->infos->len)
 	{
-		memcpy (ret->tooltips->data,
-			self->tooltips->data,
-			sizeof (GtkSourceSnippetTooltip) * self->tooltips->len);
+		return NULL;
 	}
 
-	return G_LIST_MODEL (g_steal_pointer (&ret));
+	return &g_array_index (self->infos, GtkSourceSnippetInfo, position);
 }
 
 static GType
@@ -771,19 +1416,21 @@ gtk_source_snippet_bundle_get_item_type (GListModel *model)
 static guint
 gtk_source_snippet_bundle_get_n_items (GListModel *model)
 {
-	return GTK_SOURCE_SNIPPET_BUNDLE (model)->infos->len;
+	GtkSourceSnippetBundle *self = GTK_SOURCE_SNIPPET_BUNDLE (model);
+
+	if (self->positions != NULL)
+	{
+		return self->n_positions;
+	}
+
+	return self->infos->len;
 }
 
 GtkSourceSnippetInfo *
 _gtk_source_snippet_bundle_get_info (GtkSourceSnippetBundle *self,
                                      guint                   position)
 {
-	if (position >= self->infos->len)
-	{
-		return NULL;
-	}
-
-	return &g_array_index (self->infos, GtkSourceSnippetInfo, position);
+	return (GtkSourceSnippetInfo *)get_nth_info (self, position);
 }
 
 static gpointer
@@ -791,13 +1438,14 @@ gtk_source_snippet_bundle_get_item (GListModel *model,
                                     guint       position)
 {
 	GtkSourceSnippetBundle *self = GTK_SOURCE_SNIPPET_BUNDLE (model);
+	const GtkSourceSnippetInfo *info = get_nth_info (self, position);
 
-	if (position >= self->infos->len)
+	if (info == NULL)
 	{
 		return NULL;
 	}
 
-	return create_snippet_from_info (self, &g_array_index (self->infos, GtkSourceSnippetInfo, position));
+	return create_snippet_from_info (self, info);
 }
 
 static void
@@ -24,9 +24,11 @@
 G_BEGIN_DECLS
 
 G_GNUC_INTERNAL
-GtkSourceSnippetManager *_gtk_source_snippet_manager_peek_default (void);
+GtkSourceSnippetManager *_gtk_source_snippet_manager_peek_default     (void);
 G_GNUC_INTERNAL
-const gchar             *_gtk_source_snippet_manager_intern       (GtkSourceSnippetManager *manager,
-                                                                   const gchar             *str);
+const gchar             *_gtk_source_snippet_manager_intern           (GtkSourceSnippetManager *manager,
+                                                                       const gchar             *str);
+G_GNUC_INTERNAL
+guint                    _gtk_source_snippet_manager_get_n_files_read (GtkSourceSnippetManager *manager);
 
 G_END_DECLS
@@ -19,6 +19,10 @@
 
 #include "config.h"
 
+#include <errno.h>
+
+#include <glib/gstdio.h>
+
 #include "gtksourcesnippet-private.h"
 #include "gtksourcesnippetbundle-private.h"
 #include "gtksourcesnippetmanager-private.h"
@@ -42,6 +46,37 @@
 #define SNIPPET_DIR         "snippets"
 #define SNIPPET_FILE_SUFFIX ".snippets"
 
+/* Increase when the layout of the cache changes. */
+#define CACHE_FORMAT_VERSION 2
+
+/* Files loaded shortly one after the other are saved together. */
+#define CACHE_SAVE_DELAY_SECONDS 2
+
+/* The format version and the GtkSourceView version, then for each file its
+ * path, size, modification time in nanoseconds, languages and, if it was
+ * parsed, its snippets.
+ */
+#define CACHE_TYPE "(uuuua(stxasm" GTK_SOURCE_SNIPPET_BUNDLE_VARIANT_TYPE "))"
+
+typedef struct
+{
+	char                   *path;
+
+	/* The interned languages of the snippets of the file */
+	GPtrArray              *languages;
+
+	/* To know if the cache is still valid for the file */
+	guint64                 size;
+	gint64                  mtime;
+
+	/* The parsed snippets once loaded, or the cached ones until then */
+	GtkSourceSnippetBundle *bundle;
+	GVariant               *cached;
+
+	guint                   has_stamp : 1;
+	guint                   loaded : 1;
+} SnippetFile;
+
 struct _GtkSourceSnippetManager
 {
 	GObject parent_instance;
@@ -67,6 +102,20 @@ struct _GtkSourceSnippetManager
 	 * query the @bundle.
 	 */
 	GtkSourceSnippetBundle *bundle;
+
+	/* The SnippetFile of the files on the search path. Only their
+	 * languages are known at first, a file is loaded in @bundle the
+	 * first time snippets of one of its languages are requested.
+	 */
+	GPtrArray *files;
+
+	/* The timeout saving the cache once it changed */
+	guint save_cache_source;
+
+	/* The number of snippet files scanned or parsed, rather than
+	 * restored from the cache.
+	 */
+	guint n_files_read;
 };
 
 enum {
@@ -80,17 +129,39 @@ static GParamSpec *properties[N_PROPS];
 
 G_DEFINE_TYPE (GtkSourceSnippetManager, gtk_source_snippet_manager, G_TYPE_OBJECT)
 
+static void save_cache (GtkSourceSnippetManager *self,
+                        gboolean                 async);
+
+static void
+snippet_file_free (SnippetFile *file)
+{
+	g_free (file->path);
+	g_clear_pointer (&file->languages, g_ptr_array_unref);
+	g_clear_object (&file->bundle);
+	g_clear_pointer (&file->cached, g_variant_unref);
+	g_free (file);
+}
+
 static void
 gtk_source_snippet_manager_dispose (GObject *object)
 {
 	GtkSourceSnippetManager *self = GTK_SOURCE_SNIPPET_MANAGER (object);
 
+	/* Do not lose the files loaded since the last save. */
+	if (self->save_cache_source != 0)
+	{
+		g_clear_handle_id (&self->save_cache_source, g_source_remove);
+		save_cache (self, FALSE);
+	}
+
 	if (self->bundle != NULL)
 	{
 		g_object_run_dispose (G_OBJECT (self->bundle));
 		g_clear_object (&self->bundle);
 	}
 
+	g_clear_pointer (&self->files, g_ptr_array_unref);
+
 	G_OBJECT_CLASS (gtk_source_snippet_manager_parent_class)->dispose (object);
 }
 
@@ -205,6 +276,14 @@ _gtk_source_snippet_manager_peek_default (void)
 	return default_instance;
 }
 
+guint
+_gtk_source_snippet_manager_get_n_files_read (GtkSourceSnippetManager *self)
+{
+	g_return_val_if_fail (GTK_SOURCE_IS_SNIPPET_MANAGER (self), 0);
+
+	return self->n_files_read;
+}
+
 const gchar *
 _gtk_source_snippet_manager_intern (GtkSourceSnippetManager *self,
                                     const gchar             *str)
@@ -282,15 +361,248 @@ gtk_source_snippet_manager_get_search_path (GtkSourceSnippetManager *self)
 	return (const gchar * const *)self->search_path;
 }
 
+/* SNIPPETS CACHE ----------------------------------------------------------
+ *
+ * Parsing the snippet files is deferred until snippets of their languages
+ * are requested, but the languages of each file must be known beforehand.
+ * They are saved in the user cache dir with the snippets of the files
+ * parsed so far, so that the next times neither the languages nor the
+ * snippets need to be read from the files, as long as they are unchanged.
+ * The cache is saved a little after it changes, so that the languages
+ * requested in a row are saved at once, and written from a thread.
+ */
+
+static gchar *
+get_cache_filename (GtkSourceSnippetManager *self)
+{
+	gchar *dirs;
+	gchar *key;
+	gchar *checksum;
+	gchar *basename;
+	gchar *cache_filename;
+
+	/* Names and descriptions are translated while parsing. */
+	dirs = g_strjoinv ("\n", (gchar **)gtk_source_snippet_manager_get_search_path (self));
+	key = g_strconcat (dirs, "\n", g_get_language_names ()[0], NULL);
+	checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA1, key, -1);
+	basename = g_strconcat (checksum, ".cache", NULL);
+
+	cache_filename = g_build_filename (g_get_user_cache_dir (),
+	                                   "gtksourceview-" GSV_API_VERSION_S,
+	                                   "snippets",
+	                                   basename,
+	                                   NULL);
+
+	g_free (basename);
+	g_free (checksum);
+	g_free (key);
+	g_free (dirs);
+
+	return cache_filename;
+}
+
+/* Returns the cached files by path. */
+static GHashTable *
+load_cache (GtkSourceSnippetManager *self)
+{
+	GHashTable *cached_files;
+	gchar *cache_filename;
+	gchar *contents;
+	gsize length;
+	GBytes *bytes;
+	GVariant *cache;
+	GVariant *files;
+	guint32 format, major, minor, micro;
+
+	cached_files = g_hash_table_new_full (g_str_hash, g_str_equal,
+	                                      g_free, (GDestroyNotify)g_variant_unref);
+
+	cache_filename = get_cache_filename (self);
+
+	if (!g_file_get_contents (cache_filename, &contents, &length, NULL))
+	{
+		g_free (cache_filename);
+		return cached_files;
+	}
+
+	/* Not trusted: a corrupted file gives default values. */
+	bytes = g_bytes_new_take (contents, length);
+	cache = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (CACHE_TYPE), bytes, FALSE));
+	g_bytes_unref (bytes);
+
+	g_variant_get (cache, "(uuuu@a(stxasm" GTK_SOURCE_SNIPPET_BUNDLE_VARIANT_TYPE "))",
+	               &format, &major, &minor, &micro, &files);
+
+	if (format == CACHE_FORMAT_VERSION &&
+	    major == GTK_SOURCE_MAJOR_VERSION &&
+	    minor == GTK_SOURCE_MINOR_VERSION &&
+	    micro == GTK_SOURCE_MICRO_VERSION)
+	{
+		GVariantIter iter;
+		GVariant *file;
+
+		g_variant_iter_init (&iter, files);
+		while ((file = g_variant_iter_next_value (&iter)))
+		{
+			const gchar *path;
+
+			g_variant_get_child (file, 0, "&s", &path);
+			g_hash_table_insert (cached_files, g_strdup (path), file);
+		}
+	}
+
+	g_variant_unref (files);
+	g_variant_unref (cache);
+	g_free (cache_filename);
+
+	return cached_files;
+}
+
 static void
-ensure_snippets (GtkSourceSnippetManager *self)
+save_cache_cb (GObject      *object,
+               GAsyncResult *result,
+               gpointer      user_data)
 {
-	GtkSourceSnippetBundle *bundle;
+	GError *error = NULL;
+
+	if (!g_file_replace_contents_finish (G_FILE (object), result, NULL, &error))
+	{
+		g_debug ("Could not save the snippets cache '%s': %s",
+		         (const gchar *)user_data,
+		         error->message);
+		g_clear_error (&error);
+	}
+
+	g_free (user_data);
+}
+
+/* Serializes the snippets of the files parsed so far, then writes them
+ * from a thread if @async, since the cache is only saved in the
+ * background while snippets are used.
+ */
+static void
+save_cache (GtkSourceSnippetManager *self,
+            gboolean                 async)
+{
+	GVariantBuilder files_builder;
+	GVariant *cache;
+	GBytes *bytes;
+	gchar *cache_filename;
+	gchar *dirname;
+	GError *error = NULL;
+
+	g_variant_builder_init (&files_builder, G_VARIANT_TYPE ("a(stxasm" GTK_SOURCE_SNIPPET_BUNDLE_VARIANT_TYPE ")"));
+
+	for (guint i = 0; i < self->files->len; i++)
+	{
+		SnippetFile *file = g_ptr_array_index (self->files, i);
+		GVariant *snippets = NULL;
+
+		if (!file->has_stamp)
+			continue;
+
+		if (file->bundle != NULL)
+			snippets = _gtk_source_snippet_bundle_serialize (file->bundle);
+		else if (file->cached != NULL)
+			snippets = file->cached;
+
+		g_variant_builder_add (&files_builder, "(stx@as@m" GTK_SOURCE_SNIPPET_BUNDLE_VARIANT_TYPE ")",
+		                       file->path,
+		                       file->size,
+		                       file->mtime,
+		                       g_variant_new_strv ((const gchar * const *)file->languages->pdata,
+		                                           file->languages->len),
+		                       g_variant_new_maybe (G_VARIANT_TYPE (GTK_SOURCE_SNIPPET_BUNDLE_VARIANT_TYPE),
+		                                            snippets));
+	}
+
+	cache = g_variant_ref_sink (g_variant_new ("(uuuu@a(stxasm" GTK_SOURCE_SNIPPET_BUNDLE_VARIANT_TYPE "))",
+	                                           CACHE_FORMAT_VERSION,
+	                                           GTK_SOURCE_MAJOR_VERSION,
+	                                           GTK_SOURCE_MINOR_VERSION,
+	                                           GTK_SOURCE_MICRO_VERSION,
+	                                           g_variant_builder_end (&files_builder)));
+	bytes = g_variant_get_data_as_bytes (cache);
+
+	cache_filename = get_cache_filename (self);
+	dirname = g_path_get_dirname (cache_filename);
+
+	if (g_mkdir_with_parents (dirname, 0700) != 0)
+	{
+		g_debug ("Could not save the snippets cache '%s': %s",
+		         cache_filename,
+		         g_strerror (errno));
+	}
+	else if (async)
+	{
+		GFile *file = g_file_new_for_path (cache_filename);
+
+		g_file_replace_contents_bytes_async (file,
+		                                     bytes,
+		                                     NULL,
+		                                     FALSE,
+		                                     G_FILE_CREATE_PRIVATE | G_FILE_CREATE_REPLACE_DESTINATION,
+		                                     NULL,
+		                                     save_cache_cb,
+		                                     g_strdup (cache_filename));
+
+		g_object_unref (file);
+	}
+	else if (!g_file_set_contents (cache_filename,
+	                               g_bytes_get_data (bytes, NULL),
+	                               g_bytes_get_size (bytes),
+	                               &error))
+	{
+		g_debug ("Could not save the snippets cache '%s': %s",
+		         cache_filename,
+		         error->message);
+		g_clear_error (&error);
+	}
+
+	g_free (dirname);
+	g_free (cache_filename);
+	g_bytes_unref (bytes);
+	g_variant_unref (cache);
+}
+
+static gboolean
+save_cache_timeout_cb (gpointer user_data)
+{
+	GtkSourceSnippetManager *self = user_data;
+
+	self->save_cache_source = 0;
+	save_cache (self, TRUE);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* The cache changed. Each language loaded would otherwise serialize all
+ * the files again, so the save waits for the next ones.
+ */
+static void
+queue_save_cache (GtkSourceSnippetManager *self)
+{
+	if (self->save_cache_source == 0)
+	{
+		self->save_cache_source =
+			g_timeout_add_seconds_full (G_PRIORITY_LOW,
+			                            CACHE_SAVE_DELAY_SECONDS,
+			                            save_cache_timeout_cb,
+			                            self,
+			                            NULL);
+	}
+}
+
+static void
+ensure_files (GtkSourceSnippetManager *self)
+{
+	GHashTable *cached_files;
 	GSList *filenames;
+	guint n_cached = 0;
 
 	g_assert (GTK_SOURCE_IS_SNIPPET_MANAGER (self));
 
-	if (self->bundle != NULL)
+	if (self->files != NULL)
 	{
 		return;
 	}
@@ -300,26 +612,163 @@ ensure_snippets (GtkSourceSnippetManager *self)
 		SNIPPET_FILE_SUFFIX,
 		TRUE);
 
-	bundle = _gtk_source_snippet_bundle_new ();
+	cached_files = load_cache (self);
+
+	self->files = g_ptr_array_new_with_free_func ((GDestroyNotify)snippet_file_free);
+	self->bundle = _gtk_source_snippet_bundle_new ();
 
 	for (const GSList *f = filenames; f; f = f->next)
 	{
-		const gchar *filename = f->data;
-		GtkSourceSnippetBundle *parsed;
+		SnippetFile *file = g_new0 (SnippetFile, 1);
+		GVariant *cached;
 
-		parsed = _gtk_source_snippet_bundle_new_from_file (filename, self);
+		file->path = g_strdup (f->data);
+		file->has_stamp = _gtk_source_utils_get_file_stamp (file->path, &file->size, &file->mtime);
 
-		if (parsed != NULL)
-			_gtk_source_snippet_bundle_merge (bundle, parsed);
-		else
-			g_warning ("Error reading snippet file '%s'", filename);
+		cached = file->has_stamp ? g_hash_table_lookup (cached_files, file->path) : NULL;
+
+		if (cached != NULL)
+		{
+			guint64 cached_size;
+			gint64 cached_mtime;
+
+			g_variant_get_child (cached, 1, "t", &cached_size);
+			g_variant_get_child (cached, 2, "x", &cached_mtime);
+
+			if (cached_size != file->size || cached_mtime != file->mtime)
+				cached = NULL;
+		}
+
+		if (cached != NULL)
+		{
+			const gchar **languages;
+			GVariant *snippets;
 
-		g_clear_object (&parsed);
+			g_variant_get_child (cached, 3, "^a&s", &languages);
+			g_variant_get_child (cached, 4, "m@" GTK_SOURCE_SNIPPET_BUNDLE_VARIANT_TYPE, &snippets);
+
+			file->languages = g_ptr_array_new ();
+
+			for (guint i = 0; languages[i] != NULL; i++)
+			{
+				g_ptr_array_add (file->languages,
+				                 (gchar *)_gtk_source_snippet_manager_intern (self, languages[i]));
+			}
+
+			file->cached = snippets;
+			n_cached++;
+
+			g_free (languages);
+		}
+		else
+		{
+			file->languages = _gtk_source_snippet_bundle_scan_languages (file->path, self);
+			self->n_files_read++;
+
+			if (file->languages == NULL)
+			{
+				g_warning ("Error reading snippet file '%s'", file->path);
+				file->languages = g_ptr_array_new ();
+				file->loaded = TRUE;
+			}
+
+			if (file->has_stamp)
+				queue_save_cache (self);
+		}
+
+		g_ptr_array_add (self->files, file);
 	}
 
-	self->bundle = g_steal_pointer (&bundle);
+	/* Forget the files which are not on the search path anymore. */
+	if (n_cached != g_hash_table_size (cached_files))
+	{
+		queue_save_cache (self);
+	}
 
+	g_hash_table_unref (cached_files);
 	g_slist_free_full (filenames, g_free);
+}
+
+static gboolean
+snippet_file_has_language (SnippetFile *file,
+                           const gchar *language_id)
+{
+	for (guint i = 0; i < file->languages->len; i++)
+	{
+		if (g_str_equal (g_ptr_array_index (file->languages, i), language_id))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static void
+load_file (GtkSourceSnippetManager *self,
+           SnippetFile             *file)
+{
+	g_assert (GTK_SOURCE_IS_SNIPPET_MANAGER (self));
+	g_assert (!file->loaded);
+
+	file->loaded = TRUE;
+
+	if (file->cached != NULL)
+	{
+		file->bundle = _gtk_source_snippet_bundle_deserialize (file->cached, self);
+		g_clear_pointer (&file->cached, g_variant_unref);
+		return;
+	}
+
+	file->bundle = _gtk_source_snippet_bundle_new_from_file (file->path, self);
+	self->n_files_read++;
+
+	if (file->bundle == NULL)
+		g_warning ("Error reading snippet file '%s'", file->path);
+	else if (file->has_stamp)
+		queue_save_cache (self);
+}
+
+/* Loads the files with snippets for @language_id, or all the files if
+ * @language_id is %NULL.
+ */
+static void
+ensure_snippets (GtkSourceSnippetManager *self,
+                 const gchar             *language_id)
+{
+	gboolean changed = FALSE;
+
+	g_assert (GTK_SOURCE_IS_SNIPPET_MANAGER (self));
+
+	ensure_files (self);
+
+	for (guint i = 0; i < self->files->len; i++)
+	{
+		SnippetFile *file = g_ptr_array_index (self->files, i);
+
+		if (file->loaded)
+			continue;
+
+		if (language_id != NULL && !snippet_file_has_language (file, language_id))
+			continue;
+
+		load_file (self, file);
+		changed = TRUE;
+	}
+
+	/* Merge the files again in the order of the search path, which
+	 * decides between the snippets with the same trigger.
+	 */
+	if (changed)
+	{
+		_gtk_source_snippet_bundle_clear (self->bundle);
+
+		for (guint i = 0; i < self->files->len; i++)
+		{
+			SnippetFile *file = g_ptr_array_index (self->files, i);
+
+			if (file->bundle != NULL)
+				_gtk_source_snippet_bundle_merge (self->bundle, file->bundle);
+		}
+	}
 
 	g_return_if_fail (GTK_SOURCE_IS_SNIPPET_BUNDLE (self->bundle));
 }
@@ -341,7 +790,7 @@ gtk_source_snippet_manager_list_groups (GtkSourceSnippetManager *self)
 {
 	g_return_val_if_fail (GTK_SOURCE_IS_SNIPPET_MANAGER (self), NULL);
 
-	ensure_snippets (self);
+	ensure_snippets (self, NULL);
 
 	return _gtk_source_snippet_bundle_list_groups (self->bundle);
 }
@@ -373,7 +822,7 @@ gtk_source_snippet_manager_list_matching (GtkSourceSnippetManager *self,
 {
 	g_return_val_if_fail (GTK_SOURCE_IS_SNIPPET_MANAGER (self), NULL);
 
-	ensure_snippets (self);
+	ensure_snippets (self, language_id);
 
 	return _gtk_source_snippet_bundle_list_matching (self->bundle, group, language_id, trigger_prefix);
 }
@@ -401,7 +850,7 @@ gtk_source_snippet_manager_get_snippet (GtkSourceSnippetManager *self,
 {
 	g_return_val_if_fail (GTK_SOURCE_IS_SNIPPET_MANAGER (self), NULL);
 
-	ensure_snippets (self);
+	ensure_snippets (self, language_id);
 
 	return _gtk_source_snippet_bundle_get_snippet (self->bundle, group, language_id, trigger);
 }
@@ -424,7 +873,7 @@ gtk_source_snippet_manager_list_all (GtkSourceSnippetManager *self)
 {
 	g_return_val_if_fail (GTK_SOURCE_IS_SNIPPET_MANAGER (self), NULL);
 
-	ensure_snippets (self);
+	ensure_snippets (self, NULL);
 
 	return G_LIST_MODEL (self->bundle);
 }
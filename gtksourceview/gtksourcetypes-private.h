@@ -35,7 +35,10 @@ typedef struct _GtkSourceContextEngine          GtkSourceContextEngine;
 typedef struct _GtkSourceEngine                 GtkSourceEngine;
 typedef struct _GtkSourceGutterRendererLines    GtkSourceGutterRendererLines;
 typedef struct _GtkSourceGutterRendererMarks    GtkSourceGutterRendererMarks;
+typedef struct _GtkSourceKeywordTrie            GtkSourceKeywordTrie;
+typedef struct _GtkSourceMapRaster              GtkSourceMapRaster;
 typedef struct _GtkSourceMarksSequence          GtkSourceMarksSequence;
+typedef struct _GtkSourceOccurrenceIndex        GtkSourceOccurrenceIndex;
 typedef struct _GtkSourcePixbufHelper           GtkSourcePixbufHelper;
 typedef struct _GtkSourceRegex                  GtkSourceRegex;
 typedef struct _GtkSourceSnippetBundle          GtkSourceSnippetBundle;
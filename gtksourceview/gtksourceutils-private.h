@@ -33,6 +33,10 @@ GSList  *_gtk_source_utils_get_file_list                 (gchar
                                                           const gchar                 *suffix,
                                                           gboolean                     only_dirs);
 G_GNUC_INTERNAL
+gboolean _gtk_source_utils_get_file_stamp                (const gchar                 *filename,
+                                                          guint64                     *size,
+                                                          gint64                      *mtime);
+G_GNUC_INTERNAL
 gint     _gtk_source_utils_string_to_int                 (const gchar                 *str);
 G_GNUC_INTERNAL
 gint     _gtk_source_utils_int_to_string                 (guint                        value,
@@ -401,6 +401,45 @@ _gtk_source_utils_get_file_list (gchar       **path,
 	return g_slist_reverse (files);
 }
 
+/* Gets the size and the modification time of @filename, in nanoseconds,
+ * to know if a cache of its contents is still valid. Whole seconds would
+ * miss a file rewritten with the same size within the same second.
+ * Resources do not change, but neither are they worth caching, so it
+ * fails for them.
+ */
+gboolean
+_gtk_source_utils_get_file_stamp (const gchar *filename,
+				  guint64     *size,
+				  gint64      *mtime)
+{
+	GFile *file;
+	GFileInfo *info;
+
+	if (g_str_has_prefix (filename, "resource://"))
+		return FALSE;
+
+	file = g_file_new_for_path (filename);
+	info = g_file_query_info (file,
+				  G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+				  G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+				  G_FILE_ATTRIBUTE_TIME_MODIFIED_NSEC,
+				  G_FILE_QUERY_INFO_NONE,
+				  NULL,
+				  NULL);
+	g_object_unref (file);
+
+	if (info == NULL)
+		return FALSE;
+
+	*size = g_file_info_get_size (info);
+	*mtime = (gint64)g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_GINT64_CONSTANT (1000000000) +
+		 g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_NSEC);
+
+	g_object_unref (info);
+
+	return TRUE;
+}
+
 /* Wrapper around strtoull for easier use: tries
  * to convert @str to a number and return -1 if it is not.
  * Used to check if references in subpattern contexts
@@ -95,5 +95,9 @@ gboolean _gtk_source_view_get_current_line_number_background (GtkSourceView *vie
 gboolean _gtk_source_view_get_current_line_number_color      (GtkSourceView *view,
                                                               GdkRGBA       *rgba);
 gboolean _gtk_source_view_get_current_line_number_bold       (GtkSourceView *view);
+gboolean _gtk_source_view_replay_key                         (GtkSourceView   *view,
+                                                              guint            key,
+                                                              GdkModifierType  state,
+                                                              const char      *text);
 
 G_END_DECLS
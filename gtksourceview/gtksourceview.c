@@ -49,6 +49,7 @@
 #include "gtksourcecompletion-private.h"
 #include "gtksourcecompletionprovider.h"
 #include "gtksourceiter-private.h"
+#include "gtksourcescheduler-private.h"
 #include "gtksourcesearchcontext-private.h"
 #include "gtksourcespacedrawer.h"
 #include "gtksourcespacedrawer-private.h"
@@ -238,6 +239,9 @@ typedef struct
 	guint show_right_margin  : 1;
 	guint smart_backspace : 1;
 	guint enable_snippets : 1;
+	guint has_focus : 1;
+	guint scheduler_visible : 1;
+	guint scheduler_focused : 1;
 
 	GtkAdjustment *vadj;
 	GtkAdjustment *hadj;
@@ -375,6 +379,40 @@ gtk_source_view_constructed (GObject *object)
 		          NULL);
 }
 
+/* The background work of the buffer (highlighting, search occurrences...)
+ * is done first while it is shown, and then while it has the focus.
+ */
+static void
+update_scheduler_holds (GtkSourceView *view)
+{
+	GtkSourceViewPrivate *priv = gtk_source_view_get_instance_private (view);
+	gboolean visible;
+	gboolean focused;
+
+	visible = priv->source_buffer != NULL && gtk_widget_get_mapped (GTK_WIDGET (view));
+	focused = priv->source_buffer != NULL && priv->has_focus;
+
+	if (visible != priv->scheduler_visible)
+	{
+		if (visible)
+			_gtk_source_scheduler_hold_owner (priv->source_buffer, GTK_SOURCE_SCHEDULER_PRIORITY_VISIBLE);
+		else
+			_gtk_source_scheduler_release_owner (priv->source_buffer, GTK_SOURCE_SCHEDULER_PRIORITY_VISIBLE);
+
+		priv->scheduler_visible = visible;
+	}
+
+	if (focused != priv->scheduler_focused)
+	{
+		if (focused)
+			_gtk_source_scheduler_hold_owner (priv->source_buffer, GTK_SOURCE_SCHEDULER_PRIORITY_FOCUSED);
+		else
+			_gtk_source_scheduler_release_owner (priv->source_buffer, GTK_SOURCE_SCHEDULER_PRIORITY_FOCUSED);
+
+		priv->scheduler_focused = focused;
+	}
+}
+
 static void
 gtk_source_view_focus_changed (GtkSourceView           *view,
                                GtkEventControllerFocus *focus)
@@ -384,6 +422,9 @@ gtk_source_view_focus_changed (GtkSourceView           *view,
 	g_assert (GTK_SOURCE_IS_VIEW (view));
 	g_assert (GTK_IS_EVENT_CONTROLLER_FOCUS (focus));
 
+	priv->has_focus = gtk_event_controller_focus_is_focus (focus);
+	update_scheduler_holds (view);
+
 	if (priv->left_gutter)
 	{
 		gtk_widget_queue_draw (GTK_WIDGET (priv->left_gutter));
@@ -578,6 +619,14 @@ gtk_source_view_size_allocate (GtkWidget *widget,
 	gtk_source_view_ensure_redrawn_rect_is_highlighted (GTK_SOURCE_VIEW (widget), &visible_rect);
 }
 
+static void
+gtk_source_view_map (GtkWidget *widget)
+{
+	GTK_WIDGET_CLASS (gtk_source_view_parent_class)->map (widget);
+
+	update_scheduler_holds (GTK_SOURCE_VIEW (widget));
+}
+
 static void
 gtk_source_view_unmap (GtkWidget *widget)
 {
@@ -587,6 +636,8 @@ gtk_source_view_unmap (GtkWidget *widget)
 	GTK_WIDGET_CLASS (gtk_source_view_parent_class)->unmap (widget);
 
 	_gtk_source_view_assistants_hide_all (&priv->assistants);
+
+	update_scheduler_holds (view);
 }
 
 static void
@@ -609,6 +660,7 @@ gtk_source_view_class_init (GtkSourceViewClass *klass)
 	widget_class->snapshot = gtk_source_view_snapshot;
 	widget_class->css_changed = gtk_source_view_css_changed;
 	widget_class->size_allocate = gtk_source_view_size_allocate;
+	widget_class->map = gtk_source_view_map;
 	widget_class->unmap = gtk_source_view_unmap;
 
 	textview_class->move_cursor = gtk_source_view_move_cursor;
@@ -1782,6 +1834,15 @@ search_start_cb (GtkSourceBufferInternal *buffer_internal,
 						     FALSE);
 }
 
+static void
+search_matches_changed_cb (GtkSourceBufferInternal *buffer_internal,
+                           GtkSourceSearchContext  *search_context,
+                           GtkSourceView           *view)
+{
+	/* The occurrences are painted in gtk_source_view_snapshot_layer(). */
+	gtk_widget_queue_draw (GTK_WIDGET (view));
+}
+
 static void
 source_mark_updated_cb (GtkSourceBuffer *buffer,
                         GtkSourceMark   *mark,
@@ -1891,8 +1952,24 @@ remove_source_buffer (GtkSourceView *view)
 						      search_start_cb,
 						      view);
 
+		g_signal_handlers_disconnect_by_func (buffer_internal,
+						      search_matches_changed_cb,
+						      view);
+
 		_gtk_source_view_snippets_set_buffer (&priv->snippets, NULL);
 
+		if (priv->scheduler_visible)
+		{
+			_gtk_source_scheduler_release_owner (priv->source_buffer, GTK_SOURCE_SCHEDULER_PRIORITY_VISIBLE);
+			priv->scheduler_visible = FALSE;
+		}
+
+		if (priv->scheduler_focused)
+		{
+			_gtk_source_scheduler_release_owner (priv->source_buffer, GTK_SOURCE_SCHEDULER_PRIORITY_FOCUSED);
+			priv->scheduler_focused = FALSE;
+		}
+
 		g_object_unref (priv->source_buffer);
 		priv->source_buffer = NULL;
 	}
@@ -1954,9 +2031,16 @@ set_source_buffer (GtkSourceView *view,
 				  G_CALLBACK (search_start_cb),
 				  view);
 
+		g_signal_connect (buffer_internal,
+				  "search-matches-changed",
+				  G_CALLBACK (search_matches_changed_cb),
+				  view);
+
 		buffer_has_selection_changed_cb (GTK_SOURCE_BUFFER (buffer), NULL, view);
 
 		_gtk_source_view_snippets_set_buffer (&priv->snippets, priv->source_buffer);
+
+		update_scheduler_holds (view);
 	}
 
 	gtk_source_view_update_style_scheme (view);
@@ -2897,6 +2981,180 @@ gtk_source_view_paint_current_line_highlight (GtkSourceView *view,
 					       &priv->current_line_background_color);
 }
 
+/* Paints the characters of an occurrence, merging the ones next to each
+ * other on the same display line. In a line with right-to-left or mixed
+ * text, the end of the occurrence is not always on the right of its
+ * start, and its characters are not always contiguous on screen. The
+ * line terminators are painted up to the edge of the view on the side
+ * where their paragraph ends, like the selection.
+ */
+static void
+gtk_source_view_paint_search_match (GtkSourceView      *view,
+                                    GtkSnapshot        *snapshot,
+                                    const GdkRGBA      *color,
+                                    const GdkRectangle *visible_rect,
+                                    const GtkTextIter  *start,
+                                    const GtkTextIter  *end)
+{
+	GtkTextView *text_view = GTK_TEXT_VIEW (view);
+	GdkRectangle run = { 0 };
+	gboolean has_run = FALSE;
+	GtkTextIter iter = *start;
+
+	while (gtk_text_iter_compare (&iter, end) < 0)
+	{
+		GdkRectangle rect;
+
+		gtk_text_view_get_iter_location (text_view, &iter, &rect);
+
+		/* The characters of a right-to-left run have a negative width. */
+		if (rect.width < 0)
+		{
+			rect.x += rect.width;
+			rect.width = -rect.width;
+		}
+
+		if (gtk_text_iter_ends_line (&iter))
+		{
+			GtkTextIter line_start = iter;
+			gboolean rtl;
+
+			if (gtk_text_view_starts_display_line (text_view, &line_start))
+			{
+				rtl = gtk_widget_get_direction (GTK_WIDGET (view)) == GTK_TEXT_DIR_RTL;
+			}
+			else
+			{
+				GdkRectangle line_start_rect;
+
+				gtk_text_view_backward_display_line_start (text_view, &line_start);
+				gtk_text_view_get_iter_location (text_view, &line_start, &line_start_rect);
+				rtl = rect.x < line_start_rect.x;
+			}
+
+			if (rtl)
+			{
+				rect.width = rect.x + rect.width - visible_rect->x;
+				rect.x = visible_rect->x;
+			}
+			else
+			{
+				rect.width = visible_rect->x + visible_rect->width - rect.x;
+			}
+		}
+
+		if (has_run &&
+		    rect.y == run.y &&
+		    rect.x <= run.x + run.width &&
+		    run.x <= rect.x + rect.width)
+		{
+			gdk_rectangle_union (&run, &rect, &run);
+		}
+		else
+		{
+			if (has_run)
+			{
+				gtk_snapshot_append_color (snapshot,
+				                           color,
+				                           &GRAPHENE_RECT_INIT (run.x, run.y, run.width, run.height));
+			}
+
+			run = rect;
+			has_run = TRUE;
+		}
+
+		if (!gtk_text_iter_forward_char (&iter))
+		{
+			break;
+		}
+	}
+
+	if (has_run)
+	{
+		gtk_snapshot_append_color (snapshot,
+		                           color,
+		                           &GRAPHENE_RECT_INIT (run.x, run.y, run.width, run.height));
+	}
+}
+
+/* Paints the search occurrences that are not marked with the found_tag of
+ * their search context, only for the visible part of the buffer.
+ */
+static void
+gtk_source_view_paint_search_matches (GtkSourceView *view,
+                                      GtkSnapshot   *snapshot)
+{
+	GtkSourceViewPrivate *priv = gtk_source_view_get_instance_private (view);
+	GtkTextView *text_view = GTK_TEXT_VIEW (view);
+	GtkTextBuffer *buffer;
+	GdkRectangle visible_rect;
+	GtkTextIter visible_start;
+	GtkTextIter visible_end;
+	GArray *matches = NULL;
+	const GList *l;
+
+	if (priv->source_buffer == NULL)
+	{
+		return;
+	}
+
+	buffer = GTK_TEXT_BUFFER (priv->source_buffer);
+
+	gtk_text_view_get_visible_rect (text_view, &visible_rect);
+	get_visible_region (text_view, &visible_start, &visible_end);
+
+	for (l = _gtk_source_buffer_get_search_contexts (priv->source_buffer); l != NULL; l = l->next)
+	{
+		GtkSourceSearchContext *search_context = l->data;
+		GdkRGBA color;
+		guint i;
+
+		if (!_gtk_source_search_context_get_match_background (search_context, &color))
+		{
+			continue;
+		}
+
+		if (matches == NULL)
+		{
+			matches = g_array_new (FALSE, FALSE, sizeof (gint));
+		}
+
+		g_array_set_size (matches, 0);
+		_gtk_source_search_context_get_matches (search_context,
+		                                        &visible_start,
+		                                        &visible_end,
+		                                        matches);
+
+		for (i = 0; i + 1 < matches->len; i += 2)
+		{
+			GtkTextIter match_start;
+			GtkTextIter match_end;
+
+			gtk_text_buffer_get_iter_at_offset (buffer, &match_start, g_array_index (matches, gint, i));
+			gtk_text_buffer_get_iter_at_offset (buffer, &match_end, g_array_index (matches, gint, i + 1));
+
+			if (gtk_text_iter_compare (&match_start, &visible_start) < 0)
+			{
+				match_start = visible_start;
+			}
+
+			if (gtk_text_iter_compare (&match_end, &visible_end) > 0)
+			{
+				match_end = visible_end;
+			}
+
+			gtk_source_view_paint_search_match (view,
+			                                    snapshot,
+			                                    &color,
+			                                    &visible_rect,
+			                                    &match_start,
+			                                    &match_end);
+		}
+	}
+
+	g_clear_pointer (&matches, g_array_unref);
+}
+
 static void
 gtk_source_view_snapshot_layer (GtkTextView      *text_view,
                                 GtkTextViewLayer  layer,
@@ -2936,6 +3194,8 @@ gtk_source_view_snapshot_layer (GtkTextView      *text_view,
 		}
 
 		gtk_source_view_paint_marks_background (view, snapshot);
+
+		gtk_source_view_paint_search_matches (view, snapshot);
 	}
 	else if (layer == GTK_TEXT_VIEW_LAYER_ABOVE_TEXT)
 	{
@@ -4299,6 +4559,122 @@ do_ctrl_backspace (GtkSourceView *view)
 	return FALSE;
 }
 
+static void
+indent_after_insert (GtkSourceView *view,
+                     gunichar       expected)
+{
+	GtkSourceViewPrivate *priv = gtk_source_view_get_instance_private (view);
+	GtkTextBuffer *buf;
+	GtkTextMark *mark;
+	GtkTextIter prev;
+	GtkTextIter cur;
+
+	buf = gtk_text_view_get_buffer (GTK_TEXT_VIEW (view));
+	mark = gtk_text_buffer_get_insert (buf);
+
+	gtk_text_buffer_get_iter_at_mark (buf, &prev, mark);
+	gtk_text_iter_backward_char (&prev);
+
+	if (gtk_text_iter_get_char (&prev) == expected)
+	{
+		gtk_text_buffer_begin_user_action (buf);
+		gtk_text_buffer_get_iter_at_mark (buf, &cur, mark);
+		gtk_source_indenter_indent (priv->indenter, view, &cur);
+		gtk_text_view_scroll_mark_onscreen (GTK_TEXT_VIEW (view), mark);
+		gtk_text_buffer_end_user_action (buf);
+	}
+}
+
+/* The keys handled after the input method: snippets, Tab and Backspace. */
+static gboolean
+gtk_source_view_handle_editing_key (GtkSourceView *view,
+                                    guint          key,
+                                    guint          keycode,
+                                    guint          state)
+{
+	GtkSourceViewPrivate *priv = gtk_source_view_get_instance_private (view);
+	GtkTextBuffer *buf;
+	guint modifiers;
+	gboolean editable;
+
+	buf = gtk_text_view_get_buffer (GTK_TEXT_VIEW (view));
+	editable = gtk_text_view_get_editable (GTK_TEXT_VIEW (view));
+
+	/* Be careful when testing for modifier state equality:
+	 * caps lock, num lock,etc need to be taken into account */
+	modifiers = gtk_accelerator_get_default_mod_mask ();
+
+	if (priv->enable_snippets &&
+	    _gtk_source_view_snippets_key_pressed (&priv->snippets, key, keycode, state))
+	{
+		return TRUE;
+	}
+
+	/* if tab or shift+tab:
+	 * with shift+tab key is GDK_ISO_Left_Tab (yay! on win32 and mac too!)
+	 */
+	if ((key == GDK_KEY_Tab || key == GDK_KEY_KP_Tab || key == GDK_KEY_ISO_Left_Tab) &&
+	    ((state & modifiers) == 0 ||
+	     (state & modifiers) == GDK_SHIFT_MASK) &&
+	    editable &&
+	    gtk_text_view_get_accepts_tab (GTK_TEXT_VIEW (view)))
+	{
+		GtkTextIter s, e;
+		gboolean has_selection;
+
+		has_selection = gtk_text_buffer_get_selection_bounds (buf, &s, &e);
+
+		if (priv->indent_on_tab)
+		{
+			/* shift+tab: always unindent */
+			if (state & GDK_SHIFT_MASK)
+			{
+				_gtk_source_buffer_save_and_clear_selection (GTK_SOURCE_BUFFER (buf));
+				gtk_source_view_unindent_lines (view, &s, &e);
+				_gtk_source_buffer_restore_selection (GTK_SOURCE_BUFFER (buf));
+				return TRUE;
+			}
+
+			/* tab: if we have a selection which spans one whole line
+			 * or more, we mass indent, if the selection spans less then
+			 * the full line just replace the text with \t
+			 */
+			if (has_selection &&
+			    ((gtk_text_iter_starts_line (&s) && gtk_text_iter_ends_line (&e)) ||
+			     (gtk_text_iter_get_line (&s) != gtk_text_iter_get_line (&e))))
+			{
+				_gtk_source_buffer_save_and_clear_selection (GTK_SOURCE_BUFFER (buf));
+				gtk_source_view_indent_lines (view, &s, &e);
+				_gtk_source_buffer_restore_selection (GTK_SOURCE_BUFFER (buf));
+				return TRUE;
+			}
+		}
+
+		insert_tab_or_spaces (view, &s, &e);
+		return TRUE;
+	}
+
+	if (key == GDK_KEY_BackSpace)
+	{
+		if ((state & modifiers) == 0)
+		{
+			if (priv->smart_backspace && do_smart_backspace (view))
+			{
+				return TRUE;
+			}
+		}
+		else if ((state & modifiers) == GDK_CONTROL_MASK)
+		{
+			if (do_ctrl_backspace (view))
+			{
+				return TRUE;
+			}
+		}
+	}
+
+	return FALSE;
+}
+
 static gboolean
 gtk_source_view_key_pressed (GtkSourceView         *view,
                              guint                  key,
@@ -4312,7 +4688,6 @@ gtk_source_view_key_pressed (GtkSourceView         *view,
 	GtkTextIter cur;
 	GtkTextMark *mark;
 	gint64 insertion_count;
-	guint modifiers;
 	gboolean editable;
 
 	g_assert (GTK_SOURCE_IS_VIEW (view));
@@ -4322,10 +4697,6 @@ gtk_source_view_key_pressed (GtkSourceView         *view,
 	insertion_count = _gtk_source_buffer_get_insertion_count (priv->source_buffer);
 	editable = gtk_text_view_get_editable (GTK_TEXT_VIEW (view));
 
-	/* Be careful when testing for modifier state equality:
-	 * caps lock, num lock,etc need to be taken into account */
-	modifiers = gtk_accelerator_get_default_mod_mask ();
-
 	mark = gtk_text_buffer_get_insert (buf);
 	gtk_text_buffer_get_iter_at_mark (buf, &cur, mark);
 
@@ -4419,95 +4790,67 @@ gtk_source_view_key_pressed (GtkSourceView         *view,
 		 */
 		if (did_insert)
 		{
-			GtkTextIter prev;
-			gunichar ch;
-
-			gtk_text_buffer_get_iter_at_mark (buf, &prev, mark);
-			gtk_text_iter_backward_char (&prev);
-			ch = gtk_text_iter_get_char (&prev);
-
-			if (ch == expected)
-			{
-				gtk_text_buffer_begin_user_action (buf);
-				gtk_text_buffer_get_iter_at_mark (buf, &cur, mark);
-				gtk_source_indenter_indent (priv->indenter, view, &cur);
-				gtk_text_view_scroll_mark_onscreen (GTK_TEXT_VIEW (view), mark);
-				gtk_text_buffer_end_user_action (buf);
-			}
+			indent_after_insert (view, expected);
 		}
 
 		return GDK_EVENT_STOP;
 	}
 
-	if (priv->enable_snippets &&
-	    _gtk_source_view_snippets_key_pressed (&priv->snippets, key, keycode, state))
+	if (gtk_source_view_handle_editing_key (view, key, keycode, state))
 	{
 		return GDK_EVENT_STOP;
 	}
 
-	/* if tab or shift+tab:
-	 * with shift+tab key is GDK_ISO_Left_Tab (yay! on win32 and mac too!)
-	 */
-	if ((key == GDK_KEY_Tab || key == GDK_KEY_KP_Tab || key == GDK_KEY_ISO_Left_Tab) &&
-	    ((state & modifiers) == 0 ||
-	     (state & modifiers) == GDK_SHIFT_MASK) &&
-	    editable &&
-	    gtk_text_view_get_accepts_tab (GTK_TEXT_VIEW (view)))
-	{
-		GtkTextIter s, e;
-		gboolean has_selection;
-
-		has_selection = gtk_text_buffer_get_selection_bounds (buf, &s, &e);
+	return retval;
+}
 
-		if (priv->indent_on_tab)
-		{
-			/* shift+tab: always unindent */
-			if (state & GDK_SHIFT_MASK)
-			{
-				_gtk_source_buffer_save_and_clear_selection (GTK_SOURCE_BUFFER (buf));
-				gtk_source_view_unindent_lines (view, &s, &e);
-				_gtk_source_buffer_restore_selection (GTK_SOURCE_BUFFER (buf));
-				return GDK_EVENT_STOP;
-			}
+/*
+ * _gtk_source_view_replay_key:
+ * @view: a #GtkSourceView
+ * @key: the keyval
+ * @state: the modifiers
+ * @text: (nullable): the text an input method would commit for @key
+ *
+ * Handles a key press which does not come from an event, such as a key
+ * replayed from a Vim macro, the way the key controller would: the text
+ * of an indenter trigger is inserted and the line indented, and snippets,
+ * Tab and Backspace are handled.
+ *
+ * Returns: %TRUE if the key was handled, otherwise the caller is expected
+ *   to insert @text itself.
+ */
+gboolean
+_gtk_source_view_replay_key (GtkSourceView   *view,
+                             guint            key,
+                             GdkModifierType  state,
+                             const char      *text)
+{
+	GtkSourceViewPrivate *priv = gtk_source_view_get_instance_private (view);
+	GtkTextBuffer *buf;
+	GtkTextIter cur;
 
-			/* tab: if we have a selection which spans one whole line
-			 * or more, we mass indent, if the selection spans less then
-			 * the full line just replace the text with \t
-			 */
-			if (has_selection &&
-			    ((gtk_text_iter_starts_line (&s) && gtk_text_iter_ends_line (&e)) ||
-			     (gtk_text_iter_get_line (&s) != gtk_text_iter_get_line (&e))))
-			{
-				_gtk_source_buffer_save_and_clear_selection (GTK_SOURCE_BUFFER (buf));
-				gtk_source_view_indent_lines (view, &s, &e);
-				_gtk_source_buffer_restore_selection (GTK_SOURCE_BUFFER (buf));
-				return GDK_EVENT_STOP;
-			}
-		}
+	g_return_val_if_fail (GTK_SOURCE_IS_VIEW (view), FALSE);
 
-		insert_tab_or_spaces (view, &s, &e);
-		return GDK_EVENT_STOP;
-	}
+	buf = gtk_text_view_get_buffer (GTK_TEXT_VIEW (view));
+	gtk_text_buffer_get_iter_at_mark (buf, &cur, gtk_text_buffer_get_insert (buf));
 
-	if (key == GDK_KEY_BackSpace)
+	if (text != NULL &&
+	    text[0] != 0 &&
+	    gtk_text_view_get_editable (GTK_TEXT_VIEW (view)) &&
+	    priv->auto_indent &&
+	    priv->indenter != NULL &&
+	    gtk_source_indenter_is_trigger (priv->indenter, view, &cur, state, key))
 	{
-		if ((state & modifiers) == 0)
-		{
-			if (priv->smart_backspace && do_smart_backspace (view))
-			{
-				return GDK_EVENT_STOP;
-			}
-		}
-		else if ((state & modifiers) == GDK_CONTROL_MASK)
-		{
-			if (do_ctrl_backspace (view))
-			{
-				return GDK_EVENT_STOP;
-			}
-		}
+		gtk_text_buffer_begin_user_action (buf);
+		gtk_text_buffer_insert (buf, &cur, text, -1);
+		gtk_text_buffer_end_user_action (buf);
+
+		indent_after_insert (view, g_utf8_get_char (text));
+
+		return TRUE;
 	}
 
-	return retval;
+	return gtk_source_view_handle_editing_key (view, key, 0, state);
 }
 
 static gboolean
@@ -84,6 +84,10 @@ gboolean    impl_match_info_next             (ImplMatchInfo          *match_info
                                               GError                **error);
 int         impl_match_info_get_match_count  (const ImplMatchInfo    *match_info);
 const char *impl_regex_get_pattern           (const ImplRegex        *regex);
+gboolean    impl_regex_jit_compile           (ImplRegex              *regex);
+gboolean    impl_regex_is_jit_compiled       (const ImplRegex        *regex);
 int         impl_regex_get_max_lookbehind    (const ImplRegex        *regex);
+gboolean    impl_regex_can_match_newline     (const ImplRegex        *regex);
+int         impl_regex_get_max_newlines      (const ImplRegex        *regex);
 
 G_END_DECLS
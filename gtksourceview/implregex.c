@@ -63,6 +63,7 @@ struct _ImplRegex
 	pcre2_compile_context *context;
 	pcre2_code            *code;
 	guint                  has_jit : 1;
+	guint                  jit_failed : 1;
 };
 
 struct _ImplMatchInfo
@@ -237,7 +238,7 @@ impl_regex_new (const char          *pattern,
 	/* Now try to JIT the pattern for faster execution time */
 	if (compile_options & G_REGEX_OPTIMIZE)
 	{
-		regex->has_jit = pcre2_jit_compile (regex->code, PCRE2_JIT_COMPLETE) == 0;
+		impl_regex_jit_compile (regex);
 	}
 
 #ifdef GTK_SOURCE_PROFILER_ENABLED
@@ -253,6 +254,31 @@ impl_regex_new (const char          *pattern,
 	return regex;
 }
 
+/* JIT compiles a regex created without G_REGEX_OPTIMIZE, once it turns
+ * out to be matched often enough to be worth it.
+ */
+gboolean
+impl_regex_jit_compile (ImplRegex *regex)
+{
+	g_return_val_if_fail (regex != NULL, FALSE);
+
+	if (!regex->has_jit && !regex->jit_failed)
+	{
+		regex->has_jit = pcre2_jit_compile (regex->code, PCRE2_JIT_COMPLETE) == 0;
+		regex->jit_failed = !regex->has_jit;
+	}
+
+	return regex->has_jit;
+}
+
+gboolean
+impl_regex_is_jit_compiled (const ImplRegex *regex)
+{
+	g_return_val_if_fail (regex != NULL, FALSE);
+
+	return regex->has_jit;
+}
+
 const char *
 impl_regex_get_pattern (const ImplRegex *regex)
 {
@@ -1150,6 +1176,650 @@ impl_regex_get_max_lookbehind (const ImplRegex *regex)
 	return value;
 }
 
+static inline gboolean
+is_line_terminator (gunichar ch)
+{
+	/* The line terminators of a GtkTextBuffer. */
+	return ch == '\n' || ch == '\r' || ch == 0x2029;
+}
+
+/* Skips the escape sequence at *@p. Returns FALSE if it can match a line
+ * terminator, or if it is not known. @codepoint is set to the character
+ * matched by the escape sequence, if it is a single one, or -1.
+ */
+static gboolean
+escape_is_single_line (const char **p,
+                       gboolean     in_class,
+                       gint32      *codepoint)
+{
+	const char *q = *p + 1;
+	gunichar ch;
+
+	*codepoint = -1;
+
+	if (*q == '\0')
+	{
+		*p = q;
+		return TRUE;
+	}
+
+	ch = g_utf8_get_char (q);
+	*p = g_utf8_next_char (q);
+
+	if (!g_ascii_isalnum (ch))
+	{
+		*codepoint = ch;
+		return !is_line_terminator (ch);
+	}
+
+	switch (ch)
+	{
+		case 't':
+			*codepoint = '\t';
+			return TRUE;
+
+		case 'a':
+			*codepoint = 0x07;
+			return TRUE;
+
+		case 'e':
+			*codepoint = 0x1b;
+			return TRUE;
+
+		case 'f':
+			*codepoint = 0x0c;
+			return TRUE;
+
+		case 'b':
+			if (in_class)
+				*codepoint = 0x08;
+			return TRUE;
+
+		/* With PCRE2_UCP, \S does not match U+2029 either. */
+		case 'd':
+		case 'w':
+		case 'h':
+		case 'S':
+		case 'V':
+			return TRUE;
+
+		case 'A':
+		case 'B':
+		case 'E':
+		case 'G':
+		case 'K':
+		case 'Z':
+		case 'z':
+		case 'g':
+		case 'k':
+			return !in_class;
+
+		case 'N':
+			return !in_class && **p != '{';
+
+		/* A back reference, and not an octal escape. */
+		case '1': case '2': case '3': case '4': case '5':
+		case '6': case '7': case '8': case '9':
+			return !in_class && !g_ascii_isdigit (**p);
+
+		default:
+			return FALSE;
+	}
+}
+
+static gboolean
+posix_class_is_single_line (const char *name,
+                            gsize       len)
+{
+	static const char * const single_line_classes[] = {
+		"alnum", "alpha", "blank", "digit", "graph", "lower",
+		"print", "punct", "upper", "word", "xdigit",
+	};
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS (single_line_classes); i++)
+	{
+		if (strlen (single_line_classes[i]) == len &&
+		    strncmp (single_line_classes[i], name, len) == 0)
+		{
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/* Skips the character class at *@p. */
+static gboolean
+class_is_single_line (const char **p)
+{
+	const char *q = *p + 1;
+
+	if (*q == '^')
+	{
+		return FALSE;
+	}
+
+	/* A ']' at the start is a literal. */
+	if (*q == ']')
+	{
+		q++;
+	}
+
+	while (*q != '\0' && *q != ']')
+	{
+		gint32 low;
+		gint32 high;
+
+		if (q[0] == '[' && q[1] == ':')
+		{
+			const char *end = strstr (q + 2, ":]");
+
+			if (end == NULL ||
+			    !posix_class_is_single_line (q + 2, end - (q + 2)))
+			{
+				return FALSE;
+			}
+
+			q = end + 2;
+			continue;
+		}
+
+		if (*q == '\\')
+		{
+			if (!escape_is_single_line (&q, TRUE, &low))
+				return FALSE;
+		}
+		else
+		{
+			low = g_utf8_get_char (q);
+			q = g_utf8_next_char (q);
+
+			if (is_line_terminator (low))
+				return FALSE;
+		}
+
+		if (q[0] != '-' || q[1] == ']' || q[1] == '\0' || low < 0)
+		{
+			continue;
+		}
+
+		/* A range. */
+		q++;
+
+		if (*q == '\\')
+		{
+			if (!escape_is_single_line (&q, TRUE, &high))
+				return FALSE;
+		}
+		else if (q[0] == '[' && q[1] == ':')
+		{
+			return FALSE;
+		}
+		else
+		{
+			high = g_utf8_get_char (q);
+			q = g_utf8_next_char (q);
+		}
+
+		if (high < 0 ||
+		    (low <= '\n' && '\n' <= high) ||
+		    (low <= '\r' && '\r' <= high) ||
+		    (low <= 0x2029 && 0x2029 <= high))
+		{
+			return FALSE;
+		}
+	}
+
+	if (*q == ']')
+	{
+		q++;
+	}
+
+	*p = q;
+	return TRUE;
+}
+
+static gboolean
+pattern_is_single_line (const char *pattern)
+{
+	const char *p = pattern;
+
+	while (*p != '\0')
+	{
+		gunichar ch = g_utf8_get_char (p);
+
+		if (is_line_terminator (ch))
+		{
+			return FALSE;
+		}
+
+		if (ch == '\\')
+		{
+			gint32 codepoint;
+
+			/* \Q...\E would need to be skipped too. */
+			if (p[1] == 'Q' ||
+			    !escape_is_single_line (&p, FALSE, &codepoint))
+			{
+				return FALSE;
+			}
+
+			continue;
+		}
+
+		if (ch == '[')
+		{
+			if (!class_is_single_line (&p))
+			{
+				return FALSE;
+			}
+
+			continue;
+		}
+
+		if (ch == '(' && p[1] == '*')
+		{
+			/* A verb or a start of pattern option, like (*CR). */
+			return FALSE;
+		}
+
+		if (ch == '(' && p[1] == '?')
+		{
+			const char *q = p + 2;
+
+			while (g_ascii_isalpha (*q) || *q == '^' || *q == '-')
+			{
+				q++;
+			}
+
+			/* An option setting: only some options are known to
+			 * keep '.' and the escapes away from the line
+			 * terminators.
+			 */
+			if (q > p + 2 && (*q == ')' || *q == ':'))
+			{
+				const char *option;
+
+				for (option = p + 2; option < q; option++)
+				{
+					if (strchr ("imnxJU^-", *option) == NULL)
+						return FALSE;
+				}
+			}
+		}
+
+		p = g_utf8_next_char (p);
+	}
+
+	return TRUE;
+}
+
+/**
+ * impl_regex_can_match_newline:
+ * @regex: an #ImplRegex.
+ *
+ * Tells whether a match of @regex can contain a line terminator, so can
+ * span several lines of a GtkTextBuffer. The answer is conservative: the
+ * pattern is only scanned for the constructs which can match a line
+ * terminator, like "\s", negated character classes or the "s" option.
+ *
+ * Returns: %FALSE if no match of @regex contains a line terminator.
+ */
+gboolean
+impl_regex_can_match_newline (const ImplRegex *regex)
+{
+	uint32_t has_cr_or_lf = 0;
+
+	g_return_val_if_fail (regex != NULL, TRUE);
+	g_return_val_if_fail (regex->code != NULL, TRUE);
+
+	if (regex->compile_flags & PCRE2_DOTALL)
+	{
+		return TRUE;
+	}
+
+	pcre2_pattern_info (regex->code, PCRE2_INFO_HASCRORLF, &has_cr_or_lf);
+
+	if (has_cr_or_lf)
+	{
+		return TRUE;
+	}
+
+	return !pattern_is_single_line (regex->pattern);
+}
+
+#define MAX_GROUP_DEPTH 32
+#define MAX_LINE_TERMINATORS 1000
+
+/* Skips the character class at *@p, whatever it contains. */
+static void
+skip_class (const char **p)
+{
+	const char *q = *p + 1;
+
+	if (*q == '^')
+		q++;
+
+	if (*q == ']')
+		q++;
+
+	while (*q != '\0' && *q != ']')
+	{
+		if (q[0] == '[' && q[1] == ':')
+		{
+			const char *end = strstr (q + 2, ":]");
+
+			if (end != NULL)
+			{
+				q = end + 2;
+				continue;
+			}
+		}
+
+		if (*q == '\\' && q[1] != '\0')
+			q++;
+
+		q = g_utf8_next_char (q);
+	}
+
+	if (*q == ']')
+		q++;
+
+	*p = q;
+}
+
+/* Skips the quantifier at *@p, if any. Returns the largest number of
+ * repetitions it allows, or -1 if there is no limit.
+ */
+static int
+skip_quantifier (const char **p)
+{
+	const char *q = *p;
+	int max = 1;
+
+	if (*q == '?')
+	{
+		q++;
+	}
+	else if (*q == '*' || *q == '+')
+	{
+		max = -1;
+		q++;
+	}
+	else if (*q == '{')
+	{
+		const char *r = q + 1;
+		guint64 low = 0;
+		guint64 high = 0;
+		gboolean has_low = FALSE;
+		gboolean has_high = FALSE;
+
+		while (g_ascii_isdigit (*r))
+		{
+			low = MIN (low * 10 + (*r - '0'), G_MAXINT);
+			r++;
+			has_low = TRUE;
+		}
+
+		if (*r == '}' && has_low)
+		{
+			max = (int)low;
+			q = r + 1;
+		}
+		else if (*r == ',')
+		{
+			r++;
+
+			while (g_ascii_isdigit (*r))
+			{
+				high = MIN (high * 10 + (*r - '0'), G_MAXINT);
+				r++;
+				has_high = TRUE;
+			}
+
+			/* Otherwise '{' is a literal. */
+			if (*r == '}' && (has_low || has_high))
+			{
+				max = has_high ? (int)high : -1;
+				q = r + 1;
+			}
+		}
+	}
+
+	/* Lazy or possessive. */
+	if (q != *p && (*q == '?' || *q == '+'))
+		q++;
+
+	*p = q;
+	return max;
+}
+
+/* Skips the start of the group at *@p, until its contents. Returns FALSE
+ * if it is not known, like a subroutine call, or if it can change how the
+ * rest of the pattern is read, like the "x" or "s" options.
+ */
+static gboolean
+skip_group_start (const char **p,
+                  gboolean    *is_group)
+{
+	const char *q = *p + 1;
+	const char *options;
+
+	*is_group = TRUE;
+
+	if (*q == '*')
+		return FALSE;
+
+	if (*q != '?')
+	{
+		*p = q;
+		return TRUE;
+	}
+
+	q++;
+
+	/* A comment. */
+	if (*q == '#')
+	{
+		const char *end = strchr (q, ')');
+
+		if (end == NULL)
+			return FALSE;
+
+		*is_group = FALSE;
+		*p = end + 1;
+		return TRUE;
+	}
+
+	/* An option setting, alone or for a non-capturing group. */
+	for (options = q; g_ascii_isalpha (*q) || *q == '^' || *q == '-'; q++)
+		;
+
+	if (q > options && (*q == ')' || *q == ':'))
+	{
+		const char *option;
+
+		for (option = options; option < q; option++)
+		{
+			if (strchr ("imnJU^-", *option) == NULL)
+				return FALSE;
+		}
+
+		*is_group = *q == ':';
+		*p = q + 1;
+		return TRUE;
+	}
+
+	q = options;
+
+	if (*q != '\0' && strchr (":=!|>", *q) != NULL)
+	{
+		*p = q + 1;
+		return TRUE;
+	}
+
+	if (q[0] == '<' && (q[1] == '=' || q[1] == '!'))
+	{
+		*p = q + 2;
+		return TRUE;
+	}
+
+	/* A named group. */
+	if (*q == 'P' && q[1] == '<')
+		q++;
+
+	if (*q == '<' || *q == '\'')
+	{
+		const char *end = strchr (q + 1, *q == '<' ? '>' : '\'');
+
+		if (end == NULL)
+			return FALSE;
+
+		*p = end + 1;
+		return TRUE;
+	}
+
+	/* Recursions, subroutine calls, conditions, callouts... */
+	return FALSE;
+}
+
+/* Counts the atoms of @pattern that can match a line terminator, each
+ * multiplied by the repetitions its quantifiers allow. Returns -1 if the
+ * count is not bounded or not known.
+ */
+static int
+pattern_get_max_line_terminators (const char *pattern,
+                                  gboolean    dotall)
+{
+	int counts[MAX_GROUP_DEPTH + 1];
+	int depth = 0;
+	gboolean has_back_reference = FALSE;
+	const char *p = pattern;
+
+	counts[0] = 0;
+
+	while (*p != '\0')
+	{
+		gunichar ch = g_utf8_get_char (p);
+		int atom = 0;
+		int max;
+
+		if (ch == '\\')
+		{
+			gint32 codepoint;
+			char letter = p[1];
+
+			if (letter == 'Q')
+				return -1;
+
+			if (letter == 'g' || letter == 'k' || (letter >= '1' && letter <= '9'))
+				has_back_reference = TRUE;
+
+			if (!escape_is_single_line (&p, FALSE, &codepoint))
+			{
+				atom = 1;
+
+				/* Like \x{2029} or \p{Zp}. */
+				if (*p == '{' && letter != '\0' && strchr ("xopPN", letter) != NULL)
+				{
+					const char *end = strchr (p, '}');
+
+					if (end == NULL)
+						return -1;
+
+					p = end + 1;
+				}
+			}
+		}
+		else if (ch == '[')
+		{
+			const char *q = p;
+
+			if (!class_is_single_line (&q))
+				atom = 1;
+
+			skip_class (&p);
+		}
+		else if (ch == '(')
+		{
+			gboolean is_group;
+
+			if (!skip_group_start (&p, &is_group))
+				return -1;
+
+			if (is_group)
+			{
+				if (depth == MAX_GROUP_DEPTH)
+					return -1;
+
+				counts[++depth] = 0;
+			}
+
+			continue;
+		}
+		else if (ch == ')')
+		{
+			if (depth == 0)
+				return -1;
+
+			atom = counts[depth--];
+			p++;
+		}
+		else
+		{
+			atom = is_line_terminator (ch) || (ch == '.' && dotall);
+			p = g_utf8_next_char (p);
+		}
+
+		max = skip_quantifier (&p);
+
+		if (atom > 0)
+		{
+			if (max < 0)
+				return -1;
+
+			counts[depth] += MIN ((gint64)atom * max, MAX_LINE_TERMINATORS + 1);
+
+			if (counts[depth] > MAX_LINE_TERMINATORS)
+				return -1;
+		}
+	}
+
+	/* A back reference can repeat what a group matched. */
+	if (depth != 0 || (has_back_reference && counts[0] > 0))
+		return -1;
+
+	return counts[0];
+}
+
+/**
+ * impl_regex_get_max_newlines:
+ * @regex: an #ImplRegex.
+ *
+ * Gets the largest number of line terminators that a match of @regex can
+ * contain, lookarounds included. A modification of a GtkTextBuffer can
+ * then only change the matches that are at most that many lines around
+ * it. Like impl_regex_can_match_newline(), the answer is conservative.
+ *
+ * Returns: the number of line terminators, or -1 if it is not bounded, as
+ *   with "\s+", or not known.
+ */
+int
+impl_regex_get_max_newlines (const ImplRegex *regex)
+{
+	g_return_val_if_fail (regex != NULL, -1);
+	g_return_val_if_fail (regex->code != NULL, -1);
+
+	if (regex->compile_flags & PCRE2_EXTENDED)
+	{
+		return -1;
+	}
+
+	return pattern_get_max_line_terminators (regex->pattern,
+	                                         (regex->compile_flags & PCRE2_DOTALL) != 0);
+}
+
 gboolean
 impl_match_info_is_partial_match (const ImplMatchInfo *match_info)
 {
@@ -21,24 +21,43 @@
 
 #include "config.h"
 
+#include <glib/gi18n.h>
+
+#include "gtksourcebuffer-private.h"
 #include "gtksourceindenter.h"
 #include "gtksourceview.h"
+#include "gtksourceview-private.h"
 
 #include "gtksourcevim.h"
 #include "gtksourcevimcommand.h"
 #include "gtksourcevimcommandbar.h"
 #include "gtksourceviminsert.h"
 #include "gtksourcevimnormal.h"
+#include "gtksourcevimregisters.h"
 #include "gtksourcevimreplace.h"
 #include "gtksourcevimvisual.h"
 
+/* Keys without a character are stored in macros as a private-use
+ * character, from their keyval.
+ */
+#define MACRO_KEYVAL_BASE 0xF0000
+#define MACRO_KEYVAL_MAX  0xFFFD
+
+/* Recursive macros have no other way to stop. */
+#define MAX_MACRO_DEPTH 100
+
 struct _GtkSourceVim
 {
 	GtkSourceVimState  parent_instance;
 	GString           *command_text;
 	GtkGestureClick   *click;
+	GString           *macro;
+	const char        *macro_register;
+	char              *recording_text;
+	guint              macro_depth;
 	guint              constrain_insert_source;
 	guint              in_handle_event : 1;
+	guint              macro_aborted : 1;
 };
 
 G_DEFINE_TYPE (GtkSourceVim, gtk_source_vim, GTK_SOURCE_TYPE_VIM_STATE)
@@ -246,12 +265,192 @@ gtk_source_vim_real_filter (GtkSourceVim *self,
 	return TRUE;
 }
 
+/* Macros are stored in registers as text, like in Vim, so that they can
+ * be yanked, edited and put back. Control keys are stored as their control
+ * character.
+ */
+static void
+append_key (GString         *str,
+            guint            keyval,
+            GdkModifierType  mods)
+{
+	gunichar ch;
+
+	switch (keyval)
+	{
+		case GDK_KEY_Escape:
+			g_string_append_c (str, '\033');
+			return;
+
+		case GDK_KEY_Return:
+		case GDK_KEY_KP_Enter:
+		case GDK_KEY_ISO_Enter:
+			g_string_append_c (str, '\n');
+			return;
+
+		case GDK_KEY_Tab:
+		case GDK_KEY_KP_Tab:
+		case GDK_KEY_ISO_Left_Tab:
+			g_string_append_c (str, '\t');
+			return;
+
+		case GDK_KEY_BackSpace:
+			g_string_append_c (str, '\b');
+			return;
+
+		default:
+			break;
+	}
+
+	ch = gdk_keyval_to_unicode (keyval);
+
+	if ((mods & GDK_CONTROL_MASK) != 0)
+	{
+		ch = g_unichar_toupper (ch);
+
+		if (ch > '@' && ch <= '_')
+		{
+			g_string_append_c (str, ch & 0x1F);
+			return;
+		}
+	}
+	else if ((mods & (GDK_ALT_MASK | GDK_SUPER_MASK)) == 0 &&
+	         ch >= 0x20 && ch != 0x7F)
+	{
+		g_string_append_unichar (str, ch);
+		return;
+	}
+
+	if (keyval <= MACRO_KEYVAL_MAX)
+	{
+		g_string_append_unichar (str, MACRO_KEYVAL_BASE + keyval);
+	}
+}
+
+static guint
+read_key (const char      **str,
+          GdkModifierType  *mods)
+{
+	gunichar ch = g_utf8_get_char (*str);
+
+	*str = g_utf8_next_char (*str);
+	*mods = 0;
+
+	switch (ch)
+	{
+		case '\033':
+			return GDK_KEY_Escape;
+
+		case '\n':
+		case '\r':
+			return GDK_KEY_Return;
+
+		case '\t':
+			return GDK_KEY_Tab;
+
+		case '\b':
+			return GDK_KEY_BackSpace;
+
+		default:
+			break;
+	}
+
+	if (ch < 0x20)
+	{
+		*mods = GDK_CONTROL_MASK;
+		return gdk_unicode_to_keyval (g_unichar_tolower (ch + '@'));
+	}
+
+	if (ch >= MACRO_KEYVAL_BASE && ch <= MACRO_KEYVAL_BASE + MACRO_KEYVAL_MAX)
+	{
+		return ch - MACRO_KEYVAL_BASE;
+	}
+
+	return gdk_unicode_to_keyval (ch);
+}
+
+/* Returns the character that GtkTextView would insert for the key, or 0. */
+static gunichar
+get_key_text (guint           keyval,
+              GdkModifierType mods)
+{
+	gunichar ch;
+
+	if ((mods & (GDK_CONTROL_MASK | GDK_ALT_MASK | GDK_SUPER_MASK)) != 0)
+		return 0;
+
+	switch (keyval)
+	{
+		case GDK_KEY_Return:
+		case GDK_KEY_KP_Enter:
+		case GDK_KEY_ISO_Enter:
+			return '\n';
+
+		case GDK_KEY_Tab:
+		case GDK_KEY_KP_Tab:
+			return '\t';
+
+		default:
+			break;
+	}
+
+	ch = gdk_keyval_to_unicode (keyval);
+
+	if (ch < 0x20 || ch == 0x7F)
+		return 0;
+
+	return ch;
+}
+
+static void
+gtk_source_vim_record_key (GtkSourceVim    *self,
+                           guint            keyval,
+                           GdkModifierType  mods)
+{
+	g_assert (GTK_SOURCE_IS_VIM (self));
+
+	/* The key stopping the recording is not part of the macro */
+	if (self->macro != NULL)
+	{
+		append_key (self->macro, keyval, mods);
+	}
+}
+
+static gboolean
+gtk_source_vim_handle_keypress (GtkSourceVimState *state,
+                                guint              keyval,
+                                guint              keycode,
+                                GdkModifierType    mods,
+                                const char        *string)
+{
+	GtkSourceVim *self = (GtkSourceVim *)state;
+	GtkSourceVimState *current;
+	gboolean recording;
+	gboolean ret;
+
+	g_assert (GTK_SOURCE_IS_VIM (self));
+
+	current = gtk_source_vim_state_get_current (state);
+	if (current == state)
+		return FALSE;
+
+	recording = self->macro != NULL;
+
+	ret = GTK_SOURCE_VIM_STATE_GET_CLASS (current)->handle_keypress (current, keyval, keycode, mods, string);
+
+	if (recording)
+		gtk_source_vim_record_key (self, keyval, mods);
+
+	return ret;
+}
+
 static gboolean
 gtk_source_vim_handle_event (GtkSourceVimState *state,
                              GdkEvent          *event)
 {
 	GtkSourceVim *self = (GtkSourceVim *)state;
 	GtkSourceVimState *current;
+	gboolean recording;
 	gboolean ret = FALSE;
 
 	g_assert (GTK_SOURCE_IS_VIM (self));
@@ -265,8 +464,20 @@ gtk_source_vim_handle_event (GtkSourceVimState *state,
 	if (current == state)
 		goto finish;
 
+	recording = self->macro != NULL;
+
 	ret = gtk_source_vim_state_handle_event (current, event);
 
+	if (recording &&
+	    gdk_event_get_event_type (event) == GDK_KEY_PRESS &&
+	    !gdk_key_event_is_modifier (event))
+	{
+		gtk_source_vim_record_key (self,
+		                           gdk_key_event_get_keyval (event),
+		                           gdk_event_get_modifier_state (event)
+		                           & gtk_accelerator_get_default_mod_mask ());
+	}
+
 	g_string_truncate (self->command_text, 0);
 	gtk_source_vim_state_append_command (state, self->command_text);
 	g_object_notify_by_pspec (G_OBJECT (self), properties[PROP_COMMAND_TEXT]);
@@ -430,6 +641,14 @@ gtk_source_vim_dispose (GObject *object)
 		self->command_text = NULL;
 	}
 
+	if (self->macro != NULL)
+	{
+		g_string_free (self->macro, TRUE);
+		self->macro = NULL;
+	}
+
+	g_clear_pointer (&self->recording_text, g_free);
+
 	G_OBJECT_CLASS (gtk_source_vim_parent_class)->dispose (object);
 }
 
@@ -466,6 +685,7 @@ gtk_source_vim_class_init (GtkSourceVimClass *klass)
 	object_class->get_property = gtk_source_vim_get_property;
 
 	state_class->handle_event = gtk_source_vim_handle_event;
+	state_class->handle_keypress = gtk_source_vim_handle_keypress;
 	state_class->view_set = gtk_source_vim_view_set;
 	state_class->resume = gtk_source_vim_resume;
 
@@ -623,6 +843,11 @@ gtk_source_vim_get_command_bar_text (GtkSourceVim *self)
 		current = gtk_source_vim_state_get_parent (current);
 	}
 
+	if (self->recording_text != NULL)
+	{
+		return self->recording_text;
+	}
+
 	return "";
 }
 
@@ -711,3 +936,301 @@ gtk_source_vim_emit_format (GtkSourceVim *self,
 
 	return ret;
 }
+
+gboolean
+gtk_source_vim_get_recording (GtkSourceVim *self)
+{
+	g_return_val_if_fail (GTK_SOURCE_IS_VIM (self), FALSE);
+
+	return self->macro != NULL;
+}
+
+/* Starts recording the keys pressed into @register_name, as with
+ * q{register}. An uppercase register name appends to the register.
+ */
+void
+gtk_source_vim_begin_recording (GtkSourceVim *self,
+                                const char   *register_name)
+{
+	GtkSourceVimState *registers;
+	char *name;
+
+	g_return_if_fail (GTK_SOURCE_IS_VIM (self));
+	g_return_if_fail (register_name != NULL);
+
+	if (self->macro != NULL)
+	{
+		gtk_source_vim_end_recording (self);
+	}
+
+	registers = gtk_source_vim_state_get_registers (GTK_SOURCE_VIM_STATE (self));
+	name = g_utf8_strdown (register_name, -1);
+
+	self->macro = g_string_new (NULL);
+	self->macro_register = g_intern_string (name);
+	self->recording_text = g_strdup_printf (_("recording @%s"), name);
+
+	if (g_ascii_isupper (register_name[0]))
+	{
+		const char *value = gtk_source_vim_registers_get (GTK_SOURCE_VIM_REGISTERS (registers), name);
+
+		if (value != NULL)
+		{
+			g_string_append (self->macro, value);
+		}
+	}
+
+	g_free (name);
+
+	g_object_notify_by_pspec (G_OBJECT (self), properties[PROP_COMMAND_BAR_TEXT]);
+}
+
+void
+gtk_source_vim_end_recording (GtkSourceVim *self)
+{
+	GtkSourceVimState *registers;
+
+	g_return_if_fail (GTK_SOURCE_IS_VIM (self));
+
+	if (self->macro == NULL)
+	{
+		return;
+	}
+
+	registers = gtk_source_vim_state_get_registers (GTK_SOURCE_VIM_STATE (self));
+	gtk_source_vim_registers_set (GTK_SOURCE_VIM_REGISTERS (registers),
+	                              self->macro_register,
+	                              self->macro->str);
+
+	g_string_free (self->macro, TRUE);
+	self->macro = NULL;
+	self->macro_register = NULL;
+	g_clear_pointer (&self->recording_text, g_free);
+
+	g_object_notify_by_pspec (G_OBJECT (self), properties[PROP_COMMAND_BAR_TEXT]);
+}
+
+/* Does what GtkTextView does with the text of a key press. */
+static void
+commit_text (GtkSourceVim *self,
+             const char   *text)
+{
+	GtkSourceView *view;
+	GtkSourceBuffer *buffer;
+	GtkTextIter iter;
+	gboolean editable;
+
+	g_assert (GTK_SOURCE_IS_VIM (self));
+	g_assert (text != NULL);
+
+	view = gtk_source_vim_state_get_view (GTK_SOURCE_VIM_STATE (self));
+	buffer = gtk_source_vim_state_get_buffer (GTK_SOURCE_VIM_STATE (self), &iter, NULL);
+	editable = gtk_text_view_get_editable (GTK_TEXT_VIEW (view));
+
+	if (gtk_text_view_get_overwrite (GTK_TEXT_VIEW (view)) &&
+	    !gtk_text_iter_ends_line (&iter))
+	{
+		GtkTextIter end = iter;
+
+		gtk_text_iter_forward_char (&end);
+		gtk_text_buffer_delete_interactive (GTK_TEXT_BUFFER (buffer), &iter, &end, editable);
+	}
+
+	gtk_text_buffer_insert_interactive_at_cursor (GTK_TEXT_BUFFER (buffer), text, -1, editable);
+}
+
+static void
+flush_text (GtkSourceVim *self,
+            GString      *text)
+{
+	if (text->len > 0)
+	{
+		commit_text (self, text->str);
+		g_string_truncate (text, 0);
+	}
+}
+
+/* Does what GtkTextView would have done with a key that the insert or
+ * replace mode did not handle.
+ */
+static void
+play_unhandled_key (GtkSourceVim      *self,
+                    GtkSourceVimState *current,
+                    guint              keyval,
+                    GdkModifierType    mods)
+{
+	GtkSourceView *view;
+	gunichar ch;
+	char str[8];
+
+	g_assert (GTK_SOURCE_IS_VIM (self));
+
+	if (!GTK_SOURCE_IS_VIM_INSERT (current) && !GTK_SOURCE_IS_VIM_REPLACE (current))
+		return;
+
+	view = gtk_source_vim_state_get_view (current);
+	ch = get_key_text (keyval, mods);
+	str[ch ? g_unichar_to_utf8 (ch, str) : 0] = 0;
+
+	/* The view auto-indents, expands snippets, handles Tab, etc */
+	if (_gtk_source_view_replay_key (view, keyval, mods, ch ? str : NULL))
+		return;
+
+	if (ch)
+	{
+		commit_text (self, str);
+		return;
+	}
+
+	switch (keyval)
+	{
+		case GDK_KEY_BackSpace:
+			g_signal_emit_by_name (view, "backspace");
+			break;
+
+		case GDK_KEY_Delete:
+		case GDK_KEY_KP_Delete:
+			g_signal_emit_by_name (view, "delete-from-cursor", GTK_DELETE_CHARS, 1);
+			break;
+
+		case GDK_KEY_Left:
+		case GDK_KEY_Right:
+			g_signal_emit_by_name (view, "move-cursor",
+			                       GTK_MOVEMENT_VISUAL_POSITIONS,
+			                       keyval == GDK_KEY_Left ? -1 : 1,
+			                       FALSE);
+			break;
+
+		case GDK_KEY_Up:
+		case GDK_KEY_Down:
+			g_signal_emit_by_name (view, "move-cursor",
+			                       GTK_MOVEMENT_DISPLAY_LINES,
+			                       keyval == GDK_KEY_Up ? -1 : 1,
+			                       FALSE);
+			break;
+
+		case GDK_KEY_Home:
+		case GDK_KEY_End:
+			g_signal_emit_by_name (view, "move-cursor",
+			                       GTK_MOVEMENT_DISPLAY_LINE_ENDS,
+			                       keyval == GDK_KEY_Home ? -1 : 1,
+			                       FALSE);
+			break;
+
+		default:
+			break;
+	}
+}
+
+/* Plays @keys, as stored in a register, @count times.
+ *
+ * All the repetitions are a single user action, and cursor movements are
+ * only notified at the end, so that bracket matching, the gutter, etc, are
+ * updated once. The buffer holds its changes meanwhile: the highlighting,
+ * the search occurrences and the map see a single replacement when the
+ * macro ends, unless a search from the macro needs them earlier. Text
+ * typed in insert mode is inserted at once rather than a character at a
+ * time, unless the view has to see the keys to auto-indent.
+ *
+ * As in Vim, the replay stops at the first error, such as a motion which
+ * could not move (see gtk_source_vim_abort_macro()).
+ *
+ * Returns FALSE if macros are nested too deeply.
+ */
+gboolean
+gtk_source_vim_play_macro (GtkSourceVim *self,
+                           const char   *keys,
+                           int           count)
+{
+	GtkSourceVimState *state = (GtkSourceVimState *)self;
+	GtkSourceBuffer *buffer;
+	GtkSourceView *view;
+	GString *text;
+
+	g_return_val_if_fail (GTK_SOURCE_IS_VIM (self), FALSE);
+	g_return_val_if_fail (keys != NULL, FALSE);
+
+	if (self->macro_depth >= MAX_MACRO_DEPTH)
+	{
+		return FALSE;
+	}
+
+	view = gtk_source_vim_state_get_view (state);
+	buffer = gtk_source_vim_state_get_buffer (state, NULL, NULL);
+	text = g_string_new (NULL);
+
+	if (self->macro_depth++ == 0)
+	{
+		gtk_source_vim_state_begin_user_action (state);
+		_gtk_source_buffer_block_cursor_moved (buffer);
+		_gtk_source_buffer_hold_changes (buffer);
+	}
+
+	for (int i = 0; i < count && !self->macro_aborted; i++)
+	{
+		const char *iter = keys;
+
+		while (*iter != 0 && !self->macro_aborted)
+		{
+			GtkSourceVimState *current;
+			GdkModifierType mods;
+			char string[16];
+			guint keyval;
+			gunichar ch;
+
+			keyval = read_key (&iter, &mods);
+			current = gtk_source_vim_state_get_current (state);
+
+			/* The insert mode lets GtkTextView insert text, which
+			 * can be batched as long as GtkSourceView does not
+			 * handle the key itself.
+			 */
+			if (GTK_SOURCE_IS_VIM_INSERT (current) &&
+			    (ch = get_key_text (keyval, mods)) &&
+			    ch != '\t' &&
+			    !gtk_source_view_get_auto_indent (view))
+			{
+				g_string_append_unichar (text, ch);
+				continue;
+			}
+
+			flush_text (self, text);
+
+			if (keyval == 0 || current == state)
+				continue;
+
+			gtk_source_vim_state_keyval_to_string (keyval, mods, string);
+
+			if (!GTK_SOURCE_VIM_STATE_GET_CLASS (current)->handle_keypress (current, keyval, 0, mods, string))
+			{
+				play_unhandled_key (self, current, keyval, mods);
+			}
+		}
+
+		flush_text (self, text);
+	}
+
+	if (--self->macro_depth == 0)
+	{
+		self->macro_aborted = FALSE;
+		_gtk_source_buffer_release_changes (buffer);
+		_gtk_source_buffer_unblock_cursor_moved (buffer);
+		gtk_source_vim_state_end_user_action (state);
+	}
+
+	g_string_free (text, TRUE);
+
+	return TRUE;
+}
+
+/* Stops the macros being played, if any, after the current key. */
+void
+gtk_source_vim_abort_macro (GtkSourceVim *self)
+{
+	g_return_if_fail (GTK_SOURCE_IS_VIM (self));
+
+	if (self->macro_depth > 0)
+	{
+		self->macro_aborted = TRUE;
+	}
+}
@@ -42,5 +42,13 @@ gboolean      gtk_source_vim_emit_format          (GtkSourceVim   *self,
                                                    GtkTextIter    *begin,
                                                    GtkTextIter    *end);
 void          gtk_source_vim_emit_ready           (GtkSourceVim   *self);
+gboolean      gtk_source_vim_get_recording        (GtkSourceVim   *self);
+void          gtk_source_vim_begin_recording      (GtkSourceVim   *self,
+                                                   const char     *register_name);
+void          gtk_source_vim_end_recording        (GtkSourceVim   *self);
+gboolean      gtk_source_vim_play_macro           (GtkSourceVim   *self,
+                                                   const char     *keys,
+                                                   int             count);
+void          gtk_source_vim_abort_macro          (GtkSourceVim   *self);
 
 G_END_DECLS
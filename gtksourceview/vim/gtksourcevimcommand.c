@@ -32,6 +32,10 @@
 #include <gtksourceview/gtksourcestylescheme.h>
 #include <gtksourceview/gtksourceview.h>
 
+#include "gtksourcebuffer-private.h"
+#include "gtksourcesearchcontext-private.h"
+#include "implregex-private.h"
+
 #include "gtksourcevim.h"
 #include "gtksourcevimcharpending.h"
 #include "gtksourcevimcommand.h"
@@ -84,6 +88,18 @@ static const struct {
 	{ "xhtml", "html" },
 };
 
+static const struct {
+	const char *name;
+	const char *command;
+} global_commands[] = {
+	{ "global!", "vglobal" },
+	{ "global", "global" },
+	{ "vglobal", "vglobal" },
+	{ "g!", "vglobal" },
+	{ "g", "global" },
+	{ "v", "vglobal" },
+};
+
 static inline gboolean
 parse_number (const char *str,
               int        *number)
@@ -1265,8 +1281,13 @@ gtk_source_vim_command_search_replace (GtkSourceVimCommand *self)
 	gboolean flag_g = FALSE;
 	gboolean flag_i = FALSE;
 	gboolean found_match = FALSE;
+	GArray *starts;
+	GArray *ends;
+	GPtrArray *replacements;
 	guint line = 0;
 	int last_line;
+	int last_offset = 0;
+	int delta = 0;
 
 	g_assert (GTK_SOURCE_IS_VIM_COMMAND (self));
 
@@ -1303,11 +1324,16 @@ gtk_source_vim_command_search_replace (GtkSourceVimCommand *self)
 	line = gtk_text_iter_get_line (&iter);
 	last_line = -1;
 
-	gtk_text_buffer_begin_user_action (GTK_TEXT_BUFFER (buffer));
+	starts = g_array_new (FALSE, FALSE, sizeof (int));
+	ends = g_array_new (FALSE, FALSE, sizeof (int));
+	replacements = g_ptr_array_new_with_free_func (g_free);
 
+	/* Collect the replacements, and apply them at once. */
 	while (gtk_source_search_context_forward (context, &iter, &match_start, &match_end, &wrapped) && !wrapped)
 	{
 		guint cur_line = gtk_text_iter_get_line (&match_start);
+		char *replacement;
+		int offset;
 
 		if (!found_match)
 		{
@@ -1337,22 +1363,44 @@ gtk_source_vim_command_search_replace (GtkSourceVimCommand *self)
 			goto next_result;
 		}
 
-		last_line = cur_line;
-		if (!gtk_source_search_context_replace (context, &match_start, &match_end, replace_str, -1, NULL))
+		replacement = _gtk_source_search_context_get_replacement (context, &match_start, &match_end, replace_str, -1, NULL);
+
+		if (replacement == NULL)
 		{
 			break;
 		}
 
+		last_line = cur_line;
+
+		/* Where the last replacement starts once the previous ones are applied */
+		last_offset = gtk_text_iter_get_offset (&match_start) + delta;
+		delta += g_utf8_strlen (replacement, -1) - (gtk_text_iter_get_offset (&match_end) - gtk_text_iter_get_offset (&match_start));
+
+		offset = gtk_text_iter_get_offset (&match_start);
+		g_array_append_val (starts, offset);
+		offset = gtk_text_iter_get_offset (&match_end);
+		g_array_append_val (ends, offset);
+		g_ptr_array_add (replacements, replacement);
+
 	next_result:
 		iter = match_end;
 		gtk_text_iter_forward_char (&iter);
 	}
 
-	gtk_text_buffer_end_user_action (GTK_TEXT_BUFFER (buffer));
+	_gtk_source_search_context_replace_ranges (context,
+	                                           (const int *)(gpointer)starts->data,
+	                                           (const int *)(gpointer)ends->data,
+	                                           (const char * const *)replacements->pdata,
+	                                           starts->len);
+
+	g_array_unref (starts);
+	g_array_unref (ends);
+	g_ptr_array_unref (replacements);
 
 	if (last_line >= 0)
 	{
-		gtk_text_buffer_get_iter_at_line (GTK_TEXT_BUFFER (buffer), &iter, last_line);
+		gtk_text_buffer_get_iter_at_offset (GTK_TEXT_BUFFER (buffer), &iter, last_offset);
+		gtk_text_iter_set_line_offset (&iter, 0);
 		while (!gtk_text_iter_ends_line (&iter) &&
 		       g_unichar_isspace (gtk_text_iter_get_char (&iter)))
 			gtk_text_iter_forward_char (&iter);
@@ -1367,6 +1415,442 @@ cleanup:
 	g_free (options);
 }
 
+/* Splits "/pattern/command" of :g, the command being the rest of the
+ * string, separators included.
+ */
+static gboolean
+parse_global (const char  *str,
+              char       **pattern,
+              const char **command)
+{
+	GString *build;
+	gunichar sep;
+	gboolean escaped = FALSE;
+
+	*pattern = NULL;
+	*command = NULL;
+
+	if (str == NULL || *str == 0)
+		return FALSE;
+
+	sep = g_utf8_get_char (str);
+	build = g_string_new (NULL);
+
+	for (str = g_utf8_next_char (str); *str; str = g_utf8_next_char (str))
+	{
+		gunichar ch = g_utf8_get_char (str);
+
+		if (escaped)
+		{
+			escaped = FALSE;
+
+			/* don't escape separator in output string */
+			if (ch == sep)
+				g_string_truncate (build, build->len - 1);
+		}
+		else if (ch == '\\')
+		{
+			escaped = TRUE;
+		}
+		else if (ch == sep)
+		{
+			str = g_utf8_next_char (str);
+			break;
+		}
+
+		g_string_append_unichar (build, ch);
+	}
+
+	*pattern = g_string_free (build, FALSE);
+	*command = str;
+
+	return TRUE;
+}
+
+/* Finds the lines of [@first_line, @last_line] matching @regex, with a
+ * single pass over their text. The lines are delimited like in
+ * GtkTextBuffer, by "\n", "\r", "\r\n" or U+2029.
+ */
+static GArray *
+find_matching_lines (GtkTextBuffer *buffer,
+                     ImplRegex     *regex,
+                     int            first_line,
+                     int            last_line,
+                     gboolean       invert)
+{
+	ImplMatchInfo *match_info = NULL;
+	GtkTextIter begin;
+	GtkTextIter end;
+	GArray *lines;
+	char *text;
+	gsize len;
+	gsize pos = 0;
+	int line = first_line;
+	int next_line = first_line;
+
+	lines = g_array_new (FALSE, FALSE, sizeof (int));
+
+	gtk_text_buffer_get_iter_at_line (buffer, &begin, first_line);
+	gtk_text_buffer_get_iter_at_line (buffer, &end, last_line);
+	if (!gtk_text_iter_ends_line (&end))
+		gtk_text_iter_forward_to_line_end (&end);
+
+	text = gtk_text_buffer_get_slice (buffer, &begin, &end, TRUE);
+	len = strlen (text);
+
+	while (impl_regex_match_full (regex, text, len, pos, 0, &match_info, NULL))
+	{
+		int match_start;
+		int delimiter;
+		int next;
+
+		impl_match_info_fetch_pos (match_info, 0, &match_start, NULL);
+		g_clear_pointer (&match_info, impl_match_info_free);
+
+		/* The match may start on a following line, @pos being the
+		 * start of @line.
+		 */
+		for (;;)
+		{
+			pango_find_paragraph_boundary (text + pos, len - pos, &delimiter, &next);
+
+			if (pos + next > (gsize)match_start || next == delimiter)
+				break;
+
+			pos += next;
+			line++;
+		}
+
+		for (; invert && next_line < line; next_line++)
+			g_array_append_val (lines, next_line);
+
+		if (!invert)
+			g_array_append_val (lines, line);
+
+		next_line = line + 1;
+
+		/* The last line */
+		if (next == delimiter)
+			break;
+
+		pos += next;
+		line++;
+	}
+
+	g_clear_pointer (&match_info, impl_match_info_free);
+
+	for (; invert && next_line <= last_line; next_line++)
+		g_array_append_val (lines, next_line);
+
+	g_free (text);
+
+	return lines;
+}
+
+/* Deletes @lines, which is what most :g commands do, from the last run
+ * of consecutive lines so that the line numbers before it stay valid.
+ */
+static void
+delete_lines (GtkSourceVimCommand *self,
+              GArray              *lines)
+{
+	GtkSourceBuffer *buffer;
+	GtkTextIter iter;
+	GtkTextIter end;
+	char *line_text;
+	char *text;
+	int last_line;
+	int cursor_line;
+
+	buffer = gtk_source_vim_state_get_buffer (GTK_SOURCE_VIM_STATE (self), NULL, NULL);
+	last_line = gtk_text_buffer_get_line_count (GTK_TEXT_BUFFER (buffer)) - 1;
+
+	/* Like :delete, the register gets the last deleted line */
+	gtk_text_buffer_get_iter_at_line (GTK_TEXT_BUFFER (buffer), &iter,
+	                                  g_array_index (lines, int, lines->len - 1));
+	end = iter;
+	if (!gtk_text_iter_ends_line (&end))
+		gtk_text_iter_forward_to_line_end (&end);
+	line_text = gtk_text_iter_get_slice (&iter, &end);
+	text = g_strdup_printf ("%s\n", line_text);
+	gtk_source_vim_state_set_current_register_value (GTK_SOURCE_VIM_STATE (self), text);
+	g_free (line_text);
+	g_free (text);
+
+	cursor_line = g_array_index (lines, int, lines->len - 1) + 1 - lines->len;
+
+	/* A single undo step, and a single update of the highlighting and
+	 * the search occurrences.
+	 */
+	gtk_source_vim_state_begin_user_action (GTK_SOURCE_VIM_STATE (self));
+	_gtk_source_buffer_hold_changes (buffer);
+
+	for (guint i = lines->len; i > 0;)
+	{
+		int last = g_array_index (lines, int, i - 1);
+		int first = last;
+
+		/* Delete runs of lines with a single range */
+		for (i--; i > 0 && g_array_index (lines, int, i - 1) == first - 1; i--)
+			first--;
+
+		gtk_text_buffer_get_iter_at_line (GTK_TEXT_BUFFER (buffer), &iter, first);
+
+		if (last < last_line)
+		{
+			gtk_text_buffer_get_iter_at_line (GTK_TEXT_BUFFER (buffer), &end, last + 1);
+		}
+		else
+		{
+			/* Swallow the newline before the last line */
+			if (first > 0)
+				gtk_text_iter_backward_char (&iter);
+			gtk_text_buffer_get_end_iter (GTK_TEXT_BUFFER (buffer), &end);
+		}
+
+		gtk_text_buffer_delete (GTK_TEXT_BUFFER (buffer), &iter, &end);
+	}
+
+	_gtk_source_buffer_release_changes (buffer);
+	gtk_source_vim_state_end_user_action (GTK_SOURCE_VIM_STATE (self));
+
+	gtk_text_buffer_get_iter_at_line (GTK_TEXT_BUFFER (buffer), &iter, MAX (0, cursor_line));
+	while (!gtk_text_iter_ends_line (&iter) &&
+	       g_unichar_isspace (gtk_text_iter_get_char (&iter)))
+		gtk_text_iter_forward_char (&iter);
+	gtk_source_vim_state_select (GTK_SOURCE_VIM_STATE (self), &iter, &iter);
+}
+
+typedef struct
+{
+	GtkTextMark **marks;
+	gboolean     *removed;
+	guint         n_marks;
+} GlobalLines;
+
+/* Flags the marks of the lines that @begin and @end remove, with their
+ * newline or the one before them. The marks stay sorted, so only the
+ * ones from @begin are checked.
+ */
+static void
+global_lines_delete_range_cb (GtkTextBuffer *buffer,
+                              GtkTextIter   *begin,
+                              GtkTextIter   *end,
+                              GlobalLines   *global)
+{
+	int begin_offset = gtk_text_iter_get_offset (begin);
+	int end_offset = gtk_text_iter_get_offset (end);
+	guint lo = 0;
+	guint hi = global->n_marks;
+
+	while (lo < hi)
+	{
+		guint mid = lo + (hi - lo) / 2;
+		GtkTextIter iter;
+
+		gtk_text_buffer_get_iter_at_mark (buffer, &iter, global->marks[mid]);
+
+		if (gtk_text_iter_get_offset (&iter) < begin_offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (guint i = lo; i < global->n_marks; i++)
+	{
+		GtkTextIter iter;
+		int offset;
+		int line_end;
+
+		gtk_text_buffer_get_iter_at_mark (buffer, &iter, global->marks[i]);
+		offset = gtk_text_iter_get_offset (&iter);
+
+		if (offset > end_offset)
+			break;
+
+		if (!gtk_text_iter_ends_line (&iter))
+			gtk_text_iter_forward_to_line_end (&iter);
+		line_end = gtk_text_iter_get_offset (&iter);
+
+		if ((begin_offset <= offset && line_end < end_offset) ||
+		    (begin_offset < offset && line_end <= end_offset))
+			global->removed[i] = TRUE;
+	}
+}
+
+/* Runs @command on each of @lines, starting at the beginning of the line.
+ * Marks keep track of the lines while the previous ones are modified, and
+ * like in Vim, the lines removed in the meantime are skipped.
+ */
+static void
+run_on_lines (GtkSourceVimCommand *self,
+              GArray              *lines,
+              const char          *command)
+{
+	GtkSourceBuffer *buffer;
+	GlobalLines global;
+	GtkTextIter iter;
+	gulong handler;
+	int last_offset = -1;
+
+	buffer = gtk_source_vim_state_get_buffer (GTK_SOURCE_VIM_STATE (self), NULL, NULL);
+
+	global.n_marks = lines->len;
+	global.marks = g_new (GtkTextMark *, lines->len);
+	global.removed = g_new0 (gboolean, lines->len);
+
+	for (guint i = 0; i < lines->len; i++)
+	{
+		gtk_text_buffer_get_iter_at_line (GTK_TEXT_BUFFER (buffer), &iter, g_array_index (lines, int, i));
+		global.marks[i] = gtk_text_buffer_create_mark (GTK_TEXT_BUFFER (buffer), NULL, &iter, TRUE);
+	}
+
+	handler = g_signal_connect (buffer,
+	                            "delete-range",
+	                            G_CALLBACK (global_lines_delete_range_cb),
+	                            &global);
+
+	for (guint i = 0; i < lines->len; i++)
+	{
+		GtkSourceVimState *new_state;
+		GtkSourceVimState *sub = NULL;
+		int offset;
+
+		if (global.removed[i])
+			continue;
+
+		gtk_text_buffer_get_iter_at_mark (GTK_TEXT_BUFFER (buffer), &iter, global.marks[i]);
+		offset = gtk_text_iter_get_offset (&iter);
+
+		/* The line was joined to a previous one, its mark collapsed
+		 * into the line or onto the mark of the previous line.
+		 */
+		if (!gtk_text_iter_starts_line (&iter) || offset == last_offset)
+			continue;
+
+		gtk_source_vim_state_select (GTK_SOURCE_VIM_STATE (self), &iter, &iter);
+
+		if (!(new_state = gtk_source_vim_command_new_parsed (GTK_SOURCE_VIM_STATE (self), command)))
+			break;
+
+		gtk_source_vim_state_reparent (new_state, self, &sub);
+		gtk_source_vim_state_repeat (sub);
+		gtk_source_vim_state_release (&sub);
+		g_object_unref (new_state);
+
+		gtk_text_buffer_get_iter_at_mark (GTK_TEXT_BUFFER (buffer), &iter, global.marks[i]);
+		last_offset = gtk_text_iter_get_offset (&iter);
+	}
+
+	g_signal_handler_disconnect (buffer, handler);
+
+	for (guint i = 0; i < lines->len; i++)
+		gtk_text_buffer_delete_mark (GTK_TEXT_BUFFER (buffer), global.marks[i]);
+
+	g_free (global.marks);
+	g_free (global.removed);
+}
+
+static void
+gtk_source_vim_command_global_full (GtkSourceVimCommand *self,
+                                    gboolean             invert)
+{
+	GtkSourceBuffer *buffer;
+	ImplRegex *regex;
+	GtkTextIter iter;
+	GArray *lines;
+	const char *command;
+	char *pattern = NULL;
+	int first_line;
+	int last_line;
+
+	g_assert (GTK_SOURCE_IS_VIM_COMMAND (self));
+
+	if (!parse_global (self->options, &pattern, &command) || pattern[0] == 0)
+		goto cleanup;
+
+	/* "^" and "$" also match at the "\r" line terminators */
+	if (!(regex = impl_regex_new (pattern, G_REGEX_MULTILINE | G_REGEX_NEWLINE_ANYCRLF, 0, NULL)))
+		goto cleanup;
+
+	buffer = gtk_source_vim_state_get_buffer (GTK_SOURCE_VIM_STATE (self), &iter, NULL);
+
+	/* Unlike :s, the default range is the whole buffer */
+	if (self->mark_begin && self->mark_end)
+	{
+		GtkTextIter end;
+
+		gtk_text_buffer_get_iter_at_mark (GTK_TEXT_BUFFER (buffer), &iter, self->mark_begin);
+		gtk_text_buffer_get_iter_at_mark (GTK_TEXT_BUFFER (buffer), &end, self->mark_end);
+		first_line = gtk_text_iter_get_line (&iter);
+		last_line = gtk_text_iter_get_line (&end);
+	}
+	else
+	{
+		first_line = 0;
+		last_line = gtk_text_buffer_get_line_count (GTK_TEXT_BUFFER (buffer)) - 1;
+
+		/* The empty line after a trailing newline is not a line for Vim */
+		gtk_text_buffer_get_iter_at_line (GTK_TEXT_BUFFER (buffer), &iter, last_line);
+		if (last_line > 0 && gtk_text_iter_is_end (&iter))
+			last_line--;
+	}
+
+	lines = find_matching_lines (GTK_TEXT_BUFFER (buffer), regex, first_line, last_line, invert);
+	impl_regex_unref (regex);
+
+	if (lines->len > 0)
+	{
+		gtk_source_vim_state_get_buffer (GTK_SOURCE_VIM_STATE (self), &iter, NULL);
+		gtk_source_vim_state_push_jump (GTK_SOURCE_VIM_STATE (self), &iter);
+
+		while (*command == ' ')
+			command++;
+
+		gtk_text_buffer_begin_user_action (GTK_TEXT_BUFFER (buffer));
+		_gtk_source_buffer_block_cursor_moved (buffer);
+
+		if (*command == 0)
+		{
+			/* There is nothing to print, so only move to the last line */
+			gtk_text_buffer_get_iter_at_line (GTK_TEXT_BUFFER (buffer), &iter,
+			                                  g_array_index (lines, int, lines->len - 1));
+			gtk_source_vim_state_select (GTK_SOURCE_VIM_STATE (self), &iter, &iter);
+		}
+		else if (g_str_equal (command, "d") || g_str_equal (command, "delete"))
+		{
+			if (gtk_source_vim_state_get_editable (GTK_SOURCE_VIM_STATE (self)))
+				delete_lines (self, lines);
+		}
+		else
+		{
+			run_on_lines (self, lines, command);
+		}
+
+		_gtk_source_buffer_unblock_cursor_moved (buffer);
+		gtk_text_buffer_end_user_action (GTK_TEXT_BUFFER (buffer));
+
+		self->ignore_mark = TRUE;
+	}
+
+	g_array_unref (lines);
+
+cleanup:
+	g_free (pattern);
+}
+
+static void
+gtk_source_vim_command_global (GtkSourceVimCommand *self)
+{
+	gtk_source_vim_command_global_full (self, FALSE);
+}
+
+static void
+gtk_source_vim_command_vglobal (GtkSourceVimCommand *self)
+{
+	gtk_source_vim_command_global_full (self, TRUE);
+}
+
 static void
 gtk_source_vim_command_set (GtkSourceVimCommand *self)
 {
@@ -1863,9 +2347,11 @@ gtk_source_vim_command_class_init (GtkSourceVimCommandClass *klass)
 	ADD_COMMAND ("line-number",    gtk_source_vim_command_line_number);
 	ADD_COMMAND ("filter",         gtk_source_vim_command_filter);
 	ADD_COMMAND ("format",         gtk_source_vim_command_format);
+	ADD_COMMAND ("global",         gtk_source_vim_command_global);
 	ADD_COMMAND ("search",         gtk_source_vim_command_search);
 	ADD_COMMAND ("search-replace", gtk_source_vim_command_search_replace);
 	ADD_COMMAND ("search-reverse", gtk_source_vim_command_search_reverse);
+	ADD_COMMAND ("vglobal",        gtk_source_vim_command_vglobal);
 	ADD_COMMAND ("jump-backward",  gtk_source_vim_command_jump_backward);
 	ADD_COMMAND ("jump-forward",   gtk_source_vim_command_jump_forward);
 #undef ADD_COMMAND
@@ -2116,6 +2602,25 @@ gtk_source_vim_command_new_parsed (GtkSourceVimState *current,
 		goto finish;
 	}
 
+	for (guint i = 0; i < G_N_ELEMENTS (global_commands); i++)
+	{
+		const char *rest;
+
+		if (!g_str_has_prefix (command_line, global_commands[i].name))
+			continue;
+
+		/* The pattern delimiter cannot be alphanumeric, \, " or | */
+		rest = command_line + strlen (global_commands[i].name);
+
+		if (*rest != 0 && !g_ascii_isalnum (*rest) && strchr ("\\\"| ", *rest) == NULL)
+		{
+			ret = GTK_SOURCE_VIM_COMMAND (gtk_source_vim_command_new (global_commands[i].command));
+			g_set_str (&ret->options, rest);
+
+			goto finish;
+		}
+	}
+
 	if (strchr (command_line, ' '))
 	{
 		char **split = g_strsplit (command_line, " ", 2);
@@ -56,6 +56,7 @@ struct _GtkSourceVimNormal
 	GtkSourceVimState *repeat;
 	GtkSourceVimState *last_visual;
 	KeyHandler         handler;
+	const char        *last_macro;
 	int                count;
 	ChangeModifier     change_modifier;
 	guint              has_count : 1;
@@ -1184,6 +1185,87 @@ key_handler_mark (GtkSourceVimNormal *self,
 	return TRUE;
 }
 
+static gboolean
+key_handler_record (GtkSourceVimNormal *self,
+                    guint               keyval,
+                    guint               keycode,
+                    GdkModifierType     mods,
+                    const char         *string)
+{
+	GtkSourceVimState *root;
+
+	g_assert (GTK_SOURCE_IS_VIM_NORMAL (self));
+
+	root = gtk_source_vim_state_get_root (GTK_SOURCE_VIM_STATE (self));
+
+	if (!GTK_SOURCE_IS_VIM (root) ||
+	    !(g_ascii_isalnum (string[0]) || string[0] == '"') ||
+	    string[1] != 0)
+	{
+		return gtk_source_vim_normal_bail (self);
+	}
+
+	gtk_source_vim_begin_recording (GTK_SOURCE_VIM (root), string);
+	gtk_source_vim_normal_clear (self);
+
+	return TRUE;
+}
+
+static gboolean
+key_handler_play (GtkSourceVimNormal *self,
+                  guint               keyval,
+                  guint               keycode,
+                  GdkModifierType     mods,
+                  const char         *string)
+{
+	GtkSourceVimState *registers;
+	GtkSourceVimState *root;
+	const char *name;
+	char *keys;
+	int count;
+
+	g_assert (GTK_SOURCE_IS_VIM_NORMAL (self));
+
+	root = gtk_source_vim_state_get_root (GTK_SOURCE_VIM_STATE (self));
+	registers = gtk_source_vim_state_get_registers (GTK_SOURCE_VIM_STATE (self));
+
+	if (!GTK_SOURCE_IS_VIM (root))
+		return gtk_source_vim_normal_bail (self);
+
+	if (g_str_equal (string, "@"))
+		name = self->last_macro;
+	else if ((g_ascii_isalnum (string[0]) || string[0] == '"') && string[1] == 0)
+		name = g_intern_string (string);
+	else
+		name = NULL;
+
+	if (name == NULL)
+		return gtk_source_vim_normal_bail (self);
+
+	/* The macro may change its own register */
+	keys = g_strdup (gtk_source_vim_registers_get (GTK_SOURCE_VIM_REGISTERS (registers), name));
+
+	if (keys == NULL || keys[0] == 0)
+	{
+		g_free (keys);
+		return gtk_source_vim_normal_bail (self);
+	}
+
+	count = MAX (1, self->count);
+
+	self->last_macro = name;
+	gtk_source_vim_normal_clear (self);
+
+	if (!gtk_source_vim_play_macro (GTK_SOURCE_VIM (root), keys, count))
+	{
+		gtk_source_vim_state_beep (GTK_SOURCE_VIM_STATE (self));
+	}
+
+	g_free (keys);
+
+	return TRUE;
+}
+
 static gboolean
 key_handler_initial (GtkSourceVimNormal *self,
                      guint               keyval,
@@ -1336,6 +1418,28 @@ key_handler_initial (GtkSourceVimNormal *self,
 				self->handler = key_handler_register;
 				return TRUE;
 
+			case GDK_KEY_q:
+			{
+				GtkSourceVimState *root = gtk_source_vim_state_get_root (GTK_SOURCE_VIM_STATE (self));
+
+				if (GTK_SOURCE_IS_VIM (root) &&
+				    gtk_source_vim_get_recording (GTK_SOURCE_VIM (root)))
+				{
+					gtk_source_vim_end_recording (GTK_SOURCE_VIM (root));
+					gtk_source_vim_normal_clear (self);
+				}
+				else
+				{
+					self->handler = key_handler_record;
+				}
+
+				return TRUE;
+			}
+
+			case GDK_KEY_at:
+				self->handler = key_handler_play;
+				return TRUE;
+
 			case GDK_KEY_y:
 				gtk_source_vim_normal_begin_command (self,
 				                                     NULL,
@@ -29,6 +29,7 @@
 #include "gtksourceutils-private.h"
 #include "gtksourceview.h"
 
+#include "gtksourcevim.h"
 #include "gtksourcevimjumplist.h"
 #include "gtksourcevimregisters.h"
 #include "gtksourcevimmarks.h"
@@ -467,6 +468,7 @@ gtk_source_vim_state_get_buffer (GtkSourceVimState *self,
 void
 gtk_source_vim_state_beep (GtkSourceVimState *self)
 {
+	GtkSourceVimState *root;
 	GtkSourceView *view;
 
 	g_return_if_fail (GTK_SOURCE_IS_VIM_STATE (self));
@@ -475,6 +477,14 @@ gtk_source_vim_state_beep (GtkSourceVimState *self)
 	{
 		gtk_widget_error_bell (GTK_WIDGET (view));
 	}
+
+	/* Like in Vim, an error stops the macro being played */
+	root = gtk_source_vim_state_get_root (self);
+
+	if (GTK_SOURCE_IS_VIM (root))
+	{
+		gtk_source_vim_abort_macro (GTK_SOURCE_VIM (root));
+	}
 }
 
 GtkSourceVimState *
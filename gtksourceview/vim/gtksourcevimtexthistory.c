@@ -100,9 +100,24 @@ gtk_source_vim_text_history_insert_text_cb (GtkSourceVimTextHistory *self,
 	op.offset = self->bytes->len;
 
 	g_string_append_len (self->bytes, text, len);
-	g_array_append_val (self->ops, op);
 
 	self->cursor_position = position + op.length;
+
+	/* Text typed a character at a time is replayed with a single
+	 * insertion. The bytes of the last insertion are at the end.
+	 */
+	if (self->ops->len > 0)
+	{
+		Op *last = &g_array_index (self->ops, Op, self->ops->len - 1);
+
+		if (last->kind == OP_INSERT)
+		{
+			last->length += op.length;
+			return;
+		}
+	}
+
+	g_array_append_val (self->ops, op);
 }
 
 static void
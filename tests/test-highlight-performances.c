@@ -0,0 +1,505 @@
+/*
+ * This file is part of GtkSourceView
+ *
+ * GtkSourceView is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GtkSourceView is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <gtksourceview/gtksource.h>
+#include "gtksourceview/gtksourcebuffer-private.h"
+#include "gtksourceview/gtksourcecontextengine-private.h"
+#include "gtksourceview/gtksourceregex-private.h"
+
+#ifdef G_OS_UNIX
+# include <sys/resource.h>
+#endif
+#ifdef __GLIBC__
+# include <malloc.h>
+#endif
+
+/* This measures the syntax highlighting of the samples of
+ * tests/syntax-highlighting/, without any display. Each sample is loaded,
+ * optionally replicated to a given size, and the whole buffer is
+ * highlighted with gtk_source_buffer_ensure_highlight(). The results are
+ * printed per language as a JSON object, which can be saved and given
+ * back with --compare to find the regressions of a change.
+ *
+ * The report is also a valid GVariant of type a{sa{sd}}, which is how
+ * the baseline is read.
+ *
+ * Usage: test-highlight-performances [OPTION…] [FILE…]
+ */
+
+#define DEFAULT_THRESHOLD 10.0
+
+typedef struct
+{
+	guint64 bytes;
+	gdouble seconds;
+	guint64 segments;
+	guint64 sub_patterns;
+	guint64 regex_matches;
+	guint64 tree_bytes;
+	gint64 heap_bytes;
+	guint64 peak_rss_kb;
+} Result;
+
+typedef struct
+{
+	const gchar *name;
+
+	/* Whether a greater value is better. */
+	gboolean higher_is_better;
+
+	/* Whether the value depends on the load of the machine, or on the
+	 * order of the samples, and is only reported.
+	 */
+	gboolean noisy;
+} Metric;
+
+static const Metric metrics[] = {
+	{ "mb_per_s", TRUE, FALSE },
+	{ "segments", FALSE, FALSE },
+	{ "sub_patterns", FALSE, FALSE },
+	{ "regex_matches", FALSE, FALSE },
+	{ "tree_bytes", FALSE, FALSE },
+	{ "heap_bytes", FALSE, TRUE },
+	{ "peak_rss_kb", FALSE, TRUE },
+};
+
+static gdouble size_mb;
+static gchar *output_filename;
+static gchar *baseline_filename;
+static gdouble threshold = DEFAULT_THRESHOLD;
+static gchar **language_ids;
+static gchar **filenames;
+
+static GOptionEntry entries[] = {
+	{ "size", 's', 0, G_OPTION_ARG_DOUBLE, &size_mb, "Replicate each sample to about MB megabytes", "MB" },
+	{ "output", 'o', 0, G_OPTION_ARG_FILENAME, &output_filename, "Write the report to FILE instead of the standard output", "FILE" },
+	{ "compare", 'c', 0, G_OPTION_ARG_FILENAME, &baseline_filename, "Compare with the report in FILE, and fail on regressions", "FILE" },
+	{ "threshold", 't', 0, G_OPTION_ARG_DOUBLE, &threshold, "Allowed difference with the baseline, in percent (default: 10)", "PERCENT" },
+	{ "language", 'l', 0, G_OPTION_ARG_STRING_ARRAY, &language_ids, "Only benchmark the samples of LANGUAGE", "LANGUAGE" },
+	{ G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &filenames, NULL, "[FILE…]" },
+	{ NULL }
+};
+
+/* Same as in the testsuite: use the language files of the source tree. */
+static void
+init_default_manager (void)
+{
+	gchar *dir;
+
+	dir = g_build_filename (TOP_SRCDIR, "data", "language-specs", NULL);
+
+	if (g_file_test (dir, G_FILE_TEST_IS_DIR))
+	{
+		GtkSourceLanguageManager *lm = gtk_source_language_manager_get_default ();
+		const gchar *lang_dirs[2] = {dir, NULL};
+
+		gtk_source_language_manager_set_search_path (lm, lang_dirs);
+	}
+
+	g_free (dir);
+}
+
+static gint
+compare_filenames (gconstpointer a,
+                   gconstpointer b)
+{
+	return g_strcmp0 (*(const gchar * const *) a, *(const gchar * const *) b);
+}
+
+static GPtrArray *
+get_sample_filenames (void)
+{
+	GPtrArray *samples;
+	gchar *dirname;
+	GDir *dir;
+	const gchar *name;
+	GError *error = NULL;
+
+	samples = g_ptr_array_new_with_free_func (g_free);
+
+	if (filenames != NULL)
+	{
+		guint i;
+
+		for (i = 0; filenames[i] != NULL; i++)
+			g_ptr_array_add (samples, g_strdup (filenames[i]));
+
+		return samples;
+	}
+
+	dirname = g_build_filename (TOP_SRCDIR, "tests", "syntax-highlighting", NULL);
+	dir = g_dir_open (dirname, 0, &error);
+
+	if (dir == NULL)
+	{
+		g_printerr ("%s\n", error->message);
+		exit (EXIT_FAILURE);
+	}
+
+	while ((name = g_dir_read_name (dir)) != NULL)
+		g_ptr_array_add (samples, g_build_filename (dirname, name, NULL));
+
+	g_ptr_array_sort (samples, compare_filenames);
+
+	g_dir_close (dir);
+	g_free (dirname);
+
+	return samples;
+}
+
+static gchar *
+replicate (const gchar *contents,
+           gsize        length)
+{
+	GString *text;
+	gsize size = size_mb * 1024 * 1024;
+
+	text = g_string_sized_new (MAX (size, length) + 1);
+
+	do
+	{
+		g_string_append_len (text, contents, length);
+
+		if (length > 0 && contents[length - 1] != '\n')
+			g_string_append_c (text, '\n');
+	}
+	while (length > 0 && text->len < size);
+
+	return g_string_free (text, FALSE);
+}
+
+static gint64
+get_heap_size (void)
+{
+#ifdef __GLIBC__
+# if __GLIBC_PREREQ (2, 33)
+	return mallinfo2 ().uordblks;
+# endif
+#endif
+	return 0;
+}
+
+static guint64
+get_peak_rss_kb (void)
+{
+#ifdef G_OS_UNIX
+	struct rusage usage;
+
+	if (getrusage (RUSAGE_SELF, &usage) == 0)
+		return usage.ru_maxrss;
+#endif
+	return 0;
+}
+
+static void
+benchmark_sample (GtkSourceLanguage *language,
+                  const gchar       *text,
+                  Result            *result)
+{
+	GtkSourceBuffer *buffer;
+	GtkSourceEngine *engine;
+	GtkSourceContextEngineStats stats = { 0 };
+	GtkTextIter start, end;
+	GTimer *timer;
+	guint64 regex_matches;
+	gint64 heap_size;
+
+	buffer = gtk_source_buffer_new_with_language (language);
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), text, -1);
+	gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (buffer), &start, &end);
+
+	regex_matches = _gtk_source_regex_get_n_matches ();
+	heap_size = get_heap_size ();
+	timer = g_timer_new ();
+
+	gtk_source_buffer_ensure_highlight (buffer, &start, &end);
+
+	g_timer_stop (timer);
+
+	engine = _gtk_source_buffer_get_highlight_engine (buffer);
+	if (GTK_SOURCE_IS_CONTEXT_ENGINE (engine))
+		_gtk_source_context_engine_get_stats (GTK_SOURCE_CONTEXT_ENGINE (engine), &stats);
+
+	result->bytes += strlen (text);
+	result->seconds += g_timer_elapsed (timer, NULL);
+	result->segments += stats.n_segments_allocated;
+	result->sub_patterns += stats.n_sub_patterns_allocated;
+	result->regex_matches += _gtk_source_regex_get_n_matches () - regex_matches;
+	result->tree_bytes += stats.tree_size;
+	result->heap_bytes += get_heap_size () - heap_size;
+	result->peak_rss_kb = get_peak_rss_kb ();
+
+	g_timer_destroy (timer);
+	g_object_unref (buffer);
+}
+
+static gdouble
+get_metric (const Result *result,
+            const gchar  *name)
+{
+	if (g_str_equal (name, "mb_per_s"))
+		return result->seconds > 0 ? result->bytes / (1024.0 * 1024.0) / result->seconds : 0;
+	if (g_str_equal (name, "segments"))
+		return result->segments;
+	if (g_str_equal (name, "sub_patterns"))
+		return result->sub_patterns;
+	if (g_str_equal (name, "regex_matches"))
+		return result->regex_matches;
+	if (g_str_equal (name, "tree_bytes"))
+		return result->tree_bytes;
+	if (g_str_equal (name, "heap_bytes"))
+		return result->heap_bytes;
+	if (g_str_equal (name, "peak_rss_kb"))
+		return result->peak_rss_kb;
+
+	g_return_val_if_reached (0);
+}
+
+static gchar *
+build_report (GHashTable *results)
+{
+	GString *report;
+	GList *ids, *l;
+
+	report = g_string_new ("{\n");
+	ids = g_list_sort (g_hash_table_get_keys (results), (GCompareFunc) g_strcmp0);
+
+	for (l = ids; l != NULL; l = l->next)
+	{
+		const Result *result = g_hash_table_lookup (results, l->data);
+
+		g_string_append_printf (report,
+		                        "  \"%s\": {\n"
+		                        "    \"bytes\": %" G_GUINT64_FORMAT ",\n"
+		                        "    \"seconds\": %.6f,\n"
+		                        "    \"mb_per_s\": %.3f,\n"
+		                        "    \"segments\": %" G_GUINT64_FORMAT ",\n"
+		                        "    \"sub_patterns\": %" G_GUINT64_FORMAT ",\n"
+		                        "    \"regex_matches\": %" G_GUINT64_FORMAT ",\n"
+		                        "    \"tree_bytes\": %" G_GUINT64_FORMAT ",\n"
+		                        "    \"heap_bytes\": %" G_GINT64_FORMAT ",\n"
+		                        "    \"peak_rss_kb\": %" G_GUINT64_FORMAT "\n"
+		                        "  }%s\n",
+		                        (const gchar *) l->data,
+		                        result->bytes,
+		                        result->seconds,
+		                        get_metric (result, "mb_per_s"),
+		                        result->segments,
+		                        result->sub_patterns,
+		                        result->regex_matches,
+		                        result->tree_bytes,
+		                        result->heap_bytes,
+		                        result->peak_rss_kb,
+		                        l->next != NULL ? "," : "");
+	}
+
+	g_string_append (report, "}\n");
+	g_list_free (ids);
+
+	return g_string_free (report, FALSE);
+}
+
+/* Returns the number of regressions. */
+static guint
+compare_with_baseline (GHashTable  *results,
+                       const gchar *filename)
+{
+	GVariant *baseline;
+	GVariantIter iter;
+	GVariant *values;
+	const gchar *id;
+	gchar *contents;
+	guint n_regressions = 0;
+	GError *error = NULL;
+
+	if (!g_file_get_contents (filename, &contents, NULL, &error))
+	{
+		g_printerr ("%s\n", error->message);
+		exit (EXIT_FAILURE);
+	}
+
+	baseline = g_variant_parse (G_VARIANT_TYPE ("a{sa{sd}}"), contents, NULL, NULL, &error);
+	g_free (contents);
+
+	if (baseline == NULL)
+	{
+		g_printerr ("Invalid baseline %s: %s\n", filename, error->message);
+		exit (EXIT_FAILURE);
+	}
+
+	g_variant_iter_init (&iter, baseline);
+	while (g_variant_iter_next (&iter, "{&s@a{sd}}", &id, &values))
+	{
+		const Result *result = g_hash_table_lookup (results, id);
+		GVariantDict dict;
+		guint i;
+
+		if (result == NULL)
+		{
+			g_variant_unref (values);
+			continue;
+		}
+
+		g_variant_dict_init (&dict, values);
+
+		for (i = 0; i < G_N_ELEMENTS (metrics); i++)
+		{
+			gdouble old_value, new_value, change;
+			gboolean regression;
+
+			if (!g_variant_dict_lookup (&dict, metrics[i].name, "d", &old_value) ||
+			    old_value == 0)
+				continue;
+
+			new_value = get_metric (result, metrics[i].name);
+			change = (new_value - old_value) * 100 / old_value;
+
+			regression = !metrics[i].noisy &&
+			             (metrics[i].higher_is_better ? change < -threshold : change > threshold);
+
+			if (regression)
+				n_regressions++;
+
+			if (regression || ABS (change) > threshold)
+			{
+				g_printerr ("%s: %s %.3f -> %.3f (%+.1f%%)%s\n",
+				            id, metrics[i].name,
+				            old_value, new_value, change,
+				            regression ? " REGRESSION" : "");
+			}
+		}
+
+		g_variant_dict_clear (&dict);
+		g_variant_unref (values);
+	}
+
+	g_variant_unref (baseline);
+
+	return n_regressions;
+}
+
+int
+main (int argc, char *argv[])
+{
+	GOptionContext *context;
+	GtkSourceLanguageManager *lm;
+	GHashTable *results;
+	GPtrArray *samples;
+	gchar *report;
+	guint i;
+	int status = EXIT_SUCCESS;
+	GError *error = NULL;
+
+	context = g_option_context_new (NULL);
+	g_option_context_add_main_entries (context, entries, NULL);
+
+	if (!g_option_context_parse (context, &argc, &argv, &error))
+	{
+		g_printerr ("%s\n", error->message);
+		return EXIT_FAILURE;
+	}
+
+	gtk_source_init ();
+	init_default_manager ();
+
+	lm = gtk_source_language_manager_get_default ();
+	results = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	samples = get_sample_filenames ();
+
+	for (i = 0; i < samples->len; i++)
+	{
+		const gchar *filename = g_ptr_array_index (samples, i);
+		GtkSourceLanguage *language;
+		Result *result;
+		const gchar *id;
+		gchar *basename;
+		gchar *contents;
+		gchar *text;
+		gsize length;
+
+		basename = g_path_get_basename (filename);
+		language = gtk_source_language_manager_guess_language (lm, basename, NULL);
+		g_free (basename);
+
+		if (language == NULL)
+			continue;
+
+		id = gtk_source_language_get_id (language);
+
+		if (language_ids != NULL && !g_strv_contains ((const gchar * const *) language_ids, id))
+			continue;
+
+		if (!g_file_get_contents (filename, &contents, &length, &error))
+		{
+			g_printerr ("%s\n", error->message);
+			g_clear_error (&error);
+			continue;
+		}
+
+		result = g_hash_table_lookup (results, id);
+		if (result == NULL)
+		{
+			result = g_new0 (Result, 1);
+			g_hash_table_insert (results, g_strdup (id), result);
+		}
+
+		text = replicate (contents, length);
+		benchmark_sample (language, text, result);
+
+		g_free (text);
+		g_free (contents);
+	}
+
+	report = build_report (results);
+
+	if (output_filename != NULL)
+	{
+		if (!g_file_set_contents (output_filename, report, -1, &error))
+		{
+			g_printerr ("%s\n", error->message);
+			g_clear_error (&error);
+			status = EXIT_FAILURE;
+		}
+	}
+	else
+	{
+		g_print ("%s", report);
+	}
+
+	if (baseline_filename != NULL)
+	{
+		guint n_regressions = compare_with_baseline (results, baseline_filename);
+
+		if (n_regressions > 0)
+		{
+			g_printerr ("%u regressions compared to %s\n", n_regressions, baseline_filename);
+			status = EXIT_FAILURE;
+		}
+	}
+
+	g_free (report);
+	g_ptr_array_unref (samples);
+	g_hash_table_unref (results);
+	g_option_context_free (context);
+
+	gtk_source_finalize ();
+
+	return status;
+}
@@ -0,0 +1,210 @@
+/*
+ * This file is part of GtkSourceView
+ *
+ * GtkSourceView is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GtkSourceView is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+
+#include <cairo-pdf.h>
+#include <glib/gstdio.h>
+#include <gtk/gtk.h>
+#include <gtksourceview/gtksource.h>
+
+/* This measures the time needed to export a highlighted C buffer to PDF,
+ * with and without wrapping. The pagination and the drawing of the pages are
+ * measured separately. The pages are then rendered again with the worker
+ * threads of gtk_source_print_compositor_render_pages_async().
+ *
+ * Usage: test-print-performances [N_LINES]
+ */
+
+#define DEFAULT_NB_LINES 100000
+
+typedef struct
+{
+	GtkSourcePrintCompositor *compositor;
+	GTimer *timer;
+	GMainLoop *main_loop;
+	gdouble pagination_time;
+} PrintData;
+
+static void
+begin_print_cb (GtkPrintOperation *operation,
+                GtkPrintContext   *context,
+                PrintData         *data)
+{
+	g_timer_start (data->timer);
+
+	while (!gtk_source_print_compositor_paginate (data->compositor, context));
+
+	data->pagination_time = g_timer_elapsed (data->timer, NULL);
+
+	gtk_print_operation_set_n_pages (operation,
+	                                 gtk_source_print_compositor_get_n_pages (data->compositor));
+
+	g_timer_start (data->timer);
+}
+
+static void
+draw_page_cb (GtkPrintOperation *operation,
+              GtkPrintContext   *context,
+              gint               page_nr,
+              PrintData         *data)
+{
+	gtk_source_print_compositor_draw_page (data->compositor, context, page_nr);
+}
+
+static void
+render_pages_cb (GtkSourcePrintCompositor *compositor,
+                 GAsyncResult             *result,
+                 PrintData                *data)
+{
+	GError *error = NULL;
+
+	if (!gtk_source_print_compositor_render_pages_finish (compositor, result, &error))
+	{
+		g_printerr ("Rendering failed: %s\n", error->message);
+		g_clear_error (&error);
+	}
+	else
+	{
+		g_print ("parallel drawing: %lf seconds.\n",
+		         g_timer_elapsed (data->timer, NULL));
+	}
+
+	g_main_loop_quit (data->main_loop);
+}
+
+static void
+render_pages_to_pdf (PrintData   *data,
+                     const gchar *filename)
+{
+	GtkPageSetup *page_setup;
+	cairo_surface_t *surface;
+
+	page_setup = gtk_page_setup_new ();
+	surface = cairo_pdf_surface_create (filename,
+	                                    gtk_page_setup_get_paper_width (page_setup, GTK_UNIT_POINTS),
+	                                    gtk_page_setup_get_paper_height (page_setup, GTK_UNIT_POINTS));
+
+	data->main_loop = g_main_loop_new (NULL, FALSE);
+	g_timer_start (data->timer);
+
+	gtk_source_print_compositor_render_pages_async (data->compositor,
+	                                                surface,
+	                                                0, -1,
+	                                                NULL,
+	                                                (GAsyncReadyCallback) render_pages_cb,
+	                                                data);
+
+	g_main_loop_run (data->main_loop);
+	g_main_loop_unref (data->main_loop);
+
+	cairo_surface_finish (surface);
+	cairo_surface_destroy (surface);
+	g_object_unref (page_setup);
+}
+
+static void
+export_to_pdf (GtkSourceBuffer *buffer,
+               GtkWrapMode      wrap_mode,
+               const gchar     *filename)
+{
+	GtkPrintOperation *operation;
+	GtkPrintOperationResult result;
+	PrintData data = { 0 };
+	GError *error = NULL;
+
+	data.compositor = gtk_source_print_compositor_new (buffer);
+	data.timer = g_timer_new ();
+
+	gtk_source_print_compositor_set_wrap_mode (data.compositor, wrap_mode);
+	gtk_source_print_compositor_set_print_line_numbers (data.compositor, 1);
+
+	operation = gtk_print_operation_new ();
+	gtk_print_operation_set_export_filename (operation, filename);
+
+	g_signal_connect (operation, "begin-print", G_CALLBACK (begin_print_cb), &data);
+	g_signal_connect (operation, "draw-page", G_CALLBACK (draw_page_cb), &data);
+
+	result = gtk_print_operation_run (operation,
+	                                  GTK_PRINT_OPERATION_ACTION_EXPORT,
+	                                  NULL,
+	                                  &error);
+
+	if (result == GTK_PRINT_OPERATION_RESULT_ERROR)
+	{
+		g_printerr ("Export failed: %s\n", error->message);
+		g_clear_error (&error);
+	}
+	else
+	{
+		g_print ("%s: %d pages, pagination: %lf seconds, drawing: %lf seconds.\n",
+		         wrap_mode == GTK_WRAP_NONE ? "no wrapping" : "word wrapping",
+		         gtk_source_print_compositor_get_n_pages (data.compositor),
+		         data.pagination_time,
+		         g_timer_elapsed (data.timer, NULL));
+
+		render_pages_to_pdf (&data, filename);
+	}
+
+	g_timer_destroy (data.timer);
+	g_object_unref (operation);
+	g_object_unref (data.compositor);
+}
+
+int
+main (int argc, char *argv[])
+{
+	GtkSourceLanguageManager *manager;
+	GtkSourceBuffer *buffer;
+	GtkTextIter iter;
+	gchar *filename;
+	gint nb_lines = DEFAULT_NB_LINES;
+	gint i;
+
+	gtk_init ();
+
+	if (argc > 1)
+	{
+		nb_lines = MAX (1, atoi (argv[1]));
+	}
+
+	manager = gtk_source_language_manager_get_default ();
+	buffer = gtk_source_buffer_new (NULL);
+	gtk_source_buffer_set_language (buffer,
+	                                gtk_source_language_manager_get_language (manager, "c"));
+
+	gtk_text_buffer_get_start_iter (GTK_TEXT_BUFFER (buffer), &iter);
+
+	for (i = 0; i < nb_lines; i++)
+	{
+		gtk_text_buffer_insert (GTK_TEXT_BUFFER (buffer),
+		                        &iter,
+		                        "\tif (foo != NULL) /* comment */ return bar (\"string\", 42);\n",
+		                        -1);
+	}
+
+	filename = g_build_filename (g_get_tmp_dir (), "gtksourceview-print-performances.pdf", NULL);
+
+	export_to_pdf (buffer, GTK_WRAP_NONE, filename);
+	export_to_pdf (buffer, GTK_WRAP_WORD, filename);
+
+	g_remove (filename);
+	g_free (filename);
+	g_object_unref (buffer);
+
+	return 0;
+}
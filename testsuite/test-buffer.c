@@ -20,8 +20,11 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <gtksourceview/gtksource.h>
 #include "gtksourceview/gtksourcebuffer-private.h"
+#include "gtksourceview/gtksourcebufferinternal-private.h"
+#include "gtksourceview/gtksourcecontextengine-private.h"
 
 static const char *c_snippet =
 	"#include <foo.h>\n"
@@ -131,6 +134,377 @@ test_get_context_classes (void)
 	g_object_unref (buffer);
 }
 
+static void
+test_context_class_tag (void)
+{
+	GtkSourceLanguageManager *lm;
+	GtkSourceBuffer *buffer;
+	GtkSourceLanguage *lang;
+	GtkTextTagTable *tag_table;
+	GtkTextIter start, end, i;
+	GtkTextTag *tag;
+
+	lm = gtk_source_language_manager_get_default ();
+	lang = gtk_source_language_manager_get_language (lm, "c");
+	buffer = gtk_source_buffer_new_with_language (lang);
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), c_snippet, -1);
+	gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (buffer), &start, &end);
+	gtk_source_buffer_ensure_highlight (buffer, &start, &end);
+
+	/* The context classes don't need tags, they are only created once
+	 * requested.
+	 */
+	tag_table = gtk_text_buffer_get_tag_table (GTK_TEXT_BUFFER (buffer));
+	g_assert_null (gtk_text_tag_table_lookup (tag_table, "gtksourceview:context-classes:comment"));
+	gtk_text_buffer_get_iter_at_line_offset (GTK_TEXT_BUFFER (buffer), &i, 2, 5);
+	g_assert_true (gtk_source_buffer_iter_has_context_class (buffer, &i, "comment"));
+
+	gtk_text_buffer_get_start_iter (GTK_TEXT_BUFFER (buffer), &i);
+	g_assert_true (gtk_source_buffer_iter_forward_to_context_class_toggle (buffer, &i, "comment"));
+	g_assert_cmpint (gtk_text_iter_get_line (&i), ==, 2);
+	g_assert_cmpint (gtk_text_iter_get_line_offset (&i), ==, 0);
+	g_assert_true (gtk_source_buffer_iter_forward_to_context_class_toggle (buffer, &i, "comment"));
+	g_assert_cmpint (gtk_text_iter_get_line (&i), ==, 2);
+	g_assert_true (gtk_text_iter_ends_line (&i));
+
+	/* Without toggle, the iter is left where it is. */
+	g_assert_false (gtk_source_buffer_iter_forward_to_context_class_toggle (buffer, &i, "comment"));
+	g_assert_cmpint (gtk_text_iter_get_line (&i), ==, 2);
+	g_assert_true (gtk_text_iter_ends_line (&i));
+
+	gtk_text_buffer_get_end_iter (GTK_TEXT_BUFFER (buffer), &i);
+
+	g_assert_true (gtk_source_buffer_iter_backward_to_context_class_toggle (buffer, &i, "comment"));
+	g_assert_true (gtk_text_iter_ends_line (&i));
+	g_assert_true (gtk_source_buffer_iter_backward_to_context_class_toggle (buffer, &i, "comment"));
+	g_assert_cmpint (gtk_text_iter_get_line_offset (&i), ==, 0);
+	g_assert_false (gtk_source_buffer_iter_backward_to_context_class_toggle (buffer, &i, "comment"));
+	g_assert_cmpint (gtk_text_iter_get_line (&i), ==, 2);
+	g_assert_cmpint (gtk_text_iter_get_line_offset (&i), ==, 0);
+
+	gtk_text_buffer_get_start_iter (GTK_TEXT_BUFFER (buffer), &i);
+	g_assert_false (gtk_source_buffer_iter_forward_to_context_class_toggle (buffer, &i, "unknown"));
+	g_assert_true (gtk_text_iter_is_start (&i));
+
+	/* Once requested, the tag follows the class. */
+	tag = gtk_source_buffer_ensure_context_class_tag (buffer, "comment");
+	g_assert_true (GTK_IS_TEXT_TAG (tag));
+	g_assert_true (tag == gtk_text_tag_table_lookup (tag_table, "gtksourceview:context-classes:comment"));
+	g_assert_true (tag == gtk_source_buffer_ensure_context_class_tag (buffer, "comment"));
+
+	gtk_text_buffer_get_iter_at_line_offset (GTK_TEXT_BUFFER (buffer), &i, 2, 5);
+	g_assert_true (gtk_text_iter_has_tag (&i, tag));
+	gtk_text_buffer_get_iter_at_line_offset (GTK_TEXT_BUFFER (buffer), &i, 3, 0);
+	g_assert_false (gtk_text_iter_has_tag (&i, tag));
+
+	gtk_text_buffer_insert (GTK_TEXT_BUFFER (buffer), &i, "/* new */", -1);
+	gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (buffer), &start, &end);
+	gtk_source_buffer_ensure_highlight (buffer, &start, &end);
+	gtk_text_buffer_get_iter_at_line_offset (GTK_TEXT_BUFFER (buffer), &i, 3, 3);
+	g_assert_true (gtk_text_iter_has_tag (&i, tag));
+	g_assert_true (gtk_source_buffer_iter_has_context_class (buffer, &i, "comment"));
+
+	/* The tag stays, but is emptied with the language. */
+	gtk_source_buffer_set_language (buffer, NULL);
+	gtk_text_buffer_get_iter_at_line_offset (GTK_TEXT_BUFFER (buffer), &i, 3, 3);
+	g_assert_false (gtk_text_iter_has_tag (&i, tag));
+	g_assert_false (gtk_source_buffer_iter_has_context_class (buffer, &i, "comment"));
+	g_assert_true (tag == gtk_text_tag_table_lookup (tag_table, "gtksourceview:context-classes:comment"));
+
+	g_object_unref (buffer);
+}
+
+static void
+highlight_degraded_cb (GtkSourceBuffer *buffer,
+                       GtkTextIter     *start,
+                       GtkTextIter     *end,
+                       gint            *n_degraded)
+{
+	g_assert_cmpint (gtk_text_iter_get_line (start), ==, 0);
+	g_assert_true (gtk_text_iter_starts_line (start));
+	g_assert_true (gtk_text_iter_ends_line (end));
+	(*n_degraded)++;
+}
+
+static void
+test_max_highlight_line_length (void)
+{
+	GtkSourceLanguageManager *lm;
+	GtkSourceBuffer *buffer;
+	GtkSourceLanguage *lang;
+	GtkTextIter start, end, i;
+	GString *text;
+	gint n_degraded = 0;
+
+	text = g_string_new ("int x; /* ");
+	while (text->len < 200)
+		g_string_append (text, "word ");
+	g_string_append (text, "*/ int y;\nint z;\n");
+
+	lm = gtk_source_language_manager_get_default ();
+	lang = gtk_source_language_manager_get_language (lm, "c");
+	buffer = gtk_source_buffer_new_with_language (lang);
+	g_signal_connect (buffer, "highlight-degraded", G_CALLBACK (highlight_degraded_cb), &n_degraded);
+
+	g_assert_cmpuint (gtk_source_buffer_get_max_highlight_line_length (buffer), ==, 0);
+	gtk_source_buffer_set_max_highlight_line_length (buffer, 32);
+	g_assert_cmpuint (gtk_source_buffer_get_max_highlight_line_length (buffer), ==, 32);
+
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), text->str, -1);
+	gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (buffer), &start, &end);
+	gtk_source_buffer_ensure_highlight (buffer, &start, &end);
+
+	/* Reported from the scheduler, not during the analysis. */
+	g_assert_cmpint (n_degraded, ==, 0);
+	flush_queue ();
+	g_assert_cmpint (n_degraded, ==, 1);
+
+	/* The line analyzed again is not reported again. */
+	gtk_text_buffer_get_iter_at_line_offset (GTK_TEXT_BUFFER (buffer), &i, 0, 100);
+	gtk_text_buffer_insert (GTK_TEXT_BUFFER (buffer), &i, "word ", -1);
+	gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (buffer), &start, &end);
+	gtk_source_buffer_ensure_highlight (buffer, &start, &end);
+	flush_queue ();
+	g_assert_cmpint (n_degraded, ==, 1);
+	gtk_text_buffer_get_iter_at_line_offset (GTK_TEXT_BUFFER (buffer), &i, 0, 100);
+	gtk_text_buffer_get_iter_at_line_offset (GTK_TEXT_BUFFER (buffer), &end, 0, 105);
+	gtk_text_buffer_delete (GTK_TEXT_BUFFER (buffer), &i, &end);
+
+	/* The rest of the line stays in the comment, which ends with it. */
+	gtk_text_buffer_get_iter_at_line_offset (GTK_TEXT_BUFFER (buffer), &i, 0, 12);
+	g_assert_true (gtk_source_buffer_iter_has_context_class (buffer, &i, "comment"));
+	gtk_text_buffer_get_iter_at_line_offset (GTK_TEXT_BUFFER (buffer), &i, 0, text->len - 12);
+	g_assert_true (gtk_source_buffer_iter_has_context_class (buffer, &i, "comment"));
+	gtk_text_buffer_get_iter_at_line_offset (GTK_TEXT_BUFFER (buffer), &i, 1, 0);
+	g_assert_false (gtk_source_buffer_iter_has_context_class (buffer, &i, "comment"));
+
+	/* Without limit, the whole line is analyzed again. */
+	gtk_source_buffer_set_max_highlight_line_length (buffer, 0);
+	gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (buffer), &start, &end);
+	gtk_source_buffer_ensure_highlight (buffer, &start, &end);
+	flush_queue ();
+	g_assert_cmpint (n_degraded, ==, 1);
+
+	gtk_text_buffer_get_iter_at_line_offset (GTK_TEXT_BUFFER (buffer), &i, 0, text->len - 12);
+	g_assert_false (gtk_source_buffer_iter_has_context_class (buffer, &i, "comment"));
+
+	g_string_free (text, TRUE);
+	g_object_unref (buffer);
+}
+
+static void
+test_max_highlight_line_time (void)
+{
+	GtkSourceBuffer *buffer;
+	guint max_time;
+
+	buffer = gtk_source_buffer_new (NULL);
+
+	g_assert_cmpuint (gtk_source_buffer_get_max_highlight_line_time (buffer), ==, 250);
+	gtk_source_buffer_set_max_highlight_line_time (buffer, 0);
+	g_assert_cmpuint (gtk_source_buffer_get_max_highlight_line_time (buffer), ==, 0);
+
+	g_object_set (buffer, "max-highlight-line-time", 100, NULL);
+	g_object_get (buffer, "max-highlight-line-time", &max_time, NULL);
+	g_assert_cmpuint (max_time, ==, 100);
+
+	g_object_unref (buffer);
+}
+
+static gboolean
+has_class_at (GtkSourceBuffer *buffer,
+              gint             line,
+              gint             line_offset,
+              const gchar     *context_class)
+{
+	GtkTextIter iter;
+
+	gtk_text_buffer_get_iter_at_line_offset (GTK_TEXT_BUFFER (buffer), &iter, line, line_offset);
+
+	return gtk_source_buffer_iter_has_context_class (buffer, &iter, context_class);
+}
+
+static void
+test_context_classes_edits (void)
+{
+	static const gchar *names[] = { "comment", "no-spell-check", "string" };
+	GtkSourceLanguageManager *lm;
+	GtkSourceLanguage *lang;
+	GtkSourceBuffer *buffer;
+	GtkSourceBuffer *reference;
+	GtkTextIter start, end;
+	gchar *text;
+	gint offset;
+	guint n;
+
+	lm = gtk_source_language_manager_get_default ();
+	lang = gtk_source_language_manager_get_language (lm, "c");
+	buffer = gtk_source_buffer_new_with_language (lang);
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), c_snippet, -1);
+	gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (buffer), &start, &end);
+	gtk_source_buffer_ensure_highlight (buffer, &start, &end);
+
+	/* The classes move with the text until they are updated. */
+	gtk_text_buffer_get_start_iter (GTK_TEXT_BUFFER (buffer), &start);
+	gtk_text_buffer_insert (GTK_TEXT_BUFFER (buffer), &start, "int x;\n", -1);
+	g_assert_false (has_class_at (buffer, 2, 0, "comment"));
+	g_assert_true (has_class_at (buffer, 3, 0, "comment"));
+	g_assert_true (has_class_at (buffer, 3, 22, "comment"));
+	g_assert_false (has_class_at (buffer, 3, 23, "comment"));
+
+	/* A class containing the inserted text grows. */
+	gtk_text_buffer_get_iter_at_line_offset (GTK_TEXT_BUFFER (buffer), &start, 3, 3);
+	gtk_text_buffer_insert (GTK_TEXT_BUFFER (buffer), &start, "abc", -1);
+	g_assert_true (has_class_at (buffer, 3, 25, "comment"));
+	g_assert_false (has_class_at (buffer, 3, 26, "comment"));
+
+	gtk_text_buffer_get_iter_at_line (GTK_TEXT_BUFFER (buffer), &start, 0);
+	gtk_text_buffer_get_iter_at_line (GTK_TEXT_BUFFER (buffer), &end, 1);
+	gtk_text_buffer_delete (GTK_TEXT_BUFFER (buffer), &start, &end);
+	g_assert_false (has_class_at (buffer, 1, 0, "comment"));
+	g_assert_true (has_class_at (buffer, 2, 0, "comment"));
+	g_assert_true (has_class_at (buffer, 2, 25, "comment"));
+	g_assert_false (has_class_at (buffer, 2, 26, "comment"));
+
+	/* Cut the end of the comment, and the classes are the ones of the
+	 * same text highlighted from scratch.
+	 */
+	gtk_text_buffer_get_iter_at_line_offset (GTK_TEXT_BUFFER (buffer), &start, 2, 20);
+	gtk_text_buffer_get_iter_at_line_offset (GTK_TEXT_BUFFER (buffer), &end, 3, 4);
+	gtk_text_buffer_delete (GTK_TEXT_BUFFER (buffer), &start, &end);
+	gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (buffer), &start, &end);
+	gtk_source_buffer_ensure_highlight (buffer, &start, &end);
+
+	text = gtk_text_buffer_get_text (GTK_TEXT_BUFFER (buffer), &start, &end, TRUE);
+	reference = gtk_source_buffer_new_with_language (lang);
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (reference), text, -1);
+	gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (reference), &start, &end);
+	gtk_source_buffer_ensure_highlight (reference, &start, &end);
+
+	for (offset = 0; offset < gtk_text_buffer_get_char_count (GTK_TEXT_BUFFER (buffer)); offset++)
+	{
+		GtkTextIter iter, reference_iter;
+
+		gtk_text_buffer_get_iter_at_offset (GTK_TEXT_BUFFER (buffer), &iter, offset);
+		gtk_text_buffer_get_iter_at_offset (GTK_TEXT_BUFFER (reference), &reference_iter, offset);
+
+		for (n = 0; n < G_N_ELEMENTS (names); n++)
+		{
+			g_assert_cmpint (gtk_source_buffer_iter_has_context_class (buffer, &iter, names[n]), ==,
+			                 gtk_source_buffer_iter_has_context_class (reference, &reference_iter, names[n]));
+		}
+	}
+
+	g_free (text);
+	g_object_unref (reference);
+	g_object_unref (buffer);
+}
+
+static void
+get_tree_stats (GtkSourceBuffer             *buffer,
+                GtkSourceContextEngineStats *stats)
+{
+	GtkSourceEngine *engine;
+	GtkTextIter start, end;
+
+	gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (buffer), &start, &end);
+	gtk_source_buffer_ensure_highlight (buffer, &start, &end);
+
+	engine = _gtk_source_buffer_get_highlight_engine (buffer);
+	g_assert_true (GTK_SOURCE_IS_CONTEXT_ENGINE (engine));
+	_gtk_source_context_engine_get_stats (GTK_SOURCE_CONTEXT_ENGINE (engine), stats);
+}
+
+static void
+test_segment_tree_release (void)
+{
+	static const gchar *line = "/* a */ x = \"b\";\n";
+	GtkSourceContextEngineStats full;
+	GtkSourceContextEngineStats stats;
+	GtkSourceLanguageManager *lm;
+	GtkSourceLanguage *lang;
+	GtkSourceBuffer *buffer;
+	GtkTextIter start, end;
+	GString *text;
+	guint i;
+
+	text = g_string_new (NULL);
+	for (i = 0; i < 5000; i++)
+		g_string_append (text, line);
+
+	lm = gtk_source_language_manager_get_default ();
+	lang = gtk_source_language_manager_get_language (lm, "c");
+	buffer = gtk_source_buffer_new_with_language (lang);
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), text->str, -1);
+	get_tree_stats (buffer, &full);
+	g_assert_cmpuint (full.n_segments, >, 5000);
+
+	/* The memory of the erased segments is released. */
+	gtk_text_buffer_get_iter_at_line (GTK_TEXT_BUFFER (buffer), &start, 1);
+	gtk_text_buffer_get_end_iter (GTK_TEXT_BUFFER (buffer), &end);
+	gtk_text_buffer_delete (GTK_TEXT_BUFFER (buffer), &start, &end);
+	get_tree_stats (buffer, &stats);
+	g_assert_cmpuint (stats.n_segments, <, 10);
+	g_assert_cmpuint (stats.tree_size, <, full.tree_size / 4);
+
+	/* The tree grows again in the memory kept or reused. */
+	gtk_text_buffer_insert (GTK_TEXT_BUFFER (buffer), &end, text->str + strlen (line), -1);
+	get_tree_stats (buffer, &stats);
+	g_assert_cmpuint (stats.n_segments, >, 5000);
+
+	for (i = 0; i < 5000; i += 1234)
+	{
+		g_assert_true (has_class_at (buffer, i, 3, "comment"));
+		g_assert_false (has_class_at (buffer, i, 9, "comment"));
+		g_assert_true (has_class_at (buffer, i, 13, "string"));
+	}
+
+	g_string_free (text, TRUE);
+	g_object_unref (buffer);
+}
+
+static void
+test_tag_toggles (void)
+{
+	GtkSourceContextEngineStats stats;
+	GtkSourceLanguageManager *lm;
+	GtkSourceLanguage *lang;
+	GtkSourceBuffer *buffer;
+	GtkTextIter iter;
+	GString *text;
+	guint i;
+
+	text = g_string_new ("/*\n");
+	for (i = 0; i < 2000; i++)
+		g_string_append (text, " * text\n");
+	g_string_append (text, " */\nint x = 1;\n");
+
+	lm = gtk_source_language_manager_get_default ();
+	lang = gtk_source_language_manager_get_language (lm, "c");
+	buffer = gtk_source_buffer_new_with_language (lang);
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), text->str, -1);
+	get_tree_stats (buffer, &stats);
+	g_assert_cmpuint (stats.n_toggles_added, >, 0);
+
+	/* Typing in the comment does not change its tags. */
+	gtk_text_buffer_get_iter_at_line_offset (GTK_TEXT_BUFFER (buffer), &iter, 1000, 3);
+	gtk_text_buffer_insert (GTK_TEXT_BUFFER (buffer), &iter, "x", -1);
+	get_tree_stats (buffer, &stats);
+	g_assert_cmpuint (stats.n_toggles_added, ==, 0);
+	g_assert_cmpuint (stats.n_toggles_removed, ==, 0);
+	g_assert_true (has_class_at (buffer, 1000, 3, "comment"));
+
+	/* Ending the comment there removes its tag from the next lines. */
+	gtk_text_buffer_get_iter_at_line_offset (GTK_TEXT_BUFFER (buffer), &iter, 1000, 1);
+	gtk_text_buffer_insert (GTK_TEXT_BUFFER (buffer), &iter, "*/", -1);
+	get_tree_stats (buffer, &stats);
+	g_assert_cmpuint (stats.n_toggles_removed, >, 0);
+	g_assert_false (has_class_at (buffer, 1001, 3, "comment"));
+
+	g_string_free (text, TRUE);
+	g_object_unref (buffer);
+}
+
 static void
 do_test_change_case (GtkSourceBuffer         *buffer,
 		     GtkSourceChangeCaseType  case_type,
@@ -241,6 +615,20 @@ test_join_lines (void)
 	g_object_unref (buffer);
 }
 
+static void
+sort_lines_cb (GObject      *source_object,
+               GAsyncResult *result,
+               gpointer      user_data)
+{
+	GMainLoop *main_loop = user_data;
+	GError *error = NULL;
+
+	gtk_source_buffer_sort_lines_finish (GTK_SOURCE_BUFFER (source_object), result, &error);
+	g_assert_no_error (error);
+
+	g_main_loop_quit (main_loop);
+}
+
 static void
 do_test_sort_lines (GtkSourceBuffer    *buffer,
 		    const gchar        *text,
@@ -252,6 +640,7 @@ do_test_sort_lines (GtkSourceBuffer    *buffer,
 {
 	GtkTextIter start;
 	GtkTextIter end;
+	GMainLoop *main_loop;
 	gchar *changed;
 	char *escaped;
 
@@ -272,6 +661,28 @@ do_test_sort_lines (GtkSourceBuffer    *buffer,
 	g_assert_cmpstr (changed, ==, expected);
 
 	g_free (changed);
+
+	/* The async variant must give the same result. */
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), text, -1);
+
+	gtk_text_buffer_get_iter_at_offset (GTK_TEXT_BUFFER (buffer), &start, start_offset);
+	gtk_text_buffer_get_iter_at_offset (GTK_TEXT_BUFFER (buffer), &end, end_offset);
+
+	main_loop = g_main_loop_new (NULL, FALSE);
+
+	gtk_source_buffer_sort_lines_async (buffer, &start, &end, flags, column,
+	                                    NULL, NULL, NULL, NULL,
+	                                    sort_lines_cb, main_loop);
+
+	g_main_loop_run (main_loop);
+	g_main_loop_unref (main_loop);
+
+	gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (buffer), &start, &end);
+	changed = gtk_text_buffer_get_text (GTK_TEXT_BUFFER (buffer), &start, &end, TRUE);
+
+	g_assert_cmpstr (changed, ==, expected);
+
+	g_free (changed);
 }
 
 static void
@@ -307,6 +718,385 @@ test_sort_lines (void)
 	g_object_unref (buffer);
 }
 
+typedef struct
+{
+	GMainLoop *main_loop;
+	GError    *error;
+	guint      n_progress;
+	goffset    max_progress;
+	goffset    total;
+	guint      n_notify;
+} SortLinesData;
+
+static void
+sort_lines_data_cb (GObject      *source_object,
+                    GAsyncResult *result,
+                    gpointer      user_data)
+{
+	SortLinesData *data = user_data;
+
+	gtk_source_buffer_sort_lines_finish (GTK_SOURCE_BUFFER (source_object), result, &data->error);
+
+	g_main_loop_quit (data->main_loop);
+}
+
+static void
+sort_lines_progress_cb (goffset  current_num_bytes,
+                        goffset  total_num_bytes,
+                        gpointer user_data)
+{
+	SortLinesData *data = user_data;
+
+	g_assert_cmpint (current_num_bytes, <=, total_num_bytes);
+
+	data->n_progress++;
+	data->max_progress = MAX (data->max_progress, current_num_bytes);
+	data->total = total_num_bytes;
+}
+
+static void
+sort_lines_notify_cb (gpointer user_data)
+{
+	SortLinesData *data = user_data;
+
+	data->n_notify++;
+}
+
+/* Runs gtk_source_buffer_sort_lines_async() on the whole @buffer. */
+static void
+sort_all_lines_async (GtkSourceBuffer    *buffer,
+                      GtkSourceSortFlags  flags,
+                      gint                column,
+                      GCancellable       *cancellable,
+                      const gchar        *insert_while_sorting,
+                      SortLinesData      *data)
+{
+	GtkTextIter start;
+	GtkTextIter end;
+
+	data->main_loop = g_main_loop_new (NULL, FALSE);
+
+	gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (buffer), &start, &end);
+	gtk_source_buffer_sort_lines_async (buffer, &start, &end, flags, column,
+	                                    cancellable,
+	                                    sort_lines_progress_cb, data, sort_lines_notify_cb,
+	                                    sort_lines_data_cb, data);
+
+	if (insert_while_sorting != NULL)
+	{
+		gtk_text_buffer_get_end_iter (GTK_TEXT_BUFFER (buffer), &end);
+		gtk_text_buffer_insert (GTK_TEXT_BUFFER (buffer), &end, insert_while_sorting, -1);
+	}
+
+	g_main_loop_run (data->main_loop);
+	g_clear_pointer (&data->main_loop, g_main_loop_unref);
+
+	g_assert_cmpuint (data->n_notify, ==, 1);
+}
+
+/* More than 4096 lines, so that the async sort is split in several runs
+ * which are merged, when there are several processors.
+ */
+static gchar *
+get_lines_to_sort (guint n_lines)
+{
+	GString *str;
+	GRand *rand;
+	guint i;
+
+	str = g_string_new (NULL);
+	rand = g_rand_new_with_seed (42);
+
+	/* With duplicates, but lines with the same key are the same, as the
+	 * sorts do not keep the order of equal keys.
+	 */
+	for (i = 0; i < n_lines; i++)
+	{
+		guint n = g_rand_int_range (rand, 0, n_lines / 2);
+
+		g_string_append_printf (str, "%cfile%u\n", "aBcDeF"[n % 6], n);
+	}
+
+	g_rand_free (rand);
+
+	return g_string_free (str, FALSE);
+}
+
+static void
+test_sort_lines_parallel (void)
+{
+	GtkSourceBuffer *buffer;
+	gchar *text;
+	guint flags;
+
+	buffer = gtk_source_buffer_new (NULL);
+	text = get_lines_to_sort (5000);
+
+	for (flags = 0; flags <= (GTK_SOURCE_SORT_FLAGS_CASE_SENSITIVE |
+	                          GTK_SOURCE_SORT_FLAGS_REVERSE_ORDER |
+	                          GTK_SOURCE_SORT_FLAGS_REMOVE_DUPLICATES |
+	                          GTK_SOURCE_SORT_FLAGS_FILENAME); flags++)
+	{
+		gint column;
+
+		for (column = 0; column <= 1; column++)
+		{
+			SortLinesData data = { 0 };
+			GtkTextIter start;
+			GtkTextIter end;
+			gchar *expected;
+			gchar *sorted;
+
+			g_test_message ("Sorting with flags 0x%x from column %d", flags, column);
+
+			/* The sequential sort is the reference. */
+			gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), text, -1);
+			gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (buffer), &start, &end);
+			gtk_source_buffer_sort_lines (buffer, &start, &end, flags, column);
+			gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (buffer), &start, &end);
+			expected = gtk_text_buffer_get_text (GTK_TEXT_BUFFER (buffer), &start, &end, TRUE);
+
+			gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), text, -1);
+			sort_all_lines_async (buffer, flags, column, NULL, NULL, &data);
+			g_assert_no_error (data.error);
+
+			gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (buffer), &start, &end);
+			sorted = gtk_text_buffer_get_text (GTK_TEXT_BUFFER (buffer), &start, &end, TRUE);
+			g_assert_cmpstr (sorted, ==, expected);
+
+			/* The keys of all the lines are computed before the
+			 * runs are sorted and merged.
+			 */
+			g_assert_cmpuint (data.n_progress, >, 0);
+			g_assert_cmpint (data.total % 2, ==, 0);
+			g_assert_cmpint (data.max_progress, >=, data.total / 2);
+
+			g_free (expected);
+			g_free (sorted);
+		}
+	}
+
+	g_free (text);
+	g_object_unref (buffer);
+}
+
+static void
+test_sort_lines_cancelled (void)
+{
+	GtkSourceBuffer *buffer;
+	GCancellable *cancellable;
+	SortLinesData data = { 0 };
+	GtkTextIter start;
+	GtkTextIter end;
+	gchar *text;
+	gchar *result;
+
+	buffer = gtk_source_buffer_new (NULL);
+	text = get_lines_to_sort (5000);
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), text, -1);
+
+	cancellable = g_cancellable_new ();
+	g_cancellable_cancel (cancellable);
+
+	sort_all_lines_async (buffer, 0, 0, cancellable, NULL, &data);
+	g_assert_error (data.error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+	g_clear_error (&data.error);
+
+	/* The buffer is left untouched. */
+	gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (buffer), &start, &end);
+	result = gtk_text_buffer_get_text (GTK_TEXT_BUFFER (buffer), &start, &end, TRUE);
+	g_assert_cmpstr (result, ==, text);
+
+	g_free (result);
+	g_free (text);
+	g_object_unref (cancellable);
+	g_object_unref (buffer);
+}
+
+static void
+test_sort_lines_buffer_changed (void)
+{
+	GtkSourceBuffer *buffer;
+	SortLinesData data = { 0 };
+	GtkTextIter start;
+	GtkTextIter end;
+	gchar *result;
+
+	buffer = gtk_source_buffer_new (NULL);
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), "ccc\nbbb\naaa\n", -1);
+
+	sort_all_lines_async (buffer, 0, 0, NULL, "ddd\n", &data);
+	g_assert_error (data.error, G_IO_ERROR, G_IO_ERROR_FAILED);
+	g_clear_error (&data.error);
+
+	/* Only the modification made while sorting is in the buffer. */
+	gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (buffer), &start, &end);
+	result = gtk_text_buffer_get_text (GTK_TEXT_BUFFER (buffer), &start, &end, TRUE);
+	g_assert_cmpstr (result, ==, "ccc\nbbb\naaa\nddd\n");
+
+	g_free (result);
+	g_object_unref (buffer);
+}
+
+static void
+test_replace_ranges (void)
+{
+	GtkSourceBuffer *buffer;
+	GtkTextBuffer *text_buffer;
+	GtkSourceMark *mark;
+	GtkTextIter start;
+	GtkTextIter end;
+	const gint starts[] = { 0, 4, 8, 11 };
+	const gint ends[] = { 3, 4, 9, 11 };
+	const gchar *replacements[] = { "x", "new ", "", "!" };
+	gchar *text;
+
+	buffer = gtk_source_buffer_new (NULL);
+	text_buffer = GTK_TEXT_BUFFER (buffer);
+
+	gtk_text_buffer_set_text (text_buffer, "foo bar bàz", -1);
+
+	/* On "bar", between two ranges. */
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &start, 5);
+	mark = gtk_source_buffer_create_source_mark (buffer, NULL, "test", &start);
+
+	/* Select "ar". */
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &start, 5);
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &end, 7);
+	gtk_text_buffer_select_range (text_buffer, &start, &end);
+
+	gtk_source_buffer_replace_ranges (buffer, starts, ends, replacements, G_N_ELEMENTS (starts));
+
+	gtk_text_buffer_get_bounds (text_buffer, &start, &end);
+	text = gtk_text_buffer_get_text (text_buffer, &start, &end, TRUE);
+	g_assert_cmpstr (text, ==, "x new bar àz!");
+	g_free (text);
+
+	gtk_text_buffer_get_iter_at_mark (text_buffer, &start, GTK_TEXT_MARK (mark));
+	g_assert_cmpint (gtk_text_iter_get_offset (&start), ==, 7);
+
+	gtk_text_buffer_get_selection_bounds (text_buffer, &start, &end);
+	g_assert_cmpint (gtk_text_iter_get_offset (&start), ==, 7);
+	g_assert_cmpint (gtk_text_iter_get_offset (&end), ==, 9);
+
+	/* A single undo step. */
+	gtk_text_buffer_undo (text_buffer);
+
+	gtk_text_buffer_get_bounds (text_buffer, &start, &end);
+	text = gtk_text_buffer_get_text (text_buffer, &start, &end, TRUE);
+	g_assert_cmpstr (text, ==, "foo bar bàz");
+	g_free (text);
+
+	/* Deletions only. */
+	gtk_source_buffer_replace_ranges (buffer, starts, ends, NULL, 3);
+
+	gtk_text_buffer_get_bounds (text_buffer, &start, &end);
+	text = gtk_text_buffer_get_text (text_buffer, &start, &end, TRUE);
+	g_assert_cmpstr (text, ==, " bar àz");
+	g_free (text);
+
+	g_object_unref (buffer);
+}
+
+static void
+test_replace_ranges_keeps_gaps (void)
+{
+	GtkSourceBuffer *buffer;
+	GtkTextBuffer *text_buffer;
+	GtkTextMark *mark;
+	GtkTextTag *tag;
+	GtkTextIter start;
+	GtkTextIter end;
+	const gint starts[] = { 0, 9 };
+	const gint ends[] = { 1, 10 };
+	const gchar *replacements[] = { "AA", "BB" };
+	gchar *text;
+
+	buffer = gtk_source_buffer_new (NULL);
+	text_buffer = GTK_TEXT_BUFFER (buffer);
+
+	gtk_text_buffer_set_text (text_buffer, "a middle b", -1);
+
+	/* A plain mark and a tag on "middle", between the ranges. */
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &start, 4);
+	mark = gtk_text_buffer_create_mark (text_buffer, NULL, &start, TRUE);
+
+	tag = gtk_text_buffer_create_tag (text_buffer, NULL, NULL);
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &start, 2);
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &end, 8);
+	gtk_text_buffer_apply_tag (text_buffer, tag, &start, &end);
+
+	gtk_source_buffer_replace_ranges (buffer, starts, ends, replacements, G_N_ELEMENTS (starts));
+
+	gtk_text_buffer_get_bounds (text_buffer, &start, &end);
+	text = gtk_text_buffer_get_text (text_buffer, &start, &end, TRUE);
+	g_assert_cmpstr (text, ==, "AA middle BB");
+	g_free (text);
+
+	gtk_text_buffer_get_iter_at_mark (text_buffer, &start, mark);
+	g_assert_cmpint (gtk_text_iter_get_offset (&start), ==, 5);
+
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &start, 3);
+	g_assert_true (gtk_text_iter_starts_tag (&start, tag));
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &end, 9);
+	g_assert_true (gtk_text_iter_ends_tag (&end, tag));
+
+	g_object_unref (buffer);
+}
+
+static void
+text_replaced_cb (GtkSourceBufferInternal *buffer_internal,
+                  gint                     start_offset,
+                  gint                     old_end_offset,
+                  gint                     new_end_offset,
+                  gint                    *offsets)
+{
+	offsets[0]++;
+	offsets[1] = start_offset;
+	offsets[2] = old_end_offset;
+	offsets[3] = new_end_offset;
+}
+
+static void
+test_replace_ranges_single_update (void)
+{
+	GtkSourceBuffer *buffer;
+	GtkTextBuffer *text_buffer;
+	GtkSourceBufferInternal *buffer_internal;
+	const gint starts[] = { 2, 6, 10 };
+	const gint ends[] = { 3, 7, 11 };
+	const gchar *replacements[] = { "xx", "", "yy" };
+	gint offsets[4] = { 0 };
+
+	buffer = gtk_source_buffer_new (NULL);
+	text_buffer = GTK_TEXT_BUFFER (buffer);
+
+	gtk_text_buffer_set_text (text_buffer, "a b\nc d\ne f", -1);
+
+	buffer_internal = _gtk_source_buffer_internal_get_from_buffer (buffer);
+	g_signal_connect (buffer_internal,
+			  "text-replaced",
+			  G_CALLBACK (text_replaced_cb),
+			  offsets);
+
+	gtk_source_buffer_replace_ranges (buffer, starts, ends, replacements, G_N_ELEMENTS (starts));
+
+	/* The ranges are edited one by one, but reported at once, from the
+	 * start of the first range to the end of the last one.
+	 */
+	g_assert_cmpint (offsets[0], ==, 1);
+	g_assert_cmpint (offsets[1], ==, 2);
+	g_assert_cmpint (offsets[2], ==, 11);
+	g_assert_cmpint (offsets[3], ==, 12);
+	g_assert_false (_gtk_source_buffer_get_changes_held (buffer));
+
+	/* The other edits are not held. */
+	gtk_text_buffer_set_text (text_buffer, "", -1);
+	g_assert_cmpint (offsets[0], ==, 1);
+
+	g_object_unref (buffer);
+}
+
 static void
 do_test_move_words (GtkSourceView      *view,
                     GtkSourceBuffer    *buffer,
@@ -509,9 +1299,21 @@ main (int argc, char** argv)
 
 	g_test_add_func ("/Buffer/bug-634510", test_get_buffer);
 	g_test_add_func ("/Buffer/get-context-classes", test_get_context_classes);
+	g_test_add_func ("/Buffer/context-class-tag", test_context_class_tag);
+	g_test_add_func ("/Buffer/context-classes-edits", test_context_classes_edits);
+	g_test_add_func ("/Buffer/segment-tree-release", test_segment_tree_release);
+	g_test_add_func ("/Buffer/tag-toggles", test_tag_toggles);
+	g_test_add_func ("/Buffer/max-highlight-line-length", test_max_highlight_line_length);
+	g_test_add_func ("/Buffer/max-highlight-line-time", test_max_highlight_line_time);
 	g_test_add_func ("/Buffer/change-case", test_change_case);
 	g_test_add_func ("/Buffer/join-lines", test_join_lines);
 	g_test_add_func ("/Buffer/sort-lines", test_sort_lines);
+	g_test_add_func ("/Buffer/sort-lines-parallel", test_sort_lines_parallel);
+	g_test_add_func ("/Buffer/sort-lines-cancelled", test_sort_lines_cancelled);
+	g_test_add_func ("/Buffer/sort-lines-buffer-changed", test_sort_lines_buffer_changed);
+	g_test_add_func ("/Buffer/replace-ranges", test_replace_ranges);
+	g_test_add_func ("/Buffer/replace-ranges-keeps-gaps", test_replace_ranges_keeps_gaps);
+	g_test_add_func ("/Buffer/replace-ranges-single-update", test_replace_ranges_single_update);
 	g_test_add_func ("/Buffer/move-words", test_move_words);
 	g_test_add_func ("/Buffer/bracket-matching", test_bracket_matching);
 
@@ -930,6 +930,112 @@ test_max_size_gzip_file (void)
 	g_object_unref (loader);
 }
 
+typedef struct
+{
+	const gchar *expected_buffer_contents;
+	guint expected_n_lines;
+	guint expected_page_line;
+} LoadPageTestData;
+
+static void
+load_page_cb (GtkSourceFileLoader *loader,
+              GAsyncResult        *result,
+              LoadPageTestData    *data)
+{
+	GtkSourceBuffer *buffer;
+	GtkSourceFile *file;
+	GtkTextIter start;
+	GtkTextIter end;
+	GError *error = NULL;
+	gchar *text;
+
+	g_assert_true (gtk_source_file_loader_load_page_finish (loader, result, &error));
+	g_assert_no_error (error);
+
+	buffer = gtk_source_file_loader_get_buffer (loader);
+	gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (buffer), &start, &end);
+	text = gtk_text_iter_get_slice (&start, &end);
+	g_assert_cmpstr (text, ==, data->expected_buffer_contents);
+	g_free (text);
+
+	g_assert_cmpuint (gtk_source_file_loader_get_n_lines (loader), ==, data->expected_n_lines);
+	g_assert_cmpuint (gtk_source_file_loader_get_page_line (loader), ==, data->expected_page_line);
+	g_assert_false (gtk_text_buffer_get_modified (GTK_TEXT_BUFFER (buffer)));
+
+	file = gtk_source_file_loader_get_file (loader);
+	g_assert_true (gtk_source_file_is_readonly (file));
+
+	g_main_loop_quit (main_loop);
+}
+
+static void
+test_load_page (void)
+{
+	GFile *location;
+	GtkSourceBuffer *buffer;
+	GtkSourceFile *file;
+	GtkSourceFileLoader *loader;
+	LoadPageTestData data = { 0 };
+	GError *error = NULL;
+	char *filename;
+
+	main_loop = g_main_loop_new (NULL, FALSE);
+
+	filename = g_build_filename (g_get_tmp_dir (), "gtksourceview-file-loader-page.txt", NULL);
+	g_file_set_contents (filename, "line 0\nline 1\nline 2\nline 3\nline 4", -1, &error);
+	g_assert_no_error (error);
+
+	location = g_file_new_for_path (filename);
+	buffer = gtk_source_buffer_new (NULL);
+	file = gtk_source_file_new ();
+	gtk_source_file_set_location (file, location);
+	loader = gtk_source_file_loader_new (buffer, file);
+
+	g_assert_cmpuint (gtk_source_file_loader_get_n_lines (loader), ==, 0);
+
+	/* First window, which indexes the file. */
+	data.expected_buffer_contents = "line 1\nline 2";
+	data.expected_n_lines = 5;
+	data.expected_page_line = 1;
+	gtk_source_file_loader_load_page_async (loader, 1, 2,
+	                                        G_PRIORITY_DEFAULT,
+	                                        NULL,
+	                                        (GAsyncReadyCallback) load_page_cb,
+	                                        &data);
+	g_main_loop_run (main_loop);
+
+	/* Moving the window reuses the index. The window is clamped to the
+	 * end of the file.
+	 */
+	data.expected_buffer_contents = "line 3\nline 4";
+	data.expected_page_line = 3;
+	gtk_source_file_loader_load_page_async (loader, 3, 10,
+	                                        G_PRIORITY_DEFAULT,
+	                                        NULL,
+	                                        (GAsyncReadyCallback) load_page_cb,
+	                                        &data);
+	g_main_loop_run (main_loop);
+
+	/* The size limit applies to the window. */
+	gtk_source_file_loader_set_max_size (loader, 8);
+	data.expected_buffer_contents = "line 0";
+	data.expected_page_line = 0;
+	gtk_source_file_loader_load_page_async (loader, 0, 1,
+	                                        G_PRIORITY_DEFAULT,
+	                                        NULL,
+	                                        (GAsyncReadyCallback) load_page_cb,
+	                                        &data);
+	g_main_loop_run (main_loop);
+	g_main_loop_unref (main_loop);
+
+	delete_file (location);
+	g_free (filename);
+	g_object_unref (location);
+	g_object_unref (buffer);
+	g_object_unref (file);
+	g_object_unref (loader);
+}
+
 gint
 main (gint   argc,
       gchar *argv[])
@@ -946,6 +1052,7 @@ main (gint   argc,
 	g_test_add_func ("/file-loader/overflow-size-stream", test_overflow_size_stream);
 	g_test_add_func ("/file-loader/max-size-file", test_max_size_file);
 	g_test_add_func ("/file-loader/max-size-gzip-file", test_max_size_gzip_file);
+	g_test_add_func ("/file-loader/load-page", test_load_page);
 #ifdef G_OS_UNIX
 	g_test_add_func ("/file-loader/non-regular-file-rejected-before-read",
 	                 test_non_regular_file_rejected_before_read);
@@ -0,0 +1,125 @@
+/*
+ * This file is part of GtkSourceView
+ *
+ * GtkSourceView is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GtkSourceView is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include <gtksourceview/gtksource.h>
+#include "gtksourceview/gtksourcekeywordtrie-private.h"
+
+static void
+test_is_literal (void)
+{
+	g_assert_true (_gtk_source_keyword_is_literal ("while"));
+	g_assert_true (_gtk_source_keyword_is_literal ("uint8_t"));
+	g_assert_false (_gtk_source_keyword_is_literal (""));
+	g_assert_false (_gtk_source_keyword_is_literal ("G_[A-Z]+"));
+	g_assert_false (_gtk_source_keyword_is_literal ("operator\\+"));
+	g_assert_false (_gtk_source_keyword_is_literal ("été"));
+}
+
+static void
+test_has_prefix (void)
+{
+	GtkSourceKeywordTrie *trie;
+	const gchar *text = "int interval; if";
+
+	trie = _gtk_source_keyword_trie_new (FALSE);
+	_gtk_source_keyword_trie_add (trie, "int");
+	_gtk_source_keyword_trie_add (trie, "if");
+	_gtk_source_keyword_trie_add (trie, "int");
+
+	g_assert_true (_gtk_source_keyword_trie_has_prefix (trie, text, strlen (text), 0));
+	/* The keyword must end the word. */
+	g_assert_false (_gtk_source_keyword_trie_has_prefix (trie, text, strlen (text), 4));
+	g_assert_false (_gtk_source_keyword_trie_has_prefix (trie, text, strlen (text), 1));
+	g_assert_true (_gtk_source_keyword_trie_has_prefix (trie, text, strlen (text), 14));
+	g_assert_false (_gtk_source_keyword_trie_has_prefix (trie, text, 15, 14));
+	g_assert_false (_gtk_source_keyword_trie_has_prefix (trie, "INT", 3, 0));
+	g_assert_true (_gtk_source_keyword_trie_has_prefix (trie, "int(", 4, 0));
+	/* A non-ASCII character may end the word. */
+	g_assert_true (_gtk_source_keyword_trie_has_prefix (trie, "inté", strlen ("inté"), 0));
+
+	/* A longer keyword matches where the shorter one does not end the word. */
+	_gtk_source_keyword_trie_add (trie, "integer");
+	g_assert_true (_gtk_source_keyword_trie_has_prefix (trie, "integer x", 9, 0));
+	g_assert_false (_gtk_source_keyword_trie_has_prefix (trie, "integers", 8, 0));
+
+	_gtk_source_keyword_trie_unref (trie);
+}
+
+static void
+test_find (void)
+{
+	GtkSourceKeywordTrie *trie;
+	const gchar *text = "xint = print (int);";
+	gint len = strlen (text);
+
+	trie = _gtk_source_keyword_trie_new (FALSE);
+	_gtk_source_keyword_trie_add (trie, "int");
+
+	g_assert_cmpint (_gtk_source_keyword_trie_find (trie, text, len, 0, len), ==, 14);
+	g_assert_cmpint (_gtk_source_keyword_trie_find (trie, text, len, 0, 14), ==, -1);
+	g_assert_cmpint (_gtk_source_keyword_trie_find (trie, text, len, 15, len), ==, -1);
+
+	/* "int" starts "interval", but does not end a word there. */
+	text = "interval int";
+	len = strlen (text);
+	g_assert_cmpint (_gtk_source_keyword_trie_find (trie, text, len, 0, len), ==, 9);
+
+	/* A non-ASCII character may be a word boundary. */
+	text = "éint";
+	g_assert_cmpint (_gtk_source_keyword_trie_find (trie, text, strlen (text), 0, strlen (text)), ==, 2);
+
+	_gtk_source_keyword_trie_unref (trie);
+}
+
+static void
+test_caseless (void)
+{
+	GtkSourceKeywordTrie *trie;
+	GtkSourceKeywordTrie *all;
+	const gchar *text = "x Select \xe2\x84\xaaey";
+
+	trie = _gtk_source_keyword_trie_new (TRUE);
+	_gtk_source_keyword_trie_add (trie, "SELECT");
+	_gtk_source_keyword_trie_add (trie, "key");
+
+	g_assert_true (_gtk_source_keyword_trie_has_prefix (trie, text, strlen (text), 2));
+	/* U+212A KELVIN SIGN matches k caselessly. */
+	g_assert_true (_gtk_source_keyword_trie_has_prefix (trie, text, strlen (text), 9));
+	g_assert_cmpint (_gtk_source_keyword_trie_find (trie, text, strlen (text), 3, strlen (text)), ==, 9);
+
+	all = _gtk_source_keyword_trie_new (TRUE);
+	_gtk_source_keyword_trie_add_all (all, trie);
+	g_assert_cmpint (_gtk_source_keyword_trie_find (all, text, strlen (text), 0, strlen (text)), ==, 2);
+
+	_gtk_source_keyword_trie_unref (all);
+	_gtk_source_keyword_trie_unref (trie);
+}
+
+int
+main (int argc, char** argv)
+{
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/KeywordTrie/is-literal", test_is_literal);
+	g_test_add_func ("/KeywordTrie/has-prefix", test_has_prefix);
+	g_test_add_func ("/KeywordTrie/find", test_find);
+	g_test_add_func ("/KeywordTrie/caseless", test_caseless);
+
+	return g_test_run ();
+}
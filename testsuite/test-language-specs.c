@@ -1,5 +1,7 @@
 #include <gtksourceview/gtksource.h>
 
+#include "gtksourceview/gtksourcelanguage-private.h"
+
 static GHashTable *skipped;
 
 static void
@@ -9,6 +11,7 @@ test_func (gconstpointer data)
 	const char *language_id = data;
 	GtkSourceLanguage *l;
 	GtkSourceBuffer *buffer;
+	GError *error = NULL;
 
 	g_assert_true (GTK_SOURCE_IS_LANGUAGE_MANAGER (lm));
 	g_assert_nonnull (data);
@@ -29,6 +32,12 @@ test_func (gconstpointer data)
 			       "highlight-syntax", TRUE,
 			       NULL);
 
+	/* The regexes are only compiled when first matched, so compile
+	 * them all to find the invalid ones.
+	 */
+	_gtk_source_language_compile_regexes (l, &error);
+	g_assert_no_error (error);
+
 	g_object_unref (buffer);
 }
 
@@ -22,8 +22,11 @@
 #endif
 
 #include <stdlib.h>
+#include <glib/gstdio.h>
 #include <gtk/gtk.h>
 #include <gtksourceview/gtksource.h>
+#include "gtksourceview/gtksourcecontextengine-private.h"
+#include "gtksourceview/gtksourcelanguage-private.h"
 
 typedef struct _TestFixture TestFixture;
 
@@ -188,12 +191,282 @@ test_language (TestFixture   *fixture,
 	check_language (language, "test-empty", "Test Empty", "Others", TRUE, NULL, NULL, NULL, NULL, NULL, NULL);
 }
 
+static guint
+count_cache_files (void)
+{
+	gchar *cache_dir;
+	GDir *dir;
+	guint n_files = 0;
+
+	cache_dir = g_build_filename (g_get_user_cache_dir (), "gtksourceview-5", "language-specs", NULL);
+	dir = g_dir_open (cache_dir, 0, NULL);
+
+	if (dir != NULL)
+	{
+		while (g_dir_read_name (dir) != NULL)
+			n_files++;
+
+		g_dir_close (dir);
+	}
+
+	g_free (cache_dir);
+
+	return n_files;
+}
+
+static void
+remove_cache_files (void)
+{
+	gchar *cache_dir;
+	const gchar *name;
+	GDir *dir;
+
+	cache_dir = g_build_filename (g_get_user_cache_dir (), "gtksourceview-5", "language-specs", NULL);
+	dir = g_dir_open (cache_dir, 0, NULL);
+
+	if (dir != NULL)
+	{
+		while ((name = g_dir_read_name (dir)) != NULL)
+		{
+			gchar *cache_filename = g_build_filename (cache_dir, name, NULL);
+			g_unlink (cache_filename);
+			g_free (cache_filename);
+		}
+
+		g_dir_close (dir);
+	}
+
+	g_rmdir (cache_dir);
+	g_free (cache_dir);
+}
+
+/* Returns whether the language was replayed from the cache. */
+static gboolean
+load_language_from (const gchar * const *search_path)
+{
+	GtkSourceLanguageManager *manager;
+	GtkSourceLanguage *language;
+	guint n_cache_replays;
+
+	n_cache_replays = _gtk_source_language_get_n_cache_replays ();
+
+	manager = gtk_source_language_manager_new ();
+	gtk_source_language_manager_set_search_path (manager, search_path);
+
+	language = gtk_source_language_manager_get_language (manager, "test-full");
+	g_assert_nonnull (language);
+
+	/* Loads the styles, parsing the definitions. */
+	g_assert_cmpstr (gtk_source_language_get_style_name (language, "test-full:string"), ==, "String");
+	g_assert_cmpstr (gtk_source_language_get_style_fallback (language, "test-full:keyword"), ==, "def:keyword");
+
+	g_object_unref (manager);
+
+	return _gtk_source_language_get_n_cache_replays () != n_cache_replays;
+}
+
+static gboolean
+load_language_again (TestFixture *fixture)
+{
+	return load_language_from (gtk_source_language_manager_get_search_path (fixture->manager));
+}
+
+static void
+test_cache (TestFixture   *fixture,
+            gconstpointer  data)
+{
+	gchar *cache_dir;
+	gchar *cache_filename;
+	const gchar *name;
+	GDir *dir;
+
+	/* The other tests may have saved it already. */
+	remove_cache_files ();
+
+	/* Parsed and saved. */
+	g_assert_false (load_language_again (fixture));
+	g_assert_cmpuint (count_cache_files (), ==, 1);
+
+	/* Replayed from the cache. */
+	g_assert_true (load_language_again (fixture));
+	g_assert_cmpuint (count_cache_files (), ==, 1);
+
+	/* A corrupted cache is parsed again. */
+	cache_dir = g_build_filename (g_get_user_cache_dir (), "gtksourceview-5", "language-specs", NULL);
+	dir = g_dir_open (cache_dir, 0, NULL);
+	g_assert_nonnull (dir);
+	name = g_dir_read_name (dir);
+	g_assert_nonnull (name);
+	cache_filename = g_build_filename (cache_dir, name, NULL);
+	g_dir_close (dir);
+
+	g_assert_true (g_file_set_contents (cache_filename, "garbage", -1, NULL));
+
+	g_assert_false (load_language_again (fixture));
+	g_assert_cmpuint (count_cache_files (), ==, 1);
+	g_assert_true (load_language_again (fixture));
+
+	g_unlink (cache_filename);
+	g_rmdir (cache_dir);
+
+	g_free (cache_filename);
+	g_free (cache_dir);
+}
+
+static void
+test_cache_changed_file (TestFixture   *fixture,
+                         gconstpointer  data)
+{
+	const gchar * const *current;
+	const gchar **search_path;
+	GFileInfo *info;
+	GFile *file;
+	gchar *lang_dir;
+	gchar *source;
+	gchar *filename;
+	gchar *contents;
+	gsize length;
+	guint64 mtime;
+	guint32 usec;
+
+	lang_dir = g_dir_make_tmp ("test-language-specs-XXXXXX", NULL);
+	g_assert_nonnull (lang_dir);
+
+	/* The copy comes first, and hides the original. */
+	current = gtk_source_language_manager_get_search_path (fixture->manager);
+	search_path = g_new0 (const gchar *, g_strv_length ((gchar **)current) + 2);
+	search_path[0] = lang_dir;
+	for (guint i = 0; current[i] != NULL; i++)
+		search_path[i + 1] = current[i];
+
+	source = g_test_build_filename (G_TEST_DIST, "language-specs", "test-full.lang", NULL);
+	g_assert_true (g_file_get_contents (source, &contents, &length, NULL));
+	filename = g_build_filename (lang_dir, "test-full.lang", NULL);
+	g_assert_true (g_file_set_contents (filename, contents, length, NULL));
+
+	g_assert_false (load_language_from (search_path));
+	g_assert_true (load_language_from (search_path));
+
+	/* Touching the file within the same second invalidates the cache. */
+	file = g_file_new_for_path (filename);
+	info = g_file_query_info (file,
+	                          G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+	                          G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+	                          G_FILE_QUERY_INFO_NONE,
+	                          NULL,
+	                          NULL);
+	g_assert_nonnull (info);
+	mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+	usec = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+	g_object_unref (info);
+
+	info = g_file_info_new ();
+	g_file_info_set_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED, mtime);
+	g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC, (usec + 1) % G_USEC_PER_SEC);
+	g_assert_true (g_file_set_attributes_from_info (file, info, G_FILE_QUERY_INFO_NONE, NULL, NULL));
+	g_object_unref (info);
+
+	g_assert_false (load_language_from (search_path));
+	g_assert_true (load_language_from (search_path));
+
+	remove_cache_files ();
+	g_unlink (filename);
+	g_rmdir (lang_dir);
+
+	g_object_unref (file);
+	g_free (search_path);
+	g_free (contents);
+	g_free (filename);
+	g_free (source);
+	g_free (lang_dir);
+}
+
+/* Replays the definitions of a main context, of a simple context in it, and
+ * of the keywords of @keywords_id.
+ */
+static gboolean
+replay_keywords (GtkSourceLanguage   *language,
+                 const gchar         *keywords_id,
+                 const gchar * const *keywords)
+{
+	GtkSourceContextData *ctx_data;
+	GVariantBuilder builder;
+	GVariant *calls;
+	GError *error = NULL;
+	gboolean success;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(yv)"));
+	g_variant_builder_add (&builder, "(yv)", 'c',
+	                       g_variant_new ("(smsmsmsmsms@a(sb)u)",
+	                                      "test-full:test-full", NULL, NULL, NULL, NULL, NULL,
+	                                      g_variant_new_array (G_VARIANT_TYPE ("(sb)"), NULL, 0),
+	                                      0));
+	g_variant_builder_add (&builder, "(yv)", 'c',
+	                       g_variant_new ("(smsmsmsmsms@a(sb)u)",
+	                                      "test-full:keywords", "test-full:test-full", "\\bint\\b", NULL, NULL, NULL,
+	                                      g_variant_new_array (G_VARIANT_TYPE ("(sb)"), NULL, 0),
+	                                      0));
+	g_variant_builder_add (&builder, "(yv)", 'k',
+	                       g_variant_new ("(s^asb)", keywords_id, keywords, FALSE));
+	calls = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+	ctx_data = _gtk_source_context_data_new (language);
+	success = _gtk_source_context_data_replay (ctx_data, calls, &error);
+	g_assert_true (success == (error == NULL));
+
+	g_clear_error (&error);
+	_gtk_source_context_data_unref (ctx_data);
+	g_variant_unref (calls);
+
+	return success;
+}
+
+static void
+test_replay_invalid_keywords (TestFixture   *fixture,
+                              gconstpointer  data)
+{
+	GtkSourceLanguage *language;
+	const gchar *keywords[] = { "int", NULL };
+	const gchar *not_literal[] = { "int", "in+t", NULL };
+
+	language = gtk_source_language_manager_get_language (fixture->manager, "test-full");
+	g_assert_nonnull (language);
+
+	g_assert_true (replay_keywords (language, "test-full:keywords", keywords));
+
+	/* A corrupted recording is rejected, the language is then parsed. */
+	g_assert_false (replay_keywords (language, "test-full:unknown", keywords));
+	g_assert_false (replay_keywords (language, "test-full:test-full", keywords));
+	g_assert_false (replay_keywords (language, "test-full:keywords", not_literal));
+}
+
 int
 main (int argc, char** argv)
 {
+	gchar *cache_home;
+	gchar *cache_dir;
+	int ret;
+
+	/* Do not read or write the user cache. */
+	cache_home = g_dir_make_tmp ("test-language-XXXXXX", NULL);
+	g_assert_nonnull (cache_home);
+	g_setenv ("XDG_CACHE_HOME", cache_home, TRUE);
+
 	gtk_test_init (&argc, &argv);
 
 	g_test_add ("/Language/language-properties", TestFixture, NULL, test_fixture_setup, test_language, test_fixture_teardown);
+	g_test_add ("/Language/cache", TestFixture, NULL, test_fixture_setup, test_cache, test_fixture_teardown);
+	g_test_add ("/Language/cache-changed-file", TestFixture, NULL, test_fixture_setup, test_cache_changed_file, test_fixture_teardown);
+	g_test_add ("/Language/replay-invalid-keywords", TestFixture, NULL, test_fixture_setup, test_replay_invalid_keywords, test_fixture_teardown);
+
+	ret = g_test_run ();
+
+	cache_dir = g_build_filename (cache_home, "gtksourceview-5", NULL);
+	g_rmdir (cache_dir);
+	g_rmdir (cache_home);
+
+	g_free (cache_dir);
+	g_free (cache_home);
 
-	return g_test_run();
+	return ret;
 }
@@ -0,0 +1,202 @@
+/*
+ * This file is part of GtkSourceView
+ *
+ * GtkSourceView is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GtkSourceView is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtksourceview/gtksource.h>
+#include "gtksourceview/gtksourcemapraster-private.h"
+
+static void
+check_run (GtkSourceMapRaster *raster,
+           guint               line,
+           guint               n,
+           guint               expected_column,
+           guint               expected_length,
+           const GdkRGBA      *expected_color)
+{
+	guint column;
+	guint length;
+	GdkRGBA color;
+
+	g_assert_true (_gtk_source_map_raster_get_run (raster, line, n, &column, &length, &color));
+	g_assert_cmpuint (column, ==, expected_column);
+	g_assert_cmpuint (length, ==, expected_length);
+	g_assert_true (gdk_rgba_equal (&color, expected_color));
+}
+
+static void
+test_summary (void)
+{
+	GtkSourceMapRaster *raster;
+	GtkTextBuffer *buffer;
+	GtkTextTag *tag;
+	GtkTextIter start;
+	GtkTextIter end;
+	GdkRGBA black = { 0., 0., 0., 1. };
+	GdkRGBA red;
+
+	gdk_rgba_parse (&red, "red");
+
+	buffer = GTK_TEXT_BUFFER (gtk_source_buffer_new (NULL));
+	gtk_text_buffer_set_text (buffer, "a  bcd\te\n\n    f", -1);
+	tag = gtk_text_buffer_create_tag (buffer, NULL, "foreground", "red", NULL);
+
+	/* "bc" */
+	gtk_text_buffer_get_iter_at_line_offset (buffer, &start, 0, 3);
+	gtk_text_buffer_get_iter_at_line_offset (buffer, &end, 0, 5);
+	gtk_text_buffer_apply_tag (buffer, tag, &start, &end);
+
+	raster = _gtk_source_map_raster_new (NULL);
+	_gtk_source_map_raster_set_tab_width (raster, 4);
+	_gtk_source_map_raster_set_buffer (raster, buffer);
+
+	g_assert_cmpuint (_gtk_source_map_raster_get_n_lines (raster), ==, 3);
+
+	g_assert_cmpuint (_gtk_source_map_raster_get_n_runs (raster, 0), ==, 4);
+	check_run (raster, 0, 0, 0, 1, &black);
+	check_run (raster, 0, 1, 3, 2, &red);
+	check_run (raster, 0, 2, 5, 1, &black);
+	check_run (raster, 0, 3, 8, 1, &black);
+
+	g_assert_cmpuint (_gtk_source_map_raster_get_n_runs (raster, 1), ==, 0);
+
+	g_assert_cmpuint (_gtk_source_map_raster_get_n_runs (raster, 2), ==, 1);
+	check_run (raster, 2, 0, 4, 1, &black);
+
+	/* Removing the tag only summarizes its line again. */
+	gtk_text_buffer_remove_tag (buffer, tag, &start, &end);
+	g_assert_false (_gtk_source_map_raster_is_cached (raster, 0));
+	g_assert_true (_gtk_source_map_raster_is_cached (raster, 2));
+	g_assert_cmpuint (_gtk_source_map_raster_get_n_runs (raster, 0), ==, 3);
+	check_run (raster, 0, 1, 3, 3, &black);
+
+	/* The runs are cut at the last column. */
+	_gtk_source_map_raster_set_metrics (raster, 1., 1., 4);
+	g_assert_cmpuint (_gtk_source_map_raster_get_n_runs (raster, 0), ==, 2);
+	check_run (raster, 0, 1, 3, 1, &black);
+
+	_gtk_source_map_raster_free (raster);
+	g_object_unref (buffer);
+}
+
+static void
+test_edits (void)
+{
+	GtkSourceMapRaster *raster;
+	GtkTextBuffer *buffer;
+	GtkTextIter start;
+	GtkTextIter end;
+	GdkRGBA black = { 0., 0., 0., 1. };
+	guint line;
+
+	buffer = GTK_TEXT_BUFFER (gtk_source_buffer_new (NULL));
+	gtk_text_buffer_set_text (buffer, "zero\none\n  two\nthree", -1);
+
+	raster = _gtk_source_map_raster_new (NULL);
+	_gtk_source_map_raster_set_buffer (raster, buffer);
+
+	for (line = 0; line < 4; line++)
+	{
+		g_assert_cmpuint (_gtk_source_map_raster_get_n_runs (raster, line), ==, 1);
+		g_assert_true (_gtk_source_map_raster_is_cached (raster, line));
+	}
+
+	/* Insert two lines in the middle of the line 1. */
+	gtk_text_buffer_get_iter_at_line_offset (buffer, &start, 1, 1);
+	gtk_text_buffer_insert (buffer, &start, " x\ny\n", -1);
+
+	g_assert_cmpuint (_gtk_source_map_raster_get_n_lines (raster), ==, 6);
+	g_assert_true (_gtk_source_map_raster_is_cached (raster, 0));
+	g_assert_false (_gtk_source_map_raster_is_cached (raster, 1));
+	g_assert_false (_gtk_source_map_raster_is_cached (raster, 2));
+	g_assert_false (_gtk_source_map_raster_is_cached (raster, 3));
+	g_assert_true (_gtk_source_map_raster_is_cached (raster, 4));
+	g_assert_true (_gtk_source_map_raster_is_cached (raster, 5));
+
+	/* "o x", "y", "ne", "  two" */
+	g_assert_cmpuint (_gtk_source_map_raster_get_n_runs (raster, 1), ==, 2);
+	check_run (raster, 1, 1, 2, 1, &black);
+	check_run (raster, 2, 0, 0, 1, &black);
+	check_run (raster, 3, 0, 0, 2, &black);
+	check_run (raster, 4, 0, 2, 3, &black);
+
+	/* Join the lines 1 to 3 again. */
+	gtk_text_buffer_get_iter_at_line_offset (buffer, &start, 1, 1);
+	gtk_text_buffer_get_iter_at_line_offset (buffer, &end, 3, 0);
+	gtk_text_buffer_delete (buffer, &start, &end);
+
+	g_assert_cmpuint (_gtk_source_map_raster_get_n_lines (raster), ==, 4);
+	g_assert_true (_gtk_source_map_raster_is_cached (raster, 0));
+	g_assert_false (_gtk_source_map_raster_is_cached (raster, 1));
+	g_assert_true (_gtk_source_map_raster_is_cached (raster, 2));
+	g_assert_true (_gtk_source_map_raster_is_cached (raster, 3));
+
+	check_run (raster, 1, 0, 0, 3, &black);
+	check_run (raster, 2, 0, 2, 3, &black);
+	check_run (raster, 3, 0, 0, 5, &black);
+
+	_gtk_source_map_raster_invalidate (raster);
+	g_assert_false (_gtk_source_map_raster_is_cached (raster, 3));
+
+	_gtk_source_map_raster_free (raster);
+	g_object_unref (buffer);
+}
+
+static void
+test_map_property (void)
+{
+	GtkSourceView *view;
+	GtkSourceMap *map;
+
+	view = g_object_ref_sink (GTK_SOURCE_VIEW (gtk_source_view_new ()));
+	map = g_object_ref_sink (GTK_SOURCE_MAP (gtk_source_map_new ()));
+	gtk_source_map_set_view (map, view);
+
+	g_assert_true (gtk_text_view_get_buffer (GTK_TEXT_VIEW (map)) ==
+	               gtk_text_view_get_buffer (GTK_TEXT_VIEW (view)));
+
+	/* The map does not display the buffer itself in the raster mode. */
+	gtk_source_map_set_raster (map, TRUE);
+	g_assert_true (gtk_source_map_get_raster (map));
+	g_assert_true (gtk_text_view_get_buffer (GTK_TEXT_VIEW (map)) !=
+	               gtk_text_view_get_buffer (GTK_TEXT_VIEW (view)));
+
+	gtk_source_map_set_raster (map, FALSE);
+	g_assert_false (gtk_source_map_get_raster (map));
+	g_assert_true (gtk_text_view_get_buffer (GTK_TEXT_VIEW (map)) ==
+	               gtk_text_view_get_buffer (GTK_TEXT_VIEW (view)));
+
+	g_object_unref (map);
+	g_object_unref (view);
+}
+
+int
+main (int argc,
+      char *argv[])
+{
+	int ret;
+
+	gtk_init ();
+	gtk_source_init ();
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/MapRaster/summary", test_summary);
+	g_test_add_func ("/MapRaster/edits", test_edits);
+	g_test_add_func ("/MapRaster/map-property", test_map_property);
+
+	ret = g_test_run ();
+	gtk_source_finalize ();
+	return ret;
+}
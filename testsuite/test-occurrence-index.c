@@ -0,0 +1,137 @@
+/*
+ * This file is part of GtkSourceView
+ *
+ * GtkSourceView is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GtkSourceView is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtksourceview/gtksource.h>
+#include "gtksourceview/gtksourceoccurrenceindex-private.h"
+
+static void
+check_nth (GtkSourceOccurrenceIndex *index,
+           guint                     n,
+           gint                      expected_start,
+           gint                      expected_end)
+{
+	gint start;
+	gint end;
+
+	g_assert_true (_gtk_source_occurrence_index_get_nth (index, n, &start, &end));
+	g_assert_cmpint (start, ==, expected_start);
+	g_assert_cmpint (end, ==, expected_end);
+}
+
+static void
+test_add (void)
+{
+	GtkSourceOccurrenceIndex *index;
+
+	index = _gtk_source_occurrence_index_new ();
+
+	_gtk_source_occurrence_index_add (index, 10, 12);
+	_gtk_source_occurrence_index_add (index, 0, 2);
+	_gtk_source_occurrence_index_add (index, 2, 4);
+	_gtk_source_occurrence_index_add (index, 20, 25);
+
+	g_assert_cmpuint (_gtk_source_occurrence_index_get_count (index), ==, 4);
+	check_nth (index, 0, 0, 2);
+	check_nth (index, 1, 2, 4);
+	check_nth (index, 3, 20, 25);
+	g_assert_false (_gtk_source_occurrence_index_get_nth (index, 4, NULL, NULL));
+
+	g_assert_cmpuint (_gtk_source_occurrence_index_get_position (index, 10, 12), ==, 3);
+	g_assert_cmpuint (_gtk_source_occurrence_index_get_position (index, 10, 11), ==, 0);
+	g_assert_cmpuint (_gtk_source_occurrence_index_get_position (index, 11, 12), ==, 0);
+
+	g_assert_cmpuint (_gtk_source_occurrence_index_count_before (index, 0), ==, 0);
+	g_assert_cmpuint (_gtk_source_occurrence_index_count_before (index, 3), ==, 2);
+	g_assert_cmpuint (_gtk_source_occurrence_index_count_before (index, 100), ==, 4);
+
+	_gtk_source_occurrence_index_clear (index);
+	g_assert_cmpuint (_gtk_source_occurrence_index_get_count (index), ==, 0);
+
+	_gtk_source_occurrence_index_free (index);
+}
+
+static void
+test_remove_range (void)
+{
+	GtkSourceOccurrenceIndex *index;
+
+	index = _gtk_source_occurrence_index_new ();
+
+	_gtk_source_occurrence_index_add (index, 0, 2);
+	_gtk_source_occurrence_index_add (index, 2, 4);
+	_gtk_source_occurrence_index_add (index, 6, 9);
+	_gtk_source_occurrence_index_add (index, 10, 12);
+
+	/* An empty range only removes the occurrence containing it. */
+	g_assert_cmpuint (_gtk_source_occurrence_index_remove_range (index, 2, 2), ==, 0);
+	g_assert_cmpuint (_gtk_source_occurrence_index_remove_range (index, 7, 7), ==, 1);
+	g_assert_cmpuint (_gtk_source_occurrence_index_get_position (index, 6, 9), ==, 0);
+
+	g_assert_cmpuint (_gtk_source_occurrence_index_remove_range (index, 1, 3), ==, 2);
+	g_assert_cmpuint (_gtk_source_occurrence_index_get_count (index), ==, 1);
+	check_nth (index, 0, 10, 12);
+
+	_gtk_source_occurrence_index_free (index);
+}
+
+static void
+test_shift (void)
+{
+	GtkSourceOccurrenceIndex *index;
+	guint i;
+
+	index = _gtk_source_occurrence_index_new ();
+
+	for (i = 0; i < 1000; i++)
+		_gtk_source_occurrence_index_add (index, i * 4, i * 4 + 2);
+
+	/* Insert 10 characters at the offset 8. */
+	_gtk_source_occurrence_index_shift (index, 8, 10);
+	check_nth (index, 1, 4, 6);
+	check_nth (index, 2, 18, 20);
+	check_nth (index, 999, 4006, 4008);
+
+	/* Delete them again. */
+	_gtk_source_occurrence_index_shift (index, 18, -10);
+
+	for (i = 0; i < 1000; i++)
+	{
+		g_assert_cmpuint (_gtk_source_occurrence_index_get_position (index, i * 4, i * 4 + 2), ==, i + 1);
+	}
+
+	/* Delete the text [100; 200) and the occurrences in it. */
+	g_assert_cmpuint (_gtk_source_occurrence_index_remove_range (index, 100, 200), ==, 25);
+	_gtk_source_occurrence_index_shift (index, 200, -100);
+	g_assert_cmpuint (_gtk_source_occurrence_index_get_count (index), ==, 975);
+	check_nth (index, 24, 96, 98);
+	check_nth (index, 25, 100, 102);
+	g_assert_cmpuint (_gtk_source_occurrence_index_count_before (index, 101), ==, 26);
+
+	_gtk_source_occurrence_index_free (index);
+}
+
+int
+main (int argc, char** argv)
+{
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/OccurrenceIndex/add", test_add);
+	g_test_add_func ("/OccurrenceIndex/remove-range", test_remove_range);
+	g_test_add_func ("/OccurrenceIndex/shift", test_shift);
+
+	return g_test_run ();
+}
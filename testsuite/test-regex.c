@@ -255,6 +255,82 @@ test_issue_198 (void)
 	g_clear_pointer (&re, impl_regex_unref);
 }
 
+static void
+test_lazy_compile (void)
+{
+	GtkSourceRegex *regex;
+	ImplRegex *reference;
+	GError *error = NULL;
+	gboolean has_jit;
+	guint i;
+
+	/* Invalid patterns are only found when compiled. */
+	regex = _gtk_source_regex_new ("(", 0, &error);
+	g_assert_no_error (error);
+	g_assert_nonnull (regex);
+	g_assert_false (_gtk_source_regex_is_compiled (regex));
+	g_assert_false (_gtk_source_regex_compile (regex, &error));
+	g_assert_error (error, G_REGEX_ERROR, G_REGEX_ERROR_COMPILE);
+	g_clear_error (&error);
+	_gtk_source_regex_unref (regex);
+
+	regex = _gtk_source_regex_new ("a+", 0, &error);
+	g_assert_no_error (error);
+	g_assert_false (_gtk_source_regex_is_compiled (regex));
+	g_assert_cmpstr (_gtk_source_regex_get_pattern (regex), ==, "a+");
+
+	g_assert_true (_gtk_source_regex_match (regex, "baa", -1, 0));
+	g_assert_true (_gtk_source_regex_is_compiled (regex));
+	g_assert_false (_gtk_source_regex_is_jit_compiled (regex));
+	g_assert_cmpstr (_gtk_source_regex_get_pattern (regex), ==, "a+");
+
+	/* JIT may not be available on this platform. */
+	reference = impl_regex_new ("a+", G_REGEX_OPTIMIZE, 0, NULL);
+	has_jit = impl_regex_is_jit_compiled (reference);
+	impl_regex_unref (reference);
+
+	for (i = 0; i < 100; i++)
+		g_assert_false (_gtk_source_regex_match (regex, "bbb", -1, 0));
+
+	g_assert_cmpint (_gtk_source_regex_is_jit_compiled (regex), ==, has_jit);
+	g_assert_true (_gtk_source_regex_match (regex, "baa", -1, 0));
+
+	_gtk_source_regex_unref (regex);
+}
+
+static void
+test_max_newlines (void)
+{
+	static const struct {
+		const char *pattern;
+		int max_newlines;
+	} tests[] = {
+		{ "abc", 0 },
+		{ "a\\nb", 1 },
+		{ "a\\sb", 1 },
+		{ "[^x]?", 1 },
+		{ "(a\\n|b\\n){2}", 2 },
+		{ "a\\n{2,3}", 3 },
+		{ "(?<=a\\n)b", 1 },
+		{ "(a\\n)+", -1 },
+		{ "a\\s*b", -1 },
+		{ "a\\n{2,}", -1 },
+		{ "(a\\n)\\1", -1 },
+		{ "(?s)a", -1 },
+		{ "(a)(?1)", -1 },
+	};
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS (tests); i++)
+	{
+		ImplRegex *regex = impl_regex_new (tests[i].pattern, 0, 0, NULL);
+
+		g_assert_nonnull (regex);
+		g_assert_cmpint (impl_regex_get_max_newlines (regex), ==, tests[i].max_newlines);
+		impl_regex_unref (regex);
+	}
+}
+
 int
 main (int argc, char** argv)
 {
@@ -263,6 +339,8 @@ main (int argc, char** argv)
 	g_test_add_func ("/Regex/slash-c", test_slash_c_pattern);
 	g_test_add_func ("/Regex/compare-g-regex", test_compare);
 	g_test_add_func ("/Regex/issue_198", test_issue_198);
+	g_test_add_func ("/Regex/lazy-compile", test_lazy_compile);
+	g_test_add_func ("/Regex/max-newlines", test_max_newlines);
 
 	return g_test_run();
 }
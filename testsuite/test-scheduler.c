@@ -0,0 +1,185 @@
+/*
+ * This file is part of GtkSourceView
+ *
+ * GtkSourceView is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * GtkSourceView is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtksourceview/gtksource.h>
+#include "gtksourceview/gtksourcebuffer-private.h"
+#include "gtksourceview/gtksourcescheduler-private.h"
+
+static GString *run_order;
+
+/* If we are running from the source dir (e.g. during make check)
+ * we override the path to read from the data dir
+ */
+static void
+init_default_manager (void)
+{
+	gchar *dir;
+
+	dir = g_build_filename (TOP_SRCDIR, "data", "language-specs", NULL);
+
+	if (g_file_test (dir, G_FILE_TEST_IS_DIR))
+	{
+		GtkSourceLanguageManager *lm = gtk_source_language_manager_get_default ();
+		const gchar *lang_dirs[2] = {dir, NULL};
+
+		gtk_source_language_manager_set_search_path (lm, lang_dirs);
+	}
+
+	g_free (dir);
+}
+
+/* The number of tasks of @type registered in the scheduler. */
+static guint
+get_n_tasks (const gchar *type)
+{
+	GVariant *stats;
+	GVariant *tasks;
+	guint n_tasks = 0;
+	guint64 n_runs;
+	gint64 time_spent;
+
+	stats = g_variant_ref_sink (gtk_source_scheduler_get_stats ());
+	tasks = g_variant_lookup_value (stats, "tasks", G_VARIANT_TYPE ("a{s(utx)}"));
+
+	g_assert_nonnull (tasks);
+	g_assert_true (g_variant_lookup (tasks, type, "(utx)", &n_tasks, &n_runs, &time_spent));
+
+	g_variant_unref (tasks);
+	g_variant_unref (stats);
+
+	return n_tasks;
+}
+
+static void
+test_engines_share_scheduler (void)
+{
+	GtkSourceLanguageManager *lm;
+	GtkSourceLanguage *lang;
+	GtkSourceBuffer *buffers[3];
+	guint n_before;
+	guint i;
+
+	lm = gtk_source_language_manager_get_default ();
+	lang = gtk_source_language_manager_get_language (lm, "c");
+	g_assert_nonnull (lang);
+
+	n_before = get_n_tasks ("highlighting");
+
+	for (i = 0; i < G_N_ELEMENTS (buffers); i++)
+	{
+		GtkSourceEngine *engine;
+
+		buffers[i] = gtk_source_buffer_new_with_language (lang);
+		gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffers[i]),
+					  "/* comment */\nint main (void) { return 0; }\n",
+					  -1);
+
+		/* The first update is work of the shared scheduler, not an
+		 * idle of its own.
+		 */
+		engine = _gtk_source_buffer_get_highlight_engine (buffers[i]);
+		g_assert_nonnull (engine);
+		g_assert_null (g_main_context_find_source_by_funcs_user_data (NULL, &g_idle_funcs, engine));
+	}
+
+	g_assert_cmpuint (get_n_tasks ("highlighting"), ==, n_before + G_N_ELEMENTS (buffers));
+
+	while (get_n_tasks ("highlighting") > n_before)
+	{
+		g_main_context_iteration (NULL, TRUE);
+	}
+
+	for (i = 0; i < G_N_ELEMENTS (buffers); i++)
+	{
+		GtkTextIter iter;
+
+		gtk_text_buffer_get_start_iter (GTK_TEXT_BUFFER (buffers[i]), &iter);
+		g_assert_true (gtk_source_buffer_iter_has_context_class (buffers[i], &iter, "comment"));
+
+		g_object_unref (buffers[i]);
+	}
+}
+
+static gboolean
+record_run_cb (gint64   deadline,
+               gpointer user_data)
+{
+	if (run_order->len > 0)
+	{
+		g_string_append_c (run_order, ' ');
+	}
+
+	g_string_append (run_order, user_data);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+test_visible_first (void)
+{
+	GObject *background_owner;
+	GObject *shown_owner;
+
+	background_owner = g_object_new (G_TYPE_OBJECT, NULL);
+	shown_owner = g_object_new (G_TYPE_OBJECT, NULL);
+	run_order = g_string_new (NULL);
+
+	_gtk_source_scheduler_hold_owner (shown_owner, GTK_SOURCE_SCHEDULER_PRIORITY_VISIBLE);
+
+	/* Added in the reverse order of their priority. */
+	_gtk_source_scheduler_add_for_owner (background_owner,
+	                                     GTK_SOURCE_SCHEDULER_TASK_OTHER,
+	                                     record_run_cb,
+	                                     "background",
+	                                     NULL);
+	_gtk_source_scheduler_add_for_owner (shown_owner,
+	                                     GTK_SOURCE_SCHEDULER_TASK_OTHER,
+	                                     record_run_cb,
+	                                     "shown",
+	                                     NULL);
+	_gtk_source_scheduler_add_visible (GTK_SOURCE_SCHEDULER_TASK_OTHER,
+	                                   record_run_cb,
+	                                   "visible",
+	                                   NULL);
+
+	while (get_n_tasks ("other") > 0)
+	{
+		g_main_context_iteration (NULL, TRUE);
+	}
+
+	g_assert_cmpstr (run_order->str, ==, "visible shown background");
+
+	_gtk_source_scheduler_release_owner (shown_owner, GTK_SOURCE_SCHEDULER_PRIORITY_VISIBLE);
+
+	g_string_free (run_order, TRUE);
+	run_order = NULL;
+	g_object_unref (background_owner);
+	g_object_unref (shown_owner);
+}
+
+int
+main (int argc, char** argv)
+{
+	gtk_test_init (&argc, &argv);
+
+	init_default_manager ();
+
+	g_test_add_func ("/Scheduler/engines-share-scheduler", test_engines_share_scheduler);
+	g_test_add_func ("/Scheduler/visible-first", test_visible_first);
+
+	return g_test_run ();
+}
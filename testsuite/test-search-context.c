@@ -19,6 +19,8 @@
 
 #include <gtk/gtk.h>
 #include <gtksourceview/gtksource.h>
+#include "gtksourceview/gtksourcebuffer-private.h"
+#include "gtksourceview/gtksourcesearchcontext-private.h"
 
 typedef struct
 {
@@ -1187,6 +1189,178 @@ test_occurrence_position (void)
 	pos = gtk_source_search_context_get_occurrence_position (context, &start, &end);
 	g_assert_cmpint (pos, ==, 2);
 
+	g_assert_true (gtk_source_search_context_get_nth_occurrence (context, 2, &start, &end));
+	g_assert_cmpint (gtk_text_iter_get_offset (&start), ==, 2);
+	g_assert_cmpint (gtk_text_iter_get_offset (&end), ==, 4);
+	g_assert_false (gtk_source_search_context_get_nth_occurrence (context, 0, NULL, NULL));
+	g_assert_false (gtk_source_search_context_get_nth_occurrence (context, 3, NULL, NULL));
+
+	/* Contents: "b aaaa" */
+	gtk_text_buffer_get_start_iter (text_buffer, &start);
+	gtk_text_buffer_insert (text_buffer, &start, "b ", -1);
+	flush_queue ();
+
+	g_assert_true (gtk_source_search_context_get_nth_occurrence (context, 1, &start, &end));
+	g_assert_cmpint (gtk_text_iter_get_offset (&start), ==, 2);
+	g_assert_cmpint (gtk_text_iter_get_offset (&end), ==, 4);
+	pos = gtk_source_search_context_get_occurrence_position (context, &start, &end);
+	g_assert_cmpint (pos, ==, 1);
+
+	g_object_unref (source_buffer);
+	g_object_unref (settings);
+	g_object_unref (context);
+}
+
+static void
+test_use_text_tags (void)
+{
+	GtkSourceBuffer *source_buffer = gtk_source_buffer_new (NULL);
+	GtkTextBuffer *text_buffer = GTK_TEXT_BUFFER (source_buffer);
+	GtkSourceSearchSettings *settings = gtk_source_search_settings_new ();
+	GtkSourceSearchContext *context = gtk_source_search_context_new (source_buffer, settings);
+	GtkTextIter iter;
+	GtkTextIter match_start;
+	GtkTextIter match_end;
+	GSList *tags;
+
+	static SearchResult forward_results[] =
+	{
+		{ 0, 2, TRUE, FALSE },
+		{ 2, 4, TRUE, FALSE },
+		{ 2, 4, TRUE, FALSE },
+		{ 0, 2, TRUE, TRUE },
+		{ 0, 2, TRUE, TRUE }
+	};
+
+	static SearchResult backward_results[] =
+	{
+		{ 2, 4, TRUE, TRUE },
+		{ 2, 4, TRUE, TRUE },
+		{ 0, 2, TRUE, FALSE },
+		{ 0, 2, TRUE, FALSE },
+		{ 2, 4, TRUE, FALSE }
+	};
+
+	g_assert_true (gtk_source_search_context_get_use_text_tags (context));
+
+	gtk_text_buffer_set_text (text_buffer, "aaaa", -1);
+	gtk_source_search_settings_set_search_text (settings, "aa");
+	gtk_source_search_settings_set_wrap_around (settings, TRUE);
+	flush_queue ();
+
+	gtk_source_search_context_set_use_text_tags (context, FALSE);
+	flush_queue ();
+
+	g_assert_cmpint (gtk_source_search_context_get_occurrences_count (context), ==, 2);
+
+	gtk_text_buffer_get_start_iter (text_buffer, &iter);
+	tags = gtk_text_iter_get_tags (&iter);
+	g_assert_null (tags);
+
+	check_search_results (source_buffer, context, forward_results, TRUE);
+	check_search_results (source_buffer, context, backward_results, FALSE);
+
+	gtk_source_search_settings_set_regex_enabled (settings, TRUE);
+	check_search_results (source_buffer, context, forward_results, TRUE);
+	check_search_results (source_buffer, context, backward_results, FALSE);
+	gtk_source_search_settings_set_regex_enabled (settings, FALSE);
+
+	/* Contents: "aaxaa" */
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &iter, 2);
+	gtk_text_buffer_insert (text_buffer, &iter, "x", -1);
+	flush_queue ();
+	g_assert_cmpint (gtk_source_search_context_get_occurrences_count (context), ==, 2);
+
+	/* Contents: "axaa" */
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &iter, 1);
+	gtk_text_buffer_backspace (text_buffer, &iter, FALSE, TRUE);
+	flush_queue ();
+	g_assert_cmpint (gtk_source_search_context_get_occurrences_count (context), ==, 1);
+	g_assert_true (gtk_source_search_context_get_nth_occurrence (context, 1, &match_start, &match_end));
+	g_assert_cmpint (gtk_text_iter_get_offset (&match_start), ==, 2);
+	g_assert_cmpint (gtk_text_iter_get_offset (&match_end), ==, 4);
+
+	g_object_unref (source_buffer);
+	g_object_unref (settings);
+	g_object_unref (context);
+}
+
+static void
+test_search_region (void)
+{
+	GtkSourceBuffer *source_buffer = gtk_source_buffer_new (NULL);
+	GtkTextBuffer *text_buffer = GTK_TEXT_BUFFER (source_buffer);
+	GtkSourceSearchSettings *settings = gtk_source_search_settings_new ();
+	GtkSourceSearchContext *context = gtk_source_search_context_new (source_buffer, settings);
+	GtkSourceRegion *region;
+	GtkTextIter start;
+	GtkTextIter end;
+	GtkTextIter match_start;
+	GtkTextIter match_end;
+	gboolean found;
+	gint count;
+	guint nb_replacements;
+	gchar *contents;
+	GError *error = NULL;
+
+	gtk_text_buffer_set_text (text_buffer, "foo\nfoo bar foo\nfoo", -1);
+	gtk_source_search_settings_set_search_text (settings, "foo");
+
+	/* "oo bar fo" */
+	region = gtk_source_region_new (text_buffer);
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &start, 5);
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &end, 14);
+	gtk_source_region_add_subregion (region, &start, &end);
+	gtk_source_search_context_set_search_region (context, region);
+	flush_queue ();
+
+	count = gtk_source_search_context_get_occurrences_count (context);
+	g_assert_cmpint (count, ==, 0);
+
+	/* "foo bar foo" */
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &start, 4);
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &end, 15);
+	gtk_source_region_add_subregion (region, &start, &end);
+	gtk_source_search_context_set_search_region (context, region);
+	g_object_unref (region);
+	flush_queue ();
+
+	count = gtk_source_search_context_get_occurrences_count (context);
+	g_assert_cmpint (count, ==, 2);
+
+	gtk_text_buffer_get_start_iter (text_buffer, &start);
+	found = gtk_source_search_context_forward (context, &start, &match_start, &match_end, NULL);
+	g_assert_true (found);
+	g_assert_cmpint (gtk_text_iter_get_offset (&match_start), ==, 4);
+
+	gtk_text_buffer_get_end_iter (text_buffer, &end);
+	found = gtk_source_search_context_backward (context, &end, &match_start, &match_end, NULL);
+	g_assert_true (found);
+	g_assert_cmpint (gtk_text_iter_get_offset (&match_start), ==, 12);
+
+	/* The text inserted at the start of the region is part of it. */
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &start, 4);
+	gtk_text_buffer_insert (text_buffer, &start, "foo ", -1);
+	flush_queue ();
+
+	count = gtk_source_search_context_get_occurrences_count (context);
+	g_assert_cmpint (count, ==, 3);
+
+	nb_replacements = gtk_source_search_context_replace_all (context, "X", -1, &error);
+	g_assert_no_error (error);
+	g_assert_cmpint (nb_replacements, ==, 3);
+
+	contents = get_buffer_contents (text_buffer);
+	g_assert_cmpstr (contents, ==, "foo\nX X bar X\nfoo");
+	g_free (contents);
+
+	gtk_source_search_context_set_search_region (context, NULL);
+	g_assert_null (gtk_source_search_context_get_search_region (context));
+	flush_queue ();
+
+	count = gtk_source_search_context_get_occurrences_count (context);
+	g_assert_cmpint (count, ==, 2);
+
 	g_object_unref (source_buffer);
 	g_object_unref (settings);
 	g_object_unref (context);
@@ -1260,6 +1434,58 @@ test_replace_all (void)
 	g_object_unref (context);
 }
 
+static void
+test_held_changes (void)
+{
+	GtkSourceBuffer *source_buffer = gtk_source_buffer_new (NULL);
+	GtkTextBuffer *text_buffer = GTK_TEXT_BUFFER (source_buffer);
+	GtkSourceSearchSettings *settings = gtk_source_search_settings_new ();
+	GtkSourceSearchContext *context = gtk_source_search_context_new (source_buffer, settings);
+	GtkTextIter start;
+	GtkTextIter end;
+	GtkTextIter match_start;
+	GtkTextIter match_end;
+	gboolean found;
+	gint offset;
+	gint pos;
+
+	gtk_text_buffer_set_text (text_buffer, "aa bb aa", -1);
+	gtk_source_search_settings_set_search_text (settings, "aa");
+	flush_queue ();
+	g_assert_cmpint (gtk_source_search_context_get_occurrences_count (context), ==, 2);
+
+	/* A search in the middle of held changes sees the current text, not
+	 * the occurrences from before the changes.
+	 */
+	_gtk_source_buffer_hold_changes (source_buffer);
+
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &start, 0);
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &end, 3);
+	gtk_text_buffer_delete (text_buffer, &start, &end);
+
+	gtk_text_buffer_get_start_iter (text_buffer, &start);
+	found = gtk_source_search_context_forward (context, &start, &match_start, &match_end, NULL);
+	g_assert_true (found);
+
+	offset = gtk_text_iter_get_offset (&match_start);
+	g_assert_cmpint (offset, ==, 3);
+	offset = gtk_text_iter_get_offset (&match_end);
+	g_assert_cmpint (offset, ==, 5);
+
+	pos = gtk_source_search_context_get_occurrence_position (context, &match_start, &match_end);
+	g_assert_cmpint (pos, ==, 1);
+
+	gtk_text_buffer_insert (text_buffer, &match_end, " aa", -1);
+
+	_gtk_source_buffer_release_changes (source_buffer);
+	flush_queue ();
+	g_assert_cmpint (gtk_source_search_context_get_occurrences_count (context), ==, 2);
+
+	g_object_unref (source_buffer);
+	g_object_unref (settings);
+	g_object_unref (context);
+}
+
 static void
 test_regex_basics (void)
 {
@@ -1583,6 +1809,286 @@ test_regex_look_ahead (void)
 	g_object_unref (context);
 }
 
+static void
+test_regex_shared_scan (void)
+{
+	GtkSourceBuffer *source_buffer = gtk_source_buffer_new (NULL);
+	GtkTextBuffer *text_buffer = GTK_TEXT_BUFFER (source_buffer);
+	GtkSourceSearchSettings *settings1 = gtk_source_search_settings_new ();
+	GtkSourceSearchSettings *settings2 = gtk_source_search_settings_new ();
+	GtkSourceSearchContext *context1 = gtk_source_search_context_new (source_buffer, settings1);
+	GtkSourceSearchContext *context2 = gtk_source_search_context_new (source_buffer, settings2);
+	GtkTextIter iter;
+	GtkTextIter match_start;
+	GtkTextIter match_end;
+	gint count;
+
+	gtk_source_search_settings_set_regex_enabled (settings1, TRUE);
+	gtk_source_search_settings_set_search_text (settings1, "(?<=1)23");
+	gtk_source_search_settings_set_regex_enabled (settings2, TRUE);
+	gtk_source_search_settings_set_search_text (settings2, "3\\n2");
+
+	/* Both contexts scan the new text, the second one has a partial match
+	 * at the end of the lines.
+	 */
+	gtk_text_buffer_set_text (text_buffer, "12\n23\n123\n23\n12", -1);
+	flush_queue ();
+
+	count = gtk_source_search_context_get_occurrences_count (context1);
+	g_assert_cmpint (count, ==, 1);
+	count = gtk_source_search_context_get_occurrences_count (context2);
+	g_assert_cmpint (count, ==, 1);
+
+	g_assert_true (gtk_source_search_context_get_nth_occurrence (context2, 1, &match_start, &match_end));
+	g_assert_cmpint (gtk_text_iter_get_offset (&match_start), ==, 8);
+	g_assert_cmpint (gtk_text_iter_get_offset (&match_end), ==, 11);
+
+	gtk_text_buffer_get_iter_at_line (text_buffer, &iter, 1);
+	gtk_text_buffer_insert (text_buffer, &iter, "1", -1);
+	flush_queue ();
+
+	count = gtk_source_search_context_get_occurrences_count (context1);
+	g_assert_cmpint (count, ==, 2);
+	count = gtk_source_search_context_get_occurrences_count (context2);
+	g_assert_cmpint (count, ==, 1);
+
+	g_assert_cmpuint (_gtk_source_search_context_get_shared_chunks (context1), >, 0);
+	g_assert_cmpuint (_gtk_source_search_context_get_shared_chunks (context2), >, 0);
+
+	g_object_unref (source_buffer);
+	g_object_unref (settings1);
+	g_object_unref (settings2);
+	g_object_unref (context1);
+	g_object_unref (context2);
+}
+
+static void
+test_shared_scan (void)
+{
+	GtkSourceBuffer *source_buffer = gtk_source_buffer_new (NULL);
+	GtkTextBuffer *text_buffer = GTK_TEXT_BUFFER (source_buffer);
+	GtkSourceSearchSettings *settings1 = gtk_source_search_settings_new ();
+	GtkSourceSearchSettings *settings2 = gtk_source_search_settings_new ();
+	GtkSourceSearchSettings *settings3 = gtk_source_search_settings_new ();
+	GtkSourceSearchContext *context1 = gtk_source_search_context_new (source_buffer, settings1);
+	GtkSourceSearchContext *context2 = gtk_source_search_context_new (source_buffer, settings2);
+	GtkSourceSearchContext *context3 = gtk_source_search_context_new (source_buffer, settings3);
+	GtkTextIter iter;
+	gint count;
+
+	gtk_source_search_settings_set_search_text (settings1, "TODO");
+	gtk_source_search_settings_set_case_sensitive (settings1, TRUE);
+	gtk_source_search_settings_set_search_text (settings2, "fixme");
+	gtk_source_search_settings_set_search_text (settings3, "absent");
+
+	gtk_text_buffer_set_text (text_buffer, "a TODO\nb todo\nFIXME c\nTODO TODO\n", -1);
+	flush_queue ();
+
+	count = gtk_source_search_context_get_occurrences_count (context1);
+	g_assert_cmpint (count, ==, 3);
+	count = gtk_source_search_context_get_occurrences_count (context2);
+	g_assert_cmpint (count, ==, 1);
+	count = gtk_source_search_context_get_occurrences_count (context3);
+	g_assert_cmpint (count, ==, 0);
+
+	g_assert_cmpuint (_gtk_source_search_context_get_shared_chunks (context1), >, 0);
+	g_assert_cmpuint (_gtk_source_search_context_get_shared_chunks (context2), >, 0);
+	g_assert_cmpuint (_gtk_source_search_context_get_shared_chunks (context3), >, 0);
+
+	/* The occurrences of the modified lines are updated. */
+	gtk_text_buffer_get_iter_at_line (text_buffer, &iter, 1);
+	gtk_text_buffer_insert (text_buffer, &iter, "Fixme ", -1);
+	flush_queue ();
+
+	count = gtk_source_search_context_get_occurrences_count (context1);
+	g_assert_cmpint (count, ==, 3);
+	count = gtk_source_search_context_get_occurrences_count (context2);
+	g_assert_cmpint (count, ==, 2);
+	count = gtk_source_search_context_get_occurrences_count (context3);
+	g_assert_cmpint (count, ==, 0);
+
+	g_object_unref (source_buffer);
+	g_object_unref (settings1);
+	g_object_unref (settings2);
+	g_object_unref (settings3);
+	g_object_unref (context1);
+	g_object_unref (context2);
+	g_object_unref (context3);
+}
+
+static void
+check_nth_occurrence (GtkSourceSearchContext *context,
+                      gint                    n,
+                      gint                    expected_start,
+                      gint                    expected_end)
+{
+	GtkTextIter match_start;
+	GtkTextIter match_end;
+
+	g_assert_true (gtk_source_search_context_get_nth_occurrence (context, n, &match_start, &match_end));
+	g_assert_cmpint (gtk_text_iter_get_offset (&match_start), ==, expected_start);
+	g_assert_cmpint (gtk_text_iter_get_offset (&match_end), ==, expected_end);
+}
+
+static void
+test_shared_scan_matches (void)
+{
+	GtkSourceBuffer *source_buffer = gtk_source_buffer_new (NULL);
+	GtkTextBuffer *text_buffer = GTK_TEXT_BUFFER (source_buffer);
+	GtkSourceSearchSettings *settings1 = gtk_source_search_settings_new ();
+	GtkSourceSearchSettings *settings2 = gtk_source_search_settings_new ();
+	GtkSourceSearchContext *context1 = gtk_source_search_context_new (source_buffer, settings1);
+	GtkSourceSearchContext *context2 = gtk_source_search_context_new (source_buffer, settings2);
+	gint count;
+
+	gtk_source_search_settings_set_search_text (settings1, "aa");
+	gtk_source_search_settings_set_case_sensitive (settings1, TRUE);
+	gtk_source_search_settings_set_search_text (settings2, "AB");
+	gtk_source_search_settings_set_at_word_boundaries (settings2, TRUE);
+
+	/* The occurrences found in the shared text don't overlap, and the
+	 * word boundaries are checked afterwards.
+	 */
+	gtk_text_buffer_set_text (text_buffer, "aaa ab xab\nAB aa", -1);
+	flush_queue ();
+
+	count = gtk_source_search_context_get_occurrences_count (context1);
+	g_assert_cmpint (count, ==, 2);
+	check_nth_occurrence (context1, 1, 0, 2);
+	check_nth_occurrence (context1, 2, 14, 16);
+
+	count = gtk_source_search_context_get_occurrences_count (context2);
+	g_assert_cmpint (count, ==, 2);
+	check_nth_occurrence (context2, 1, 4, 6);
+	check_nth_occurrence (context2, 2, 11, 13);
+
+	g_assert_cmpuint (_gtk_source_search_context_get_shared_chunks (context1), >, 0);
+	g_assert_cmpuint (_gtk_source_search_context_get_shared_chunks (context2), >, 0);
+
+	/* The case insensitive search of a non-ASCII text normalizes it,
+	 * it uses the GtkTextIter search.
+	 */
+	gtk_source_search_settings_set_search_text (settings2, "e");
+	gtk_source_search_settings_set_at_word_boundaries (settings2, FALSE);
+	gtk_text_buffer_set_text (text_buffer, "\xc3\xa9 E aa", -1);
+	flush_queue ();
+
+	count = gtk_source_search_context_get_occurrences_count (context1);
+	g_assert_cmpint (count, ==, 1);
+	check_nth_occurrence (context1, 1, 4, 6);
+
+	count = gtk_source_search_context_get_occurrences_count (context2);
+	g_assert_cmpint (count, >=, 1);
+	check_nth_occurrence (context2, count, 2, 3);
+
+	g_object_unref (source_buffer);
+	g_object_unref (settings1);
+	g_object_unref (settings2);
+	g_object_unref (context1);
+	g_object_unref (context2);
+}
+
+static void
+test_regex_incremental_scan (void)
+{
+	GtkSourceBuffer *source_buffer = gtk_source_buffer_new (NULL);
+	GtkTextBuffer *text_buffer = GTK_TEXT_BUFFER (source_buffer);
+	GtkSourceSearchSettings *settings = gtk_source_search_settings_new ();
+	GtkSourceSearchContext *context = gtk_source_search_context_new (source_buffer, settings);
+	GtkTextIter start;
+	GtkTextIter end;
+	gint count;
+
+	gtk_text_buffer_set_text (text_buffer, "aaa\n12\n123\naa", -1);
+
+	/* A match can not span several lines, only the modified line is
+	 * re-scanned.
+	 */
+	gtk_source_search_settings_set_regex_enabled (settings, TRUE);
+	gtk_source_search_settings_set_search_text (settings, "(aa)+");
+	flush_queue ();
+
+	count = gtk_source_search_context_get_occurrences_count (context);
+	g_assert_cmpint (count, ==, 2);
+	check_nth_occurrence (context, 1, 0, 2);
+	check_nth_occurrence (context, 2, 11, 13);
+
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &start, 3);
+	gtk_text_buffer_insert (text_buffer, &start, "a", -1);
+	flush_queue ();
+
+	count = gtk_source_search_context_get_occurrences_count (context);
+	g_assert_cmpint (count, ==, 2);
+	check_nth_occurrence (context, 1, 0, 4);
+	check_nth_occurrence (context, 2, 12, 14);
+
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &start, 2);
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &end, 5);
+	gtk_text_buffer_delete (text_buffer, &start, &end);
+	flush_queue ();
+
+	/* "aa12" */
+	count = gtk_source_search_context_get_occurrences_count (context);
+	g_assert_cmpint (count, ==, 2);
+	check_nth_occurrence (context, 1, 0, 2);
+	check_nth_occurrence (context, 2, 9, 11);
+
+	/* With \s, a match can span several lines. */
+	gtk_source_search_settings_set_search_text (settings, "2\\s+1");
+	flush_queue ();
+
+	count = gtk_source_search_context_get_occurrences_count (context);
+	g_assert_cmpint (count, ==, 1);
+	check_nth_occurrence (context, 1, 3, 6);
+
+	gtk_text_buffer_get_start_iter (text_buffer, &start);
+	gtk_text_buffer_insert (text_buffer, &start, "2\n\n", -1);
+	flush_queue ();
+
+	count = gtk_source_search_context_get_occurrences_count (context);
+	g_assert_cmpint (count, ==, 1);
+	check_nth_occurrence (context, 1, 6, 9);
+
+	/* The insertion on the third line creates a match starting on the
+	 * first line.
+	 */
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &start, 3);
+	gtk_text_buffer_insert (text_buffer, &start, "1", -1);
+	flush_queue ();
+
+	count = gtk_source_search_context_get_occurrences_count (context);
+	g_assert_cmpint (count, ==, 2);
+	check_nth_occurrence (context, 1, 0, 4);
+	check_nth_occurrence (context, 2, 7, 10);
+
+	/* A match can contain one line terminator, only the modified lines
+	 * and the lines around them are re-scanned.
+	 */
+	gtk_source_search_settings_set_search_text (settings, "2\\n1");
+	flush_queue ();
+
+	count = gtk_source_search_context_get_occurrences_count (context);
+	g_assert_cmpint (count, ==, 1);
+	check_nth_occurrence (context, 1, 7, 10);
+
+	/* The deletion on the second line creates a match starting on the
+	 * first line.
+	 */
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &start, 2);
+	gtk_text_buffer_get_iter_at_offset (text_buffer, &end, 3);
+	gtk_text_buffer_delete (text_buffer, &start, &end);
+	flush_queue ();
+
+	count = gtk_source_search_context_get_occurrences_count (context);
+	g_assert_cmpint (count, ==, 2);
+	check_nth_occurrence (context, 1, 0, 3);
+	check_nth_occurrence (context, 2, 6, 9);
+
+	g_object_unref (source_buffer);
+	g_object_unref (settings);
+	g_object_unref (context);
+}
+
 static void
 test_destroy_buffer_during_search (void)
 {
@@ -1634,12 +2140,19 @@ main (int argc, char **argv)
 	g_test_add_func ("/Search/highlight", test_highlight);
 	g_test_add_func ("/Search/get-search-text", test_get_search_text);
 	g_test_add_func ("/Search/occurrence-position", test_occurrence_position);
+	g_test_add_func ("/Search/use-text-tags", test_use_text_tags);
+	g_test_add_func ("/Search/search-region", test_search_region);
 	g_test_add_func ("/Search/replace", test_replace);
 	g_test_add_func ("/Search/replace_all", test_replace_all);
+	g_test_add_func ("/Search/held-changes", test_held_changes);
 	g_test_add_func ("/Search/regex/basics", test_regex_basics);
 	g_test_add_func ("/Search/regex/at-word-boundaries", test_regex_at_word_boundaries);
 	g_test_add_func ("/Search/regex/look-behind", test_regex_look_behind);
 	g_test_add_func ("/Search/regex/look-ahead", test_regex_look_ahead);
+	g_test_add_func ("/Search/regex/shared-scan", test_regex_shared_scan);
+	g_test_add_func ("/Search/shared-scan", test_shared_scan);
+	g_test_add_func ("/Search/shared-scan-matches", test_shared_scan_matches);
+	g_test_add_func ("/Search/regex/incremental-scan", test_regex_incremental_scan);
 	g_test_add_func ("/Search/destroy-buffer-during-search", test_destroy_buffer_during_search);
 
 	return g_test_run ();
@@ -19,8 +19,10 @@
 
 #include "config.h"
 
+#include <glib/gstdio.h>
 #include <gtksourceview/gtksource.h>
 #include <gtksourceview/gtksourceinit.h>
+#include "gtksourceview/gtksourcesnippetmanager-private.h"
 
 static const gchar *data_search_path[] = {
 	TOP_SRCDIR"/data/snippets",
@@ -152,12 +154,296 @@ test_snippet_parse_issue_252 (void)
 	g_assert_finalize_object (snippet);
 }
 
+static void
+check_triggers (GListModel  *model,
+                const char **triggers)
+{
+	guint n_items = g_list_model_get_n_items (model);
+
+	g_assert_cmpint (n_items, ==, g_strv_length ((char **)triggers));
+
+	for (guint i = 0; i < n_items; i++)
+	{
+		GtkSourceSnippet *snippet = g_list_model_get_item (model, i);
+
+		g_assert_cmpstr (gtk_source_snippet_get_trigger (snippet), ==, triggers[i]);
+		g_object_unref (snippet);
+	}
+}
+
+static void
+test_snippet_matching (void)
+{
+	const char *all[] = { "apache2", "gpl3", "lgpl2", "lgpl3", "mit", NULL };
+	const char *lgpl[] = { "lgpl2", "lgpl3", NULL };
+	const char *none[] = { NULL };
+	GtkSourceSnippetManager *mgr;
+	GtkSourceSnippet *snippet;
+	GListModel *model;
+
+	mgr = g_object_new (GTK_SOURCE_TYPE_SNIPPET_MANAGER, NULL);
+	gtk_source_snippet_manager_set_search_path (mgr, data_search_path);
+
+	model = gtk_source_snippet_manager_list_matching (mgr, NULL, "c", NULL);
+	check_triggers (model, all);
+	g_object_unref (model);
+
+	model = gtk_source_snippet_manager_list_matching (mgr, NULL, "python", "lgpl");
+	check_triggers (model, lgpl);
+	g_object_unref (model);
+
+	model = gtk_source_snippet_manager_list_matching (mgr, "Licenses", "rust", "lgpl");
+	check_triggers (model, lgpl);
+	g_object_unref (model);
+
+	model = gtk_source_snippet_manager_list_matching (mgr, "Licenses", "rust", "lgpl4");
+	check_triggers (model, none);
+	g_object_unref (model);
+
+	model = gtk_source_snippet_manager_list_matching (mgr, "Unknown", "c", NULL);
+	check_triggers (model, none);
+	g_object_unref (model);
+
+	model = gtk_source_snippet_manager_list_matching (mgr, NULL, "unknown", NULL);
+	check_triggers (model, none);
+	g_object_unref (model);
+
+	/* Once per language */
+	model = gtk_source_snippet_manager_list_matching (mgr, NULL, NULL, "gpl");
+	g_assert_cmpint (g_list_model_get_n_items (model), ==, 11);
+	g_object_unref (model);
+
+	snippet = gtk_source_snippet_manager_get_snippet (mgr, "Licenses", NULL, "mit");
+	g_assert_nonnull (snippet);
+	g_assert_cmpstr (gtk_source_snippet_get_trigger (snippet), ==, "mit");
+	g_assert_finalize_object (snippet);
+
+	g_assert_null (gtk_source_snippet_manager_get_snippet (mgr, NULL, "c", "gpl"));
+	g_assert_null (gtk_source_snippet_manager_get_snippet (mgr, "Unknown", "c", "mit"));
+
+	g_assert_finalize_object (mgr);
+}
+
+static gchar *
+get_cache_dir (void)
+{
+	return g_build_filename (g_get_user_cache_dir (), "gtksourceview-5", "snippets", NULL);
+}
+
+/* Returns the only cache file, or %NULL if there is none. */
+static gchar *
+get_cache_filename (void)
+{
+	gchar *cache_dir = get_cache_dir ();
+	gchar *cache_filename = NULL;
+	const gchar *name;
+	GDir *dir;
+
+	dir = g_dir_open (cache_dir, 0, NULL);
+
+	if (dir != NULL)
+	{
+		if ((name = g_dir_read_name (dir)) != NULL)
+			cache_filename = g_build_filename (cache_dir, name, NULL);
+
+		g_assert_null (g_dir_read_name (dir));
+		g_dir_close (dir);
+	}
+
+	g_free (cache_dir);
+
+	return cache_filename;
+}
+
+static void
+remove_cache (void)
+{
+	gchar *cache_filename = get_cache_filename ();
+	gchar *cache_dir = get_cache_dir ();
+
+	if (cache_filename != NULL)
+		g_unlink (cache_filename);
+
+	g_rmdir (cache_dir);
+
+	g_free (cache_filename);
+	g_free (cache_dir);
+}
+
+/* Returns the number of files which were not taken from the cache. */
+static guint
+load_snippets_again (void)
+{
+	const char *triggers[] = { "apache2", "gpl3", "lgpl2", "lgpl3", "mit", NULL };
+	GtkSourceSnippetManager *mgr;
+	GtkSourceSnippet *snippet;
+	const gchar **groups;
+	GListModel *model;
+	guint n_files_read;
+
+	mgr = g_object_new (GTK_SOURCE_TYPE_SNIPPET_MANAGER, NULL);
+	gtk_source_snippet_manager_set_search_path (mgr, data_search_path);
+
+	/* Only loads the snippets for Python. */
+	snippet = gtk_source_snippet_manager_get_snippet (mgr, NULL, "python", "mit");
+	g_assert_nonnull (snippet);
+	g_assert_cmpstr (gtk_source_snippet_get_name (snippet), ==, "MIT");
+	g_assert_cmpint (gtk_source_snippet_get_n_chunks (snippet), >, 0);
+	g_assert_finalize_object (snippet);
+
+	model = gtk_source_snippet_manager_list_matching (mgr, NULL, "rust", NULL);
+	check_triggers (model, triggers);
+	g_object_unref (model);
+
+	/* Loads everything. */
+	groups = gtk_source_snippet_manager_list_groups (mgr);
+	g_assert_cmpint (1, ==, g_strv_length ((gchar **)groups));
+	g_assert_cmpstr (groups[0], ==, "Licenses");
+	g_free (groups);
+
+	n_files_read = _gtk_source_snippet_manager_get_n_files_read (mgr);
+
+	/* Saves the cache. */
+	g_assert_finalize_object (mgr);
+
+	return n_files_read;
+}
+
+static void
+test_snippet_cache (void)
+{
+	gchar *cache_filename;
+
+	remove_cache ();
+
+	/* Parsed and saved. */
+	g_assert_cmpuint (load_snippets_again (), >, 0);
+	cache_filename = get_cache_filename ();
+	g_assert_nonnull (cache_filename);
+
+	/* Loaded from the cache. */
+	g_assert_cmpuint (load_snippets_again (), ==, 0);
+
+	/* A corrupted cache is ignored and saved again. */
+	g_assert_true (g_file_set_contents (cache_filename, "garbage", -1, NULL));
+	g_assert_cmpuint (load_snippets_again (), >, 0);
+	g_assert_cmpuint (load_snippets_again (), ==, 0);
+
+	remove_cache ();
+	g_free (cache_filename);
+}
+
+static const gchar *
+get_trigger_for_c (const gchar * const *search_path,
+                   guint               *n_files_read)
+{
+	GtkSourceSnippetManager *mgr;
+	GtkSourceSnippet *snippet;
+	GListModel *model;
+	const gchar *trigger;
+
+	mgr = g_object_new (GTK_SOURCE_TYPE_SNIPPET_MANAGER, NULL);
+	gtk_source_snippet_manager_set_search_path (mgr, search_path);
+
+	model = gtk_source_snippet_manager_list_matching (mgr, "Test", "c", NULL);
+	g_assert_cmpuint (g_list_model_get_n_items (model), ==, 1);
+	snippet = g_list_model_get_item (model, 0);
+	trigger = g_intern_string (gtk_source_snippet_get_trigger (snippet));
+	g_object_unref (snippet);
+	g_object_unref (model);
+
+	*n_files_read = _gtk_source_snippet_manager_get_n_files_read (mgr);
+	g_assert_finalize_object (mgr);
+
+	return trigger;
+}
+
+static void
+test_snippet_cache_stamp (void)
+{
+	const gchar *search_path[2] = { NULL, NULL };
+	const gchar *format = "<snippets _group=\"Test\">\n"
+	                      "  <snippet _name=\"Test\" trigger=\"%s\">\n"
+	                      "    <text languages=\"c\"><![CDATA[x]]></text>\n"
+	                      "  </snippet>\n"
+	                      "</snippets>\n";
+	GFileInfo *info;
+	GFile *file;
+	gchar *snippets_dir;
+	gchar *filename;
+	gchar *contents;
+	guint64 mtime;
+	guint32 usec;
+	guint n_files_read;
+
+	remove_cache ();
+
+	snippets_dir = g_dir_make_tmp ("test-snippets-XXXXXX", NULL);
+	g_assert_nonnull (snippets_dir);
+	filename = g_build_filename (snippets_dir, "test.snippets", NULL);
+	search_path[0] = snippets_dir;
+
+	contents = g_strdup_printf (format, "aaa");
+	g_assert_true (g_file_set_contents (filename, contents, -1, NULL));
+	g_free (contents);
+
+	g_assert_cmpstr (get_trigger_for_c (search_path, &n_files_read), ==, "aaa");
+	g_assert_cmpuint (n_files_read, ==, 2);
+	g_assert_cmpstr (get_trigger_for_c (search_path, &n_files_read), ==, "aaa");
+	g_assert_cmpuint (n_files_read, ==, 0);
+
+	/* Rewrite the file with the same size and the same modification
+	 * time in seconds: only the sub-second part of the time changes.
+	 */
+	file = g_file_new_for_path (filename);
+	info = g_file_query_info (file,
+	                          G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+	                          G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+	                          G_FILE_QUERY_INFO_NONE,
+	                          NULL,
+	                          NULL);
+	g_assert_nonnull (info);
+	mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+	usec = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+	g_object_unref (info);
+
+	contents = g_strdup_printf (format, "bbb");
+	g_assert_true (g_file_set_contents (filename, contents, -1, NULL));
+	g_free (contents);
+
+	info = g_file_info_new ();
+	g_file_info_set_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED, mtime);
+	g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC, (usec + 1) % G_USEC_PER_SEC);
+	g_assert_true (g_file_set_attributes_from_info (file, info, G_FILE_QUERY_INFO_NONE, NULL, NULL));
+	g_object_unref (info);
+
+	g_assert_cmpstr (get_trigger_for_c (search_path, &n_files_read), ==, "bbb");
+	g_assert_cmpuint (n_files_read, ==, 2);
+	g_assert_cmpstr (get_trigger_for_c (search_path, &n_files_read), ==, "bbb");
+	g_assert_cmpuint (n_files_read, ==, 0);
+
+	remove_cache ();
+	g_unlink (filename);
+	g_rmdir (snippets_dir);
+
+	g_object_unref (file);
+	g_free (filename);
+	g_free (snippets_dir);
+}
+
 gint
 main (gint argc,
       gchar *argv[])
 {
+	gchar *cache_home;
+	gchar *cache_dir;
 	int ret;
 
+	/* Do not read or write the user cache. */
+	cache_home = g_dir_make_tmp ("test-snippets-XXXXXX", NULL);
+	g_assert_nonnull (cache_home);
+	g_setenv ("XDG_CACHE_HOME", cache_home, TRUE);
+
 	gtk_init ();
 	gtk_source_init ();
 	g_test_init (&argc, &argv, NULL);
@@ -166,8 +452,20 @@ main (gint argc,
 	g_test_add_func ("/SourceView/Snippets/new-parsed", test_snippet_parse);
 	g_test_add_func ("/SourceView/Snippets/$0-in-middle", test_snippet_parse_issue_252);
 	g_test_add_func ("/SourceView/Snippets/snippet-fetching", test_snippet_fetching);
+	g_test_add_func ("/SourceView/Snippets/snippet-matching", test_snippet_matching);
+	g_test_add_func ("/SourceView/Snippets/snippet-cache", test_snippet_cache);
+	g_test_add_func ("/SourceView/Snippets/snippet-cache-stamp", test_snippet_cache_stamp);
 	ret = g_test_run ();
 
+	remove_cache ();
+
+	cache_dir = g_build_filename (cache_home, "gtksourceview-5", NULL);
+	g_rmdir (cache_dir);
+	g_rmdir (cache_home);
+
+	g_free (cache_dir);
+	g_free (cache_home);
+
 	gtk_source_finalize ();
 
 	return ret;
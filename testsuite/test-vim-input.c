@@ -30,6 +30,7 @@
 #include <gtksourceview/vim/gtksourcevimstate.h>
 
 #include "gtksourceview/gtksourcelanguagemanager-private.h"
+#include "gtksourceview/gtksourceview-private.h"
 
 static void
 run_test (const char *text,
@@ -59,7 +60,6 @@ run_test (const char *text,
 
 	for (const char *c = input; *c; c = g_utf8_next_char (c))
 	{
-		GtkSourceVimState *current = gtk_source_vim_state_get_current (GTK_SOURCE_VIM_STATE (vim));
 		gunichar ch = g_utf8_get_char (c);
 		char string[16] = {0};
 		GdkModifierType mods = 0;
@@ -105,7 +105,8 @@ run_test (const char *text,
 			keyval = gdk_unicode_to_keyval (ch);
 		}
 
-		if (!GTK_SOURCE_VIM_STATE_GET_CLASS (current)->handle_keypress (current, keyval, 0, mods, string))
+		/* Go through the toplevel so that macros are recorded */
+		if (!GTK_SOURCE_VIM_STATE_GET_CLASS (vim)->handle_keypress (GTK_SOURCE_VIM_STATE (vim), keyval, 0, mods, string))
 		{
 			gtk_text_buffer_insert_at_cursor (GTK_TEXT_BUFFER (buffer), string, -1);
 		}
@@ -154,6 +155,94 @@ run_test (const char *text,
 	g_assert_finalize_object (G_OBJECT (view));
 }
 
+/* Like run_test(), but in @view, and the keys that the Vim emulation does
+ * not handle go through the view as its key controller would, so that a
+ * macro replaying them behaves the same.
+ */
+static void
+run_replay_test (GtkSourceView *view,
+                 const char    *text,
+                 const char    *input,
+                 const char    *expected)
+{
+	GtkSourceBuffer *buffer = GTK_SOURCE_BUFFER (gtk_text_view_get_buffer (GTK_TEXT_VIEW (view)));
+	GtkSourceVim *vim = gtk_source_vim_new (view);
+	GtkSourceVimState *registers = gtk_source_vim_state_get_registers (GTK_SOURCE_VIM_STATE (vim));
+	GtkTextIter begin, end;
+	GtkTextIter insert;
+	GString *expected_text;
+	int cursor_offset = -1;
+	char *ret;
+
+	gtk_source_vim_registers_reset (GTK_SOURCE_VIM_REGISTERS (registers));
+
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), text, -1);
+	gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (buffer), &begin, &end);
+	gtk_text_buffer_select_range (GTK_TEXT_BUFFER (buffer), &begin, &begin);
+
+	for (const char *c = input; *c; c = g_utf8_next_char (c))
+	{
+		gunichar ch = g_utf8_get_char (c);
+		char string[16] = {0};
+		guint keyval;
+
+		string[g_unichar_to_utf8 (ch, string)] = 0;
+
+		if (ch == '\033')
+		{
+			g_strlcpy (string, "^[", sizeof string);
+			keyval = GDK_KEY_Escape;
+		}
+		else if (ch == '\n')
+		{
+			keyval = GDK_KEY_Return;
+		}
+		else if (ch == '\t')
+		{
+			keyval = GDK_KEY_Tab;
+		}
+		else
+		{
+			keyval = gdk_unicode_to_keyval (ch);
+		}
+
+		if (!GTK_SOURCE_VIM_STATE_GET_CLASS (vim)->handle_keypress (GTK_SOURCE_VIM_STATE (vim), keyval, 0, 0, string) &&
+		    !_gtk_source_view_replay_key (view, keyval, 0, string))
+		{
+			gtk_text_buffer_insert_at_cursor (GTK_TEXT_BUFFER (buffer), string, -1);
+		}
+	}
+
+	expected_text = g_string_new (NULL);
+	for (const char *c = expected; *c; c = g_utf8_next_char (c))
+	{
+		gunichar ch = g_utf8_get_char (c);
+
+		if (ch == '|')
+			cursor_offset = g_utf8_strlen (expected_text->str, expected_text->len);
+		else
+			g_string_append_unichar (expected_text, ch);
+	}
+
+	gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (buffer), &begin, &end);
+	ret = gtk_text_iter_get_slice (&begin, &end);
+	g_assert_cmpstr (ret, ==, expected_text->str);
+	g_free (ret);
+
+	if (cursor_offset >= 0)
+	{
+		gtk_text_buffer_get_iter_at_mark (GTK_TEXT_BUFFER (buffer),
+		                                  &insert,
+		                                  gtk_text_buffer_get_insert (GTK_TEXT_BUFFER (buffer)));
+		g_assert_cmpint (gtk_text_iter_get_offset (&insert), ==, cursor_offset);
+	}
+
+	g_string_free (expected_text, TRUE);
+
+	g_assert_finalize_object (G_OBJECT (vim));
+	g_assert_finalize_object (G_OBJECT (view));
+}
+
 static void
 test_yank (void)
 {
@@ -397,12 +486,60 @@ test_command_bar (void)
 	run_test ("", ":nohlsearch\n", "");
 }
 
+static void
+test_global (void)
+{
+	run_test ("a\nDEBUG x\nb\nDEBUG y\n", ":g/DEBUG/d\n", "a\nb\n");
+	run_test ("a\nDEBUG x\nb\n", ":v/DEBUG/d\n", "DEBUG x\n");
+	run_test ("a\nb\n", ":g!/a/d\n", "a\n");
+	run_test ("x1\nx2\nx3\nx4", ":2,3g/x/d\n", "x1\nx4");
+	run_test ("a\nb\na", ":g/a/d\n", "b");
+	run_test ("abc", ":g/z/d\n", "abc");
+	run_test ("a1\nb1\na2\n", ":g/^a/s/[0-9]/N/\n", "aN\nb1\naN\n");
+	run_test ("a/1\nb/1\n", ":g#a/#s/1/2/\n", "a/2\nb/1\n");
+	/* The lines joined by a previous substitution are skipped */
+	run_test ("a\na\nb\n", ":g/a/s/a\\n/X/\n", "Xa\nb\n");
+	run_test ("a\na\nc\n", ":g/a/s/\\n.*//\n", "a\nc\n");
+	/* With the other line terminators of GtkTextBuffer */
+	run_test ("a\rb\ra\r", ":g/a/d\n", "b\r");
+	run_test ("a\r\nb\r\nc", ":g/^b$/d\n", "a\r\nc");
+}
+
 static void
 test_visual (void)
 {
 	run_test ("0123456789", "3lvllohhx", "06789");
 }
 
+static void
+test_macro (void)
+{
+	run_test ("a\nb\nc\n", "qaI- \033jq2@a", "- a\n- b\n- c\n|");
+	run_test ("1\n2\n3\n4", "qqA;\033jq@q@@", "1;\n2;\n3;\n|4");
+	run_test ("1\n2\n3", "qaxjq10@a", "\n\n|");
+	run_test ("abc", "qaxqqAxq@a", "|");
+	run_test ("abc", "qaq@a", "|abc");
+	run_test ("abc", "qaxq\"ap", "bxc");
+	run_test ("x", "qaA!\033q\"ap", "x!A!\033");
+}
+
+static void
+test_macro_view_keys (void)
+{
+	GtkSourceView *view;
+
+	/* Return in a replayed macro auto-indents like when typed */
+	view = GTK_SOURCE_VIEW (g_object_ref_sink (gtk_source_view_new ()));
+	gtk_source_view_set_auto_indent (view, TRUE);
+	run_replay_test (view, "  a", "qaA\nb\033q@a", "  a\n  b\n  |b");
+
+	/* And Tab inserts spaces */
+	view = GTK_SOURCE_VIEW (g_object_ref_sink (gtk_source_view_new ()));
+	gtk_source_view_set_insert_spaces_instead_of_tabs (view, TRUE);
+	gtk_source_view_set_tab_width (view, 4);
+	run_replay_test (view, "a\nb", "qaI\t\033jq@a", "    a\n   | b");
+}
+
 int
 main (int argc,
       char *argv[])
@@ -438,7 +575,10 @@ main (int argc,
 	g_test_add_func ("/GtkSourceView/vim-input/operator", test_operator);
 	g_test_add_func ("/GtkSourceView/vim-input/search-and-replace", test_search_and_replace);
 	g_test_add_func ("/GtkSourceView/vim-input/command-bar", test_command_bar);
+	g_test_add_func ("/GtkSourceView/vim-input/global", test_global);
 	g_test_add_func ("/GtkSourceView/vim-input/visual", test_visual);
+	g_test_add_func ("/GtkSourceView/vim-input/macro", test_macro);
+	g_test_add_func ("/GtkSourceView/vim-input/macro-view-keys", test_macro_view_keys);
 	ret = g_test_run ();
 	gtk_source_finalize ();
 	return ret;